@@ -38,6 +38,7 @@
 #include <grpc++/client_context.h>
 #include <grpc++/create_channel.h>
 #include <grpc++/security/credentials.h>
+#include <grpc++/support/channel_arguments.h>
 #include <grpc/grpc.h>
 #include <grpc/support/log.h>
 
@@ -55,6 +56,7 @@
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/client_profile.h"
 #include "src/main/cpp/global_variables.h"
 #include "src/main/cpp/option_processor.h"
 #include "src/main/cpp/startup_options.h"
@@ -63,11 +65,13 @@
 #include "src/main/cpp/util/exit_code.h"
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/md5.h"
 #include "src/main/cpp/util/numbers.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/path_platform.h"
 #include "src/main/cpp/util/port.h"
 #include "src/main/cpp/util/strings.h"
+#include "src/main/cpp/util/thread_pool.h"
 #include "src/main/cpp/workspace_layout.h"
 #include "third_party/ijar/zip.h"
 
@@ -160,8 +164,15 @@ class BlazeServer {
   virtual ~BlazeServer() {}
 
   // Acquire a lock for the server running in this output base. Returns the
-  // number of milliseconds spent waiting for the lock.
-  uint64_t AcquireLock();
+  // number of milliseconds spent waiting for the lock. A shared lock lets the
+  // client use a running server, but not start or stop one.
+  uint64_t AcquireLock(bool shared);
+
+  // Exchanges the shared lock taken by AcquireLock() for an exclusive one. The
+  // lock is released in between, so anything learned about the server under
+  // the shared lock is stale afterwards. Returns the number of milliseconds
+  // spent waiting for the lock.
+  uint64_t UpgradeLock();
 
   // Whether there is an active connection to a server.
   bool Connected() const { return connected_; }
@@ -185,6 +196,13 @@ class BlazeServer {
   // is in connected state.
   virtual void KillRunningServer() = 0;
 
+  // Disconnects from an existing server and asks it to shut down, leaving the
+  // files in its server directory for the next server to overwrite. Does not
+  // wait for the server process to exit; its PID goes to
+  // globals->exiting_server_pid. Only call this when this object is in
+  // connected state.
+  virtual void ShutDownRunningServerForRestart() = 0;
+
   // Cancel the currently running command. If there is no command currently
   // running, the result is unspecified. When called, this object must be in
   // connected state.
@@ -205,10 +223,15 @@ static BlazeServer *blaze_server;
 // call exit(2) or _exit(2) (attributed with ATTRIBUTE_NORETURN) meaning we have
 // to delete the objects before those.
 
-uint64_t BlazeServer::AcquireLock() {
-  return blaze::AcquireLock(globals->options->output_base,
-                            globals->options->batch,
-                            globals->options->block_for_lock, &blaze_lock_);
+uint64_t BlazeServer::AcquireLock(bool shared) {
+  return blaze::AcquireLock(
+      globals->options->output_base, globals->options->batch,
+      globals->options->block_for_lock, shared, &blaze_lock_);
+}
+
+uint64_t BlazeServer::UpgradeLock() {
+  blaze::ReleaseLock(&blaze_lock_);
+  return AcquireLock(false);
 }
 
 // Communication method that uses gRPC on a socket bound to localhost. More
@@ -222,11 +245,15 @@ class GrpcBlazeServer : public BlazeServer {
   virtual void Disconnect();
   virtual unsigned int Communicate();
   virtual void KillRunningServer();
+  virtual void ShutDownRunningServerForRestart();
   virtual void Cancel();
 
  private:
   enum CancelThreadAction { NOTHING, JOIN, CANCEL, COMMAND_ID_RECEIVED };
 
+  // Runs the shutdown command on the server, with the given extra arguments.
+  void SendShutdown(const vector<string> &args);
+
   std::unique_ptr<command_server::CommandServer::Stub> client_;
   std::string request_cookie_;
   std::string response_cookie_;
@@ -356,9 +383,70 @@ class GetInstallKeyFileProcessor : public PureZipExtractorProcessor {
   string *install_base_key_;
 };
 
+// Returns the file caching the install MD5 and the embedded file names of the
+// Blaze binary at self_path, so that the binary need not be scanned on every
+// invocation. The cache is keyed by the binary's path; its content is the
+// GetFileStamp() of the binary it was computed from, the install MD5 and the
+// file names, one per line.
+static string GetClientCacheFile(const string &output_user_root,
+                                 const string &self_path) {
+  return blaze::GetHashedBaseDir(
+      blaze_util::JoinPath(output_user_root, "install/_client_cache"),
+      self_path);
+}
+
+// Populates globals->install_md5 and globals->extracted_binaries from the
+// cache file, if it was written for the file stamp. Returns false on a miss.
+static bool ReadClientCache(const string &cache_file, const string &stamp) {
+  string content;
+  if (!blaze_util::ReadFile(cache_file, &content)) {
+    return false;
+  }
+  vector<string> lines = blaze_util::Split(content, '\n');
+  if (lines.size() < 2 || lines[0] != stamp || lines[1].size() != 32) {
+    return false;
+  }
+  globals->install_md5 = lines[1];
+  globals->extracted_binaries.assign(lines.begin() + 2, lines.end());
+  return true;
+}
+
+// Writes the cache file if the install directory exists, that is once the
+// binary has been extracted. Failing to write it is not an error.
+static void WriteClientCache(const string &output_user_root,
+                             const string &cache_file, const string &stamp) {
+  if (!blaze_util::IsDirectory(
+          blaze_util::JoinPath(output_user_root, "install")) ||
+      !blaze_util::MakeDirectories(blaze_util::Dirname(cache_file), 0777)) {
+    return;
+  }
+  string content = stamp + "\n" + globals->install_md5 + "\n";
+  for (const auto &file : globals->extracted_binaries) {
+    content += file + "\n";
+  }
+  // Write to a temporary file and rename it, so that a concurrent client never
+  // reads a partial cache file.
+  string tmp_file = cache_file + ".tmp." + blaze::GetProcessIdAsString();
+  if (!blaze_util::WriteFile(content, tmp_file) ||
+      blaze_util::RenameDirectory(tmp_file, cache_file) !=
+          blaze_util::kRenameDirectorySuccess) {
+    blaze_util::UnlinkPath(tmp_file);
+  }
+}
+
 // Populates globals->install_md5 and globals->extracted_binaries by reading the
-// ZIP entries in the Blaze binary.
-static void ComputeInstallMd5AndNoteAllFiles(const string &self_path) {
+// ZIP entries in the Blaze binary, or from the cache written by a previous
+// invocation of the same binary.
+static void ComputeInstallMd5AndNoteAllFiles(const string &output_user_root,
+                                             const string &self_path) {
+  ScopedClientPhase phase(&globals->client_profile, "ComputeInstallMd5");
+  const string stamp = blaze::GetFileStamp(self_path);
+  const string cache_file = GetClientCacheFile(output_user_root, self_path);
+  if (!stamp.empty() && ReadClientCache(cache_file, stamp)) {
+    BAZEL_LOG(INFO) << "Read the install MD5 from " << cache_file;
+    return;
+  }
+
   NoteAllFilesZipProcessor note_all_files_processor(
       &globals->extracted_binaries);
   GetInstallKeyFileProcessor install_key_processor(&globals->install_md5);
@@ -380,6 +468,10 @@ static void ComputeInstallMd5AndNoteAllFiles(const string &self_path) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "Failed to find install_base_key's in zip file";
   }
+
+  if (!stamp.empty()) {
+    WriteClientCache(output_user_root, cache_file, stamp);
+  }
 }
 
 // Escapes colons by replacing them with '_C' and underscores by replacing them
@@ -398,6 +490,24 @@ string GetEmbeddedBinariesRoot(const string &install_base) {
 }
 
 // Returns the JVM command argument array.
+// Returns the directory that --experimental_server_checkpoint keeps the
+// checkpoint of the server of this output base in.
+static string GetServerCheckpointDir() {
+  return blaze::GetHashedBaseDir(
+      blaze_util::JoinPath(globals->options->output_user_root, "checkpoint"),
+      globals->options->output_base);
+}
+
+// Returns true if --experimental_server_checkpoint is set and the server's JDK
+// can take checkpoints; such JDKs come with their own copy of CRIU. Other JVMs
+// would refuse to start with the CRaC flags.
+static bool IsServerCheckpointEnabled() {
+  return globals->options->server_checkpoint &&
+         blaze_util::PathExists(blaze_util::JoinPath(
+             blaze_util::Dirname(blaze_util::Dirname(globals->jvm_path)),
+             "lib/criu"));
+}
+
 static vector<string> GetArgumentArray(
     const WorkspaceLayout *workspace_layout) {
   vector<string> result;
@@ -480,6 +590,12 @@ static vector<string> GetArgumentArray(
   }
   result.insert(result.end(), user_options.begin(), user_options.end());
 
+  if (IsServerCheckpointEnabled()) {
+    // Lets MaybeCheckpointServer() checkpoint the server.
+    result.push_back("-XX:CRaCCheckpointTo=" +
+                     blaze_util::PathAsJvmFlag(GetServerCheckpointDir()));
+  }
+
   globals->options->AddJVMArgumentSuffix(real_install_dir,
                                          globals->ServerJarPath(), &result);
 
@@ -517,6 +633,18 @@ static vector<string> GetArgumentArray(
                    blaze_util::ConvertPath(globals->workspace));
   result.push_back("--default_system_javabase=" + GetSystemJavabase());
 
+  // The resources available for local actions. Unlike the server's own
+  // detection, these take the limits of a Linux container into account.
+  const uint64_t available_memory = GetAvailableMemoryBytes();
+  if (available_memory > 0) {
+    result.push_back("--host_available_memory_mb=" +
+                     ToString(available_memory >> 20));
+  }
+  const unsigned int available_cpus = GetAvailableCpuCount();
+  if (available_cpus > 0) {
+    result.push_back("--host_available_cpus=" + ToString(available_cpus));
+  }
+
   if (!globals->options->server_jvm_out.empty()) {
     result.push_back("--server_jvm_out=" + globals->options->server_jvm_out);
   }
@@ -538,6 +666,21 @@ static vector<string> GetArgumentArray(
   }
   result.push_back("--experimental_oom_more_eagerly_threshold=" +
                    ToString(globals->options->oom_more_eagerly_threshold));
+  if (globals->options->idle_shutdown_on_memory_pressure) {
+    result.push_back("--experimental_idle_shutdown_on_memory_pressure");
+  } else {
+    result.push_back("--noexperimental_idle_shutdown_on_memory_pressure");
+  }
+  if (globals->options->unix_socket) {
+    result.push_back("--experimental_unix_socket");
+  } else {
+    result.push_back("--noexperimental_unix_socket");
+  }
+  if (globals->options->posix_spawn) {
+    result.push_back("--experimental_posix_spawn");
+  } else {
+    result.push_back("--noexperimental_posix_spawn");
+  }
 
   if (globals->options->write_command_log) {
     result.push_back("--write_command_log");
@@ -660,9 +803,64 @@ static void GoToWorkspace(const WorkspaceLayout *workspace_layout) {
   }
 }
 
-// Starts the Blaze server.
-static int StartServer(const WorkspaceLayout *workspace_layout,
-                        BlazeServerStartup **server_startup) {
+static bool AreStartupOptionsDifferent(
+    const vector<string> &running_server_args,
+    const vector<string> &requested_args);
+
+// Returns true if --experimental_server_checkpoint left a checkpoint of a
+// server with the given arguments to restore.
+static bool CanRestoreServer(const vector<string> &jvm_args_vector) {
+  const string checkpoint_dir = GetServerCheckpointDir();
+  string joined_arguments;
+  // CRIU writes its inventory last, so it only exists for a whole checkpoint.
+  if (!blaze_util::PathExists(
+          blaze_util::JoinPath(checkpoint_dir, "inventory.img")) ||
+      !blaze_util::ReadFile(blaze_util::JoinPath(checkpoint_dir, "cmdline"),
+                            &joined_arguments)) {
+    return false;
+  }
+  return !AreStartupOptionsDifferent(
+      blaze_util::Split(joined_arguments, '\0'), jvm_args_vector);
+}
+
+// Removes the checkpoint of the server, e.g. because it could not be restored.
+static void DiscardServerCheckpoint() {
+  const string checkpoint_dir = GetServerCheckpointDir();
+  blaze_util::UnlinkPath(blaze_util::JoinPath(checkpoint_dir, "inventory.img"));
+  blaze_util::UnlinkPath(blaze_util::JoinPath(checkpoint_dir, "cmdline"));
+}
+
+// Starts the Blaze server, restoring it from its checkpoint if `restore`.
+// Returns whether the JVM reads `file`, a path in the install base, every time
+// it starts the server: the server jar, and the shared libraries, the module
+// image and the jars of the embedded JDK.
+static bool IsReadAtServerStartup(const string &file) {
+  static const char *const kSuffixes[] = {".jar", ".so", ".dylib", ".dll",
+                                          "/lib/modules"};
+  for (const char *suffix : kSuffixes) {
+    if (blaze_util::ends_with(file, suffix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Starts reading the files that IsReadAtServerStartup() accepts into the page
+// cache, so that after a reboot the JVM does not wait for them one small read
+// at a time. The reads go on in the background while the server starts.
+static void PrefetchInstallBase() {
+  ScopedClientPhase phase(&globals->client_profile, "PrefetchInstallBase");
+  const string embedded_binaries = blaze_util::JoinPath(
+      globals->options->install_base, "_embedded_binaries");
+  for (const string &file : globals->extracted_binaries) {
+    if (IsReadAtServerStartup(file)) {
+      PrefetchFile(blaze_util::JoinPath(embedded_binaries, file));
+    }
+  }
+}
+
+static int StartServer(const WorkspaceLayout *workspace_layout, bool restore,
+                       BlazeServerStartup **server_startup) {
   vector<string> jvm_args_vector = GetArgumentArray(workspace_layout);
   string argument_string = GetArgumentString(jvm_args_vector);
   string server_dir =
@@ -686,11 +884,47 @@ static int StartServer(const WorkspaceLayout *workspace_layout,
   // we can still print errors to the terminal.
   GoToWorkspace(workspace_layout);
 
+  if (globals->options->prefetch_install_base) {
+    PrefetchInstallBase();
+  }
+
+  if (restore) {
+    const string checkpoint_dir = GetServerCheckpointDir();
+    const vector<string> restore_args = {
+        jvm_args_vector[0],
+        "-XX:CRaCRestoreFrom=" + blaze_util::PathAsJvmFlag(checkpoint_dir)};
+    ExecuteDaemon(globals->jvm_path, restore_args, PrepareEnvironmentForJvm(),
+                  globals->jvm_log_file, globals->jvm_log_file_append,
+                  server_dir, server_startup);
+    // The server comes back with the PID it had when it was checkpointed,
+    // which its pid file watcher expects to find in the pid file.
+    string pid;
+    int server_pid;
+    if (!blaze_util::ReadFile(
+            blaze_util::JoinPath(checkpoint_dir, kServerPidFile), &pid) ||
+        !blaze_util::safe_strto32(pid, &server_pid) ||
+        !blaze_util::WriteFile(
+            pid, blaze_util::JoinPath(server_dir, kServerPidFile))) {
+      return -1;
+    }
+    return server_pid;
+  }
+
   return ExecuteDaemon(exe, jvm_args_vector, PrepareEnvironmentForJvm(),
                        globals->jvm_log_file, globals->jvm_log_file_append,
                        server_dir, server_startup);
 }
 
+// Writes the phases of the startup to --client_profile, if given.
+static void WriteClientProfile() {
+  const string &path = globals->options->client_profile;
+  if (!path.empty() &&
+      !blaze_util::WriteFile(globals->client_profile.ToJson(), path)) {
+    BAZEL_LOG(WARNING) << "Failed to write the client profile to '" << path
+                       << "': " << GetLastErrorString();
+  }
+}
+
 // Replace this process with blaze in standalone/batch mode.
 // The batch mode blaze process handles the command and exits.
 //
@@ -736,6 +970,7 @@ static void StartStandalone(const WorkspaceLayout *workspace_layout,
   string exe =
       globals->options->GetExe(globals->jvm_path, globals->ServerJarPath());
 
+  WriteClientProfile();
   {
     WithEnvVars env_obj(PrepareEnvironmentForJvm());
     ExecuteProgram(exe, jvm_args_vector);
@@ -779,15 +1014,41 @@ static int GetServerPid(const string &server_dir) {
   return result;
 }
 
+// Applies --experimental_scheduling_profile, or else --batch_cpu_scheduling
+// and --io_nice_level, to this process and thereby to the server it starts.
+static void SetSchedulingForProfile() {
+  if (globals->options->scheduling_profile == "background") {
+    SetIdleScheduling();
+  } else {
+    SetScheduling(globals->options->batch_cpu_scheduling,
+                  globals->options->io_nice_level);
+  }
+}
+
 static void SetRestartReasonIfNotSet(RestartReason restart_reason) {
   if (globals->restart_reason == NO_RESTART) {
     globals->restart_reason = restart_reason;
   }
 }
 
+// Waits for the server that ShutDownRunningServerForRestart() left exiting,
+// if any, so that nothing it still does on its way out gets in the way of the
+// command. Kills it if it does not exit within the grace period.
+static void AwaitExitingServer() {
+  if (globals->exiting_server_pid > 0 &&
+      !AwaitServerProcessTermination(globals->exiting_server_pid,
+                                     globals->options->output_base,
+                                     kPostShutdownGracePeriodSeconds)) {
+    KillServerProcess(globals->exiting_server_pid,
+                      globals->options->output_base);
+  }
+  globals->exiting_server_pid = -1;
+}
+
 // Starts up a new server and connects to it. Exits if it didn't work out.
 static void StartServerAndConnect(const WorkspaceLayout *workspace_layout,
                                   BlazeServer *server) {
+  ScopedClientPhase phase(&globals->client_profile, "StartServerAndConnect");
   string server_dir =
       blaze_util::JoinPath(globals->options->output_base, "server");
 
@@ -805,7 +1066,10 @@ static void StartServerAndConnect(const WorkspaceLayout *workspace_layout,
   // having two server instances running in the same output base is a
   // disaster.
   int server_pid = GetServerPid(server_dir);
-  if (server_pid > 0) {
+  // A server that is exiting for a restart leaves its PID file behind, but is
+  // not in the way of the next one.
+  if (server_pid > 0 && server_pid != globals->exiting_server_pid &&
+      server_pid != globals->speculative_server_pid) {
     if (VerifyServerProcess(server_pid, globals->options->output_base)) {
       if (KillServerProcess(server_pid, globals->options->output_base)) {
         BAZEL_LOG(USER) << "Killed non-responsive server process (pid="
@@ -819,11 +1083,21 @@ static void StartServerAndConnect(const WorkspaceLayout *workspace_layout,
     }
   }
 
-  SetScheduling(globals->options->batch_cpu_scheduling,
-                globals->options->io_nice_level);
-
+  bool restore = false;
   BlazeServerStartup *server_startup;
-  server_pid = StartServer(workspace_layout, &server_startup);
+  if (globals->speculative_server_startup != NULL) {
+    // Started by MaybeStartServerEarly() and booting since.
+    server_pid = globals->speculative_server_pid;
+    server_startup = globals->speculative_server_startup;
+    globals->speculative_server_pid = -1;
+    globals->speculative_server_startup = NULL;
+  } else {
+    SetSchedulingForProfile();
+
+    restore = IsServerCheckpointEnabled() &&
+              CanRestoreServer(GetArgumentArray(workspace_layout));
+    server_pid = StartServer(workspace_layout, restore, &server_startup);
+  }
 
   BAZEL_LOG(USER) << "Starting local " << globals->options->product_name
                   << " server and connecting to it...";
@@ -833,12 +1107,11 @@ static void StartServerAndConnect(const WorkspaceLayout *workspace_layout,
   auto try_until_time(std::chrono::system_clock::now() +
                       std::chrono::seconds(120));
   while (std::chrono::system_clock::now() < try_until_time) {
-    auto next_attempt_time(std::chrono::system_clock::now() +
-                           std::chrono::milliseconds(100));
     if (server->Connect()) {
       fputc('\n', stderr);
       fflush(stderr);
       delete server_startup;
+      AwaitExitingServer();
       return;
     }
 
@@ -849,7 +1122,20 @@ static void StartServerAndConnect(const WorkspaceLayout *workspace_layout,
       fflush(stderr);
     }
 
-    std::this_thread::sleep_until(next_attempt_time);
+    // Returns as soon as the server is ready to accept connections or dies.
+    server_startup->WaitForReadiness(1000);
+    if (restore && (server_pid < 0 || !server_startup->IsStillAlive())) {
+      BAZEL_LOG(WARNING) << "Could not restore the server from its checkpoint, "
+                            "starting a new one.";
+      if (server_pid > 0) {
+        KillServerProcess(server_pid, globals->options->output_base);
+      }
+      DiscardServerCheckpoint();
+      delete server_startup;
+      restore = false;
+      server_pid = StartServer(workspace_layout, restore, &server_startup);
+      continue;
+    }
     if (!server_startup->IsStillAlive()) {
       globals->option_processor->PrintStartupOptionsProvenanceMessage();
       if (globals->jvm_log_file_append) {
@@ -869,49 +1155,147 @@ static void StartServerAndConnect(const WorkspaceLayout *workspace_layout,
       << "couldn't connect to server (" << server_pid << ") after 120 seconds.";
 }
 
-// A PureZipExtractorProcessor to extract the files from the blaze zip.
-class ExtractBlazeZipProcessor : public PureZipExtractorProcessor {
+// A devtools_ijar::ZipExtractorProcessor to extract the files from the blaze
+// zip into directories that already exist.
+class ExtractBlazeZipProcessor : public devtools_ijar::ZipExtractorProcessor {
  public:
   explicit ExtractBlazeZipProcessor(const string &embedded_binaries)
-      : embedded_binaries_(embedded_binaries) {}
-
-  bool AcceptPure(const char *filename,
-                  const devtools_ijar::u4 attr) const override {
-    return !devtools_ijar::zipattr_is_dir(attr);
-  }
+      : embedded_binaries_(embedded_binaries),
+        mtime_(blaze_util::CreateFileMtime()) {}
 
   bool Accept(const char *filename, const devtools_ijar::u4 attr) override {
-    return AcceptPure(filename, attr);
+    return !devtools_ijar::zipattr_is_dir(attr);
   }
 
   void Process(const char *filename, const devtools_ijar::u4 attr,
                const devtools_ijar::u1 *data, const size_t size) override {
     string path = blaze_util::JoinPath(embedded_binaries_, filename);
-    if (!blaze_util::MakeDirectories(blaze_util::Dirname(path), 0777)) {
-      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
-          << "couldn't create '" << path << "': " << GetLastErrorString();
-    }
-
     if (!blaze_util::WriteFile(data, size, path, 0755)) {
       BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
           << "Failed to write zipped file '" << path
           << "': " << GetLastErrorString();
     }
+
+    // Set the time to a distantly futuristic value so we can observe
+    // tampering. Note that keeping a static, deterministic timestamp, such as
+    // the default timestamp set by unzip (1970-01-01) and using that to detect
+    // tampering is not enough, because we also need the timestamp to change
+    // between Bazel releases so that the metadata cache knows that the files
+    // may have changed. This is essential for the correctness of actions that
+    // use embedded binaries as artifacts.
+    if (!mtime_->SetToDistantFuture(path)) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "failed to set timestamp on '" << path
+          << "': " << GetLastErrorString();
+    }
   }
 
  private:
   const string embedded_binaries_;
+  std::unique_ptr<blaze_util::IFileMtime> mtime_;
+};
+
+// Shares the file 'stored' as 'target', with the distant future mtime of
+// extracted files. Returns false, and leaves 'target' alone, if 'stored' is
+// missing, has been tampered with, or cannot be shared.
+static bool ShareStoredFile(const string &stored, const string &target) {
+  std::unique_ptr<blaze_util::IFileMtime> mtime(
+      blaze_util::CreateFileMtime());
+  bool in_future;
+  if (!mtime->GetIfInDistantFuture(stored, &in_future) || !in_future ||
+      !ShareFile(stored, target)) {
+    return false;
+  }
+  // Clones need not keep the mtime.
+  if (!(mtime->GetIfInDistantFuture(target, &in_future) &&
+        (in_future || mtime->SetToDistantFuture(target)))) {
+    blaze_util::UnlinkPath(target);
+    return false;
+  }
+  return true;
+}
+
+// Adds the extracted file 'path' to the store as 'stored', unless it is there
+// already. The file is shared under a temporary name first, so that 'stored'
+// appears complete or not at all. This is only a cache: errors are ignored.
+static void StoreExtractedFile(const string &path, const string &stored,
+                               size_t index) {
+  if (blaze_util::PathExists(stored)) {
+    return;
+  }
+  string tmp_stored = stored + ".tmp." + blaze::GetProcessIdAsString() + "." +
+                      std::to_string(index);
+  // RenameDirectory() renames files, too.
+  if (ShareFile(path, tmp_stored) &&
+      blaze_util::RenameDirectory(tmp_stored, stored) !=
+          blaze_util::kRenameDirectorySuccess) {
+    blaze_util::UnlinkPath(tmp_stored);
+  }
+}
+
+// Like ExtractBlazeZipProcessor, but shares each file from the content store
+// if the store has a file with the same contents, instead of writing it. The
+// files in the store are named by the MD5 digest of their contents, so files
+// that are the same in different releases, like the JDK's, are found however
+// the releases compressed them, and different files never collide.
+class SharingZipProcessor : public ExtractBlazeZipProcessor {
+ public:
+  SharingZipProcessor(const string &embedded_binaries,
+                      const string &content_store)
+      : ExtractBlazeZipProcessor(embedded_binaries),
+        embedded_binaries_(embedded_binaries),
+        content_store_(content_store),
+        shared_(false) {}
+
+  void Process(const char *filename, const devtools_ijar::u4 attr,
+               const devtools_ijar::u1 *data, const size_t size) override {
+    // Md5Digest::Update takes no more than 4GB at once.
+    const size_t kChunkSize = 1 << 30;
+    blaze_util::Md5Digest digest;
+    for (size_t offset = 0; offset < size; offset += kChunkSize) {
+      digest.Update(data + offset,
+                    static_cast<unsigned int>(std::min(kChunkSize,
+                                                       size - offset)));
+    }
+    unsigned char buf[blaze_util::Md5Digest::kDigestLength];
+    digest.Finish(buf);
+    digest_ = digest.String();
+    shared_ = ShareStoredFile(blaze_util::JoinPath(content_store_, digest_),
+                              blaze_util::JoinPath(embedded_binaries_,
+                                                   filename));
+    if (!shared_) {
+      ExtractBlazeZipProcessor::Process(filename, attr, data, size);
+    }
+  }
+
+  // The MD5 digest of the contents of the last file processed.
+  const string &digest() const { return digest_; }
+
+  // Whether the last file processed was shared from the store.
+  bool shared() const { return shared_; }
+
+ private:
+  const string embedded_binaries_;
+  const string content_store_;
+  string digest_;
+  bool shared_;
 };
 
 // Actually extracts the embedded data files into the tree whose root
-// is 'embedded_binaries'.
+// is 'embedded_binaries'. The directories are created first; then the files
+// are inflated and written on a pool of threads, largest first; then, once
+// they are all written, the files are synced, still in parallel, and every
+// directory is synced once.
+// If 'content_store' is not empty, the files found in that directory are
+// shared from there instead of written (see SharingZipProcessor), the other
+// ones are added to it once they are synced, and the digests of all of them
+// are added to 'content_digests'.
 static void ActuallyExtractData(const string &argv0,
-                                const string &embedded_binaries) {
+                                const string &embedded_binaries,
+                                const string &content_store,
+                                set<string> *content_digests) {
   std::string install_md5;
   GetInstallKeyFileProcessor install_key_processor(&install_md5);
-  ExtractBlazeZipProcessor extract_blaze_processor(embedded_binaries);
-  CompoundZipProcessor processor({&extract_blaze_processor,
-                                  &install_key_processor});
   if (!blaze_util::MakeDirectories(embedded_binaries, 0777)) {
     BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
         << "couldn't create '" << embedded_binaries
@@ -922,18 +1306,86 @@ static void ActuallyExtractData(const string &argv0,
                   << " installation...";
 
   std::unique_ptr<devtools_ijar::ZipExtractor> extractor(
-      devtools_ijar::ZipExtractor::Create(argv0.c_str(), &processor));
+      devtools_ijar::ZipExtractor::Create(argv0.c_str(),
+                                          &install_key_processor));
   if (extractor.get() == NULL) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "Failed to open " << globals->options->product_name
         << " as a zip file: " << GetLastErrorString();
   }
-  if (extractor->ProcessAll() < 0) {
+  vector<devtools_ijar::ZipEntry> entries;
+  if (extractor->GetEntries(&entries) < 0) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "Failed to extract " << globals->options->product_name
         << " as a zip file: " << extractor->GetError();
   }
 
+  vector<const devtools_ijar::ZipEntry *> files;
+  set<string> directories;
+  for (const auto &entry : entries) {
+    if (devtools_ijar::zipattr_is_dir(entry.attr)) {
+      continue;
+    }
+    files.push_back(&entry);
+    directories.insert(blaze_util::Dirname(
+        blaze_util::JoinPath(embedded_binaries, entry.filename)));
+    if (install_key_processor.AcceptPure(entry.filename.c_str(),
+                                         entry.attr)) {
+      string error;
+      if (extractor->ExtractEntry(entry, &install_key_processor, &error) <
+          0) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "Failed to extract " << globals->options->product_name
+            << " as a zip file: " << error;
+      }
+    }
+  }
+  // Start with the largest files, so that the last thread to finish is not
+  // left inflating the server jar or the JDK's modules on its own.
+  std::stable_sort(files.begin(), files.end(),
+                   [](const devtools_ijar::ZipEntry *a,
+                      const devtools_ijar::ZipEntry *b) {
+                     return a->uncompressed_size > b->uncompressed_size;
+                   });
+  for (const auto &directory : directories) {
+    if (!blaze_util::MakeDirectories(directory, 0777)) {
+      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+          << "couldn't create '" << directory
+          << "': " << GetLastErrorString();
+    }
+  }
+
+  // Filled in only with a content store.
+  vector<string> digests(files.size());
+  vector<char> written(files.size(), true);
+  // This thread is one of the extracting threads.
+  const int threads = blaze_util::DefaultThreadCount();
+  std::unique_ptr<blaze_util::ThreadPool> pool;
+  if (threads > 1) {
+    pool.reset(new blaze_util::ThreadPool(threads - 1, 1));
+  }
+  blaze_util::ParallelFor(pool.get(), files.size(), threads, [&](size_t i) {
+    std::unique_ptr<ExtractBlazeZipProcessor> processor;
+    if (content_store.empty()) {
+      processor.reset(new ExtractBlazeZipProcessor(embedded_binaries));
+    } else {
+      processor.reset(
+          new SharingZipProcessor(embedded_binaries, content_store));
+    }
+    string error;
+    if (extractor->ExtractEntry(*files[i], processor.get(), &error) < 0) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "Failed to extract " << globals->options->product_name
+          << " as a zip file: " << error;
+    }
+    if (!content_store.empty()) {
+      const auto *sharing =
+          static_cast<const SharingZipProcessor *>(processor.get());
+      digests[i] = sharing->digest();
+      written[i] = !sharing->shared();
+    }
+  });
+
   if (install_md5 != globals->install_md5) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "The " << globals->options->product_name << " binary at " << argv0
@@ -945,143 +1397,386 @@ static void ActuallyExtractData(const string &argv0,
            "this then you should investigate what happened.";
   }
 
-  // Set the timestamps of the extracted files to the future and make sure (or
-  // at least as sure as we can...) that the files we have written are actually
-  // on the disk.
+  // Make sure (or at least as sure as we can...) that the files we have
+  // written, and every directory between them and embedded_binaries, are
+  // actually on the disk. The !directory.empty() and
+  // !blaze_util::IsRootDirectory(directory) conditions are not strictly
+  // needed, but it makes this loop more robust, because otherwise, if due to
+  // some glitch, directory was not under embedded_binaries, it would get into
+  // an infinite loop.
+  vector<string> to_sync;
+  for (const auto *file : files) {
+    to_sync.push_back(blaze_util::JoinPath(embedded_binaries, file->filename));
+  }
+  set<string> synced_directories;
+  for (string directory : directories) {
+    while (directory != embedded_binaries &&
+           synced_directories.count(directory) == 0 && !directory.empty() &&
+           !blaze_util::IsRootDirectory(directory)) {
+      to_sync.push_back(directory);
+      synced_directories.insert(directory);
+      directory = blaze_util::Dirname(directory);
+    }
+  }
+  to_sync.push_back(embedded_binaries);
+  blaze_util::SyncFiles(to_sync);
+
+  // Only files that are on the disk are stored, so that a crash cannot leave a
+  // partial one in the store.
+  if (!content_store.empty()) {
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (written[i]) {
+        StoreExtractedFile(
+            blaze_util::JoinPath(embedded_binaries, files[i]->filename),
+            blaze_util::JoinPath(content_store, digests[i]), i);
+      }
+    }
+    content_digests->insert(digests.begin(), digests.end());
+  }
+}
+
+// Renames the completed installation at 'tmp_install' to 'install_base'. If
+// another good installation snuck in before us, that one is kept.
+static void RenameInstallBaseIntoPlace(const string &tmp_install,
+                                       const string &install_base) {
+  int attempts = 0;
+  while (attempts < 120) {
+    int result = blaze_util::RenameDirectory(tmp_install.c_str(),
+                                             install_base.c_str());
+    if (result == blaze_util::kRenameDirectorySuccess ||
+        result == blaze_util::kRenameDirectoryFailureNotEmpty) {
+      // If renaming fails because the directory already exists and is not
+      // empty, then we assume another good installation snuck in before us.
+      break;
+    } else {
+      // Otherwise the install directory may still be scanned by the antivirus
+      // (in case we're running on Windows) so we need to wait for that to
+      // finish and try renaming again.
+      ++attempts;
+      BAZEL_LOG(USER) << "install base directory '" << tmp_install
+                      << "' could not be renamed into place after "
+                      << attempts << " second(s), trying again\r";
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+  }
 
-  vector<string> extracted_files;
+  // Give up renaming after 120 failed attempts / 2 minutes.
+  if (attempts == 120) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+        << "install base directory '" << tmp_install
+        << "' could not be renamed into place: " << GetLastErrorString();
+  }
+}
 
-  // Walks the temporary directory recursively and collects full file paths.
-  blaze_util::GetAllFilesUnder(embedded_binaries, &extracted_files);
+// Returns whether every extracted file in 'install_base' is in place and has
+// the distant future mtime it was extracted with. Sets 'error' if not.
+static bool CheckInstallBase(const string &install_base, string *error) {
+  if (!blaze_util::IsDirectory(install_base)) {
+    *error = "Install base directory '" + install_base +
+             "' could not be created. It exists but is not a directory.";
+    return false;
+  }
 
-  std::unique_ptr<blaze_util::IFileMtime> mtime(blaze_util::CreateFileMtime());
-  set<string> synced_directories;
-  for (const auto &it : extracted_files) {
-    const char *extracted_path = it.c_str();
-
-    // Set the time to a distantly futuristic value so we can observe tampering.
-    // Note that keeping a static, deterministic timestamp, such as the default
-    // timestamp set by unzip (1970-01-01) and using that to detect tampering is
-    // not enough, because we also need the timestamp to change between Bazel
-    // releases so that the metadata cache knows that the files may have
-    // changed. This is essential for the correctness of actions that use
-    // embedded binaries as artifacts.
-    if (!mtime.get()->SetToDistantFuture(it)) {
-      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-          << "failed to set timestamp on '" << extracted_path
+  std::unique_ptr<blaze_util::IFileMtime> mtime(
+      blaze_util::CreateFileMtime());
+  string real_install_dir =
+      blaze_util::JoinPath(install_base, "_embedded_binaries");
+  for (const auto &it : globals->extracted_binaries) {
+    string path = blaze_util::JoinPath(real_install_dir, it);
+    // Check that the file exists and is readable.
+    if (blaze_util::IsDirectory(path)) {
+      continue;
+    }
+    if (!blaze_util::CanReadFile(path)) {
+      *error = "corrupt installation: file '" + path +
+               "' missing. Please remove '" + install_base +
+               "' and try again.";
+      return false;
+    }
+    // Check that the timestamp is in the future. A past timestamp would
+    // indicate that the file has been tampered with.
+    // See ActuallyExtractData().
+    bool is_in_future = false;
+    if (!mtime.get()->GetIfInDistantFuture(path, &is_in_future)) {
+      *error = "Error: could not retrieve mtime of file '" + path +
+               "'. Please remove '" + install_base + "' and try again.";
+      return false;
+    }
+    if (!is_in_future) {
+      *error = "Error: corrupt installation: file '" + path +
+               "' modified.  Please remove '" + install_base +
+               "' and try again.";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Dies unless every extracted file in 'install_base' is in place and has the
+// distant future mtime it was extracted with.
+static void VerifyInstallBase(const string &install_base) {
+  string error;
+  if (!CheckInstallBase(install_base, &error)) {
+    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR) << error;
+  }
+}
+
+// Kills the server that MaybeStartServerEarly() started, if any, because the
+// client found out it should not have.
+static void DiscardSpeculativeServer() {
+  if (globals->speculative_server_startup == NULL) {
+    return;
+  }
+  BAZEL_LOG(INFO) << "Killing the server started early (pid="
+                  << globals->speculative_server_pid << ")";
+  if (globals->speculative_server_pid > 0) {
+    KillServerProcess(globals->speculative_server_pid,
+                      globals->options->output_base);
+  }
+  delete globals->speculative_server_startup;
+  globals->speculative_server_pid = -1;
+  globals->speculative_server_startup = NULL;
+}
+
+// Populates 'embedded_binaries' with the files of the verified installation
+// 'shared_install_base', using ShareFile. Returns false, after removing the
+// files it shared, if any file could not be shared, e.g. because it is on
+// another file system or belongs to somebody else.
+static bool ShareInstallBase(const string &shared_install_base,
+                             const string &embedded_binaries) {
+  string shared_binaries =
+      blaze_util::JoinPath(shared_install_base, "_embedded_binaries");
+  std::unique_ptr<blaze_util::IFileMtime> mtime(
+      blaze_util::CreateFileMtime());
+  vector<string> shared_files;
+  set<string> directories;
+  for (const auto &it : globals->extracted_binaries) {
+    string source = blaze_util::JoinPath(shared_binaries, it);
+    string target = blaze_util::JoinPath(embedded_binaries, it);
+    if (blaze_util::IsDirectory(source)) {
+      continue;
+    }
+    if (!blaze_util::MakeDirectories(blaze_util::Dirname(target), 0777)) {
+      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+          << "couldn't create '" << blaze_util::Dirname(target)
           << "': " << GetLastErrorString();
     }
+    bool in_future;
+    if (!ShareFile(source, target) ||
+        !(mtime->GetIfInDistantFuture(target, &in_future) &&
+          (in_future || mtime->SetToDistantFuture(target)))) {
+      BAZEL_LOG(INFO) << "couldn't share '" << source << "' as '" << target
+                      << "'";
+      blaze_util::UnlinkPath(target);
+      for (const auto &file : shared_files) {
+        blaze_util::UnlinkPath(file);
+      }
+      return false;
+    }
+    shared_files.push_back(target);
+    directories.insert(blaze_util::Dirname(target));
+  }
 
-    blaze_util::SyncFile(it);
+  // Like ActuallyExtractData(), make sure that the clones and the links are on
+  // the disk.
+  vector<string> to_sync(shared_files);
+  to_sync.insert(to_sync.end(), directories.begin(), directories.end());
+  to_sync.push_back(embedded_binaries);
+  blaze_util::SyncFiles(to_sync);
+  return true;
+}
 
-    string directory = blaze_util::Dirname(extracted_path);
+// Takes the lock that clients extracting into 'install_base' hold, so that
+// only one of them extracts it and the others wait and use its result. Returns
+// false if the lock cannot be taken; the clients then extract concurrently.
+static bool LockInstallBase(const string &install_base, BlazeLock *lock) {
+  if (!blaze_util::MakeDirectories(blaze_util::Dirname(install_base), 0777) ||
+      !AcquireFileLock(install_base + ".lock", lock)) {
+    BAZEL_LOG(INFO) << "couldn't lock '" << install_base << ".lock': "
+                    << GetLastErrorString();
+    return false;
+  }
+  return true;
+}
 
-    // Now walk up until embedded_binaries and sync every directory in between.
-    // synced_directories is used to avoid syncing the same directory twice.
-    // The !directory.empty() and !blaze_util::IsRootDirectory(directory)
-    // conditions are not strictly needed, but it makes this loop more robust,
-    // because otherwise, if due to some glitch, directory was not under
-    // embedded_binaries, it would get into an infinite loop.
-    while (directory != embedded_binaries &&
-           synced_directories.count(directory) == 0 && !directory.empty() &&
-           !blaze_util::IsRootDirectory(directory)) {
-      blaze_util::SyncFile(directory);
-      synced_directories.insert(directory);
-      directory = blaze_util::Dirname(directory);
+// The content store under --experimental_shared_install_base_root, and the
+// file in each shared installation that lists the digests of its files.
+static const char kContentStore[] = "cas";
+static const char kContentDigests[] = "content_digests";
+
+// Collects the entries of a directory.
+class DirectoryLister : public blaze_util::DirectoryEntryConsumer {
+ public:
+  void Consume(const string &name, bool is_directory) override {
+    entries.push_back(std::make_pair(name, is_directory));
+  }
+
+  vector<std::pair<string, bool>> entries;
+};
+
+// Removes the files in 'content_store' that no installation under
+// 'shared_root' lists anymore, e.g. because it was deleted, so that the store
+// does not grow with every release. A client of another release that
+// extracts at the same time may lose files it has just stored, which only
+// means that they are not shared later.
+static void PruneContentStore(const string &shared_root,
+                              const string &content_store) {
+  set<string> used;
+  DirectoryLister installations;
+  blaze_util::ForEachDirectoryEntry(shared_root, &installations);
+  for (const auto &installation : installations.entries) {
+    string digests;
+    if (installation.second &&
+        blaze_util::ReadFile(
+            blaze_util::JoinPath(installation.first, kContentDigests),
+            &digests)) {
+      for (const string &digest : blaze_util::Split(digests, '\n')) {
+        used.insert(digest);
+      }
+    }
+  }
+  DirectoryLister stored;
+  blaze_util::ForEachDirectoryEntry(content_store, &stored);
+  for (const auto &file : stored.entries) {
+    string name = blaze_util::Basename(file.first);
+    // Also removes the temporary files of clients that crashed.
+    if (!file.second && used.count(name) == 0) {
+      blaze_util::UnlinkPath(file.first);
     }
   }
+}
 
-  blaze_util::SyncFile(embedded_binaries);
+// Extracts the installation into 'shared_install_base' under 'shared_root',
+// sharing the files that earlier releases extracted already from the content
+// store, and adding the other ones to it. Without a store, e.g. because
+// 'shared_root' has a file in its place, the files are all extracted. Never
+// called on Windows, where nothing can be shared (see SharedInstallBaseRoot).
+static void ExtractSharedInstallBase(const string &self_path,
+                                     const string &shared_root,
+                                     const string &shared_install_base) {
+  string content_store = blaze_util::JoinPath(shared_root, kContentStore);
+  if (!blaze_util::MakeDirectories(content_store, 0777)) {
+    BAZEL_LOG(INFO) << "couldn't create the content store '" << content_store
+                    << "', extracting without it: " << GetLastErrorString();
+    content_store.clear();
+  }
+  string tmp_shared_install =
+      shared_install_base + ".tmp." + blaze::GetProcessIdAsString();
+  set<string> content_digests;
+  ActuallyExtractData(
+      self_path, blaze_util::JoinPath(tmp_shared_install, "_embedded_binaries"),
+      content_store, &content_digests);
+  if (!content_store.empty()) {
+    string digests;
+    for (const string &digest : content_digests) {
+      digests += digest + "\n";
+    }
+    if (!blaze_util::WriteFile(
+            digests,
+            blaze_util::JoinPath(tmp_shared_install, kContentDigests))) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "couldn't write '"
+          << blaze_util::JoinPath(tmp_shared_install, kContentDigests)
+          << "': " << GetLastErrorString();
+    }
+  }
+  RenameInstallBaseIntoPlace(tmp_shared_install, shared_install_base);
+  if (!content_store.empty()) {
+    PruneContentStore(shared_root, content_store);
+  }
+}
+
+// Returns --experimental_shared_install_base_root, or the empty string, after
+// saying so, on Windows: ShareFile() cannot share files there, so the
+// installation would only be extracted twice.
+static string SharedInstallBaseRoot() {
+  const string &shared_root = globals->options->shared_install_base_root;
+#if defined(_WIN32) || defined(__CYGWIN__)
+  if (!shared_root.empty()) {
+    BAZEL_LOG(WARNING) << "--experimental_shared_install_base_root is not "
+                          "supported on Windows and is ignored.";
+    return "";
+  }
+#endif
+  return shared_root;
 }
 
 // Installs Blaze by extracting the embedded data files, iff necessary.
 // The MD5-named install_base directory on disk is trusted; we assume
 // no-one has modified the extracted files beneath this directory once
-// it is in place. Concurrency during extraction is handled by
-// extracting in a tmp dir and then renaming it into place where it
-// becomes visible automically at the new path.
+// it is in place. Concurrent clients take turns extracting under a lock
+// file next to install_base, and the ones that wait find it in place. The
+// extraction still happens in a tmp dir, which is renamed into place where
+// it becomes visible automically at the new path, so that a client that
+// crashes midway leaves nothing behind at install_base.
+// With --experimental_shared_install_base_root, the files are extracted once
+// into an MD5-named directory under that root instead, and shared from there
+// into install_base where possible. The files that are the same as in other
+// releases are shared from a content-addressed store under the root, too (see
+// ExtractSharedInstallBase).
 // Populates globals->extracted_binaries with their extracted locations.
 static void ExtractData(const string &self_path) {
+  const string &install_base = globals->options->install_base;
+  bool extracted = false;
   // If the install dir doesn't exist, create it, if it does, we know it's good.
-  if (!blaze_util::PathExists(globals->options->install_base)) {
-    uint64_t st = GetMillisecondsMonotonic();
-    // Work in a temp dir to avoid races.
-    string tmp_install = globals->options->install_base + ".tmp." +
-                         blaze::GetProcessIdAsString();
-    string tmp_binaries =
-        blaze_util::JoinPath(tmp_install, "_embedded_binaries");
-    ActuallyExtractData(self_path, tmp_binaries);
-
-    uint64_t et = GetMillisecondsMonotonic();
-    globals->extract_data_time = et - st;
-
-    // Now rename the completed installation to its final name.
-    int attempts = 0;
-    while (attempts < 120) {
-      int result = blaze_util::RenameDirectory(
-          tmp_install.c_str(), globals->options->install_base.c_str());
-      if (result == blaze_util::kRenameDirectorySuccess ||
-          result == blaze_util::kRenameDirectoryFailureNotEmpty) {
-        // If renaming fails because the directory already exists and is not
-        // empty, then we assume another good installation snuck in before us.
-        break;
-      } else {
-        // Otherwise the install directory may still be scanned by the antivirus
-        // (in case we're running on Windows) so we need to wait for that to
-        // finish and try renaming again.
-        ++attempts;
-        BAZEL_LOG(USER) << "install base directory '" << tmp_install
-                        << "' could not be renamed into place after "
-                        << attempts << " second(s), trying again\r";
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+  if (!blaze_util::PathExists(install_base)) {
+    BlazeLock install_lock;
+    bool locked = LockInstallBase(install_base, &install_lock);
+    // Another client may have created it while we waited for the lock.
+    if (!blaze_util::PathExists(install_base)) {
+      uint64_t st = GetMillisecondsMonotonic();
+      // Work in a temp dir to avoid races.
+      string tmp_install =
+          install_base + ".tmp." + blaze::GetProcessIdAsString();
+      string tmp_binaries =
+          blaze_util::JoinPath(tmp_install, "_embedded_binaries");
+
+      bool shared = false;
+      const string shared_root = SharedInstallBaseRoot();
+      if (!shared_root.empty() && blaze_util::IsDirectory(shared_root)) {
+        string shared_install_base =
+            blaze_util::JoinPath(shared_root, globals->install_md5);
+        if (!blaze_util::PathExists(shared_install_base) &&
+            blaze_util::CanAccessDirectory(shared_root)) {
+          BlazeLock shared_lock;
+          bool shared_locked =
+              LockInstallBase(shared_install_base, &shared_lock);
+          if (!blaze_util::PathExists(shared_install_base)) {
+            ExtractSharedInstallBase(self_path, shared_root,
+                                     shared_install_base);
+          }
+          if (shared_locked) {
+            ReleaseLock(&shared_lock);
+          }
+        }
+        if (blaze_util::PathExists(shared_install_base)) {
+          VerifyInstallBase(shared_install_base);
+          shared = ShareInstallBase(shared_install_base, tmp_binaries);
+          BAZEL_LOG(INFO) << (shared ? "Shared" : "Couldn't share")
+                          << " the installation at '" << shared_install_base
+                          << "'";
+        }
+      }
+      if (!shared) {
+        ActuallyExtractData(self_path, tmp_binaries, "", nullptr);
       }
-    }
 
-    // Give up renaming after 120 failed attempts / 2 minutes.
-    if (attempts == 120) {
-      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-          << "install base directory '" << tmp_install
-          << "' could not be renamed into place: " << GetLastErrorString();
+      uint64_t et = GetMillisecondsMonotonic();
+      globals->extract_data_time = et - st;
+
+      // Now rename the completed installation to its final name.
+      RenameInstallBaseIntoPlace(tmp_install, install_base);
+      extracted = true;
     }
-  } else {
-    if (!blaze_util::IsDirectory(globals->options->install_base)) {
-      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-          << "Install base directory '" << globals->options->install_base
-          << "' could not be created. It exists but is not a directory.";
+    if (locked) {
+      ReleaseLock(&install_lock);
     }
-
-    std::unique_ptr<blaze_util::IFileMtime> mtime(
-        blaze_util::CreateFileMtime());
-    string real_install_dir = blaze_util::JoinPath(
-        globals->options->install_base, "_embedded_binaries");
-    for (const auto &it : globals->extracted_binaries) {
-      string path = blaze_util::JoinPath(real_install_dir, it);
-      // Check that the file exists and is readable.
-      if (blaze_util::IsDirectory(path)) {
-        continue;
-      }
-      if (!blaze_util::CanReadFile(path)) {
-        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-            << "corrupt installation: file '" << path
-            << "' missing. Please remove '" << globals->options->install_base
-            << "' and try again.";
-      }
-      // Check that the timestamp is in the future. A past timestamp would
-      // indicate that the file has been tampered with.
-      // See ActuallyExtractData().
-      bool is_in_future = false;
-      if (!mtime.get()->GetIfInDistantFuture(path, &is_in_future)) {
-        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-            << "Error: could not retrieve mtime of file '" << path
-            << "'. Please remove '" << globals->options->install_base
-            << "' and try again.";
-      }
-      if (!is_in_future) {
-        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-            << "Error: corrupt installation: file '" << path
-            << "' modified.  Please remove '" << globals->options->install_base
-            << "' and try again.";
-      }
+  }
+  if (!extracted) {
+    string error;
+    if (!CheckInstallBase(install_base, &error)) {
+      DiscardSpeculativeServer();
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR) << error;
     }
   }
 }
@@ -1134,13 +1829,11 @@ static bool AreStartupOptionsDifferent(
   return false;
 }
 
-// Kills the running Blaze server, if any, if the startup options do not match.
-static void KillRunningServerIfDifferentStartupOptions(
-    const WorkspaceLayout *workspace_layout, BlazeServer *server) {
-  if (!server->Connected()) {
-    return;
-  }
-
+// Returns true if the server that last ran in this output base, if any, was
+// started with other startup options. Does not need a connection to the
+// server, so that it can run while the client connects.
+static bool AreRunningServerStartupOptionsDifferent(
+    const WorkspaceLayout *workspace_layout) {
   string cmdline_path =
       blaze_util::JoinPath(globals->options->output_base, "server/cmdline");
   string old_joined_arguments;
@@ -1149,39 +1842,63 @@ static void KillRunningServerIfDifferentStartupOptions(
   // worse, its behavior differs slightly between kernels (in some, when longer
   // command lines are truncated, the last 4 bytes are replaced with
   // "..." + NUL.
-  blaze_util::ReadFile(cmdline_path, &old_joined_arguments);
+  if (!blaze_util::ReadFile(cmdline_path, &old_joined_arguments)) {
+    // Either no server ran here yet, in which case there's nothing to kill, or
+    // we can't tell what it runs with, in which case it has to go.
+    return true;
+  }
   vector<string> old_arguments = blaze_util::Split(old_joined_arguments, '\0');
 
   // These strings contain null-separated command line arguments. If they are
   // the same, the server can stay alive, otherwise, it needs shuffle off this
   // mortal coil.
-  if (AreStartupOptionsDifferent(old_arguments,
-                                 GetArgumentArray(workspace_layout))) {
+  return AreStartupOptionsDifferent(old_arguments,
+                                    GetArgumentArray(workspace_layout));
+}
+
+// Kills the running Blaze server, if any, if the startup options do not match.
+static void KillRunningServerIfDifferentStartupOptions(BlazeServer *server,
+                                                       bool options_differ) {
+  if (!server->Connected()) {
+    return;
+  }
+
+  if (options_differ) {
     globals->restart_reason = NEW_OPTIONS;
     BAZEL_LOG(WARNING) << "Running " << globals->options->product_name
                        << " server needs to be killed, because the startup "
                           "options are different.";
-    server->KillRunningServer();
+    server->ShutDownRunningServerForRestart();
   }
 }
 
-// Kills the old running server if it is not the same version as us,
-// dealing with various combinations of installation scheme
-// (installation symlink and older MD5_MANIFEST contents).
-// This function requires that the installation be complete, and the
-// server lock acquired.
-static void EnsureCorrectRunningVersion(BlazeServer *server) {
-  // Read the previous installation's semaphore symlink in output_base. If the
-  // target dirs don't match, or if the symlink was not present, then kill any
-  // running servers. Lastly, symlink to our installation so others know which
-  // installation is running.
+// Returns true if the installation symlink in output_base does not point to
+// our installation, e.g. because the server that last ran here is another
+// version. Like AreRunningServerStartupOptionsDifferent, this does not need a
+// connection to the server.
+static bool IsRunningAnotherVersion() {
   string installation_path =
       blaze_util::JoinPath(globals->options->output_base, "install");
   string prev_installation;
   bool ok =
       blaze_util::ReadDirectorySymlink(installation_path, &prev_installation);
-  if (!ok || !blaze_util::CompareAbsolutePaths(
-                 prev_installation, globals->options->install_base)) {
+  return !ok || !blaze_util::CompareAbsolutePaths(
+                    prev_installation, globals->options->install_base);
+}
+
+// Kills the old running server if it is not the same version as us,
+// dealing with various combinations of installation scheme
+// (installation symlink and older MD5_MANIFEST contents).
+// This function requires that the installation be complete, and the
+// server lock acquired.
+static void EnsureCorrectRunningVersion(BlazeServer *server,
+                                        bool another_version) {
+  // If the previous installation's semaphore symlink in output_base did not
+  // match, or was not present, then kill any running servers. Lastly, symlink
+  // to our installation so others know which installation is running.
+  if (another_version) {
+    string installation_path =
+        blaze_util::JoinPath(globals->options->output_base, "install");
     if (server->Connected()) {
       BAZEL_LOG(INFO)
           << "Killing running server because it is using another version of "
@@ -1212,38 +1929,102 @@ static void EnsureCorrectRunningVersion(BlazeServer *server) {
 
 static void CancelServer() { blaze_server->Cancel(); }
 
-// Performs all I/O for a single client request to the server, and
-// shuts down the client (by exit or signal).
-static ATTRIBUTE_NORETURN void SendServerRequest(
-    const WorkspaceLayout *workspace_layout, BlazeServer *server) {
+// With --experimental_server_checkpoint, checkpoints a server that had already
+// run a command before the one that just succeeded, unless there is a
+// checkpoint already. This stops the server; the next command restores it.
+// The client waits for the checkpoint while it still holds the output base
+// lock, so that no other client talks to the server in the meantime.
+static void MaybeCheckpointServer(unsigned int exit_code) {
+  if (!IsServerCheckpointEnabled() || exit_code != 0 ||
+      globals->restart_reason != NO_RESTART ||
+      globals->option_processor->GetCommand() == "shutdown") {
+    return;
+  }
+  const string checkpoint_dir = GetServerCheckpointDir();
+  if (blaze_util::PathExists(
+          blaze_util::JoinPath(checkpoint_dir, "inventory.img"))) {
+    return;
+  }
+  const string jcmd =
+      blaze_util::JoinPath(blaze_util::Dirname(globals->jvm_path), "jcmd");
+  if (!blaze_util::CanExecuteFile(jcmd)) {
+    return;
+  }
+
+  // The server keeps its arguments and PID across the checkpoint, so record
+  // them next to it for StartServer().
+  const string server_dir =
+      blaze_util::JoinPath(globals->options->output_base, "server");
+  string cmdline;
+  string pid;
+  if (!blaze_util::MakeDirectories(checkpoint_dir, 0700) ||
+      !blaze_util::ReadFile(blaze_util::JoinPath(server_dir, "cmdline"),
+                            &cmdline) ||
+      !blaze_util::ReadFile(blaze_util::JoinPath(server_dir, kServerPidFile),
+                            &pid) ||
+      !blaze_util::WriteFile(cmdline,
+                             blaze_util::JoinPath(checkpoint_dir, "cmdline")) ||
+      !blaze_util::WriteFile(
+          pid, blaze_util::JoinPath(checkpoint_dir, kServerPidFile))) {
+    BAZEL_LOG(WARNING) << "Could not prepare the server checkpoint in '"
+                       << checkpoint_dir << "': " << GetLastErrorString();
+    return;
+  }
+
+  BAZEL_LOG(INFO) << "Checkpointing the server to '" << checkpoint_dir << "'";
+  // jcmd's own pid files end up in the checkpoint directory, not in the
+  // server's.
+  BlazeServerStartup *jcmd_startup;
+  ExecuteDaemon(jcmd, {"jcmd", pid, "JDK.checkpoint"},
+                PrepareEnvironmentForJvm(),
+                blaze_util::JoinPath(checkpoint_dir, "jcmd.log"), false,
+                checkpoint_dir, &jcmd_startup);
+  auto give_up_time(std::chrono::system_clock::now() +
+                    std::chrono::seconds(120));
+  while (jcmd_startup->IsStillAlive() &&
+         std::chrono::system_clock::now() < give_up_time) {
+    jcmd_startup->WaitForReadiness(1000);
+  }
+  delete jcmd_startup;
+}
+
+// Makes sure that there is a server running in the workspace, started if need
+// be, and connects to it.
+// Check for the case when the workspace directory deleted and then gets
+// recreated while the server is running.
+static bool HasServerCwdMoved() {
+  string server_cwd = GetProcessCWD(globals->server_pid);
+  // If server_cwd is empty, GetProcessCWD failed. This notably occurs when
+  // running under Docker because then readlink(/proc/[pid]/cwd) returns
+  // EPERM.
+  // Docker issue #6687 (https://github.com/docker/docker/issues/6687) fixed
+  // this, but one still needs the --cap-add SYS_PTRACE command line flag, at
+  // least according to the discussion on Docker issue #6800
+  // (https://github.com/docker/docker/issues/6687), and even then, it's a
+  // non-default Docker flag. Given that this occurs only in very weird
+  // cases, it's better to assume that everything is alright if we can't get
+  // the cwd.
+
+  if (!server_cwd.empty() &&
+      (server_cwd != globals->workspace ||                // changed
+       server_cwd.find(" (deleted)") != string::npos)) {  // deleted.
+    // There's a distant possibility that the two paths look the same yet are
+    // actually different because the two processes have different mount
+    // tables.
+    BAZEL_LOG(INFO) << "Server's cwd moved or deleted (" << server_cwd << ").";
+    return true;
+  }
+  return false;
+}
+
+static void EnsureServerConnected(const WorkspaceLayout *workspace_layout,
+                                  BlazeServer *server) {
   while (true) {
     if (!server->Connected()) {
       StartServerAndConnect(workspace_layout, server);
     }
 
-    // Check for the case when the workspace directory deleted and then gets
-    // recreated while the server is running
-
-    string server_cwd = GetProcessCWD(globals->server_pid);
-    // If server_cwd is empty, GetProcessCWD failed. This notably occurs when
-    // running under Docker because then readlink(/proc/[pid]/cwd) returns
-    // EPERM.
-    // Docker issue #6687 (https://github.com/docker/docker/issues/6687) fixed
-    // this, but one still needs the --cap-add SYS_PTRACE command line flag, at
-    // least according to the discussion on Docker issue #6800
-    // (https://github.com/docker/docker/issues/6687), and even then, it's a
-    // non-default Docker flag. Given that this occurs only in very weird
-    // cases, it's better to assume that everything is alright if we can't get
-    // the cwd.
-
-    if (!server_cwd.empty() &&
-        (server_cwd != globals->workspace ||                // changed
-         server_cwd.find(" (deleted)") != string::npos)) {  // deleted.
-      // There's a distant possibility that the two paths look the same yet are
-      // actually different because the two processes have different mount
-      // tables.
-      BAZEL_LOG(INFO) << "Server's cwd moved or deleted (" << server_cwd
-                      << ").";
+    if (HasServerCwdMoved()) {
       server->KillRunningServer();
     } else {
       break;
@@ -1251,12 +2032,99 @@ static ATTRIBUTE_NORETURN void SendServerRequest(
   }
 
   BAZEL_LOG(INFO) << "Connected (server pid=" << globals->server_pid << ").";
+}
+
+// Performs all I/O for a single client request to the server, and
+// shuts down the client (by exit or signal).
+static ATTRIBUTE_NORETURN void SendServerRequest(
+    const WorkspaceLayout *workspace_layout, BlazeServer *server) {
+  EnsureServerConnected(workspace_layout, server);
 
   // Wall clock time since process startup.
   globals->startup_time = GetMillisecondsSinceProcessStart();
 
   SignalHandler::Get().Install(globals, CancelServer);
-  SignalHandler::Get().PropagateSignalOrExit(server->Communicate());
+  const unsigned int exit_code = server->Communicate();
+  MaybeCheckpointServer(exit_code);
+  SignalHandler::Get().PropagateSignalOrExit(exit_code);
+}
+
+// Returns true if the server that the client connected to is still the one
+// serving this output base: its PID file is unchanged, and the process is
+// alive. Another client may have restarted it since, or it may have shut down.
+static bool IsConnectedServerCurrent(BlazeServer *server) {
+  const string server_dir =
+      blaze_util::JoinPath(globals->options->output_base, "server");
+  return server->Connected() &&
+         GetServerPid(server_dir) == globals->server_pid &&
+         VerifyServerProcess(globals->server_pid,
+                             globals->options->output_base);
+}
+
+// Runs the commands that --experimental_session reads from stdin, one per line
+// with the quoting of rc files, and exits at the end of the input. Everything
+// that SendServerRequest() would do again for each command is only redone if
+// the server changed in between. Writes the exit code of each command to
+// stderr after its output, so that a caller can tell where it ends.
+static ATTRIBUTE_NORETURN void RunSession(
+    const WorkspaceLayout *workspace_layout, BlazeServer *server) {
+  if (!globals->option_processor->GetCommand().empty()) {
+    BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+        << "With --experimental_session, the commands are read from stdin.";
+  }
+  EnsureServerConnected(workspace_layout, server);
+  SignalHandler::Get().Install(globals, CancelServer);
+
+  string product = globals->options->product_name;
+  blaze_util::ToLower(&product);
+  unsigned int exit_code = blaze_exit_code::SUCCESS;
+  char buffer[4096];
+  string line;
+  while (fgets(buffer, sizeof(buffer), stdin) != NULL) {
+    line += buffer;
+    if (line.back() != '\n' && !feof(stdin)) {
+      continue;
+    }
+    vector<string> words;
+    blaze_util::Tokenize(line, '#', &words);
+    line.clear();
+    if (words.empty()) {
+      continue;
+    }
+
+    string error;
+    exit_code = globals->option_processor->ParseCommand(
+        words, globals->workspace, globals->cwd, &error);
+    if (exit_code == blaze_exit_code::SUCCESS && words[0] == "run") {
+      // The client would have to exec() the binary.
+      error = "'run' is not supported in a session";
+      exit_code = blaze_exit_code::BAD_ARGV;
+    }
+    if (exit_code == blaze_exit_code::SUCCESS) {
+      if (!IsConnectedServerCurrent(server)) {
+        BAZEL_LOG(INFO) << "The server changed, connecting again.";
+        if (server->Connected()) {
+          server->Disconnect();
+        }
+        globals->command_wait_time = server->AcquireLock(false);
+        server->Connect();
+        const bool another_version = IsRunningAnotherVersion();
+        const bool options_differ =
+            AreRunningServerStartupOptionsDifferent(workspace_layout);
+        EnsureCorrectRunningVersion(server, another_version);
+        KillRunningServerIfDifferentStartupOptions(server, options_differ);
+        EnsureServerConnected(workspace_layout, server);
+      }
+      globals->startup_time = GetMillisecondsSinceProcessStart();
+      exit_code = server->Communicate();
+    } else {
+      BAZEL_LOG(ERROR) << error;
+    }
+    fflush(stdout);
+    fprintf(stderr, "%s-session: exit %u\n", product.c_str(), exit_code);
+    fflush(stderr);
+  }
+  SignalHandler::Get().PropagateSignalOrExit(exit_code);
 }
 
 // Parse the options, storing parsed values in globals.
@@ -1283,7 +2151,99 @@ static void ComputeWorkspace(const WorkspaceLayout *workspace_layout) {
         << "blaze_util::MakeCanonical('" << blaze_util::GetCwd()
         << "') failed: " << GetLastErrorString();
   }
-  globals->workspace = workspace_layout->GetWorkspace(globals->cwd);
+  globals->workspace = workspace_layout->GetWorkspaceWithHint(
+      globals->cwd, blaze::GetEnv("BAZEL_WORKSPACE"));
+}
+
+// Answers `info <key>` for the keys whose value the client already knows, so
+// that e.g. IDEs asking for the output base neither wait for the output base
+// lock nor start a server. Returns false if the server has to run the command,
+// which it also does for any command-line flag that could change the output.
+static bool AnswerInfoLocally(const WorkspaceLayout *workspace_layout) {
+  if (globals->option_processor->GetCommand() != "info") {
+    return false;
+  }
+  const vector<string> args =
+      globals->option_processor->GetExplicitCommandArguments();
+  if (args.size() != 1) {
+    return false;
+  }
+  string value;
+  if (args[0] == "output_base") {
+    value = globals->options->output_base;
+  } else if (args[0] == "install_base") {
+    value = globals->options->install_base;
+  } else if (args[0] == "workspace" &&
+             workspace_layout->InWorkspace(globals->workspace)) {
+    value = globals->workspace;
+  } else {
+    return false;
+  }
+#if defined(_WIN32) || defined(__CYGWIN__)
+  // The server prints paths with forward slashes.
+  std::replace(value.begin(), value.end(), '\\', '/');
+#endif
+  BAZEL_LOG(INFO) << "Answering 'info " << args[0] << "' without the server";
+  printf("%s\n", value.c_str());
+  fflush(stdout);
+  return true;
+}
+
+// Starts the server right away if the client is going to have to start it and
+// can already tell how: there is no server in the output base, the install
+// base is there, and nothing about the server is going to change. The JVM then
+// boots while the client verifies the install base and connects. If the
+// install base turns out to be broken, DiscardSpeculativeServer() kills the
+// server again.
+static void MaybeStartServerEarly(const WorkspaceLayout *workspace_layout) {
+  if (globals->options->batch ||
+      !blaze_util::PathExists(globals->options->install_base) ||
+      IsRunningAnotherVersion() || IsServerCheckpointEnabled()) {
+    return;
+  }
+  const string server_dir =
+      blaze_util::JoinPath(globals->options->output_base, "server");
+  // A server may be running, or have died without cleaning up; either way,
+  // the usual path is the one that knows what to do with it.
+  if (GetServerPid(server_dir) > 0 ||
+      !blaze_util::MakeDirectories(server_dir, 0700)) {
+    return;
+  }
+  ScopedClientPhase phase(&globals->client_profile, "StartServerEarly");
+  BAZEL_LOG(INFO) << "Starting the server while the client gets ready";
+  globals->jvm_path = globals->options->GetJvm();
+  SetSchedulingForProfile();
+  globals->speculative_server_pid = StartServer(
+      workspace_layout, false, &globals->speculative_server_startup);
+}
+
+// Returns whether the server runs `command` without changing anything that
+// another command could see, so that clients running it can share the lock.
+static bool IsReadOnlyCommand(const string &command) {
+  return command == "help" || command == "info" || command == "query" ||
+         command == "version";
+}
+
+// Connects to the server of this output base, if any, and finds out whether
+// it has to be restarted. The files in the output base tell, so this finds out
+// while connecting. Only the connecting thread records phases in the client
+// profile until it's joined.
+static void ConnectToServer(const WorkspaceLayout *workspace_layout,
+                            bool *another_version, bool *options_differ) {
+  std::thread connect_thread([]() {
+    ScopedClientPhase phase(&globals->client_profile, "Connect");
+    blaze_server->Connect();
+  });
+  *another_version = IsRunningAnotherVersion();
+  *options_differ = AreRunningServerStartupOptionsDifferent(workspace_layout);
+  connect_thread.join();
+  if (blaze_server->Connected() &&
+      globals->speculative_server_startup != NULL) {
+    // The server started early is up already.
+    delete globals->speculative_server_startup;
+    globals->speculative_server_pid = -1;
+    globals->speculative_server_startup = NULL;
+  }
 }
 
 // Figure out the base directories based on embedded data, username, cwd, etc.
@@ -1304,13 +2264,15 @@ static void ComputeBaseDirectories(const WorkspaceLayout *workspace_layout,
   if (globals->options->install_base.empty()) {
     string install_user_root =
         blaze_util::JoinPath(globals->options->output_user_root, "install");
-    ComputeInstallMd5AndNoteAllFiles(self_path);
+    ComputeInstallMd5AndNoteAllFiles(globals->options->output_user_root,
+                                     self_path);
     globals->options->install_base = blaze_util::JoinPath(install_user_root,
                                                           globals->install_md5);
   } else {
     // We still need to populate globals->install_md5 and
     // globals->extracted_binaries.
-    ComputeInstallMd5AndNoteAllFiles(self_path);
+    ComputeInstallMd5AndNoteAllFiles(globals->options->output_user_root,
+                                     self_path);
   }
 
   if (globals->options->output_base.empty()) {
@@ -1461,9 +2423,12 @@ int GetExitCodeForAbruptExit(const GlobalVariables &globals) {
 
 int Main(int argc, const char *argv[], WorkspaceLayout *workspace_layout,
          OptionProcessor *option_processor) {
-  // Logging must be set first to assure no log statements are missed.
+  // Logging must be set first to assure no log statements are missed. With
+  // --client_debug, INFO statements are written to stderr in the background,
+  // so that a slow terminal does not slow down the client.
   std::unique_ptr<blaze_util::BazelLogHandler> default_handler(
-      new blaze_util::BazelLogHandler());
+      new blaze_util::BazelLogHandler(
+          1024, blaze_util::BazelLogHandler::OverflowPolicy::BLOCK));
   blaze_util::SetLogHandler(std::move(default_handler));
 
   globals = new GlobalVariables(option_processor);
@@ -1483,7 +2448,10 @@ int Main(int argc, const char *argv[], WorkspaceLayout *workspace_layout,
   UnlimitResources();
 
   // Must be done before command line parsing.
-  ComputeWorkspace(workspace_layout);
+  {
+    ScopedClientPhase phase(&globals->client_profile, "ComputeWorkspace");
+    ComputeWorkspace(workspace_layout);
+  }
 
   // Must be done before command line parsing.
   // ParseOptions already populate --client_env, so detect bash before it
@@ -1491,7 +2459,10 @@ int Main(int argc, const char *argv[], WorkspaceLayout *workspace_layout,
   DetectBashOrDie();
 
   globals->binary_path = CheckAndGetBinaryPath(argv[0]);
-  ParseOptions(argc, argv);
+  {
+    ScopedClientPhase phase(&globals->client_profile, "ParseOptions");
+    ParseOptions(argc, argv);
+  }
 
   SetDebugLog(globals->options->client_debug);
   // If client_debug was false, this is ignored, so it's accurate.
@@ -1507,24 +2478,72 @@ int Main(int argc, const char *argv[], WorkspaceLayout *workspace_layout,
   const string self_path = GetSelfPath();
   ComputeBaseDirectories(workspace_layout, self_path);
 
+  if (AnswerInfoLocally(workspace_layout)) {
+    WriteClientProfile();
+    return blaze_exit_code::SUCCESS;
+  }
+
   blaze_server = static_cast<BlazeServer *>(
       new GrpcBlazeServer(globals->options->connect_timeout_secs));
 
-  globals->command_wait_time = blaze_server->AcquireLock();
+  // Read-only commands only need the lock until their request reached the
+  // server, like any other command, but they don't keep each other from doing
+  // so unless one of them has to start the server.
+  const bool shared_lock =
+      !globals->options->batch &&
+      IsReadOnlyCommand(globals->option_processor->GetCommand());
+  {
+    ScopedClientPhase phase(&globals->client_profile, "AcquireLock");
+    globals->command_wait_time = blaze_server->AcquireLock(shared_lock);
+  }
+  if (globals->command_wait_time > 0) {
+    // Show the time spent waiting for another command separately from the cost
+    // of taking the lock.
+    const ClientProfile::Clock::time_point now = ClientProfile::Clock::now();
+    globals->client_profile.AddPhase(
+        "Wait for another command to release the lock",
+        now - std::chrono::milliseconds(globals->command_wait_time), now);
+    BAZEL_LOG(INFO) << "Waited " << globals->command_wait_time
+                    << "ms for the output base lock";
+  }
+
+  if (!shared_lock) {
+    MaybeStartServerEarly(workspace_layout);
+  }
 
   WarnFilesystemType(globals->options->output_base);
 
-  ExtractData(self_path);
+  {
+    ScopedClientPhase phase(&globals->client_profile, "ExtractData");
+    ExtractData(self_path);
+  }
   globals->jvm_path = globals->options->GetJvm();
 
-  blaze_server->Connect();
-  EnsureCorrectRunningVersion(blaze_server);
-  KillRunningServerIfDifferentStartupOptions(workspace_layout, blaze_server);
+  bool another_version, options_differ;
+  ConnectToServer(workspace_layout, &another_version, &options_differ);
+  if (shared_lock &&
+      (!blaze_server->Connected() || another_version || options_differ ||
+       HasServerCwdMoved())) {
+    // Only a client holding the exclusive lock may start or stop the server.
+    BAZEL_LOG(INFO) << "The server has to be started, taking the exclusive "
+                       "lock";
+    if (blaze_server->Connected()) {
+      blaze_server->Disconnect();
+    }
+    {
+      ScopedClientPhase phase(&globals->client_profile, "UpgradeLock");
+      globals->command_wait_time += blaze_server->UpgradeLock();
+    }
+    ConnectToServer(workspace_layout, &another_version, &options_differ);
+  }
+  EnsureCorrectRunningVersion(blaze_server, another_version);
+  KillRunningServerIfDifferentStartupOptions(blaze_server, options_differ);
 
   if (globals->options->batch) {
-    SetScheduling(globals->options->batch_cpu_scheduling,
-                  globals->options->io_nice_level);
+    SetSchedulingForProfile();
     StartStandalone(workspace_layout, blaze_server);
+  } else if (globals->options->session) {
+    RunSession(workspace_layout, blaze_server);
   } else {
     SendServerRequest(workspace_layout, blaze_server);
   }
@@ -1552,6 +2571,7 @@ GrpcBlazeServer::~GrpcBlazeServer() {
 }
 
 bool GrpcBlazeServer::TryConnect(command_server::CommandServer::Stub *client) {
+  ScopedClientPhase phase(&globals->client_profile, "Ping");
   grpc::ClientContext context;
   context.set_deadline(std::chrono::system_clock::now() +
                        std::chrono::seconds(connect_timeout_secs_));
@@ -1582,14 +2602,17 @@ bool GrpcBlazeServer::Connect() {
   std::string ipv4_prefix = "127.0.0.1:";
   std::string ipv6_prefix_1 = "[0:0:0:0:0:0:0:1]:";
   std::string ipv6_prefix_2 = "[::1]:";
+  std::string unix_prefix = "unix:";
 
   if (!blaze_util::ReadFile(blaze_util::JoinPath(server_dir, "command_port"),
                             &port)) {
     return false;
   }
 
-  // Make sure that we are being directed to localhost
-  if (port.compare(0, ipv4_prefix.size(), ipv4_prefix) &&
+  // Make sure that we are being directed to localhost, or to a Unix domain
+  // socket (with --experimental_unix_socket), which is always local.
+  if (port.compare(0, unix_prefix.size(), unix_prefix) &&
+      port.compare(0, ipv4_prefix.size(), ipv4_prefix) &&
       port.compare(0, ipv6_prefix_1.size(), ipv6_prefix_1) &&
       port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2)) {
     return false;
@@ -1614,8 +2637,13 @@ bool GrpcBlazeServer::Connect() {
     return false;
   }
 
-  std::shared_ptr<grpc::Channel> channel(
-      grpc::CreateChannel(port, grpc::InsecureChannelCredentials()));
+  // Let the server send several output chunks ahead of the client writing them
+  // out, so that large outputs like those of `query` are not throttled by the
+  // HTTP/2 flow control round trips.
+  grpc::ChannelArguments channel_args;
+  channel_args.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES, 4 * 1024 * 1024);
+  std::shared_ptr<grpc::Channel> channel(grpc::CreateCustomChannel(
+      port, grpc::InsecureChannelCredentials(), channel_args));
   std::unique_ptr<command_server::CommandServer::Stub> client(
       command_server::CommandServer::NewStub(channel));
 
@@ -1721,9 +2749,7 @@ void GrpcBlazeServer::SendCancelMessage() {
 }
 
 // This will wait indefinitely until the server shuts down
-void GrpcBlazeServer::KillRunningServer() {
-  assert(connected_);
-
+void GrpcBlazeServer::SendShutdown(const vector<string> &args) {
   grpc::ClientContext context;
   command_server::RunRequest request;
   command_server::RunResponse response;
@@ -1732,11 +2758,30 @@ void GrpcBlazeServer::KillRunningServer() {
   request.set_client_description("pid=" + blaze::GetProcessIdAsString() +
                                  " (for shutdown)");
   request.add_arg("shutdown");
+  for (const string &arg : args) {
+    request.add_arg(arg);
+  }
   std::unique_ptr<grpc::ClientReader<command_server::RunResponse>> reader(
       client_->Run(&context, request));
 
   while (reader->Read(&response)) {
   }
+}
+
+void GrpcBlazeServer::ShutDownRunningServerForRestart() {
+  assert(connected_);
+
+  // Once the command is done, the server has saved its state, and what is
+  // left of its shutdown can overlap with the start of the next server.
+  SendShutdown({"--experimental_for_restart"});
+  globals->exiting_server_pid = globals->server_pid;
+  connected_ = false;
+}
+
+void GrpcBlazeServer::KillRunningServer() {
+  assert(connected_);
+
+  SendShutdown({});
 
   // Wait for the server process to terminate (if we know the server PID).
   // If it does not terminate itself gracefully within 1m, terminate it.
@@ -1794,6 +2839,8 @@ unsigned int GrpcBlazeServer::Communicate() {
 
   grpc::ClientContext context;
   command_server::RunResponse response;
+  const ClientProfile::Clock::time_point run_start =
+      ClientProfile::Clock::now();
   std::unique_ptr<grpc::ClientReader<command_server::RunResponse>> reader(
       client_->Run(&context, request));
 
@@ -1808,8 +2855,22 @@ unsigned int GrpcBlazeServer::Communicate() {
   command_server::RunResponse final_response;
   bool finished = false;
   bool finished_warning_emitted = false;
+  bool response_received = false;
+  bool output_received = false;
 
   while (reader->Read(&response)) {
+    if (!response_received) {
+      globals->client_profile.AddPhase("Run (until the first response)",
+                                       run_start, ClientProfile::Clock::now());
+      response_received = true;
+    }
+    if (!output_received && (!response.standard_output().empty() ||
+                             !response.standard_error().empty())) {
+      globals->client_profile.AddInstant("first output",
+                                         ClientProfile::Clock::now());
+      output_received = true;
+    }
+
     if (finished && !finished_warning_emitted) {
       BAZEL_LOG(USER) << "\nServer returned messages after reporting exit code";
       finished_warning_emitted = true;
@@ -1872,6 +2933,8 @@ unsigned int GrpcBlazeServer::Communicate() {
   SendAction(CancelThreadAction::JOIN);
   cancel_thread.join();
 
+  WriteClientProfile();
+
   grpc::Status status = reader->Finish();
   if (!status.ok()) {
     BAZEL_LOG(USER) << "\nServer terminated abruptly (error code: "
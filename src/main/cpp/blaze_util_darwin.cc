@@ -21,6 +21,7 @@
 #include <sys/un.h>
 
 #include <libproc.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -143,7 +144,51 @@ uint64_t GetMillisecondsSinceProcessStart() {
 }
 
 void SetScheduling(bool batch_cpu_scheduling, int io_nice_level) {
-  // stubbed out so we can compile for Darwin.
+  if (batch_cpu_scheduling) {
+    // The closest to SCHED_BATCH: the utility class still gets the CPU when
+    // the machine is busy, but gives way to the work the user is waiting on.
+    // The server and its actions start out in the class of this thread.
+    int err = pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+    if (err != 0) {
+      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+          << "pthread_set_qos_class_self_np(QOS_CLASS_UTILITY) failed: "
+          << strerror(err);
+    }
+  }
+
+  if (io_nice_level >= 0) {
+    // There are no levels within a class as on Linux, so the levels are
+    // spread over the IO policies. Only the lowest level is throttled.
+    int policy;
+    if (io_nice_level <= 3) {
+      policy = IOPOL_IMPORTANT;
+    } else if (io_nice_level <= 5) {
+      policy = IOPOL_STANDARD;
+    } else if (io_nice_level == 6) {
+      policy = IOPOL_UTILITY;
+    } else {
+      policy = IOPOL_THROTTLE;
+    }
+    if (setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, policy) < 0) {
+      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+          << "setiopolicy_np() with policy " << policy << " for level "
+          << io_nice_level << " failed: " << GetLastErrorString();
+    }
+  }
+}
+
+void SetIdleScheduling() {
+  // Both the nice value and the IO policy are inherited by the server and the
+  // actions it spawns.
+  if (setpriority(PRIO_PROCESS, 0, PRIO_MAX) < 0) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "setpriority() failed: " << GetLastErrorString();
+  }
+  if (setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_PROCESS, IOPOL_THROTTLE) <
+      0) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "setiopolicy_np(IOPOL_THROTTLE) failed: " << GetLastErrorString();
+  }
 }
 
 string GetProcessCWD(int pid) {
@@ -246,4 +291,23 @@ int32_t GetExplicitSystemLimit(const int resource) {
   return limit;
 }
 
+uint64_t GetAvailableMemoryBytes() {
+  uint64_t memory;
+  size_t len = sizeof(memory);
+  if (sysctlbyname("hw.memsize", &memory, &len, nullptr, 0) == -1) {
+    return 0;
+  }
+  return memory;
+}
+
+unsigned int GetAvailableCpuCount() {
+  int32_t cores;
+  size_t len = sizeof(cores);
+  if (sysctlbyname("hw.logicalcpu", &cores, &len, nullptr, 0) == -1 ||
+      cores <= 0) {
+    return 0;
+  }
+  return cores;
+}
+
 }   // namespace blaze.
@@ -20,6 +20,7 @@
 #include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/queue.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
@@ -109,6 +110,14 @@ void SetScheduling(bool batch_cpu_scheduling, int io_nice_level) {
   // Stubbed out so we can compile for FreeBSD.
 }
 
+void SetIdleScheduling() {
+  // FreeBSD has no IO priorities, so this only lowers the nice value.
+  if (setpriority(PRIO_PROCESS, 0, PRIO_MAX) < 0) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "setpriority() failed: " << GetLastErrorString();
+  }
+}
+
 string GetProcessCWD(int pid) {
   if (kill(pid, 0) < 0) return "";
   auto procstat = procstat_open_sysctl();
@@ -168,4 +177,18 @@ int32_t GetExplicitSystemLimit(const int resource) {
   return -1;
 }
 
+uint64_t GetAvailableMemoryBytes() {
+  unsigned long memory;  // NOLINT
+  size_t len = sizeof(memory);
+  if (sysctlbyname("hw.physmem", &memory, &len, nullptr, 0) == -1) {
+    return 0;
+  }
+  return memory;
+}
+
+unsigned int GetAvailableCpuCount() {
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT
+  return cores > 0 ? cores : 0;
+}
+
 }  // namespace blaze
@@ -12,10 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <ctype.h>
 #include <errno.h>  // errno, ENAMETOOLONG
 #include <limits.h>
 #include <linux/magic.h>
 #include <pwd.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -129,6 +131,22 @@ void SetScheduling(bool batch_cpu_scheduling, int io_nice_level) {
   }
 }
 
+void SetIdleScheduling() {
+  sched_param param = {};
+  param.sched_priority = 0;
+  if (sched_setscheduler(0, SCHED_IDLE, &param)) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "sched_setscheduler(SCHED_IDLE) failed: " << GetLastErrorString();
+  }
+
+  if (blaze_util::sys_ioprio_set(IOPRIO_WHO_PROCESS, getpid(),
+                                 IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0)) < 0) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "ioprio_set() with class " << IOPRIO_CLASS_IDLE
+        << " failed: " << GetLastErrorString();
+  }
+}
+
 string GetProcessCWD(int pid) {
   char server_cwd[PATH_MAX] = {};
   if (readlink(
@@ -261,4 +279,90 @@ int32_t GetExplicitSystemLimit(const int resource) {
   return -1;
 }
 
+// Reads the whitespace-separated integers at the start of a cgroup control
+// file into values, stopping at the first word that isn't one, such as "max".
+// Returns false if the file cannot be read.
+static bool ReadCgroupValues(const string &path, vector<int64_t> *values) {
+  string contents;
+  if (!blaze_util::ReadFile(path, &contents)) {
+    return false;
+  }
+  const char *p = contents.c_str();
+  while (true) {
+    char *end;
+    errno = 0;
+    const long long value = strtoll(p, &end, 10);  // NOLINT
+    if (end == p || errno != 0 || (*end != '\0' && !isspace(*end))) {
+      return true;
+    }
+    values->push_back(value);
+    p = end;
+  }
+}
+
+uint64_t CapMemoryToCgroupLimit(uint64_t memory, const string &cgroup_root) {
+  // The cgroup v2 layout first, then the v1 one.
+  for (const char *file : {"memory.max", "memory/memory.limit_in_bytes"}) {
+    vector<int64_t> limit;
+    ReadCgroupValues(blaze_util::JoinPath(cgroup_root, file), &limit);
+    // Without a limit, cgroup v1 reports a huge number and v2 says "max".
+    if (!limit.empty() && limit[0] > 0 &&
+        (memory == 0 || static_cast<uint64_t>(limit[0]) < memory)) {
+      memory = limit[0];
+    }
+  }
+  return memory;
+}
+
+unsigned int CapCpusToCgroupQuota(unsigned int cores,
+                                  const string &cgroup_root) {
+  // The quota is the CPU time the cgroup may use per period, in microseconds.
+  // cgroup v2 says "max" without a quota, which the v1 files must not undo.
+  vector<int64_t> quota_and_period;
+  if (!ReadCgroupValues(blaze_util::JoinPath(cgroup_root, "cpu.max"),
+                        &quota_and_period)) {
+    ReadCgroupValues(blaze_util::JoinPath(cgroup_root, "cpu/cpu.cfs_quota_us"),
+                     &quota_and_period);
+    ReadCgroupValues(
+        blaze_util::JoinPath(cgroup_root, "cpu/cpu.cfs_period_us"),
+        &quota_and_period);
+  }
+  if (quota_and_period.size() == 2 && quota_and_period[0] > 0 &&
+      quota_and_period[1] > 0) {
+    const int64_t quota_cores =
+        (quota_and_period[0] + quota_and_period[1] - 1) / quota_and_period[1];
+    if (quota_cores < cores) {
+      cores = quota_cores;
+    }
+  }
+  return cores;
+}
+
+// The cgroup control files are read where they are mounted in a container.
+static const char kCgroupRoot[] = "/sys/fs/cgroup";
+
+uint64_t GetAvailableMemoryBytes() {
+  const long pages = sysconf(_SC_PHYS_PAGES);  // NOLINT
+  const long page_size = sysconf(_SC_PAGESIZE);  // NOLINT
+  uint64_t memory = 0;
+  if (pages > 0 && page_size > 0) {
+    memory = static_cast<uint64_t>(pages) * page_size;
+  }
+  return CapMemoryToCgroupLimit(memory, kCgroupRoot);
+}
+
+unsigned int GetAvailableCpuCount() {
+  cpu_set_t cpus;
+  long cores;  // NOLINT
+  if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+    cores = CPU_COUNT(&cpus);
+  } else {
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (cores <= 0) {
+    return 0;
+  }
+  return CapCpusToCgroupQuota(cores, kCgroupRoot);
+}
+
 }  // namespace blaze
@@ -79,6 +79,11 @@ uint64_t GetMillisecondsSinceProcessStart();
 // on Linux, so it should only be called when necessary.
 void SetScheduling(bool batch_cpu_scheduling, int io_nice_level);
 
+// Lowers the cpu and IO priority of this process, and of the processes it
+// starts, so that they only run when the machine is otherwise idle. Used for
+// --experimental_scheduling_profile=background instead of SetScheduling.
+void SetIdleScheduling();
+
 // Returns the cwd for a process.
 std::string GetProcessCWD(int pid);
 
@@ -102,15 +107,20 @@ class BlazeServerStartup {
  public:
   virtual ~BlazeServerStartup() {}
   virtual bool IsStillAlive() = 0;
-};
 
+  // Blocks until the server signals that it is ready to accept connections,
+  // the server dies, or `milliseconds` elapse, whichever comes first.
+  // Implementations that cannot be notified of the readiness return after a
+  // short interval instead, so that the caller keeps polling.
+  virtual void WaitForReadiness(unsigned int milliseconds) = 0;
+};
 
 // Starts a daemon process with its standard output and standard error
 // redirected (and conditionally appended) to the file "daemon_output". Sets
 // server_startup to an object that can be used to query if the server is
-// still alive. The PID of the daemon started is written into server_dir,
-// both as a symlink (for legacy reasons) and as a file, and returned to the
-// caller.
+// still alive and to wait until it is ready. The PID of the daemon started is
+// written into server_dir, both as a symlink (for legacy reasons) and as a
+// file, and returned to the caller.
 int ExecuteDaemon(const std::string& exe,
                   const std::vector<std::string>& args_vector,
                   const std::map<std::string, EnvVarValue>& env,
@@ -127,6 +137,22 @@ extern const char kListSeparator;
 // Implemented via junctions on Windows.
 bool SymlinkDirectories(const std::string& target, const std::string& link);
 
+// Creates the file ``target`` with the contents of ``source`` without copying
+// them: as a copy-on-write clone where the file system supports that (Btrfs,
+// XFS, APFS), else as a hard link. Clones get ``source``'s permissions, but not
+// necessarily its mtime. Only files owned by root or by the current user, and
+// not writable by anyone else, are shared, so that nobody else can change a
+// file after it is shared.
+// Returns false if the file was not shared; ``target`` then does not exist.
+// Not implemented on Windows, where it always returns false, so the client
+// ignores --experimental_shared_install_base_root there.
+bool ShareFile(const std::string& source, const std::string& target);
+
+// Asks the OS to read the file ``path`` into the page cache in the background,
+// so that a process reading it soon does not wait for the disk. Returns
+// without waiting for the reads. This is only a hint; errors are ignored.
+void PrefetchFile(const std::string& path);
+
 struct BlazeLock {
 #if defined(_WIN32) || defined(__CYGWIN__)
   /* HANDLE */ void* handle;
@@ -136,15 +162,24 @@ struct BlazeLock {
 };
 
 // Acquires a lock on the output base. Exits if the lock cannot be acquired.
+// A ``shared`` lock only excludes exclusive ones, so any number of clients can
+// hold it at the same time.
 // Sets ``lock`` to a value that can subsequently be passed to ReleaseLock().
 // Returns the number of milliseconds spent with waiting for the lock.
 uint64_t AcquireLock(const std::string& output_base, bool batch_mode,
-                     bool block, BlazeLock* blaze_lock);
+                     bool block, bool shared, BlazeLock* blaze_lock);
 
 // Releases the lock on the output base. In case of an error, continues as
 // usual.
 void ReleaseLock(BlazeLock* blaze_lock);
 
+// Takes an exclusive lock on the file ``path``, creating it if needed, and
+// waits for it as long as another process holds it. The lock goes away with
+// the process holding it, so a client that crashes does not leave it behind.
+// Returns false if the file cannot be opened or locked. Sets ``lock`` to a
+// value that can subsequently be passed to ReleaseLock().
+bool AcquireFileLock(const std::string& path, BlazeLock* blaze_lock);
+
 // Verifies whether the server process still exists. Returns true if it does.
 bool VerifyServerProcess(int pid, const std::string& output_base);
 
@@ -166,6 +201,11 @@ void ExcludePathFromBackup(const std::string& path);
 std::string GetHashedBaseDir(const std::string& root,
                              const std::string& hashable);
 
+// Returns a string that identifies the current version of the file at `path`:
+// it changes whenever the file is modified or replaced. Returns the empty
+// string if the file cannot be examined.
+std::string GetFileStamp(const std::string& path);
+
 // Create a safe installation directory where we keep state, installations etc.
 // This method ensures that the directory is created, is owned by the current
 // user, and not accessible to anyone else.
@@ -209,6 +249,30 @@ int GetTerminalColumns();
 // function is implemented for the platform.
 int32_t GetExplicitSystemLimit(const int resource);
 
+// Returns the amount of physical memory available to this process in bytes,
+// which on Linux is capped by the memory limit of its cgroup, as in a
+// container. Returns 0 if it cannot be determined.
+uint64_t GetAvailableMemoryBytes();
+
+// Returns the number of CPU cores available to this process, which on Linux
+// takes its CPU affinity and the CPU quota of its cgroup into account. Returns
+// 0 if it cannot be determined.
+unsigned int GetAvailableCpuCount();
+
+#if defined(__linux__)
+// Returns `memory` capped to the memory limit in the cgroup v2 or v1 control
+// files below `cgroup_root`. A limit of "max" (v2) or of more than `memory`
+// (v1 without a limit) leaves it as it is, and so does 0.
+uint64_t CapMemoryToCgroupLimit(uint64_t memory,
+                                const std::string &cgroup_root);
+
+// Returns `cores` capped to the CPU quota, rounded up, in the cgroup v2 or v1
+// control files below `cgroup_root`. A quota of "max" (v2) or -1 (v1) means
+// there is none.
+unsigned int CapCpusToCgroupQuota(unsigned int cores,
+                                  const std::string &cgroup_root);
+#endif  // defined(__linux__)
+
 // Raises soft system resource limits to hard limits in an attempt to let
 // large builds work. This is a best-effort operation and may or may not be
 // implemented for a given platform. Returns true if all limits were properly
@@ -33,9 +33,20 @@
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>  // FICLONE
+#endif
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>  // NOLINT
 #include <cinttypes>
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/global_variables.h"
@@ -173,6 +184,7 @@ void ExecuteProgram(const string& exe, const vector<string>& args_vector) {
                   << blaze_util::GetCwd();
 
   const char** argv = ConvertStringVectorToArgv(args_vector);
+  blaze_util::FlushLogging();
   execv(exe.c_str(), const_cast<char**>(argv));
 }
 
@@ -182,6 +194,76 @@ bool SymlinkDirectories(const string &target, const string &link) {
   return symlink(target.c_str(), link.c_str()) == 0;
 }
 
+bool ShareFile(const string &source, const string &target) {
+  int source_fd = open(source.c_str(), O_RDONLY);
+  if (source_fd < 0) {
+    return false;
+  }
+  struct stat source_stat;
+  if (fstat(source_fd, &source_stat) < 0 || !S_ISREG(source_stat.st_mode) ||
+      (source_stat.st_uid != 0 && source_stat.st_uid != geteuid()) ||
+      (source_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    close(source_fd);
+    return false;
+  }
+
+#if defined(FICLONE)
+  int target_fd = open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+                       source_stat.st_mode & 0777);
+  if (target_fd >= 0) {
+    bool cloned = ioctl(target_fd, FICLONE, source_fd) == 0;
+    close(target_fd);
+    if (cloned) {
+      close(source_fd);
+      return true;
+    }
+    unlink(target.c_str());
+  }
+#elif defined(__APPLE__)
+  // On APFS. Cloning the open file, rather than the path, clones the file
+  // checked above. The clone is created complete or not at all.
+  if (fclonefileat(source_fd, AT_FDCWD, target.c_str(), 0) == 0) {
+    close(source_fd);
+    return true;
+  }
+#endif
+  close(source_fd);
+
+  if (link(source.c_str(), target.c_str()) < 0) {
+    return false;
+  }
+  // The file we checked above may have been replaced since; if so, the link
+  // points to some other file, which we must not trust.
+  struct stat target_stat;
+  if (lstat(target.c_str(), &target_stat) < 0 ||
+      target_stat.st_dev != source_stat.st_dev ||
+      target_stat.st_ino != source_stat.st_ino) {
+    unlink(target.c_str());
+    return false;
+  }
+  return true;
+}
+
+void PrefetchFile(const string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+#if defined(__linux__) || defined(__FreeBSD__)
+  // A length of 0 means up to the end of the file.
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(__APPLE__)
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    struct radvisory advice;
+    advice.ra_offset = 0;
+    advice.ra_count = static_cast<int>(std::min<off_t>(st.st_size, INT_MAX));
+    fcntl(fd, F_RDADVISE, &advice);
+  }
+#endif
+  close(fd);
+}
+
 // Causes the current process to become a daemon (i.e. a child of
 // init, detached from the terminal, in its own session.)  We don't
 // change cwd, though.
@@ -216,25 +298,60 @@ static void Daemonize(const char* daemon_output,
   (void) dup(STDOUT_FILENO);  // stderr (2>&1)
 }
 
+// The environment variable that tells the server which inherited file
+// descriptor to write a byte to once it is ready to accept connections. Keep in
+// sync with GrpcServerImpl.java.
+static const char kServerReadyFdEnvVar[] = "BAZEL_SERVER_READY_FD";
+
 // Notifies the client about the death of the server process by keeping a socket
 // open in the server. If the server dies for any reason, the socket will be
-// closed, which can be detected by the client.
+// closed, which can be detected by the client. The server also inherits the
+// write end of a pipe, to which it writes a byte once it is ready to accept
+// connections.
 class SocketBlazeServerStartup : public BlazeServerStartup {
  public:
-  SocketBlazeServerStartup(int pipe_fd);
+  SocketBlazeServerStartup(int pipe_fd, int ready_fd);
   virtual ~SocketBlazeServerStartup();
   virtual bool IsStillAlive();
+  virtual void WaitForReadiness(unsigned int milliseconds);
 
  private:
   int fd;
+  int ready_fd;  // -1 once the server has written to it or closed it.
 };
 
-SocketBlazeServerStartup::SocketBlazeServerStartup(int fd)
-    : fd(fd) {
+SocketBlazeServerStartup::SocketBlazeServerStartup(int fd, int ready_fd)
+    : fd(fd), ready_fd(ready_fd) {
 }
 
 SocketBlazeServerStartup::~SocketBlazeServerStartup() {
   close(fd);
+  if (ready_fd >= 0) {
+    close(ready_fd);
+  }
+}
+
+void SocketBlazeServerStartup::WaitForReadiness(unsigned int milliseconds) {
+  if (ready_fd < 0) {
+    // The server does not signal twice, so fall back to polling.
+    TrySleep(std::min(milliseconds, 100u));
+    return;
+  }
+  struct pollfd pfds[2];
+  pfds[0].fd = fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = ready_fd;
+  pfds[1].events = POLLIN;
+  int result;
+  do {
+    result = poll(pfds, 2, milliseconds);
+  } while (result < 0 && errno == EINTR);
+  if (result > 0 && pfds[1].revents != 0) {
+    // Either the readiness byte, or the end of the file if the server has
+    // closed the pipe; the latter is followed by a regular poll.
+    close(ready_fd);
+    ready_fd = -1;
+  }
 }
 
 bool SocketBlazeServerStartup::IsStillAlive() {
@@ -343,6 +460,17 @@ int ExecuteDaemon(const string& exe,
         << "socket creation failed: " << GetLastErrorString();
   }
 
+  // The server inherits the write end, so only the client's end is closed on
+  // exec.
+  int ready_fds[2];
+  if (pipe(ready_fds) || fcntl(ready_fds[0], F_SETFD, FD_CLOEXEC) == -1) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "pipe creation failed: " << GetLastErrorString();
+  }
+  std::map<string, EnvVarValue> daemon_env(env);
+  daemon_env[kServerReadyFdEnvVar] =
+      EnvVarValue(EnvVarAction::SET, ToString(ready_fds[1]));
+
   const char* daemon_output_chars = daemon_output.c_str();
   const char** argv = ConvertStringVectorToArgv(args_vector);
   const char* exe_chars = exe.c_str();
@@ -355,6 +483,7 @@ int ExecuteDaemon(const string& exe,
   } else if (child > 0) {
     // Parent process (i.e. the client)
     close(fds[1]);  // parent keeps one side...
+    close(ready_fds[1]);
     int unused_status;
     waitpid(child, &unused_status, 0);  // child double-forks
     pid_t server_pid = 0;
@@ -371,16 +500,17 @@ int ExecuteDaemon(const string& exe,
     char dummy = 'a';
     WriteToFdWithRetryEintr(fds[0], &dummy, 1,
                        "cannot notify server about having written PID file");
-    *server_startup = new SocketBlazeServerStartup(fds[0]);
+    *server_startup = new SocketBlazeServerStartup(fds[0], ready_fds[0]);
     return server_pid;
   } else {
     // Child process (i.e. the server)
     // NB: There should only be system calls in this branch. See the comment
     // before ExecuteDaemon() to understand why.
     close(fds[0]);  // ...child keeps the other.
+    close(ready_fds[0]);
 
     {
-      WithEnvVars env_obj(env);
+      WithEnvVars env_obj(daemon_env);
       Daemonize(daemon_output_chars, daemon_output_append);
       pid_t server_pid = getpid();
       WriteToFdWithRetryEintr(fds[1], &server_pid, sizeof server_pid,
@@ -410,6 +540,31 @@ string GetHashedBaseDir(const string& root, const string& hashable) {
   return blaze_util::JoinPath(root, digest.String());
 }
 
+string GetFileStamp(const string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return "";
+  }
+  // Include the nanoseconds where the file system has them, so that a file
+  // rewritten within the same second with the same size gets a new stamp.
+#if defined(__APPLE__)
+  const struct timespec& mtim = st.st_mtimespec;
+  const struct timespec& ctim = st.st_ctimespec;
+#else
+  const struct timespec& mtim = st.st_mtim;
+  const struct timespec& ctim = st.st_ctim;
+#endif
+  char buf[160];
+  snprintf(buf, sizeof(buf),
+           "%" PRIu64 ":%" PRIu64 ":%" PRId64 ":%" PRId64 ".%09ld:%" PRId64
+           ".%09ld",
+           static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+           static_cast<int64_t>(st.st_size),
+           static_cast<int64_t>(mtim.tv_sec), static_cast<long>(mtim.tv_nsec),
+           static_cast<int64_t>(ctim.tv_sec), static_cast<long>(ctim.tv_nsec));
+  return buf;
+}
+
 void CreateSecureOutputRoot(const string& path) {
   const char* root = path.c_str();
   struct stat fileinfo = {};
@@ -543,8 +698,56 @@ static int setlk(int fd, struct flock *lock) {
   return -1;
 }
 
+// Like setlk(), but blocks until the lock is available.
+static void setlkw(int fd, struct flock *lock) {
+#ifdef __linux__
+#ifndef F_OFD_SETLKW
+#define F_OFD_SETLKW 38
+#endif
+#endif
+  while (true) {
+#ifdef F_OFD_SETLKW
+    if (fcntl(fd, F_OFD_SETLKW, lock) == 0) return;
+    if (errno == EINTR) continue;
+    if (errno != EINVAL) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "unexpected result from F_OFD_SETLKW: " << GetLastErrorString();
+    }
+#endif
+    if (fcntl(fd, F_SETLKW, lock) == 0) return;
+    if (errno == EDEADLK) {
+      // The kernel's deadlock detection can have false positives for POSIX
+      // locks; just try again a little later.
+      TrySleep(500);
+    } else if (errno != EINTR) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "unexpected result from F_SETLKW: " << GetLastErrorString();
+    }
+  }
+}
+
+// Prints the owner recorded in the lock file if it differs from *owner.
+static void ReportLockOwner(int lockfd, bool block, string *owner) {
+  string buffer(4096, 0);
+  ssize_t r = pread(lockfd, &buffer[0], buffer.size(), 0);
+  if (r < 0) {
+    BAZEL_LOG(WARNING) << "pread() lock file: " << strerror(errno);
+    r = 0;
+  }
+  buffer.resize(r);
+  if (*owner != buffer) {
+    // Each time we learn a new lock owner, print it out.
+    *owner = buffer;
+    BAZEL_LOG(USER) << "Another command holds the client lock: \n" << *owner;
+    if (block) {
+      BAZEL_LOG(USER) << "Waiting for it to complete...";
+      fflush(stderr);
+    }
+  }
+}
+
 uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
-                     BlazeLock* blaze_lock) {
+                     bool shared, BlazeLock* blaze_lock) {
   string lockfile = blaze_util::JoinPath(output_base, "lock");
   int lockfd = open(lockfile.c_str(), O_CREAT|O_RDWR, 0644);
 
@@ -563,51 +766,50 @@ uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
   }
 
   struct flock lock = {};
-  lock.l_type = F_WRLCK;
+  lock.l_type = shared ? F_RDLCK : F_WRLCK;
   lock.l_whence = SEEK_SET;
   lock.l_start = 0;
   // This doesn't really matter now, but allows us to subdivide the lock
   // later if that becomes meaningful.  (Ranges beyond EOF can be locked.)
   lock.l_len = 4096;
 
-  // Take the exclusive server lock.  If we fail, we busy-wait until the lock
-  // becomes available.
+  // Take the server lock.  If we fail, we wait until the lock becomes
+  // available.
   //
-  // We used to rely on fcntl(F_SETLKW) to lazy-wait for the lock to become
-  // available, which is theoretically fine, but doing so prevents us from
-  // determining if the PID of the server holding the lock has changed under the
-  // hood.  There have been multiple bug reports where users (especially macOS
-  // ones) mention that the Blaze invocation hangs on a non-existent PID.  This
-  // should help troubleshoot those scenarios in case there really is a bug
-  // somewhere.
+  // A separate thread waits for the lock in fcntl(F_SETLKW), so that we take it
+  // as soon as the other command releases it. Meanwhile, this thread re-reads
+  // the lock file every 500ms to find out if the process holding the lock has
+  // changed under the hood: there have been multiple bug reports where users
+  // (especially macOS ones) mention that the Blaze invocation hangs on a
+  // non-existent PID.  This should help troubleshoot those scenarios in case
+  // there really is a bug somewhere.
   bool multiple_attempts = false;
   string owner;
   const uint64_t start_time = GetMillisecondsMonotonic();
-  while (setlk(lockfd, &lock) == -1) {
-    string buffer(4096, 0);
-    ssize_t r = pread(lockfd, &buffer[0], buffer.size(), 0);
-    if (r < 0) {
-      BAZEL_LOG(WARNING) << "pread() lock file: " << strerror(errno);
-      r = 0;
-    }
-    buffer.resize(r);
-    if (owner != buffer) {
-      // Each time we learn a new lock owner, print it out.
-      owner = buffer;
-      BAZEL_LOG(USER) << "Another command holds the client lock: \n" << owner;
-      if (block) {
-        BAZEL_LOG(USER) << "Waiting for it to complete...";
-        fflush(stderr);
-      }
-    }
-
+  if (setlk(lockfd, &lock) == -1) {
+    ReportLockOwner(lockfd, block, &owner);
     if (!block) {
       BAZEL_DIE(blaze_exit_code::BAD_ARGV)
           << "Exiting because the lock is held and --noblock_for_lock was "
              "given.";
     }
 
-    TrySleep(500);
+    std::mutex mutex;
+    std::condition_variable locked_cv;
+    bool locked = false;
+    std::thread waiter([lockfd, &lock, &mutex, &locked_cv, &locked]() {
+      setlkw(lockfd, &lock);
+      std::lock_guard<std::mutex> guard(mutex);
+      locked = true;
+      locked_cv.notify_one();
+    });
+    std::unique_lock<std::mutex> guard(mutex);
+    while (!locked_cv.wait_for(guard, std::chrono::milliseconds(500),
+                               [&locked]() { return locked; })) {
+      ReportLockOwner(lockfd, block, &owner);
+    }
+    guard.unlock();
+    waiter.join();
     multiple_attempts = true;
   }
   const uint64_t end_time = GetMillisecondsMonotonic();
@@ -620,13 +822,17 @@ uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
 
   // Identify ourselves in the lockfile.
   // The contents are printed for human consumption when another client
-  // fails to take the lock, but not parsed otherwise.
+  // fails to take the lock, but not parsed otherwise. Of several clients
+  // sharing the lock, the last one to take it is shown.
   (void) ftruncate(lockfd, 0);
   lseek(lockfd, 0, SEEK_SET);
   // Arguably we should ensure this fits in the 4KB we lock.  In practice no one
   // will have a cwd long enough to overflow that, and nothing currently uses
   // the rest of the lock file anyway.
   dprintf(lockfd, "pid=%d\nowner=client\n", getpid());
+  if (shared) {
+    dprintf(lockfd, "shared=true\n");
+  }
   string cwd = blaze_util::GetCwd();
   dprintf(lockfd, "cwd=%s\n", cwd.c_str());
   if (const char *tty = ttyname(STDIN_FILENO)) {  // NOLINT (single-threaded)
@@ -640,6 +846,25 @@ void ReleaseLock(BlazeLock* blaze_lock) {
   close(blaze_lock->lockfd);
 }
 
+bool AcquireFileLock(const string& path, BlazeLock* blaze_lock) {
+  int lockfd = open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+  if (lockfd < 0) {
+    return false;
+  }
+  struct flock lock = {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 1;
+  if (setlk(lockfd, &lock) == -1) {
+    BAZEL_LOG(USER) << "Another client holds '" << path
+                    << "', waiting for it...";
+    setlkw(lockfd, &lock);
+  }
+  blaze_lock->lockfd = lockfd;
+  return true;
+}
+
 bool KillServerProcess(int pid, const string& output_base) {
   // Kill the process and make sure it's dead before proceeding.
   killpg(pid, SIGKILL);
@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <mutex>  // NOLINT
 #include <sstream>
 #include <thread>  // NOLINT (to slience Google-internal linter)
 #include <type_traits>  // static_assert
@@ -243,6 +244,16 @@ void SetScheduling(bool batch_cpu_scheduling, int io_nice_level) {
   // TODO(bazel-team): There should be a similar function on Windows.
 }
 
+void SetIdleScheduling() {
+  // Processes created by an idle priority process inherit its priority class,
+  // so this also covers the server and its actions.
+  if (!SetPriorityClass(GetCurrentProcess(), IDLE_PRIORITY_CLASS)) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "SetPriorityClass(IDLE_PRIORITY_CLASS) failed: "
+        << GetLastErrorString();
+  }
+}
+
 string GetProcessCWD(int pid) {
   // TODO(bazel-team) 2016-11-18: decide whether we need this on Windows and
   // implement or delete.
@@ -429,6 +440,12 @@ class ProcessHandleBlazeServerStartup : public BlazeServerStartup {
            exit_time.dwHighDateTime == 0 && exit_time.dwLowDateTime == 0;
   }
 
+  // The server does not signal its readiness on Windows, so this only returns
+  // early if the server dies.
+  void WaitForReadiness(unsigned int milliseconds) override {
+    ::WaitForSingleObject(proc, milliseconds < 100 ? milliseconds : 100);
+  }
+
  private:
   AutoHandle proc;
 };
@@ -681,11 +698,69 @@ bool SymlinkDirectories(const string &posix_target, const string &posix_name) {
   return true;
 }
 
+bool ShareFile(const string &source, const string &target) {
+  // Hard links would need the POSIX check that nobody else can change the
+  // source, which on Windows means checking its owner and DACL. Until then,
+  // the client ignores --experimental_shared_install_base_root here.
+  return false;
+}
+
+void PrefetchFile(const string &path) {
+#if _WIN32_WINNT >= 0x0602  // Windows 8
+  wstring wpath;
+  string error;
+  if (!blaze_util::AsAbsoluteWindowsPath(path, &wpath, &error)) {
+    return;
+  }
+  HANDLE file = ::CreateFileW(
+      /* lpFileName */ wpath.c_str(),
+      /* dwDesiredAccess */ GENERIC_READ,
+      /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ NULL,
+      /* dwCreationDisposition */ OPEN_EXISTING,
+      /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
+      /* hTemplateFile */ NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  if (mapping != NULL) {
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view != NULL) {
+      // The reads go to the file cache, which keeps the pages once the view
+      // is gone.
+      WIN32_MEMORY_RANGE_ENTRY range;
+      range.VirtualAddress = view;
+      range.NumberOfBytes = static_cast<SIZE_T>(size.QuadPart);
+      PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+      UnmapViewOfFile(view);
+    }
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+#endif
+}
+
 
 #ifndef STILL_ACTIVE
 #define STILL_ACTIVE (259)  // From MSDN about GetExitCodeProcess.
 #endif
 
+// The server process last found by VerifyServerProcess, so that checking the
+// same server again (e.g. while AwaitServerProcessTermination polls it) takes
+// a single OpenProcess and does not re-read server.starttime.
+struct VerifiedServerProcess {
+  int pid;
+  string output_base;
+  uint64_t start_time;
+};
+static std::mutex verified_server_mutex;
+static VerifiedServerProcess verified_server = {-1, "", 0};
+
 // On Windows (and Linux) we use a combination of PID and start time to identify
 // the server process. That is supposed to be unique unless one can start more
 // processes than there are PIDs available within a single jiffy.
@@ -706,6 +781,17 @@ bool VerifyServerProcess(int pid, const string& output_base) {
     return false;
   }
 
+  {
+    std::lock_guard<std::mutex> lock(verified_server_mutex);
+    if (verified_server.pid == pid &&
+        verified_server.start_time == start_time &&
+        verified_server.output_base == output_base) {
+      // Same PID and start time as a process already matched against the
+      // start time file, so it is the same process.
+      return true;
+    }
+  }
+
   string recorded_start_time;
   bool file_present = blaze_util::ReadFile(
       blaze_util::JoinPath(output_base, "server/server.starttime"),
@@ -713,7 +799,17 @@ bool VerifyServerProcess(int pid, const string& output_base) {
 
   // If start time file got deleted, but PID file didn't, assume that this is an
   // old Bazel process that doesn't know how to write start time files yet.
-  return !file_present || recorded_start_time == ToString(start_time);
+  if (!file_present) {
+    return true;
+  }
+  if (recorded_start_time != ToString(start_time)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(verified_server_mutex);
+  verified_server.pid = pid;
+  verified_server.output_base = output_base;
+  verified_server.start_time = start_time;
+  return true;
 }
 
 bool KillServerProcess(int pid, const string& output_base) {
@@ -776,6 +872,30 @@ string GetHashedBaseDir(const string& root, const string& hashable) {
   return blaze_util::JoinPath(root, string(coded_name));
 }
 
+string GetFileStamp(const string& path) {
+  wstring wpath;
+  string error;
+  if (!blaze_util::AsAbsoluteWindowsPath(path, &wpath, &error)) {
+    return "";
+  }
+  AutoHandle handle(::CreateFileW(
+      wpath.c_str(), /* dwDesiredAccess */ 0,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ NULL, OPEN_EXISTING,
+      FILE_FLAG_BACKUP_SEMANTICS, /* hTemplateFile */ NULL));
+  BY_HANDLE_FILE_INFORMATION info;
+  if (!handle.IsValid() || !::GetFileInformationByHandle(handle, &info)) {
+    return "";
+  }
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%lx:%lx%08lx:%lx%08lx:%lx%08lx",
+           info.dwVolumeSerialNumber, info.nFileIndexHigh, info.nFileIndexLow,
+           info.nFileSizeHigh, info.nFileSizeLow,
+           info.ftLastWriteTime.dwHighDateTime,
+           info.ftLastWriteTime.dwLowDateTime);
+  return buf;
+}
+
 void CreateSecureOutputRoot(const string& path) {
   // TODO(bazel-team): implement this properly, by mimicing whatever the POSIX
   // implementation does.
@@ -930,7 +1050,7 @@ uint64_t WindowsClock::GetProcessMilliseconds() const {
 }
 
 uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
-                     BlazeLock* blaze_lock) {
+                     bool shared, BlazeLock* blaze_lock) {
   string lockfile = blaze_util::JoinPath(output_base, "lock");
   wstring wlockfile;
   string error;
@@ -941,19 +1061,22 @@ uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
   }
 
   blaze_lock->handle = INVALID_HANDLE_VALUE;
-  bool first_lock_attempt = true;
+  bool multiple_attempts = false;
   uint64_t st = GetMillisecondsMonotonic();
   while (true) {
+    // The file is shared, so that waiting clients can open it and wait for the
+    // lock in LockFileEx below. Clients that lock the file by opening it
+    // without FILE_SHARE_WRITE still exclude each other: we retry on a sharing
+    // violation.
     blaze_lock->handle = ::CreateFileW(
         /* lpFileName */ wlockfile.c_str(),
         /* dwDesiredAccess */ GENERIC_READ | GENERIC_WRITE,
-        /* dwShareMode */ FILE_SHARE_READ,
+        /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE,
         /* lpSecurityAttributes */ NULL,
-        /* dwCreationDisposition */ CREATE_ALWAYS,
+        /* dwCreationDisposition */ OPEN_ALWAYS,
         /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
         /* hTemplateFile */ NULL);
     if (blaze_lock->handle != INVALID_HANDLE_VALUE) {
-      // We could open the file, so noone else holds a lock on it.
       break;
     }
     if (GetLastError() == ERROR_SHARING_VIOLATION) {
@@ -962,8 +1085,8 @@ uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
         BAZEL_DIE(blaze_exit_code::BAD_ARGV)
             << "Another command is running. Exiting immediately.";
       }
-      if (first_lock_attempt) {
-        first_lock_attempt = false;
+      if (!multiple_attempts) {
+        multiple_attempts = true;
         BAZEL_LOG(USER)
             << "Another command is running. Waiting for it to complete...";
         fflush(stderr);
@@ -976,26 +1099,60 @@ uint64_t AcquireLock(const string& output_base, bool batch_mode, bool block,
           << ") failed: " << GetLastErrorString();
     }
   }
-  uint64_t wait_time = GetMillisecondsMonotonic() - st;
 
-  // We have the lock.
+  // Without LOCKFILE_EXCLUSIVE_LOCK, LockFileEx takes a shared lock.
+  const DWORD lock_flags = shared ? 0 : LOCKFILE_EXCLUSIVE_LOCK;
   OVERLAPPED overlapped = {0};
   if (!LockFileEx(
           /* hFile */ blaze_lock->handle,
-          /* dwFlags */ LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+          /* dwFlags */ lock_flags | LOCKFILE_FAIL_IMMEDIATELY,
           /* dwReserved */ 0,
           /* nNumberOfBytesToLockLow */ 1,
           /* nNumberOfBytesToLockHigh */ 0,
           /* lpOverlapped */ &overlapped)) {
-    BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-        << "AcquireLock(" << lockfile << "): LockFileEx("
-        << blaze_util::WstringToString(wlockfile)
-        << ") failed: " << GetLastErrorString();
+    if (GetLastError() != ERROR_LOCK_VIOLATION) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "AcquireLock(" << lockfile << "): LockFileEx("
+          << blaze_util::WstringToString(wlockfile)
+          << ") failed: " << GetLastErrorString();
+    }
+    // Someone else has the lock.
+    if (!block) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "Another command is running. Exiting immediately.";
+    }
+    if (!multiple_attempts) {
+      multiple_attempts = true;
+      BAZEL_LOG(USER)
+          << "Another command is running. Waiting for it to complete...";
+      fflush(stderr);
+    }
+    // Without LOCKFILE_FAIL_IMMEDIATELY, LockFileEx blocks on a synchronous
+    // handle until the lock is ours, so we take it as soon as the other
+    // command releases it (or exits, which releases it too).
+    overlapped = {0};
+    if (!LockFileEx(
+            /* hFile */ blaze_lock->handle,
+            /* dwFlags */ lock_flags,
+            /* dwReserved */ 0,
+            /* nNumberOfBytesToLockLow */ 1,
+            /* nNumberOfBytesToLockHigh */ 0,
+            /* lpOverlapped */ &overlapped)) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "AcquireLock(" << lockfile << "): LockFileEx("
+          << blaze_util::WstringToString(wlockfile)
+          << ") failed: " << GetLastErrorString();
+    }
   }
+
+  // As on other platforms, only report the time spent waiting for other
+  // commands to complete, not how fast taking a free lock is.
+  uint64_t wait_time =
+      multiple_attempts ? GetMillisecondsMonotonic() - st : 0;
+
   // On other platforms we write some info about this process into the lock file
-  // such as the server PID. On Windows we don't do that because the file is
-  // locked exclusively, meaning other processes may not open the file even for
-  // reading.
+  // such as the server PID. On Windows we don't do that because the locked
+  // region cannot be read by other processes.
 
   return wait_time;
 }
@@ -1006,6 +1163,42 @@ void ReleaseLock(BlazeLock* blaze_lock) {
   CloseHandle(blaze_lock->handle);
 }
 
+bool AcquireFileLock(const string& path, BlazeLock* blaze_lock) {
+  wstring wpath;
+  string error;
+  if (!blaze_util::AsAbsoluteWindowsPath(path, &wpath, &error)) {
+    return false;
+  }
+  HANDLE handle = ::CreateFileW(
+      /* lpFileName */ wpath.c_str(),
+      /* dwDesiredAccess */ GENERIC_READ | GENERIC_WRITE,
+      /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ NULL,
+      /* dwCreationDisposition */ OPEN_ALWAYS,
+      /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
+      /* hTemplateFile */ NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  OVERLAPPED overlapped = {0};
+  if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+                  0, 1, 0, &overlapped)) {
+    if (GetLastError() != ERROR_LOCK_VIOLATION) {
+      CloseHandle(handle);
+      return false;
+    }
+    BAZEL_LOG(USER) << "Another client holds '" << path
+                    << "', waiting for it...";
+    overlapped = {0};
+    if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+      CloseHandle(handle);
+      return false;
+    }
+  }
+  blaze_lock->handle = handle;
+  return true;
+}
+
 #ifdef GetUserName
 // By including <windows.h>, we have GetUserName defined either as
 // GetUserNameA or GetUserNameW.
@@ -1078,6 +1271,21 @@ int GetTerminalColumns() {
   return 80;  // default if not a terminal.
 }
 
+uint64_t GetAvailableMemoryBytes() {
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!::GlobalMemoryStatusEx(&status)) {
+    return 0;
+  }
+  return status.ullTotalPhys;
+}
+
+unsigned int GetAvailableCpuCount() {
+  SYSTEM_INFO info;
+  ::GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+}
+
 bool UnlimitResources() {
   return true;  // Nothing to do so assume success.
 }
@@ -0,0 +1,76 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/client_profile.h"
+
+#include <sstream>
+
+namespace blaze {
+
+using std::string;
+
+ClientProfile::ClientProfile() : origin_(Clock::now()) {}
+
+void ClientProfile::AddPhase(const string &name, Clock::time_point start,
+                             Clock::time_point end) {
+  Event event = {name, MicrosSinceOrigin(start),
+                 MicrosSinceOrigin(end) - MicrosSinceOrigin(start)};
+  events_.push_back(event);
+}
+
+void ClientProfile::AddInstant(const string &name, Clock::time_point time) {
+  Event event = {name, MicrosSinceOrigin(time), -1};
+  events_.push_back(event);
+}
+
+int64_t ClientProfile::MicrosSinceOrigin(Clock::time_point time) const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time - origin_)
+      .count();
+}
+
+// Escapes the characters that cannot appear verbatim in a JSON string.
+static string JsonEscape(const string &str) {
+  string result;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result += ' ';
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+string ClientProfile::ToJson() const {
+  std::ostringstream out;
+  out << "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+         "\"args\":{\"name\":\"client\"}}";
+  for (const Event &event : events_) {
+    out << ",\n{\"name\":\"" << JsonEscape(event.name) << "\",";
+    if (event.duration_micros < 0) {
+      out << "\"ph\":\"i\",\"s\":\"p\",\"ts\":" << event.start_micros << ",";
+    } else {
+      out << "\"ph\":\"X\",\"ts\":" << event.start_micros
+          << ",\"dur\":" << event.duration_micros << ",";
+    }
+    out << "\"pid\":0,\"tid\":0}";
+  }
+  out << "]\n";
+  return out.str();
+}
+
+}  // namespace blaze
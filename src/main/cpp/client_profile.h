@@ -0,0 +1,79 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_CLIENT_PROFILE_H_
+#define BAZEL_SRC_MAIN_CPP_CLIENT_PROFILE_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace blaze {
+
+// Records how long the phases of the client's startup take, to be written out
+// with --client_profile.
+class ClientProfile {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // The timestamps of the events are relative to the time of construction.
+  ClientProfile();
+
+  // Records a phase that took from `start` to `end`.
+  void AddPhase(const std::string &name, Clock::time_point start,
+                Clock::time_point end);
+
+  // Records a point in time, e.g. the first byte of output.
+  void AddInstant(const std::string &name, Clock::time_point time);
+
+  // Returns the events in the JSON trace file format, as a JSON array like
+  // the server's --experimental_generate_json_trace_profile output. The
+  // events are labelled with the process id 0, so that they can be merged
+  // with the server's events, which use the process id 1.
+  std::string ToJson() const;
+
+ private:
+  struct Event {
+    std::string name;
+    int64_t start_micros;
+    int64_t duration_micros;  // -1 for an instant event.
+  };
+
+  int64_t MicrosSinceOrigin(Clock::time_point time) const;
+
+  const Clock::time_point origin_;
+  std::vector<Event> events_;
+};
+
+// Records the time spent in its scope as a phase of a ClientProfile.
+class ScopedClientPhase {
+ public:
+  ScopedClientPhase(ClientProfile *profile, const std::string &name)
+      : profile_(profile), name_(name), start_(ClientProfile::Clock::now()) {}
+
+  ~ScopedClientPhase() {
+    profile_->AddPhase(name_, start_, ClientProfile::Clock::now());
+  }
+
+ private:
+  ClientProfile *profile_;
+  const std::string name_;
+  const ClientProfile::Clock::time_point start_;
+};
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_CLIENT_PROFILE_H_
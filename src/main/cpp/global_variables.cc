@@ -19,6 +19,9 @@ namespace blaze {
 GlobalVariables::GlobalVariables(OptionProcessor* option_processor)
     : option_processor(option_processor),
       server_pid(-1),
+      exiting_server_pid(-1),
+      speculative_server_pid(-1),
+      speculative_server_startup(NULL),
       options(NULL), /* Initialized after parsing with option_processor. */
       startup_time(0),
       extract_data_time(0),
@@ -22,10 +22,12 @@
 #include <string>
 #include <vector>
 
+#include "src/main/cpp/client_profile.h"
 #include "src/main/cpp/util/port.h"  // pid_t on Windows/MSVC
 
 namespace blaze {
 
+class BlazeServerStartup;
 class OptionProcessor;
 class StartupOptions;
 
@@ -78,6 +80,15 @@ struct GlobalVariables {
   // by making PID handling platform-independent or some other idea.
   pid_t server_pid;
 
+  // The PID of a server that was told to shut down for a restart and may
+  // still be exiting while its successor starts, or -1.
+  pid_t exiting_server_pid;
+
+  // The server started before the client finished verifying the install base,
+  // and its startup, if any; -1 and NULL otherwise.
+  pid_t speculative_server_pid;
+  BlazeServerStartup *speculative_server_startup;
+
   // Contains the relative paths of all the files in the attached zip, and is
   // populated during GetInstallBase().
   std::vector<std::string> extracted_binaries;
@@ -100,6 +111,9 @@ struct GlobalVariables {
   // The reason for the server restart.
   RestartReason restart_reason;
 
+  // The phases of the startup, written to --client_profile if given.
+  ClientProfile client_profile;
+
   // The absolute path of the blaze binary.
   std::string binary_path;
 
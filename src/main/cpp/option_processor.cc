@@ -252,13 +252,28 @@ blaze_exit_code::ExitCode OptionProcessor::GetRcFiles(
       internal::DedupeBlazercPaths(candidate_bazelrc_paths);
   deduped_blazerc_paths.push_back(user_bazelrc_path);
 
+  // The parsed rc files are cached in the output user root. The rc files
+  // themselves cannot move the cache, only the command line can.
+  const char* output_user_root_flag =
+      SearchUnaryOption(cmd_line->startup_args, "--output_user_root");
+  const string output_user_root =
+      output_user_root_flag != nullptr
+          ? blaze::AbsolutePathFromFlag(output_user_root_flag)
+          : parsed_startup_options_->output_user_root;
+  string cache_dir = blaze_util::JoinPath(output_user_root, "rc_cache");
+  if (!blaze_util::IsDirectory(output_user_root) ||
+      !blaze_util::MakeDirectories(cache_dir, 0755)) {
+    cache_dir.clear();
+  }
+
   for (const auto& bazelrc_path : deduped_blazerc_paths) {
     if (bazelrc_path.empty()) {
       continue;
     }
     std::unique_ptr<RcFile> parsed_rc;
-    blaze_exit_code::ExitCode parse_rcfile_exit_code = ParseRcFile(
-        workspace_layout, workspace, bazelrc_path, &parsed_rc, error);
+    blaze_exit_code::ExitCode parse_rcfile_exit_code =
+        ParseRcFile(workspace_layout, workspace, bazelrc_path, cache_dir,
+                    &parsed_rc, error);
     if (parse_rcfile_exit_code != blaze_exit_code::SUCCESS) {
       return parse_rcfile_exit_code;
     }
@@ -271,14 +286,16 @@ blaze_exit_code::ExitCode OptionProcessor::GetRcFiles(
 blaze_exit_code::ExitCode ParseRcFile(const WorkspaceLayout* workspace_layout,
                                       const std::string& workspace,
                                       const std::string& rc_file_path,
+                                      const std::string& cache_dir,
                                       std::unique_ptr<RcFile>* result_rc_file,
                                       std::string* error) {
   assert(!rc_file_path.empty());
   assert(result_rc_file != nullptr);
 
   RcFile::ParseError parse_error;
-  std::unique_ptr<RcFile> parsed_file = RcFile::Parse(
-      rc_file_path, workspace_layout, workspace, &parse_error, error);
+  std::unique_ptr<RcFile> parsed_file =
+      RcFile::ParseCached(rc_file_path, workspace_layout, workspace, cache_dir,
+                          &parse_error, error);
   if (parsed_file == nullptr) {
     return internal::ParseErrorToExitCode(parse_error);
   }
@@ -321,6 +338,34 @@ blaze_exit_code::ExitCode OptionProcessor::ParseOptions(
   return blaze_exit_code::SUCCESS;
 }
 
+blaze_exit_code::ExitCode OptionProcessor::ParseCommand(
+    const vector<string>& command_and_args, const string& workspace,
+    const string& cwd, string* error) {
+  assert(cmd_line_ != nullptr);
+  if (command_and_args.empty() || IsArg(command_and_args[0])) {
+    *error = "expected a command, not startup options";
+    return blaze_exit_code::BAD_ARGV;
+  }
+  std::unique_ptr<CommandLine> cmd_line(new CommandLine(
+      cmd_line_->path_to_binary, cmd_line_->startup_args, command_and_args[0],
+      vector<string>(command_and_args.begin() + 1, command_and_args.end())));
+
+  std::vector<std::unique_ptr<RcFile>> rc_files;
+  if (!SearchNullaryOption(cmd_line->startup_args, "ignore_all_rc_files",
+                           false)) {
+    const blaze_exit_code::ExitCode rc_parsing_exit_code = GetRcFiles(
+        workspace_layout_, workspace, cwd, cmd_line.get(), &rc_files, error);
+    if (rc_parsing_exit_code != blaze_exit_code::SUCCESS) {
+      return rc_parsing_exit_code;
+    }
+  }
+
+  cmd_line_ = std::move(cmd_line);
+  blazerc_and_env_command_args_ =
+      GetBlazercAndEnvCommandArgs(cwd, rc_files, GetProcessedEnv());
+  return blaze_exit_code::SUCCESS;
+}
+
 static void PrintStartupOptions(const std::string& source,
                                 const std::vector<std::string>& options) {
   if (!source.empty()) {
@@ -88,6 +88,16 @@ class OptionProcessor {
                                          const std::string& cwd,
                                          std::string* error);
 
+  // Replaces the command and its arguments with command_and_args, e.g. the
+  // next command of a session, keeping the startup options parsed by
+  // ParseOptions. The rc files are read again, since they may have changed;
+  // startup options in them are ignored. Fails for an empty command or one
+  // that starts with an option.
+  blaze_exit_code::ExitCode ParseCommand(
+      const std::vector<std::string>& command_and_args,
+      const std::string& workspace, const std::string& cwd,
+      std::string* error);
+
   // Get the Blaze command to be executed.
   // Returns an empty string if no command was found on the command line.
   std::string GetCommand() const;
@@ -152,10 +162,12 @@ class OptionProcessor {
   std::unique_ptr<StartupOptions> parsed_startup_options_;
 };
 
-// Parses and returns the contents of the rc file.
+// Parses and returns the contents of the rc file, using the results cached in
+// cache_dir unless it is empty.
 blaze_exit_code::ExitCode ParseRcFile(const WorkspaceLayout* workspace_layout,
                                       const std::string& workspace,
                                       const std::string& rc_file_path,
+                                      const std::string& cache_dir,
                                       std::unique_ptr<RcFile>* result_rc_file,
                                       std::string* error);
 
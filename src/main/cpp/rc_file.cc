@@ -20,7 +20,9 @@
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
 #include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/numbers.h"
 #include "src/main/cpp/util/strings.h"
 #include "src/main/cpp/workspace_layout.h"
 
@@ -47,6 +49,134 @@ RcFile::RcFile(string filename, const WorkspaceLayout* workspace_layout,
   return (*error == ParseError::NONE) ? std::move(rcfile) : nullptr;
 }
 
+/*static*/ std::unique_ptr<RcFile> RcFile::ParseCached(
+    std::string filename, const WorkspaceLayout* workspace_layout,
+    std::string workspace, const std::string& cache_dir, ParseError* error,
+    std::string* error_text) {
+  if (cache_dir.empty()) {
+    return Parse(std::move(filename), workspace_layout, std::move(workspace),
+                 error, error_text);
+  }
+  // Imports starting with %workspace% depend on the workspace, so it is part of
+  // the key.
+  const string cache_file =
+      GetHashedBaseDir(cache_dir, filename + "\n" + workspace);
+  std::unique_ptr<RcFile> rcfile(
+      new RcFile(filename, workspace_layout, workspace));
+  if (rcfile->ReadCache(cache_file)) {
+    BAZEL_LOG(INFO) << "Read the parsed RcFile " << rcfile->filename_
+                    << " from " << cache_file;
+    *error = ParseError::NONE;
+    return rcfile;
+  }
+  rcfile = Parse(std::move(filename), workspace_layout, std::move(workspace),
+                 error, error_text);
+  if (rcfile != nullptr && blaze_util::IsDirectory(cache_dir)) {
+    rcfile->WriteCache(cache_file);
+  }
+  return rcfile;
+}
+
+// The cache file consists of lines: the file name and the workspace it was
+// parsed for; the number of files in the import closure, then the path and the
+// GetFileStamp() of each; the number of options, then the command, the index
+// of the source file and the option itself for each. None of these can contain
+// a newline, as the rc file is split into lines before it's tokenized.
+static const char kRcCacheVersion[] = "rc_cache_v1";
+
+bool RcFile::ReadCache(const string& cache_file) {
+  string contents;
+  if (!blaze_util::ReadFile(cache_file, &contents)) {
+    return false;
+  }
+  const vector<string> lines = blaze_util::Split(contents, '\n');
+  size_t i = 0;
+  // Returns the next line, or nullptr at the end of the file.
+  auto next = [&lines, &i]() -> const string* {
+    return i < lines.size() ? &lines[i++] : nullptr;
+  };
+  auto next_count = [&next](size_t* count) {
+    const string* line = next();
+    int value;
+    if (line == nullptr || !blaze_util::safe_strto32(*line, &value) ||
+        value < 0) {
+      return false;
+    }
+    *count = value;
+    return true;
+  };
+
+  const string* line = next();
+  if (line == nullptr || *line != kRcCacheVersion) return false;
+  line = next();
+  if (line == nullptr || *line != filename_) return false;
+  line = next();
+  if (line == nullptr || *line != workspace_) return false;
+
+  size_t num_sources;
+  if (!next_count(&num_sources) || num_sources == 0) return false;
+  vector<string*> sources;
+  for (size_t s = 0; s < num_sources; ++s) {
+    const string* path = next();
+    const string* stamp = next();
+    if (stamp == nullptr || stamp->empty() || *stamp != GetFileStamp(*path)) {
+      return false;
+    }
+    rcfile_paths_.push_back(*path);
+    sources.push_back(&rcfile_paths_.back());
+  }
+
+  size_t num_options;
+  if (!next_count(&num_options)) return false;
+  for (size_t o = 0; o < num_options; ++o) {
+    const string* command = next();
+    size_t source;
+    if (command == nullptr || !next_count(&source) || source >= num_sources) {
+      return false;
+    }
+    const string* option = next();
+    if (option == nullptr) return false;
+    options_[*command].push_back({sources[source], *option});
+  }
+  return true;
+}
+
+void RcFile::WriteCache(const string& cache_file) const {
+  string contents = string(kRcCacheVersion) + "\n" + filename_ + "\n" +
+                    workspace_ + "\n" +
+                    ToString(rcfile_paths_.size()) + "\n";
+  std::unordered_map<const string*, size_t> source_index;
+  for (const string& path : rcfile_paths_) {
+    const string stamp = GetFileStamp(path);
+    if (stamp.empty() || path.find('\n') != string::npos) {
+      return;
+    }
+    const size_t index = source_index.size();
+    source_index[&path] = index;
+    contents += path + "\n" + stamp + "\n";
+  }
+  int num_options = 0;
+  string option_lines;
+  for (const auto& command_options : options_) {
+    for (const RcOption& option : command_options.second) {
+      option_lines += command_options.first + "\n" +
+                      ToString(source_index[option.source_path]) +
+                      "\n" + option.option + "\n";
+      ++num_options;
+    }
+  }
+  contents += ToString(num_options) + "\n" + option_lines;
+
+  // Write to a temporary file and rename it, so that a concurrent client never
+  // reads a partial cache file.
+  const string tmp_file = cache_file + ".tmp." + GetProcessIdAsString();
+  if (!blaze_util::WriteFile(contents, tmp_file) ||
+      blaze_util::RenameDirectory(tmp_file, cache_file) !=
+          blaze_util::kRenameDirectorySuccess) {
+    blaze_util::UnlinkPath(tmp_file);
+  }
+}
+
 RcFile::ParseError RcFile::ParseFile(const string& filename,
                                      deque<string>* import_stack,
                                      string* error_text) {
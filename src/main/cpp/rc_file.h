@@ -41,6 +41,15 @@ class RcFile {
       std::string filename, const WorkspaceLayout* workspace_layout,
       std::string workspace, ParseError* error, std::string* error_text);
 
+  // Like Parse, but reuses the result of an earlier parse of the same file that
+  // was stored in cache_dir, as long as no file in its import closure changed
+  // since. Successful parses are stored in cache_dir if it exists. An empty
+  // cache_dir disables the cache.
+  static std::unique_ptr<RcFile> ParseCached(
+      std::string filename, const WorkspaceLayout* workspace_layout,
+      std::string workspace, const std::string& cache_dir, ParseError* error,
+      std::string* error_text);
+
   // Returns all relevant rc sources for this file (including itself).
   const std::deque<std::string>& sources() const { return rcfile_paths_; }
 
@@ -61,6 +70,13 @@ class RcFile {
                        std::deque<std::string>* import_stack,
                        std::string* error_text);
 
+  // Populates the object from the cache file, if the files it was parsed from
+  // are unchanged. Returns false on a miss.
+  bool ReadCache(const std::string& cache_file);
+  // Stores the parsed object in the cache file. Failing to do so is not an
+  // error.
+  void WriteCache(const std::string& cache_file) const;
+
   const std::string filename_;
 
   // Workspace definition.
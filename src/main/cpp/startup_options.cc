@@ -14,6 +14,7 @@
 #include "src/main/cpp/startup_options.h"
 
 #include <assert.h>
+#include <ctype.h>
 
 #include <cstdio>
 #include <cstdlib>
@@ -77,11 +78,20 @@ StartupOptions::StartupOptions(const string &product_name,
       deep_execroot(true),
       block_for_lock(true),
       host_jvm_debug(false),
+      adaptive_host_jvm_args(false),
+      server_class_data_sharing(false),
+      server_checkpoint(false),
+      prefetch_install_base(false),
       batch(false),
+      session(false),
       batch_cpu_scheduling(false),
       io_nice_level(-1),
+      scheduling_profile("interactive"),
+      idle_shutdown_on_memory_pressure(false),
       oom_more_eagerly(false),
       oom_more_eagerly_threshold(100),
+      unix_socket(false),
+      posix_spawn(false),
       write_command_log(true),
       watchfs(false),
       fatal_event_bus_exceptions(false),
@@ -129,15 +139,26 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterNullaryStartupFlag("client_debug");
   RegisterNullaryStartupFlag("deep_execroot");
   RegisterNullaryStartupFlag("expand_configs_in_place");
+  RegisterNullaryStartupFlag("experimental_adaptive_host_jvm_args");
+  RegisterNullaryStartupFlag("experimental_idle_shutdown_on_memory_pressure");
   RegisterNullaryStartupFlag("experimental_oom_more_eagerly");
+  RegisterNullaryStartupFlag("experimental_posix_spawn");
+  RegisterNullaryStartupFlag("experimental_prefetch_install_base");
+  RegisterNullaryStartupFlag("experimental_server_checkpoint");
+  RegisterNullaryStartupFlag("experimental_server_class_data_sharing");
+  RegisterNullaryStartupFlag("experimental_session");
+  RegisterNullaryStartupFlag("experimental_unix_socket");
   RegisterNullaryStartupFlag("fatal_event_bus_exceptions");
   RegisterNullaryStartupFlag("host_jvm_debug");
   RegisterNullaryStartupFlag("ignore_all_rc_files");
   RegisterNullaryStartupFlag("watchfs");
   RegisterNullaryStartupFlag("write_command_log");
+  RegisterUnaryStartupFlag("client_profile");
   RegisterUnaryStartupFlag("command_port");
   RegisterUnaryStartupFlag("connect_timeout_secs");
   RegisterUnaryStartupFlag("experimental_oom_more_eagerly_threshold");
+  RegisterUnaryStartupFlag("experimental_scheduling_profile");
+  RegisterUnaryStartupFlag("experimental_shared_install_base_root");
   RegisterUnaryStartupFlag("host_javabase");
   RegisterUnaryStartupFlag("host_jvm_args");
   RegisterUnaryStartupFlag("host_jvm_profile");
@@ -199,10 +220,19 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
                                      "--output_user_root")) != NULL) {
     output_user_root = blaze::AbsolutePathFromFlag(value);
     option_sources["output_user_root"] = rcfile;
+  } else if ((value = GetUnaryOption(
+                  arg, next_arg, "--experimental_shared_install_base_root")) !=
+             NULL) {
+    shared_install_base_root = blaze::AbsolutePathFromFlag(value);
+    option_sources["shared_install_base_root"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg,
                                      "--server_jvm_out")) != NULL) {
     server_jvm_out = blaze::AbsolutePathFromFlag(value);
     option_sources["server_jvm_out"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--client_profile")) != NULL) {
+    client_profile = blaze::AbsolutePathFromFlag(value);
+    option_sources["client_profile"] = rcfile;
   } else if (GetNullaryOption(arg, "--deep_execroot")) {
     deep_execroot = true;
     option_sources["deep_execroot"] = rcfile;
@@ -215,6 +245,40 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
   } else if (GetNullaryOption(arg, "--host_jvm_debug")) {
     host_jvm_debug = true;
     option_sources["host_jvm_debug"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_adaptive_host_jvm_args")) {
+    adaptive_host_jvm_args = true;
+    option_sources["experimental_adaptive_host_jvm_args"] = rcfile;
+  } else if (GetNullaryOption(arg,
+                              "--noexperimental_adaptive_host_jvm_args")) {
+    adaptive_host_jvm_args = false;
+    option_sources["experimental_adaptive_host_jvm_args"] = rcfile;
+  } else if (GetNullaryOption(arg,
+                              "--experimental_server_class_data_sharing")) {
+    server_class_data_sharing = true;
+    option_sources["experimental_server_class_data_sharing"] = rcfile;
+  } else if (GetNullaryOption(arg,
+                              "--noexperimental_server_class_data_sharing")) {
+    server_class_data_sharing = false;
+    option_sources["experimental_server_class_data_sharing"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_session")) {
+    session = true;
+    option_sources["experimental_session"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noexperimental_session")) {
+    session = false;
+    option_sources["experimental_session"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_prefetch_install_base")) {
+    prefetch_install_base = true;
+    option_sources["experimental_prefetch_install_base"] = rcfile;
+  } else if (GetNullaryOption(arg,
+                              "--noexperimental_prefetch_install_base")) {
+    prefetch_install_base = false;
+    option_sources["experimental_prefetch_install_base"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_server_checkpoint")) {
+    server_checkpoint = true;
+    option_sources["experimental_server_checkpoint"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noexperimental_server_checkpoint")) {
+    server_checkpoint = false;
+    option_sources["experimental_server_checkpoint"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg,
                                      "--host_jvm_profile")) != NULL) {
     host_jvm_profile = value;
@@ -271,6 +335,19 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
       return blaze_exit_code::BAD_ARGV;
     }
     option_sources["io_nice_level"] = rcfile;
+  } else if ((value = GetUnaryOption(
+                  arg, next_arg, "--experimental_scheduling_profile")) !=
+             NULL) {
+    if (string(value) != "interactive" && string(value) != "background") {
+      blaze_util::StringPrintf(
+          error,
+          "Invalid argument to --experimental_scheduling_profile: '%s'. Must "
+          "be 'interactive' or 'background'.",
+          value);
+      return blaze_exit_code::BAD_ARGV;
+    }
+    scheduling_profile = value;
+    option_sources["scheduling_profile"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg, "--max_idle_secs")) !=
              NULL) {
     if (!blaze_util::safe_strto32(value, &max_idle_secs) ||
@@ -286,6 +363,26 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(
   } else if (GetNullaryOption(arg, "--noexperimental_oom_more_eagerly")) {
     oom_more_eagerly = false;
     option_sources["experimental_oom_more_eagerly"] = rcfile;
+  } else if (GetNullaryOption(
+                 arg, "--experimental_idle_shutdown_on_memory_pressure")) {
+    idle_shutdown_on_memory_pressure = true;
+    option_sources["experimental_idle_shutdown_on_memory_pressure"] = rcfile;
+  } else if (GetNullaryOption(
+                 arg, "--noexperimental_idle_shutdown_on_memory_pressure")) {
+    idle_shutdown_on_memory_pressure = false;
+    option_sources["experimental_idle_shutdown_on_memory_pressure"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_unix_socket")) {
+    unix_socket = true;
+    option_sources["experimental_unix_socket"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noexperimental_unix_socket")) {
+    unix_socket = false;
+    option_sources["experimental_unix_socket"] = rcfile;
+  } else if (GetNullaryOption(arg, "--experimental_posix_spawn")) {
+    posix_spawn = true;
+    option_sources["experimental_posix_spawn"] = rcfile;
+  } else if (GetNullaryOption(arg, "--noexperimental_posix_spawn")) {
+    posix_spawn = false;
+    option_sources["experimental_posix_spawn"] = rcfile;
   } else if ((value = GetUnaryOption(
                   arg, next_arg,
                   "--experimental_oom_more_eagerly_threshold")) != NULL) {
@@ -504,9 +601,119 @@ blaze_exit_code::ExitCode StartupOptions::AddJVMArguments(
     const string &host_javabase, std::vector<string> *result,
     const vector<string> &user_options, string *error) const {
   AddJVMLoggingArguments(result);
+  if (adaptive_host_jvm_args) {
+    AddAdaptiveJVMArguments(GetAvailableMemoryBytes(), GetAvailableCpuCount(),
+                            user_options, result);
+  }
+  if (server_class_data_sharing) {
+    string java_release;
+    blaze_util::ReadFile(blaze_util::JoinPath(host_javabase, "release"),
+                         &java_release);
+    AddClassDataSharingArguments(java_release, install_base, user_options,
+                                 result);
+  }
   return AddJVMMemoryArguments(host_javabase, result, user_options, error);
 }
 
+void StartupOptions::AddAdaptiveJVMArguments(uint64_t memory_bytes,
+                                             unsigned int cores,
+                                             const vector<string> &user_options,
+                                             vector<string> *result) {
+  auto user_sets = [&user_options](const string &prefix) {
+    for (const string &option : user_options) {
+      if (option.compare(0, prefix.size(), prefix) == 0) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const uint64_t memory_mb = memory_bytes >> 20;
+  if (memory_mb > 0 && !user_sets("-Xmx")) {
+    // Half of the memory, leaving the rest to the actions the server spawns,
+    // and a quarter of anything beyond 16GB. The JVM cannot use compressed
+    // object pointers with a heap of 32GB or more.
+    uint64_t heap_mb = memory_mb <= 16384 ? memory_mb / 2
+                                          : 8192 + (memory_mb - 16384) / 4;
+    if (heap_mb > 31 * 1024) {
+      heap_mb = 31 * 1024;
+    }
+    result->push_back("-Xmx" + ToString(heap_mb) + "m");
+  }
+
+  // Like the JVM's own definition of a "server class machine", but applied to
+  // the resources of the container rather than those of the host.
+  const bool small_machine =
+      (cores > 0 && cores < 2) || (memory_mb > 0 && memory_mb < 2048);
+  bool user_sets_gc = false;
+  for (const string &option : user_options) {
+    if (option.compare(0, 8, "-XX:+Use") == 0 && option.size() > 10 &&
+        option.compare(option.size() - 2, 2, "GC") == 0) {
+      user_sets_gc = true;
+    }
+  }
+  if ((cores > 0 || memory_mb > 0) && !user_sets_gc) {
+    result->push_back(small_machine ? "-XX:+UseSerialGC" : "-XX:+UseG1GC");
+  }
+  if (cores > 0 && !small_machine && !user_sets("-XX:ParallelGCThreads=")) {
+    // The JVM's default for the number of cores.
+    const unsigned int threads = cores <= 8 ? cores : 8 + (cores - 8) * 5 / 8;
+    result->push_back("-XX:ParallelGCThreads=" + ToString(threads));
+  }
+}
+
+void StartupOptions::AddClassDataSharingArguments(
+    const string &java_release, const string &archive_dir,
+    const vector<string> &user_options, vector<string> *result) {
+  for (const string &option : user_options) {
+    if (option.compare(0, 8, "-Xshare:") == 0 ||
+        option.compare(0, 22, "-XX:SharedArchiveFile=") == 0 ||
+        option.compare(0, 25, "-XX:ArchiveClassesAtExit=") == 0) {
+      return;
+    }
+  }
+
+  // E.g. JAVA_VERSION="11.0.2", or "1.8.0_172" before JDK 9.
+  static const char kVersionKey[] = "JAVA_VERSION=\"";
+  string version;
+  for (const string &line : blaze_util::Split(java_release, '\n')) {
+    if (line.compare(0, sizeof(kVersionKey) - 1, kVersionKey) == 0) {
+      version = line.substr(sizeof(kVersionKey) - 1);
+      version = version.substr(0, version.find('"'));
+    }
+  }
+  int feature = 0;
+  const string feature_part = version.compare(0, 2, "1.") == 0
+                                  ? version.substr(2)
+                                  : version;
+  for (size_t i = 0;
+       i < feature_part.size() && feature_part[i] >= '0' &&
+       feature_part[i] <= '9';
+       ++i) {
+    feature = feature * 10 + (feature_part[i] - '0');
+  }
+  if (feature < 13) {
+    return;
+  }
+
+  // The archive is only valid for the JDK that wrote it, and the install base
+  // for the classes in it, so an upgrade of either starts a fresh one.
+  string archive_name = "server-";
+  for (char c : version) {
+    archive_name += isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  const string archive =
+      blaze_util::JoinPath(archive_dir, archive_name + ".jsa");
+  if (blaze_util::PathExists(archive)) {
+    // If the archive turns out to be unusable, the JVM starts without it.
+    result->push_back("-XX:SharedArchiveFile=" +
+                      blaze_util::PathAsJvmFlag(archive));
+  } else {
+    result->push_back("-XX:ArchiveClassesAtExit=" +
+                      blaze_util::PathAsJvmFlag(archive));
+  }
+}
+
 void StartupOptions::AddJVMLoggingArguments(std::vector<string> *result) const {
   // Configure logging
   const string propFile =
@@ -14,6 +14,8 @@
 #ifndef BAZEL_SRC_MAIN_CPP_STARTUP_OPTIONS_H_
 #define BAZEL_SRC_MAIN_CPP_STARTUP_OPTIONS_H_
 
+#include <stdint.h>
+
 #include <map>
 #include <memory>
 #include <set>
@@ -170,6 +172,26 @@ class StartupOptions {
       const std::string &host_javabase, std::vector<std::string> *result,
       const std::vector<std::string> &user_options, std::string *error) const;
 
+  // Adds the JVM flags for --experimental_adaptive_host_jvm_args to result: a
+  // maximum heap size, a garbage collector and its number of threads chosen for
+  // the given memory and cores, either of which may be 0 if unknown. Leaves out
+  // the flags that user_options already set.
+  static void AddAdaptiveJVMArguments(
+      uint64_t memory_bytes, unsigned int cores,
+      const std::vector<std::string> &user_options,
+      std::vector<std::string> *result);
+
+  // Adds the JVM flags for --experimental_server_class_data_sharing to result,
+  // given the contents of the "release" file of the server's JDK: the server
+  // maps the class-data sharing archive that an earlier server with the same
+  // JDK left in archive_dir, or else writes one there when it exits. Only
+  // JDK 13 and later can archive the classes a running JVM loaded; nothing is
+  // added for older ones, or if user_options already set up class sharing.
+  static void AddClassDataSharingArguments(
+      const std::string &java_release, const std::string &archive_dir,
+      const std::vector<std::string> &user_options,
+      std::vector<std::string> *result);
+
   // Adds JVM logging-related flags for Bazel.
   //
   // This is called by StartupOptions::AddJVMArguments and is a separate method
@@ -208,6 +230,11 @@ class StartupOptions {
   // Installation base for a specific release installation.
   std::string install_base;
 
+  // If set, the installation is extracted once into an MD5-named directory
+  // under this root, e.g. shared by all the users of a machine, and the files
+  // of install_base are shared with it instead of being extracted again.
+  std::string shared_install_base_root;
+
   // The toplevel directory containing Blaze's output.  When Blaze is
   // run by a test, we use TEST_TMPDIR, simplifying the correct
   // hermetic invocation of Blaze from tests.
@@ -231,12 +258,33 @@ class StartupOptions {
 
   bool host_jvm_debug;
 
+  // If true, the heap size and the garbage collector of the server are chosen
+  // for the memory and cores available to the client.
+  bool adaptive_host_jvm_args;
+
+  // If true, the server starts from an archive of the classes it loaded on
+  // its first run, kept in the install base.
+  bool server_class_data_sharing;
+
+  // If true, a warmed-up server is checkpointed under the output user root,
+  // and later servers are restored from that checkpoint. Needs a JDK with
+  // CRaC (Coordinated Restore at Checkpoint) support.
+  bool server_checkpoint;
+
+  // If true, the client asks the OS to read the server jar and the files of
+  // the embedded JDK into the page cache as it starts the server.
+  bool prefetch_install_base;
+
   std::string host_jvm_profile;
 
   std::vector<std::string> host_jvm_args;
 
   bool batch;
 
+  // If true, the client runs the commands it reads from stdin, one per line,
+  // on the same server connection.
+  bool session;
+
   // From the man page: "This policy is useful for workloads that are
   // non-interactive, but do not want to lower their nice value, and for
   // workloads that want a deterministic scheduling policy without
@@ -247,12 +295,31 @@ class StartupOptions {
   // for best-effort scheduling. 0 is highest priority, 7 is lowest.
   int io_nice_level;
 
+  // "interactive" leaves the scheduling to --batch_cpu_scheduling and
+  // --io_nice_level. "background" runs Blaze only when the CPU and the disks
+  // are otherwise idle, and overrides those two flags.
+  std::string scheduling_profile;
+
   int max_idle_secs;
 
+  // If true, an idle server shuts down early when the machine is short of
+  // memory and a garbage collection did not help.
+  bool idle_shutdown_on_memory_pressure;
+
   bool oom_more_eagerly;
 
   int oom_more_eagerly_threshold;
 
+  // If true, the server listens on a Unix domain socket in its server
+  // directory instead of on a loopback TCP port, where supported. Not on
+  // Windows: neither the gRPC C++ client nor Netty has a transport for
+  // AF_UNIX or named pipes there, so the server keeps using TCP.
+  bool unix_socket;
+
+  // If true, the server starts subprocesses with posix_spawn through JNI
+  // instead of java.lang.ProcessBuilder. Not on Windows.
+  bool posix_spawn;
+
   bool write_command_log;
 
   // If true, Blaze will listen to OS-level file change notifications.
@@ -289,6 +356,10 @@ class StartupOptions {
   // Whether to output addition debugging information in the client.
   bool client_debug;
 
+  // If supplied, the file to write the duration of the client's startup phases
+  // to, in the JSON trace file format.
+  std::string client_profile;
+
   // Value of the java.util.logging.FileHandler.formatter Java property.
   std::string java_logging_formatter;
 
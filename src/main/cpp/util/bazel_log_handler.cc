@@ -25,14 +25,41 @@
 
 namespace blaze_util {
 
+// Returns the line that a statement is logged as.
+static std::string FormatMessage(LogLevel level, const std::string& filename,
+                                 int line, const std::string& message) {
+  std::ostringstream entry;
+  entry << "[bazel " << LogLevelName(level) << " " << filename << ":" << line
+        << "] " << message << "\n";
+  return entry.str();
+}
+
 BazelLogHandler::BazelLogHandler()
+    : BazelLogHandler(0, OverflowPolicy::BLOCK) {}
+
+BazelLogHandler::BazelLogHandler(size_t max_queued_messages,
+                                 OverflowPolicy overflow_policy)
     : output_stream_set_(false),
       logging_deactivated_(false),
       buffer_stream_(new std::stringstream()),
       output_stream_(),
-      owned_output_stream_() {}
+      owned_output_stream_(),
+      max_queued_messages_(max_queued_messages),
+      overflow_policy_(overflow_policy),
+      dropped_messages_(0),
+      writing_(false),
+      stopping_(false) {}
 
 BazelLogHandler::~BazelLogHandler() {
+  if (writer_.joinable()) {
+    // Let the background thread write what is queued, then stop.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    queued_.notify_one();
+    writer_.join();
+  }
   if (!logging_deactivated_) {
     // If SetLoggingOutputStream was never called, dump the buffer to stderr,
     // otherwise, flush the stream.
@@ -72,8 +99,29 @@ void BazelLogHandler::HandleMessage(LogLevel level, const std::string& filename,
   } else {
     log_stream = output_stream_;
   }
-  (*log_stream) << "[bazel " << LogLevelName(level) << " " << filename << ":"
-                << line << "] " << message << std::endl;
+  std::string entry = FormatMessage(level, filename, line, message);
+  if (writer_.joinable()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (level == LOGLEVEL_INFO) {
+      if (queue_.size() >= max_queued_messages_) {
+        if (overflow_policy_ == OverflowPolicy::DROP) {
+          dropped_messages_++;
+          return;
+        }
+        written_.wait(lock, [this]() {
+          return queue_.size() < max_queued_messages_;
+        });
+      }
+      queue_.push_back(std::move(entry));
+      queued_.notify_one();
+      return;
+    }
+    // Keep the order of the statements: write this one after the queued ones.
+    AwaitQueueWritten(&lock);
+    (*log_stream) << entry << std::flush;
+  } else {
+    (*log_stream) << entry << std::flush;
+  }
 
   // If we have a fatal message, exit with the provided error code.
   if (level == LOGLEVEL_FATAL) {
@@ -129,6 +177,55 @@ void BazelLogHandler::FlushBufferToNewStreamAndSet(
     (*output_stream_) << buffer_stream_->str();
     buffer_stream_ = nullptr;
     output_stream_->flush();
+    if (max_queued_messages_ > 0) {
+      writer_ = std::thread(&BazelLogHandler::WriteQueue, this);
+    }
+  }
+}
+
+void BazelLogHandler::Flush() {
+  if (writer_.joinable()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    AwaitQueueWritten(&lock);
+  }
+}
+
+void BazelLogHandler::AwaitQueueWritten(std::unique_lock<std::mutex>* lock) {
+  written_.wait(*lock, [this]() { return queue_.empty() && !writing_; });
+}
+
+void BazelLogHandler::WriteQueue() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queued_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;  // stopping, and everything queued was written
+    }
+    // Take all queued statements at once, so that HandleMessage only waits for
+    // the lock while we swap the queues, never while we write.
+    std::deque<std::string> batch;
+    batch.swap(queue_);
+    size_t dropped_messages = dropped_messages_;
+    dropped_messages_ = 0;
+    writing_ = true;
+    written_.notify_all();
+    lock.unlock();
+
+    for (const std::string& entry : batch) {
+      (*output_stream_) << entry;
+    }
+    if (dropped_messages > 0) {
+      std::ostringstream message;
+      message << "Dropped " << dropped_messages
+              << " log statements because the log output was too slow";
+      (*output_stream_) << FormatMessage(LOGLEVEL_WARNING, __FILE__, __LINE__,
+                                         message.str());
+    }
+    output_stream_->flush();
+
+    lock.lock();
+    writing_ = false;
+    written_.notify_all();
   }
 }
 
@@ -15,7 +15,11 @@
 #ifndef BAZEL_SRC_MAIN_CPP_BAZEL_LOG_HANDLER_H_
 #define BAZEL_SRC_MAIN_CPP_BAZEL_LOG_HANDLER_H_
 
+#include <condition_variable>  // NOLINT
+#include <deque>
 #include <iostream>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 
 #include "src/main/cpp/util/logging.h"
 
@@ -26,9 +30,28 @@ namespace blaze_util {
 // startup, logs are buffered until SetOutputStream is called. At that point,
 // all past log statements are dumped in the appropriate stream, and all
 // following statements are logged directly.
+//
+// An asynchronous handler queues INFO statements once the output stream is set
+// and writes them from a background thread, so that a slow stream does not
+// slow down the client. Statements of level USER and above are written after
+// the queued ones, before HandleMessage returns.
 class BazelLogHandler : public blaze_util::LogHandler {
  public:
+  // What an asynchronous handler does with an INFO statement when its queue is
+  // full.
+  enum class OverflowPolicy {
+    // Wait until the background thread has taken the queued statements.
+    BLOCK,
+    // Drop the statement. The number of dropped statements is logged with the
+    // next statements written.
+    DROP,
+  };
+
+  // Creates a handler that writes every statement synchronously.
   BazelLogHandler();
+  // Creates an asynchronous handler, which queues at most max_queued_messages
+  // INFO statements. A max_queued_messages of 0 makes it synchronous.
+  BazelLogHandler(size_t max_queued_messages, OverflowPolicy overflow_policy);
   ~BazelLogHandler() override;
 
   void HandleMessage(blaze_util::LogLevel level, const std::string& filename,
@@ -38,8 +61,17 @@ class BazelLogHandler : public blaze_util::LogHandler {
       std::unique_ptr<std::ostream> new_output_stream) override;
   void SetOutputStreamToStderr() override;
 
+  // Waits until all queued statements are written to the output stream and
+  // flushes it. Does nothing for a synchronous handler.
+  void Flush() override;
+
  private:
   void FlushBufferToNewStreamAndSet(std::ostream* new_output_stream);
+  // Waits until the background thread is idle with nothing queued, so that the
+  // caller may write to output_stream_ while it holds the lock.
+  void AwaitQueueWritten(std::unique_lock<std::mutex>* lock);
+  // The loop of the background thread writing the queued statements.
+  void WriteQueue();
   bool output_stream_set_;
   bool logging_deactivated_;
   std::unique_ptr<std::stringstream> buffer_stream_;
@@ -48,6 +80,23 @@ class BazelLogHandler : public blaze_util::LogHandler {
   // A unique pts to the output_stream, if we need to keep ownership of the
   // stream. In the case of stderr logging, this is null.
   std::unique_ptr<std::ostream> owned_output_stream_;
+
+  // For asynchronous handlers: the most statements queued, or 0 if the handler
+  // is synchronous, and what to do when the queue is full.
+  const size_t max_queued_messages_;
+  const OverflowPolicy overflow_policy_;
+  // Protects the members below. The background thread writes to
+  // output_stream_ without holding it, while writing_ is true.
+  std::mutex mutex_;
+  // Signaled when statements are queued or the handler is destroyed.
+  std::condition_variable queued_;
+  // Signaled when the background thread has taken or written statements.
+  std::condition_variable written_;
+  std::deque<std::string> queue_;
+  size_t dropped_messages_;
+  bool writing_;
+  bool stopping_;
+  std::thread writer_;
 };
 }  // namespace blaze_util
 
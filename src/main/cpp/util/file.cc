@@ -109,10 +109,6 @@ class DirectoryTreeWalker : public DirectoryEntryConsumer {
   _ForEachDirectoryEntry _walk_entries;
 };
 
-void GetAllFilesUnder(const string &path, vector<string> *result) {
-  _GetAllFilesUnder(path, result, &ForEachDirectoryEntry);
-}
-
 void _GetAllFilesUnder(const string &path,
                        vector<string> *result,
                        _ForEachDirectoryEntry walk_entries) {
@@ -67,9 +67,11 @@ bool WriteFile(const std::string &content, const std::string &filename,
 //
 // Does not follow symlinks / junctions.
 //
-// Populates `result` with the full paths of the files. Every entry will have
-// `path` as its prefix. If `path` is a file, `result` contains just this
-// file.
+// Populates `result` with the full paths of the files, in no particular order.
+// Every entry will have `path` as its prefix. If `path` is a file, `result`
+// contains just this file.
+//
+// Reads several directories in parallel where supported.
 void GetAllFilesUnder(const std::string &path,
                       std::vector<std::string> *result);
 
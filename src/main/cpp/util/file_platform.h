@@ -19,6 +19,7 @@
 
 #include <cinttypes>
 #include <string>
+#include <vector>
 
 namespace blaze_util {
 
@@ -166,6 +167,12 @@ bool IsDirectory(const std::string& path);
 // pdie() if syncing fails.
 void SyncFile(const std::string& path);
 
+// Makes sure that every file and directory in `paths` is on the disk, like
+// calling SyncFile() on each, but faster for many paths: on Linux with one
+// syncfs() per file system, elsewhere with concurrent fsync() calls.
+// pdie() if syncing fails.
+void SyncFiles(const std::vector<std::string>& paths);
+
 // mkdir -p path. All newly created directories use the given mode.
 // `mode` should be an octal permission mask, e.g. 0755.
 // Returns false on failure, sets errno.
@@ -201,6 +208,29 @@ void ForEachDirectoryEntry(const std::string &path,
 
 #if defined(_WIN32) || defined(__CYGWIN__)
 std::wstring GetCwdW();
+#else  // !(defined(_WIN32) || defined(__CYGWIN__))
+// Interface to be implemented by WalkDirectoryTree clients. Visit may be
+// called from several threads at once.
+class DirectoryTreeVisitor {
+ public:
+  virtual ~DirectoryTreeVisitor() {}
+
+  // This method is called for each entry in a directory (except "." and "..").
+  // `dirfd` is an open file descriptor of the directory, valid only during the
+  // call, and `dir` its path. `name` is the name of the entry in it, and
+  // `d_type` its type as in struct dirent (e.g. DT_LNK for a symlink to a
+  // directory), found with fstatat() if the filesystem does not report it.
+  // If the entry is a directory (DT_DIR) and this returns true, the walk
+  // continues into it.
+  virtual bool Visit(int dirfd, const std::string &dir, const char *name,
+                     unsigned char d_type) = 0;
+};
+
+// Walks the directory tree under `path`, reading up to `jobs` directories at
+// once. Does not follow symlinks below `path`. Does nothing if `path` is not a
+// directory.
+void WalkDirectoryTree(const std::string &path, int jobs,
+                       DirectoryTreeVisitor *visitor);
 #endif  // defined(_WIN32) || defined(__CYGWIN__)
 
 }  // namespace blaze_util
@@ -840,6 +840,10 @@ void SyncFile(const string& path) {
   // fsync always fails on Cygwin with "Permission denied" for some reason.
 }
 
+void SyncFiles(const std::vector<string>& paths) {
+  // No-op, like SyncFile.
+}
+
 static bool MakeDirectoriesW(const wstring& path) {
   if (path.empty()) {
     return false;
@@ -931,7 +935,15 @@ void ForEachDirectoryEntry(const string &path,
   // normalized (see NormalizeWindowsPath).
   wpath.append(L"\\");
   WIN32_FIND_DATAW metadata;
-  HANDLE handle = ::FindFirstFileW((wpath + L"*").c_str(), &metadata);
+  // FindExInfoBasic skips looking up the 8.3 names, which we don't use, and
+  // FIND_FIRST_EX_LARGE_FETCH fetches more entries per call.
+  HANDLE handle = ::FindFirstFileExW(
+      /* lpFileName */ (wpath + L"*").c_str(),
+      /* fInfoLevelId */ FindExInfoBasic,
+      /* lpFindFileData */ &metadata,
+      /* fSearchOp */ FindExSearchNameMatch,
+      /* lpSearchFilter */ NULL,
+      /* dwAdditionalFlags */ FIND_FIRST_EX_LARGE_FETCH);
   if (handle == INVALID_HANDLE_VALUE) {
     return;  // directory does not exist or is empty
   }
@@ -949,4 +961,8 @@ void ForEachDirectoryEntry(const string &path,
   ::FindClose(handle);
 }
 
+void GetAllFilesUnder(const string &path, std::vector<string> *result) {
+  _GetAllFilesUnder(path, result, &ForEachDirectoryEntry);
+}
+
 }  // namespace blaze_util
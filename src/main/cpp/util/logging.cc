@@ -109,4 +109,10 @@ void SetLoggingOutputStreamToStderr() {
   }
 }
 
+void FlushLogging() {
+  if (internal::log_handler_ != nullptr) {
+    internal::log_handler_->Flush();
+  }
+}
+
 }  // namespace blaze_util
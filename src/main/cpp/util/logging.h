@@ -154,6 +154,9 @@ class LogHandler {
 
   virtual void SetOutputStream(std::unique_ptr<std::ostream> output_stream) = 0;
   virtual void SetOutputStreamToStderr() = 0;
+  // Writes out any statements the handler holds back. By default, there are
+  // none.
+  virtual void Flush() {}
 };
 
 // Sets the log handler that routes all log messages.
@@ -165,6 +168,10 @@ void SetLogHandler(std::unique_ptr<LogHandler> new_handler);
 void SetLoggingOutputStream(std::unique_ptr<std::ostream> output_stream);
 void SetLoggingOutputStreamToStderr();
 
+// Waits until the log handler has written all statements logged so far, e.g.
+// before the process is replaced by execv().
+void FlushLogging();
+
 }  // namespace blaze_util
 
 #endif  // BAZEL_SRC_MAIN_CPP_LOGGING_H_
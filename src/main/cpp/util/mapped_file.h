@@ -0,0 +1,128 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_MAPPED_FILE_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <string>
+
+namespace blaze_util {
+
+// A file mapped read-only into memory, shared by the native archive tools
+// (ijar, singlejar). Besides the mapping itself, it knows how to tell the OS
+// how the file is going to be read.
+class MappedFile {
+ public:
+#ifdef _WIN32
+  typedef /* HANDLE = void* */ void *FileHandleType;
+#else   // not _WIN32
+  typedef int FileHandleType;
+#endif  // _WIN32
+
+  // How the mapping is going to be read, see Open().
+  enum AccessPattern {
+    kRandomAccess,
+    // Read once, mostly from start to end: the whole file is advised
+    // sequential and prefetched as soon as it is mapped.
+    kSequentialAccess,
+  };
+
+  // Files up to this size are read in as they are mapped (MAP_POPULATE on
+  // Linux), which is cheaper than taking a page fault for each page.
+  static const size_t kPopulateLimit = 1 << 20;
+
+  MappedFile();
+  ~MappedFile() { Close(); }
+
+  // Maps the file under `path`. An empty file is mapped, too. Returns false
+  // and sets `*error` on failure.
+  bool Open(const std::string &path, AccessPattern pattern,
+            std::string *error);
+
+  // The same for the file open as `handle`, which is duplicated rather than
+  // taken over: the caller still closes it.
+  bool OpenHandle(FileHandleType handle, AccessPattern pattern,
+                  std::string *error);
+
+  // Uses the `size` bytes at `data` as if they were mapped from a file. They
+  // are not copied and must not change until Close(). There is no fd() then,
+  // and the hints below do nothing.
+  void OpenMemory(const void *data, size_t size);
+
+  void Close();
+
+  bool is_open() const;
+
+  bool mapped(const void *addr) const {
+    return mapped_start_ <= addr && addr < mapped_end_;
+  }
+  const unsigned char *start() const { return mapped_start_; }
+  const unsigned char *end() const { return mapped_end_; }
+  const unsigned char *address(off_t offset) const {
+    return mapped_start_ + offset;
+  }
+  off_t offset(const void *address) const {
+    return reinterpret_cast<const unsigned char *>(address) - mapped_start_;
+  }
+  FileHandleType fd() const { return fd_; }
+  size_t size() const { return mapped_end_ - mapped_start_; }
+
+  // Starts reading the given range of the file in the background, so that
+  // accessing it later does not wait for the I/O. This is only a hint.
+  void Prefetch(off_t offset, size_t count) const;
+
+  // Tells the OS that the given range is going to be read once, in order.
+  // This is only a hint.
+  void AdviseSequential(off_t offset, size_t count) const;
+
+  // Drops the pages entirely inside the given range from memory, so that a
+  // large file read once does not push other files out of the page cache.
+  // Accessing the range again reads it from the file. This is only a hint.
+  void Release(off_t offset, size_t count) const;
+
+  // Unmaps the `count` bytes following the ones already discarded, which
+  // must not be accessed anymore. `count` must be a multiple of the page
+  // size. Frees the address space of huge files read front to back.
+  void Discard(size_t count);
+
+ private:
+  // Maps the file open as fd_.
+  bool Map(AccessPattern pattern, std::string *error);
+
+  unsigned char *mapped_start_;
+  unsigned char *mapped_end_;
+  size_t discarded_;
+  FileHandleType fd_;
+  bool in_memory_;  // Set by OpenMemory().
+#ifdef _WIN32
+  /* HANDLE */ void *mapping_;
+#endif  // _WIN32
+};
+
+// Tells the OS that the memory in the given range, a whole page-aligned
+// mapping of at least a few megabytes that is written once, would rather be
+// backed by transparent huge pages. Only the part aligned to huge pages can
+// be. This is only a hint, and a no-op where it is not supported.
+void AdviseHugePages(void *addr, size_t length);
+
+// Returns the alignment to give a mapping of `length` bytes for
+// AdviseHugePages() to cover all of it: the huge page size for large
+// mappings, else the page size.
+size_t HugePageAlignment(size_t length);
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_MAPPED_FILE_H_
@@ -0,0 +1,204 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/main/cpp/util/mapped_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+namespace blaze_util {
+
+using std::string;
+
+// The size of the transparent huge pages on x86-64 and arm64 with 4K pages.
+static const size_t kHugePageSize = 2 << 20;
+
+MappedFile::MappedFile()
+    : mapped_start_(nullptr),
+      mapped_end_(nullptr),
+      discarded_(0),
+      fd_(-1),
+      in_memory_(false) {}
+
+bool MappedFile::Open(const string &path, AccessPattern pattern,
+                      string *error) {
+  if (is_open()) {
+    *error = "already open";
+    return false;
+  }
+  if ((fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC)) < 0) {
+    *error = string("open: ") + strerror(errno);
+    return false;
+  }
+  return Map(pattern, error);
+}
+
+bool MappedFile::OpenHandle(FileHandleType handle, AccessPattern pattern,
+                            string *error) {
+  if (is_open()) {
+    *error = "already open";
+    return false;
+  }
+  if ((fd_ = fcntl(handle, F_DUPFD_CLOEXEC, 0)) < 0) {
+    *error = string("fcntl: ") + strerror(errno);
+    return false;
+  }
+  return Map(pattern, error);
+}
+
+void MappedFile::OpenMemory(const void *data, size_t size) {
+  Close();
+  mapped_start_ =
+      const_cast<unsigned char *>(static_cast<const unsigned char *>(data));
+  mapped_end_ = mapped_start_ + size;
+  discarded_ = 0;
+  in_memory_ = true;
+}
+
+bool MappedFile::Map(AccessPattern pattern, string *error) {
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    *error = string("fstat: ") + strerror(errno);
+    Close();
+    return false;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    *error = "is a directory";
+    Close();
+    return false;
+  }
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if (static_cast<size_t>(st.st_size) <= kPopulateLimit) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+  // Map the file, even if it is empty (in which case allocate 1 byte to it).
+  void *start = mmap(nullptr, st.st_size ? st.st_size : 1, PROT_READ, flags,
+                     fd_, 0);
+  if (start == MAP_FAILED) {
+    *error = string("mmap: ") + strerror(errno);
+    Close();
+    return false;
+  }
+  mapped_start_ = static_cast<unsigned char *>(start);
+  mapped_end_ = mapped_start_ + st.st_size;
+  discarded_ = 0;
+  if (pattern == kSequentialAccess && size() > kPopulateLimit) {
+    AdviseSequential(0, size());
+    Prefetch(0, size());
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (in_memory_) {
+    mapped_start_ = mapped_end_ = nullptr;
+    in_memory_ = false;
+  }
+  if (mapped_start_ != nullptr) {
+    size_t length = std::max<size_t>(size(), 1);
+    if (discarded_ < length) {
+      munmap(mapped_start_ + discarded_, length - discarded_);
+    }
+    mapped_start_ = mapped_end_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool MappedFile::is_open() const { return fd_ >= 0 || in_memory_; }
+
+void MappedFile::Prefetch(off_t offset, size_t count) const {
+  if (fd_ < 0 || count == 0) {
+    return;
+  }
+#if defined(__linux__) || defined(__FreeBSD__)
+  // Queues the reads to the page cache and returns without waiting for them.
+  posix_fadvise(fd_, offset, count, POSIX_FADV_WILLNEED);
+#else
+  // The range has to start at a page boundary.
+  size_t page_offset = offset % getpagesize();
+  madvise(mapped_start_ + offset - page_offset, count + page_offset,
+          MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::AdviseSequential(off_t offset, size_t count) const {
+  if (fd_ < 0 || count == 0) {
+    return;
+  }
+  // The range has to start at a page boundary.
+  size_t page_offset = offset % getpagesize();
+  madvise(mapped_start_ + offset - page_offset, count + page_offset,
+          MADV_SEQUENTIAL);
+}
+
+void MappedFile::Release(off_t offset, size_t count) const {
+  if (fd_ < 0) {
+    return;
+  }
+  // Only the pages that hold nothing outside of the range.
+  const off_t page_size = getpagesize();
+  off_t start = (offset + page_size - 1) / page_size * page_size;
+  off_t end = (offset + static_cast<off_t>(count)) / page_size * page_size;
+  if (end <= start) {
+    return;
+  }
+  // The mapping is read only, so this just unmaps the pages; the next access
+  // maps them from the file again.
+  madvise(mapped_start_ + start, end - start, MADV_DONTNEED);
+#if defined(__linux__) || defined(__FreeBSD__)
+  // Now that they are not mapped, they can leave the page cache, too.
+  posix_fadvise(fd_, start, end - start, POSIX_FADV_DONTNEED);
+#endif
+}
+
+void MappedFile::Discard(size_t count) {
+  count = std::min(count, size() - std::min(discarded_, size()));
+  if (fd_ < 0 || count == 0) {
+    return;
+  }
+  munmap(mapped_start_ + discarded_, count);
+  discarded_ += count;
+}
+
+void AdviseHugePages(void *addr, size_t length) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  // Advise the whole range, not just its part aligned to huge pages: the
+  // kernel only uses huge pages where they fit anyway, and advising part of
+  // a mapping splits it in two, which mremap() then refuses to grow.
+  madvise(addr, length, MADV_HUGEPAGE);
+#endif
+}
+
+size_t HugePageAlignment(size_t length) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (length >= 4 * kHugePageSize) {
+    return kHugePageSize;
+  }
+#endif
+  return getpagesize();
+}
+
+}  // namespace blaze_util
@@ -0,0 +1,179 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/main/cpp/util/mapped_file.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <string>
+
+#include "src/main/cpp/util/errors.h"
+#include "src/main/cpp/util/path_platform.h"
+
+namespace blaze_util {
+
+using std::string;
+using std::wstring;
+
+MappedFile::MappedFile()
+    : mapped_start_(nullptr),
+      mapped_end_(nullptr),
+      discarded_(0),
+      fd_(INVALID_HANDLE_VALUE),
+      in_memory_(false),
+      mapping_(NULL) {}
+
+bool MappedFile::Open(const string &path, AccessPattern pattern,
+                      string *error) {
+  if (is_open()) {
+    *error = "already open";
+    return false;
+  }
+  wstring wpath;
+  if (!AsAbsoluteWindowsPath(path, &wpath, error)) {
+    return false;
+  }
+  // FILE_FLAG_SEQUENTIAL_SCAN makes the cache manager read ahead further.
+  fd_ = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                    OPEN_EXISTING,
+                    pattern == kSequentialAccess ? FILE_FLAG_SEQUENTIAL_SCAN
+                                                 : FILE_ATTRIBUTE_NORMAL,
+                    NULL);
+  if (fd_ == INVALID_HANDLE_VALUE) {
+    *error = "CreateFileW: " + GetLastErrorString();
+    return false;
+  }
+  return Map(pattern, error);
+}
+
+bool MappedFile::OpenHandle(FileHandleType handle, AccessPattern pattern,
+                            string *error) {
+  if (is_open()) {
+    *error = "already open";
+    return false;
+  }
+  if (!DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &fd_,
+                       0, FALSE, DUPLICATE_SAME_ACCESS)) {
+    fd_ = INVALID_HANDLE_VALUE;
+    *error = "DuplicateHandle: " + GetLastErrorString();
+    return false;
+  }
+  return Map(pattern, error);
+}
+
+void MappedFile::OpenMemory(const void *data, size_t size) {
+  Close();
+  mapped_start_ =
+      const_cast<unsigned char *>(static_cast<const unsigned char *>(data));
+  mapped_end_ = mapped_start_ + size;
+  discarded_ = 0;
+  in_memory_ = true;
+}
+
+bool MappedFile::Map(AccessPattern pattern, string *error) {
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(fd_, &size)) {
+    *error = "GetFileSizeEx: " + GetLastErrorString();
+    Close();
+    return false;
+  }
+  if (size.QuadPart == 0) {
+    // An empty file cannot be mapped; any valid address will do.
+    static unsigned char empty;
+    mapped_start_ = mapped_end_ = &empty;
+    return true;
+  }
+  mapping_ = CreateFileMappingW(fd_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_ == NULL) {
+    *error = "CreateFileMapping: " + GetLastErrorString();
+    Close();
+    return false;
+  }
+  void *view = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (view == NULL) {
+    *error = "MapViewOfFile: " + GetLastErrorString();
+    Close();
+    return false;
+  }
+  mapped_start_ = static_cast<unsigned char *>(view);
+  mapped_end_ = mapped_start_ + size.QuadPart;
+  discarded_ = 0;
+  if (pattern == kSequentialAccess || this->size() <= kPopulateLimit) {
+    Prefetch(0, this->size());
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (mapping_ != NULL) {
+    UnmapViewOfFile(mapped_start_);
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+  }
+  mapped_start_ = mapped_end_ = nullptr;
+  in_memory_ = false;
+  if (fd_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(fd_);
+    fd_ = INVALID_HANDLE_VALUE;
+  }
+}
+
+bool MappedFile::is_open() const {
+  return fd_ != INVALID_HANDLE_VALUE || in_memory_;
+}
+
+void MappedFile::Prefetch(off_t offset, size_t count) const {
+  if (mapping_ == NULL || count == 0) {
+    return;
+  }
+#if _WIN32_WINNT >= 0x0602  // Windows 8
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = mapped_start_ + offset;
+  range.NumberOfBytes = count;
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+
+void MappedFile::AdviseSequential(off_t offset, size_t count) const {
+  // There is no such hint for a mapped view; Open() asks for sequential
+  // reading on the whole file instead.
+}
+
+void MappedFile::Release(off_t offset, size_t count) const {
+  if (mapping_ == NULL || count == 0) {
+    return;
+  }
+  // Unlocking pages that are not locked removes them from the working set.
+  VirtualUnlock(mapped_start_ + offset, count);
+}
+
+void MappedFile::Discard(size_t count) {
+  // A view cannot be unmapped in part. Dropping the pages from the working
+  // set is the closest.
+  count = std::min(count, size() - std::min(discarded_, size()));
+  Release(discarded_, count);
+  discarded_ += count;
+}
+
+void AdviseHugePages(void *addr, size_t length) {
+  // Large pages have to be allocated as such, with a privilege.
+}
+
+size_t HugePageAlignment(size_t length) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+}
+
+}  // namespace blaze_util
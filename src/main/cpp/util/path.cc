@@ -19,9 +19,17 @@
 
 namespace blaze_util {
 
-std::string Dirname(const std::string &path) { return SplitPath(path).first; }
+std::string Dirname(const std::string &path) {
+  size_t dirname_end, basename_start;
+  FindPathSplit(path, &dirname_end, &basename_start);
+  return path.substr(0, dirname_end);
+}
 
-std::string Basename(const std::string &path) { return SplitPath(path).second; }
+std::string Basename(const std::string &path) {
+  size_t dirname_end, basename_start;
+  FindPathSplit(path, &dirname_end, &basename_start);
+  return path.substr(basename_start);
+}
 
 std::string JoinPath(const std::string &path1, const std::string &path2) {
   if (path1.empty()) {
@@ -29,23 +37,24 @@ std::string JoinPath(const std::string &path1, const std::string &path2) {
     return path2;
   }
 
-  if (path1[path1.size() - 1] == '/') {
-    if (path2.find('/') == 0) {
-      // foo/ + /bar
-      return path1 + path2.substr(1);
-    } else {
-      // foo/ + bar
-      return path1 + path2;
-    }
+  // Build the result in place, with a single allocation.
+  bool path1_slash = path1[path1.size() - 1] == '/';
+  bool path2_slash = !path2.empty() && path2[0] == '/';
+  std::string result;
+  result.reserve(path1.size() + path2.size() + 1);
+  result.append(path1);
+  if (path1_slash && path2_slash) {
+    // foo/ + /bar
+    result.append(path2, 1, std::string::npos);
   } else {
-    if (path2.find('/') == 0) {
-      // foo + /bar
-      return path1 + path2;
-    } else {
+    if (!path1_slash && !path2_slash) {
       // foo + bar
-      return path1 + "/" + path2;
+      result.push_back('/');
     }
+    // foo/ + bar, foo + /bar
+    result.append(path2);
   }
+  return result;
 }
 
 }  // namespace blaze_util
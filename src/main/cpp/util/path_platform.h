@@ -37,6 +37,12 @@ bool CompareAbsolutePaths(const std::string &a, const std::string &b);
 // Split a path to dirname and basename parts.
 std::pair<std::string, std::string> SplitPath(const std::string &path);
 
+// Finds where SplitPath splits `path`, without copying either part: the
+// dirname is path[0, *dirname_end) and the basename is
+// path[*basename_start, path.size()).
+void FindPathSplit(const std::string &path, size_t *dirname_end,
+                   size_t *basename_start);
+
 bool IsDevNull(const char *path);
 
 // Returns true if `path` is the root directory or a Windows drive root.
@@ -34,17 +34,24 @@ bool CompareAbsolutePaths(const std::string &a, const std::string &b) {
   return a == b;
 }
 
-std::pair<std::string, std::string> SplitPath(const std::string &path) {
+void FindPathSplit(const std::string &path, size_t *dirname_end,
+                   size_t *basename_start) {
   size_t pos = path.rfind('/');
+  if (pos == std::string::npos) {
+    // Handle the case with no '/' in 'path'.
+    *dirname_end = *basename_start = 0;
+  } else {
+    // Handle the case with a single leading '/' in 'path'.
+    *dirname_end = pos == 0 ? 1 : pos;
+    *basename_start = pos + 1;
+  }
+}
 
-  // Handle the case with no '/' in 'path'.
-  if (pos == std::string::npos) return std::make_pair("", path);
-
-  // Handle the case with a single leading '/' in 'path'.
-  if (pos == 0)
-    return std::make_pair(std::string(path, 0, 1), std::string(path, 1));
-
-  return std::make_pair(std::string(path, 0, pos), std::string(path, pos + 1));
+std::pair<std::string, std::string> SplitPath(const std::string &path) {
+  size_t dirname_end, basename_start;
+  FindPathSplit(path, &dirname_end, &basename_start);
+  return std::make_pair(path.substr(0, dirname_end),
+                        path.substr(basename_start));
 }
 
 bool IsDevNull(const char *path) {
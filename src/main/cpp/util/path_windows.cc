@@ -14,7 +14,8 @@
 
 #include "src/main/cpp/util/path_platform.h"
 
-#include <wchar.h>  // wcslen
+#include <string.h>  // memmove
+#include <wchar.h>   // wcslen
 #include <windows.h>
 
 #include <algorithm>
@@ -122,7 +123,7 @@ const wchar_t* RemoveUncPrefixMaybe(const wchar_t* ptr) {
 // also be just the root part, no other components, e.g. "c:\" is both absolute
 // and root, but "c:\foo" is just absolute.
 template <typename char_type>
-static bool IsRootOrAbsolute(const std::basic_string<char_type>& path,
+static bool IsRootOrAbsolute(const char_type* path, size_t size,
                              bool must_be_root) {
   // An absolute path is one that starts with "/", "\", "c:/", "c:\",
   // "\\?\c:\", or rarely "\??\c:\" or "\\.\c:\".
@@ -131,53 +132,62 @@ static bool IsRootOrAbsolute(const std::basic_string<char_type>& path,
   // valid (in some cases it seems to be, though MSDN doesn't mention it).
   return
       // path is (or starts with) "/" or "\"
-      ((must_be_root ? path.size() == 1 : !path.empty()) &&
-       IsPathSeparator(path[0])) ||
+      ((must_be_root ? size == 1 : size > 0) && IsPathSeparator(path[0])) ||
       // path is (or starts with) "c:/" or "c:\" or similar
-      ((must_be_root ? path.size() == 3 : path.size() >= 3) &&
-       HasDriveSpecifierPrefix(path.c_str()) && IsPathSeparator(path[2])) ||
+      ((must_be_root ? size == 3 : size >= 3) &&
+       HasDriveSpecifierPrefix(path) && IsPathSeparator(path[2])) ||
       // path is (or starts with) "\\?\c:\" or "\??\c:\" or similar
-      ((must_be_root ? path.size() == 7 : path.size() >= 7) &&
-       HasUncPrefix(path.c_str()) &&
-       HasDriveSpecifierPrefix(path.c_str() + 4) && IsPathSeparator(path[6]));
+      ((must_be_root ? size == 7 : size >= 7) && HasUncPrefix(path) &&
+       HasDriveSpecifierPrefix(path + 4) && IsPathSeparator(path[6]));
 }
 
 template <typename char_type>
-static std::pair<std::basic_string<char_type>, std::basic_string<char_type> >
-SplitPathImpl(const std::basic_string<char_type>& path) {
-  if (path.empty()) {
-    return std::make_pair(std::basic_string<char_type>(),
-                          std::basic_string<char_type>());
-  }
+static bool IsRootOrAbsolute(const std::basic_string<char_type>& path,
+                             bool must_be_root) {
+  return IsRootOrAbsolute(path.c_str(), path.size(), must_be_root);
+}
 
-  size_t pos = path.size() - 1;
-  for (auto it = path.crbegin(); it != path.crend(); ++it, --pos) {
-    if (IsPathSeparator(*it)) {
+template <typename char_type>
+static void FindPathSplitImpl(const std::basic_string<char_type>& path,
+                              size_t* dirname_end, size_t* basename_start) {
+  *dirname_end = *basename_start = 0;
+  for (size_t pos = path.size(); pos > 0;) {
+    --pos;
+    if (IsPathSeparator(path[pos])) {
       if ((pos == 2 || pos == 6) &&
-          IsRootOrAbsolute(path.substr(0, pos + 1), /* must_be_root */ true)) {
+          IsRootOrAbsolute(path.c_str(), pos + 1, /* must_be_root */ true)) {
         // Windows path, top-level directory, e.g. "c:\foo",
         // result is ("c:\", "foo").
         // Or UNC path, top-level directory, e.g. "\\?\c:\foo"
         // result is ("\\?\c:\", "foo").
-        return std::make_pair(
-            // Include the "/" or "\" in the drive specifier.
-            path.substr(0, pos + 1), path.substr(pos + 1));
+        // Include the "/" or "\" in the drive specifier.
+        *dirname_end = pos + 1;
       } else {
         // Windows path (neither top-level nor drive root), Unix path, or
-        // relative path.
-        return std::make_pair(
-            // If the only "/" is the leading one, then that shall be the first
-            // pair element, otherwise the substring up to the rightmost "/".
-            pos == 0 ? path.substr(0, 1) : path.substr(0, pos),
-            // If the rightmost "/" is the tail, then the second pair element
-            // should be empty.
-            pos == path.size() - 1 ? std::basic_string<char_type>()
-                                   : path.substr(pos + 1));
+        // relative path. If the only "/" is the leading one, then that shall
+        // be the dirname, otherwise the substring up to the rightmost "/".
+        *dirname_end = pos == 0 ? 1 : pos;
       }
+      // If the rightmost "/" is the tail, then the basename is empty.
+      *basename_start = pos + 1;
+      return;
     }
   }
   // Handle the case with no '/' or '\' in `path`.
-  return std::make_pair(std::basic_string<char_type>(), path);
+}
+
+template <typename char_type>
+static std::pair<std::basic_string<char_type>, std::basic_string<char_type> >
+SplitPathImpl(const std::basic_string<char_type>& path) {
+  size_t dirname_end, basename_start;
+  FindPathSplitImpl(path, &dirname_end, &basename_start);
+  return std::make_pair(path.substr(0, dirname_end),
+                        path.substr(basename_start));
+}
+
+void FindPathSplit(const std::string& path, size_t* dirname_end,
+                   size_t* basename_start) {
+  FindPathSplitImpl(path, dirname_end, basename_start);
 }
 
 std::pair<std::string, std::string> SplitPath(const std::string& path) {
@@ -220,7 +230,6 @@ bool AsWindowsPath(const std::string& path, std::string* result,
     return false;
   }
 
-  std::string mutable_path = path;
   if (path[0] == '/') {
     if (error) {
       *error = "Unix-style paths are unsupported";
@@ -230,10 +239,12 @@ bool AsWindowsPath(const std::string& path, std::string* result,
 
   if (path[0] == '\\') {
     // This is an absolute Windows path on the current drive, e.g. "\foo\bar".
-    mutable_path = std::string(1, GetCurrentDrive()) + ":" + path;
-  }  // otherwise this is a relative path, or absolute Windows path.
-
-  result->assign(NormalizeWindowsPath(mutable_path));
+    *result = NormalizeWindowsPath(std::string(1, GetCurrentDrive()) + ":" +
+                                   path);
+  } else {
+    // This is a relative path, or absolute Windows path.
+    *result = NormalizeWindowsPath(path);
+  }
   return true;
 }
 
@@ -262,10 +273,10 @@ bool AsAbsoluteWindowsPath(const std::string& path, std::wstring* result,
     return false;
   }
   if (!IsRootOrAbsolute(*result, /* must_be_root */ false)) {
-    *result = GetCwdW() + L"\\" + *result;
+    result->insert(0, GetCwdW() + L"\\");
   }
   if (!HasUncPrefix(result->c_str())) {
-    *result = std::wstring(L"\\\\?\\") + *result;
+    result->insert(0, L"\\\\?\\");
   }
   return true;
 }
@@ -299,23 +310,21 @@ bool AsShortWindowsPath(const std::string& path, std::string* result,
     }
 
     // Join all segments.
-    std::wostringstream builder;
     bool first = true;
     for (auto it = segments.crbegin(); it != segments.crend(); ++it) {
       if (!first || !IsRootDirectoryW(wpath)) {
-        builder << L'\\' << *it;
-      } else {
-        builder << *it;
+        wsuffix.push_back(L'\\');
       }
+      wsuffix.append(*it);
       first = false;
     }
-    wsuffix = builder.str();
   }
 
   std::wstring wresult;
   if (IsRootDirectoryW(wpath)) {
     // Strip the UNC prefix from `wpath`, and the leading "\" from `wsuffix`.
-    wresult = std::wstring(RemoveUncPrefixMaybe(wpath.c_str())) + wsuffix;
+    wresult.assign(RemoveUncPrefixMaybe(wpath.c_str()));
+    wresult.append(wsuffix);
   } else {
     std::unique_ptr<WCHAR[]> wshort(
         new WCHAR[size]);  // size includes null-terminator
@@ -330,7 +339,8 @@ bool AsShortWindowsPath(const std::string& path, std::string* result,
       return false;
     }
     // GetShortPathNameW may preserve the UNC prefix in the result, so strip it.
-    wresult = std::wstring(RemoveUncPrefixMaybe(wshort.get())) + wsuffix;
+    wresult.assign(RemoveUncPrefixMaybe(wshort.get()));
+    wresult.append(wsuffix);
   }
 
   result->assign(WstringToCstring(wresult.c_str()).get());
@@ -374,60 +384,54 @@ std::string NormalizeWindowsPath(std::string path) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
         << "NormalizeWindowsPath(" << path << "): expected a Windows path";
   }
-  if (path.size() >= 4 && HasUncPrefix(path.c_str())) {
-    path = path.substr(4);
-  }
-
-  static const std::string dot(".");
-  static const std::string dotdot("..");
 
-  std::vector<std::string> segments;
-  int segment_start = -1;
-  // Find the path segments in `path` (separated by "/").
-  for (int i = 0;; ++i) {
-    if (!IsPathSeparator(path[i]) && path[i] != '\0') {
+  // Normalize in place: the result is never longer than `path`, so the
+  // segments kept are moved to the front of `path`, separated by "\", and
+  // `written` is the length of the result so far. A ".." removes the last
+  // segment written.
+  size_t written = 0;
+  size_t segment_start = std::string::npos;
+  for (size_t i = path.size() >= 4 && HasUncPrefix(path.c_str()) ? 4 : 0;;
+       ++i) {
+    // Reading path[path.size()] is safe and yields '\0'.
+    char c = path[i];
+    if (!IsPathSeparator(c) && c != '\0') {
       // The current character does not end a segment, so start one unless it's
       // already started.
-      if (segment_start < 0) {
+      if (segment_start == std::string::npos) {
         segment_start = i;
       }
-    } else if (segment_start >= 0 && i > segment_start) {
+    } else if (segment_start != std::string::npos) {
       // The current character is "/" or "\0", so this ends a segment.
-      // Add that to `segments` if there's anything to add; handle "." and "..".
-      std::string segment(path, segment_start, i - segment_start);
-      segment_start = -1;
-      if (segment == dotdot) {
-        if (!segments.empty() &&
-            !HasDriveSpecifierPrefix(segments[0].c_str())) {
-          segments.pop_back();
+      // Add that to the result; handle "." and "..".
+      size_t length = i - segment_start;
+      const char* segment = path.c_str() + segment_start;
+      segment_start = std::string::npos;
+      if (length == 2 && segment[0] == '.' && segment[1] == '.') {
+        if (written > 0 && !HasDriveSpecifierPrefix(path.c_str())) {
+          size_t last = path.rfind('\\', written - 1);
+          written = last == std::string::npos ? 0 : last;
+        }
+      } else if (length != 1 || segment[0] != '.') {
+        if (written > 0) {
+          path[written++] = '\\';
         }
-      } else if (segment != dot) {
-        segments.push_back(segment);
+        memmove(&path[written], segment, length);
+        written += length;
       }
     }
-    if (path[i] == '\0') {
+    if (c == '\0') {
       break;
     }
   }
+  path.resize(written);
 
   // Handle the case when `path` is just a drive specifier (or some degenerate
   // form of it, e.g. "c:\..").
-  if (segments.size() == 1 && segments[0].size() == 2 &&
-      HasDriveSpecifierPrefix(segments[0].c_str())) {
-    return segments[0] + '\\';
-  }
-
-  // Join all segments.
-  bool first = true;
-  std::ostringstream result;
-  for (const auto& s : segments) {
-    if (!first) {
-      result << '\\';
-    }
-    first = false;
-    result << s;
+  if (written == 2 && HasDriveSpecifierPrefix(path.c_str())) {
+    path.push_back('\\');
   }
-  return result.str();
+  return path;
 }
 
 }  // namespace blaze_util
@@ -17,9 +17,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cassert>
 #include <memory>  // unique_ptr
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLAZE_UTIL_SCAN_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>  // _BitScanForward
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BLAZE_UTIL_SCAN_NEON 1
+#endif
+
 #include "src/main/cpp/util/exit_code.h"
 
 namespace blaze_util {
@@ -167,6 +180,63 @@ void StripWhitespace(string *str) {
   }
 }
 
+const char *FindTokenBreak(const char *begin, const char *end) {
+  const char *p = begin;
+#if defined(BLAZE_UTIL_SCAN_SSE2)
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i double_quote = _mm_set1_epi8('"');
+  const __m128i single_quote = _mm_set1_epi8('\'');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i four = _mm_set1_epi8(4);
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // '\t', '\n', '\v', '\f' and '\r' are the only bytes that map to 0..4.
+    __m128i control = _mm_sub_epi8(chunk, tab);
+    __m128i breaks = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                     _mm_cmpeq_epi8(chunk, double_quote)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, single_quote),
+                     _mm_cmpeq_epi8(chunk, backslash)));
+    breaks = _mm_or_si128(
+        breaks, _mm_cmpeq_epi8(_mm_min_epu8(control, four), control));
+    int mask = _mm_movemask_epi8(breaks);
+    if (mask != 0) {
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return p + index;
+#else
+      return p + __builtin_ctz(mask);
+#endif
+    }
+  }
+#elif defined(BLAZE_UTIL_SCAN_NEON)
+  const uint8x16_t space = vdupq_n_u8(' ');
+  const uint8x16_t double_quote = vdupq_n_u8('"');
+  const uint8x16_t single_quote = vdupq_n_u8('\'');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t tab = vdupq_n_u8('\t');
+  const uint8x16_t four = vdupq_n_u8(4);
+  for (; end - p >= 16; p += 16) {
+    uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+    uint8x16_t breaks = vorrq_u8(
+        vorrq_u8(vceqq_u8(chunk, space), vceqq_u8(chunk, double_quote)),
+        vorrq_u8(vceqq_u8(chunk, single_quote), vceqq_u8(chunk, backslash)));
+    breaks = vorrq_u8(breaks, vcleq_u8(vsubq_u8(chunk, tab), four));
+    if (vmaxvq_u8(breaks) != 0) {
+      break;  // the loop below finds it within these 16 bytes
+    }
+  }
+#endif
+  for (; p < end; ++p) {
+    if (IsTokenBreak(*p)) {
+      return p;
+    }
+  }
+  return end;
+}
+
 static void GetNextToken(const string &str, const char &comment,
                          string::const_iterator *iter, vector<string> *words) {
   string output;
@@ -190,7 +260,12 @@ static void GetNextToken(const string &str, const char &comment,
         quote = '\0';
         ++last;
       } else {
-        output += *last++;
+        // Copy the characters up to the next break at once; a break other
+        // than the quote or a backslash is copied by the next iteration.
+        const char *begin = &*last;
+        const char *run = FindTokenBreak(begin + 1, str.data() + str.size());
+        output.append(begin, run);
+        last += run - begin;
       }
     } else {
       if (*last == comment) {
@@ -201,7 +276,13 @@ static void GetNextToken(const string &str, const char &comment,
         // Absorb opening quote.
         quote = *last++;
       } else {
-        output += *last++;
+        // Copy the characters up to the next break or comment at once.
+        const char *begin = &*last;
+        const char *run = std::find(
+            begin + 1, FindTokenBreak(begin + 1, str.data() + str.size()),
+            comment);
+        output.append(begin, run);
+        last += run - begin;
       }
     }
   }
@@ -91,6 +91,18 @@ void Replace(const std::string &oldsub, const std::string &newsub,
 // Removes whitespace from both ends of a string.
 void StripWhitespace(std::string *str);
 
+// Returns true if `c` ends a run of plain token characters: ASCII whitespace
+// (see ascii_isspace), a single or double quote, or a backslash.
+static inline bool IsTokenBreak(unsigned char c) {
+  return ascii_isspace(c) || c == '"' || c == '\'' || c == '\\';
+}
+
+// Returns a pointer to the first character in [begin, end) for which
+// IsTokenBreak is true, or `end` if there is none. Scans 16 bytes at a time
+// with SSE2 or NEON where available, so that tokenizers can copy the plain
+// characters of a large params file in bulk.
+const char *FindTokenBreak(const char *begin, const char *end);
+
 // Tokenizes str on whitespace and places the tokens in words. Splits on spaces,
 // newlines, carriage returns, and tabs. Respects single and double quotes (that
 // is, "a string of 'some stuff'" would be 4 tokens). If the comment character
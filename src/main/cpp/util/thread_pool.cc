@@ -0,0 +1,371 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/main/cpp/util/thread_pool.h"
+
+#include <stdlib.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace blaze_util {
+
+using std::string;
+
+namespace {
+
+// The pool, if any, whose worker the current thread is, and its index.
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+#if defined(__linux__)
+// Returns the contents of `path` with the newlines as spaces, or "" if it
+// cannot be read.
+string ReadSmallFile(const string &path) {
+  std::ifstream in(path);
+  std::stringstream contents;
+  string line;
+  while (std::getline(in, line)) {
+    contents << line << ' ';
+  }
+  return contents.str();
+}
+#endif
+
+}  // namespace
+
+int CpuLimitFromCgroup(const string &cpu_max) {
+  const char *start = cpu_max.c_str();
+  char *end;
+  long long quota = strtoll(start, &end, 10);  // NOLINT
+  if (end == start || quota <= 0) {
+    // "max", or -1 with cgroup v1.
+    return 0;
+  }
+  start = end;
+  long long period = strtoll(start, &end, 10);  // NOLINT
+  if (end == start || period <= 0) {
+    return 0;
+  }
+  return static_cast<int>((quota + period - 1) / period);
+}
+
+int DefaultThreadCount() {
+  int cpus = static_cast<int>(std::thread::hardware_concurrency());
+#if defined(__linux__)
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    cpus = CPU_COUNT(&set);
+  }
+  string cpu_max = ReadSmallFile("/sys/fs/cgroup/cpu.max");
+  if (cpu_max.empty()) {
+    // cgroup v1 has the quota and the period in separate files.
+    cpu_max = ReadSmallFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us") +
+              ReadSmallFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+  }
+  int limit = CpuLimitFromCgroup(cpu_max);
+  if (limit > 0 && limit < cpus) {
+    cpus = limit;
+  }
+#endif
+  return std::max(cpus, 1);
+}
+
+ThreadPool::ThreadPool(int thread_count, size_t queue_capacity)
+    : capacity_(std::max<size_t>(queue_capacity, 1) *
+                std::max(thread_count, 1)),
+      queued_(0),
+      cancelled_(false),
+      next_queue_(0),
+      pending_(0),
+      stopping_(false) {
+  for (int i = 0; i < std::max(thread_count, 1); ++i) {
+    queues_.emplace_back(new Queue());
+  }
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    workers_.emplace_back(&ThreadPool::Work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+bool ThreadPool::Submit(std::function<void()> task) {
+  const bool on_worker = current_pool == this;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (on_worker && !cancelled_ && queued_ >= capacity_) {
+      // Waiting for a worker to make room could wait for this one.
+      lock.unlock();
+      task();
+      return true;
+    }
+    space_cv_.wait(lock,
+                   [this]() { return cancelled_ || queued_ < capacity_; });
+    if (cancelled_) {
+      return false;
+    }
+    ++pending_;
+    Queue &queue = *queues_[on_worker ? current_worker
+                                      : next_queue_++ % queues_.size()];
+    std::lock_guard<std::mutex> queue_lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+    ++queued_;
+  }
+  work_cv_.notify_one();
+  return true;
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void ThreadPool::Cancel() {
+  std::vector<std::function<void()>> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    for (auto &queue : queues_) {
+      std::lock_guard<std::mutex> queue_lock(queue->mutex);
+      for (auto &task : queue->tasks) {
+        dropped.push_back(std::move(task));
+      }
+      queued_ -= queue->tasks.size();
+      queue->tasks.clear();
+    }
+  }
+  space_cv_.notify_all();
+  // Destroy the tasks without holding a lock; what they hold may want one.
+  size_t count = dropped.size();
+  dropped.clear();
+  Settle(count);
+}
+
+bool ThreadPool::Take(size_t self, std::function<void()> *task) {
+  for (size_t i = 0; i < queues_.size() && queued_ > 0; ++i) {
+    Queue &queue = *queues_[(self + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      // The newest task of its own, whose data is most likely still cached.
+      *task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      *task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    --queued_;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::Settle(size_t count) {
+  if (count == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_ -= count;
+  if (pending_ == 0) {
+    done_cv_.notify_all();
+  }
+}
+
+void ThreadPool::Work(size_t self) {
+  current_pool = this;
+  current_worker = self;
+  for (;;) {
+    std::function<void()> task;
+    if (Take(self, &task)) {
+      {
+        // Submit() waits for room with the lock held.
+        std::lock_guard<std::mutex> lock(mutex_);
+      }
+      space_cv_.notify_one();
+      task();
+      task = nullptr;
+      Settle(1);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_cv_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+    if (stopping_ && queued_ == 0) {
+      return;
+    }
+  }
+}
+
+namespace {
+
+// The items of one RunOrdered() call.
+struct OrderedItems {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<bool> produced;
+  // Whether the task of the item is gone: it ran, or Cancel() dropped it.
+  std::vector<bool> settled;
+  size_t outstanding;
+};
+
+// Settles an item when the task holding it is destroyed, which is after it
+// ran, or when Cancel() dropped it without running it.
+class OrderedTicket {
+ public:
+  OrderedTicket(OrderedItems *items, size_t ix) : items_(items), ix_(ix) {}
+
+  ~OrderedTicket() {
+    std::lock_guard<std::mutex> lock(items_->mutex);
+    items_->settled[ix_] = true;
+    --items_->outstanding;
+    items_->cv.notify_all();
+  }
+
+ private:
+  OrderedItems *items_;
+  size_t ix_;
+};
+
+}  // namespace
+
+bool RunOrdered(ThreadPool *pool, size_t count, size_t max_ahead,
+                const std::function<void(size_t)> &produce,
+                const std::function<bool(size_t)> &commit) {
+  if (pool == nullptr) {
+    for (size_t ix = 0; ix < count; ++ix) {
+      produce(ix);
+      if (!commit(ix)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  OrderedItems items;
+  items.produced.assign(count, false);
+  items.settled.assign(count, false);
+  items.outstanding = 0;
+  max_ahead = std::max<size_t>(max_ahead, 1);
+
+  bool ok = true;
+  size_t submitted = 0;
+  for (size_t ix = 0; ok && ix < count; ++ix) {
+    while (ok && submitted < count && submitted < ix + max_ahead) {
+      {
+        std::lock_guard<std::mutex> lock(items.mutex);
+        ++items.outstanding;
+      }
+      const size_t item = submitted;
+      auto ticket = std::make_shared<OrderedTicket>(&items, item);
+      ok = pool->Submit([ticket, item, &items, &produce]() {
+        produce(item);
+        std::lock_guard<std::mutex> lock(items.mutex);
+        items.produced[item] = true;
+      });
+      ++submitted;
+    }
+    if (!ok) {
+      break;
+    }
+    bool produced;
+    {
+      std::unique_lock<std::mutex> lock(items.mutex);
+      items.cv.wait(lock, [&items, ix]() { return items.settled[ix]; });
+      produced = items.produced[ix];
+    }
+    ok = produced && commit(ix);
+  }
+
+  std::unique_lock<std::mutex> lock(items.mutex);
+  items.cv.wait(lock, [&items]() { return items.outstanding == 0; });
+  return ok;
+}
+
+namespace {
+
+// The items of one ParallelFor() call. The tasks helping with them share it,
+// since they may only start once the call returned.
+struct ParallelItems {
+  ParallelItems(size_t count, const std::function<void(size_t)> *fn)
+      : count(count), fn(fn), next(0), running(0), closed(false) {}
+
+  // Runs fn() on the items no thread took yet.
+  void Run() {
+    for (size_t ix = next++; ix < count; ix = next++) {
+      (*fn)(ix);
+    }
+  }
+
+  const size_t count;
+  // Only valid until `closed`.
+  const std::function<void(size_t)> *fn;
+  std::atomic<size_t> next;
+  std::mutex mutex;
+  std::condition_variable cv;
+  // Tasks in Run(). Guarded by `mutex`, as is `closed`.
+  size_t running;
+  bool closed;
+};
+
+}  // namespace
+
+void ParallelFor(ThreadPool *pool, size_t count, size_t max_threads,
+                 const std::function<void(size_t)> &fn) {
+  auto items = std::make_shared<ParallelItems>(count, &fn);
+  if (pool != nullptr && count > 1 && max_threads > 1) {
+    // The calling thread is one of them.
+    const size_t workers = pool->thread_count();
+    const size_t helpers = std::min({count - 1, max_threads - 1, workers});
+    for (size_t i = 0; i < helpers; ++i) {
+      pool->Submit([items]() {
+        {
+          std::lock_guard<std::mutex> lock(items->mutex);
+          if (items->closed) {
+            return;
+          }
+          ++items->running;
+        }
+        items->Run();
+        std::lock_guard<std::mutex> lock(items->mutex);
+        if (--items->running == 0) {
+          items->cv.notify_all();
+        }
+      });
+    }
+  }
+  // Rather than wait for busy workers, the calling thread takes items too.
+  items->Run();
+  std::unique_lock<std::mutex> lock(items->mutex);
+  items->closed = true;
+  items->cv.wait(lock, [&items]() { return items->running == 0; });
+}
+
+}  // namespace blaze_util
@@ -0,0 +1,141 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_THREAD_POOL_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_THREAD_POOL_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace blaze_util {
+
+// Returns the number of threads worth running CPU-bound work on: the CPUs
+// this process may run on, further limited on Linux by the CPU quota of its
+// cgroup (e.g. in a container). At least 1.
+int DefaultThreadCount();
+
+// Returns the number of CPUs that the contents of a cgroup v2 "cpu.max" file,
+// "<quota> <period>" or "max <period>", allow, rounded up; 0 for no limit or
+// contents that cannot be parsed.
+int CpuLimitFromCgroup(const std::string &cpu_max);
+
+// A fixed set of worker threads running tasks, shared by the native tools
+// (the client, ijar, singlejar, build-runfiles, the JNI library) so that
+// their parallel parts do not each manage threads of their own.
+//
+// Each worker has a queue. Tasks submitted from outside the pool go to the
+// queues in turn; a task submitted by a task goes to the queue of the worker
+// running it. Workers take their own newest task first and, when out of work,
+// steal the oldest task of another worker. The queues are bounded: Submit()
+// blocks while they are full, except on a worker, where it runs the task right
+// away instead.
+//
+// Usage:
+//   ThreadPool pool(DefaultThreadCount(), 64);
+//   for (...) pool.Submit([...]() { ... });
+//   pool.Wait();
+class ThreadPool {
+ public:
+  // Starts `thread_count` workers, at least one. Their queues hold up to
+  // `queue_capacity` tasks per worker between them.
+  ThreadPool(int thread_count, size_t queue_capacity);
+
+  // Waits for the submitted tasks, then stops the workers.
+  ~ThreadPool();
+
+  // Queues `task` to run on a worker. Returns false, without running it, if
+  // the pool is cancelled.
+  bool Submit(std::function<void()> task);
+
+  // Blocks until every task submitted so far has run or has been dropped by
+  // Cancel(). Must not be called from a task.
+  void Wait();
+
+  // Drops the tasks that have not started yet and makes Submit() refuse new
+  // ones. Running tasks run to completion; long ones should check cancelled().
+  void Cancel();
+
+  bool cancelled() const { return cancelled_; }
+
+  int thread_count() const { return static_cast<int>(queues_.size()); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void Work(size_t self);
+
+  // Takes the newest task of queue `self`, or else the oldest task of another
+  // queue. Returns false if all queues are empty.
+  bool Take(size_t self, std::function<void()> *task);
+
+  // Called after a task ran or was dropped.
+  void Settle(size_t count);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  const size_t capacity_;
+
+  // Tasks in the queues. Only grows with `mutex_` held, and only changes with
+  // the lock of the queue held.
+  std::atomic<size_t> queued_;
+  std::atomic<bool> cancelled_;
+  std::atomic<size_t> next_queue_;
+
+  // Guards the fields below, and the waits for `queued_` to change.
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable space_cv_;
+  std::condition_variable done_cv_;
+  // Tasks queued or running.
+  size_t pending_;
+  bool stopping_;
+};
+
+// Runs produce(i) for each i in [0, count) on `pool`, and commit(i) on the
+// calling thread in the order of i, each as soon as produce(i) returned. The
+// output is thus the same as that of running both in turn on one thread, while
+// the work of produce() is spread over the pool. At most `max_ahead` items
+// past the one to commit next are produced but not yet committed, which bounds
+// the memory they hold.
+// Stops early if commit() returns false or the pool is cancelled, and returns
+// false then; items produced past that point are not committed. Returns only
+// once no produce() call is running any more. Must not be called from a task.
+// With a null `pool`, runs produce(i) and commit(i) in turn on the calling
+// thread.
+bool RunOrdered(ThreadPool *pool, size_t count, size_t max_ahead,
+                const std::function<void(size_t)> &produce,
+                const std::function<bool(size_t)> &commit);
+
+// Runs fn(i) for each i in [0, count) on at most `max_threads` threads: the
+// calling thread and workers of `pool`, which take the items in turn. Returns
+// once every call returned. Unlike Wait(), does not wait for the other tasks
+// of the pool, so that callers can share one, and may be called from a task.
+// With a null `pool`, or a cancelled one, the calling thread runs every item.
+void ParallelFor(ThreadPool *pool, size_t count, size_t max_threads,
+                 const std::function<void(size_t)> &fn);
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_THREAD_POOL_H_
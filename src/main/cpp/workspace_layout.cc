@@ -51,6 +51,21 @@ string WorkspaceLayout::GetWorkspace(const string &cwd) const {
   return "";
 }
 
+string WorkspaceLayout::GetWorkspaceWithHint(const string &cwd,
+                                             const string &hint) const {
+  if (!hint.empty()) {
+    // Only string operations until hint is found among cwd and its parents.
+    string dir = cwd;
+    while (dir.size() > hint.size() && !blaze_util::IsRootDirectory(dir)) {
+      dir = blaze_util::Dirname(dir);
+    }
+    if (dir == hint && InWorkspace(hint)) {
+      return hint;
+    }
+  }
+  return GetWorkspace(cwd);
+}
+
 string WorkspaceLayout::GetPrettyWorkspaceName(
     const std::string& workspace) const {
   // e.g. A Bazel server process running in ~/src/myproject (where there's a
@@ -40,6 +40,14 @@ class WorkspaceLayout {
   // relative or absolute.
   virtual std::string GetWorkspace(const std::string& cwd) const;
 
+  // Like GetWorkspace, but takes the word of the caller, e.g. an IDE through
+  // $BAZEL_WORKSPACE, that cwd is in the workspace `hint`: if cwd is hint or
+  // below it and hint is a workspace, returns hint after a single stat instead
+  // of one per directory from cwd up. Workspaces nested in hint are not looked
+  // for. Otherwise, or if hint is empty, falls back to GetWorkspace(cwd).
+  std::string GetWorkspaceWithHint(const std::string& cwd,
+                                   const std::string& hint) const;
+
   // Given a result returned from GetWorkspace, returns a pretty workspace name
   // than can e.g. be used in the process title of the Bazel server.
   virtual std::string GetPrettyWorkspaceName(
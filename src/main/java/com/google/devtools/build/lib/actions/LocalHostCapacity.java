@@ -26,6 +26,8 @@ public final class LocalHostCapacity {
 
   private static final OS currentOS = OS.getCurrent();
   private static ResourceSet localHostCapacity;
+  private static double memoryLimitMb = 0;
+  private static double cpuLimit = 0;
 
   private LocalHostCapacity() {}
 
@@ -51,9 +53,36 @@ public final class LocalHostCapacity {
     if (localResources == null) {
       localResources = LocalHostResourceFallback.getLocalHostResources();
     }
+    if ((memoryLimitMb > 0 && memoryLimitMb < localResources.getMemoryMb())
+        || (cpuLimit > 0 && cpuLimit < localResources.getCpuUsage())) {
+      localResources =
+          ResourceSet.create(
+              memoryLimitMb > 0
+                  ? Math.min(memoryLimitMb, localResources.getMemoryMb())
+                  : localResources.getMemoryMb(),
+              cpuLimit > 0
+                  ? Math.min(cpuLimit, localResources.getCpuUsage())
+                  : localResources.getCpuUsage(),
+              localResources.getIoUsage(),
+              localResources.getLocalTestCount());
+    }
     return localResources;
   }
 
+  /**
+   * Caps the machine-specific capacity to the memory and CPUs that the client found available, for
+   * example within the limits of a Linux container, which the machine-specific values do not take
+   * into account.
+   *
+   * @param memoryMb the available memory, or 0 if unknown
+   * @param cpus the available CPUs, or 0 if unknown
+   */
+  public static void setResourceLimits(double memoryMb, double cpus) {
+    memoryLimitMb = memoryMb;
+    cpuLimit = cpus;
+    localHostCapacity = null;
+  }
+
   /**
    * Sets the local host capacity to hardcoded values.
    *
@@ -30,7 +30,9 @@ public class BazelDiffAwarenessModule extends BlazeModule {
   public void workspaceInit(
       BlazeRuntime runtime, BlazeDirectories directories, WorkspaceBuilder builder) {
     // Order here is important - LocalDiffAwareness creation always succeeds, so it must be last.
-    builder.addDiffAwarenessFactory(new LocalDiffAwareness.Factory(ImmutableList.<String>of()));
+    builder.addDiffAwarenessFactory(
+        new LocalDiffAwareness.Factory(
+            ImmutableList.<String>of(), directories.getOutputBase().getRelative("_fsevents")));
   }
 
   @Override
@@ -435,6 +435,11 @@ public class BazelJavaSemantics implements JavaSemantics {
                 ";",
                 Iterables.transform(classpath, Artifact.ROOT_RELATIVE_PATH_STRING))
             .addJoinedValues("jvm_flags", " ", jvmFlags)
+            .addKeyValuePair(
+                "class_data_sharing",
+                ruleContext.getFragment(JavaConfiguration.class).javaLauncherClassDataSharing()
+                    ? "1"
+                    : "0")
             .build();
 
     LauncherFileWriteAction.createAndRegister(ruleContext, javaLauncher, launchInfo);
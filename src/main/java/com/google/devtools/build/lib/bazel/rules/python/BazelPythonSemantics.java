@@ -18,6 +18,7 @@ import static java.nio.charset.StandardCharsets.ISO_8859_1;
 
 import com.google.common.base.Joiner;
 import com.google.common.collect.ImmutableList;
+import com.google.common.collect.Iterables;
 import com.google.devtools.build.lib.actions.Artifact;
 import com.google.devtools.build.lib.actions.ParamFileInfo;
 import com.google.devtools.build.lib.actions.ParameterFile;
@@ -195,7 +196,13 @@ public class BazelPythonSemantics implements PythonSemantics {
                 .build(ruleContext));
       } else {
         if (ruleContext.getConfiguration().enableWindowsExeLauncher()) {
-          return createWindowsExeLauncher(ruleContext, pythonBinary, executable);
+          return createWindowsExeLauncher(
+              ruleContext,
+              pythonBinary,
+              main,
+              imports,
+              config.getImportAllRepositories(),
+              executable);
         }
 
         ruleContext.registerAction(
@@ -213,13 +220,24 @@ public class BazelPythonSemantics implements PythonSemantics {
   }
 
   private static Artifact createWindowsExeLauncher(
-      RuleContext ruleContext, String pythonBinary, Artifact pythonLauncher)
+      RuleContext ruleContext,
+      String pythonBinary,
+      String main,
+      NestedSet<PathFragment> imports,
+      boolean importAllRepositories,
+      Artifact pythonLauncher)
       throws InterruptedException {
+    // With the main file and the import path, the launcher can run the binary from its runfiles
+    // tree directly, if there is one, rather than through the stub in the zip file.
     LaunchInfo launchInfo =
         LaunchInfo.builder()
             .addKeyValuePair("binary_type", "Python")
             .addKeyValuePair("workspace_name", ruleContext.getWorkspaceName())
             .addKeyValuePair("python_bin_path", pythonBinary)
+            .addKeyValuePair("python_main", main)
+            .addJoinedValues(
+                "python_imports", ";", Iterables.transform(imports, PathFragment::getPathString))
+            .addKeyValuePair("python_import_all", importAllRepositories ? "1" : "0")
             .build();
     LauncherFileWriteAction.createAndRegister(ruleContext, pythonLauncher, launchInfo);
     return pythonLauncher;
@@ -267,6 +267,9 @@ public class LocalSpawnRunner implements SpawnRunner {
         Command cmd;
         OutputStream stdOut;
         OutputStream stdErr;
+        // If set, the subprocess writes its output to these files itself.
+        Path stdoutPath = null;
+        Path stderrPath = null;
         Path commandTmpDir = tmpDir.getRelative("work");
         commandTmpDir.createDirectory();
         Map<String, String> environment =
@@ -299,6 +302,13 @@ public class LocalSpawnRunner implements SpawnRunner {
         } else {
           stdOut = outErr.getOutputStream();
           stdErr = outErr.getErrorStream();
+          if (OS.getCurrent() == OS.WINDOWS) {
+            // Let the subprocess append to the files of outErr instead of streaming its output
+            // through two threads of this process. WindowsSubprocessFactory keeps the contents of
+            // the files, so the output of earlier spawns of the action is kept as before.
+            stdoutPath = outErr.getOutputPath();
+            stderrPath = outErr.getErrorPath();
+          }
           cmd =
               new Command(
                   spawn.getArguments().toArray(new String[0]),
@@ -310,7 +320,10 @@ public class LocalSpawnRunner implements SpawnRunner {
         long startTime = System.currentTimeMillis();
         CommandResult commandResult = null;
         try {
-          commandResult = cmd.execute(stdOut, stdErr);
+          commandResult =
+              stdoutPath != null && stderrPath != null
+                  ? cmd.execute(stdoutPath.getPathFile(), stderrPath.getPathFile())
+                  : cmd.execute(stdOut, stdErr);
           if (Thread.currentThread().isInterrupted()) {
             throw new InterruptedException();
           }
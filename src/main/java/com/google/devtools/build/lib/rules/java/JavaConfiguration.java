@@ -170,6 +170,7 @@ public final class JavaConfiguration extends Fragment implements JavaConfigurati
   private final Label runtimeLabel;
   private final boolean explicitJavaTestDeps;
   private final boolean experimentalTestRunner;
+  private final boolean javaLauncherClassDataSharing;
   private final boolean jplPropagateCcLinkParamsStore;
   private final ImmutableList<Label> pluginList;
 
@@ -206,6 +207,7 @@ public final class JavaConfiguration extends Fragment implements JavaConfigurati
     this.allowRuntimeDepsOnNeverLink = javaOptions.allowRuntimeDepsOnNeverLink;
     this.explicitJavaTestDeps = javaOptions.explicitJavaTestDeps;
     this.experimentalTestRunner = javaOptions.experimentalTestRunner;
+    this.javaLauncherClassDataSharing = javaOptions.javaLauncherClassDataSharing;
     this.jplPropagateCcLinkParamsStore = javaOptions.jplPropagateCcLinkParamsStore;
 
     ImmutableList.Builder<Label> translationsBuilder = ImmutableList.builder();
@@ -260,6 +262,7 @@ public final class JavaConfiguration extends Fragment implements JavaConfigurati
       Label runtimeLabel,
       boolean explicitJavaTestDeps,
       boolean experimentalTestRunner,
+      boolean javaLauncherClassDataSharing,
       boolean jplPropagateCcLinkParamsStore,
       ImmutableList<Label> pluginList,
       boolean useLegacyBazelJavaTest) {
@@ -289,6 +292,7 @@ public final class JavaConfiguration extends Fragment implements JavaConfigurati
     this.runtimeLabel = runtimeLabel;
     this.explicitJavaTestDeps = explicitJavaTestDeps;
     this.experimentalTestRunner = experimentalTestRunner;
+    this.javaLauncherClassDataSharing = javaLauncherClassDataSharing;
     this.jplPropagateCcLinkParamsStore = jplPropagateCcLinkParamsStore;
     this.pluginList = pluginList;
     this.useLegacyBazelJavaTest = useLegacyBazelJavaTest;
@@ -475,6 +479,14 @@ public final class JavaConfiguration extends Fragment implements JavaConfigurati
     return explicitJavaTestDeps;
   }
 
+  /**
+   * Returns whether the Windows launchers of Java binaries start the JVM from a class data sharing
+   * archive, which the first run dumps.
+   */
+  public boolean javaLauncherClassDataSharing() {
+    return javaLauncherClassDataSharing;
+  }
+
   /**
    * Returns an enum representing whether or not Bazel should attempt to enforce one-version
    * correctness on java_binary rules using the 'oneversion' tool in the java_toolchain.
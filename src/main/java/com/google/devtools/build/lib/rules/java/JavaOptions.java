@@ -274,6 +274,18 @@ public class JavaOptions extends FragmentOptions {
   )
   public boolean experimentalTestRunner;
 
+  @Option(
+    name = "experimental_java_launcher_class_data_sharing",
+    defaultValue = "false",
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.AFFECTS_OUTPUTS},
+    help =
+        "If enabled, the Windows launchers of java_binary and java_test targets start the JVM "
+            + "from a class data sharing archive of the classes on their classpath, which the "
+            + "first run of each binary dumps next to it. Requires JDK 13 or later."
+  )
+  public boolean javaLauncherClassDataSharing;
+
   @Option(
     name = "javabuilder_top",
     defaultValue = "null",
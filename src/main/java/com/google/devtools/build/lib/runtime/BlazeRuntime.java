@@ -24,6 +24,7 @@ import com.google.common.eventbus.SubscriberExceptionHandler;
 import com.google.common.util.concurrent.Futures;
 import com.google.common.util.concurrent.Uninterruptibles;
 import com.google.devtools.build.lib.actions.ActionKeyContext;
+import com.google.devtools.build.lib.actions.LocalHostCapacity;
 import com.google.devtools.build.lib.analysis.BlazeDirectories;
 import com.google.devtools.build.lib.analysis.BlazeVersionInfo;
 import com.google.devtools.build.lib.analysis.ConfiguredRuleClassProvider;
@@ -61,6 +62,7 @@ import com.google.devtools.build.lib.shell.JavaSubprocessFactory;
 import com.google.devtools.build.lib.shell.SubprocessBuilder;
 import com.google.devtools.build.lib.shell.SubprocessFactory;
 import com.google.devtools.build.lib.unix.UnixFileSystem;
+import com.google.devtools.build.lib.unix.UnixSubprocessFactory;
 import com.google.devtools.build.lib.util.AbruptExitException;
 import com.google.devtools.build.lib.util.CustomExitCodePublisher;
 import com.google.devtools.build.lib.util.ExitCode;
@@ -922,9 +924,11 @@ public final class BlazeRuntime {
         RPCServer.Factory factory = (RPCServer.Factory) factoryClass.getConstructor().newInstance();
         rpcServer[0] = factory.create(dispatcher, runtime.getClock(),
             startupOptions.commandPort,
+            startupOptions.unixSocket,
             runtime.getWorkspace().getWorkspace(),
             runtime.getServerDirectory(),
-            startupOptions.maxIdleSeconds);
+            startupOptions.maxIdleSeconds,
+            startupOptions.idleShutdownOnMemoryPressure);
       } catch (ReflectiveOperationException | IllegalArgumentException e) {
         throw new AbruptExitException("gRPC server not compiled in", ExitCode.BLAZE_INTERNAL_ERROR);
       }
@@ -968,12 +972,14 @@ public final class BlazeRuntime {
     return OS.getCurrent() == OS.WINDOWS ? new WindowsFileSystem() : new UnixFileSystem();
   }
 
-  private static SubprocessFactory subprocessFactoryImplementation() {
-    if (!"0".equals(System.getProperty("io.bazel.EnableJni")) && OS.getCurrent() == OS.WINDOWS) {
-      return WindowsSubprocessFactory.INSTANCE;
-    } else {
+  private static SubprocessFactory subprocessFactoryImplementation(boolean posixSpawn) {
+    if ("0".equals(System.getProperty("io.bazel.EnableJni"))) {
       return JavaSubprocessFactory.INSTANCE;
     }
+    if (OS.getCurrent() == OS.WINDOWS) {
+      return WindowsSubprocessFactory.INSTANCE;
+    }
+    return posixSpawn ? UnixSubprocessFactory.INSTANCE : JavaSubprocessFactory.INSTANCE;
   }
 
   /**
@@ -1040,6 +1046,8 @@ public final class BlazeRuntime {
     PathFragment outputBase = startupOptions.outputBase;
 
     maybeForceJNIByGettingPid(installBase); // Must be before first use of JNI.
+    LocalHostCapacity.setResourceLimits(
+        startupOptions.hostAvailableMemoryMb, startupOptions.hostAvailableCpus);
 
     // From the point of view of the Java program --install_base, --output_base, and
     // --output_user_root are mandatory options, despite the comment in their declarations.
@@ -1070,7 +1078,8 @@ public final class BlazeRuntime {
     }
 
     Path.setFileSystemForSerialization(fs);
-    SubprocessBuilder.setSubprocessFactory(subprocessFactoryImplementation());
+    SubprocessBuilder.setSubprocessFactory(
+        subprocessFactoryImplementation(startupOptions.posixSpawn));
 
     Path outputUserRootPath = fs.getPath(outputUserRoot);
     Path installBasePath = fs.getPath(installBase);
@@ -145,6 +145,25 @@ public class BlazeServerStartupOptions extends OptionsBase {
   )
   public PathFragment outputUserRoot;
 
+  @Option(
+    name = "experimental_shared_install_base_root",
+    defaultValue = "", // NOTE: only for documentation, value never passed to the server.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
+    converter = OptionsUtils.PathFragmentConverter.class,
+    valueHelp = "<path>",
+    help =
+        "If set to an existing directory, e.g. one shared by all the users of a machine, each "
+            + "Blaze release is extracted only once into a directory named by its MD5 beneath it. "
+            + "New install bases are then populated with copy-on-write clones of or hard links to "
+            + "those files instead of being extracted again. Only files owned by root or by the "
+            + "current user, and not writable by others, are shared; otherwise Blaze falls back to "
+            + "extracting the install base as usual. The files that are the same as in releases "
+            + "extracted earlier are shared from a content store in the \"cas\" subdirectory. "
+            + "Not supported on Windows, where it is ignored with a warning."
+  )
+  public PathFragment sharedInstallBaseRoot;
+
   /**
    * Note: This option is only used by the C++ client, never by the Java server. It is included here
    * to make sure that the option is documented in the help output, which is auto-generated by Java
@@ -188,6 +207,32 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + " and as a fall-back host_javabase. This is not the embedded JDK.")
   public PathFragment defaultSystemJavabase;
 
+  @Option(
+    name = "host_available_memory_mb",
+    defaultValue = "0", // NOTE: only for documentation, value is always passed by the client.
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.EXECUTION, OptionEffectTag.LOSES_INCREMENTAL_STATE},
+    metadataTags = {OptionMetadataTag.HIDDEN},
+    help =
+        "The memory available to Blaze in MB, as detected by the client, e.g. within the limits "
+            + "of its Linux container. Local actions are scheduled to fit it. Zero if unknown. "
+            + "This flag is only to be set by the blaze client."
+  )
+  public int hostAvailableMemoryMb;
+
+  @Option(
+    name = "host_available_cpus",
+    defaultValue = "0", // NOTE: only for documentation, value is always passed by the client.
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.EXECUTION, OptionEffectTag.LOSES_INCREMENTAL_STATE},
+    metadataTags = {OptionMetadataTag.HIDDEN},
+    help =
+        "The number of CPUs available to Blaze, as detected by the client, e.g. within the "
+            + "CPU quota of its Linux container. Local actions are scheduled to fit it. Zero if "
+            + "unknown. This flag is only to be set by the blaze client."
+  )
+  public int hostAvailableCpus;
+
   @Option(
     name = "max_idle_secs",
     // NOTE: default value only used for documentation, value is always passed by the client when
@@ -202,6 +247,19 @@ public class BlazeServerStartupOptions extends OptionsBase {
   )
   public int maxIdleSeconds;
 
+  @Option(
+    name = "experimental_idle_shutdown_on_memory_pressure",
+    defaultValue = "false", // NOTE: only for documentation, value is always passed by the client.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.EAGERNESS_TO_EXIT, OptionEffectTag.LOSES_INCREMENTAL_STATE},
+    help =
+        "If true, an idle server watches the memory pressure of the machine: Linux pressure "
+            + "stall information, or the memory pressure level on macOS. Under pressure it "
+            + "collects garbage, and if that does not help, shuts down before --max_idle_secs "
+            + "is up. Otherwise it stays up for --max_idle_secs, or for good if that is zero."
+  )
+  public boolean idleShutdownOnMemoryPressure;
+
   @Option(
     name = "batch",
     defaultValue = "false",
@@ -272,10 +330,11 @@ public class BlazeServerStartupOptions extends OptionsBase {
     effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
     valueHelp = "{-1,0,1,2,3,4,5,6,7}",
     help =
-        "Only on Linux; set a level from 0-7 for best-effort IO scheduling using the "
-            + "sys_ioprio_set system call. 0 is highest priority, 7 is lowest. The anticipatory "
-            + "scheduler may only honor up to priority 4. If set to a negative value, then Blaze "
-            + "does not perform a system call."
+        "Only on Linux and macOS; set a level from 0-7 for best-effort IO scheduling using "
+            + "the sys_ioprio_set system call. 0 is highest priority, 7 is lowest. The "
+            + "anticipatory scheduler may only honor up to priority 4. On macOS, the levels map "
+            + "to IO policies: 0-3 important, 4-5 standard, 6 utility and 7 throttled. If set to "
+            + "a negative value, then Blaze does not perform a system call."
   )
   public int ioNiceLevel;
 
@@ -285,12 +344,29 @@ public class BlazeServerStartupOptions extends OptionsBase {
     documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
     effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
     help =
-        "Only on Linux; use 'batch' CPU scheduling for Blaze. This policy is useful for "
-            + "workloads that are non-interactive, but do not want to lower their nice value. "
-            + "See 'man 2 sched_setscheduler'. If false, then Blaze does not perform a system call."
+        "Only on Linux and macOS; use 'batch' CPU scheduling for Blaze. This policy is useful "
+            + "for workloads that are non-interactive, but do not want to lower their nice value. "
+            + "See 'man 2 sched_setscheduler'. On macOS, Blaze runs in the 'utility' quality of "
+            + "service class instead. If false, then Blaze does not perform a system call."
   )
   public boolean batchCpuScheduling;
 
+  @Option(
+    name = "experimental_scheduling_profile",
+    defaultValue = "interactive", // NOTE: only for documentation, value never passed to the server.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
+    valueHelp = "{interactive,background}",
+    help =
+        "'interactive' leaves the scheduling of Blaze to --batch_cpu_scheduling and "
+            + "--io_nice_level. 'background' overrides both, and runs the Blaze server and its "
+            + "local actions only when the CPU and the disks are otherwise idle: with the "
+            + "SCHED_IDLE policy and the idle IO class on Linux, with the highest nice value and "
+            + "with throttled IO on macOS, and in the idle priority class on Windows. Like the "
+            + "flags it overrides, this takes effect when the server is started."
+  )
+  public String schedulingProfile;
+
   @Option(
       name = "ignore_all_rc_files",
       defaultValue = "false", // NOTE: purely decorative, rc files are read by the client.
@@ -361,6 +437,33 @@ public class BlazeServerStartupOptions extends OptionsBase {
   )
   public int commandPort;
 
+  @Option(
+    name = "experimental_unix_socket",
+    defaultValue = "false", // NOTE: only for documentation, value is always passed by the client.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {
+      OptionEffectTag.LOSES_INCREMENTAL_STATE,
+      OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION
+    },
+    help =
+        "If true, the client and the server communicate over a Unix domain socket in the "
+            + "server directory of the output base instead of a loopback TCP port. Ignored, "
+            + "falling back to TCP, where Unix domain sockets are not supported, e.g. on "
+            + "Windows."
+  )
+  public boolean unixSocket;
+
+  @Option(
+    name = "experimental_posix_spawn",
+    defaultValue = "false", // NOTE: only for documentation, value is always passed by the client.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.EXECUTION},
+    help =
+        "If true, the server starts subprocesses with posix_spawn through JNI instead of "
+            + "java.lang.ProcessBuilder. Ignored on Windows and when JNI is disabled."
+  )
+  public boolean posixSpawn;
+
   @Option(
     name = "product_name",
     defaultValue = "bazel", // NOTE: only for documentation, value is always passed by the client.
@@ -399,6 +502,46 @@ public class BlazeServerStartupOptions extends OptionsBase {
   )
   public boolean clientDebug;
 
+  @Option(
+    name = "client_profile",
+    defaultValue = "null", // NOTE: only for documentation, value is set and used by the client.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.AFFECTS_OUTPUTS, OptionEffectTag.BAZEL_MONITORING},
+    converter = OptionsUtils.PathFragmentConverter.class,
+    valueHelp = "<path>",
+    help =
+        "If set, the client writes how long each phase of its startup took to this file, in the "
+            + "JSON trace file format. Changing this option will not cause the server to restart."
+  )
+  public PathFragment clientProfile;
+
+  @Option(
+    name = "experimental_prefetch_install_base",
+    defaultValue = "false", // NOTE: only for documentation, value is set and used by the client.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.HOST_MACHINE_RESOURCE_OPTIMIZATIONS},
+    help =
+        "If true, the client asks the OS to read the server jar and the files of the embedded "
+            + "JDK into the page cache in the background whenever it starts a server, which "
+            + "saves the server from waiting for many small reads from a cold disk. Changing this "
+            + "option will not cause the server to restart."
+  )
+  public boolean prefetchInstallBase;
+
+  @Option(
+    name = "experimental_session",
+    defaultValue = "false", // NOTE: only for documentation, value is set and used by the client.
+    documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If true, the client reads commands from stdin, one per line, and runs each of them on "
+            + "the same server connection, without parsing the startup options, taking the "
+            + "output base lock and connecting to the server again. After each command, it "
+            + "writes its exit code to stderr. Changing this option will not cause the server "
+            + "to restart."
+  )
+  public boolean session;
+
   @Option(
     name = "connect_timeout_secs",
     defaultValue = "30", // NOTE: only for documentation, value is set and used by the client.
@@ -50,6 +50,43 @@ public class HostJvmStartupOptions extends OptionsBase {
   )
   public List<String> hostJvmArgs;
 
+  @Option(
+    name = "experimental_adaptive_host_jvm_args",
+    defaultValue = "false", // NOTE: purely decorative!  See BlazeServerStartupOptions.
+    documentationCategory = OptionDocumentationCategory.UNCATEGORIZED,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If set, the maximum heap size, the garbage collector and its number of threads are "
+            + "chosen for the memory and cores available to Blaze, e.g. within the limits of its "
+            + "Linux container. --host_jvm_args that set any of them take precedence."
+  )
+  public boolean adaptiveHostJvmArgs;
+
+  @Option(
+    name = "experimental_server_class_data_sharing",
+    defaultValue = "false", // NOTE: purely decorative!  See BlazeServerStartupOptions.
+    documentationCategory = OptionDocumentationCategory.UNCATEGORIZED,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If set and the server runs on JDK 13 or later, the first server of an install base "
+            + "writes an archive of the classes it loaded when it exits, and later servers "
+            + "start from that archive instead of loading the classes from the jar again."
+  )
+  public boolean serverClassDataSharing;
+
+  @Option(
+    name = "experimental_server_checkpoint",
+    defaultValue = "false", // NOTE: purely decorative!  See BlazeServerStartupOptions.
+    documentationCategory = OptionDocumentationCategory.UNCATEGORIZED,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If set and the server runs on a JDK with CRaC support, a server that has run a "
+            + "command before is checkpointed under the output user root after its next "
+            + "successful command, and later servers with the same startup options are restored "
+            + "from that checkpoint instead of starting cold."
+  )
+  public boolean serverCheckpoint;
+
   @Option(
     name = "host_jvm_profile",
     defaultValue = "", // NOTE: purely decorative!  See BlazeServerStartupOptions.
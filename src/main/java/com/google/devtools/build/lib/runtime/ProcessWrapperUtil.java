@@ -56,6 +56,9 @@ public final class ProcessWrapperUtil {
     private final List<String> commandArguments;
     private Path stdoutPath;
     private Path stderrPath;
+    private boolean streamOutput;
+    private long maxOutputBytes;
+    private long killOutputBytes;
     private Duration timeout;
     private Duration killDelay;
     private Path statisticsPath;
@@ -77,6 +80,34 @@ public final class ProcessWrapperUtil {
       return this;
     }
 
+    /**
+     * Sets whether the redirected stdout and stderr also stream live to the stdout and stderr of
+     * the tool, so that the output of a long-running command can be followed while it runs. The
+     * files still get all of the output.
+     */
+    public CommandLineBuilder setStreamOutput(boolean streamOutput) {
+      this.streamOutput = streamOutput;
+      return this;
+    }
+
+    /**
+     * Sets the size that the stdout and stderr files are each limited to, 0 for no limit. Past it,
+     * only the first and the last half of that many bytes are kept.
+     */
+    public CommandLineBuilder setMaxOutputBytes(long maxOutputBytes) {
+      this.maxOutputBytes = maxOutputBytes;
+      return this;
+    }
+
+    /**
+     * Sets the number of bytes of stdout or stderr past which the command is killed, 0 for no
+     * limit.
+     */
+    public CommandLineBuilder setKillOutputBytes(long killOutputBytes) {
+      this.killOutputBytes = killOutputBytes;
+      return this;
+    }
+
     /** Sets the timeout for the command run using the process-wrapper tool. */
     public CommandLineBuilder setTimeout(Duration timeout) {
       this.timeout = timeout;
@@ -115,6 +146,15 @@ public final class ProcessWrapperUtil {
       if (stderrPath != null) {
         fullCommandLine.add("--stderr=" + stderrPath);
       }
+      if (streamOutput) {
+        fullCommandLine.add("--stream_output");
+      }
+      if (maxOutputBytes > 0) {
+        fullCommandLine.add("--max_output_bytes=" + maxOutputBytes);
+      }
+      if (killOutputBytes > 0) {
+        fullCommandLine.add("--kill_output_bytes=" + killOutputBytes);
+      }
       if (statisticsPath != null) {
         fullCommandLine.add("--stats=" + statisticsPath);
       }
@@ -169,10 +169,10 @@ public final class QueryCommand implements BlazeCommand {
 
     OutputStream out;
     if (formatter.canBeBuffered()) {
-      // There is no particular reason for the 16384 constant here, except its a multiple of the
-      // gRPC buffer size. We mainly don't want to send each label individually because the output
-      // stream is connected to gRPC, and every write gets converted to one gRPC call.
-      out = new BufferedOutputStream(env.getReporter().getOutErr().getOutputStream(), 16384);
+      // We don't want to send each label individually because the output stream is connected to
+      // gRPC, and every write gets converted to one gRPC call. The buffer is as large as the chunks
+      // the gRPC output stream sends, so large outputs need few calls.
+      out = new BufferedOutputStream(env.getReporter().getOutErr().getOutputStream(), 256 * 1024);
     } else {
       out = env.getReporter().getOutErr().getOutputStream();
     }
@@ -21,6 +21,7 @@ import com.google.devtools.build.lib.util.ExitCode;
 import com.google.devtools.common.options.Option;
 import com.google.devtools.common.options.OptionDocumentationCategory;
 import com.google.devtools.common.options.OptionEffectTag;
+import com.google.devtools.common.options.OptionMetadataTag;
 import com.google.devtools.common.options.OptionsBase;
 import com.google.devtools.common.options.OptionsParser;
 import com.google.devtools.common.options.OptionsProvider;
@@ -49,6 +50,19 @@ public final class ShutdownCommand implements BlazeCommand {
               + "consumed by the JVM exceeds this value."
     )
     public int heapSizeLimit;
+
+    @Option(
+      name = "experimental_for_restart",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.EAGERNESS_TO_EXIT},
+      metadataTags = {OptionMetadataTag.HIDDEN},
+      help =
+          "If true, a new server is about to start in this output base while this one exits, so "
+              + "this one leaves the files in the server directory for the new one to overwrite. "
+              + "Only to be set by the client."
+    )
+    public boolean forRestart;
   }
 
   @Override
@@ -56,7 +70,8 @@ public final class ShutdownCommand implements BlazeCommand {
 
   @Override
   public BlazeCommandResult exec(CommandEnvironment env, OptionsProvider options) {
-    int limit = options.getOptions(Options.class).heapSizeLimit;
+    Options shutdownOptions = options.getOptions(Options.class);
+    int limit = shutdownOptions.heapSizeLimit;
 
     // Iff limit is non-zero, shut down the server if total memory exceeds the
     // limit. totalMemory is the actual heap size that the VM currently uses
@@ -67,6 +82,11 @@ public final class ShutdownCommand implements BlazeCommand {
 
     if (limit == 0 ||
         Runtime.getRuntime().totalMemory() > limit * 1000L * 1000) {
+      if (shutdownOptions.forRestart) {
+        // Neither delete the new server's PID and port files on the way out nor exit in a hurry
+        // when the new server overwrites the PID file.
+        env.getRuntime().prepareForAbruptShutdown();
+      }
       return BlazeCommandResult.shutdown(ExitCode.SUCCESS);
     }
 
@@ -63,12 +63,23 @@ public final class LinuxSandboxUtil {
     private Duration killDelay;
     private Path stdoutPath;
     private Path stderrPath;
+    private boolean streamOutput;
     private Set<Path> writableFilesAndDirectories = ImmutableSet.of();
     private Set<Path> tmpfsDirectories = ImmutableSet.of();
+    private String tmpfsOptions = "";
+    private Path scratchDirectory;
     private Map<Path, Path> bindMounts = ImmutableMap.of();
+    private Path inputLayer;
+    private Path overlayWorkDirectory;
     private Path statisticsPath;
+    private Path cgroupParent;
+    private long memoryLimitBytes;
+    private double cpuLimit;
+    private String cpus = "";
+    private String numaNodes = "";
     private boolean useFakeHostname = false;
     private boolean createNetworkNamespace = false;
+    private Path networkNamespace;
     private boolean useFakeRoot = false;
     private boolean useFakeUsername = false;
     private boolean useDebugMode = false;
@@ -117,6 +128,16 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets whether the redirected stdout and stderr also stream live to the stdout and stderr of
+     * the tool, so that the output of a long-running command can be followed while it runs. The
+     * files still get all of the output.
+     */
+    public CommandLineBuilder setStreamOutput(boolean streamOutput) {
+      this.streamOutput = streamOutput;
+      return this;
+    }
+
     /** Sets the files or directories to make writable for the sandboxed process, if any. */
     public CommandLineBuilder setWritableFilesAndDirectories(
         Set<Path> writableFilesAndDirectories) {
@@ -130,6 +151,21 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets the mount options of the tmpfs directories and the scratch directory, e.g. {@code
+     * size=1g,huge=within_size}, if any.
+     */
+    public CommandLineBuilder setTmpfsOptions(String tmpfsOptions) {
+      this.tmpfsOptions = tmpfsOptions;
+      return this;
+    }
+
+    /** Sets the directory where to mount an empty tmpfs that TMPDIR points to, if any. */
+    public CommandLineBuilder setScratchDirectory(Path scratchDirectory) {
+      this.scratchDirectory = scratchDirectory;
+      return this;
+    }
+
     /**
      * Sets the sources and targets of files or directories to explicitly bind-mount in the sandbox,
      * if any.
@@ -139,12 +175,56 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets a read-only directory to overlay under the working directory, if any, and the empty
+     * directory overlayfs needs next to it. The working directory stays the writable upper layer.
+     */
+    public CommandLineBuilder setInputLayer(Path inputLayer, Path overlayWorkDirectory) {
+      this.inputLayer = inputLayer;
+      this.overlayWorkDirectory = overlayWorkDirectory;
+      return this;
+    }
+
     /** Sets the path for writing execution statistics (e.g. resource usage). */
     public CommandLineBuilder setStatisticsPath(Path statisticsPath) {
       this.statisticsPath = statisticsPath;
       return this;
     }
 
+    /** Sets the cgroup v2 directory to create a cgroup for the command in, if any. */
+    public CommandLineBuilder setCgroupParent(Path cgroupParent) {
+      this.cgroupParent = cgroupParent;
+      return this;
+    }
+
+    /** Sets the memory limit of the command's cgroup in bytes, or 0 for none. */
+    public CommandLineBuilder setMemoryLimitBytes(long memoryLimitBytes) {
+      this.memoryLimitBytes = memoryLimitBytes;
+      return this;
+    }
+
+    /** Sets the CPU limit of the command's cgroup in cores, or 0 for none. */
+    public CommandLineBuilder setCpuLimit(double cpuLimit) {
+      this.cpuLimit = cpuLimit;
+      return this;
+    }
+
+    /** Sets the CPUs to run the command on, e.g. {@code 0-15,64-79}, if restricted. */
+    public CommandLineBuilder setCpus(String cpus) {
+      this.cpus = cpus;
+      return this;
+    }
+
+    /**
+     * Sets the NUMA nodes to allocate the memory of the command on, e.g. {@code 0}, if restricted.
+     * Unless {@link #setCpus} restricts them otherwise, the command then runs on the CPUs of these
+     * nodes.
+     */
+    public CommandLineBuilder setNumaNodes(String numaNodes) {
+      this.numaNodes = numaNodes;
+      return this;
+    }
+
     /** Sets whether to use a fake 'localhost' hostname inside the sandbox. */
     public CommandLineBuilder setUseFakeHostname(boolean useFakeHostname) {
       this.useFakeHostname = useFakeHostname;
@@ -157,6 +237,15 @@ public final class LinuxSandboxUtil {
       return this;
     }
 
+    /**
+     * Sets a network namespace without network access to join instead of creating one, e.g. {@code
+     * /proc/<pid>/ns/net} of a process started with {@code unshare --user --map-root-user --net}.
+     */
+    public CommandLineBuilder setNetworkNamespace(Path networkNamespace) {
+      this.networkNamespace = networkNamespace;
+      return this;
+    }
+
     /** Sets whether to pretend to be 'root' inside the namespace. */
     public CommandLineBuilder setUseFakeRoot(boolean useFakeRoot) {
       this.useFakeRoot = useFakeRoot;
@@ -190,6 +279,15 @@ public final class LinuxSandboxUtil {
       Preconditions.checkState(
           !(this.useFakeUsername && this.useFakeRoot),
           "useFakeUsername and useFakeRoot are exclusive");
+      Preconditions.checkState(
+          (this.inputLayer == null) == (this.overlayWorkDirectory == null),
+          "inputLayer requires overlayWorkDirectory");
+      Preconditions.checkState(
+          this.cgroupParent != null || (this.memoryLimitBytes == 0 && this.cpuLimit == 0),
+          "memory and CPU limits require a cgroupParent");
+      Preconditions.checkState(
+          !(this.createNetworkNamespace && this.networkNamespace != null),
+          "createNetworkNamespace and networkNamespace are exclusive");
 
       ImmutableList.Builder<String> commandLineBuilder = ImmutableList.builder();
 
@@ -209,11 +307,23 @@ public final class LinuxSandboxUtil {
       if (stderrPath != null) {
         commandLineBuilder.add("-L", stderrPath.getPathString());
       }
+      if (streamOutput) {
+        commandLineBuilder.add("-O");
+      }
       for (Path writablePath : writableFilesAndDirectories) {
         commandLineBuilder.add("-w", writablePath.getPathString());
       }
       for (Path tmpfsPath : tmpfsDirectories) {
         commandLineBuilder.add("-e", tmpfsPath.getPathString());
+        if (!tmpfsOptions.isEmpty()) {
+          commandLineBuilder.add("-E", tmpfsOptions);
+        }
+      }
+      if (scratchDirectory != null) {
+        commandLineBuilder.add("-s", scratchDirectory.getPathString());
+        if (!tmpfsOptions.isEmpty()) {
+          commandLineBuilder.add("-E", tmpfsOptions);
+        }
       }
       for (Path bindMountTarget : bindMounts.keySet()) {
         Path bindMountSource = bindMounts.get(bindMountTarget);
@@ -223,15 +333,37 @@ public final class LinuxSandboxUtil {
           commandLineBuilder.add("-m", bindMountTarget.getPathString());
         }
       }
+      if (inputLayer != null) {
+        commandLineBuilder.add("-I", inputLayer.getPathString());
+        commandLineBuilder.add("-i", overlayWorkDirectory.getPathString());
+      }
       if (statisticsPath != null) {
         commandLineBuilder.add("-S", statisticsPath.getPathString());
       }
+      if (cgroupParent != null) {
+        commandLineBuilder.add("-C", cgroupParent.getPathString());
+      }
+      if (memoryLimitBytes > 0) {
+        commandLineBuilder.add("-x", Long.toString(memoryLimitBytes));
+      }
+      if (cpuLimit > 0) {
+        commandLineBuilder.add("-c", Double.toString(cpuLimit));
+      }
+      if (!cpus.isEmpty()) {
+        commandLineBuilder.add("-a", cpus);
+      }
+      if (!numaNodes.isEmpty()) {
+        commandLineBuilder.add("-b", numaNodes);
+      }
       if (useFakeHostname) {
         commandLineBuilder.add("-H");
       }
       if (createNetworkNamespace) {
         commandLineBuilder.add("-N");
       }
+      if (networkNamespace != null) {
+        commandLineBuilder.add("-n", networkNamespace.getPathString());
+      }
       if (useFakeRoot) {
         commandLineBuilder.add("-R");
       }
@@ -14,6 +14,7 @@
 
 package com.google.devtools.build.lib.sandbox;
 
+import com.google.common.base.Splitter;
 import com.google.common.collect.ImmutableList;
 import com.google.common.collect.ImmutableMap;
 import com.google.common.collect.ImmutableSet;
@@ -36,6 +37,7 @@ import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.Symlinks;
+import java.io.ByteArrayOutputStream;
 import java.io.File;
 import java.io.IOException;
 import java.time.Duration;
@@ -76,6 +78,30 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
     return true;
   }
 
+  /**
+   * Returns the NUMA nodes the linux sandbox can bind actions to, as reported by {@code
+   * linux-sandbox -A}, or an empty list if that fails.
+   */
+  private static ImmutableList<Integer> getNumaNodes(CommandEnvironment cmdEnv) {
+    String[] argv = {LinuxSandboxUtil.getLinuxSandbox(cmdEnv).getPathString(), "-A"};
+    Command cmd = new Command(argv, ImmutableMap.of(), cmdEnv.getExecRoot().getPathFile());
+    ByteArrayOutputStream stdout = new ByteArrayOutputStream();
+    try {
+      cmd.execute(stdout, ByteStreams.nullOutputStream());
+    } catch (CommandException e) {
+      return ImmutableList.of();
+    }
+    ImmutableList.Builder<Integer> nodes = ImmutableList.builder();
+    for (String line : Splitter.on('\n').omitEmptyStrings().split(stdout.toString())) {
+      try {
+        nodes.add(Integer.parseInt(line.substring(0, line.indexOf(' '))));
+      } catch (IndexOutOfBoundsException | NumberFormatException e) {
+        return ImmutableList.of();
+      }
+    }
+    return nodes.build();
+  }
+
   private final FileSystem fileSystem;
   private final BlazeDirectories blazeDirs;
   private final Path execRoot;
@@ -87,6 +113,10 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
   private final LocalEnvProvider localEnvProvider;
   private final Duration timeoutKillDelay;
   private final @Nullable SandboxfsProcess sandboxfsProcess;
+  /** The NUMA nodes actions are bound to, empty unless there is more than one to choose from. */
+  private final ImmutableList<Integer> numaNodes;
+  /** The number of running actions bound to each of {@link #numaNodes}. */
+  private final int[] numaNodeLoads;
 
   /**
    * Creates a sandboxed spawn runner that uses the {@code linux-sandbox} tool.
@@ -118,6 +148,26 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
     this.timeoutKillDelay = timeoutKillDelay;
     this.sandboxfsProcess = sandboxfsProcess;
     this.localEnvProvider = new PosixLocalEnvProvider(cmdEnv.getClientEnv());
+    ImmutableList<Integer> numaNodes =
+        getSandboxOptions().sandboxNumaBinding ? getNumaNodes(cmdEnv) : ImmutableList.of();
+    this.numaNodes = numaNodes.size() > 1 ? numaNodes : ImmutableList.of();
+    this.numaNodeLoads = new int[this.numaNodes.size()];
+  }
+
+  /** Returns the index in {@link #numaNodes} of the node running the fewest actions. */
+  private synchronized int acquireNumaNode() {
+    int best = 0;
+    for (int i = 1; i < numaNodeLoads.length; i++) {
+      if (numaNodeLoads[i] < numaNodeLoads[best]) {
+        best = i;
+      }
+    }
+    numaNodeLoads[best]++;
+    return best;
+  }
+
+  private synchronized void releaseNumaNode(int index) {
+    numaNodeLoads[index]--;
   }
 
   @Override
@@ -148,9 +198,9 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
         LinuxSandboxUtil.commandLineBuilder(linuxSandbox, spawn.getArguments())
             .setWritableFilesAndDirectories(writableDirs)
             .setTmpfsDirectories(getTmpfsPaths())
+            .setTmpfsOptions(getSandboxOptions().sandboxTmpfsOptions)
             .setBindMounts(getReadOnlyBindMounts(blazeDirs, sandboxExecRoot))
             .setUseFakeHostname(getSandboxOptions().sandboxFakeHostname)
-            .setCreateNetworkNamespace(!(allowNetwork || Spawns.requiresNetwork(spawn)))
             .setUseDebugMode(getSandboxOptions().sandboxDebug)
             .setKillDelay(timeoutKillDelay);
 
@@ -164,36 +214,62 @@ final class LinuxSandboxedSpawnRunner extends AbstractSandboxSpawnRunner {
       commandLineBuilder.setUseFakeUsername(true);
     }
 
+    if (!(allowNetwork || Spawns.requiresNetwork(spawn))) {
+      if (getSandboxOptions().sandboxNetworkNamespace.isEmpty()) {
+        commandLineBuilder.setCreateNetworkNamespace(true);
+      } else {
+        commandLineBuilder.setNetworkNamespace(
+            sandboxBase.getFileSystem().getPath(getSandboxOptions().sandboxNetworkNamespace));
+      }
+    }
+
+    if (!getSandboxOptions().sandboxCgroupParent.isEmpty()) {
+      commandLineBuilder.setCgroupParent(
+          sandboxBase.getFileSystem().getPath(getSandboxOptions().sandboxCgroupParent));
+    }
+
     Path statisticsPath = null;
     if (getSandboxOptions().collectLocalSandboxExecutionStatistics) {
       statisticsPath = sandboxPath.getRelative("stats.out");
       commandLineBuilder.setStatisticsPath(statisticsPath);
     }
 
-    SandboxedSpawn sandbox;
-    if (sandboxfsProcess != null) {
-      sandbox =
-          new SandboxfsSandboxedSpawn(
-              sandboxfsProcess,
-              sandboxPath,
-              commandLineBuilder.build(),
-              environment,
-              SandboxHelpers.processInputFiles(spawn, context, execRoot),
-              outputs,
-              ImmutableSet.of());
-    } else {
-      sandbox =
-          new SymlinkedSandboxedSpawn(
-              sandboxPath,
-              sandboxExecRoot,
-              commandLineBuilder.build(),
-              environment,
-              SandboxHelpers.processInputFiles(spawn, context, execRoot),
-              outputs,
-              writableDirs);
+    int numaNode = -1;
+    if (!numaNodes.isEmpty()) {
+      numaNode = acquireNumaNode();
+      commandLineBuilder.setNumaNodes(Integer.toString(numaNodes.get(numaNode)));
     }
 
-    return runSpawn(spawn, sandbox, context, execRoot, timeout, statisticsPath);
+    try {
+      SandboxedSpawn sandbox;
+      if (sandboxfsProcess != null) {
+        sandbox =
+            new SandboxfsSandboxedSpawn(
+                sandboxfsProcess,
+                sandboxPath,
+                commandLineBuilder.build(),
+                environment,
+                SandboxHelpers.processInputFiles(spawn, context, execRoot),
+                outputs,
+                ImmutableSet.of());
+      } else {
+        sandbox =
+            new SymlinkedSandboxedSpawn(
+                sandboxPath,
+                sandboxExecRoot,
+                commandLineBuilder.build(),
+                environment,
+                SandboxHelpers.processInputFiles(spawn, context, execRoot),
+                outputs,
+                writableDirs);
+      }
+
+      return runSpawn(spawn, sandbox, context, execRoot, timeout, statisticsPath);
+    } finally {
+      if (numaNode >= 0) {
+        releaseNumaNode(numaNode);
+      }
+    }
   }
 
   @Override
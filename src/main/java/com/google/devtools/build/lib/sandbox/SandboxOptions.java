@@ -147,6 +147,18 @@ public class SandboxOptions extends OptionsBase {
   )
   public List<String> sandboxTmpfsPath;
 
+  @Option(
+    name = "experimental_sandbox_tmpfs_options",
+    defaultValue = "",
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.EXECUTION},
+    help =
+        "Mount options for the directories of --sandbox_tmpfs_path, e.g. "
+            + "'size=1g,huge=within_size' to cap how much memory an action's temporary files can "
+            + "use (if supported by the sandboxing implementation, ignored otherwise)."
+  )
+  public String sandboxTmpfsOptions;
+
   @Option(
     name = "sandbox_writable_path",
     allowMultiple = true,
@@ -218,6 +230,44 @@ public class SandboxOptions extends OptionsBase {
   )
   public boolean collectLocalSandboxExecutionStatistics;
 
+  @Option(
+    name = "experimental_sandbox_cgroup_parent",
+    defaultValue = "",
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.EXECUTION},
+    help =
+        "If set, the Linux sandbox runs each action in a new cgroup below this writable cgroup v2 "
+            + "directory. With --experimental_collect_local_sandbox_action_metrics, the statistics "
+            + "then cover all processes of the action, including their peak memory."
+  )
+  public String sandboxCgroupParent;
+
+  @Option(
+    name = "experimental_sandbox_numa_binding",
+    defaultValue = "false",
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.EXECUTION},
+    help =
+        "If enabled on a machine with more than one NUMA node, each Linux-sandboxed action is "
+            + "bound to the node running the fewest other actions: it runs on the CPUs of that "
+            + "node and allocates its memory there, instead of accessing the memory of the other "
+            + "nodes."
+  )
+  public boolean sandboxNumaBinding;
+
+  @Option(
+    name = "experimental_sandbox_network_namespace",
+    defaultValue = "",
+    documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+    effectTags = {OptionEffectTag.EXECUTION},
+    help =
+        "If set, Linux-sandboxed actions without network access share this network namespace "
+            + "(e.g. /proc/<pid>/ns/net of 'unshare --user --map-root-user --net sleep infinity') "
+            + "instead of each creating a new one, which does not scale to many parallel actions. "
+            + "The actions can then reach each other over the loopback interface."
+  )
+  public String sandboxNetworkNamespace;
+
   @Option(
     name = "experimental_enable_docker_sandbox",
     defaultValue = "false",
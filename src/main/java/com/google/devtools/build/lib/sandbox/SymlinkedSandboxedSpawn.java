@@ -21,6 +21,7 @@ import java.util.Collection;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
+import java.util.TreeMap;
 
 /**
  * Creates an execRoot for a Spawn that contains input files as symlinks to their original
@@ -39,6 +40,18 @@ public class SymlinkedSandboxedSpawn extends AbstractContainerizingSandboxedSpaw
     super(sandboxPath, sandboxExecRoot, arguments, environment, inputs, outputs, writableDirs);
   }
 
+  @Override
+  protected void createInputs(Map<PathFragment, Path> inputs) throws IOException {
+    // Create all links in one call, sorted so that the file system can reuse the parent
+    // directories of consecutive links.
+    Map<PathFragment, PathFragment> links = new TreeMap<>();
+    for (Map.Entry<PathFragment, Path> entry : inputs.entrySet()) {
+      // A null value means that we're supposed to create an empty file as the input.
+      links.put(entry.getKey(), entry.getValue() == null ? null : entry.getValue().asFragment());
+    }
+    getSandboxExecRoot().createSymbolicLinks(links);
+  }
+
   @Override
   protected void copyFile(Path source, Path target) throws IOException {
     target.createSymbolicLink(source);
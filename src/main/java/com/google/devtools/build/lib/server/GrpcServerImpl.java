@@ -51,6 +51,16 @@ import io.grpc.StatusRuntimeException;
 import io.grpc.netty.NettyServerBuilder;
 import io.grpc.stub.ServerCallStreamObserver;
 import io.grpc.stub.StreamObserver;
+import io.netty.channel.EventLoopGroup;
+import io.netty.channel.ServerChannel;
+import io.netty.channel.epoll.Epoll;
+import io.netty.channel.epoll.EpollEventLoopGroup;
+import io.netty.channel.epoll.EpollServerDomainSocketChannel;
+import io.netty.channel.kqueue.KQueue;
+import io.netty.channel.kqueue.KQueueEventLoopGroup;
+import io.netty.channel.kqueue.KQueueServerDomainSocketChannel;
+import io.netty.channel.unix.DomainSocketAddress;
+import java.io.FileOutputStream;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.io.PrintWriter;
@@ -76,6 +86,7 @@ import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicLong;
 import java.util.concurrent.atomic.AtomicReference;
 import java.util.logging.Logger;
+import javax.annotation.Nullable;
 import javax.annotation.concurrent.GuardedBy;
 
 /**
@@ -112,6 +123,8 @@ public class GrpcServerImpl implements RPCServer {
   private static final Logger logger = Logger.getLogger(GrpcServerImpl.class.getName());
 
   private static final long NANOSECONDS_IN_MS = TimeUnit.MILLISECONDS.toNanos(1);
+  // How often an idle server checks for memory pressure, if it does.
+  private static final long MEMORY_PRESSURE_POLL_NANOS = TimeUnit.SECONDS.toNanos(10);
 
   private class RunningCommand implements AutoCloseable {
     private final Thread thread;
@@ -153,9 +166,18 @@ public class GrpcServerImpl implements RPCServer {
   public static class Factory implements RPCServer.Factory {
     @Override
     public RPCServer create(BlazeCommandDispatcher dispatcher, Clock clock, int port,
-      Path workspace, Path serverDirectory, int maxIdleSeconds) throws IOException {
+        boolean unixSocket, Path workspace, Path serverDirectory, int maxIdleSeconds,
+        boolean idleShutdownOnMemoryPressure)
+        throws IOException {
       return new GrpcServerImpl(
-          dispatcher, clock, port, workspace, serverDirectory, maxIdleSeconds);
+          dispatcher,
+          clock,
+          port,
+          unixSocket,
+          workspace,
+          serverDirectory,
+          maxIdleSeconds,
+          idleShutdownOnMemoryPressure);
     }
   }
 
@@ -385,7 +407,10 @@ public class GrpcServerImpl implements RPCServer {
    */
   @VisibleForTesting
   static class RpcOutputStream extends OutputStream {
-    private static final int CHUNK_SIZE = 8192;
+    // Large writes are split into chunks of this size. They are well below the 4MB maximum
+    // message size of the client, but large enough that the per-message cost is negligible for
+    // outputs of hundreds of megabytes.
+    @VisibleForTesting static final int CHUNK_SIZE = 256 * 1024;
 
     // Store commandId and responseCookie as ByteStrings to avoid String -> UTF8 bytes conversion
     // for each serialized chunk of output.
@@ -490,8 +515,11 @@ public class GrpcServerImpl implements RPCServer {
 
   // These paths are all relative to the server directory
   private static final String PORT_FILE = "command_port";
+  private static final String SOCKET_FILE = "command.sock";
   private static final String REQUEST_COOKIE_FILE = "request_cookie";
   private static final String RESPONSE_COOKIE_FILE = "response_cookie";
+  // Keep in sync with blaze_util_posix.cc.
+  private static final String SERVER_READY_FD_ENV_VAR = "BAZEL_SERVER_READY_FD";
 
   private static final AtomicBoolean runShutdownHooks = new AtomicBoolean(true);
 
@@ -507,18 +535,24 @@ public class GrpcServerImpl implements RPCServer {
   private final String responseCookie;
   private final AtomicLong interruptCounter = new AtomicLong(0);
   private final int maxIdleSeconds;
+  // Null unless the server shuts down early when idle under memory pressure.
+  @Nullable private final MemoryPressure memoryPressure;
   private final PidFileWatcherThread pidFileWatcherThread;
   private final Path pidFile;
   private final String pidInFile;
   private final List<Path> filesToDeleteAtExit = new ArrayList<>();
   private final int port;
+  private final boolean unixSocket;
 
   private Server server;
+  private EventLoopGroup eventLoopGroup;
   private IdleServerTasks idleServerTasks;
   boolean serving;
 
   public GrpcServerImpl(BlazeCommandDispatcher dispatcher, Clock clock, int port,
-      Path workspace, Path serverDirectory, int maxIdleSeconds) throws IOException {
+      boolean unixSocket, Path workspace, Path serverDirectory, int maxIdleSeconds,
+      boolean idleShutdownOnMemoryPressure)
+      throws IOException {
     Runtime.getRuntime().addShutdownHook(new Thread() {
       @Override
       public void run() {
@@ -538,7 +572,9 @@ public class GrpcServerImpl implements RPCServer {
     this.serverDirectory = serverDirectory;
     this.workspace = workspace;
     this.port = port;
+    this.unixSocket = unixSocket;
     this.maxIdleSeconds = maxIdleSeconds;
+    this.memoryPressure = idleShutdownOnMemoryPressure ? MemoryPressure.create() : null;
     this.serving = false;
 
     this.streamExecutorPool =
@@ -614,16 +650,25 @@ public class GrpcServerImpl implements RPCServer {
       boolean idle = runningCommands.isEmpty();
       boolean wasIdle = false;
       long shutdownTime = -1;
+      // Whether the heap was already collected for the memory pressure in this idle period.
+      boolean collectedForPressure = false;
 
       while (true) {
         if (!wasIdle && idle) {
-          shutdownTime = BlazeClock.nanoTime() + maxIdleSeconds * 1000L * NANOSECONDS_IN_MS;
+          shutdownTime =
+              maxIdleSeconds > 0
+                  ? BlazeClock.nanoTime() + maxIdleSeconds * 1000L * NANOSECONDS_IN_MS
+                  : Long.MAX_VALUE;
+          collectedForPressure = false;
         }
 
         try {
           if (idle) {
             Verify.verify(shutdownTime > 0);
             long waitTime = shutdownTime - BlazeClock.nanoTime();
+            if (memoryPressure != null) {
+              waitTime = Math.min(waitTime, MEMORY_PRESSURE_POLL_NANOS);
+            }
             if (waitTime > 0) {
               // Round upwards so that we don't busy-wait in the last millisecond
               runningCommands.wait((waitTime + NANOSECONDS_IN_MS - 1) / NANOSECONDS_IN_MS);
@@ -638,12 +683,23 @@ public class GrpcServerImpl implements RPCServer {
         wasIdle = idle;
         idle = runningCommands.isEmpty();
         if (wasIdle && idle && BlazeClock.nanoTime() >= shutdownTime) {
+          logger.info("About to shutdown due to idleness");
           break;
         }
+        if (wasIdle && idle && memoryPressure != null && memoryPressure.isHigh()) {
+          if (collectedForPressure) {
+            logger.info("About to shutdown due to idleness under memory pressure");
+            break;
+          }
+          // Give back what the heap can spare first; if that does not relieve the pressure by the
+          // next poll, the server goes away.
+          logger.info("Collecting garbage due to idleness under memory pressure");
+          System.gc();
+          collectedForPressure = true;
+        }
       }
     }
 
-    logger.info("About to shutdown due to idleness");
     server.shutdown();
   }
 
@@ -688,6 +744,86 @@ public class GrpcServerImpl implements RPCServer {
   public void serve() throws IOException {
     Preconditions.checkState(!serving);
 
+    String serverAddress = unixSocket ? startOnUnixSocket() : null;
+    if (serverAddress == null) {
+      serverAddress = startOnLoopback();
+    }
+
+    if (maxIdleSeconds > 0 || memoryPressure != null) {
+      Thread timeoutThread = new Thread(this::timeoutThread);
+      timeoutThread.setName("grpc-timeout");
+      timeoutThread.setDaemon(true);
+      timeoutThread.start();
+    }
+    serving = true;
+
+    writeServerFile(PORT_FILE, serverAddress);
+    writeServerFile(REQUEST_COOKIE_FILE, requestCookie);
+    writeServerFile(RESPONSE_COOKIE_FILE, responseCookie);
+    signalReadiness();
+
+    try {
+      server.awaitTermination();
+    } catch (InterruptedException e) {
+      // TODO(lberki): Handle SIGINT in a reasonable way
+      throw new IllegalStateException(e);
+    } finally {
+      if (eventLoopGroup != null) {
+        eventLoopGroup.shutdownGracefully();
+      }
+    }
+  }
+
+  /**
+   * Starts the server on a Unix domain socket in the server directory, which is only accessible
+   * by the current user. Returns the address to write to the port file, or null if Unix domain
+   * sockets are not supported here or the socket cannot be bound, in which case the server is not
+   * started.
+   */
+  private String startOnUnixSocket() throws IOException {
+    Path socket = serverDirectory.getChild(SOCKET_FILE);
+    // sun_path is 108 bytes on Linux and 104 on macOS, including the terminating NUL.
+    if (socket.getPathString().getBytes(StandardCharsets.UTF_8).length >= 104) {
+      logger.warning("Socket path " + socket + " is too long, listening on a TCP port instead");
+      return null;
+    }
+    Class<? extends ServerChannel> channelType;
+    if (Epoll.isAvailable()) {
+      eventLoopGroup = new EpollEventLoopGroup();
+      channelType = EpollServerDomainSocketChannel.class;
+    } else if (KQueue.isAvailable()) {
+      eventLoopGroup = new KQueueEventLoopGroup();
+      channelType = KQueueServerDomainSocketChannel.class;
+    } else {
+      logger.warning("Unix domain sockets are not supported, listening on a TCP port instead");
+      return null;
+    }
+
+    try {
+      // A stale socket of a previous server would make the bind fail.
+      socket.delete();
+      server =
+          NettyServerBuilder.forAddress(new DomainSocketAddress(socket.getPathString()))
+              .channelType(channelType)
+              .bossEventLoopGroup(eventLoopGroup)
+              .workerEventLoopGroup(eventLoopGroup)
+              .addService(commandServer)
+              .directExecutor()
+              .build()
+              .start();
+    } catch (IOException e) {
+      logger.warning(
+          "Cannot listen on " + socket + ", listening on a TCP port instead: " + e.getMessage());
+      eventLoopGroup.shutdownGracefully();
+      eventLoopGroup = null;
+      return null;
+    }
+    deleteAtExit(socket);
+    return "unix:" + socket.getPathString();
+  }
+
+  /** Starts the server on a loopback TCP port and returns the address to write to the port file. */
+  private String startOnLoopback() throws IOException {
     // For reasons only Apple knows, you cannot bind to IPv4-localhost when you run in a sandbox
     // that only allows loopback traffic, but binding to IPv6-localhost works fine. This would
     // however break on systems that don't support IPv6. So what we'll do is to try to bind to IPv6
@@ -709,25 +845,24 @@ public class GrpcServerImpl implements RPCServer {
               .build()
               .start();
     }
+    return InetAddresses.toUriString(address.getAddress()) + ":" + server.getPort();
+  }
 
-    if (maxIdleSeconds > 0) {
-      Thread timeoutThread = new Thread(this::timeoutThread);
-      timeoutThread.setName("grpc-timeout");
-      timeoutThread.setDaemon(true);
-      timeoutThread.start();
+  /**
+   * Tells the client that started this server that it can connect now, by writing a byte to the
+   * inherited pipe named by {@link #SERVER_READY_FD_ENV_VAR}. Without it, the client polls.
+   */
+  private static void signalReadiness() {
+    String fd = System.getenv(SERVER_READY_FD_ENV_VAR);
+    if (fd == null || !fd.matches("[0-9]+")) {
+      return;
     }
-    serving = true;
-
-    writeServerFile(
-        PORT_FILE, InetAddresses.toUriString(address.getAddress()) + ":" + server.getPort());
-    writeServerFile(REQUEST_COOKIE_FILE, requestCookie);
-    writeServerFile(RESPONSE_COOKIE_FILE, responseCookie);
-
-    try {
-      server.awaitTermination();
-    } catch (InterruptedException e) {
-      // TODO(lberki): Handle SIGINT in a reasonable way
-      throw new IllegalStateException(e);
+    // Java cannot write to a file descriptor by number, but it can open the pipe again through
+    // /dev/fd, which is a link to /proc/self/fd on Linux.
+    try (OutputStream out = new FileOutputStream("/dev/fd/" + fd)) {
+      out.write(0);
+    } catch (IOException e) {
+      logger.warning("Cannot signal readiness to the client: " + e.getMessage());
     }
   }
 
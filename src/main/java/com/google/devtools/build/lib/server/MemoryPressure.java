@@ -0,0 +1,129 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.server;
+
+import com.google.common.annotations.VisibleForTesting;
+import com.google.common.io.ByteStreams;
+import com.google.devtools.build.lib.util.OS;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Paths;
+import java.util.logging.Logger;
+import javax.annotation.Nullable;
+
+/**
+ * Tells whether the machine is short of memory, as far as the OS says so: by pressure stall
+ * information on Linux 4.20 and later, and by the memory pressure level on macOS.
+ */
+abstract class MemoryPressure {
+  private static final Logger logger = Logger.getLogger(MemoryPressure.class.getName());
+
+  /**
+   * The share of the last ten seconds, in percent, in which some tasks stalled waiting for memory
+   * that counts as pressure.
+   */
+  @VisibleForTesting static final double STALL_PERCENT_THRESHOLD = 10.0;
+
+  private static final String LINUX_PRESSURE_FILE = "/proc/pressure/memory";
+
+  /** The value of kern.memorystatus_vm_pressure_level for a warning. */
+  private static final int DARWIN_PRESSURE_WARN = 2;
+
+  /** Returns whether there is memory pressure right now. */
+  abstract boolean isHigh();
+
+  /** Returns a monitor for the current OS, or null if it has no way to tell memory pressure. */
+  @Nullable
+  static MemoryPressure create() {
+    switch (OS.getCurrent()) {
+      case LINUX:
+        if (Files.isReadable(Paths.get(LINUX_PRESSURE_FILE))) {
+          return new LinuxMemoryPressure();
+        }
+        return null;
+      case DARWIN:
+        return new DarwinMemoryPressure();
+      default:
+        return null;
+    }
+  }
+
+  /**
+   * Returns whether the contents of /proc/pressure/memory, e.g.
+   * "some avg10=1.53 avg60=0.87 avg300=0.26 total=1303212", show pressure.
+   */
+  @VisibleForTesting
+  static boolean isLinuxPressureHigh(String contents) {
+    for (String line : contents.split("\n")) {
+      if (!line.startsWith("some ")) {
+        continue;
+      }
+      for (String field : line.split(" ")) {
+        if (field.startsWith("avg10=")) {
+          try {
+            return Double.parseDouble(field.substring("avg10=".length()))
+                >= STALL_PERCENT_THRESHOLD;
+          } catch (NumberFormatException e) {
+            return false;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  private static class LinuxMemoryPressure extends MemoryPressure {
+    @Override
+    boolean isHigh() {
+      try {
+        return isLinuxPressureHigh(
+            new String(
+                Files.readAllBytes(Paths.get(LINUX_PRESSURE_FILE)), StandardCharsets.US_ASCII));
+      } catch (IOException e) {
+        logger.warning("Cannot read " + LINUX_PRESSURE_FILE + ": " + e);
+        return false;
+      }
+    }
+  }
+
+  /**
+   * The level that the notifications of dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE)
+   * report, which the JVM does not expose; sysctl has it, too.
+   */
+  private static class DarwinMemoryPressure extends MemoryPressure {
+    @Override
+    boolean isHigh() {
+      try {
+        Process process =
+            new ProcessBuilder("/usr/sbin/sysctl", "-n", "kern.memorystatus_vm_pressure_level")
+                .redirectErrorStream(true)
+                .start();
+        String output;
+        try (InputStream in = process.getInputStream()) {
+          output = new String(ByteStreams.toByteArray(in), StandardCharsets.US_ASCII).trim();
+        }
+        return process.waitFor() == 0 && Integer.parseInt(output) >= DARWIN_PRESSURE_WARN;
+      } catch (IOException | NumberFormatException e) {
+        logger.warning("Cannot get the memory pressure level: " + e);
+        return false;
+      } catch (InterruptedException e) {
+        Thread.currentThread().interrupt();
+        return false;
+      }
+    }
+  }
+}
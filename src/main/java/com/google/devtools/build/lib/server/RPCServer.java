@@ -29,7 +29,9 @@ public interface RPCServer {
    */
   interface Factory {
     RPCServer create(BlazeCommandDispatcher dispatcher, Clock clock, int port,
-        Path workspace, Path serverDirectory, int maxIdleSeconds) throws IOException;
+        boolean unixSocket, Path workspace, Path serverDirectory, int maxIdleSeconds,
+        boolean idleShutdownOnMemoryPressure)
+        throws IOException;
   }
 
   /**
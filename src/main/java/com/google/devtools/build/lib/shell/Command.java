@@ -248,6 +248,32 @@ public final class Command {
             .get();
   }
 
+  /**
+   * Execute this command with no input to stdin, and with the output written by the subprocess
+   * directly to the given files, so that no threads are needed to read it. If the current process
+   * is interrupted, then the subprocess is also interrupted. This call blocks until the subprocess
+   * completes or an error occurs.
+   *
+   * <p>Whether existing contents of the files are kept depends on the {@link SubprocessFactory}.
+   * Both files may be the same.
+   *
+   * @return {@link CommandResult} representing result of the execution; it holds no output
+   * @throws ExecFailedException if {@link Runtime#exec(String[])} fails for any reason
+   * @throws AbnormalTerminationException if the process was terminated due to a signal
+   * @throws BadExitStatusException if the process exits with a non-zero status
+   */
+  public CommandResult execute(File stdoutFile, File stderrFile) throws CommandException {
+    Preconditions.checkNotNull(stdoutFile);
+    Preconditions.checkNotNull(stderrFile);
+    return doExecute(
+            NO_INPUT,
+            Consumers.createRedirectedConsumers(),
+            KILL_SUBPROCESS_ON_INTERRUPT,
+            stdoutFile,
+            stderrFile)
+        .get();
+  }
+
   /**
    * Execute this command with no input to stdin, and with the output captured in memory. If the
    * current process is interrupted, then the subprocess is also interrupted. This call blocks until
@@ -355,10 +381,20 @@ public final class Command {
   private FutureCommandResult doExecute(
       InputStream stdinInput, OutErrConsumers outErrConsumers, boolean killSubprocessOnInterrupt) 
           throws ExecFailedException {
+    return doExecute(stdinInput, outErrConsumers, killSubprocessOnInterrupt, null, null);
+  }
+
+  private FutureCommandResult doExecute(
+      InputStream stdinInput,
+      OutErrConsumers outErrConsumers,
+      boolean killSubprocessOnInterrupt,
+      @Nullable File stdoutFile,
+      @Nullable File stderrFile)
+      throws ExecFailedException {
     Preconditions.checkNotNull(stdinInput, "stdinInput");
     logCommand();
 
-    Subprocess process = startProcess();
+    Subprocess process = startProcess(stdoutFile, stderrFile);
 
     outErrConsumers.logConsumptionStrategy();
     outErrConsumers.registerInputs(
@@ -372,11 +408,25 @@ public final class Command {
     return new FutureCommandResultImpl(this, process, outErrConsumers, killSubprocessOnInterrupt);
   }
 
-  private Subprocess startProcess() throws ExecFailedException {
-    try {
-      return subprocessBuilder.start();
-    } catch (IOException ioe) {
-      throw new ExecFailedException(this, ioe);
+  private Subprocess startProcess(@Nullable File stdoutFile, @Nullable File stderrFile)
+      throws ExecFailedException {
+    // The redirection is only set for this one process: the builder is shared by all executions of
+    // this command.
+    synchronized (subprocessBuilder) {
+      try {
+        if (stdoutFile != null) {
+          subprocessBuilder.setStdout(stdoutFile);
+          subprocessBuilder.setStderr(stderrFile);
+        }
+        return subprocessBuilder.start();
+      } catch (IOException ioe) {
+        throw new ExecFailedException(this, ioe);
+      } finally {
+        if (stdoutFile != null) {
+          subprocessBuilder.setStdout(SubprocessBuilder.StreamAction.STREAM);
+          subprocessBuilder.setStderr(SubprocessBuilder.StreamAction.STREAM);
+        }
+      }
     }
   }
 
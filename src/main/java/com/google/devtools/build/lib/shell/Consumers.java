@@ -33,7 +33,8 @@ import java.util.logging.Logger;
  * This class provides convenience methods for consuming (actively reading)
  * output and error streams with different consumption policies:
  * accumulating ({@link #createAccumulatingConsumers()},
- * and streaming ({@link #createStreamingConsumers(OutputStream, OutputStream)}).
+ * streaming ({@link #createStreamingConsumers(OutputStream, OutputStream)})
+ * and none, for output redirected to files ({@link #createRedirectedConsumers()}).
  */
 final class Consumers {
 
@@ -55,6 +56,10 @@ final class Consumers {
     return new OutErrConsumers(new StreamingConsumer(out), new StreamingConsumer(err));
   }
 
+  static OutErrConsumers createRedirectedConsumers() {
+    return new OutErrConsumers(new RedirectedConsumer(), new RedirectedConsumer());
+  }
+
   static class OutErrConsumers {
     private final OutputConsumer out;
     private final OutputConsumer err;
@@ -191,6 +196,31 @@ final class Consumers {
     }
   }
 
+  /**
+   * This consumer reads nothing: the subprocess writes the output to a
+   * file itself, so it never reaches this process.
+   */
+  private static class RedirectedConsumer implements OutputConsumer {
+    @Override
+    public ByteArrayOutputStream getAccumulatedOut() {
+      return CommandResult.NO_OUTPUT_COLLECTED;
+    }
+
+    @Override
+    public void logConsumptionStrategy() {
+      logger.finer("Output will be written to a file by the subprocess");
+    }
+
+    @Override
+    public void registerInput(InputStream in, boolean closeConsumer) {}
+
+    @Override
+    public void cancel() {}
+
+    @Override
+    public void waitForCompletion() {}
+  }
+
   /**
    * A mixin that makes consumers active - this is where we kick of
    * multithreading ({@link #registerInput(InputStream, boolean)}), cancel actions
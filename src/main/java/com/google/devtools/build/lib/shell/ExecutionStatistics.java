@@ -43,6 +43,61 @@ public final class ExecutionStatistics {
     }
   }
 
+  /**
+   * Provides the resource usage of the command's cgroup, if it ran in one.
+   *
+   * @param executionStatisticsProtoPath path to a materialized ExecutionStatistics proto
+   * @return a {@link CgroupUsage} object containing cgroup statistics, if available
+   */
+  public static Optional<CgroupUsage> getCgroupUsage(Path executionStatisticsProtoPath)
+      throws IOException {
+    try (InputStream protoInputStream =
+        new BufferedInputStream(executionStatisticsProtoPath.getInputStream())) {
+      Protos.ExecutionStatistics executionStatisticsProto =
+          Protos.ExecutionStatistics.parseFrom(protoInputStream);
+      if (executionStatisticsProto.hasCgroupUsage()) {
+        return Optional.of(new CgroupUsage(executionStatisticsProto.getCgroupUsage()));
+      } else {
+        return Optional.empty();
+      }
+    }
+  }
+
+  /**
+   * Provides the timings of the phases of a command execution, if the process-wrapper or sandbox
+   * recorded them.
+   */
+  public static Optional<PhaseTimings> getPhaseTimings(Path executionStatisticsProtoPath)
+      throws IOException {
+    try (InputStream protoInputStream =
+        new BufferedInputStream(executionStatisticsProtoPath.getInputStream())) {
+      Protos.ExecutionStatistics executionStatisticsProto =
+          Protos.ExecutionStatistics.parseFrom(protoInputStream);
+      if (executionStatisticsProto.hasTimestamps()) {
+        return Optional.of(new PhaseTimings(executionStatisticsProto.getTimestamps()));
+      } else {
+        return Optional.empty();
+      }
+    }
+  }
+
+  /**
+   * Provides how much output of a command was dropped, if the process-wrapper limited its size.
+   */
+  public static Optional<OutputTruncation> getOutputTruncation(Path executionStatisticsProtoPath)
+      throws IOException {
+    try (InputStream protoInputStream =
+        new BufferedInputStream(executionStatisticsProtoPath.getInputStream())) {
+      Protos.ExecutionStatistics executionStatisticsProto =
+          Protos.ExecutionStatistics.parseFrom(protoInputStream);
+      if (executionStatisticsProto.hasOutputTruncation()) {
+        return Optional.of(new OutputTruncation(executionStatisticsProto.getOutputTruncation()));
+      } else {
+        return Optional.empty();
+      }
+    }
+  }
+
   /**
    * Provides resource usage statistics for command execution, derived from the getrusage() system
    * call.
@@ -148,4 +203,120 @@ public final class ExecutionStatistics {
       return resourceUsageProto.getNivcsw();
     }
   }
+
+  /**
+   * Provides resource usage statistics of all processes of a command, derived from the files of
+   * the cgroup v2 it ran in. Unlike {@link ResourceUsage}, this includes descendants that were
+   * reparented and never waited for.
+   */
+  public static class CgroupUsage {
+    private final Protos.CgroupUsage cgroupUsageProto;
+
+    /** Provides cgroup statistics via a CgroupUsage proto object. */
+    public CgroupUsage(Protos.CgroupUsage cgroupUsageProto) {
+      this.cgroupUsageProto = cgroupUsageProto;
+    }
+
+    /** Returns the peak memory usage (in bytes) of the cgroup, or 0 if not available. */
+    public long getMemoryPeakBytes() {
+      return cgroupUsageProto.getMemoryPeakBytes();
+    }
+
+    /** Returns the number of processes killed for exceeding the memory limit. */
+    public long getOomKills() {
+      return cgroupUsageProto.getOomKills();
+    }
+
+    /** Returns the CPU time used by the cgroup. */
+    public Duration getCpuTime() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuUsageUsec() * 1000);
+    }
+
+    /** Returns the user CPU time used by the cgroup. */
+    public Duration getUserCpuTime() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuUserUsec() * 1000);
+    }
+
+    /** Returns the system CPU time used by the cgroup. */
+    public Duration getSystemCpuTime() {
+      return Duration.ofNanos(cgroupUsageProto.getCpuSystemUsec() * 1000);
+    }
+
+    /** Returns the bytes read from block devices, or 0 if not available. */
+    public long getIoReadBytes() {
+      return cgroupUsageProto.getIoReadBytes();
+    }
+
+    /** Returns the bytes written to block devices, or 0 if not available. */
+    public long getIoWriteBytes() {
+      return cgroupUsageProto.getIoWriteBytes();
+    }
+  }
+
+  /**
+   * Provides the time spent in each phase of a command execution: setting up the process-wrapper or
+   * sandbox, running the command, and tearing down again.
+   */
+  public static class PhaseTimings {
+    private final Protos.PhaseTimestamps timestampsProto;
+
+    /** Provides phase timings via a PhaseTimestamps proto object. */
+    public PhaseTimings(Protos.PhaseTimestamps timestampsProto) {
+      this.timestampsProto = timestampsProto;
+    }
+
+    /** Returns the time from the start of the process-wrapper or sandbox to the command's start. */
+    public Duration getSetupTime() {
+      return micros(timestampsProto.getChildStartUsec() - timestampsProto.getStartUsec());
+    }
+
+    /** Returns the time the command ran for. */
+    public Duration getCommandTime() {
+      return micros(timestampsProto.getChildExitUsec() - timestampsProto.getChildStartUsec());
+    }
+
+    /** Returns the time from the command's exit to the end of the process-wrapper or sandbox. */
+    public Duration getTeardownTime() {
+      return micros(timestampsProto.getEndUsec() - timestampsProto.getChildExitUsec());
+    }
+
+    private static Duration micros(long usec) {
+      return Duration.ofNanos(usec * 1000);
+    }
+  }
+
+  /** Provides how much of the output of a command the process-wrapper kept, if it limited it. */
+  public static class OutputTruncation {
+    private final Protos.OutputTruncation truncationProto;
+
+    /** Provides output truncation statistics via an OutputTruncation proto object. */
+    public OutputTruncation(Protos.OutputTruncation truncationProto) {
+      this.truncationProto = truncationProto;
+    }
+
+    /** Returns the number of bytes the command wrote to stdout. */
+    public long getStdoutBytes() {
+      return truncationProto.getStdoutBytes();
+    }
+
+    /** Returns the number of bytes written to stdout that are not in the stdout file. */
+    public long getStdoutDroppedBytes() {
+      return truncationProto.getStdoutDroppedBytes();
+    }
+
+    /** Returns the number of bytes the command wrote to stderr. */
+    public long getStderrBytes() {
+      return truncationProto.getStderrBytes();
+    }
+
+    /** Returns the number of bytes written to stderr that are not in the stderr file. */
+    public long getStderrDroppedBytes() {
+      return truncationProto.getStderrDroppedBytes();
+    }
+
+    /** Returns whether the command was killed for writing more than the hard limit. */
+    public boolean wasKilled() {
+      return truncationProto.getKilled();
+    }
+  }
 }
@@ -310,7 +310,7 @@ public class ActionMetadataHandler implements MetadataHandler {
       // Preserve existing behavior: we don't set non-TreeArtifact directories
       // read only and executable. However, it's unusual for non-TreeArtifact outputs
       // to be directories.
-      setTreeReadOnlyAndExecutable(artifact, PathFragment.EMPTY_FRAGMENT);
+      setTreeReadOnlyAndExecutable(artifact);
     }
 
     Set<TreeFileArtifact> registeredContents = outputDirectoryListings.get(artifact);
@@ -658,16 +658,8 @@ public class ActionMetadataHandler implements MetadataHandler {
     }
   }
 
-  private void setTreeReadOnlyAndExecutable(SpecialArtifact parent, PathFragment subpath)
-      throws IOException {
-    Path path = artifactPathResolver.toPath(parent).getRelative(subpath);
-    if (path.isDirectory()) {
-      path.chmod(0555);
-      for (Path child : path.getDirectoryEntries()) {
-        setTreeReadOnlyAndExecutable(parent, subpath.getChild(child.getBaseName()));
-      }
-    } else {
-      setPathReadOnlyAndExecutable(ActionInputHelper.treeFileArtifact(parent, subpath));
-    }
+  private void setTreeReadOnlyAndExecutable(SpecialArtifact parent) throws IOException {
+    // Injected files are not skipped here, but chmodTree leaves files in this mode already alone.
+    artifactPathResolver.toPath(parent).chmodTree(0555);
   }
 }
@@ -0,0 +1,130 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableSet;
+import com.google.devtools.build.lib.UnixJniLoader;
+import com.google.devtools.common.options.OptionsClassProvider;
+import java.io.File;
+import java.nio.file.Path;
+
+/**
+ * A {@link DiffAwareness} that uses kqueue from native code to watch the filesystem, to use in
+ * lieu of {@link WatchServiceDiffAwareness} on FreeBSD.
+ *
+ * <p>kqueue needs an open descriptor for every watched file and directory. The native code watches
+ * new files as soon as their directory reports them, on its own thread. If the tree needs more
+ * descriptors than it may use, or the root goes away, the next view is broken and the next build
+ * checks every file.
+ */
+public final class FreeBSDKqueueDiffAwareness extends LocalDiffAwareness {
+  private boolean closed;
+
+  // Keep a pointer to a native structure in the JNI code (the run loop needs that structure).
+  private long nativePointer;
+
+  private boolean opened;
+
+  /** Watch changes on the file system under <code>watchRoot</code>. */
+  FreeBSDKqueueDiffAwareness(String watchRoot) {
+    super(watchRoot);
+  }
+
+  /** Helper function to start the watch of <code>root</code>, called by {@link #init}. */
+  private native void create(String root);
+
+  /** Run the main loop; it frees the native structure once {@link #doClose} is called. */
+  private native void run();
+
+  private void init() {
+    // The code below is based on the assumption that init() can never fail: a failure to watch is
+    // reported by the next poll().
+    Preconditions.checkState(!opened);
+    opened = true;
+    create(watchRootPath.toAbsolutePath().toString());
+    // Start a thread that just contains the kevent loop.
+    Thread thread =
+        new Thread(
+            new Runnable() {
+              @Override
+              public void run() {
+                FreeBSDKqueueDiffAwareness.this.run();
+              }
+            },
+            "kqueue-diff-awareness");
+    thread.setDaemon(true);
+    thread.start();
+  }
+
+  /** Close this watch service, this service should not be used any longer after closing. */
+  @Override
+  public void close() {
+    if (opened && !closed) {
+      closed = true;
+      doClose();
+    }
+  }
+
+  static final boolean JNI_AVAILABLE;
+
+  /** JNI code stopping the main loop and closing the kqueue and the watched descriptors. */
+  private native void doClose();
+
+  /**
+   * JNI code returning the list of absolute paths modified since last call, or null if changes
+   * were lost.
+   */
+  private native String[] poll();
+
+  static {
+    boolean loadJniWorked = false;
+    try {
+      UnixJniLoader.loadJni();
+      loadJniWorked = true;
+    } catch (UnsatisfiedLinkError ignored) {
+      // The Bazel bootstrap binary doesn't have access to the JNI code; LocalDiffAwareness.Factory
+      // uses WatchServiceDiffAwareness there instead.
+    }
+    JNI_AVAILABLE = loadJniWorked;
+  }
+
+  @Override
+  public View getCurrentView(OptionsClassProvider options)
+      throws BrokenDiffAwarenessException {
+    // See WatchServiceDiffAwareness#getCurrentView for an explanation of this logic.
+    boolean watchFs = options.getOptions(Options.class).watchFS;
+    if (watchFs && !opened) {
+      init();
+    } else if (!watchFs && opened) {
+      close();
+      throw new BrokenDiffAwarenessException("Switched off --watchfs again");
+    } else if (!opened) {
+      return EVERYTHING_MODIFIED;
+    }
+    Preconditions.checkState(!closed);
+    String[] modified = poll();
+    if (modified == null) {
+      close();
+      throw new BrokenDiffAwarenessException(
+          "Changes were lost when watching local filesystem for changes");
+    }
+    ImmutableSet.Builder<Path> paths = ImmutableSet.builder();
+    for (String path : modified) {
+      paths.add(new File(path).toPath());
+    }
+    return newView(paths.build());
+  }
+}
@@ -20,6 +20,7 @@ import com.google.common.base.Preconditions;
 import com.google.common.collect.ImmutableList;
 import com.google.common.collect.ImmutableSet;
 import com.google.common.collect.Iterables;
+import com.google.common.hash.Hashing;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.vfs.ModifiedFileSet;
 import com.google.devtools.build.lib.vfs.PathFragment;
@@ -29,18 +30,24 @@ import com.google.devtools.common.options.OptionDocumentationCategory;
 import com.google.devtools.common.options.OptionEffectTag;
 import com.google.devtools.common.options.OptionsBase;
 import java.io.IOException;
+import java.nio.charset.StandardCharsets;
 import java.nio.file.FileSystems;
 import java.nio.file.Path;
 import java.util.Set;
+import javax.annotation.Nullable;
 
 /**
  * File system watcher for local filesystems. It's able to provide a list of changed files between
- * two consecutive calls. On Linux, uses the standard Java WatchService, which uses 'inotify' and,
- * on OS X, uses {@link MacOSXFsEventsDiffAwareness}, which use FSEvents.
+ * two consecutive calls. On Linux, uses {@link LinuxInotifyDiffAwareness}, which uses 'inotify'
+ * from native code, on OS X, uses {@link MacOSXFsEventsDiffAwareness}, which use FSEvents, on
+ * FreeBSD, uses {@link FreeBSDKqueueDiffAwareness}, which uses kqueue, on Windows, uses {@link
+ * WindowsDiffAwareness}, which uses ReadDirectoryChangesW, and elsewhere, uses the standard Java
+ * WatchService.
  *
  * <p>
- * This is an abstract class, specialized by {@link MacOSXFsEventsDiffAwareness} and
- * {@link WatchServiceDiffAwareness}.
+ * This is an abstract class, specialized by {@link LinuxInotifyDiffAwareness},
+ * {@link MacOSXFsEventsDiffAwareness}, {@link FreeBSDKqueueDiffAwareness},
+ * {@link WindowsDiffAwareness} and {@link WatchServiceDiffAwareness}.
  */
 public abstract class LocalDiffAwareness implements DiffAwareness {
   /**
@@ -62,14 +69,25 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
   /** Factory for creating {@link LocalDiffAwareness} instances. */
   public static class Factory implements DiffAwareness.Factory {
     private final ImmutableList<String> prefixBlacklist;
+    @Nullable private final com.google.devtools.build.lib.vfs.Path stateDirectory;
 
     /**
      * Creates a new factory; the file system watcher may not work on all file systems, particularly
      * for network file systems. The prefix blacklist can be used to blacklist known paths that
      * point to network file systems.
+     *
+     * <p>Watchers that can resume after a restart, i.e. the FSEvents one, keep their position in
+     * a file under {@code stateDirectory} if it is not null.
      */
-    public Factory(ImmutableList<String> prefixBlacklist) {
+    public Factory(
+        ImmutableList<String> prefixBlacklist,
+        @Nullable com.google.devtools.build.lib.vfs.Path stateDirectory) {
       this.prefixBlacklist = prefixBlacklist;
+      this.stateDirectory = stateDirectory;
+    }
+
+    public Factory(ImmutableList<String> prefixBlacklist) {
+      this(prefixBlacklist, null);
     }
 
     @Override
@@ -90,7 +108,24 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
       }
       // On OSX uses FsEvents due to https://bugs.openjdk.java.net/browse/JDK-7133447
       if (OS.getCurrent() == OS.DARWIN) {
-        return new MacOSXFsEventsDiffAwareness(resolvedPathEntryFragment.toString());
+        Path stateFile = null;
+        if (stateDirectory != null) {
+          String name =
+              Hashing.md5()
+                  .hashString(resolvedPathEntryFragment.toString(), StandardCharsets.UTF_8)
+                  .toString();
+          stateFile = stateDirectory.getRelative(name).getPathFile().toPath();
+        }
+        return new MacOSXFsEventsDiffAwareness(resolvedPathEntryFragment.toString(), stateFile);
+      }
+      if (OS.getCurrent() == OS.LINUX && LinuxInotifyDiffAwareness.JNI_AVAILABLE) {
+        return new LinuxInotifyDiffAwareness(resolvedPathEntryFragment.toString());
+      }
+      if (OS.getCurrent() == OS.FREEBSD && FreeBSDKqueueDiffAwareness.JNI_AVAILABLE) {
+        return new FreeBSDKqueueDiffAwareness(resolvedPathEntryFragment.toString());
+      }
+      if (OS.getCurrent() == OS.WINDOWS && WindowsDiffAwareness.JNI_AVAILABLE) {
+        return new WindowsDiffAwareness(resolvedPathEntryFragment.toString());
       }
 
       return new WatchServiceDiffAwareness(resolvedPathEntryFragment.toString());
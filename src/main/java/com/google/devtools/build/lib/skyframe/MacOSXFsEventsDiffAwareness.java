@@ -14,12 +14,19 @@
 
 package com.google.devtools.build.lib.skyframe;
 
+import static java.nio.charset.StandardCharsets.UTF_8;
+
 import com.google.common.base.Preconditions;
 import com.google.common.collect.ImmutableSet;
 import com.google.devtools.build.lib.UnixJniLoader;
 import com.google.devtools.common.options.OptionsClassProvider;
 import java.io.File;
+import java.io.IOException;
+import java.nio.file.Files;
 import java.nio.file.Path;
+import java.nio.file.StandardCopyOption;
+import java.util.logging.Logger;
+import javax.annotation.Nullable;
 
 /**
  * A {@link DiffAwareness} that use fsevents to watch the filesystem to use in lieu of
@@ -27,10 +34,23 @@ import java.nio.file.Path;
  *
  * <p>On OS X, the local diff awareness cannot work because WatchService is dummy and do polling,
  * which is slow (https://bugs.openjdk.java.net/browse/JDK-7133447).
+ *
+ * <p>Given a state file, it keeps the FSEvents ID of the last change it reported there, and the
+ * next instance watching the same root, e.g. in a later server, resumes the event stream from it:
+ * FSEvents then replays the changes made in between, which the first views report.
  */
 public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
+  private static final Logger logger =
+      Logger.getLogger(MacOSXFsEventsDiffAwareness.class.getName());
+
   private final double latency;
 
+  // Where the position in the event history is kept between instances, or null.
+  @Nullable private final Path stateFile;
+
+  // The UUID of the event history of the volume of the watched root, or null if unknown.
+  @Nullable private String deviceUuid;
+
   private boolean closed;
 
   // Keep a pointer to a native structure in the JNI code (the FsEvents callback needs that
@@ -43,22 +63,39 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
    * Watch changes on the file system under <code>watchRoot</code> with a granularity of
    * <code>delay</code> seconds.
    */
-  MacOSXFsEventsDiffAwareness(String watchRoot, double latency) {
+  MacOSXFsEventsDiffAwareness(String watchRoot, double latency, @Nullable Path stateFile) {
     super(watchRoot);
     this.latency = latency;
+    this.stateFile = stateFile;
+  }
+
+  /**
+   * Watch changes on the file system under <code>watchRoot</code> with a granularity of 5ms,
+   * resuming from and recording the position in the event history in <code>stateFile</code> if
+   * it is not null.
+   */
+  MacOSXFsEventsDiffAwareness(String watchRoot, @Nullable Path stateFile) {
+    this(watchRoot, 0.005, stateFile);
   }
 
   /**
    * Watch changes on the file system under <code>watchRoot</code> with a granularity of 5ms.
    */
   MacOSXFsEventsDiffAwareness(String watchRoot) {
-    this(watchRoot, 0.005);
+    this(watchRoot, null);
   }
 
   /**
-   * Helper function to start the watch of <code>paths</code>, called by the constructor.
+   * Helper function to start the watch of <code>paths</code>, called by the constructor. Replays
+   * the events after <code>sinceWhen</code> first if it is not negative.
    */
-  private native void create(String[] paths, double latency);
+  private native void create(String[] paths, double latency, long sinceWhen);
+
+  /** Returns the UUID of the event history of the volume holding <code>path</code>, or null. */
+  private static native String deviceUuid(String path);
+
+  /** Returns the ID of the last event covered by the last {@link #poll}. */
+  private native long lastPolledEventId();
 
   /**
    * Run the main loop
@@ -70,7 +107,13 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
     // case; if you change init(), then you also need to update {@link #getCurrentView}.
     Preconditions.checkState(!opened);
     opened = true;
-    create(new String[] {watchRootPath.toAbsolutePath().toString()}, latency);
+    String root = watchRootPath.toAbsolutePath().toString();
+    long sinceWhen = -1;
+    if (stateFile != null) {
+      deviceUuid = deviceUuid(root);
+      sinceWhen = readSavedEventId();
+    }
+    create(new String[] {root}, latency, sinceWhen);
     // Start a thread that just contains the OS X run loop.
     new Thread(
             new Runnable() {
@@ -94,6 +137,44 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
     }
   }
 
+  /**
+   * Returns the event ID saved in the state file by an earlier instance, or -1 if there is none
+   * that can be resumed from, e.g. because the volume was reformatted since.
+   */
+  private long readSavedEventId() {
+    if (deviceUuid == null || !Files.exists(stateFile)) {
+      return -1;
+    }
+    try {
+      String[] fields = new String(Files.readAllBytes(stateFile), UTF_8).trim().split(" ");
+      if (fields.length == 2 && fields[0].equals(deviceUuid)) {
+        return Long.parseLong(fields[1]);
+      }
+    } catch (IOException | NumberFormatException e) {
+      logger.warning("Cannot read " + stateFile + ": " + e.getMessage());
+    }
+    return -1;
+  }
+
+  /** Saves the position of the last poll in the state file, or removes it if it is -1. */
+  private void saveEventId(long eventId) {
+    if (stateFile == null) {
+      return;
+    }
+    try {
+      if (eventId < 0 || deviceUuid == null) {
+        Files.deleteIfExists(stateFile);
+        return;
+      }
+      Files.createDirectories(stateFile.getParent());
+      Path tmp = stateFile.resolveSibling(stateFile.getFileName() + ".tmp");
+      Files.write(tmp, (deviceUuid + " " + eventId + "\n").getBytes(UTF_8));
+      Files.move(tmp, stateFile, StandardCopyOption.REPLACE_EXISTING);
+    } catch (IOException e) {
+      logger.warning("Cannot write " + stateFile + ": " + e.getMessage());
+    }
+  }
+
   private static final boolean JNI_AVAILABLE;
 
   /**
@@ -102,7 +183,8 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
   private native void doClose();
 
   /**
-   * JNI code returning the list of absolute path modified since last call.
+   * JNI code returning the list of absolute path modified since last call, or null if some changes
+   * were not reported, e.g. because there were too many.
    */
   private native String[] poll();
 
@@ -138,10 +220,19 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
       return EVERYTHING_MODIFIED;
     }
     Preconditions.checkState(!closed);
+    String[] modified = poll();
+    if (modified == null) {
+      // A later instance must not replay the events that were lost again.
+      saveEventId(-1);
+      close();
+      throw new BrokenDiffAwarenessException(
+          "Events were lost when watching local filesystem for changes");
+    }
     ImmutableSet.Builder<Path> paths = ImmutableSet.builder();
-    for (String path : poll()) {
+    for (String path : modified) {
       paths.add(new File(path).toPath());
     }
+    saveEventId(lastPolledEventId());
     return newView(paths.build());
   }
 }
@@ -430,6 +430,41 @@ public final class NativePosixFiles {
   public static native byte[] lgetxattr(String path, String name)
       throws IOException;
 
+  /**
+   * Copies the regular file {@code from}, following symbolic links, to {@code to}, replacing
+   * {@code to} if it exists. The copy gets the mode bits and the modification time of {@code
+   * from}. It is a copy-on-write clone where the file system supports that (FICLONE on Btrfs and
+   * XFS, clonefile on APFS); otherwise the kernel copies the data where it can
+   * (copy_file_range, sendfile), and a read/write loop the rest.
+   *
+   * @param from the file to copy.
+   * @param to the copy.
+   * @throws IOException if the file could not be copied; {@code to} then does not exist.
+   */
+  public static native void copyFile(String from, String to) throws IOException;
+
+  /**
+   * Copies many files with a single native call, like {@link #copyFile}, on a few native threads
+   * that take the files off a shared queue.
+   *
+   * @param from the files to copy; none may be null.
+   * @param to the copies, positionally matching {@code from}; none may be null.
+   * @param errnos receives 0 for every file that was copied, and the errno of the failure
+   *     otherwise.
+   */
+  public static void copyFiles(String[] from, String[] to, int[] errnos) {
+    if (to.length != from.length || errnos.length < from.length) {
+      throw new IllegalArgumentException(
+          "copyFiles got " + from.length + " sources, " + to.length + " targets and "
+              + errnos.length + " results");
+    }
+    if (from.length > 0) {
+      copyFilesNative(from, to, errnos);
+    }
+  }
+
+  private static native void copyFilesNative(String[] from, String[] to, int[] errnos);
+
   /**
    * Returns the MD5 digest of the specified file, following symbolic links.
    *
@@ -450,6 +485,65 @@ public final class NativePosixFiles {
     return HashCode.fromBytes(md5sumAsBytes(path));
   }
 
+  /**
+   * Creates many symbolic links below a directory in one call, creating the missing directories on
+   * the way. The directories are opened relative to each other and kept open while consecutive
+   * links share them, so {@code links} should be sorted.
+   *
+   * @param root the existing directory the links are relative to.
+   * @param links the relative paths of the links; none may be null or contain "..".
+   * @param targets the targets of the links; a null target creates an empty file instead.
+   * @param parallel whether the links may be created on a few native threads.
+   * @throws IOException if a directory or link could not be created, e.g. because it exists;
+   *     creation stops at the first failure.
+   */
+  public static void symlinkTree(String root, String[] links, String[] targets, boolean parallel)
+      throws IOException {
+    if (targets.length != links.length) {
+      throw new IllegalArgumentException(
+          "symlinkTree got " + links.length + " links and " + targets.length + " targets");
+    }
+    if (links.length > 0) {
+      symlinkTreeNative(root, links, targets, parallel);
+    }
+  }
+
+  private static native void symlinkTreeNative(
+      String root, String[] links, String[] targets, boolean parallel) throws IOException;
+
+  /**
+   * Removes everything below {@code path} if it is a directory, and does nothing otherwise. Doesn't
+   * follow symlinks. Directories are made readable, writable and searchable by their owner on the
+   * way, as in {@link com.google.devtools.build.lib.vfs.FileSystemUtils#deleteTreesBelow}.
+   *
+   * <p>The tree is walked with file descriptors of the directories, so no path is resolved more
+   * than once.
+   *
+   * @param path the directory to empty.
+   * @param parallel whether the entries of {@code path} may be removed on a few native threads.
+   * @throws IOException if something could not be removed; the rest is removed anyway.
+   */
+  public static native void deleteTreesBelow(String path, boolean parallel) throws IOException;
+
+  /**
+   * Sets the mode, and optionally the modification time, of {@code path} and of every directory
+   * and regular file below it, e.g. to make a finished output tree read-only. Symlinks are neither
+   * followed nor changed. Entries that are in the requested state already are left untouched, so
+   * their change times stay as they are. Does nothing if {@code path} does not exist.
+   *
+   * <p>The tree is walked with file descriptors of the directories; a directory gets its mode
+   * before its entries are listed, so {@code mode} must let the owner read and search directories.
+   *
+   * @param path the root of the tree.
+   * @param mode the permission bits to set, e.g. 0555.
+   * @param mtimeMillis the modification time to set, in milliseconds since the epoch, or a
+   *     negative number to leave the modification times alone.
+   * @param parallel whether the entries of {@code path} may be handled on a few native threads.
+   * @throws IOException if something could not be changed; the rest is changed anyway.
+   */
+  public static native void chmodTree(String path, int mode, long mtimeMillis, boolean parallel)
+      throws IOException;
+
   /**
    * Removes entire directory tree. Doesn't follow symlinks.
    *
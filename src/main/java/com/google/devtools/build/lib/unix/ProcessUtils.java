@@ -13,8 +13,12 @@
 // limitations under the License.
 package com.google.devtools.build.lib.unix;
 
-import com.google.devtools.build.lib.UnixJniLoader;
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
 
+import com.google.devtools.build.lib.UnixJniLoader;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
 
 /**
  * Various utilities related to UNIX processes.
@@ -49,4 +53,115 @@ public final class ProcessUtils {
    * @return the real user ID of the current process.
    */
   public static native int getuid();
+
+  /** Flag of {@link #spawn}: merge the stderr of the child into its stdout. */
+  public static final int SPAWN_REDIRECT_ERROR_STREAM = 1;
+
+  /** Flag of {@link #spawn}: put the child in a new process group, whose id is its pid. */
+  public static final int SPAWN_NEW_PROCESS_GROUP = 2;
+
+  /**
+   * Returns whether {@link #spawn} is available: it needs posix_spawn file actions that change the
+   * working directory and close the descriptors the child should not inherit (glibc 2.34, FreeBSD
+   * 13.1, macOS 10.15).
+   */
+  public static native boolean canSpawn();
+
+  /**
+   * Starts a process with posix_spawn(3). Unlike {@link ProcessBuilder}, which has the JDK's
+   * jspawnhelper execute the program, this executes it directly.
+   *
+   * <p>The child inherits only the descriptors 0, 1 and 2, and its signals are unblocked and set
+   * to their default action. It gets a pipe as its stdin.
+   *
+   * @param argv the program and its arguments; a program without a slash is searched in the PATH
+   *     of this process.
+   * @param env the environment of the child as "NAME=value" entries, or null to inherit that of
+   *     this process.
+   * @param workingDirectory the working directory of the child, or null for that of this process.
+   * @param stdoutPath the file that the stdout of the child is appended to, or null for a pipe.
+   * @param stderrPath the file that the stderr of the child is appended to, or null for a pipe.
+   * @param flags a combination of the SPAWN_* flags.
+   * @param fds receives the write end of the stdin pipe, the read ends of the stdout and stderr
+   *     pipes (-1 where there is no pipe), and a pidfd of the child (-1 where the system has none),
+   *     to be closed with {@link #closeFd}.
+   * @return the pid of the child.
+   * @throws IOException if the program could not be started.
+   */
+  public static int spawn(
+      Iterable<String> argv,
+      Iterable<String> env,
+      String workingDirectory,
+      String stdoutPath,
+      String stderrPath,
+      int flags,
+      int[] fds)
+      throws IOException {
+    if (fds.length < 4) {
+      throw new IllegalArgumentException("spawn needs 4 descriptor slots, got " + fds.length);
+    }
+    return spawnNative(
+        toBytesArray(argv),
+        env == null ? null : toBytesArray(env),
+        toBytes(workingDirectory),
+        toBytes(stdoutPath),
+        toBytes(stderrPath),
+        flags,
+        fds);
+  }
+
+  private static native int spawnNative(
+      byte[][] argv,
+      byte[][] env,
+      byte[] workingDirectory,
+      byte[] stdoutPath,
+      byte[] stderrPath,
+      int flags,
+      int[] fds)
+      throws IOException;
+
+  /** Returns the Latin-1 bytes of {@code s} followed by a NUL, or null if {@code s} is null. */
+  private static byte[] toBytes(String s) {
+    return s == null ? null : (s + "\0").getBytes(ISO_8859_1);
+  }
+
+  private static byte[][] toBytesArray(Iterable<String> strings) {
+    List<byte[]> result = new ArrayList<>();
+    for (String s : strings) {
+      result.add(toBytes(s));
+    }
+    return result.toArray(new byte[0][]);
+  }
+
+  /**
+   * Blocks until the child {@code pid} of {@link #spawn} exits, without reaping it: until {@link
+   * #reap} is called, the pid cannot be reused, so it is safe to signal.
+   */
+  public static native void waitForExit(int pid);
+
+  /**
+   * Reaps the child {@code pid}, which has exited, and returns its exit code; 128 plus the signal
+   * number if it was killed by a signal, like {@link Process#exitValue}, or -1 on error.
+   */
+  public static native int reap(int pid);
+
+  /**
+   * Sends the signal {@code signal} to the process {@code pid}, through {@code pidfd} if it is not
+   * -1. Returns whether the signal was sent.
+   */
+  public static native boolean signal(int pid, int pidfd, int signal);
+
+  /**
+   * Reads up to {@code length} bytes from the descriptor {@code fd} into {@code bytes}. Returns the
+   * number of bytes read, or -1 at end of file.
+   */
+  public static native int readFd(int fd, byte[] bytes, int offset, int length)
+      throws IOException;
+
+  /** Writes {@code length} bytes from {@code bytes} to the descriptor {@code fd}. */
+  public static native void writeFd(int fd, byte[] bytes, int offset, int length)
+      throws IOException;
+
+  /** Closes the descriptor {@code fd}. */
+  public static native void closeFd(int fd);
 }
@@ -30,6 +30,7 @@ import java.io.IOException;
 import java.util.ArrayList;
 import java.util.Collection;
 import java.util.List;
+import java.util.Map;
 
 /**
  * This class implements the FileSystem interface using direct calls to the UNIX filesystem.
@@ -350,6 +351,21 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     NativePosixFiles.rename(sourcePath.toString(), targetPath.toString());
   }
 
+  @Override
+  protected void copyFile(Path sourcePath, Path targetPath) throws IOException {
+    if (targetPath.getFileSystem() != this) {
+      super.copyFile(sourcePath, targetPath);
+      return;
+    }
+    String name = targetPath.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      NativePosixFiles.copyFile(sourcePath.toString(), name);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_WRITE, name);
+    }
+  }
+
   @Override
   protected long getFileSize(Path path, boolean followSymlinks) throws IOException {
     return stat(path, followSymlinks).getSize();
@@ -366,6 +382,55 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  /** Links are created on native threads from this many on; see {@link #createSymbolicLinks}. */
+  private static final int PARALLEL_SYMLINK_TREE_THRESHOLD = 10000;
+
+  @Override
+  protected void createSymbolicLinks(Path root, Map<PathFragment, PathFragment> links)
+      throws IOException {
+    String[] linkPaths = new String[links.size()];
+    String[] targets = new String[links.size()];
+    int i = 0;
+    for (Map.Entry<PathFragment, PathFragment> entry : links.entrySet()) {
+      linkPaths[i] = entry.getKey().getPathString();
+      targets[i] = entry.getValue() == null ? null : entry.getValue().getPathString();
+      i++;
+    }
+    String name = root.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      // Concurrent sandboxes keep the cores busy already; only really large trees, which would
+      // otherwise delay their action a lot, use more threads.
+      NativePosixFiles.symlinkTree(
+          name, linkPaths, targets, links.size() >= PARALLEL_SYMLINK_TREE_THRESHOLD);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_WRITE, name);
+    }
+  }
+
+  @Override
+  protected void deleteTreesBelow(Path dir) throws IOException {
+    String name = dir.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      // Callers such as sandbox teardown run concurrently with each other already.
+      NativePosixFiles.deleteTreesBelow(name, /*parallel=*/ false);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_DELETE, name);
+    }
+  }
+
+  @Override
+  protected void chmodTree(Path path, int mode) throws IOException {
+    String name = path.toString();
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      NativePosixFiles.chmodTree(name, mode, /*mtimeMillis=*/ -1, /*parallel=*/ true);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_WRITE, name);
+    }
+  }
+
   @Override
   protected long getLastModifiedTime(Path path, boolean followSymlinks) throws IOException {
     return stat(path, followSymlinks).getLastModifiedTime();
@@ -0,0 +1,239 @@
+// Copyright 2014 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.unix;
+
+import com.google.devtools.build.lib.shell.Subprocess;
+import java.io.ByteArrayInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.ThreadFactory;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * A subprocess started with {@link ProcessUtils#spawn}.
+ */
+final class UnixSubprocess implements Subprocess {
+  private static final int SIGTERM = 15;
+
+  /** Output stream for writing to the stdin of the process. */
+  private static final class ProcessOutputStream extends OutputStream {
+    private int fd;
+
+    ProcessOutputStream(int fd) {
+      this.fd = fd;
+    }
+
+    @Override
+    public void write(int b) throws IOException {
+      write(new byte[] {(byte) b}, 0, 1);
+    }
+
+    @Override
+    public synchronized void write(byte[] b, int off, int len) throws IOException {
+      if (fd < 0) {
+        throw new IOException("Stream closed");
+      }
+      ProcessUtils.writeFd(fd, b, off, len);
+    }
+
+    @Override
+    public synchronized void close() {
+      if (fd >= 0) {
+        ProcessUtils.closeFd(fd);
+        fd = -1;
+      }
+    }
+  }
+
+  /**
+   * Input stream for reading the stdout or stderr of the process.
+   *
+   * <p>Reading and closing are synchronized, so that the descriptor is not closed, and possibly
+   * reused, while a read is blocked on it.
+   */
+  private static final class ProcessInputStream extends InputStream {
+    private int fd;
+
+    ProcessInputStream(int fd) {
+      this.fd = fd;
+    }
+
+    @Override
+    public int read() throws IOException {
+      byte[] buf = new byte[1];
+      return read(buf, 0, 1) == 1 ? buf[0] & 0xff : -1;
+    }
+
+    @Override
+    public synchronized int read(byte[] b, int off, int len) throws IOException {
+      if (off < 0 || len < 0 || len > b.length - off) {
+        throw new IndexOutOfBoundsException();
+      }
+      if (fd < 0) {
+        throw new IOException("Stream closed");
+      }
+      return len == 0 ? 0 : ProcessUtils.readFd(fd, b, off, len);
+    }
+
+    @Override
+    public synchronized void close() {
+      if (fd >= 0) {
+        ProcessUtils.closeFd(fd);
+        fd = -1;
+      }
+    }
+  }
+
+  private static final AtomicInteger THREAD_SEQUENCE_NUMBER = new AtomicInteger(1);
+  private static final ExecutorService WAITER_POOL =
+      Executors.newCachedThreadPool(
+          new ThreadFactory() {
+            @Override
+            public Thread newThread(Runnable runnable) {
+              Thread thread =
+                  new Thread(
+                      null,
+                      runnable,
+                      "Unix-Process-Waiter-Thread-" + THREAD_SEQUENCE_NUMBER.getAndIncrement(),
+                      16 * 1024);
+              thread.setDaemon(true);
+              return thread;
+            }
+          });
+
+  private final int pid;
+  private int pidfd;
+  private final ProcessOutputStream stdinStream;
+  private final InputStream stdoutStream;
+  private final InputStream stderrStream;
+  private final long deadlineMillis;
+  private final AtomicBoolean deadlineExceeded = new AtomicBoolean();
+  private final CountDownLatch waitLatch = new CountDownLatch(1);
+  // Guarded by this; set once the process is reaped, after which its pid may be reused.
+  private boolean reaped;
+  private int exitCode;
+
+  UnixSubprocess(int pid, int[] fds, long deadlineMillis) {
+    this.pid = pid;
+    this.pidfd = fds[3];
+    this.deadlineMillis = deadlineMillis;
+    stdinStream = new ProcessOutputStream(fds[0]);
+    stdoutStream = fds[1] < 0 ? emptyStream() : new ProcessInputStream(fds[1]);
+    stderrStream = fds[2] < 0 ? emptyStream() : new ProcessInputStream(fds[2]);
+    // As on Windows, every process consumes a waiter thread; the thread is blocked in the kernel,
+    // and waitFor() only waits for the latch, so it can be interrupted.
+    @SuppressWarnings("unused")
+    Future<?> possiblyIgnoredError = WAITER_POOL.submit(this::waiterThreadFunc);
+  }
+
+  /** The stream of an output that is redirected, like that of {@link java.lang.Process}. */
+  private static InputStream emptyStream() {
+    return new ByteArrayInputStream(new byte[0]);
+  }
+
+  private void waiterThreadFunc() {
+    ProcessUtils.waitForExit(pid);
+    synchronized (this) {
+      exitCode = ProcessUtils.reap(pid);
+      reaped = true;
+    }
+    waitLatch.countDown();
+  }
+
+  @Override
+  public synchronized boolean destroy() {
+    // Until the process is reaped its pid cannot be reused, so this never signals another process.
+    return !reaped && ProcessUtils.signal(pid, pidfd, SIGTERM);
+  }
+
+  @Override
+  public synchronized int exitValue() {
+    if (!reaped) {
+      throw new IllegalThreadStateException("process " + pid + " has not exited");
+    }
+    return exitCode;
+  }
+
+  @Override
+  public boolean finished() {
+    if (deadlineMillis > 0
+        && System.currentTimeMillis() > deadlineMillis
+        && deadlineExceeded.compareAndSet(false, true)) {
+      destroy();
+    }
+    return waitLatch.getCount() == 0;
+  }
+
+  @Override
+  public boolean timedout() {
+    return deadlineExceeded.get();
+  }
+
+  @Override
+  public void waitFor() throws InterruptedException {
+    if (deadlineMillis > 0) {
+      long waitTimeMillis = deadlineMillis - System.currentTimeMillis();
+      if (!waitLatch.await(waitTimeMillis, TimeUnit.MILLISECONDS)
+          && deadlineExceeded.compareAndSet(false, true)) {
+        destroy();
+      }
+    }
+    waitLatch.await();
+  }
+
+  @Override
+  public OutputStream getOutputStream() {
+    return stdinStream;
+  }
+
+  @Override
+  public InputStream getInputStream() {
+    return stdoutStream;
+  }
+
+  @Override
+  public InputStream getErrorStream() {
+    return stderrStream;
+  }
+
+  @Override
+  public void close() {
+    stdinStream.close();
+    try {
+      stdoutStream.close();
+      stderrStream.close();
+    } catch (IOException e) {
+      // Closing a descriptor does not fail in a way that matters here.
+    }
+    synchronized (this) {
+      if (pidfd >= 0) {
+        ProcessUtils.closeFd(pidfd);
+        pidfd = -1;
+      }
+    }
+  }
+
+  @Override
+  public String toString() {
+    return String.format("%s:[pid %d]", super.toString(), pid);
+  }
+}
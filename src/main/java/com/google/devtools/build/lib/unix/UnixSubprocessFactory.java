@@ -0,0 +1,103 @@
+// Copyright 2014 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.unix;
+
+import com.google.devtools.build.lib.shell.JavaSubprocessFactory;
+import com.google.devtools.build.lib.shell.Subprocess;
+import com.google.devtools.build.lib.shell.SubprocessBuilder;
+import com.google.devtools.build.lib.shell.SubprocessBuilder.StreamAction;
+import com.google.devtools.build.lib.shell.SubprocessFactory;
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * A subprocess factory that uses posix_spawn(3) through {@link ProcessUtils#spawn}.
+ *
+ * <p>{@link java.lang.ProcessBuilder} does not copy the heap either: the JDK starts its
+ * jspawnhelper with posix_spawn or vfork, and the helper then executes the program. This executes
+ * the program directly, and puts it in a new process group without a wrapper. Used only with
+ * --experimental_posix_spawn. Where the system's posix_spawn cannot do what is needed, this
+ * delegates to {@link JavaSubprocessFactory}.
+ */
+public class UnixSubprocessFactory implements SubprocessFactory {
+  public static final UnixSubprocessFactory INSTANCE = new UnixSubprocessFactory();
+
+  private final boolean canSpawn;
+
+  private UnixSubprocessFactory() {
+    // Singleton
+    canSpawn = ProcessUtils.canSpawn();
+  }
+
+  @Override
+  public Subprocess create(SubprocessBuilder params) throws IOException {
+    if (!canSpawn) {
+      return JavaSubprocessFactory.INSTANCE.create(params);
+    }
+
+    List<String> env = null;
+    if (params.getEnv() != null) {
+      env = new ArrayList<>(params.getEnv().size());
+      for (Map.Entry<String, String> entry : params.getEnv().entrySet()) {
+        env.add(entry.getKey() + "=" + entry.getValue());
+      }
+    }
+    int flags = params.redirectErrorStream() ? ProcessUtils.SPAWN_REDIRECT_ERROR_STREAM : 0;
+    File workingDirectory = params.getWorkingDirectory();
+
+    // Deadline is now + given timeout.
+    long deadlineMillis =
+        params.getTimeoutMillis() > 0
+            ? Math.addExact(System.currentTimeMillis(), params.getTimeoutMillis())
+            : 0;
+    int[] fds = new int[4];
+    int pid =
+        ProcessUtils.spawn(
+            params.getArgv(),
+            env,
+            workingDirectory == null ? null : workingDirectory.getPath(),
+            getRedirectPath(params.getStdout(), params.getStdoutFile()),
+            getRedirectPath(params.getStderr(), params.getStderrFile()),
+            flags,
+            fds);
+    return new UnixSubprocess(pid, fds, deadlineMillis);
+  }
+
+  /**
+   * Returns the path that a stream is appended to, or null to stream it through a pipe. If a file
+   * redirected to exists, deletes the file, as {@link JavaSubprocessFactory} does.
+   */
+  private String getRedirectPath(StreamAction action, File file) {
+    switch (action) {
+      case DISCARD:
+        return "/dev/null";
+
+      case REDIRECT:
+        if (file.exists()) {
+          file.delete();
+        }
+        return file.getPath();
+
+      case STREAM:
+        return null;
+
+      default:
+        throw new IllegalStateException();
+    }
+  }
+}
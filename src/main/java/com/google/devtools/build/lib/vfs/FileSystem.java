@@ -31,6 +31,7 @@ import java.io.OutputStream;
 import java.nio.file.FileAlreadyExistsException;
 import java.util.Collection;
 import java.util.List;
+import java.util.Map;
 
 /**
  * This interface models a file system using UNIX the naming scheme.
@@ -718,6 +719,27 @@ public abstract class FileSystem {
    */
   public abstract void renameTo(Path sourcePath, Path targetPath) throws IOException;
 
+  /**
+   * Copies the file "sourcePath" to "targetPath", which may be on another file system, replacing a
+   * potentially existing "targetPath". See {@link FileSystemUtils#copyFile} for specification.
+   *
+   * @throws IOException if the file could not be copied
+   */
+  protected void copyFile(Path sourcePath, Path targetPath) throws IOException {
+    try {
+      targetPath.delete();
+    } catch (IOException e) {
+      throw new IOException(
+          "error copying file: couldn't delete destination: " + e.getMessage());
+    }
+    FileSystemUtils.asByteSource(sourcePath).copyTo(FileSystemUtils.asByteSink(targetPath));
+    targetPath.setLastModifiedTime(sourcePath.getLastModifiedTime()); // Preserve mtime.
+    if (!sourcePath.isWritable()) {
+      targetPath.setWritable(false); // Make file read-only if original was read-only.
+    }
+    targetPath.setExecutable(sourcePath.isExecutable()); // Copy executable bit.
+  }
+
   /**
    * Create a new hard link file at "linkPath" for file at "originalPath".
    *
@@ -754,6 +776,63 @@ public abstract class FileSystem {
   protected abstract void createFSDependentHardLink(Path linkPath, Path originalPath)
       throws IOException;
 
+  /**
+   * Creates a symbolic link below "root" for every entry of "links", from its relative path to its
+   * target, creating the missing parent directories. A null target creates an empty file instead.
+   * See {@link Path#createSymbolicLinks} for specification.
+   *
+   * @throws IOException if a link or directory could not be created
+   */
+  protected void createSymbolicLinks(Path root, Map<PathFragment, PathFragment> links)
+      throws IOException {
+    for (Map.Entry<PathFragment, PathFragment> entry : links.entrySet()) {
+      Path link = root.getRelative(entry.getKey());
+      link.getParentDirectory().createDirectoryAndParents();
+      if (entry.getValue() != null) {
+        link.createSymbolicLink(entry.getValue());
+      } else {
+        FileSystemUtils.createEmptyFile(link);
+      }
+    }
+  }
+
+  /**
+   * Deletes all dir trees recursively beneath "dir" if it's a directory, nothing otherwise. See
+   * {@link FileSystemUtils#deleteTreesBelow} for specification.
+   *
+   * @throws IOException if any file could not be removed
+   */
+  protected void deleteTreesBelow(Path dir) throws IOException {
+    if (dir.isDirectory(Symlinks.NOFOLLOW)) {  // real directories (not symlinks)
+      dir.setReadable(true);
+      dir.setWritable(true);
+      dir.setExecutable(true);
+      for (Path child : dir.getDirectoryEntries()) {
+        FileSystemUtils.deleteTree(child);
+      }
+    }
+  }
+
+  /**
+   * Sets the permissions of {@code path} and of every directory and regular file below it to
+   * {@code mode}, without following symbolic links. Does nothing if {@code path} does not exist.
+   * {@code mode} must let the owner read and search directories.
+   *
+   * @throws IOException if the permissions of any file could not be changed
+   */
+  protected void chmodTree(Path path, int mode) throws IOException {
+    FileStatus status = path.statIfFound(Symlinks.NOFOLLOW);
+    if (status == null || !(status.isDirectory() || status.isFile())) {
+      return;
+    }
+    chmod(path, mode);
+    if (status.isDirectory()) {
+      for (Path child : path.getDirectoryEntries()) {
+        chmodTree(child, mode);
+      }
+    }
+  }
+
   /**
    * Prefetch all directories and symlinks within the package
    * rooted at "path".  Enter at most "maxDirs" total directories.
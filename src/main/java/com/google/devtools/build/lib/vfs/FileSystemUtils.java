@@ -394,18 +394,7 @@ public class FileSystemUtils {
    */
   @ThreadSafe  // but not atomic
   public static void copyFile(Path from, Path to) throws IOException {
-    try {
-      to.delete();
-    } catch (IOException e) {
-      throw new IOException("error copying file: "
-          + "couldn't delete destination: " + e.getMessage());
-    }
-    asByteSource(from).copyTo(asByteSink(to));
-    to.setLastModifiedTime(from.getLastModifiedTime()); // Preserve mtime.
-    if (!from.isWritable()) {
-      to.setWritable(false); // Make file read-only if original was read-only.
-    }
-    to.setExecutable(from.isExecutable()); // Copy executable bit.
+    from.getFileSystem().copyFile(from, to);
   }
 
   /**
@@ -427,12 +416,7 @@ public class FileSystemUtils {
       // Fallback to a copy.
       FileStatus stat = from.stat(Symlinks.NOFOLLOW);
       if (stat.isFile()) {
-        asByteSource(from).copyTo(asByteSink(to));
-        to.setLastModifiedTime(stat.getLastModifiedTime()); // Preserve mtime.
-        if (!from.isWritable()) {
-          to.setWritable(false); // Make file read-only if original was read-only.
-        }
-        to.setExecutable(from.isExecutable()); // Copy executable bit.
+        from.getFileSystem().copyFile(from, to);
       } else if (stat.isSymbolicLink()) {
         to.createSymbolicLink(from.readSymbolicLink());
       } else {
@@ -531,14 +515,7 @@ public class FileSystemUtils {
    */
   @ThreadSafe
   public static void deleteTreesBelow(Path dir) throws IOException {
-    if (dir.isDirectory(Symlinks.NOFOLLOW)) {  // real directories (not symlinks)
-      dir.setReadable(true);
-      dir.setWritable(true);
-      dir.setExecutable(true);
-      for (Path child : dir.getDirectoryEntries()) {
-        deleteTree(child);
-      }
-    }
+    dir.deleteTreesBelow();
   }
 
   /**
@@ -30,6 +30,7 @@ import java.io.OutputStream;
 import java.io.Serializable;
 import java.util.ArrayList;
 import java.util.Collection;
+import java.util.Map;
 import javax.annotation.Nullable;
 
 /**
@@ -877,6 +878,37 @@ public class Path
     fileSystem.chmod(this, mode);
   }
 
+  /**
+   * Creates a symbolic link below this directory for every entry of {@code links}, from its
+   * relative path to its target, creating the missing parent directories. A null target creates an
+   * empty file instead. No link may be below another one.
+   *
+   * @throws IOException if a link or directory could not be created, e.g. because it exists
+   */
+  public void createSymbolicLinks(Map<PathFragment, PathFragment> links) throws IOException {
+    fileSystem.createSymbolicLinks(this, links);
+  }
+
+  /**
+   * Deletes all dir trees recursively beneath this path if it's a directory, nothing otherwise.
+   * Does not follow any symbolic links.
+   *
+   * @throws IOException if any file could not be removed
+   */
+  public void deleteTreesBelow() throws IOException {
+    fileSystem.deleteTreesBelow(this);
+  }
+
+  /**
+   * Sets the permissions of this path and of every directory and regular file below it, without
+   * following symbolic links. Does nothing if this path does not exist.
+   *
+   * @throws IOException if the permissions of any file could not be changed
+   */
+  public void chmodTree(int mode) throws IOException {
+    fileSystem.chmodTree(this, mode);
+  }
+
   public void prefetchPackageAsync(int maxDirs) {
     fileSystem.prefetchPackageAsync(this, maxDirs);
   }
@@ -0,0 +1,47 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.worker;
+
+import com.google.devtools.build.lib.sandbox.LinuxSandboxUtil;
+import com.google.devtools.build.lib.vfs.Path;
+import java.io.IOException;
+import java.util.List;
+
+/**
+ * A {@link SandboxedWorker} whose process runs inside the {@code linux-sandbox} for its whole
+ * lifetime, so that it can only write to its working directory.
+ *
+ * <p>The working directory is a bind mount of the directory {@link SandboxedWorker} refreshes
+ * before each request, so the worker sees the inputs of each request without the sandbox being
+ * restarted.
+ */
+final class LinuxSandboxedWorker extends SandboxedWorker {
+  private final Path workDir;
+  private final Path linuxSandbox;
+
+  LinuxSandboxedWorker(
+      WorkerKey workerKey, int workerId, Path workDir, Path logFile, Path linuxSandbox) {
+    super(workerKey, workerId, workDir, logFile);
+    this.workDir = workDir;
+    this.linuxSandbox = linuxSandbox;
+  }
+
+  @Override
+  List<String> wrapCommandLine(List<String> args) throws IOException {
+    return LinuxSandboxUtil.commandLineBuilder(linuxSandbox, args)
+        .setWorkingDirectory(workDir)
+        .build();
+  }
+}
@@ -22,7 +22,7 @@ import java.util.Map;
 import java.util.Set;
 
 /** A {@link Worker} that runs inside a sandboxed execution root. */
-final class SandboxedWorker extends Worker {
+class SandboxedWorker extends Worker {
   private final Path workDir;
   private WorkerExecRoot workerExecRoot;
 
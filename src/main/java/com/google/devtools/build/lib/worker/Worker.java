@@ -76,13 +76,18 @@ class Worker {
       args.set(0, new File(workDir.getPathFile(), args.get(0)).getAbsolutePath());
     }
     SubprocessBuilder processBuilder = new SubprocessBuilder();
-    processBuilder.setArgv(args);
+    processBuilder.setArgv(wrapCommandLine(args));
     processBuilder.setWorkingDirectory(workDir.getPathFile());
     processBuilder.setStderr(logFile.getPathFile());
     processBuilder.setEnv(workerKey.getEnv());
     this.process = processBuilder.start();
   }
 
+  /** Returns the command line that runs the worker with the given arguments. */
+  List<String> wrapCommandLine(List<String> args) throws IOException {
+    return args;
+  }
+
   void destroy() throws IOException {
     if (shutdownHook != null) {
       Runtime.getRuntime().removeShutdownHook(shutdownHook);
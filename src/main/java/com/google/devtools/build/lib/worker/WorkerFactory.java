@@ -37,6 +37,7 @@ final class WorkerFactory extends BaseKeyedPooledObjectFactory<WorkerKey, Worker
   private WorkerOptions workerOptions;
   private final Path workerBaseDir;
   private Reporter reporter;
+  private Path linuxSandbox;
 
   public WorkerFactory(WorkerOptions workerOptions, Path workerBaseDir) {
     this.workerOptions = workerOptions;
@@ -51,6 +52,11 @@ final class WorkerFactory extends BaseKeyedPooledObjectFactory<WorkerKey, Worker
     this.workerOptions = workerOptions;
   }
 
+  /** Sets the linux-sandbox to run the sandboxed workers in, or null to run them without it. */
+  public void setLinuxSandbox(Path linuxSandbox) {
+    this.linuxSandbox = linuxSandbox;
+  }
+
   @Override
   public Worker create(WorkerKey key) throws Exception {
     int workerId = pidCounter.getAndIncrement();
@@ -61,7 +67,11 @@ final class WorkerFactory extends BaseKeyedPooledObjectFactory<WorkerKey, Worker
     boolean sandboxed = workerOptions.workerSandboxing || key.mustBeSandboxed();
     if (sandboxed) {
       Path workDir = getSandboxedWorkerPath(key, workerId);
-      worker = new SandboxedWorker(key, workerId, workDir, logFile);
+      if (linuxSandbox != null) {
+        worker = new LinuxSandboxedWorker(key, workerId, workDir, logFile, linuxSandbox);
+      } else {
+        worker = new SandboxedWorker(key, workerId, workDir, logFile);
+      }
     } else {
       worker = new Worker(key, workerId, key.getExecRoot(), logFile);
     }
@@ -37,6 +37,7 @@ import com.google.devtools.build.lib.runtime.BlazeModule;
 import com.google.devtools.build.lib.runtime.Command;
 import com.google.devtools.build.lib.runtime.CommandEnvironment;
 import com.google.devtools.build.lib.runtime.commands.CleanCommand.CleanStartingEvent;
+import com.google.devtools.build.lib.sandbox.LinuxSandboxUtil;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.common.options.OptionsBase;
@@ -107,6 +108,16 @@ public class WorkerModule extends BlazeModule {
 
     workerFactory.setReporter(env.getReporter());
     workerFactory.setOptions(options);
+    Path linuxSandbox = null;
+    if (options.workerLinuxSandbox && OS.getCurrent() == OS.LINUX) {
+      linuxSandbox = LinuxSandboxUtil.getLinuxSandbox(env);
+      if (linuxSandbox == null) {
+        env.getReporter()
+            .handle(
+                Event.warn("linux-sandbox is not available, sandboxed workers run without it"));
+      }
+    }
+    workerFactory.setLinuxSandbox(linuxSandbox);
 
     // Use a LinkedHashMap instead of an ImmutableMap.Builder to allow duplicates; the last value
     // passed wins.
@@ -107,4 +107,16 @@ public class WorkerOptions extends OptionsBase {
     help = "If enabled, workers will be executed in a sandboxed environment."
   )
   public boolean workerSandboxing;
+
+  @Option(
+    name = "experimental_worker_linux_sandbox",
+    defaultValue = "false",
+    documentationCategory = OptionDocumentationCategory.UNCATEGORIZED,
+    effectTags = {OptionEffectTag.UNKNOWN},
+    help =
+        "If enabled, sandboxed workers run inside the linux-sandbox, which lives as long as the "
+            + "worker, so that they can only write to their working directory. Only has an "
+            + "effect together with --worker_sandboxing, and on Linux."
+  )
+  public boolean workerLinuxSandbox;
 }
@@ -15,8 +15,15 @@
 #include <jni.h>
 #include <pthread.h>
 #include <stdlib.h>
-#include <list>
+#include <sys/stat.h>
 #include <string>
+#include <unordered_set>
+
+// The most distinct paths kept between two polls. Beyond that, the paths are
+// dropped and the next poll reports that everything changed: a build after
+// that many changes checks most files anyway, and this bounds both memory and
+// the cost of poll.
+static const size_t kMaxPaths = 100000;
 
 // A structure to pass around the FSEvents info and the list of paths.
 struct JNIEventsDiffAwareness {
@@ -24,16 +31,28 @@ struct JNIEventsDiffAwareness {
   CFRunLoopRef runLoop;
   // FSEvents stream reference (reference to the listened stream)
   FSEventStreamRef stream;
-  // List of paths that have been changed since last polling
-  std::list<std::string> paths;
-  // Mutex to protect concurrent access of paths.
-  // FsEventsDiffAwarenessCallback fill that list which is emptied
+  // Set of paths that have been changed since last polling; a path changed
+  // many times, e.g. by a checkout, is kept once.
+  std::unordered_set<std::string> paths;
+  // Whether paths is incomplete, because events were dropped or there were
+  // more than kMaxPaths of them. Once set, every poll reports that
+  // everything changed.
+  bool overflow;
+  // The ID of the last event received, and of the last one included in what
+  // poll returned. The latter is where a stream of a later server resumes.
+  FSEventStreamEventId last_event_id;
+  FSEventStreamEventId polled_event_id;
+  // Mutex to protect concurrent access of paths and overflow.
+  // FsEventsDiffAwarenessCallback fill that set which is emptied
   // by the MacOSXEventsDiffAwareness#poll() method.
   // The former is called inside the FsEvents run loop and the latter
   // from Java threads.
   pthread_mutex_t mutex;
 
-  JNIEventsDiffAwareness() { pthread_mutex_init(&mutex, nullptr); }
+  JNIEventsDiffAwareness()
+      : overflow(false), last_event_id(0), polled_event_id(0) {
+    pthread_mutex_init(&mutex, nullptr);
+  }
 
   ~JNIEventsDiffAwareness() { pthread_mutex_destroy(&mutex); }
 };
@@ -58,17 +77,83 @@ void FsEventsDiffAwarenessCallback(ConstFSEventStreamRef streamRef,
       static_cast<JNIEventsDiffAwareness *>(clientCallBackInfo);
   pthread_mutex_lock(&(info->mutex));
   for (int i = 0; i < numEvents; i++) {
-    info->paths.push_back(std::string(paths[i]));
+    if (eventIds[i] > info->last_event_id) {
+      info->last_event_id = eventIds[i];
+    }
+    // Nothing is kept after an overflow. A HistoryDone event marks the end
+    // of the events replayed from before the stream started, and names no
+    // path.
+    if (info->overflow ||
+        (eventFlags[i] & kFSEventStreamEventFlagHistoryDone)) {
+      continue;
+    }
+    // These flags mean that the events below the path were not all reported,
+    // so they can't be listed. Replayed events also carry MustScanSubDirs for
+    // what the history has lost.
+    if (eventFlags[i] & (kFSEventStreamEventFlagMustScanSubDirs |
+                         kFSEventStreamEventFlagUserDropped |
+                         kFSEventStreamEventFlagKernelDropped |
+                         kFSEventStreamEventFlagEventIdsWrapped |
+                         kFSEventStreamEventFlagRootChanged)) {
+      info->overflow = true;
+    } else {
+      info->paths.insert(std::string(paths[i]));
+      if (info->paths.size() > kMaxPaths) {
+        info->overflow = true;
+      }
+    }
+  }
+  if (info->overflow) {
+    info->paths.clear();
   }
   pthread_mutex_unlock(&(info->mutex));
 }
 
+// Returns the UUID of the FSEvents history of the volume holding "path", or
+// null if it has none. Event IDs are only meaningful with the same UUID.
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_deviceUuid(
+    JNIEnv *env, jclass clazz, jstring path) {
+  const char *path_chars = env->GetStringUTFChars(path, NULL);
+  struct stat st;
+  int r = stat(path_chars, &st);
+  env->ReleaseStringUTFChars(path, path_chars);
+  if (r == -1) {
+    return NULL;
+  }
+  CFUUIDRef uuid = FSEventsCopyUUIDForDevice(st.st_dev);
+  if (uuid == NULL) {
+    return NULL;
+  }
+  CFStringRef uuid_string = CFUUIDCreateString(NULL, uuid);
+  CFRelease(uuid);
+  char buffer[64];
+  jstring result = NULL;
+  if (CFStringGetCString(uuid_string, buffer, sizeof(buffer),
+                         kCFStringEncodingUTF8)) {
+    result = env->NewStringUTF(buffer);
+  }
+  CFRelease(uuid_string);
+  return result;
+}
+
+// Starts watching "paths". With a non-negative "since_when", the stream first
+// replays the events after that ID, so that the changes made while nothing
+// watched are reported by the first polls.
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_create(
     JNIEnv *env, jobject fsEventsDiffAwareness, jobjectArray paths,
-    jdouble latency) {
+    jdouble latency, jlong since_when) {
   // Create a FSEventStreamContext to pass around (env, fsEventsDiffAwareness)
   JNIEventsDiffAwareness *info = new JNIEventsDiffAwareness();
+  FSEventStreamEventId start_id = kFSEventStreamEventIdSinceNow;
+  if (since_when >= 0) {
+    start_id = static_cast<FSEventStreamEventId>(since_when);
+    info->last_event_id = start_id;
+  } else {
+    info->last_event_id = FSEventsGetCurrentEventId();
+  }
+  info->polled_event_id = info->last_event_id;
 
   FSEventStreamContext context;
   context.version = 0;
@@ -90,10 +175,13 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_create(
   CFArrayRef pathsToWatch =
       CFArrayCreate(NULL, (const void **)pathsArray, 1, NULL);
   delete[] pathsArray;
+  // kFSEventStreamCreateFlagWatchRoot reports the root being moved or
+  // deleted, through kFSEventStreamEventFlagRootChanged.
   info->stream = FSEventStreamCreate(
       NULL, &FsEventsDiffAwarenessCallback, &context, pathsToWatch,
-      kFSEventStreamEventIdSinceNow, static_cast<CFAbsoluteTime>(latency),
-      kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagFileEvents);
+      start_id, static_cast<CFAbsoluteTime>(latency),
+      kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagFileEvents |
+          kFSEventStreamCreateFlagWatchRoot);
 
   // Save the info pointer to FSEventsDiffAwareness#nativePointer
   jbyteArray array = env->NewByteArray(sizeof(info));
@@ -122,20 +210,38 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_run(
   CFRunLoopRun();
 }
 
+// Returns the paths changed since the last call, or null if some were not
+// reported and the caller has to assume that everything changed.
 extern "C" JNIEXPORT jobjectArray JNICALL
 Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_poll(
     JNIEnv *env, jobject fsEventsDiffAwareness) {
   JNIEventsDiffAwareness *info = GetInfo(env, fsEventsDiffAwareness);
   pthread_mutex_lock(&(info->mutex));
 
-  jclass classString = env->FindClass("java/lang/String");
-  jobjectArray result =
-      env->NewObjectArray(info->paths.size(), classString, NULL);
-  int i = 0;
-  for (auto it = info->paths.begin(); it != info->paths.end(); it++, i++) {
-    env->SetObjectArrayElement(result, i, env->NewStringUTF(it->c_str()));
+  jobjectArray result = NULL;
+  if (!info->overflow) {
+    jclass classString = env->FindClass("java/lang/String");
+    result = env->NewObjectArray(info->paths.size(), classString, NULL);
+    int i = 0;
+    for (auto it = info->paths.begin(); it != info->paths.end(); it++, i++) {
+      jstring path = env->NewStringUTF(it->c_str());
+      env->SetObjectArrayElement(result, i, path);
+      env->DeleteLocalRef(path);
+    }
   }
   info->paths.clear();
+  info->polled_event_id = info->last_event_id;
+  pthread_mutex_unlock(&(info->mutex));
+  return result;
+}
+
+// Returns the ID of the last event covered by the last call to poll.
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_lastPolledEventId(
+    JNIEnv *env, jobject fsEventsDiffAwareness) {
+  JNIEventsDiffAwareness *info = GetInfo(env, fsEventsDiffAwareness);
+  pthread_mutex_lock(&(info->mutex));
+  jlong result = static_cast<jlong>(info->polled_event_id);
   pthread_mutex_unlock(&(info->mutex));
   return result;
 }
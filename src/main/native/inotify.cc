@@ -0,0 +1,293 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The events a directory is watched for. IN_ATTRIB is included because a
+// change of the executable bit is a change of the file for Bazel.
+static const uint32_t kWatchMask =
+    IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY |
+    IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_DONT_FOLLOW |
+    IN_EXCL_UNLINK | IN_ONLYDIR;
+
+// The most paths kept between two polls. Beyond that, the paths are dropped
+// and the next poll reports that everything changed, as on an overflow of the
+// kernel queue.
+static const size_t kMaxPaths = 100000;
+
+// A structure to pass around the inotify state and the list of paths.
+struct JNIInotifyDiffAwareness {
+  // The inotify instance every directory below the root is watched with.
+  int inotify_fd;
+  // A pipe doClose() writes to, to wake up and stop the run loop.
+  int wake_fds[2];
+  // The watch descriptor of the root directory.
+  int root_wd;
+  // The directory each watch descriptor watches. Only used by create() and
+  // then by the run loop, so it needs no locking.
+  std::unordered_map<int, std::string> dirs;
+  // List of paths that have been changed since last polling
+  std::vector<std::string> paths;
+  // Whether events were lost, either because the kernel queue overflowed, a
+  // directory could not be watched or the root went away. Once set, every
+  // poll reports that everything changed.
+  bool overflow;
+  // Mutex to protect concurrent access of paths and overflow.
+  // The run loop fills them and LinuxInotifyDiffAwareness#poll() empties
+  // them from Java threads.
+  pthread_mutex_t mutex;
+
+  JNIInotifyDiffAwareness() : inotify_fd(-1), root_wd(-1), overflow(false) {
+    wake_fds[0] = wake_fds[1] = -1;
+    pthread_mutex_init(&mutex, nullptr);
+  }
+
+  ~JNIInotifyDiffAwareness() {
+    if (inotify_fd != -1) close(inotify_fd);
+    if (wake_fds[0] != -1) close(wake_fds[0]);
+    if (wake_fds[1] != -1) close(wake_fds[1]);
+    pthread_mutex_destroy(&mutex);
+  }
+};
+
+// Watches "dir" and every directory below it, not following symlinks. The
+// paths of everything found below "dir" are appended to "found" if it is not
+// NULL; a new directory may have been filled before its watch was added.
+// Returns false if a directory could not be watched, e.g. because
+// fs.inotify.max_user_watches was reached.
+static bool WatchRecursively(JNIInotifyDiffAwareness *info,
+                             const std::string &dir,
+                             std::vector<std::string> *found) {
+  // Add the watch before listing the directory, so that an entry is either
+  // listed below or reported by an event.
+  int wd = inotify_add_watch(info->inotify_fd, dir.c_str(), kWatchMask);
+  if (wd == -1) {
+    // The directory was deleted or replaced in the meantime; its parent
+    // reports that.
+    return errno == ENOENT || errno == ENOTDIR;
+  }
+  info->dirs[wd] = dir;
+
+  DIR *dirh = opendir(dir.c_str());
+  if (dirh == NULL) {
+    return errno == ENOENT || errno == ENOTDIR;
+  }
+  bool ok = true;
+  struct dirent *entry;
+  while ((entry = readdir(dirh)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    std::string path = dir + "/" + name;
+    if (found != NULL) {
+      found->push_back(path);
+    }
+    bool is_dir = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      is_dir = lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    if (is_dir && !WatchRecursively(info, path, found)) {
+      ok = false;
+      break;
+    }
+  }
+  closedir(dirh);
+  return ok;
+}
+
+// Handles the events in buf[0..len), appending the changed paths to
+// "changed". Returns false if events were lost.
+static bool HandleEvents(JNIInotifyDiffAwareness *info, const char *buf,
+                         ssize_t len, std::vector<std::string> *changed) {
+  bool ok = true;
+  for (const char *p = buf; p < buf + len;) {
+    const struct inotify_event *event =
+        reinterpret_cast<const struct inotify_event *>(p);
+    p += sizeof(struct inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+      ok = false;
+      continue;
+    }
+    if (event->mask & IN_IGNORED) {
+      info->dirs.erase(event->wd);
+      continue;
+    }
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+      // The parent reports the directory itself, unless it is the root.
+      if (event->wd == info->root_wd) {
+        ok = false;
+      }
+      continue;
+    }
+    auto it = info->dirs.find(event->wd);
+    if (it == info->dirs.end() || event->len == 0) {
+      continue;
+    }
+    std::string path = it->second + "/" + event->name;
+    changed->push_back(path);
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+      if (!WatchRecursively(info, path, changed)) {
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxInotifyDiffAwareness_create(
+    JNIEnv *env, jobject inotifyDiffAwareness, jstring root) {
+  JNIInotifyDiffAwareness *info = new JNIInotifyDiffAwareness();
+
+  info->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (info->inotify_fd == -1 || pipe2(info->wake_fds, O_CLOEXEC) == -1) {
+    info->overflow = true;
+  } else {
+    const char *root_chars = env->GetStringUTFChars(root, NULL);
+    std::string root_dir(root_chars);
+    env->ReleaseStringUTFChars(root, root_chars);
+    if (!WatchRecursively(info, root_dir, NULL)) {
+      info->overflow = true;
+    }
+    for (const auto &entry : info->dirs) {
+      if (entry.second == root_dir) {
+        info->root_wd = entry.first;
+      }
+    }
+    if (info->root_wd == -1) {
+      info->overflow = true;  // the root does not exist
+    }
+  }
+
+  // Save the info pointer to LinuxInotifyDiffAwareness#nativePointer
+  jclass clazz = env->GetObjectClass(inotifyDiffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(inotifyDiffAwareness, fid, reinterpret_cast<jlong>(info));
+}
+
+static JNIInotifyDiffAwareness *GetInfo(JNIEnv *env,
+                                        jobject inotifyDiffAwareness) {
+  jclass clazz = env->GetObjectClass(inotifyDiffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(inotifyDiffAwareness, fid);
+  return reinterpret_cast<JNIInotifyDiffAwareness *>(field);
+}
+
+// Reads events until doClose() is called, then frees the native structure:
+// this way, doClose() does not have to wait for the loop to notice.
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxInotifyDiffAwareness_run(
+    JNIEnv *env, jobject inotifyDiffAwareness) {
+  JNIInotifyDiffAwareness *info = GetInfo(env, inotifyDiffAwareness);
+  if (info->wake_fds[0] == -1) {
+    return;  // create() failed; doClose() frees the structure
+  }
+
+  // Large enough for a few thousand events, so a burst is drained in few
+  // reads; aligned as inotify(7) recommends.
+  static const size_t kBufferSize = 256 * 1024;
+  std::vector<struct inotify_event> storage(
+      kBufferSize / sizeof(struct inotify_event));
+  char *buf = reinterpret_cast<char *>(storage.data());
+
+  struct pollfd fds[2];
+  // Ignored by poll(2) if create() could not get an inotify instance.
+  fds[0].fd = info->inotify_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = info->wake_fds[0];
+  fds[1].events = POLLIN;
+  for (;;) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break;  // doClose() was called
+    }
+
+    std::vector<std::string> changed;
+    bool ok = true;
+    ssize_t len;
+    while ((len = read(info->inotify_fd, buf, kBufferSize)) > 0) {
+      ok &= HandleEvents(info, buf, len, &changed);
+    }
+    if (len == -1 && errno != EAGAIN && errno != EINTR) {
+      ok = false;
+    }
+
+    pthread_mutex_lock(&(info->mutex));
+    if (!ok || info->paths.size() + changed.size() > kMaxPaths) {
+      info->overflow = true;
+    }
+    if (info->overflow) {
+      info->paths.clear();
+    } else {
+      info->paths.insert(info->paths.end(), changed.begin(), changed.end());
+    }
+    pthread_mutex_unlock(&(info->mutex));
+  }
+  delete info;
+}
+
+// Returns the paths changed since the last call, or null if events were lost
+// and the caller has to assume that everything changed.
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxInotifyDiffAwareness_poll(
+    JNIEnv *env, jobject inotifyDiffAwareness) {
+  JNIInotifyDiffAwareness *info = GetInfo(env, inotifyDiffAwareness);
+  pthread_mutex_lock(&(info->mutex));
+
+  jobjectArray result = NULL;
+  if (!info->overflow) {
+    jclass classString = env->FindClass("java/lang/String");
+    result = env->NewObjectArray(info->paths.size(), classString, NULL);
+    for (size_t i = 0; i < info->paths.size(); i++) {
+      jstring path = env->NewStringUTF(info->paths[i].c_str());
+      env->SetObjectArrayElement(result, i, path);
+      env->DeleteLocalRef(path);
+    }
+  }
+  info->paths.clear();
+  pthread_mutex_unlock(&(info->mutex));
+  return result;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxInotifyDiffAwareness_doClose(
+    JNIEnv *env, jobject inotifyDiffAwareness) {
+  JNIInotifyDiffAwareness *info = GetInfo(env, inotifyDiffAwareness);
+  if (info->wake_fds[1] == -1) {
+    delete info;  // there is no run loop
+    return;
+  }
+  // The run loop frees the structure once it sees the write.
+  char c = 0;
+  while (write(info->wake_fds[1], &c, 1) == -1 && errno == EINTR) {
+  }
+}
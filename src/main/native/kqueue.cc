@@ -0,0 +1,415 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The changes a watched file or directory is watched for. NOTE_ATTRIB is
+// included because a change of the executable bit is a change of the file for
+// Bazel.
+static const u_int kWatchFflags =
+    NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_RENAME;
+
+// The most paths kept between two polls. Beyond that, the paths are dropped
+// and the next poll reports that everything changed.
+static const size_t kMaxPaths = 100000;
+
+// The most descriptors held open for watching. kqueue needs a descriptor for
+// every file and directory it watches, and they count against the process's
+// limit, so at most half of that limit is used. A tree that needs more is not
+// watched: every poll reports that everything changed, and the next build
+// checks every file.
+static const size_t kMaxWatches = 500000;
+
+// A watched file or directory.
+struct Watch {
+  // Its path below the root.
+  std::string path;
+  // Matched against the udata of events, so that a late event for a closed
+  // descriptor is not taken for an event of a new watch with the same number.
+  uintptr_t serial;
+  bool is_dir;
+  // For a directory, the inode number of each entry, to find the entries that
+  // were added, removed or replaced when the directory changes.
+  std::unordered_map<std::string, ino_t> entries;
+};
+
+// A structure to pass around the kqueue state and the list of paths.
+struct JNIKqueueDiffAwareness {
+  // The kqueue every watched file and directory is registered with.
+  int kq;
+  // The root directory; its removal or renaming breaks the view.
+  std::string root;
+  // The watches, by descriptor, and the descriptors, by path. Only used by
+  // create() and then by the run loop, so they need no locking.
+  std::unordered_map<int, Watch> watches;
+  std::map<std::string, int> fds;
+  uintptr_t next_serial;
+  size_t max_watches;
+  // List of paths that have been changed since last polling.
+  std::vector<std::string> paths;
+  // Whether changes were lost, either because a file could not be watched or
+  // the root went away. Once set, every poll reports that everything changed.
+  bool overflow;
+  // Mutex to protect concurrent access of paths and overflow.
+  // The run loop fills them and FreeBSDKqueueDiffAwareness#poll() empties
+  // them from Java threads.
+  pthread_mutex_t mutex;
+
+  JNIKqueueDiffAwareness()
+      : kq(-1), next_serial(1), max_watches(kMaxWatches), overflow(false) {
+    pthread_mutex_init(&mutex, nullptr);
+  }
+
+  ~JNIKqueueDiffAwareness() {
+    for (const auto &watch : watches) {
+      close(watch.first);
+    }
+    if (kq != -1) close(kq);
+    pthread_mutex_destroy(&mutex);
+  }
+};
+
+// Stops watching "path" and everything below it.
+static void Unwatch(JNIKqueueDiffAwareness *info, const std::string &path) {
+  auto it = info->fds.lower_bound(path);
+  while (it != info->fds.end() &&
+         (it->first == path ||
+          (it->first.compare(0, path.size(), path) == 0 &&
+           it->first[path.size()] == '/'))) {
+    close(it->second);  // also removes its event from the kqueue
+    info->watches.erase(it->second);
+    it = info->fds.erase(it);
+  }
+}
+
+// Reads the inode number of each entry of the open directory "fd" into
+// "entries". Returns false if the directory cannot be read.
+static bool ReadEntries(int fd,
+                        std::unordered_map<std::string, ino_t> *entries) {
+  int dup_fd = dup(fd);
+  if (dup_fd == -1) {
+    return false;
+  }
+  DIR *dirh = fdopendir(dup_fd);
+  if (dirh == NULL) {
+    close(dup_fd);
+    return false;
+  }
+  // The duplicate shares the offset of "fd", which an earlier read left at
+  // the end.
+  rewinddir(dirh);
+  struct dirent *entry;
+  while ((entry = readdir(dirh)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    (*entries)[name] = entry->d_fileno;
+  }
+  closedir(dirh);
+  return true;
+}
+
+// Watches "path" and, if it is a directory, everything below it, not
+// following symlinks. Symlinks and special files are not watched themselves;
+// their directory reports when they are created, removed or replaced. The
+// paths of everything found below "path" are appended to "found" if it is not
+// NULL; a new directory may have been filled before its watch was added.
+// Returns false if a file could not be watched because the descriptor budget
+// was used up.
+static bool WatchRecursively(JNIKqueueDiffAwareness *info,
+                             const std::string &path,
+                             std::vector<std::string> *found) {
+  if (info->watches.size() >= info->max_watches) {
+    return false;
+  }
+  // Register the descriptor before listing the directory, so that an entry
+  // is either listed below or reported by an event.
+  int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    // Unless the process ran out of descriptors, the file was deleted or
+    // replaced in the meantime, or cannot be watched; its directory reports
+    // changes of it.
+    return errno != EMFILE && errno != ENFILE;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+    close(fd);
+    return true;
+  }
+  Watch watch;
+  watch.path = path;
+  watch.serial = info->next_serial++;
+  watch.is_dir = S_ISDIR(st.st_mode);
+  struct kevent change;
+  EV_SET(&change, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, kWatchFflags, 0,
+         reinterpret_cast<void *>(watch.serial));
+  if (kevent(info->kq, &change, 1, NULL, 0, NULL) == -1) {
+    close(fd);
+    return false;
+  }
+  if (watch.is_dir && !ReadEntries(fd, &watch.entries)) {
+    close(fd);
+    return true;  // deleted in the meantime
+  }
+  Unwatch(info, path);
+  info->fds[path] = fd;
+  // References to the elements of an unordered_map stay valid as it grows.
+  const Watch &added = info->watches[fd] = std::move(watch);
+  for (const auto &entry : added.entries) {
+    std::string entry_path = path + "/" + entry.first;
+    if (found != NULL) {
+      found->push_back(entry_path);
+    }
+    if (!WatchRecursively(info, entry_path, found)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads the directory watched by "fd" again, appending the entries that were
+// added, removed or replaced to "changed" and watching the new ones. Returns
+// false if changes were lost.
+static bool RescanDirectory(JNIKqueueDiffAwareness *info, int fd,
+                            std::vector<std::string> *changed) {
+  std::unordered_map<std::string, ino_t> entries;
+  if (!ReadEntries(fd, &entries)) {
+    return true;  // deleted in the meantime; its own event reports that
+  }
+  Watch &watch = info->watches[fd];
+  std::vector<std::string> added;
+  for (const auto &entry : watch.entries) {
+    auto it = entries.find(entry.first);
+    if (it == entries.end() || it->second != entry.second) {
+      std::string path = watch.path + "/" + entry.first;
+      changed->push_back(path);
+      Unwatch(info, path);
+    }
+  }
+  for (const auto &entry : entries) {
+    auto it = watch.entries.find(entry.first);
+    if (it == watch.entries.end()) {
+      changed->push_back(watch.path + "/" + entry.first);
+      added.push_back(watch.path + "/" + entry.first);
+    } else if (it->second != entry.second) {
+      added.push_back(watch.path + "/" + entry.first);
+    }
+  }
+  watch.entries.swap(entries);
+
+  for (const auto &path : added) {
+    if (!WatchRecursively(info, path, changed)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Handles the events in events[0..n), appending the changed paths to
+// "changed". Returns false if changes were lost.
+static bool HandleEvents(JNIKqueueDiffAwareness *info,
+                         const struct kevent *events, int n,
+                         std::vector<std::string> *changed) {
+  bool ok = true;
+  // Directories are read again after the other events are handled, once per
+  // batch.
+  std::vector<int> rescan;
+  for (int i = 0; i < n; ++i) {
+    const struct kevent &event = events[i];
+    if (event.filter != EVFILT_VNODE) {
+      continue;
+    }
+    int fd = static_cast<int>(event.ident);
+    auto it = info->watches.find(fd);
+    if (it == info->watches.end() ||
+        it->second.serial != reinterpret_cast<uintptr_t>(event.udata)) {
+      continue;  // for a descriptor that was closed in the meantime
+    }
+    const Watch &watch = it->second;
+    if (event.fflags & (NOTE_DELETE | NOTE_RENAME)) {
+      // The directory of the file, if it is watched, reports the path again.
+      if (watch.path == info->root) {
+        ok = false;
+        continue;
+      }
+      changed->push_back(watch.path);
+      std::string path = watch.path;
+      Unwatch(info, path);
+      continue;
+    }
+    if (watch.is_dir && (event.fflags & (NOTE_WRITE | NOTE_EXTEND))) {
+      rescan.push_back(fd);
+    }
+    if (!watch.is_dir || (event.fflags & NOTE_ATTRIB)) {
+      changed->push_back(watch.path);
+    }
+  }
+  std::sort(rescan.begin(), rescan.end());
+  rescan.erase(std::unique(rescan.begin(), rescan.end()), rescan.end());
+  for (int fd : rescan) {
+    auto it = info->watches.find(fd);
+    if (it != info->watches.end() && it->second.is_dir &&
+        !RescanDirectory(info, fd, changed)) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_FreeBSDKqueueDiffAwareness_create(
+    JNIEnv *env, jobject kqueueDiffAwareness, jstring root) {
+  JNIKqueueDiffAwareness *info = new JNIKqueueDiffAwareness();
+
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur != RLIM_INFINITY) {
+    info->max_watches =
+        std::min(info->max_watches, static_cast<size_t>(limit.rlim_cur / 2));
+  }
+
+  // The user event wakes up the run loop when doClose() is called.
+  info->kq = kqueue();
+  struct kevent wake;
+  EV_SET(&wake, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+  if (info->kq != -1 && kevent(info->kq, &wake, 1, NULL, 0, NULL) == -1) {
+    close(info->kq);
+    info->kq = -1;
+  }
+  if (info->kq == -1) {
+    info->overflow = true;
+  } else {
+    const char *root_chars = env->GetStringUTFChars(root, NULL);
+    info->root = root_chars;
+    env->ReleaseStringUTFChars(root, root_chars);
+    if (!WatchRecursively(info, info->root, NULL) ||
+        info->fds.count(info->root) == 0) {
+      info->overflow = true;  // e.g. the root does not exist
+    }
+  }
+
+  // Save the info pointer to FreeBSDKqueueDiffAwareness#nativePointer
+  jclass clazz = env->GetObjectClass(kqueueDiffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(kqueueDiffAwareness, fid, reinterpret_cast<jlong>(info));
+}
+
+static JNIKqueueDiffAwareness *GetInfo(JNIEnv *env,
+                                       jobject kqueueDiffAwareness) {
+  jclass clazz = env->GetObjectClass(kqueueDiffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(kqueueDiffAwareness, fid);
+  return reinterpret_cast<JNIKqueueDiffAwareness *>(field);
+}
+
+// Reads events until doClose() is called, then frees the native structure:
+// this way, doClose() does not have to wait for the loop to notice.
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_FreeBSDKqueueDiffAwareness_run(
+    JNIEnv *env, jobject kqueueDiffAwareness) {
+  JNIKqueueDiffAwareness *info = GetInfo(env, kqueueDiffAwareness);
+  if (info->kq == -1) {
+    return;  // create() failed; doClose() frees the structure
+  }
+
+  static const int kMaxEvents = 1024;
+  std::vector<struct kevent> events(kMaxEvents);
+  bool closing = false;
+  while (!closing) {
+    int n = kevent(info->kq, NULL, 0, events.data(), kMaxEvents, NULL);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      if (events[i].filter == EVFILT_USER) {
+        closing = true;  // doClose() was called
+      }
+    }
+    if (closing) {
+      break;
+    }
+
+    std::vector<std::string> changed;
+    bool ok = HandleEvents(info, events.data(), n, &changed);
+
+    pthread_mutex_lock(&(info->mutex));
+    if (!ok || info->paths.size() + changed.size() > kMaxPaths) {
+      info->overflow = true;
+    }
+    if (info->overflow) {
+      info->paths.clear();
+    } else {
+      info->paths.insert(info->paths.end(), changed.begin(), changed.end());
+    }
+    pthread_mutex_unlock(&(info->mutex));
+  }
+  delete info;
+}
+
+// Returns the paths changed since the last call, or null if changes were lost
+// and the caller has to assume that everything changed.
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_skyframe_FreeBSDKqueueDiffAwareness_poll(
+    JNIEnv *env, jobject kqueueDiffAwareness) {
+  JNIKqueueDiffAwareness *info = GetInfo(env, kqueueDiffAwareness);
+  pthread_mutex_lock(&(info->mutex));
+
+  jobjectArray result = NULL;
+  if (!info->overflow) {
+    jclass classString = env->FindClass("java/lang/String");
+    result = env->NewObjectArray(info->paths.size(), classString, NULL);
+    for (size_t i = 0; i < info->paths.size(); i++) {
+      jstring path = env->NewStringUTF(info->paths[i].c_str());
+      env->SetObjectArrayElement(result, i, path);
+      env->DeleteLocalRef(path);
+    }
+  }
+  info->paths.clear();
+  pthread_mutex_unlock(&(info->mutex));
+  return result;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_FreeBSDKqueueDiffAwareness_doClose(
+    JNIEnv *env, jobject kqueueDiffAwareness) {
+  JNIKqueueDiffAwareness *info = GetInfo(env, kqueueDiffAwareness);
+  if (info->kq == -1) {
+    delete info;  // there is no run loop
+    return;
+  }
+  // The run loop frees the structure once it sees the event.
+  struct kevent wake;
+  EV_SET(&wake, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+  kevent(info->kq, &wake, 1, NULL, 0, NULL);
+}
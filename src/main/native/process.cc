@@ -14,7 +14,25 @@
 
 #include <jni.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(__FreeBSD__)
+#include <sys/param.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern char **environ;
 
 /*
  * Class:     com.google.devtools.build.lib.unix.ProcessUtils
@@ -45,3 +63,418 @@ extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_unix_ProcessUtils_getuid(JNIEnv *env, jclass clazz) {
   return getuid();
 }
+
+// The flags of ProcessUtils.spawn; keep in sync with ProcessUtils.java.
+enum SpawnFlags {
+  SPAWN_REDIRECT_ERROR_STREAM = 1,
+  SPAWN_NEW_PROCESS_GROUP = 2,
+};
+
+// Whether posix_spawn can change the working directory of the child and close
+// the descriptors it should not inherit. Without either, ProcessUtils.spawn is
+// not available and Java falls back to java.lang.ProcessBuilder.
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 34)
+#define SPAWN_SUPPORTED 1
+#endif
+#elif defined(__FreeBSD__)
+#if __FreeBSD_version >= 1301000
+#define SPAWN_SUPPORTED 1
+#endif
+#elif defined(__APPLE__)
+#define SPAWN_SUPPORTED 1
+#endif
+
+#if defined(SPAWN_SUPPORTED)
+
+// Creates a pipe whose descriptors are closed on exec, so that children
+// spawned concurrently by other threads do not inherit them.
+static int CloexecPipe(int fds[2]) {
+#if defined(__APPLE__)
+  if (pipe(fds) < 0) {
+    return -1;
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  return 0;
+#else
+  return pipe2(fds, O_CLOEXEC);
+#endif
+}
+
+// Adds the file action that connects the descriptor `target` of the child to
+// `path`, opened for appending, or to the pipe `pipe_fds`, whose other end
+// the parent keeps.
+static int AddRedirect(posix_spawn_file_actions_t *actions, int target,
+                       const char *path, int pipe_fds[2]) {
+  if (path != nullptr) {
+    return posix_spawn_file_actions_addopen(
+        actions, target, path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+  }
+  if (CloexecPipe(pipe_fds) < 0) {
+    return errno;
+  }
+  return posix_spawn_file_actions_adddup2(actions, pipe_fds[1], target);
+}
+
+static void ClosePipe(int pipe_fds[2]) {
+  for (int i = 0; i < 2; ++i) {
+    if (pipe_fds[i] >= 0) {
+      close(pipe_fds[i]);
+      pipe_fds[i] = -1;
+    }
+  }
+}
+
+// Starts `argv` with posix_spawn, which does not copy the page tables of the
+// JVM as fork does. The child gets the environment `envp` (that of this
+// process if null), the working directory `cwd` (this one's if null), and
+// stdout and stderr appended to the given files, or to pipes if null. Only the
+// descriptors 0, 1 and 2 are inherited; signals are reset to their default
+// and unblocked.
+//
+// On success, returns 0 and stores the pid, and in `fds` the write end of the
+// stdin pipe, the read ends of the stdout and stderr pipes (-1 if there is
+// none), and a pidfd of the child (-1 if the system has none). Returns an
+// errno value on failure, including failures to exec the program.
+static int SpawnProcess(char *const argv[], char *const envp[],
+                        const char *cwd, const char *stdout_path,
+                        const char *stderr_path, int flags, pid_t *pid,
+                        int fds[4]) {
+  int in[2] = {-1, -1};
+  int out[2] = {-1, -1};
+  int err[2] = {-1, -1};
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  short attr_flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigfillset(&signals);
+  sigdelset(&signals, SIGKILL);
+  sigdelset(&signals, SIGSTOP);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+  if (flags & SPAWN_NEW_PROCESS_GROUP) {
+    attr_flags |= POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setpgroup(&attr, 0);
+  }
+#if defined(__APPLE__)
+  // Only the descriptors of the file actions are inherited.
+  attr_flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#endif
+  posix_spawnattr_setflags(&attr, attr_flags);
+
+  int error = CloexecPipe(in) < 0 ? errno : 0;
+  if (error == 0) {
+    error = posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+  }
+  if (error == 0) {
+    error = AddRedirect(&actions, STDOUT_FILENO, stdout_path, out);
+  }
+  if (error == 0) {
+    if (flags & SPAWN_REDIRECT_ERROR_STREAM) {
+      error = posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO,
+                                               STDERR_FILENO);
+    } else {
+      error = AddRedirect(&actions, STDERR_FILENO, stderr_path, err);
+    }
+  }
+#if !defined(__APPLE__)
+  if (error == 0) {
+    error = posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+  }
+#endif
+  if (error == 0 && cwd != nullptr) {
+#if defined(__APPLE__)
+    if (__builtin_available(macOS 10.15, *)) {
+      error = posix_spawn_file_actions_addchdir_np(&actions, cwd);
+    } else {
+      error = ENOSYS;
+    }
+#else
+    error = posix_spawn_file_actions_addchdir_np(&actions, cwd);
+#endif
+  }
+  if (error == 0) {
+    // Like execvp, posix_spawnp searches the PATH of this process.
+    error = strchr(argv[0], '/') != nullptr
+                ? posix_spawn(pid, argv[0], &actions, &attr, argv,
+                              envp != nullptr ? envp : environ)
+                : posix_spawnp(pid, argv[0], &actions, &attr, argv,
+                               envp != nullptr ? envp : environ);
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  // The child has its ends of the pipes now.
+  close(in[0]);
+  in[0] = -1;
+  if (out[1] >= 0) {
+    close(out[1]);
+    out[1] = -1;
+  }
+  if (err[1] >= 0) {
+    close(err[1]);
+    err[1] = -1;
+  }
+  if (error != 0) {
+    ClosePipe(in);
+    ClosePipe(out);
+    ClosePipe(err);
+    return error;
+  }
+
+  fds[0] = in[1];
+  fds[1] = out[0];
+  fds[2] = err[0];
+  fds[3] = -1;
+#if defined(__linux__) && defined(__NR_pidfd_open)
+  fds[3] = syscall(__NR_pidfd_open, *pid, 0);
+  if (fds[3] >= 0) {
+    fcntl(fds[3], F_SETFD, FD_CLOEXEC);
+  }
+#endif
+  return 0;
+}
+
+#endif  // defined(SPAWN_SUPPORTED)
+
+static void ThrowIOException(JNIEnv *env, const std::string &message) {
+  jclass clazz = env->FindClass("java/io/IOException");
+  if (clazz != nullptr) {
+    env->ThrowNew(clazz, message.c_str());
+  }
+}
+
+// Copies the Java array of NUL-terminated byte arrays `array` into `storage`
+// and returns the pointers into it, terminated by a null pointer.
+static std::vector<char *> GetByteArrays(JNIEnv *env, jobjectArray array,
+                                         std::vector<std::string> *storage) {
+  jsize length = env->GetArrayLength(array);
+  storage->resize(length);
+  std::vector<char *> result;
+  for (jsize i = 0; i < length; ++i) {
+    jbyteArray bytes =
+        static_cast<jbyteArray>(env->GetObjectArrayElement(array, i));
+    jsize size = env->GetArrayLength(bytes);
+    (*storage)[i].resize(size);
+    env->GetByteArrayRegion(
+        bytes, 0, size, reinterpret_cast<jbyte *>(&(*storage)[i][0]));
+    env->DeleteLocalRef(bytes);
+  }
+  for (jsize i = 0; i < length; ++i) {
+    result.push_back(&(*storage)[i][0]);
+  }
+  result.push_back(nullptr);
+  return result;
+}
+
+// Returns the contents of the NUL-terminated byte array `bytes`, or the empty
+// string if it is null.
+static std::string GetBytes(JNIEnv *env, jbyteArray bytes) {
+  std::string result;
+  if (bytes != nullptr) {
+    result.resize(env->GetArrayLength(bytes));
+    env->GetByteArrayRegion(bytes, 0, result.size(),
+                            reinterpret_cast<jbyte *>(&result[0]));
+  }
+  return result;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    canSpawn
+ * Signature: ()Z
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_canSpawn(JNIEnv *env,
+                                                              jclass clazz) {
+#if defined(SPAWN_SUPPORTED)
+#if defined(__APPLE__)
+  if (__builtin_available(macOS 10.15, *)) {
+    return JNI_TRUE;
+  }
+  return JNI_FALSE;
+#else
+  return JNI_TRUE;
+#endif
+#else
+  return JNI_FALSE;
+#endif
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    spawnNative
+ * Signature: ([[B[[B[B[B[BI[I)I
+ */
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_spawnNative(
+    JNIEnv *env, jclass clazz, jobjectArray argv, jobjectArray envp,
+    jbyteArray cwd, jbyteArray stdout_path, jbyteArray stderr_path,
+    jint flags, jintArray fds) {
+#if defined(SPAWN_SUPPORTED)
+  std::vector<std::string> argv_storage;
+  std::vector<std::string> envp_storage;
+  std::vector<char *> argv_chars = GetByteArrays(env, argv, &argv_storage);
+  std::vector<char *> envp_chars;
+  if (envp != nullptr) {
+    envp_chars = GetByteArrays(env, envp, &envp_storage);
+  }
+  std::string cwd_chars = GetBytes(env, cwd);
+  std::string stdout_chars = GetBytes(env, stdout_path);
+  std::string stderr_chars = GetBytes(env, stderr_path);
+
+  pid_t pid = -1;
+  int result_fds[4];
+  int error = SpawnProcess(
+      argv_chars.data(), envp != nullptr ? envp_chars.data() : nullptr,
+      cwd != nullptr ? cwd_chars.c_str() : nullptr,
+      stdout_path != nullptr ? stdout_chars.c_str() : nullptr,
+      stderr_path != nullptr ? stderr_chars.c_str() : nullptr, flags, &pid,
+      result_fds);
+  if (error != 0) {
+    // The message of java.lang.ProcessBuilder.
+    std::string message =
+        std::string("Cannot run program \"") + argv_chars[0] + "\"";
+    if (cwd != nullptr) {
+      message += std::string(" (in directory \"") + cwd_chars.c_str() + "\")";
+    }
+    ThrowIOException(env, message + ": error=" + std::to_string(error) + ", " +
+                              strerror(error));
+    return -1;
+  }
+  jint jfds[4] = {result_fds[0], result_fds[1], result_fds[2], result_fds[3]};
+  env->SetIntArrayRegion(fds, 0, 4, jfds);
+  return pid;
+#else
+  ThrowIOException(env, "posix_spawn is not supported on this system");
+  return -1;
+#endif
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    waitForExit
+ * Signature: (I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_waitForExit(JNIEnv *env,
+                                                                 jclass clazz,
+                                                                 jint pid) {
+  // WNOWAIT leaves the child a zombie, so that its pid cannot be reused
+  // before reap() is called.
+  siginfo_t info;
+  while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) {
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    reap
+ * Signature: (I)I
+ */
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_reap(JNIEnv *env,
+                                                          jclass clazz,
+                                                          jint pid) {
+  int status;
+  pid_t result;
+  while ((result = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {
+  }
+  if (result < 0) {
+    return -1;
+  }
+  // Like java.lang.Process: 128 plus the number of the terminating signal.
+  return WIFSIGNALED(status) ? 0x80 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    signal
+ * Signature: (III)Z
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_signal(JNIEnv *env,
+                                                            jclass clazz,
+                                                            jint pid,
+                                                            jint pidfd,
+                                                            jint sig) {
+#if defined(__linux__) && defined(__NR_pidfd_send_signal)
+  if (pidfd >= 0) {
+    return syscall(__NR_pidfd_send_signal, pidfd, sig, nullptr, 0) == 0;
+  }
+#endif
+  return kill(pid, sig) == 0;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    readFd
+ * Signature: (I[BII)I
+ */
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_readFd(
+    JNIEnv *env, jclass clazz, jint fd, jbyteArray bytes, jint offset,
+    jint length) {
+  char buf[65536];
+  ssize_t result;
+  while ((result = read(fd, buf, std::min<size_t>(length, sizeof(buf)))) < 0 &&
+         errno == EINTR) {
+  }
+  if (result < 0) {
+    ThrowIOException(env, std::string("read failed: ") + strerror(errno));
+    return -1;
+  }
+  if (result == 0) {
+    return -1;  // EOF
+  }
+  env->SetByteArrayRegion(bytes, offset, result,
+                          reinterpret_cast<const jbyte *>(buf));
+  return result;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    writeFd
+ * Signature: (I[BII)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_writeFd(
+    JNIEnv *env, jclass clazz, jint fd, jbyteArray bytes, jint offset,
+    jint length) {
+  char buf[65536];
+  while (length > 0) {
+    jint chunk = std::min<jint>(length, sizeof(buf));
+    env->GetByteArrayRegion(bytes, offset, chunk,
+                            reinterpret_cast<jbyte *>(buf));
+    for (jint written = 0; written < chunk;) {
+      ssize_t result = write(fd, buf + written, chunk - written);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ThrowIOException(env, std::string("write failed: ") + strerror(errno));
+        return;
+      }
+      written += result;
+    }
+    offset += chunk;
+    length -= chunk;
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.ProcessUtils
+ * Method:    closeFd
+ * Signature: (I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_ProcessUtils_closeFd(JNIEnv *env,
+                                                             jclass clazz,
+                                                             jint fd) {
+  close(fd);
+}
@@ -29,12 +29,17 @@
 #include <unistd.h>
 #include <utime.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>  // NOLINT
 #include <string>
 #include <vector>
 
 #include "src/main/native/macros.h"
 #include "src/main/cpp/util/md5.h"
 #include "src/main/cpp/util/port.h"
+#include "src/main/cpp/util/thread_pool.h"
 
 using blaze_util::Md5Digest;
 
@@ -843,6 +848,516 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkfifo(JNIEnv *env,
   ReleaseStringLatin1Chars(path_chars);
 }
 
+// The first failure of a multi-threaded tree operation: its errno and the
+// path it was for.
+struct FirstPathError {
+  std::mutex mutex;
+  int error_number;
+  std::string path;
+
+  FirstPathError() : error_number(0) {}
+
+  void Record(int e, const std::string &p) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error_number == 0) {
+      error_number = e;
+      path = p;
+    }
+  }
+};
+
+// Makes the directory "name" in "dirfd" readable, writable and searchable by
+// its owner, as FileSystemUtils.deleteTreesBelow does, so that its entries
+// can be listed and removed.
+static int EnsureDirReadWriteSearch(int dirfd, const char *name) {
+  struct stat st;
+  if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+    return -1;
+  }
+  if ((st.st_mode & S_IRWXU) == S_IRWXU) {
+    return 0;
+  }
+  return fchmodat(dirfd, name, (st.st_mode & 07777) | S_IRWXU, 0);
+}
+
+// Lists the entries of the directory "fd", without "." and "..". Does not
+// take ownership of "fd".
+static int ListEntries(int fd, std::vector<std::string> *names,
+                       std::vector<bool> *is_dir) {
+  int dup_fd = dup(fd);
+  if (dup_fd == -1) {
+    return -1;
+  }
+  DIR *dirh = fdopendir(dup_fd);
+  if (dirh == NULL) {
+    close(dup_fd);
+    return -1;
+  }
+  for (;;) {
+    errno = 0;
+    struct dirent *entry = readdir(dirh);
+    if (entry == NULL) {
+      if (errno == 0) break;  // EOF
+      if (errno == EINTR) continue;  // interrupted by a signal
+      if (errno == EIO) continue;  // glibc returns this on transient errors
+      int saved_errno = errno;
+      closedir(dirh);
+      errno = saved_errno;
+      return -1;
+    }
+    const char *name = entry->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    bool dir = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      dir = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+            S_ISDIR(st.st_mode);
+    }
+    names->push_back(name);
+    is_dir->push_back(dir);
+  }
+  closedir(dirh);
+  return 0;
+}
+
+static void DeleteTreesBelowFd(int fd, const std::string &path,
+                               FirstPathError *error);
+
+// Removes the entry "name" of the directory "dirfd", whose path is "path",
+// and everything below it if it is a directory. Symlinks are not followed.
+static void DeleteEntry(int dirfd, const std::string &path, const char *name,
+                        bool is_dir, FirstPathError *error) {
+  std::string entry_path = path + "/" + name;
+  if (is_dir) {
+    if (EnsureDirReadWriteSearch(dirfd, name) == -1) {
+      error->Record(errno, entry_path);
+      return;
+    }
+    int fd = openat(dirfd, name,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+      error->Record(errno, entry_path);
+      return;
+    }
+    DeleteTreesBelowFd(fd, entry_path, error);
+    close(fd);
+  }
+  if (unlinkat(dirfd, name, is_dir ? AT_REMOVEDIR : 0) == -1 &&
+      errno != ENOENT) {
+    error->Record(errno, entry_path);
+  }
+}
+
+// Removes everything below the directory "fd", whose path is "path".
+static void DeleteTreesBelowFd(int fd, const std::string &path,
+                               FirstPathError *error) {
+  std::vector<std::string> names;
+  std::vector<bool> is_dir;
+  if (ListEntries(fd, &names, &is_dir) == -1) {
+    error->Record(errno, path);
+    return;
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    DeleteEntry(fd, path, names[i].c_str(), is_dir[i], error);
+  }
+}
+
+// The workers that the file system operations below spread their work over,
+// shared by all of them. Started on first use and never stopped, so that the
+// JVM does not wait for them on exit.
+static blaze_util::ThreadPool *FileSystemWorkers() {
+  static blaze_util::ThreadPool *pool =
+      new blaze_util::ThreadPool(blaze_util::DefaultThreadCount(), 16);
+  return pool;
+}
+
+// deleteTreesBelow removes the entries of the directory on at most this many
+// threads, the calling one included; each takes whole entries, i.e. subtrees.
+static const unsigned kDeleteTreesMaxThreads = 8;
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    deleteTreesBelow
+ * Signature: (Ljava/lang/String;Z)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_deleteTreesBelow(
+    JNIEnv *env, jclass clazz, jstring path, jboolean parallel) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  std::string dir(path_chars);
+  ReleaseStringLatin1Chars(path_chars);
+
+  struct stat st;
+  if (lstat(dir.c_str(), &st) == -1) {
+    if (errno != ENOENT && errno != ENOTDIR) {
+      ::PostFileException(env, errno, dir.c_str());
+    }
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return;  // only real directories have trees below them
+  }
+  if (EnsureDirReadWriteSearch(AT_FDCWD, dir.c_str()) == -1) {
+    ::PostFileException(env, errno, dir.c_str());
+    return;
+  }
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    ::PostFileException(env, errno, dir.c_str());
+    return;
+  }
+
+  FirstPathError error;
+  std::vector<std::string> names;
+  std::vector<bool> is_dir;
+  if (ListEntries(fd, &names, &is_dir) == -1) {
+    error.Record(errno, dir);
+  } else {
+    blaze_util::ParallelFor(
+        parallel ? FileSystemWorkers() : nullptr, names.size(),
+        kDeleteTreesMaxThreads, [fd, &dir, &names, &is_dir, &error](size_t i) {
+          DeleteEntry(fd, dir, names[i].c_str(), is_dir[i], &error);
+        });
+  }
+  close(fd);
+
+  if (error.error_number != 0) {
+    ::PostFileException(env, error.error_number, error.path.c_str());
+  }
+}
+
+// The state chmodTree puts directories and regular files into.
+struct ChmodTreeTarget {
+  mode_t mode;
+  // Whether to set the modification time as well, to "mtime".
+  bool set_mtime;
+  struct timespec mtime;
+};
+
+static bool HasMtime(const struct stat &st, const struct timespec &mtime) {
+#if defined(__APPLE__)
+  const struct timespec &t = st.st_mtimespec;
+#else
+  const struct timespec &t = st.st_mtim;
+#endif
+  return t.tv_sec == mtime.tv_sec && t.tv_nsec == mtime.tv_nsec;
+}
+
+// Gives the entry "name" of "dirfd", whose lstat is "st", the mode and the
+// mtime of "target", skipping the calls for what it has already, so that
+// finalizing an already final tree changes nothing, not even ctimes.
+static int ApplyChmodTreeTarget(int dirfd, const char *name,
+                                const struct stat &st,
+                                const ChmodTreeTarget &target) {
+  if ((st.st_mode & 07777) != target.mode &&
+      fchmodat(dirfd, name, target.mode, 0) == -1) {
+    return -1;
+  }
+  if (target.set_mtime && !HasMtime(st, target.mtime)) {
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1] = target.mtime;
+    return utimensat(dirfd, name, times, AT_SYMLINK_NOFOLLOW);
+  }
+  return 0;
+}
+
+static void ChmodTreeFd(int fd, const std::string &path,
+                        const ChmodTreeTarget &target, FirstPathError *error);
+
+// Applies "target" to the entry "name" of the directory "dirfd", whose path is
+// "path", and to everything below it if it is a directory. Symlinks and
+// special files are left alone. A directory gets its mode before its entries
+// are listed, so that a directory its owner could not read is handled too.
+static void ChmodTreeEntry(int dirfd, const std::string &path,
+                           const char *name, const ChmodTreeTarget &target,
+                           FirstPathError *error) {
+  std::string entry_path = path + "/" + name;
+  struct stat st;
+  if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+    error->Record(errno, entry_path);
+    return;
+  }
+  if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+    return;
+  }
+  if (ApplyChmodTreeTarget(dirfd, name, st, target) == -1) {
+    error->Record(errno, entry_path);
+    return;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    int fd = openat(dirfd, name,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+      error->Record(errno, entry_path);
+      return;
+    }
+    ChmodTreeFd(fd, entry_path, target, error);
+    close(fd);
+  }
+}
+
+// Applies "target" to everything below the directory "fd", whose path is
+// "path".
+static void ChmodTreeFd(int fd, const std::string &path,
+                        const ChmodTreeTarget &target, FirstPathError *error) {
+  std::vector<std::string> names;
+  std::vector<bool> is_dir;
+  if (ListEntries(fd, &names, &is_dir) == -1) {
+    error->Record(errno, path);
+    return;
+  }
+  for (const std::string &name : names) {
+    ChmodTreeEntry(fd, path, name.c_str(), target, error);
+  }
+}
+
+// chmodTree handles the entries of the directory on at most this many
+// threads, the calling one included; each takes whole entries, i.e. subtrees.
+static const unsigned kChmodTreeMaxThreads = 8;
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    chmodTree
+ * Signature: (Ljava/lang/String;IJZ)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_chmodTree(
+    JNIEnv *env, jclass clazz, jstring path, jint mode, jlong mtime_millis,
+    jboolean parallel) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  std::string root(path_chars);
+  ReleaseStringLatin1Chars(path_chars);
+
+  ChmodTreeTarget target;
+  target.mode = mode & 07777;
+  target.set_mtime = mtime_millis >= 0;
+  target.mtime.tv_sec = mtime_millis / 1000;
+  target.mtime.tv_nsec = (mtime_millis % 1000) * 1000000;
+
+  struct stat st;
+  if (lstat(root.c_str(), &st) == -1) {
+    if (errno != ENOENT && errno != ENOTDIR) {
+      ::PostFileException(env, errno, root.c_str());
+    }
+    return;
+  }
+  if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+    return;
+  }
+  if (ApplyChmodTreeTarget(AT_FDCWD, root.c_str(), st, target) == -1) {
+    ::PostFileException(env, errno, root.c_str());
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return;
+  }
+  int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    ::PostFileException(env, errno, root.c_str());
+    return;
+  }
+
+  FirstPathError error;
+  std::vector<std::string> names;
+  std::vector<bool> is_dir;
+  if (ListEntries(fd, &names, &is_dir) == -1) {
+    error.Record(errno, root);
+  } else {
+    blaze_util::ParallelFor(
+        parallel ? FileSystemWorkers() : nullptr, names.size(),
+        kChmodTreeMaxThreads, [fd, &root, &names, &target, &error](size_t i) {
+          ChmodTreeEntry(fd, root, names[i].c_str(), target, &error);
+        });
+  }
+  close(fd);
+
+  if (error.error_number != 0) {
+    ::PostFileException(env, error.error_number, error.path.c_str());
+  }
+}
+
+// The directories open while symlinkTree creates the links of one part of
+// its list: fds[0] is the root, and fds[i] is the directory names[i - 1] in
+// fds[i - 1]. Consecutive links of a sorted list mostly share these.
+class OpenDirStack {
+ public:
+  explicit OpenDirStack(int root_fd) : fds_(1, root_fd) {}
+
+  ~OpenDirStack() { PopTo(0); }
+
+  // Makes the directory "dir", relative to the root, the top of the stack,
+  // creating the directories on the way as needed. Returns its fd, or -1 and
+  // sets errno if a directory could not be created or opened.
+  int Enter(const std::string &dir) {
+    // Keep the directories that are a prefix of "dir".
+    size_t depth = 0;
+    size_t pos = 0;
+    while (depth < names_.size()) {
+      const std::string &name = names_[depth];
+      size_t end = pos + name.size();
+      if (end > dir.size() || dir.compare(pos, name.size(), name) != 0 ||
+          (end != dir.size() && dir[end] != '/')) {
+        break;
+      }
+      pos += name.size() + 1;
+      depth++;
+    }
+    PopTo(depth);
+    while (pos < dir.size()) {
+      size_t end = dir.find('/', pos);
+      if (end == std::string::npos) {
+        end = dir.size();
+      }
+      std::string name = dir.substr(pos, end - pos);
+      if (mkdirat(fds_.back(), name.c_str(), 0777) == -1 && errno != EEXIST) {
+        return -1;
+      }
+      // O_NOFOLLOW: never create anything through a symlink created earlier,
+      // e.g. for an input that is a parent of another.
+      int fd = openat(fds_.back(), name.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd == -1) {
+        return -1;
+      }
+      fds_.push_back(fd);
+      names_.push_back(name);
+      pos = end + 1;
+    }
+    return fds_.back();
+  }
+
+ private:
+  void PopTo(size_t depth) {
+    while (names_.size() > depth) {
+      close(fds_.back());
+      fds_.pop_back();
+      names_.pop_back();
+    }
+  }
+
+  std::vector<int> fds_;
+  std::vector<std::string> names_;
+};
+
+// Creates the links links[begin..end) below the directory "root_fd", with
+// the matching targets; a NULL target stands for an empty file. Stops at the
+// first failure, or when another thread has failed.
+static void CreateSymlinks(int root_fd, const std::vector<char *> &links,
+                           const std::vector<char *> &targets, size_t begin,
+                           size_t end, FirstPathError *error,
+                           std::atomic<bool> *failed) {
+  OpenDirStack dirs(root_fd);
+  for (size_t i = begin; i < end && !*failed; ++i) {
+    std::string link(links[i]);
+    size_t slash = link.rfind('/');
+    std::string base = link;
+    int fd = root_fd;
+    if (slash != std::string::npos) {
+      base = link.substr(slash + 1);
+      fd = dirs.Enter(link.substr(0, slash));
+    }
+    int result = fd;
+    if (fd != -1) {
+      if (targets[i] != NULL) {
+        result = symlinkat(targets[i], fd, base.c_str());
+      } else {
+        result = openat(fd, base.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                        0666);
+        if (result != -1) {
+          close(result);
+        }
+      }
+    }
+    if (result == -1) {
+      error->Record(errno, link);
+      *failed = true;
+    }
+  }
+}
+
+// symlinkTree creates links on at most this many threads, the calling one
+// included, each taking kSymlinkTreeChunk consecutive links at a time.
+static const unsigned kSymlinkTreeMaxThreads = 8;
+static const size_t kSymlinkTreeChunk = 256;
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    symlinkTreeNative
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;Z)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_symlinkTreeNative(
+    JNIEnv *env, jclass clazz, jstring root, jobjectArray links,
+    jobjectArray targets, jboolean parallel) {
+  jsize count = env->GetArrayLength(links);
+  std::vector<char *> link_chars;
+  std::vector<char *> target_chars;
+  link_chars.reserve(count);
+  target_chars.reserve(count);
+  bool ok = true;
+  for (jsize i = 0; i < count && ok; ++i) {
+    jstring link = static_cast<jstring>(env->GetObjectArrayElement(links, i));
+    jstring target =
+        static_cast<jstring>(env->GetObjectArrayElement(targets, i));
+    char *chars = GetStringLatin1Chars(env, link);
+    ok = chars != NULL;
+    link_chars.push_back(chars);
+    chars = NULL;
+    if (ok && target != NULL) {
+      chars = GetStringLatin1Chars(env, target);
+      ok = chars != NULL;
+    }
+    target_chars.push_back(chars);
+    env->DeleteLocalRef(link);
+    env->DeleteLocalRef(target);
+  }
+
+  const char *root_chars = GetStringLatin1Chars(env, root);
+  if (ok && root_chars != NULL) {
+    int root_fd = open(root_chars,
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (root_fd == -1) {
+      ::PostFileException(env, errno, root_chars);
+    } else {
+      FirstPathError error;
+      std::atomic<bool> failed(false);
+      size_t chunks =
+          (link_chars.size() + kSymlinkTreeChunk - 1) / kSymlinkTreeChunk;
+      blaze_util::ParallelFor(
+          parallel ? FileSystemWorkers() : nullptr, chunks,
+          kSymlinkTreeMaxThreads, [&](size_t chunk) {
+            size_t begin = chunk * kSymlinkTreeChunk;
+            size_t end = std::min(begin + kSymlinkTreeChunk, link_chars.size());
+            CreateSymlinks(root_fd, link_chars, target_chars, begin, end,
+                           &error, &failed);
+          });
+      close(root_fd);
+      if (error.error_number != 0) {
+        std::string path = std::string(root_chars) + "/" + error.path;
+        ::PostFileException(env, error.error_number, path.c_str());
+      }
+    }
+  }
+  if (root_chars != NULL) {
+    ReleaseStringLatin1Chars(root_chars);
+  }
+  for (char *c : link_chars) {
+    if (c != NULL) ::ReleaseStringLatin1Chars(c);
+  }
+  for (char *c : target_chars) {
+    if (c != NULL) ::ReleaseStringLatin1Chars(c);
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Linux extended file attributes
 
@@ -892,23 +1407,43 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_lgetxattr(JNIEnv *env,
 }
 
 
+// Files larger than the buffer on the stack are read this many bytes at a time.
+static const size_t kLargeFileReadSize = 256 * 1024;
+
 // Computes MD5 digest of "file", writes result in "result", which
 // must be of length Md5Digest::kDigestLength.  Returns zero on success, or
 // -1 (and sets errno) otherwise.
 static int md5sumAsBytes(const char *file,
                          jbyte result[Md5Digest::kDigestLength]) {
   Md5Digest digest;
-  // OPT: Using a 32k buffer would give marginally better performance,
-  // but what is the stack size here?
-  jbyte buf[8192];
+  jbyte stack_buf[8192];
   int fd;
   while ((fd = open(file, O_RDONLY)) == -1 && errno == EINTR) { }
   if (fd == -1) {
     return -1;
   }
-  for (ssize_t len = read(fd, buf, arraysize(buf));
+
+  // Larger files are read in larger chunks, to save read() calls, through a
+  // buffer on the heap, as the stack of the calling Java thread may be small.
+  // They are not mmap()ed: if another process truncated the file while we
+  // digest it, that would kill the whole server with a SIGBUS.
+  jbyte *buf = stack_buf;
+  size_t buf_size = arraysize(stack_buf);
+  std::unique_ptr<jbyte[]> heap_buf;
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == 0 &&
+      statbuf.st_size > static_cast<off_t>(buf_size)) {
+    buf_size = kLargeFileReadSize;
+    heap_buf.reset(new jbyte[buf_size]);
+    buf = heap_buf.get();
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+
+  for (ssize_t len = read(fd, buf, buf_size);
        len != 0;
-       len = read(fd, buf, arraysize(buf))) {
+       len = read(fd, buf, buf_size)) {
     if (len == -1) {
       if (errno == EINTR) {
         continue;
@@ -945,6 +1480,193 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_md5sumAsBytes(
   return result;
 }
 
+// Copies the regular file "from" to "to", replacing "to" if it exists, and
+// gives the copy the mode and the mtime of "from". The copy is a
+// copy-on-write clone where the file system supports that; otherwise the
+// kernel copies the data where it can, and a read/write loop the rest.
+// Returns 0, or the errno of the failure, in which case "to" is removed.
+// "from_failed" is set to whether the failure was about "from".
+static int CopyFile(const char *from, const char *to, bool *from_failed) {
+  *from_failed = true;
+  int from_fd;
+  while ((from_fd = open(from, O_RDONLY | O_CLOEXEC)) == -1 &&
+         errno == EINTR) { }
+  if (from_fd == -1) {
+    return errno;
+  }
+  portable_stat_struct st;
+  if (portable_fstat(from_fd, &st) == -1) {
+    int error = errno;
+    close(from_fd);
+    return error;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    close(from_fd);
+    return S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+  }
+  *from_failed = false;
+  if (unlink(to) == -1 && errno != ENOENT) {
+    int error = errno;
+    close(from_fd);
+    return error;
+  }
+
+  mode_t mode = st.st_mode & 07777;
+  int error = 0;
+  if (!portable_clone_file(from_fd, to)) {
+    int to_fd = open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (to_fd == -1) {
+      error = errno;
+      close(from_fd);
+      return error;
+    }
+    off_t copied = 0;
+    while (copied < st.st_size) {
+      ssize_t n = portable_copy_file_range(from_fd, to_fd, st.st_size - copied);
+      if (n > 0) {
+        copied += n;
+      } else if (n == 0) {
+        break;  // the file shrank
+      } else if (errno != EINTR) {
+        if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+            errno != EOPNOTSUPP) {
+          error = errno;
+        }
+        break;
+      }
+    }
+    // Copies what the kernel did not, in large chunks.
+    if (error == 0 && copied < st.st_size) {
+      if (lseek(from_fd, copied, SEEK_SET) == -1 ||
+          lseek(to_fd, copied, SEEK_SET) == -1) {
+        error = errno;
+      }
+      std::unique_ptr<char[]> buf(new char[1 << 20]);
+      while (error == 0) {
+        ssize_t n = read(from_fd, buf.get(), 1 << 20);
+        if (n == 0) {
+          break;
+        } else if (n < 0) {
+          if (errno != EINTR) error = errno;
+          continue;
+        }
+        for (ssize_t written = 0; error == 0 && written < n;) {
+          ssize_t w = write(to_fd, buf.get() + written, n - written);
+          if (w >= 0) {
+            written += w;
+          } else if (errno != EINTR) {
+            error = errno;
+          }
+        }
+      }
+    }
+    if (close(to_fd) == -1 && error == 0) {
+      error = errno;
+    }
+  }
+  close(from_fd);
+
+  // Without the umask, and after the data, so that a read-only mode does not
+  // get in the way.
+  struct timespec times[2];
+  times[0].tv_sec = StatSeconds(st, STAT_ATIME);
+  times[0].tv_nsec = StatNanoSeconds(st, STAT_ATIME);
+  times[1].tv_sec = StatSeconds(st, STAT_MTIME);
+  times[1].tv_nsec = StatNanoSeconds(st, STAT_MTIME);
+  if (error == 0 && (chmod(to, mode) == -1 ||
+                     utimensat(AT_FDCWD, to, times, 0) == -1)) {
+    error = errno;
+  }
+  if (error != 0) {
+    unlink(to);
+  }
+  return error;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    copyFile
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_copyFile(
+    JNIEnv *env, jclass clazz, jstring from, jstring to) {
+  const char *from_chars = GetStringLatin1Chars(env, from);
+  const char *to_chars = GetStringLatin1Chars(env, to);
+  bool from_failed;
+  int error = CopyFile(from_chars, to_chars, &from_failed);
+  if (error != 0) {
+    ::PostFileException(env, error, from_failed ? from_chars : to_chars);
+  }
+  ReleaseStringLatin1Chars(from_chars);
+  ReleaseStringLatin1Chars(to_chars);
+}
+
+// copyFiles copies files on at most this many threads, the calling one
+// included.
+static const unsigned kCopyFilesMaxThreads = 4;
+
+// Stores the Latin-1 chars of the strings of "array" in "chars". Returns
+// false, with nothing stored and an exception pending, if that failed.
+static bool GetStringArrayLatin1Chars(JNIEnv *env, jobjectArray array,
+                                      std::vector<char *> *chars) {
+  jsize count = env->GetArrayLength(array);
+  chars->reserve(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring str = static_cast<jstring>(env->GetObjectArrayElement(array, i));
+    char *c = GetStringLatin1Chars(env, str);
+    env->DeleteLocalRef(str);
+    if (c == NULL) {
+      for (char *d : *chars) {
+        ::ReleaseStringLatin1Chars(d);
+      }
+      chars->clear();
+      return false;
+    }
+    chars->push_back(c);
+  }
+  return true;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    copyFilesNative
+ * Signature: ([Ljava/lang/String;[Ljava/lang/String;[I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_copyFilesNative(
+    JNIEnv *env, jclass clazz, jobjectArray from, jobjectArray to,
+    jintArray errnos) {
+  std::vector<char *> from_chars, to_chars;
+  if (!GetStringArrayLatin1Chars(env, from, &from_chars)) {
+    return;
+  }
+  if (!GetStringArrayLatin1Chars(env, to, &to_chars)) {
+    for (char *c : from_chars) {
+      ::ReleaseStringLatin1Chars(c);
+    }
+    return;
+  }
+
+  size_t count = from_chars.size();
+  std::vector<jint> errno_values(count);
+  blaze_util::ParallelFor(
+      FileSystemWorkers(), count, kCopyFilesMaxThreads,
+      [&from_chars, &to_chars, &errno_values](size_t i) {
+        bool from_failed;
+        errno_values[i] = CopyFile(from_chars[i], to_chars[i], &from_failed);
+      });
+
+  for (char *c : from_chars) {
+    ::ReleaseStringLatin1Chars(c);
+  }
+  for (char *c : to_chars) {
+    ::ReleaseStringLatin1Chars(c);
+  }
+  env->SetIntArrayRegion(errnos, 0, count, errno_values.data());
+}
+
 extern "C" JNIEXPORT jlong JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixSystem_sysctlbynameGetLong(
     JNIEnv *env, jclass clazz, jstring name) {
@@ -36,10 +36,12 @@
 typedef struct stat portable_stat_struct;
 #define portable_stat ::stat
 #define portable_lstat ::lstat
+#define portable_fstat ::fstat
 #else
 typedef struct stat64 portable_stat_struct;
 #define portable_stat ::stat64
 #define portable_lstat ::lstat64
+#define portable_fstat ::fstat64
 #endif
 
 #if defined(__FreeBSD__)
@@ -95,6 +97,18 @@ ssize_t portable_getxattr(const char *path, const char *name, void *value,
 ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
                            size_t size, bool *attr_not_found);
 
+// Creates "to", which must not exist, as a copy-on-write clone of the open
+// regular file "from_fd", if the file system supports that. Returns false,
+// having created nothing, otherwise.
+bool portable_clone_file(int from_fd, const char *to);
+
+// Copies up to "size" bytes from the current offset of "from_fd" to the
+// current offset of "to_fd" within the kernel, advancing both offsets, like
+// copy_file_range(2). Returns the number of bytes copied, 0 at the end of
+// "from_fd", or -1 with errno set; ENOSYS, EXDEV, EINVAL or EOPNOTSUPP mean
+// that the caller has to copy the data itself.
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t size);
+
 // Run sysctlbyname(3), only available on darwin
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep);
 
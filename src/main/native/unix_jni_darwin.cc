@@ -23,6 +23,7 @@
 #include <sys/sysctl.h>
 #include <sys/syslimits.h>
 #include <sys/types.h>
+#include <sys/clonefile.h>
 #include <sys/xattr.h>
 
 #include <string>
@@ -120,3 +121,13 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   return sysctlbyname(name_chars, mibp, sizep, NULL, 0);
 }
+
+bool portable_clone_file(int from_fd, const char *to) {
+  // On APFS. The clone is created complete or not at all.
+  return fclonefileat(from_fd, AT_FDCWD, to, 0) == 0;
+}
+
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t size) {
+  errno = ENOSYS;
+  return -1;
+}
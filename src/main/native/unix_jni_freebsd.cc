@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <string>
 
@@ -89,3 +90,16 @@ ssize_t portable_lgetxattr(const char *path, const char *name, void *value,
 int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   return sysctlbyname(name_chars, mibp, sizep, NULL, 0);
 }
+
+bool portable_clone_file(int from_fd, const char *to) {
+  return false;
+}
+
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t size) {
+#if __FreeBSD_version >= 1300037
+  return copy_file_range(from_fd, NULL, to_fd, NULL, size, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
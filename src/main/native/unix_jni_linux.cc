@@ -15,11 +15,18 @@
 #include "src/main/native/unix_jni.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>  // FICLONE
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/xattr.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <string>
 
 std::string ErrorMessage(int error_number) {
@@ -91,3 +98,36 @@ int portable_sysctlbyname(const char *name_chars, long *mibp, size_t *sizep) {
   errno = ENOSYS;
   return -1;
 }
+
+bool portable_clone_file(int from_fd, const char *to) {
+#ifdef FICLONE
+  int to_fd = open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (to_fd == -1) {
+    return false;
+  }
+  bool cloned = ioctl(to_fd, FICLONE, from_fd) == 0;
+  close(to_fd);
+  if (!cloned) {
+    unlink(to);
+  }
+  return cloned;
+#else
+  return false;
+#endif
+}
+
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t size) {
+  // Neither call copies more than this at once.
+  size = std::min<size_t>(size, 0x7ffff000);
+#ifdef __NR_copy_file_range
+  // Shares the blocks where the file system can (Btrfs, XFS, NFS 4.2).
+  ssize_t n = syscall(__NR_copy_file_range, from_fd, NULL, to_fd, NULL, size,
+                      0);
+  if (n >= 0 || (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+                 errno != EOPNOTSUPP)) {
+    return n;
+  }
+#endif
+  // Before Linux 5.3, copy_file_range does not copy across file systems.
+  return sendfile(to_fd, from_fd, NULL, size);
+}
@@ -19,6 +19,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "src/main/native/jni.h"
 #include "src/main/native/windows/file.h"
@@ -90,3 +91,121 @@ Java_com_google_devtools_build_lib_windows_jni_WindowsFileOperations_nativeCreat
   }
   return JNI_TRUE;
 }
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_windows_jni_WindowsFileOperations_nativeDeleteTreesBelow(
+    JNIEnv* env, jclass clazz, jstring path, jboolean parallel,
+    jobjectArray error_msg_holder) {
+  std::wstring wpath(bazel::windows::GetJavaWstring(env, path));
+  std::wstring error(
+      bazel::windows::DeleteTreesBelow(wpath, parallel == JNI_TRUE));
+  if (!error.empty()) {
+    if (CanReportError(env, error_msg_holder)) {
+      ReportLastError(bazel::windows::MakeErrorMessage(
+                          WSTR(__FILE__), __LINE__, L"nativeDeleteTreesBelow",
+                          wpath, error),
+                      env, error_msg_holder);
+    }
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
+// Copies the attributes in `files` into the Java arrays, which must be at least
+// as long.
+static void SetAttributeArrays(
+    JNIEnv* env, const std::vector<bazel::windows::FileAttributes>& files,
+    jintArray attributes, jintArray reparse_tags, jlongArray sizes,
+    jlongArray last_modified_times) {
+  jsize count = static_cast<jsize>(files.size());
+  std::vector<jint> ints(count);
+  std::vector<jlong> longs(count);
+  for (jsize i = 0; i < count; i++) {
+    ints[i] = static_cast<jint>(files[i].attributes);
+  }
+  env->SetIntArrayRegion(attributes, 0, count, ints.data());
+  for (jsize i = 0; i < count; i++) {
+    ints[i] = static_cast<jint>(files[i].reparse_tag);
+  }
+  env->SetIntArrayRegion(reparse_tags, 0, count, ints.data());
+  for (jsize i = 0; i < count; i++) {
+    longs[i] = files[i].size;
+  }
+  env->SetLongArrayRegion(sizes, 0, count, longs.data());
+  for (jsize i = 0; i < count; i++) {
+    longs[i] = files[i].last_write_time;
+  }
+  env->SetLongArrayRegion(last_modified_times, 0, count, longs.data());
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_windows_jni_WindowsFileOperations_nativeReadDirectory(
+    JNIEnv* env, jclass clazz, jstring path, jobjectArray result_holder,
+    jobjectArray error_msg_holder) {
+  std::wstring wpath(bazel::windows::GetJavaWstring(env, path));
+  std::vector<bazel::windows::FileAttributes> entries;
+  std::wstring error(bazel::windows::ReadDirectory(wpath, &entries));
+  if (!error.empty()) {
+    if (CanReportError(env, error_msg_holder)) {
+      ReportLastError(bazel::windows::MakeErrorMessage(
+                          WSTR(__FILE__), __LINE__, L"nativeReadDirectory",
+                          wpath, error),
+                      env, error_msg_holder);
+    }
+    return JNI_FALSE;
+  }
+
+  // The result is returned as arrays of the names and of each attribute, which
+  // is much cheaper than creating a Java object per entry from native code.
+  jsize count = static_cast<jsize>(entries.size());
+  jobjectArray names =
+      env->NewObjectArray(count, env->FindClass("java/lang/String"), nullptr);
+  for (jsize i = 0; i < count; i++) {
+    jstring name = env->NewString(
+        reinterpret_cast<const jchar*>(entries[i].name.c_str()),
+        entries[i].name.size());
+    env->SetObjectArrayElement(names, i, name);
+    env->DeleteLocalRef(name);
+  }
+  jintArray attributes = env->NewIntArray(count);
+  jintArray reparse_tags = env->NewIntArray(count);
+  jlongArray sizes = env->NewLongArray(count);
+  jlongArray last_modified_times = env->NewLongArray(count);
+  SetAttributeArrays(env, entries, attributes, reparse_tags, sizes,
+                     last_modified_times);
+  env->SetObjectArrayElement(result_holder, 0, names);
+  env->SetObjectArrayElement(result_holder, 1, attributes);
+  env->SetObjectArrayElement(result_holder, 2, reparse_tags);
+  env->SetObjectArrayElement(result_holder, 3, sizes);
+  env->SetObjectArrayElement(result_holder, 4, last_modified_times);
+  return JNI_TRUE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_windows_jni_WindowsFileOperations_nativeGetAttributes(
+    JNIEnv* env, jclass clazz, jobjectArray paths, jintArray attributes,
+    jintArray reparse_tags, jlongArray sizes, jlongArray last_modified_times,
+    jobjectArray error_msg_holder) {
+  jsize count = env->GetArrayLength(paths);
+  std::vector<std::wstring> wpaths;
+  wpaths.reserve(count);
+  for (jsize i = 0; i < count; i++) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    wpaths.push_back(bazel::windows::GetJavaWstring(env, path));
+    env->DeleteLocalRef(path);
+  }
+  std::vector<bazel::windows::FileAttributes> files;
+  std::wstring error(bazel::windows::GetAttributes(wpaths, &files));
+  if (!error.empty()) {
+    if (CanReportError(env, error_msg_holder)) {
+      ReportLastError(bazel::windows::MakeErrorMessage(
+                          WSTR(__FILE__), __LINE__, L"nativeGetAttributes",
+                          L"", error),
+                      env, error_msg_holder);
+    }
+    return JNI_FALSE;
+  }
+  SetAttributeArrays(env, files, attributes, reparse_tags, sizes,
+                     last_modified_times);
+  return JNI_TRUE;
+}
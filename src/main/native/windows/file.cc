@@ -15,9 +15,14 @@
 #include <stdint.h>  // uint8_t
 #include <windows.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "src/main/native/windows/file.h"
 #include "src/main/native/windows/util.h"
@@ -43,6 +48,13 @@ int IsJunctionOrDirectorySymlink(const WCHAR* path) {
 }
 
 wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result) {
+  wstring cached;
+  if (LongPathCache()->Get(path, &cached)) {
+    result->reset(new WCHAR[cached.size() + 1]);
+    std::copy(cached.c_str(), cached.c_str() + cached.size() + 1,
+              result->get());
+    return L"";
+  }
   DWORD size = ::GetLongPathNameW(path, NULL, 0);
   if (size == 0) {
     DWORD err_code = GetLastError();
@@ -51,6 +63,7 @@ wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result) {
   }
   result->reset(new WCHAR[size]);
   ::GetLongPathNameW(path, result->get(), size);
+  LongPathCache()->Put(path, result->get());
   return L"";
 }
 
@@ -90,6 +103,7 @@ typedef struct _JunctionDescription {
 
 wstring CreateJunction(const wstring& junction_name,
                        const wstring& junction_target) {
+  ClearPathConversionCaches();
   const wstring target = HasUncPrefix(junction_target.c_str())
                              ? junction_target.substr(4)
                              : junction_target;
@@ -188,5 +202,290 @@ wstring CreateJunction(const wstring& junction_name,
   return L"";
 }
 
+// Converts a FILETIME (100 nanoseconds since 1601) to milliseconds since the
+// Unix epoch.
+static int64_t FileTimeToMillis(int64_t filetime) {
+  return (filetime - 116444736000000000LL) / 10000;
+}
+
+wstring ReadDirectory(const wstring& path,
+                      std::vector<FileAttributes>* result) {
+  AutoHandle handle(::CreateFileW(
+      /* lpFileName */ path.c_str(),
+      /* dwDesiredAccess */ FILE_LIST_DIRECTORY,
+      /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ NULL,
+      /* dwCreationDisposition */ OPEN_EXISTING,
+      /* dwFlagsAndAttributes */ FILE_FLAG_BACKUP_SEMANTICS,
+      /* hTemplateFile */ NULL));
+  if (!handle.IsValid()) {
+    DWORD err_code = GetLastError();
+    return MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ReadDirectory", path,
+                            err_code);
+  }
+
+  // Every call fills the buffer with as many entries as fit, so large
+  // directories take few calls. FILE_ID_BOTH_DIR_INFO needs 8-byte alignment.
+  static const DWORD kBufferSize = 64 * 1024;
+  unique_ptr<int64_t[]> buffer(new int64_t[kBufferSize / sizeof(int64_t)]);
+  FILE_INFO_BY_HANDLE_CLASS info_class = FileIdBothDirectoryRestartInfo;
+  result->clear();
+  while (true) {
+    if (!::GetFileInformationByHandleEx(handle, info_class, buffer.get(),
+                                        kBufferSize)) {
+      DWORD err_code = GetLastError();
+      if (err_code == ERROR_NO_MORE_FILES) {
+        return L"";
+      }
+      return MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ReadDirectory", path,
+                              err_code);
+    }
+    info_class = FileIdBothDirectoryInfo;
+
+    const uint8_t* next = reinterpret_cast<const uint8_t*>(buffer.get());
+    while (true) {
+      const FILE_ID_BOTH_DIR_INFO* entry =
+          reinterpret_cast<const FILE_ID_BOTH_DIR_INFO*>(next);
+      wstring name(entry->FileName, entry->FileNameLength / sizeof(WCHAR));
+      if (name != L"." && name != L"..") {
+        FileAttributes attributes;
+        attributes.name = name;
+        attributes.attributes = entry->FileAttributes;
+        // For reparse points, EaSize holds the reparse tag.
+        attributes.reparse_tag =
+            (entry->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+                ? entry->EaSize
+                : 0;
+        attributes.size = entry->EndOfFile.QuadPart;
+        attributes.last_write_time =
+            FileTimeToMillis(entry->LastWriteTime.QuadPart);
+        result->push_back(attributes);
+      }
+      if (entry->NextEntryOffset == 0) {
+        break;
+      }
+      next += entry->NextEntryOffset;
+    }
+  }
+}
+
+wstring GetAttributes(const std::vector<wstring>& paths,
+                      std::vector<FileAttributes>* result) {
+  result->assign(paths.size(), FileAttributes());
+  for (size_t i = 0; i < paths.size(); i++) {
+    FileAttributes* attributes = &(*result)[i];
+    attributes->attributes = INVALID_FILE_ATTRIBUTES;
+    attributes->reparse_tag = 0;
+    attributes->size = 0;
+    attributes->last_write_time = 0;
+
+    // FindFirstFileExW returns the attributes of the directory entry itself,
+    // with the reparse tag; it doesn't follow reparse points.
+    WIN32_FIND_DATAW data;
+    HANDLE find = ::FindFirstFileExW(paths[i].c_str(), FindExInfoBasic, &data,
+                                     FindExSearchNameMatch, NULL,
+                                     FIND_FIRST_EX_LARGE_FETCH);
+    if (find != INVALID_HANDLE_VALUE) {
+      ::FindClose(find);
+      attributes->attributes = data.dwFileAttributes;
+      attributes->reparse_tag =
+          (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+              ? data.dwReserved0
+              : 0;
+      attributes->size =
+          (static_cast<int64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+      attributes->last_write_time = FileTimeToMillis(
+          (static_cast<int64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+          data.ftLastWriteTime.dwLowDateTime);
+      continue;
+    }
+
+    // FindFirstFileExW cannot find the roots of volumes, such as "C:\", which
+    // are not directory entries.
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (::GetFileAttributesExW(paths[i].c_str(), GetFileExInfoStandard,
+                               &info)) {
+      attributes->attributes = info.dwFileAttributes;
+      attributes->last_write_time = FileTimeToMillis(
+          (static_cast<int64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+          info.ftLastWriteTime.dwLowDateTime);
+      continue;
+    }
+    DWORD err_code = GetLastError();
+    if (err_code != ERROR_FILE_NOT_FOUND && err_code != ERROR_PATH_NOT_FOUND &&
+        err_code != ERROR_INVALID_NAME) {
+      return MakeErrorMessage(WSTR(__FILE__), __LINE__, L"GetAttributes",
+                              paths[i], err_code);
+    }
+  }
+  return L"";
+}
+
+// FileDispositionInfoEx and its flags, from Windows 10 1709 on. They are
+// defined here so that this file builds with older SDKs too.
+static const FILE_INFO_BY_HANDLE_CLASS kFileDispositionInfoEx =
+    static_cast<FILE_INFO_BY_HANDLE_CLASS>(21);
+static const DWORD kDispositionDelete = 0x1;
+static const DWORD kDispositionPosixSemantics = 0x2;
+static const DWORD kDispositionIgnoreReadonlyAttribute = 0x10;
+
+// The first error DeleteTreesBelow runs into; the other threads go on.
+struct FirstDeleteError {
+  std::mutex mutex;
+  wstring message;
+
+  void Record(const wstring& path, DWORD err_code) {
+    Record(MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow", path,
+                            err_code));
+  }
+
+  void Record(const wstring& error_msg) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (message.empty()) {
+      message = error_msg;
+    }
+  }
+};
+
+// Deletes the file, empty directory, junction or symlink at `path`, which has
+// the attributes `attributes`, without following reparse points.
+// With POSIX semantics the name goes away right away, even if the file is
+// still open elsewhere, so the parent directory can be removed next. Where
+// these are not supported (before Windows 10 1709, or not on NTFS), the
+// read-only attribute is cleared and the file is deleted the classic way.
+static DWORD DeleteOne(const wstring& path, DWORD attributes) {
+  AutoHandle handle(::CreateFileW(
+      /* lpFileName */ path.c_str(),
+      /* dwDesiredAccess */ DELETE | FILE_WRITE_ATTRIBUTES,
+      /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ NULL,
+      /* dwCreationDisposition */ OPEN_EXISTING,
+      /* dwFlagsAndAttributes */ FILE_FLAG_BACKUP_SEMANTICS |
+          FILE_FLAG_OPEN_REPARSE_POINT,
+      /* hTemplateFile */ NULL));
+  if (!handle.IsValid()) {
+    DWORD err_code = GetLastError();
+    return err_code == ERROR_FILE_NOT_FOUND || err_code == ERROR_PATH_NOT_FOUND
+               ? ERROR_SUCCESS
+               : err_code;
+  }
+
+  DWORD flags = kDispositionDelete | kDispositionPosixSemantics |
+                kDispositionIgnoreReadonlyAttribute;
+  if (::SetFileInformationByHandle(handle, kFileDispositionInfoEx, &flags,
+                                   sizeof(flags))) {
+    return ERROR_SUCCESS;
+  }
+  DWORD err_code = GetLastError();
+  if (err_code != ERROR_INVALID_PARAMETER && err_code != ERROR_NOT_SUPPORTED &&
+      err_code != ERROR_INVALID_FUNCTION) {
+    return err_code;
+  }
+
+  if (attributes & FILE_ATTRIBUTE_READONLY) {
+    FILE_BASIC_INFO basic_info = {0};
+    basic_info.FileAttributes = (attributes & ~FILE_ATTRIBUTE_READONLY) |
+                                FILE_ATTRIBUTE_NORMAL;
+    if (!::SetFileInformationByHandle(handle, FileBasicInfo, &basic_info,
+                                      sizeof(basic_info))) {
+      return GetLastError();
+    }
+  }
+  FILE_DISPOSITION_INFO disposition = {TRUE};
+  if (!::SetFileInformationByHandle(handle, FileDispositionInfo, &disposition,
+                                    sizeof(disposition))) {
+    return GetLastError();
+  }
+  return ERROR_SUCCESS;
+}
+
+static void DeleteEntries(const wstring& dir,
+                          const std::vector<FileAttributes>& entries,
+                          std::atomic<size_t>* next, FirstDeleteError* error);
+
+// Deletes everything below the directory `dir`.
+static void DeleteTreesBelowDir(const wstring& dir, FirstDeleteError* error) {
+  std::vector<FileAttributes> entries;
+  wstring error_msg = ReadDirectory(dir, &entries);
+  if (!error_msg.empty()) {
+    error->Record(error_msg);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  DeleteEntries(dir, entries, &next, error);
+}
+
+// Takes the next of `entries` of `dir` off the work queue `next` and deletes
+// it with everything below it, until all entries are done. Junctions and
+// directory symlinks are deleted, not followed.
+static void DeleteEntries(const wstring& dir,
+                          const std::vector<FileAttributes>& entries,
+                          std::atomic<size_t>* next, FirstDeleteError* error) {
+  for (size_t i = (*next)++; i < entries.size(); i = (*next)++) {
+    const FileAttributes& entry = entries[i];
+    wstring path = dir + L"\\" + entry.name;
+    if ((entry.attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+        !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+      DeleteTreesBelowDir(path, error);
+    }
+    DWORD err_code = DeleteOne(path, entry.attributes);
+    if (err_code != ERROR_SUCCESS) {
+      error->Record(path, err_code);
+    }
+  }
+}
+
+// DeleteTreesBelow deletes the entries of the directory on at most this many
+// threads, the calling one included; each takes whole entries, i.e. subtrees.
+static const unsigned kDeleteTreesMaxThreads = 8;
+
+wstring DeleteTreesBelow(const wstring& path, bool parallel) {
+  switch (IsJunctionOrDirectorySymlink(path.c_str())) {
+    case IS_JUNCTION_YES:
+      return L"";  // only real directories have trees below them
+    case IS_JUNCTION_ERROR: {
+      DWORD err_code = GetLastError();
+      if (err_code == ERROR_FILE_NOT_FOUND ||
+          err_code == ERROR_PATH_NOT_FOUND) {
+        return L"";
+      }
+      return MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                              path, err_code);
+    }
+    default:
+      break;
+  }
+  ClearPathConversionCaches();
+  std::vector<FileAttributes> entries;
+  wstring error_msg = ReadDirectory(path, &entries);
+  if (!error_msg.empty()) {
+    // Not a directory, or it went away.
+    DWORD attrs = ::GetFileAttributesW(path.c_str());
+    return attrs == INVALID_FILE_ATTRIBUTES ||
+                   !(attrs & FILE_ATTRIBUTE_DIRECTORY)
+               ? L""
+               : error_msg;
+  }
+
+  FirstDeleteError error;
+  std::atomic<size_t> next(0);
+  unsigned threads = 1;
+  if (parallel) {
+    threads = std::min<unsigned>(
+        std::min<unsigned>(entries.size(), kDeleteTreesMaxThreads),
+        std::max(1u, std::thread::hardware_concurrency()));
+  }
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t) {
+    workers.emplace_back(DeleteEntries, std::cref(path), std::cref(entries),
+                         &next, &error);
+  }
+  DeleteEntries(path, entries, &next, &error);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return error.message;
+}
+
 }  // namespace windows
 }  // namespace bazel
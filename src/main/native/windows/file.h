@@ -16,8 +16,11 @@
 
 #include <windows.h>
 
+#include <stdint.h>
+
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace bazel {
 namespace windows {
@@ -66,6 +69,7 @@ int IsJunctionOrDirectorySymlink(const WCHAR* path);
 // prefix if it's longer than MAX_PATH. The result will have a "\\?\" prefix if
 // and only if `path` had one as well. (It's the caller's responsibility to keep
 // or remove this prefix.)
+// Successful conversions are cached in LongPathCache().
 // TODO(laszlocsomor): update GetLongPath so it succeeds even if the path does
 // not (fully) exist.
 wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result);
@@ -82,9 +86,58 @@ HANDLE OpenDirectory(const WCHAR* path, bool read_write);
 // Neither `junction_name` nor `junction_target` needs to have a "\\?\" prefix,
 // not even if they are longer than MAX_PATH, though it's okay if they do. This
 // function will add the right prefixes as necessary.
+// Clears the path conversion caches of util.h.
 wstring CreateJunction(const wstring& junction_name,
                        const wstring& junction_target);
 
+// The attributes of a file or directory entry, as
+// GetFileInformationByHandleEx and FindFirstFileExW report them.
+struct FileAttributes {
+  // The name of the directory entry, empty for GetAttributes.
+  wstring name;
+  // The FILE_ATTRIBUTE_* flags, or INVALID_FILE_ATTRIBUTES if the file does
+  // not exist.
+  DWORD attributes;
+  // The reparse tag (e.g. IO_REPARSE_TAG_MOUNT_POINT of junctions) if
+  // `attributes` has FILE_ATTRIBUTE_REPARSE_POINT, otherwise 0.
+  DWORD reparse_tag;
+  // The size of the file in bytes.
+  int64_t size;
+  // The last modification time in milliseconds since the Unix epoch.
+  int64_t last_write_time;
+};
+
+// Lists the directory at `path` with the attributes of its entries, except
+// for "." and "..", in one pass over the directory, using
+// GetFileInformationByHandleEx(FileIdBothDirectoryInfo). Reparse points in the
+// directory are not followed.
+// Returns the empty string upon success, or a human-readable error message upon
+// failure.
+// `path` must be a valid Windows path, with "\\?\" prefix if it's long.
+wstring ReadDirectory(const wstring& path, std::vector<FileAttributes>* result);
+
+// Reads the attributes of each of `paths` with FindFirstFileExW, not
+// following reparse points, and stores them in `result` in the same order.
+// Paths that don't exist get INVALID_FILE_ATTRIBUTES.
+// Returns the empty string upon success, or a human-readable error message upon
+// failure.
+// Every path must be a valid Windows path, with "\\?\" prefix if it's long.
+wstring GetAttributes(const std::vector<wstring>& paths,
+                      std::vector<FileAttributes>* result);
+
+// Deletes everything below the directory `path`, and does nothing if `path`
+// is not a directory or is a junction or directory symlink. Doesn't follow
+// junctions and symlinks below `path` either.
+// Files are deleted with POSIX semantics where supported, so files that are
+// still open elsewhere don't hold up the deletion of their directory, and
+// read-only files are deleted too. If `parallel` is true, the entries of
+// `path` are deleted on a few threads.
+// Returns the empty string upon success, or a human-readable error message
+// about the first failure; the rest of the tree is deleted anyway.
+// Clears the path conversion caches of util.h.
+// `path` must be a valid Windows path, with "\?" prefix if it's long.
+wstring DeleteTreesBelow(const wstring& path, bool parallel);
+
 }  // namespace windows
 }  // namespace bazel
 
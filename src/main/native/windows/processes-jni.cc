@@ -325,10 +325,12 @@ Java_com_google_devtools_build_lib_windows_jni_WindowsProcesses_nativeCreateProc
   if (!stdout_redirect.empty()) {
     result->stdout_.close();
 
+    // Bazel may hold the file open too, e.g. the FileOutErr that the output
+    // is redirected to on behalf of, so let it read and write the file.
     stdout_process = CreateFileW(
         /* lpFileName */ stdout_redirect.c_str(),
         /* dwDesiredAccess */ FILE_APPEND_DATA,
-        /* dwShareMode */ 0,
+        /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE,
         /* lpSecurityAttributes */ &sa,
         /* dwCreationDisposition */ OPEN_ALWAYS,
         /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
@@ -376,7 +378,7 @@ Java_com_google_devtools_build_lib_windows_jni_WindowsProcesses_nativeCreateProc
       stderr_handle = CreateFileW(
           /* lpFileName */ stderr_redirect.c_str(),
           /* dwDesiredAccess */ FILE_APPEND_DATA,
-          /* dwShareMode */ 0,
+          /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE,
           /* lpSecurityAttributes */ &sa,
           /* dwCreationDisposition */ OPEN_ALWAYS,
           /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
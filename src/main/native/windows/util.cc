@@ -69,6 +69,60 @@ wstring GetLastErrorString(DWORD error_code) {
   return result;
 }
 
+bool PathConversionCache::Get(const wstring& path, wstring* result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it == index_.end()) {
+    return false;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  *result = it->second->second;
+  return true;
+}
+
+void PathConversionCache::Put(const wstring& path, const wstring& result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it != index_.end()) {
+    it->second->second = result;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+  if (entries_.size() >= capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.emplace_front(path, result);
+  index_[path] = entries_.begin();
+}
+
+void PathConversionCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  index_.clear();
+}
+
+// Enough for the tools and working directories of the actions of a large
+// build, at a few hundred bytes per entry.
+static const size_t kPathConversionCacheCapacity = 4096;
+
+PathConversionCache* ShortPathCache() {
+  static PathConversionCache* cache =
+      new PathConversionCache(kPathConversionCacheCapacity);
+  return cache;
+}
+
+PathConversionCache* LongPathCache() {
+  static PathConversionCache* cache =
+      new PathConversionCache(kPathConversionCacheCapacity);
+  return cache;
+}
+
+void ClearPathConversionCaches() {
+  ShortPathCache()->Clear();
+  LongPathCache()->Clear();
+}
+
 static void QuotePath(const wstring& path, wstring* result) {
   *result = wstring(L"\"") + path + L"\"";
 }
@@ -123,6 +177,9 @@ wstring AsShortPath(wstring path, wstring* result) {
   // At this point we know that the path is at least MAX_PATH long and that it's
   // absolute, normalized, and Windows-style.
 
+  if (ShortPathCache()->Get(path, result)) {
+    return L"";
+  }
   wstring wlong = wstring(L"\\\\?\\") + path;
 
   // Experience shows that:
@@ -150,6 +207,7 @@ wstring AsShortPath(wstring path, wstring* result) {
   }
   GetShortPathNameW(wlong.c_str(), wshort, kMaxShortPath);
   result->assign(wshort + 4);
+  ShortPathCache()->Put(path, *result);
   return L"";
 }
 
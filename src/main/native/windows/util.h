@@ -17,7 +17,11 @@
 
 #include <windows.h>
 
+#include <list>
+#include <mutex>  // NOLINT
 #include <string>
+#include <unordered_map>
+#include <utility>
 
 namespace bazel {
 namespace windows {
@@ -84,7 +88,42 @@ wstring MakeErrorMessage(const wchar_t* file, int line,
                          DWORD error_code);
 wstring GetLastErrorString(DWORD error_code);
 
+// A bounded, thread-safe cache of the results of path conversions that hit the
+// file system, such as computing 8dot3 short names, keyed by the input path.
+// When full, the least recently used conversion makes room for the new one.
+class PathConversionCache {
+ public:
+  explicit PathConversionCache(size_t capacity) : capacity_(capacity) {}
+
+  // Sets `result` to the cached conversion of `path` and returns true, or
+  // returns false if there is none.
+  bool Get(const wstring& path, wstring* result);
+
+  void Put(const wstring& path, const wstring& result);
+
+  void Clear();
+
+ private:
+  typedef std::list<std::pair<wstring, wstring>> Entries;
+
+  const size_t capacity_;
+  std::mutex mutex_;
+  // The conversions, the most recently used first.
+  Entries entries_;
+  std::unordered_map<wstring, Entries::iterator> index_;
+};
+
+// The caches of AsShortPath and GetLongPath.
+PathConversionCache* ShortPathCache();
+PathConversionCache* LongPathCache();
+
+// Forgets all cached path conversions. Creating a junction or deleting a tree
+// can change the long or short name a path resolves to, so those clear the
+// caches.
+void ClearPathConversionCaches();
+
 // Same as `AsExecutablePathForCreateProcess` except it won't quote the result.
+// Conversions that hit the file system are cached in ShortPathCache().
 wstring AsShortPath(wstring path, wstring* result);
 
 // Computes a path suitable as the executable part in CreateProcessA's cmdline.
@@ -0,0 +1,275 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/main/native/jni.h"
+#include "src/main/native/windows/file.h"
+#include "src/main/native/windows/jni-util.h"
+
+using std::wstring;
+
+// The changes a watched tree is watched for. Attribute changes are included
+// because a change of the read-only bit is a change of the file for Bazel.
+static const DWORD kNotifyFilter =
+    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+    FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE |
+    FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION;
+
+// The most paths kept between two polls. Beyond that, the paths are dropped
+// and the next poll reports that everything changed, as on an overflow of the
+// notification buffer.
+static const size_t kMaxPaths = 100000;
+
+// A structure to pass around the watch state and the list of paths.
+struct JNIWindowsDiffAwareness {
+  // The watched root directory, as reported to Java.
+  wstring root;
+  // The root directory, opened for overlapped ReadDirectoryChangesW.
+  HANDLE dir;
+  // Signaled when a ReadDirectoryChangesW call completes.
+  HANDLE io_event;
+  // Signaled by doClose() to wake up and stop the run loop.
+  HANDLE stop_event;
+  // List of paths that have been changed since last polling.
+  std::vector<wstring> paths;
+  // Whether changes were lost, either because the notification buffer
+  // overflowed or the root could not be watched. Once set, every poll reports
+  // that everything changed.
+  bool overflow;
+  // Protects paths and overflow. The run loop fills them and
+  // WindowsDiffAwareness#poll() empties them from Java threads.
+  CRITICAL_SECTION lock;
+
+  JNIWindowsDiffAwareness()
+      : dir(INVALID_HANDLE_VALUE),
+        io_event(NULL),
+        stop_event(NULL),
+        overflow(false) {
+    InitializeCriticalSection(&lock);
+  }
+
+  ~JNIWindowsDiffAwareness() {
+    if (dir != INVALID_HANDLE_VALUE) CloseHandle(dir);
+    if (io_event != NULL) CloseHandle(io_event);
+    if (stop_event != NULL) CloseHandle(stop_event);
+    DeleteCriticalSection(&lock);
+  }
+};
+
+// Appends the paths of everything below the directory "dir" to "found", not
+// following junctions and symlinks. ReadDirectoryChangesW only reports a
+// directory that was moved into the tree, not its contents.
+static void ListRecursively(const wstring& dir, std::vector<wstring>* found) {
+  std::vector<bazel::windows::FileAttributes> entries;
+  if (!bazel::windows::ReadDirectory(dir, &entries).empty()) {
+    return;  // deleted or replaced in the meantime; that is reported too
+  }
+  for (const auto& entry : entries) {
+    wstring path = dir + L"\\" + entry.name;
+    found->push_back(path);
+    if ((entry.attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+        !(entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+      ListRecursively(path, found);
+    }
+  }
+}
+
+// Handles the FILE_NOTIFY_INFORMATION records in buf, appending the changed
+// paths to "changed".
+static void HandleNotifications(const JNIWindowsDiffAwareness* info,
+                                const char* buf,
+                                std::vector<wstring>* changed) {
+  for (const char* p = buf;;) {
+    const FILE_NOTIFY_INFORMATION* record =
+        reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+    wstring path = info->root + L"\\" +
+                   wstring(record->FileName,
+                           record->FileNameLength / sizeof(WCHAR));
+    changed->push_back(path);
+    if (record->Action == FILE_ACTION_ADDED ||
+        record->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+      DWORD attr = GetFileAttributesW(path.c_str());
+      if (attr != INVALID_FILE_ATTRIBUTES &&
+          (attr & FILE_ATTRIBUTE_DIRECTORY) &&
+          !(attr & FILE_ATTRIBUTE_REPARSE_POINT)) {
+        ListRecursively(path, changed);
+      }
+    }
+    if (record->NextEntryOffset == 0) {
+      break;
+    }
+    p += record->NextEntryOffset;
+  }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsDiffAwareness_create(
+    JNIEnv* env, jobject diffAwareness, jstring root) {
+  JNIWindowsDiffAwareness* info = new JNIWindowsDiffAwareness();
+  info->root = bazel::windows::GetJavaWstring(env, root);
+  while (!info->root.empty() && (info->root.back() == L'\\' ||
+                                 info->root.back() == L'/')) {
+    info->root.pop_back();
+  }
+
+  wstring dir = info->root;
+  if (dir.size() >= MAX_PATH && !bazel::windows::HasUncPrefix(dir.c_str())) {
+    dir = L"\\\\?\\" + dir;
+  }
+  info->dir = CreateFileW(
+      /* lpFileName */ dir.c_str(),
+      /* dwDesiredAccess */ FILE_LIST_DIRECTORY,
+      /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ NULL,
+      /* dwCreationDisposition */ OPEN_EXISTING,
+      /* dwFlagsAndAttributes */ FILE_FLAG_BACKUP_SEMANTICS |
+          FILE_FLAG_OVERLAPPED,
+      /* hTemplateFile */ NULL);
+  info->io_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+  info->stop_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+  if (info->dir == INVALID_HANDLE_VALUE || info->io_event == NULL ||
+      info->stop_event == NULL) {
+    info->overflow = true;
+  }
+
+  // Save the info pointer to WindowsDiffAwareness#nativePointer
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(diffAwareness, fid, reinterpret_cast<jlong>(info));
+}
+
+static JNIWindowsDiffAwareness* GetInfo(JNIEnv* env, jobject diffAwareness) {
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(diffAwareness, fid);
+  return reinterpret_cast<JNIWindowsDiffAwareness*>(field);
+}
+
+// Reads changes until doClose() is called, then frees the native structure:
+// this way, doClose() does not have to wait for the loop to notice.
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsDiffAwareness_run(
+    JNIEnv* env, jobject diffAwareness) {
+  JNIWindowsDiffAwareness* info = GetInfo(env, diffAwareness);
+  if (info->stop_event == NULL) {
+    return;  // create() failed; doClose() frees the structure
+  }
+
+  // Between two calls the system buffers the changes in a buffer of the same
+  // size, so it has to be large enough for a burst. 64K is also the most
+  // ReadDirectoryChangesW accepts for network drives. FILE_NOTIFY_INFORMATION
+  // needs DWORD alignment.
+  static const DWORD kBufferSize = 64 * 1024;
+  std::unique_ptr<DWORD[]> storage(new DWORD[kBufferSize / sizeof(DWORD)]);
+  char* buf = reinterpret_cast<char*>(storage.get());
+
+  HANDLE handles[2] = {info->stop_event, info->io_event};
+  bool reading = !info->overflow;
+  while (reading) {
+    OVERLAPPED overlapped = {0};
+    overlapped.hEvent = info->io_event;
+    ResetEvent(info->io_event);
+    if (!ReadDirectoryChangesW(info->dir, buf, kBufferSize,
+                               /* bWatchSubtree */ TRUE, kNotifyFilter, NULL,
+                               &overlapped, NULL)) {
+      EnterCriticalSection(&info->lock);
+      info->overflow = true;
+      info->paths.clear();
+      LeaveCriticalSection(&info->lock);
+      break;
+    }
+    DWORD bytes = 0;
+    if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) !=
+        WAIT_OBJECT_0 + 1) {
+      // doClose() was called: cancel the read, and wait for it to finish
+      // before the buffer goes away.
+      CancelIo(info->dir);
+      GetOverlappedResult(info->dir, &overlapped, &bytes, TRUE);
+      break;
+    }
+
+    std::vector<wstring> changed;
+    // No bytes means the system buffer overflowed. A failure means e.g. that
+    // the root was deleted; there are no more changes to wait for.
+    bool ok = false;
+    if (GetOverlappedResult(info->dir, &overlapped, &bytes, FALSE)) {
+      ok = bytes > 0;
+      if (ok) {
+        HandleNotifications(info, buf, &changed);
+      }
+    } else if (GetLastError() != ERROR_NOTIFY_ENUM_DIR) {
+      reading = false;
+    }
+
+    EnterCriticalSection(&info->lock);
+    if (!ok || info->paths.size() + changed.size() > kMaxPaths) {
+      info->overflow = true;
+    }
+    if (info->overflow) {
+      info->paths.clear();
+    } else {
+      info->paths.insert(info->paths.end(), changed.begin(), changed.end());
+    }
+    LeaveCriticalSection(&info->lock);
+  }
+  if (!reading) {
+    // Nothing more to read; wait for doClose() to free the structure.
+    WaitForSingleObject(info->stop_event, INFINITE);
+  }
+  delete info;
+}
+
+// Returns the paths changed since the last call, or null if changes were lost
+// and the caller has to assume that everything changed.
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsDiffAwareness_poll(
+    JNIEnv* env, jobject diffAwareness) {
+  JNIWindowsDiffAwareness* info = GetInfo(env, diffAwareness);
+  EnterCriticalSection(&info->lock);
+
+  jobjectArray result = NULL;
+  if (!info->overflow) {
+    jclass classString = env->FindClass("java/lang/String");
+    result = env->NewObjectArray(info->paths.size(), classString, NULL);
+    for (size_t i = 0; i < info->paths.size(); i++) {
+      jstring path = env->NewString(
+          reinterpret_cast<const jchar*>(info->paths[i].c_str()),
+          info->paths[i].size());
+      env->SetObjectArrayElement(result, i, path);
+      env->DeleteLocalRef(path);
+    }
+  }
+  info->paths.clear();
+  LeaveCriticalSection(&info->lock);
+  return result;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsDiffAwareness_doClose(
+    JNIEnv* env, jobject diffAwareness) {
+  JNIWindowsDiffAwareness* info = GetInfo(env, diffAwareness);
+  if (info->stop_event == NULL) {
+    delete info;  // there is no run loop
+    return;
+  }
+  // The run loop frees the structure once it sees the event.
+  SetEvent(info->stop_event);
+}
@@ -0,0 +1,260 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures build-runfiles on synthetic manifests, to back up its --jobs and
+// --incremental modes with data and to catch regressions on a filesystem.
+//
+// Generates a manifest of symlinks to a set of target files, spread over a
+// directory tree of the given depth and fanout, and a second manifest in which
+// a fraction of the symlinks point elsewhere. Then, every iteration runs
+// build-runfiles
+//   fresh    into an empty directory,
+//   noop     again with the same manifest, and
+//   changed  with the second manifest,
+// passing on the BUILD_RUNFILES_OPTIONs.
+//
+// Usage:
+//   build-runfiles-benchmark --build_runfiles=PATH [BENCHMARK_OPTION...]
+//                            [-- BUILD_RUNFILES_OPTION...]
+// Benchmark options:
+//   --entries=N     number of symlinks in the manifest (100000)
+//   --depth=N       directory levels above each symlink (3)
+//   --fanout=N      subdirectories of each directory (10)
+//   --targets=N     number of target files (1000)
+//   --change=F      fraction of the symlinks changed for "changed" (0.01)
+//   --iterations=N  number of times to run each scenario (3)
+//   --corpus_dir=D  where to create the manifests and trees ($TEST_TMPDIR,
+//                   else $TMPDIR, else /tmp)
+//
+// Prints the median and the fastest wall time of every scenario, in
+// milliseconds, followed by build-runfiles' --stats of its last run.
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string build_runfiles;
+  int entries = 100000;
+  int depth = 3;
+  int fanout = 10;
+  int targets = 1000;
+  double change = 0.01;
+  int iterations = 3;
+  std::string corpus_dir;
+  std::vector<std::string> build_runfiles_options;
+};
+
+void Die(const char *message, const std::string &arg) {
+  fprintf(stderr, "build-runfiles-benchmark: %s%s\n", message, arg.c_str());
+  exit(1);
+}
+
+bool ParseFlag(const char *arg, const char *name, std::string *value) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
+  *value = arg + len + 1;
+  return true;
+}
+
+Options ParseOptions(int argc, char **argv) {
+  Options options;
+  const char *tmp = getenv("TEST_TMPDIR");
+  if (tmp == nullptr) {
+    tmp = getenv("TMPDIR");
+  }
+  options.corpus_dir = tmp != nullptr ? tmp : "/tmp";
+  int i = 1;
+  for (; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+    std::string value;
+    if (ParseFlag(argv[i], "--build_runfiles", &value)) {
+      options.build_runfiles = value;
+    } else if (ParseFlag(argv[i], "--entries", &value)) {
+      options.entries = atoi(value.c_str());
+    } else if (ParseFlag(argv[i], "--depth", &value)) {
+      options.depth = atoi(value.c_str());
+    } else if (ParseFlag(argv[i], "--fanout", &value)) {
+      options.fanout = atoi(value.c_str());
+    } else if (ParseFlag(argv[i], "--targets", &value)) {
+      options.targets = atoi(value.c_str());
+    } else if (ParseFlag(argv[i], "--change", &value)) {
+      options.change = atof(value.c_str());
+    } else if (ParseFlag(argv[i], "--iterations", &value)) {
+      options.iterations = atoi(value.c_str());
+    } else if (ParseFlag(argv[i], "--corpus_dir", &value)) {
+      options.corpus_dir = value;
+    } else {
+      Die("unknown option ", argv[i]);
+    }
+  }
+  for (++i; i < argc; ++i) {
+    options.build_runfiles_options.push_back(argv[i]);
+  }
+  if (options.build_runfiles.empty()) {
+    Die("--build_runfiles is required", "");
+  }
+  if (options.entries < 1 || options.depth < 0 || options.fanout < 1 ||
+      options.targets < 1 || options.iterations < 1 || options.change < 0 ||
+      options.change > 1) {
+    Die("option out of range", "");
+  }
+  return options;
+}
+
+void WriteFileOrDie(const std::string &path, const std::string &contents) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr ||
+      fwrite(contents.data(), 1, contents.size(), file) != contents.size() ||
+      fclose(file) != 0) {
+    Die("cannot write ", path);
+  }
+}
+
+int RemoveEntry(const char *path, const struct stat *, int type,
+                struct FTW *) {
+  if (type == FTW_DP) {
+    chmod(path, 0700);  // build-runfiles may have left it read-only
+    return rmdir(path);
+  }
+  return unlink(path);
+}
+
+void RemoveTree(const std::string &path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 &&
+      nftw(path.c_str(), RemoveEntry, 64, FTW_DEPTH | FTW_PHYS) != 0) {
+    Die("cannot remove ", path);
+  }
+}
+
+// Returns the manifest line of entry "i", which points to "target".
+std::string ManifestLine(const Options &options, const std::string &targets,
+                         int i, int target) {
+  std::string line = "__main__";
+  for (int level = 0, n = i; level < options.depth; ++level) {
+    line += "/d" + std::to_string(n % options.fanout);
+    n /= options.fanout;
+  }
+  line += "/f" + std::to_string(i) + " " + targets + "/t" +
+          std::to_string(target % options.targets) + "\n";
+  return line;
+}
+
+// Runs build-runfiles and returns its wall time in milliseconds.
+double RunBuildRunfiles(const Options &options, const std::string &manifest,
+                        const std::string &tree, const std::string &stats) {
+  std::vector<std::string> args = {options.build_runfiles};
+  args.insert(args.end(), options.build_runfiles_options.begin(),
+              options.build_runfiles_options.end());
+  args.push_back("--stats=" + stats);
+  args.push_back(manifest);
+  args.push_back(tree);
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    Die("build-runfiles failed on ", manifest);
+  }
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options = ParseOptions(argc, argv);
+
+  const std::string corpus = options.corpus_dir + "/build-runfiles-benchmark";
+  const std::string targets = corpus + "/targets";
+  const std::string tree = corpus + "/tree.runfiles";
+  const std::string stats = corpus + "/stats";
+  RemoveTree(corpus);
+  if (mkdir(corpus.c_str(), 0777) != 0 || mkdir(targets.c_str(), 0777) != 0) {
+    Die("cannot create ", targets);
+  }
+  for (int i = 0; i < options.targets; ++i) {
+    WriteFileOrDie(targets + "/t" + std::to_string(i), "");
+  }
+
+  // The changed entries are spread evenly over the tree.
+  int changed_every =
+      options.change > 0
+          ? std::max(1, static_cast<int>(1 / options.change + 0.5))
+          : options.entries + 1;
+  std::string manifest, changed_manifest;
+  for (int i = 0; i < options.entries; ++i) {
+    manifest += ManifestLine(options, targets, i, i);
+    changed_manifest +=
+        ManifestLine(options, targets, i, i % changed_every == 0 ? i + 1 : i);
+  }
+  WriteFileOrDie(corpus + "/MANIFEST", manifest);
+  WriteFileOrDie(corpus + "/MANIFEST.changed", changed_manifest);
+
+  static const char *const kScenarios[] = {"fresh", "noop", "changed"};
+  std::vector<double> times[3];
+  for (int i = 0; i < options.iterations; ++i) {
+    RemoveTree(tree);
+    times[0].push_back(
+        RunBuildRunfiles(options, corpus + "/MANIFEST", tree, stats));
+    times[1].push_back(
+        RunBuildRunfiles(options, corpus + "/MANIFEST", tree, stats));
+    times[2].push_back(
+        RunBuildRunfiles(options, corpus + "/MANIFEST.changed", tree, stats));
+  }
+
+  printf("%-10s %12s %12s\n", "scenario", "median_ms", "min_ms");
+  for (int i = 0; i < 3; ++i) {
+    std::sort(times[i].begin(), times[i].end());
+    printf("%-10s %12.1f %12.1f\n", kScenarios[i],
+           times[i][times[i].size() / 2], times[i][0]);
+  }
+  printf("\nlast run (changed):\n");
+  fflush(stdout);
+  FILE *file = fopen(stats.c_str(), "r");
+  if (file != nullptr) {
+    char line[256];
+    while (fgets(line, sizeof line, file) != nullptr) {
+      printf("  %s", line);
+    }
+    fclose(file);
+  }
+
+  RemoveTree(corpus);
+  return 0;
+}
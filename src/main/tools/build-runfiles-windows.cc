@@ -11,17 +11,464 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+//
+// This program creates a "runfiles tree" from a "runfiles manifest" on
+// Windows. It takes the same arguments as build-runfiles.cc, except for
+// --incremental and --link_mode: an input manifest INPUT and an output
+// directory RUNFILES.
+//
+// Given the line
+//   <workspace root>/output/path C:/real/path
+// we will create directories
+//   RUNFILES\<workspace root>
+//   RUNFILES\<workspace root>\output
+// and RUNFILES\<workspace root>\output\path, which is
+// - a junction to C:\real\path if that is a directory,
+// - else a symlink to it, created with
+//   SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE so that it works in Developer
+//   Mode,
+// - else, if symlinks cannot be created at all, a copy of it.
+// A line without a target creates an empty file. Finally, a copy of the input
+// manifest is written to RUNFILES\MANIFEST.
+//
+// Unlike build-runfiles.cc, this program does not compare the tree with the
+// manifest: reading back the target of a reparse point costs about as much as
+// creating it, so the previous tree is deleted and rebuilt. With --jobs=N,
+// N threads delete and create the entries.
+
+#include <windows.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "src/main/native/windows/file.h"
+#include "src/main/native/windows/util.h"
+
+#ifndef SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE
+// Only defined by the Windows 10 Creators Update SDK and later.
+#define SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE 0x2
+#endif
+
+using std::string;
+using std::wstring;
+
+static const char* argv0;
+
+const char* input_filename;
+const char* output_base_dir;
+
+#define LOG() { \
+  fprintf(stderr, "%s (args %s %s): ", \
+          argv0, input_filename, output_base_dir); \
+}
+
+#define DIE(...) { \
+  LOG(); \
+  fprintf(stderr, __VA_ARGS__); \
+  fprintf(stderr, "\n"); \
+  exit(1); \
+}
+
+// Dies with the message of the last Win32 error, which "function" failed with
+// on "path".
+static void DieWithLastError(const char* function, const wstring& path) {
+  DWORD err = GetLastError();
+  DIE("%s '%ls': %ls [%lu]", function, path.c_str(),
+      bazel::windows::GetLastErrorString(err).c_str(), err);
+}
+
+static wstring Utf8ToWide(const string& s) {
+  if (s.empty()) {
+    return wstring();
+  }
+  int size = MultiByteToWideChar(CP_UTF8, 0, s.data(), s.size(), nullptr, 0);
+  if (size == 0) {
+    DIE("'%s' is not valid UTF-8", s.c_str());
+  }
+  wstring result(size, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, s.data(), s.size(), &result[0], size);
+  return result;
+}
+
+static void ToBackslashes(wstring* path) {
+  for (wchar_t& c : *path) {
+    if (c == L'/') {
+      c = L'\\';
+    }
+  }
+}
+
+static bool IsAbsolute(const wstring& path) {
+  return (path.size() >= 3 && path[1] == L':' &&
+          (path[2] == L'\\' || path[2] == L'/')) ||
+         (path.size() >= 2 && path[0] == L'\\' && path[1] == L'\\');
+}
+
+// Returns the absolute form of "path", with a "\\?\" prefix so that it may
+// exceed MAX_PATH.
+static wstring AbsolutePath(const wstring& path) {
+  if (bazel::windows::HasUncPrefix(path.c_str())) {
+    return path;
+  }
+  DWORD size = GetFullPathNameW(path.c_str(), 0, nullptr, nullptr);
+  if (size == 0) {
+    DieWithLastError("GetFullPathNameW", path);
+  }
+  wstring result(size, L'\0');
+  size = GetFullPathNameW(path.c_str(), size, &result[0], nullptr);
+  result.resize(size);
+  if (result.compare(0, 2, L"\\\\") == 0) {
+    return L"\\\\?\\UNC\\" + result.substr(2);  // a network share
+  }
+  return L"\\\\?\\" + result;
+}
+
+// Runs "fn(0)" to "fn(count - 1)" on "jobs" threads.
+static void ParallelFor(size_t count, int jobs,
+                        const std::function<void(size_t)>& fn) {
+  std::atomic<size_t> next(0);
+  auto worker = [&next, count, &fn]() {
+    for (size_t i; (i = next++) < count;) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < jobs && static_cast<size_t>(i) < count; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+// Returns the names and attributes of the entries of the directory "path".
+static std::vector<std::pair<wstring, DWORD> > ListDirectory(
+    const wstring& path) {
+  std::vector<std::pair<wstring, DWORD> > result;
+  WIN32_FIND_DATAW data;
+  HANDLE handle =
+      FindFirstFileExW((path + L"\\*").c_str(), FindExInfoBasic, &data,
+                       FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+  if (handle == INVALID_HANDLE_VALUE) {
+    if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+      return result;
+    }
+    DieWithLastError("FindFirstFileExW", path);
+  }
+  do {
+    const wchar_t* name = data.cFileName;
+    if (name[0] == L'.' &&
+        (name[1] == L'\0' || (name[1] == L'.' && name[2] == L'\0'))) {
+      continue;
+    }
+    result.push_back(std::make_pair(wstring(name), data.dwFileAttributes));
+  } while (FindNextFileW(handle, &data));
+  DWORD err = GetLastError();
+  FindClose(handle);
+  if (err != ERROR_NO_MORE_FILES) {
+    SetLastError(err);
+    DieWithLastError("FindNextFileW", path);
+  }
+  return result;
+}
+
+// Deletes "path", which has the attributes "attrs", and everything below it.
+// Junctions and symlinks are deleted, not followed.
+static void DeleteTree(const wstring& path, DWORD attrs) {
+  if (attrs & FILE_ATTRIBUTE_READONLY) {
+    SetFileAttributesW(path.c_str(), attrs & ~FILE_ATTRIBUTE_READONLY);
+  }
+  if (!(attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+    if (!DeleteFileW(path.c_str())) {
+      DieWithLastError("DeleteFileW", path);
+    }
+    return;
+  }
+  if (!(attrs & FILE_ATTRIBUTE_REPARSE_POINT)) {
+    for (const auto& entry : ListDirectory(path)) {
+      DeleteTree(path + L"\\" + entry.first, entry.second);
+    }
+  }
+  // Removes a junction or directory symlink itself, too.
+  if (!RemoveDirectoryW(path.c_str())) {
+    DieWithLastError("RemoveDirectoryW", path);
+  }
+}
+
+// Named so as not to overload the Win32 ReadFile.
+static bool ReadWholeFile(const string& path, string* buffer) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  char chunk[64 * 1024];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof chunk, file)) > 0) {
+    buffer->append(chunk, n);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+class RunfilesCreator {
+ public:
+  explicit RunfilesCreator(const string& output_base)
+      : output_base_(AbsolutePath(Utf8ToWide(output_base))),
+        allow_relative_(false),
+        use_metadata_(false),
+        symlinks_unavailable_(false),
+        symlink_flags_(SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE) {
+    ToBackslashes(&output_base_);
+    SetupOutputBase();
+  }
+
+  void ReadManifest(const string& manifest_file, bool allow_relative,
+                    bool use_metadata) {
+    allow_relative_ = allow_relative;
+    use_metadata_ = use_metadata;
+    if (!ReadWholeFile(manifest_file, &manifest_buffer_)) {
+      DIE("reading '%s': %s", manifest_file.c_str(), strerror(errno));
+    }
+
+    int lineno = 0;
+    for (size_t begin = 0, end; begin < manifest_buffer_.size();
+         begin = end + 1) {
+      end = manifest_buffer_.find('\n', begin);
+      bool terminated = end != string::npos;
+      if (!terminated) {
+        end = manifest_buffer_.size();
+      }
+      ++lineno;
+      // Skip metadata lines. They are used solely for
+      // dependency checking.
+      if (use_metadata_ && lineno % 2 == 0) continue;
+
+      if (!terminated) {
+        DIE("missing terminator at line %d", lineno);
+      }
+
+      string line = manifest_buffer_.substr(begin, end - begin);
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      size_t space = line.find(' ');
+      if (space == string::npos) {
+        DIE("missing field delimiter at line %d: '%s'", lineno, line.c_str());
+      } else if (line.find(' ', space + 1) != string::npos) {
+        DIE("link or target filename contains space on line %d: '%s'", lineno,
+            line.c_str());
+      }
+      wstring link = Utf8ToWide(line.substr(0, space));
+      wstring target = Utf8ToWide(line.substr(space + 1));
+      if (link.empty() || link[0] == L'/' || IsAbsolute(link)) {
+        DIE("paths must not be absolute: line %d: '%s'", lineno, line.c_str());
+      }
+      if (!allow_relative_ && !target.empty() && !IsAbsolute(target)) {
+        DIE("expected absolute path at line %d: '%s'", lineno, line.c_str());
+      }
+      ToBackslashes(&link);
+      ToBackslashes(&target);
+      // A later line for the same link replaces an earlier one.
+      entries_[link] = target;
+    }
+  }
+
+  void CreateRunfiles(int jobs) {
+    const wstring manifest = output_base_ + L"\\MANIFEST";
+    if (!DeleteFileW(manifest.c_str()) &&
+        GetLastError() != ERROR_FILE_NOT_FOUND) {
+      DieWithLastError("DeleteFileW", manifest);
+    }
 
-#include <iostream>
+    std::vector<std::pair<wstring, DWORD> > previous =
+        ListDirectory(output_base_);
+    ParallelFor(previous.size(), jobs, [this, &previous](size_t i) {
+      DeleteTree(output_base_ + L"\\" + previous[i].first,
+                 previous[i].second);
+    });
+
+    // Sorted, so a directory is created before those below it.
+    std::set<wstring> dirs;
+    for (const auto& entry : entries_) {
+      for (size_t slash = entry.first.find(L'\\'); slash != wstring::npos;
+           slash = entry.first.find(L'\\', slash + 1)) {
+        dirs.insert(entry.first.substr(0, slash));
+      }
+    }
+    for (const wstring& dir : dirs) {
+      wstring path = output_base_ + L"\\" + dir;
+      if (!CreateDirectoryW(path.c_str(), nullptr)) {
+        DieWithLastError("CreateDirectoryW", path);
+      }
+    }
+
+    std::vector<const std::pair<const wstring, wstring>*> entries;
+    for (const auto& entry : entries_) {
+      entries.push_back(&entry);
+    }
+    ParallelFor(entries.size(), jobs, [this, &entries](size_t i) {
+      CreateEntry(entries[i]->first, entries[i]->second);
+    });
+
+    // Write the manifest last, so that it is only there if the tree is
+    // complete.
+    const wstring temp_manifest = manifest + L".tmp";
+    HANDLE handle = CreateFileW(temp_manifest.c_str(), GENERIC_WRITE, 0,
+                                nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      DieWithLastError("CreateFileW", temp_manifest);
+    }
+    DWORD written;
+    BOOL ok = WriteFile(handle, manifest_buffer_.data(),
+                        manifest_buffer_.size(), &written, nullptr);
+    CloseHandle(handle);
+    if (!ok || written != manifest_buffer_.size()) {
+      DieWithLastError("WriteFile", temp_manifest);
+    }
+    if (!MoveFileExW(temp_manifest.c_str(), manifest.c_str(),
+                     MOVEFILE_REPLACE_EXISTING)) {
+      DieWithLastError("MoveFileExW", temp_manifest);
+    }
+  }
+
+ private:
+  void SetupOutputBase() {
+    // Create the output base and its parents; CreateDirectoryW only creates
+    // the last component. Only the output base itself must succeed: a parent
+    // may be a drive or a share.
+    size_t root = output_base_.find(L'\\', 4);  // after "\\?\"
+    for (size_t slash = output_base_.find(L'\\', root + 1);;
+         slash = output_base_.find(L'\\', slash + 1)) {
+      wstring dir = output_base_.substr(0, slash);
+      if (!CreateDirectoryW(dir.c_str(), nullptr) &&
+          GetLastError() != ERROR_ALREADY_EXISTS && slash == wstring::npos) {
+        DieWithLastError("CreateDirectoryW", dir);
+      }
+      if (slash == wstring::npos) {
+        break;
+      }
+    }
+  }
+
+  // Creates RUNFILES\"link" for the manifest line "link target".
+  void CreateEntry(const wstring& link, const wstring& target) {
+    const wstring path = output_base_ + L"\\" + link;
+    if (target.empty()) {
+      HANDLE handle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr,
+                                  CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (handle == INVALID_HANDLE_VALUE) {
+        DieWithLastError("CreateFileW", path);
+      }
+      CloseHandle(handle);
+      return;
+    }
+
+    // A relative target is relative to the directory of the link, as for a
+    // symlink.
+    const wstring resolved =
+        IsAbsolute(target)
+            ? target
+            : AbsolutePath(path.substr(0, path.rfind(L'\\') + 1) + target);
+    DWORD attrs = GetFileAttributesW(resolved.c_str());
+    if (attrs != INVALID_FILE_ATTRIBUTES &&
+        (attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+      wstring error = bazel::windows::CreateJunction(path, resolved);
+      if (!error.empty()) {
+        DIE("creating junction '%ls': %ls", path.c_str(), error.c_str());
+      }
+      return;
+    }
+
+    if (!symlinks_unavailable_) {
+      if (CreateSymbolicLinkW(path.c_str(), target.c_str(), symlink_flags_)) {
+        return;
+      }
+      DWORD err = GetLastError();
+      if (err == ERROR_INVALID_PARAMETER &&
+          (symlink_flags_ & SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE)) {
+        // Windows before the Creators Update does not know the flag.
+        symlink_flags_ = 0;
+        CreateEntry(link, target);
+        return;
+      }
+      if (err != ERROR_PRIVILEGE_NOT_HELD) {
+        SetLastError(err);
+        DieWithLastError("CreateSymbolicLinkW", path);
+      }
+      // Neither elevated nor in Developer Mode.
+      symlinks_unavailable_ = true;
+    }
+    if (!CopyFileW(resolved.c_str(), path.c_str(), TRUE)) {
+      DieWithLastError("CopyFileW", resolved);
+    }
+  }
+
+  wstring output_base_;
+  bool allow_relative_;
+  bool use_metadata_;
+  // Set once symlinks turn out not to be available, to copy right away.
+  std::atomic<bool> symlinks_unavailable_;
+  std::atomic<DWORD> symlink_flags_;
+  string manifest_buffer_;
+  // The links to create and their targets, with backslashes.
+  std::map<wstring, wstring> entries_;
+};
 
 int main(int argc, char** argv) {
-  // TODO(bazel-team): decide whether we need build-runfiles at all on Windows.
-  // Implement this program if so; make sure we don't run it on Windows if not.
-  std::cout << "ERROR: build-runfiles is not (yet?) implemented on Windows."
-            << std::endl
-            << "Called with args:" << std::endl;
-  for (int i = 0; i < argc; ++i) {
-    std::cout << "argv[" << i << "]=(" << argv[i] << ")" << std::endl;
-  }
-  return 1;
+  argv0 = argv[0];
+
+  argc--; argv++;
+  bool allow_relative = false;
+  bool use_metadata = false;
+  int jobs = 1;
+
+  while (argc >= 1) {
+    if (strcmp(argv[0], "--allow_relative") == 0) {
+      allow_relative = true;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--use_metadata") == 0) {
+      use_metadata = true;
+      argc--; argv++;
+    } else if (strncmp(argv[0], "--jobs=", 7) == 0) {
+      jobs = atoi(argv[0] + 7);
+      if (jobs < 1) {
+        fprintf(stderr, "%s: --jobs must be a positive number\n", argv0);
+        return 1;
+      }
+      argc--; argv++;
+    } else {
+      break;
+    }
+  }
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s "
+            "[--allow_relative] [--use_metadata] [--jobs=N] "
+            "INPUT RUNFILES\n",
+            argv0);
+    return 1;
+  }
+
+  input_filename = argv[0];
+  output_base_dir = argv[1];
+
+  RunfilesCreator runfiles_creator(output_base_dir);
+  runfiles_creator.ReadManifest(input_filename, allow_relative, use_metadata);
+  runfiles_creator.CreateRunfiles(jobs);
+
+  return 0;
 }
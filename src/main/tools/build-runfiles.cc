@@ -37,6 +37,29 @@
 // If --use_metadata is supplied, every other line is treated as opaque
 // metadata, and is ignored here.
 //
+// With --jobs=N, N threads prune and create the subtrees below the top-level
+// entries of RUNFILES concurrently.
+//
+// With --link_mode=hardlink, an entry with an absolute path to a regular file
+// is created as a hardlink to it if possible, for filesystems where following
+// symlinks is slow. --link_mode=reflink and, on Linux and on macOS (APFS),
+// hardlink mode when a hardlink is not possible create a copy-on-write clone
+// instead. Anything
+// else remains a symlink.
+//
+// With --incremental, the tree is assumed to match RUNFILES/MANIFEST, if there
+// is one, and only the entries that differ from the input manifest are
+// changed. If that assumption turns out to be wrong, the tree is scanned as
+// without --incremental.
+//
+// With --stats=FILE, counts of the entries scanned, kept, removed and created
+// and the time spent in each phase are written to FILE, one "name value" line
+// each.
+//
+// Unless --use_metadata is given, an index of RUNFILES/MANIFEST is written to
+// RUNFILES/MANIFEST.index, for the runfiles libraries to look paths up in
+// without parsing the manifest. See WriteIndex() for its format.
+//
 // All output paths must be relative and generally (but not always) begin with
 // <workspace root>. No output path may be equal to another.  No output path may
 // be a path prefix of another.
@@ -46,15 +69,33 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <map>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <set>
 #include <string>
+#include <vector>
+
+#include "src/main/cpp/util/thread_pool.h"
+#include "src/main/tools/trace.h"
 
 // program_invocation_short_name is not portable.
 static const char *argv0;
@@ -88,12 +129,47 @@ enum FileType {
   FILE_TYPE_SYMLINK
 };
 
+// What --stats reports. The phase times are summed over the --jobs threads.
+struct Stats {
+  std::atomic<uint64_t> scanned;  // entries found in the tree
+  std::atomic<uint64_t> kept;
+  std::atomic<uint64_t> removed;  // including those below removed directories
+  std::atomic<uint64_t> created;
+  std::atomic<uint64_t> read_manifest_nanos;
+  std::atomic<uint64_t> prune_nanos;
+  std::atomic<uint64_t> create_nanos;
+  std::atomic<uint64_t> finish_nanos;  // renaming MANIFEST and writing its index
+
+  Stats()
+      : scanned(0), kept(0), removed(0), created(0), read_manifest_nanos(0),
+        prune_nanos(0), create_nanos(0), finish_nanos(0) {}
+};
+
+static uint64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// How the symlinks of the manifest are put into the tree.
+enum LinkMode {
+  LINK_MODE_SYMLINK,
+  // A hardlink to the target, else a reflink copy, else a symlink.
+  LINK_MODE_HARDLINK,
+  // A reflink copy of the target, else a symlink.
+  LINK_MODE_REFLINK
+};
+
 struct FileInfo {
   FileType type;
-  std::string symlink_target;
+  const char *symlink_target = "";
+  // Whether the entry is already in place in the tree, so that it is not
+  // created again. Only set by the thread handling the entry's subtree.
+  bool exists = false;
 
   bool operator==(const FileInfo &other) const {
-    return type == other.type && symlink_target == other.symlink_target;
+    return type == other.type &&
+           strcmp(symlink_target, other.symlink_target) == 0;
   }
 
   bool operator!=(const FileInfo &other) const {
@@ -101,14 +177,186 @@ struct FileInfo {
   }
 };
 
-typedef std::map<std::string, FileInfo> FileInfoMap;
+// A path in a manifest. It points into the buffer the manifest was read into,
+// and a directory shares the bytes of the paths below it, hence the length.
+struct PathRef {
+  const char *data;
+  size_t size;
+
+  std::string str() const { return std::string(data, size); }
+};
+
+static int ComparePaths(const char *a, size_t a_size, const char *b,
+                        size_t b_size) {
+  int result = memcmp(a, b, a_size < b_size ? a_size : b_size);
+  if (result != 0) {
+    return result;
+  }
+  return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+}
+
+struct ManifestEntry {
+  PathRef path;
+  FileInfo info;
+
+  bool operator<(const ManifestEntry &other) const {
+    return ComparePaths(path.data, path.size, other.path.data,
+                        other.path.size) < 0;
+  }
+};
+
+typedef std::vector<ManifestEntry>::iterator ManifestIterator;
+
+// FNV-1a. Also the hash of RUNFILES/MANIFEST.index, so it must not change.
+static uint64_t HashPath(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The entries of a manifest and their parent directories, sorted by path and
+// indexed by a hash of it.
+class Manifest {
+ public:
+  // Adds the manifest line "link target". Both must outlive the manifest. A
+  // later line for the same link replaces an earlier one.
+  void Add(const char *link, size_t link_size, const char *target) {
+    ManifestEntry entry;
+    entry.path.data = link;
+    entry.path.size = link_size;
+    if (target[0] == '\0') {
+      // No target means an empty file.
+      entry.info.type = FILE_TYPE_REGULAR;
+    } else {
+      entry.info.type = FILE_TYPE_SYMLINK;
+      entry.info.symlink_target = target;
+    }
+    entries_.push_back(entry);
+  }
+
+  // Sorts the entries, adds their parent directories and indexes them. To be
+  // called once, after the last Add().
+  void Finish() {
+    // Keep the last line for each link.
+    std::stable_sort(entries_.begin(), entries_.end());
+    size_t count = 0;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (i + 1 < entries_.size() && !(entries_[i] < entries_[i + 1])) {
+        continue;
+      }
+      entries_[count++] = entries_[i];
+    }
+    entries_.resize(count);
+
+    // In sorted order, the paths below a directory are adjacent, so a parent
+    // is new unless it is a parent of the previous path as well: unless it
+    // ends within their common prefix.
+    ManifestEntry dir;
+    dir.info.type = FILE_TYPE_DIRECTORY;
+    PathRef previous = {"", 0};
+    for (size_t i = 0; i < count; ++i) {
+      // A copy, as entries_ grows below.
+      const PathRef path = entries_[i].path;
+      size_t common = 0;
+      while (common < path.size && common < previous.size &&
+             path.data[common] == previous.data[common]) {
+        ++common;
+      }
+      for (size_t k = common; k < path.size; ++k) {
+        if (path.data[k] == '/') {
+          dir.path.data = path.data;
+          dir.path.size = k;
+          entries_.push_back(dir);
+        }
+      }
+      previous = path;
+    }
+
+    // A line for a parent directory wins over the directory, as it is
+    // sorted first; creating what is below it then fails.
+    std::stable_sort(entries_.begin(), entries_.end());
+    entries_.erase(std::unique(entries_.begin(), entries_.end(),
+                               [](const ManifestEntry &a,
+                                  const ManifestEntry &b) { return !(a < b); }),
+                   entries_.end());
+
+    size_t buckets = 16;
+    while (buckets < 2 * entries_.size()) {
+      buckets *= 2;
+    }
+    index_.assign(buckets, 0);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      size_t bucket = HashPath(entries_[i].path.data, entries_[i].path.size);
+      while (index_[bucket & (buckets - 1)] != 0) {
+        ++bucket;
+      }
+      index_[bucket & (buckets - 1)] = i + 1;
+    }
+  }
+
+  ManifestIterator begin() { return entries_.begin(); }
+  ManifestIterator end() { return entries_.end(); }
+
+  // Returns the entry for "path", or end() if there is none.
+  ManifestIterator Find(const char *path, size_t size) {
+    size_t mask = index_.size() - 1;
+    for (size_t bucket = HashPath(path, size); index_[bucket & mask] != 0;
+         ++bucket) {
+      ManifestIterator it = entries_.begin() + (index_[bucket & mask] - 1);
+      if (ComparePaths(it->path.data, it->path.size, path, size) == 0) {
+        return it;
+      }
+    }
+    return entries_.end();
+  }
+
+  ManifestIterator Find(const std::string &path) {
+    return Find(path.data(), path.size());
+  }
+
+  // Returns the first entry whose path does not sort before "path".
+  ManifestIterator LowerBound(const std::string &path) {
+    ManifestEntry key;
+    key.path.data = path.data();
+    key.path.size = path.size();
+    return std::lower_bound(entries_.begin(), entries_.end(), key);
+  }
+
+ private:
+  std::vector<ManifestEntry> entries_;
+  // Open addressing over entries_: an entry's index plus one, or 0 if empty.
+  std::vector<uint32_t> index_;
+};
+
+// Reads the file at "path" into "buffer". Returns false and leaves errno set
+// on failure.
+static bool ReadFile(const std::string &path, std::string *buffer) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (!file) {
+    return false;
+  }
+  char chunk[64 * 1024];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof chunk, file)) > 0) {
+    buffer->append(chunk, n);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
 
 class RunfilesCreator {
  public:
   explicit RunfilesCreator(const std::string &output_base)
       : output_base_(output_base),
         output_filename_("MANIFEST"),
-        temp_filename_(output_filename_ + ".tmp") {
+        temp_filename_(output_filename_ + ".tmp"),
+        index_filename_(output_filename_ + ".index"),
+        allow_relative_(false),
+        use_metadata_(false),
+        link_mode_(LINK_MODE_SYMLINK) {
     SetupOutputBase();
     if (chdir(output_base_.c_str()) != 0) {
       PDIE("chdir '%s'", output_base_.c_str());
@@ -117,101 +365,342 @@ class RunfilesCreator {
 
   void ReadManifest(const std::string &manifest_file, bool allow_relative,
                     bool use_metadata) {
+    uint64_t start = NowNanos();
+    allow_relative_ = allow_relative;
+    use_metadata_ = use_metadata;
+    if (!ReadFile(manifest_file, &manifest_buffer_)) {
+      PDIE("reading '%s'", manifest_file.c_str());
+    }
+
+    // copy input manifest to output manifest
     FILE *outfile = fopen(temp_filename_.c_str(), "w");
     if (!outfile) {
       PDIE("opening '%s/%s' for writing", output_base_.c_str(),
            temp_filename_.c_str());
     }
-    FILE *infile = fopen(manifest_file.c_str(), "r");
-    if (!infile) {
-      PDIE("opening '%s' for reading", manifest_file.c_str());
+    if (fwrite(manifest_buffer_.data(), 1, manifest_buffer_.size(), outfile) !=
+            manifest_buffer_.size() ||
+        fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(),
+           temp_filename_.c_str());
+    }
+
+    ParseManifest(&manifest_buffer_, true, &manifest_);
+    // Don't delete the temp manifest file.
+    manifest_.Add(temp_filename_.data(), temp_filename_.size(), "");
+    manifest_.Finish();
+    stats_.read_manifest_nanos += NowNanos() - start;
+  }
+
+  // Writes what --stats reports to "path".
+  void WriteStats(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+      PDIE("opening '%s' for writing", path);
+    }
+    fprintf(file,
+            "entries_scanned %" PRIu64 "\n"
+            "entries_kept %" PRIu64 "\n"
+            "entries_removed %" PRIu64 "\n"
+            "entries_created %" PRIu64 "\n"
+            "read_manifest_ms %.3f\n"
+            "prune_ms %.3f\n"
+            "create_ms %.3f\n"
+            "finish_ms %.3f\n",
+            stats_.scanned.load(), stats_.kept.load(), stats_.removed.load(),
+            stats_.created.load(), stats_.read_manifest_nanos / 1e6,
+            stats_.prune_nanos / 1e6, stats_.create_nanos / 1e6,
+            stats_.finish_nanos / 1e6);
+    if (fclose(file) != 0) {
+      PDIE("writing to '%s'", path);
+    }
+  }
+
+  void CreateRunfiles(int jobs, bool incremental, LinkMode link_mode) {
+    link_mode_ = link_mode;
+    // The tree matches the previous manifest only if that made it into place,
+    // so read it before removing it. Should we fail below, the next run does a
+    // full scan.
+    uint64_t start = NowNanos();
+    std::string previous_buffer;
+    Manifest previous_manifest;
+    bool done = incremental &&
+                ReadPreviousManifest(&previous_buffer, &previous_manifest);
+    stats_.read_manifest_nanos += NowNanos() - start;
+    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           output_filename_.c_str());
+    }
+    if (unlink(index_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           index_filename_.c_str());
+    }
+    if (done) {
+      done = UpdateFromPreviousManifest(&previous_manifest);
+    }
+    if (!done) {
+      ScanAndCreate(jobs);
+    }
+
+    // rename output file into place
+    start = NowNanos();
+    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'",
+           output_base_.c_str(), temp_filename_.c_str(),
+           output_base_.c_str(), output_filename_.c_str());
+    }
+    if (!use_metadata_) {
+      WriteIndex();
     }
+    stats_.finish_nanos += NowNanos() - start;
+  }
 
-    // read input manifest
+ private:
+  // Writes RUNFILES/MANIFEST.index, an open-addressing hash table of the lines
+  // of RUNFILES/MANIFEST keyed by the HashPath() of their link:
+  //
+  //   char magic[8];                // "RFINDEX1"
+  //   uint64_t manifest_size;       // of RUNFILES/MANIFEST
+  //   int64_t manifest_mtime_sec;   // likewise
+  //   int64_t manifest_mtime_nsec;  // likewise
+  //   uint64_t bucket_count;        // a power of 2
+  //   uint32_t buckets[bucket_count];  // offset of a line plus 1; 0 if empty
+  //
+  // in native byte order. A reader ignores the index unless the manifest
+  // still has the recorded size and mtime. Only the last line for a link is
+  // indexed, as only that one counts.
+  void WriteIndex() {
+    struct stat st;
+    if (stat(output_filename_.c_str(), &st) != 0) {
+      PDIE("stat '%s/%s'", output_base_.c_str(), output_filename_.c_str());
+    }
+    if (manifest_buffer_.size() >= UINT32_MAX) {
+      return;  // the offsets would not fit
+    }
+
+    const char *data = manifest_buffer_.data();
+    const char *data_end = data + manifest_buffer_.size();
+    std::vector<uint32_t> lines;
+    for (ManifestIterator it = manifest_.begin(); it != manifest_.end(); ++it) {
+      // Skip the parent directories and MANIFEST.tmp, which have no line.
+      if (it->info.type != FILE_TYPE_DIRECTORY && it->path.data >= data &&
+          it->path.data < data_end) {
+        lines.push_back(it->path.data - data);
+      }
+    }
+    uint64_t buckets = 16;
+    while (buckets < 2 * lines.size()) {
+      buckets *= 2;
+    }
+    std::vector<uint32_t> table(buckets, 0);
+    for (uint32_t offset : lines) {
+      uint64_t bucket = HashPath(data + offset, strlen(data + offset));
+      while (table[bucket & (buckets - 1)] != 0) {
+        ++bucket;
+      }
+      table[bucket & (buckets - 1)] = offset + 1;
+    }
+
+    struct {
+      char magic[8];
+      uint64_t manifest_size;
+      int64_t manifest_mtime_sec;
+      int64_t manifest_mtime_nsec;
+      uint64_t bucket_count;
+    } header;
+    memcpy(header.magic, "RFINDEX1", sizeof header.magic);
+    header.manifest_size = st.st_size;
+    header.manifest_mtime_sec = st.st_mtim.tv_sec;
+    header.manifest_mtime_nsec = st.st_mtim.tv_nsec;
+    header.bucket_count = buckets;
+
+    std::string temp_filename = index_filename_ + ".tmp";
+    FILE *outfile = fopen(temp_filename.c_str(), "w");
+    if (!outfile) {
+      PDIE("opening '%s/%s' for writing", output_base_.c_str(),
+           temp_filename.c_str());
+    }
+    if (fwrite(&header, sizeof header, 1, outfile) != 1 ||
+        fwrite(table.data(), sizeof table[0], buckets, outfile) != buckets ||
+        fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(), temp_filename.c_str());
+    }
+    if (rename(temp_filename.c_str(), index_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'", output_base_.c_str(),
+           temp_filename.c_str(), output_base_.c_str(),
+           index_filename_.c_str());
+    }
+  }
+
+  // Parses the manifest in "buffer" into "manifest", turning the line ends and
+  // field delimiters into NULs. If it is malformed, dies if "strict" is true,
+  // and returns false otherwise.
+  bool ParseManifest(std::string *buffer, bool strict, Manifest *manifest) {
+#define PARSE_ERROR(args...) { \
+  if (strict) DIE(args); \
+  return false; \
+}
+    char *buf = &(*buffer)[0];
+    char *end = buf + buffer->size();
     int lineno = 0;
-    char buf[3 * PATH_MAX];
-    while (fgets(buf, sizeof buf, infile)) {
-      // copy line to output manifest
-      if (fputs(buf, outfile) == EOF) {
-        PDIE("writing to '%s/%s'", output_base_.c_str(),
-             temp_filename_.c_str());
+    for (char *next; buf < end; buf = next) {
+      char *eol = static_cast<char *>(memchr(buf, '\n', end - buf));
+      if (eol == nullptr) {
+        eol = end;  // the NUL std::string keeps after its contents
+        next = end;
+      } else {
+        next = eol + 1;
       }
 
       // parse line
       ++lineno;
       // Skip metadata lines. They are used solely for
       // dependency checking.
-      if (use_metadata && lineno % 2 == 0) continue;
+      if (use_metadata_ && lineno % 2 == 0) continue;
 
-      int n = strlen(buf)-1;
-      if (!n || buf[n] != '\n') {
-        DIE("missing terminator at line %d: '%s'\n", lineno, buf);
+      if (eol == buf || *eol != '\n') {
+        PARSE_ERROR("missing terminator at line %d: '%s'\n", lineno, buf);
       }
-      buf[n] = '\0';
+      *eol = '\0';
       if (buf[0] ==  '/') {
-        DIE("paths must not be absolute: line %d: '%s'\n", lineno, buf);
+        PARSE_ERROR("paths must not be absolute: line %d: '%s'\n", lineno,
+                    buf);
       }
-      const char *s = strchr(buf, ' ');
+      char *s = strchr(buf, ' ');
       if (!s) {
-        DIE("missing field delimiter at line %d: '%s'\n", lineno, buf);
+        PARSE_ERROR("missing field delimiter at line %d: '%s'\n", lineno, buf);
       } else if (strchr(s+1, ' ')) {
-        DIE("link or target filename contains space on line %d: '%s'\n",
-            lineno, buf);
+        PARSE_ERROR("link or target filename contains space on line %d: '%s'\n",
+                    lineno, buf);
       }
-      std::string link(buf, s-buf);
       const char *target = s+1;
-      if (!allow_relative && target[0] != '\0' && target[0] != '/'
+      if (!allow_relative_ && target[0] != '\0' && target[0] != '/'
           && target[1] != ':') {  // Match Windows paths, e.g. C:\foo or C:/foo.
-        DIE("expected absolute path at line %d: '%s'\n", lineno, buf);
+        PARSE_ERROR("expected absolute path at line %d: '%s'\n", lineno, buf);
       }
 
-      FileInfo *info = &manifest_[link];
-      if (target[0] == '\0') {
-        // No target means an empty file.
-        info->type = FILE_TYPE_REGULAR;
-      } else {
-        info->type = FILE_TYPE_SYMLINK;
-        info->symlink_target = target;
-      }
+      *s = '\0';
+      manifest->Add(buf, s-buf, target);
+    }
+    return true;
+#undef PARSE_ERROR
+  }
 
-      FileInfo parent_info;
-      parent_info.type = FILE_TYPE_DIRECTORY;
+  // Reads RUNFILES/MANIFEST as we left it into "buffer", which
+  // "previous_manifest" then points into. Returns false if there is none or
+  // it is malformed.
+  bool ReadPreviousManifest(std::string *buffer, Manifest *previous_manifest) {
+    if (!ReadFile(output_filename_, buffer)) {
+      return false;
+    }
+    if (!ParseManifest(buffer, false, previous_manifest)) {
+      fprintf(stderr, "%s: ignoring malformed '%s/%s'\n", argv0,
+              output_base_.c_str(), output_filename_.c_str());
+      return false;
+    }
+    // ReadManifest already wrote the temp manifest file.
+    previous_manifest->Add(temp_filename_.data(), temp_filename_.size(), "");
+    previous_manifest->Finish();
+    return true;
+  }
 
-      while (true) {
-        int k = link.rfind('/');
-        if (k < 0) break;
-        link.erase(k, std::string::npos);
-        if (!manifest_.insert(std::make_pair(link, parent_info)).second) break;
+  // Turns the tree from "previous_manifest" into manifest_ by merging the
+  // two: removes the entries that went away or changed, deepest first, then
+  // creates the new and changed ones, parents first. Returns false if the
+  // tree turned out not to match "previous_manifest"; it then needs a full
+  // scan.
+  bool UpdateFromPreviousManifest(Manifest *previous_manifest) {
+    uint64_t start = NowNanos();
+    for (ManifestIterator it = previous_manifest->end();
+         it != previous_manifest->begin();) {
+      --it;
+      ManifestIterator expected_it =
+          manifest_.Find(it->path.data, it->path.size);
+      if (expected_it != manifest_.end() && expected_it->info == it->info) {
+        continue;
       }
+      const std::string path = it->path.str();
+      int err = it->info.type == FILE_TYPE_DIRECTORY ? rmdir(path.c_str())
+                                                     : unlink(path.c_str());
+      if (err != 0) {
+        fprintf(stderr, "%s: removing '%s/%s': %s; scanning the tree\n",
+                argv0, output_base_.c_str(), path.c_str(), strerror(errno));
+        return false;
+      }
+      ++stats_.removed;
     }
-    if (fclose(outfile) != 0) {
-      PDIE("writing to '%s/%s'", output_base_.c_str(),
-           temp_filename_.c_str());
-    }
-    fclose(infile);
+    stats_.prune_nanos += NowNanos() - start;
 
-    // Don't delete the temp manifest file.
-    manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
+    start = NowNanos();
+    for (ManifestIterator it = manifest_.begin(); it != manifest_.end();
+         ++it) {
+      ManifestIterator previous_it =
+          previous_manifest->Find(it->path.data, it->path.size);
+      const std::string path = it->path.str();
+      if (previous_it != previous_manifest->end() &&
+          previous_it->info == it->info) {
+        // A hardlink or copy goes stale when its target is replaced.
+        if (link_mode_ == LINK_MODE_SYMLINK ||
+            it->info.type != FILE_TYPE_SYMLINK || !IsStale(path, it->info)) {
+          ++stats_.kept;
+          continue;
+        }
+        if (unlink(path.c_str()) != 0) {
+          fprintf(stderr, "%s: removing '%s/%s': %s; scanning the tree\n",
+                  argv0, output_base_.c_str(), path.c_str(), strerror(errno));
+          return false;
+        }
+        ++stats_.removed;
+      }
+      if (!CreateEntry(AT_FDCWD, path.c_str(), it->info)) {
+        fprintf(stderr, "%s: creating '%s/%s': %s; scanning the tree\n",
+                argv0, output_base_.c_str(), path.c_str(), strerror(errno));
+        return false;
+      }
+      ++stats_.created;
+    }
+    stats_.create_nanos += NowNanos() - start;
+    return true;
   }
 
-  void CreateRunfiles() {
-    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
-      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
-           output_filename_.c_str());
-    }
+  void ScanAndCreate(int jobs) {
 
-    ScanTreeAndPrune(".");
-    CreateFiles();
+    // Every top-level entry, either on disk or in the manifest, is a subtree
+    // that can be pruned and created independently of the others.
+    std::set<std::string> subtrees;
+    DIR *dh = opendir(".");
+    if (!dh) {
+      PDIE("opendir '%s'", output_base_.c_str());
+    }
+    struct dirent *entry;
+    errno = 0;
+    while ((entry = readdir(dh)) != nullptr) {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+      subtrees.insert(entry->d_name);
+      errno = 0;
+    }
+    if (errno != 0) {
+      PDIE("reading directory '%s'", output_base_.c_str());
+    }
+    closedir(dh);
+    for (ManifestIterator it = manifest_.begin(); it != manifest_.end();
+         ++it) {
+      if (memchr(it->path.data, '/', it->path.size) == nullptr) {
+        subtrees.insert(it->path.str());
+      }
+    }
 
-    // rename output file into place
-    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
-      PDIE("renaming '%s/%s' to '%s/%s'",
-           output_base_.c_str(), temp_filename_.c_str(),
-           output_base_.c_str(), output_filename_.c_str());
+    std::vector<std::string> tasks(subtrees.begin(), subtrees.end());
+    // This thread is one of the jobs.
+    std::unique_ptr<blaze_util::ThreadPool> pool;
+    if (jobs > 1) {
+      pool.reset(new blaze_util::ThreadPool(jobs - 1, 1));
     }
+    blaze_util::ParallelFor(
+        pool.get(), tasks.size(), jobs,
+        [this, &tasks](size_t i) { PruneAndCreateSubtree(tasks[i]); });
   }
 
- private:
   void SetupOutputBase() {
     struct stat st;
     if (stat(output_base_.c_str(), &st) != 0) {
@@ -221,55 +710,102 @@ class RunfilesCreator {
         PDIE("creating directory '%s'", output_base_.c_str());
       }
     } else {
-      EnsureDirReadAndWritePerms(output_base_);
+      EnsureDirReadAndWritePerms(AT_FDCWD, output_base_, output_base_);
     }
   }
 
-  void ScanTreeAndPrune(const std::string &path) {
+  // Brings the top-level entry "name" and everything below it in line with
+  // the manifest. Only touches the manifest entries of that subtree, so that
+  // several subtrees can be handled concurrently.
+  void PruneAndCreateSubtree(const std::string &name) {
+    uint64_t start = NowNanos();
+    struct stat st;
+    if (fstatat(AT_FDCWD, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+      FileInfo actual_info;
+      std::string actual_target;
+      actual_info.type = StatToFileType(st);
+      if (actual_info.type == FILE_TYPE_SYMLINK) {
+        ReadLinkOrDie(AT_FDCWD, name, name, &actual_target);
+        actual_info.symlink_target = actual_target.c_str();
+      }
+      PruneOrKeep(AT_FDCWD, name, name, actual_info);
+    } else if (errno != ENOENT) {
+      PDIE("lstating file '%s'", name.c_str());
+    }
+    uint64_t pruned = NowNanos();
+    stats_.prune_nanos += pruned - start;
+
+    ManifestIterator it = manifest_.Find(name);
+    if (it != manifest_.end()) {
+      CreateFiles(it, it + 1);
+    }
+    // The entries below "name" sort between "name/" and "name0", as '0'
+    // follows '/'.
+    CreateFiles(manifest_.LowerBound(name + '/'),
+                manifest_.LowerBound(name + '0'));
+    stats_.create_nanos += NowNanos() - pruned;
+  }
+
+  // Deletes the on-disk entry "name" in "dir_fd", at "path" in the tree, if it
+  // does not match the manifest. Otherwise, marks the manifest entry as
+  // existing and, for a directory, scans it.
+  void PruneOrKeep(int dir_fd, const std::string &name, const std::string &path,
+                   const FileInfo &actual_info) {
+    ++stats_.scanned;
+    ManifestIterator expected_it = manifest_.Find(path);
+    if (expected_it == manifest_.end() ||
+        (expected_it->info != actual_info &&
+         !IsMaterialized(dir_fd, name, path, actual_info,
+                         expected_it->info))) {
+#if !defined(__CYGWIN__)
+      DelTree(dir_fd, name, path, actual_info.type);
+#else
+      // On Windows, if deleting failed, lamely assume that
+      // the link points to the right place.
+      if (!DelTree(dir_fd, name, path, actual_info.type) &&
+          expected_it != manifest_.end()) {
+        expected_it->info.exists = true;
+      }
+#endif
+    } else {
+      expected_it->info.exists = true;
+      ++stats_.kept;
+      if (actual_info.type == FILE_TYPE_DIRECTORY) {
+        ScanTreeAndPrune(OpenDirOrDie(dir_fd, name, path), path);
+      }
+    }
+  }
+
+  // Scans the directory at "path" in the tree, which "dir_fd" is open on, and
+  // takes over "dir_fd".
+  void ScanTreeAndPrune(int dir_fd, const std::string &path) {
     // A note on non-empty files:
     // We don't distinguish between empty and non-empty files. That is, if
     // there's a file that has contents, we don't truncate it here, even though
     // the manifest supports creation of empty files, only. Given that
     // .runfiles are *supposed* to be immutable, this shouldn't be a problem.
-    EnsureDirReadAndWritePerms(path);
-
     struct dirent *entry;
-    DIR *dh = opendir(path.c_str());
+    DIR *dh = fdopendir(dir_fd);
     if (!dh) {
       PDIE("opendir '%s'", path.c_str());
     }
 
     errno = 0;
-    const std::string prefix = (path == "." ? "" : path + "/");
+    const std::string prefix = path + "/";
     while ((entry = readdir(dh)) != nullptr) {
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
 
       std::string entry_path = prefix + entry->d_name;
       FileInfo actual_info;
-      actual_info.type = DentryToFileType(entry_path, entry);
+      std::string actual_target;
+      actual_info.type = DentryToFileType(dir_fd, entry_path, entry);
 
       if (actual_info.type == FILE_TYPE_SYMLINK) {
-        ReadLinkOrDie(entry_path, &actual_info.symlink_target);
+        ReadLinkOrDie(dir_fd, entry->d_name, entry_path, &actual_target);
+        actual_info.symlink_target = actual_target.c_str();
       }
 
-      FileInfoMap::iterator expected_it = manifest_.find(entry_path);
-      if (expected_it == manifest_.end() ||
-          expected_it->second != actual_info) {
-#if !defined(__CYGWIN__)
-        DelTree(entry_path, actual_info.type);
-#else
-        // On Windows, if deleting failed, lamely assume that
-        // the link points to the right place.
-        if (!DelTree(entry_path, actual_info.type)) {
-          manifest_.erase(expected_it);
-        }
-#endif
-      } else {
-        manifest_.erase(expected_it);
-        if (actual_info.type == FILE_TYPE_DIRECTORY) {
-          ScanTreeAndPrune(entry_path);
-        }
-      }
+      PruneOrKeep(dir_fd, entry->d_name, entry_path, actual_info);
 
       errno = 0;
     }
@@ -279,38 +815,179 @@ class RunfilesCreator {
     closedir(dh);
   }
 
-  void CreateFiles() {
-    for (FileInfoMap::const_iterator it = manifest_.begin();
-         it != manifest_.end(); ++it) {
-      const std::string &path = it->first;
-      switch (it->second.type) {
-        case FILE_TYPE_DIRECTORY:
-          if (mkdir(path.c_str(), 0777) != 0) {
+  // Creates the entries in [begin, end) that are not there yet, relative to
+  // their parent directory, which is opened once for a run of siblings.
+  void CreateFiles(ManifestIterator begin, ManifestIterator end) {
+    std::string parent = ".";
+    int parent_fd = AT_FDCWD;
+    for (ManifestIterator it = begin; it != end; ++it) {
+      if (it->info.exists) {
+        continue;
+      }
+      const std::string path = it->path.str();
+      size_t k = path.rfind('/');
+      std::string dir = k == std::string::npos ? "." : path.substr(0, k);
+      if (dir != parent) {
+        if (parent_fd != AT_FDCWD) {
+          close(parent_fd);
+        }
+        parent_fd = OpenDirOrDie(AT_FDCWD, dir, dir);
+        parent.swap(dir);
+      }
+      const char *name = path.c_str() + (k == std::string::npos ? 0 : k + 1);
+
+      if (CreateEntry(parent_fd, name, it->info)) {
+        ++stats_.created;
+      } else {
+        switch (it->info.type) {
+          case FILE_TYPE_DIRECTORY:
             PDIE("mkdir '%s'", path.c_str());
-          }
-          break;
-        case FILE_TYPE_REGULAR:
-          {
-            int fd = open(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0555);
-            if (fd < 0) {
-              PDIE("creating empty file '%s'", path.c_str());
-            }
-            close(fd);
-          }
-          break;
-        case FILE_TYPE_SYMLINK:
-          {
-            const std::string& target = it->second.symlink_target;
-            if (symlink(target.c_str(), path.c_str()) != 0) {
-              PDIE("symlinking '%s' -> '%s'", path.c_str(), target.c_str());
-            }
-          }
-          break;
+          case FILE_TYPE_REGULAR:
+            PDIE("creating empty file '%s'", path.c_str());
+          case FILE_TYPE_SYMLINK:
+            PDIE("symlinking '%s' -> '%s'", path.c_str(),
+                 it->info.symlink_target);
+        }
       }
     }
+    if (parent_fd != AT_FDCWD) {
+      close(parent_fd);
+    }
+  }
+
+  // Creates "name" in "dir_fd" as "info" describes. Returns false and leaves
+  // errno set on failure.
+  bool CreateEntry(int dir_fd, const char *name, const FileInfo &info) {
+    switch (info.type) {
+      case FILE_TYPE_DIRECTORY:
+        return mkdirat(dir_fd, name, 0777) == 0;
+      case FILE_TYPE_REGULAR:
+        {
+          int fd = openat(dir_fd, name, O_CREAT|O_EXCL|O_WRONLY, 0555);
+          if (fd < 0) {
+            return false;
+          }
+          close(fd);
+          return true;
+        }
+      case FILE_TYPE_SYMLINK:
+        if (Materialize(dir_fd, name, info.symlink_target)) {
+          return true;
+        }
+        return symlinkat(info.symlink_target, dir_fd, name) == 0;
+    }
+    return false;
+  }
+
+  // Creates "name" in "dir_fd" as a hardlink to or a reflink copy of "target",
+  // as link_mode_ asks for. Returns false, having created nothing, if that is
+  // not possible: for symlinks, for relative targets, for anything but a
+  // regular file, or across filesystems.
+  bool Materialize(int dir_fd, const char *name, const char *target) {
+    struct stat st;
+    if (link_mode_ == LINK_MODE_SYMLINK || target[0] != '/' ||
+        stat(target, &st) != 0 || !S_ISREG(st.st_mode)) {
+      return false;
+    }
+    if (link_mode_ == LINK_MODE_HARDLINK &&
+        linkat(AT_FDCWD, target, dir_fd, name, AT_SYMLINK_FOLLOW) == 0) {
+      return true;
+    }
+#ifdef FICLONE
+    int src_fd = open(target, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+      return false;
+    }
+    int fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                    st.st_mode & 07777);
+    if (fd < 0) {
+      close(src_fd);
+      return false;
+    }
+    // The copy gets the target's mtime, so that IsMaterialized recognizes it.
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    bool ok = ioctl(fd, FICLONE, src_fd) == 0 && futimens(fd, times) == 0;
+    close(fd);
+    close(src_fd);
+    if (!ok) {
+      unlinkat(dir_fd, name, 0);
+    }
+    return ok;
+#elif defined(__APPLE__)
+    int src_fd = open(target, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+      return false;
+    }
+    // The clone gets the target's mode. It also gets the target's mtime, so
+    // that IsMaterialized recognizes it.
+    struct timespec times[2] = {st.st_atimespec, st.st_mtimespec};
+    bool ok = fclonefileat(src_fd, dir_fd, name, 0) == 0;
+    close(src_fd);
+    if (ok && utimensat(dir_fd, name, times, AT_SYMLINK_NOFOLLOW) != 0) {
+      unlinkat(dir_fd, name, 0);
+      ok = false;
+    }
+    return ok;
+#else
+    return false;
+#endif
+  }
+
+  // Returns whether the entry at "path" is a hardlink or copy that no longer
+  // matches "info".
+  bool IsStale(const std::string &path, const FileInfo &info) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      return false;
+    }
+    FileInfo actual_info;
+    actual_info.type = FILE_TYPE_REGULAR;
+    return !IsMaterialized(AT_FDCWD, path, path, actual_info, info);
   }
 
-  FileType DentryToFileType(const std::string &path, struct dirent *ent) {
+  // Returns whether "actual_info" of "name" in "dir_fd", at "path" in the
+  // tree, is what Materialize makes of "expected_info".
+  bool IsMaterialized(int dir_fd, const std::string &name,
+                      const std::string &path, const FileInfo &actual_info,
+                      const FileInfo &expected_info) {
+    const char *target = expected_info.symlink_target;
+    struct stat target_st;
+    if (link_mode_ == LINK_MODE_SYMLINK ||
+        actual_info.type != FILE_TYPE_REGULAR ||
+        expected_info.type != FILE_TYPE_SYMLINK || target[0] != '/' ||
+        stat(target, &target_st) != 0) {
+      return false;
+    }
+    struct stat st;
+    LStatOrDie(dir_fd, name, path, &st);
+    if (st.st_dev == target_st.st_dev && st.st_ino == target_st.st_ino) {
+      return true;
+    }
+#if defined(FICLONE)
+    return st.st_size == target_st.st_size &&
+           st.st_mtim.tv_sec == target_st.st_mtim.tv_sec &&
+           st.st_mtim.tv_nsec == target_st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    return st.st_size == target_st.st_size &&
+           st.st_mtimespec.tv_sec == target_st.st_mtimespec.tv_sec &&
+           st.st_mtimespec.tv_nsec == target_st.st_mtimespec.tv_nsec;
+#else
+    return false;
+#endif
+  }
+
+  FileType StatToFileType(const struct stat &st) {
+    if (S_ISDIR(st.st_mode)) {
+      return FILE_TYPE_DIRECTORY;
+    } else if (S_ISLNK(st.st_mode)) {
+      return FILE_TYPE_SYMLINK;
+    } else {
+      return FILE_TYPE_REGULAR;
+    }
+  }
+
+  FileType DentryToFileType(int dir_fd, const std::string &path,
+                            struct dirent *ent) {
 #ifdef _DIRENT_HAVE_D_TYPE
     if (ent->d_type != DT_UNKNOWN) {
       if (ent->d_type == DT_DIR) {
@@ -324,32 +1001,23 @@ class RunfilesCreator {
 #endif
     {
       struct stat st;
-      LStatOrDie(path, &st);
-      if (S_ISDIR(st.st_mode)) {
-        return FILE_TYPE_DIRECTORY;
-      } else if (S_ISLNK(st.st_mode)) {
-        return FILE_TYPE_SYMLINK;
-      } else {
-        return FILE_TYPE_REGULAR;
-      }
+      LStatOrDie(dir_fd, ent->d_name, path, &st);
+      return StatToFileType(st);
     }
   }
 
-  void LStatOrDie(const std::string &path, struct stat *st) {
-    if (lstat(path.c_str(), st) != 0) {
+  void LStatOrDie(int dir_fd, const std::string &name, const std::string &path,
+                  struct stat *st) {
+    if (fstatat(dir_fd, name.c_str(), st, AT_SYMLINK_NOFOLLOW) != 0) {
       PDIE("lstating file '%s'", path.c_str());
     }
   }
 
-  void StatOrDie(const std::string &path, struct stat *st) {
-    if (stat(path.c_str(), st) != 0) {
-      PDIE("stating file '%s'", path.c_str());
-    }
-  }
-
-  void ReadLinkOrDie(const std::string &path, std::string *output) {
+  void ReadLinkOrDie(int dir_fd, const std::string &name,
+                     const std::string &path, std::string *output) {
     char readlink_buffer[PATH_MAX];
-    int sz = readlink(path.c_str(), readlink_buffer, sizeof(readlink_buffer));
+    int sz = readlinkat(dir_fd, name.c_str(), readlink_buffer,
+                        sizeof(readlink_buffer));
     if (sz < 0) {
       PDIE("reading symlink '%s'", path.c_str());
     }
@@ -357,33 +1025,48 @@ class RunfilesCreator {
     std::string(readlink_buffer, sz).swap(*output);
   }
 
-  void EnsureDirReadAndWritePerms(const std::string &path) {
+  void EnsureDirReadAndWritePerms(int dir_fd, const std::string &name,
+                                  const std::string &path) {
     const int kMode = 0700;
     struct stat st;
-    LStatOrDie(path, &st);
+    LStatOrDie(dir_fd, name, path, &st);
     if ((st.st_mode & kMode) != kMode) {
       int new_mode = st.st_mode | kMode;
-      if (chmod(path.c_str(), new_mode) != 0) {
+      if (fchmodat(dir_fd, name.c_str(), new_mode, 0) != 0) {
         PDIE("chmod '%s'", path.c_str());
       }
     }
   }
 
-  bool DelTree(const std::string &path, FileType file_type) {
+  // Opens the directory "name" in "dir_fd", at "path" in the tree, making sure
+  // that we can list and change it first.
+  int OpenDirOrDie(int dir_fd, const std::string &name,
+                   const std::string &path) {
+    EnsureDirReadAndWritePerms(dir_fd, name, path);
+    int fd = openat(dir_fd, name.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+      PDIE("opendir '%s'", path.c_str());
+    }
+    return fd;
+  }
+
+  bool DelTree(int dir_fd, const std::string &name, const std::string &path,
+               FileType file_type) {
     if (file_type != FILE_TYPE_DIRECTORY) {
-      if (unlink(path.c_str()) != 0) {
+      if (unlinkat(dir_fd, name.c_str(), 0) != 0) {
 #if !defined(__CYGWIN__)
         PDIE("unlinking '%s'", path.c_str());
 #endif
         return false;
       }
+      ++stats_.removed;
       return true;
     }
 
-    EnsureDirReadAndWritePerms(path);
-
+    int fd = OpenDirOrDie(dir_fd, name, path);
     struct dirent *entry;
-    DIR *dh = opendir(path.c_str());
+    DIR *dh = fdopendir(fd);
     if (!dh) {
       PDIE("opendir '%s'", path.c_str());
     }
@@ -391,17 +1074,18 @@ class RunfilesCreator {
     while ((entry = readdir(dh)) != nullptr) {
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
       const std::string entry_path = path + '/' + entry->d_name;
-      FileType entry_file_type = DentryToFileType(entry_path, entry);
-      DelTree(entry_path, entry_file_type);
+      FileType entry_file_type = DentryToFileType(fd, entry_path, entry);
+      DelTree(fd, entry->d_name, entry_path, entry_file_type);
       errno = 0;
     }
     if (errno != 0) {
       PDIE("readdir '%s'", path.c_str());
     }
     closedir(dh);
-    if (rmdir(path.c_str()) != 0) {
+    if (unlinkat(dir_fd, name.c_str(), AT_REMOVEDIR) != 0) {
       PDIE("rmdir '%s'", path.c_str());
     }
+    ++stats_.removed;
     return true;
   }
 
@@ -409,8 +1093,15 @@ class RunfilesCreator {
   std::string output_base_;
   std::string output_filename_;
   std::string temp_filename_;
+  std::string index_filename_;
+  bool allow_relative_;
+  bool use_metadata_;
+  LinkMode link_mode_;
 
-  FileInfoMap manifest_;
+  // The input manifest, which manifest_ points into.
+  std::string manifest_buffer_;
+  Stats stats_;
+  Manifest manifest_;
 };
 
 int main(int argc, char **argv) {
@@ -419,6 +1110,10 @@ int main(int argc, char **argv) {
   argc--; argv++;
   bool allow_relative = false;
   bool use_metadata = false;
+  int jobs = 1;
+  bool incremental = false;
+  LinkMode link_mode = LINK_MODE_SYMLINK;
+  const char *stats_file = nullptr;
 
   while (argc >= 1) {
     if (strcmp(argv[0], "--allow_relative") == 0) {
@@ -427,6 +1122,28 @@ int main(int argc, char **argv) {
     } else if (strcmp(argv[0], "--use_metadata") == 0) {
       use_metadata = true;
       argc--; argv++;
+    } else if (strcmp(argv[0], "--link_mode=symlink") == 0) {
+      link_mode = LINK_MODE_SYMLINK;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--link_mode=hardlink") == 0) {
+      link_mode = LINK_MODE_HARDLINK;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--link_mode=reflink") == 0) {
+      link_mode = LINK_MODE_REFLINK;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--incremental") == 0) {
+      incremental = true;
+      argc--; argv++;
+    } else if (strncmp(argv[0], "--stats=", 8) == 0) {
+      stats_file = argv[0] + 8;
+      argc--; argv++;
+    } else if (strncmp(argv[0], "--jobs=", 7) == 0) {
+      jobs = atoi(argv[0] + 7);
+      if (jobs < 1) {
+        fprintf(stderr, "%s: --jobs must be a positive number\n", argv0);
+        return 1;
+      }
+      argc--; argv++;
     } else {
       break;
     }
@@ -434,7 +1151,8 @@ int main(int argc, char **argv) {
 
   if (argc != 2) {
     fprintf(stderr, "usage: %s "
-            "[--allow_relative] [--use_metadata] "
+            "[--allow_relative] [--use_metadata] [--incremental] [--jobs=N] "
+            "[--link_mode=symlink|hardlink|reflink] [--stats=FILE] "
             "INPUT RUNFILES\n",
             argv0);
     return 1;
@@ -453,8 +1171,17 @@ int main(int argc, char **argv) {
   }
 
   RunfilesCreator runfiles_creator(output_base_dir);
-  runfiles_creator.ReadManifest(manifest_file, allow_relative, use_metadata);
-  runfiles_creator.CreateRunfiles();
+  {
+    TraceScope trace("build-runfiles read manifest");
+    runfiles_creator.ReadManifest(manifest_file, allow_relative, use_metadata);
+  }
+  {
+    TraceScope trace("build-runfiles create");
+    runfiles_creator.CreateRunfiles(jobs, incremental, link_mode);
+  }
+  if (stats_file != nullptr) {
+    runfiles_creator.WriteStats(stats_file);
+  }
 
   return 0;
 }
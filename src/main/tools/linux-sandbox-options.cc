@@ -14,7 +14,9 @@
 
 #include "src/main/tools/linux-sandbox-options.h"
 
+#include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sched.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -57,17 +59,47 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "killing the child with SIGKILL\n"
           "  -l <file>  redirect stdout to a file\n"
           "  -L <file>  redirect stderr to a file\n"
+          "  -O  also stream the redirected stdout and stderr live to where "
+          "they were\n"
           "  -w <file>  make a file or directory writable for the sandboxed "
           "process\n"
           "  -e <dir>  mount an empty tmpfs on a directory\n"
+          "  -s <dir>  mount an empty tmpfs on a directory and set TMPDIR to "
+          "it\n"
+          "  -E <options>  mount options for the tmpfs of the preceding -e or "
+          "-s,\n"
+          "    e.g. size=1g,huge=within_size\n"
           "  -M/-m <source/target>  directory to mount inside the sandbox\n"
           "    Multiple directories can be specified and each of them will be "
           "mounted readonly.\n"
           "    The -M option specifies which directory to mount, the -m option "
           "specifies where to\n"
+          "  -I <dir>  overlay a read-only input layer under the working "
+          "directory\n"
+          "    The working directory itself becomes the writable upper layer, "
+          "so outputs\n"
+          "    still end up there. Requires -i.\n"
+          "  -i <dir>  empty directory for overlayfs to work in, on the same "
+          "filesystem\n"
+          "    as the working directory but not below it\n"
           "  -S <file>  if set, write stats in protobuf format to a file\n"
+          "  -C <dir>  run the command in a new cgroup below this cgroup v2 "
+          "directory\n"
+          "    With -S, the stats then include the cgroup's resource usage.\n"
+          "  -x <bytes>  limit the memory of the cgroup (requires -C)\n"
+          "  -c <cores>  limit the CPU time of the cgroup (requires -C)\n"
+          "  -a <cpus>  run on these CPUs only, e.g. 0-15,64-79\n"
+          "  -b <nodes>  allocate memory on these NUMA nodes only, e.g. 0, and "
+          "unless\n"
+          "    -a is given, run on their CPUs only\n"
+          "  -A  print the NUMA nodes whose CPUs we can run on, one per line "
+          "followed by\n"
+          "    these CPUs, e.g. '0 0-15,64-79', instead of running a command\n"
           "  -H  if set, make hostname in the sandbox equal to 'localhost'\n"
           "  -N  if set, a new network namespace will be created\n"
+          "  -n <file>  join this network namespace, e.g. /proc/<pid>/ns/net, "
+          "instead\n"
+          "    of creating one; it must not have network access\n"
           "  -R  if set, make the uid/gid be root\n"
           "  -U  if set, make the uid/gid be nobody\n"
           "  -D  if set, debug info will be printed\n"
@@ -83,6 +115,16 @@ static void ValidateIsAbsolutePath(char *path, char *program_name, char flag) {
   }
 }
 
+// The overlayfs mount options are a comma-separated list, and lowerdir is a
+// colon-separated list itself, so these characters cannot be escaped.
+static void ValidateIsOverlayPath(char *path, char *program_name, char flag) {
+  ValidateIsAbsolutePath(path, program_name, flag);
+  if (strpbrk(path, ",:") != nullptr) {
+    Usage(program_name,
+          "The -%c option does not support paths with ',' or ':'.", flag);
+  }
+}
+
 // Parses command line flags from an argv array and puts the results into an
 // Options structure passed in as an argument.
 static void ParseCommandLine(unique_ptr<vector<char *>> args) {
@@ -90,10 +132,13 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
   extern int optind, optopt;
   int c;
   bool source_specified = false;
+  bool tmpfs_specified = false;
 
-  while ((c = getopt(args->size(), args->data(),
-                     ":W:T:t:l:L:w:e:M:m:S:HNRUD")) != -1) {
+  while ((c = getopt(
+              args->size(), args->data(),
+              ":W:T:t:l:L:Ow:e:s:E:M:m:I:i:S:C:x:c:a:b:AHNn:RUD")) != -1) {
     if (c != 'M' && c != 'm') source_specified = false;
+    if (c != 'e' && c != 's' && c != 'E') tmpfs_specified = false;
     switch (c) {
       case 'W':
         if (opt.working_dir.empty()) {
@@ -132,6 +177,9 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Cannot redirect stderr to more than one destination.");
         }
         break;
+      case 'O':
+        opt.stream_output = true;
+        break;
       case 'w':
         ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
         opt.writable_files.emplace_back(optarg);
@@ -139,6 +187,28 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
       case 'e':
         ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
         opt.tmpfs_dirs.emplace_back(optarg);
+        opt.tmpfs_options.emplace_back();
+        tmpfs_specified = true;
+        break;
+      case 's':
+        if (!opt.scratch_dir.empty()) {
+          Usage(args->front(),
+                "Multiple scratch directories (-s) specified, expected one.");
+        }
+        ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+        opt.scratch_dir.assign(optarg);
+        opt.tmpfs_dirs.emplace_back(optarg);
+        opt.tmpfs_options.emplace_back();
+        tmpfs_specified = true;
+        break;
+      case 'E':
+        if (!tmpfs_specified) {
+          Usage(args->front(),
+                "The -E option must be strictly preceded by an -e or -s "
+                "option.");
+        }
+        opt.tmpfs_options.back().assign(optarg);
+        tmpfs_specified = false;
         break;
       case 'M':
         ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
@@ -157,6 +227,25 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
         opt.bind_mount_targets.emplace_back(optarg);
         source_specified = false;
         break;
+      case 'I':
+        if (opt.input_layer.empty()) {
+          ValidateIsOverlayPath(optarg, args->front(), static_cast<char>(c));
+          opt.input_layer.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple input layers (-I) specified, expected one.");
+        }
+        break;
+      case 'i':
+        if (opt.overlay_work_dir.empty()) {
+          ValidateIsOverlayPath(optarg, args->front(), static_cast<char>(c));
+          opt.overlay_work_dir.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple overlay work directories (-i) specified, expected "
+                "one.");
+        }
+        break;
       case 'S':
         if (opt.stats_path.empty()) {
           opt.stats_path.assign(optarg);
@@ -165,12 +254,60 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Cannot write stats to more than one destination.");
         }
         break;
+      case 'C':
+        if (opt.cgroup_parent.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.cgroup_parent.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple cgroup parents (-C) specified, expected one.");
+        }
+        break;
+      case 'x':
+        if (sscanf(optarg, "%" SCNd64, &opt.memory_limit_bytes) != 1 ||
+            opt.memory_limit_bytes <= 0) {
+          Usage(args->front(), "Invalid memory limit (-x) value: %s", optarg);
+        }
+        break;
+      case 'c':
+        if (sscanf(optarg, "%lf", &opt.cpu_limit) != 1 ||
+            !(opt.cpu_limit > 0)) {
+          Usage(args->front(), "Invalid CPU limit (-c) value: %s", optarg);
+        }
+        break;
+      case 'a':
+        if (!ParseIdList(optarg, &opt.cpus) || opt.cpus.empty()) {
+          Usage(args->front(), "Invalid CPU list (-a) value: %s", optarg);
+        }
+        break;
+      case 'b':
+        if (!ParseIdList(optarg, &opt.numa_nodes) || opt.numa_nodes.empty()) {
+          Usage(args->front(), "Invalid NUMA node list (-b) value: %s",
+                optarg);
+        }
+        break;
+      case 'A':
+        opt.print_numa_nodes = true;
+        break;
       case 'H':
         opt.fake_hostname = true;
         break;
       case 'N':
+        if (!opt.netns_path.empty()) {
+          Usage(args->front(),
+                "The -N option cannot be used at the same time as the -n "
+                "option.");
+        }
         opt.create_netns = true;
         break;
+      case 'n':
+        if (opt.create_netns || !opt.netns_path.empty()) {
+          Usage(args->front(),
+                "The -n option cannot be used with -N or more than once.");
+        }
+        ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+        opt.netns_path.assign(optarg);
+        break;
       case 'R':
         if (opt.fake_username) {
           Usage(args->front(),
@@ -253,14 +390,60 @@ static unique_ptr<vector<char *>> ExpandArguments(const vector<char *> &args) {
   return expanded;
 }
 
+bool ParseIdList(const char *list, std::vector<int> *ids) {
+  // Far more than the kernel supports, against a list that never ends.
+  const long kMaxId = 1 << 16;
+  const char *p = list;
+  while (*p != '\0' && *p != '\n') {
+    if (!isdigit(*p)) {
+      return false;
+    }
+    char *end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (*end == '-') {
+      p = end + 1;
+      if (!isdigit(*p)) {
+        return false;
+      }
+      last = strtol(p, &end, 10);
+    }
+    if (last < first || last > kMaxId) {
+      return false;
+    }
+    for (long id = first; id <= last; ++id) {
+      ids->push_back(static_cast<int>(id));
+    }
+    p = end;
+    if (*p == ',') {
+      ++p;
+      if (!isdigit(*p)) {
+        return false;
+      }
+    } else if (*p != '\0' && *p != '\n') {
+      return false;
+    }
+  }
+  return true;
+}
+
 void ParseOptions(int argc, char *argv[]) {
   vector<char *> args(argv, argv + argc);
   ParseCommandLine(ExpandArguments(args));
 
-  if (opt.args.empty()) {
+  if (opt.args.empty() && !opt.print_numa_nodes) {
     Usage(args.front(), "No command specified.");
   }
 
+  if (opt.cgroup_parent.empty() &&
+      (opt.memory_limit_bytes > 0 || opt.cpu_limit > 0)) {
+    Usage(args.front(), "The -x and -c options require the -C option.");
+  }
+
+  if (opt.input_layer.empty() != opt.overlay_work_dir.empty()) {
+    Usage(args.front(), "The -I and -i options must be used together.");
+  }
+
   if (opt.working_dir.empty()) {
     opt.working_dir = getcwd(nullptr, 0);
   }
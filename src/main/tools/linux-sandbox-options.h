@@ -17,6 +17,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -32,20 +33,44 @@ struct Options {
   std::string stdout_path;
   // Where to redirect stderr (-L)
   std::string stderr_path;
+  // Whether to also stream stdout and stderr live to where they were (-O)
+  bool stream_output;
   // Files or directories to make writable for the sandboxed process (-w)
   std::vector<std::string> writable_files;
-  // Directories where to mount an empty tmpfs (-e)
+  // Directories where to mount an empty tmpfs (-e, -s)
   std::vector<std::string> tmpfs_dirs;
+  // Mount options of each tmpfs, e.g. "size=1g,huge=within_size" (-E)
+  std::vector<std::string> tmpfs_options;
+  // The tmpfs that TMPDIR points to (-s)
+  std::string scratch_dir;
   // Source of files or directories to explicitly bind mount in the sandbox (-M)
   std::vector<std::string> bind_mount_sources;
   // Target of files or directories to explicitly bind mount in the sandbox (-m)
   std::vector<std::string> bind_mount_targets;
+  // Read-only directory to overlay under the working directory (-I)
+  std::string input_layer;
+  // Empty directory for overlayfs to work in (-i)
+  std::string overlay_work_dir;
   // Where to write stats, in protobuf format (-S)
   std::string stats_path;
+  // Cgroup v2 directory to create the action's cgroup in (-C)
+  std::string cgroup_parent;
+  // Memory limit of the action's cgroup in bytes, 0 for none (-x)
+  int64_t memory_limit_bytes;
+  // CPU limit of the action's cgroup in cores, 0 for none (-c)
+  double cpu_limit;
+  // CPUs to run the sandboxed process on (-a)
+  std::vector<int> cpus;
+  // NUMA nodes to allocate the memory of the sandboxed process on (-b)
+  std::vector<int> numa_nodes;
+  // Print the NUMA nodes we can run on instead of running a command (-A)
+  bool print_numa_nodes;
   // Set the hostname inside the sandbox to 'localhost' (-H)
   bool fake_hostname;
   // Create a new network namespace (-N)
   bool create_netns;
+  // Network namespace to join instead of creating one (-n)
+  std::string netns_path;
   // Pretend to be root inside the namespace (-R)
   bool fake_root;
   // Set the username inside the sandbox to 'nobody' (-U)
@@ -61,4 +86,8 @@ extern struct Options opt;
 // Handles parsing all command line flags and populates the global opt struct.
 void ParseOptions(int argc, char *argv[]);
 
+// Appends the numbers in a list like "0-3,8" (the cpulist format of the
+// kernel, also used for NUMA nodes) to ids. Returns false if it is malformed.
+bool ParseIdList(const char *list, std::vector<int> *ids);
+
 #endif
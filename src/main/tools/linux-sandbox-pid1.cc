@@ -19,12 +19,12 @@
 
 #include "src/main/tools/linux-sandbox-pid1.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <math.h>
 #include <mntent.h>
-#include <net/if.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -32,7 +32,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
@@ -40,7 +39,10 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #ifndef MS_REC
 // Some systems do not define MS_REC in sys/mount.h. We might be able to grab it
@@ -53,6 +55,26 @@
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
+// The new mount API (Linux 5.12) may be missing from the system headers.
+#ifndef SYS_mount_setattr
+#define SYS_mount_setattr 442
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#endif
+
+// The layout of struct mount_attr from linux/mount.h, which cannot be included
+// together with sys/mount.h on older systems.
+struct MountAttr {
+  uint64_t attr_set;
+  uint64_t attr_clr;
+  uint64_t propagation;
+  uint64_t userns_fd;
+};
+
 static int global_child_pid;
 
 static void SetupSelfDestruction(int *sync_pipe) {
@@ -146,8 +168,22 @@ static void SetupUserNamespace() {
     inner_gid = global_outer_gid;
   }
 
-  WriteFile("/proc/self/uid_map", "%d %d 1\n", inner_uid, global_outer_uid);
-  WriteFile("/proc/self/gid_map", "%d %d 1\n", inner_gid, global_outer_gid);
+  WriteFile("/proc/self/uid_map", "%d %d 1\n", inner_uid, global_parent_uid);
+  WriteFile("/proc/self/gid_map", "%d %d 1\n", inner_gid, global_parent_gid);
+}
+
+// Moves us into the action's cgroup, if there is one, before we spawn the
+// child, so that the child and all of its descendants are accounted for there.
+static void JoinCgroup() {
+  // Writing 0 moves the writing process. Since Linux 5.16, the permission
+  // check uses the credentials the file was opened with outside of our user
+  // namespace; before that, it uses our uid, which maps to the outer one.
+  if (write(global_cgroup_procs_fd, "0", 1) < 0) {
+    DIE("write(cgroup.procs)");
+  }
+  if (close(global_cgroup_procs_fd) < 0) {
+    DIE("close");
+  }
 }
 
 static void SetupUtsNamespace() {
@@ -160,13 +196,251 @@ static void SetupUtsNamespace() {
   }
 }
 
+// Returns "path" without its last component; "/" for the top-level entries.
+static std::string ParentPath(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static std::string BaseName(const std::string &path) {
+  return path.substr(path.find_last_of('/') + 1);
+}
+
+// Returns the mount points of the mount namespace, as we inherited it.
+static std::unordered_set<std::string> MountPoints() {
+  std::unordered_set<std::string> mount_points;
+  FILE *mounts = setmntent("/proc/self/mounts", "r");
+  if (mounts == nullptr) {
+    DIE("setmntent");
+  }
+  struct mntent *ent;
+  while ((ent = getmntent(mounts)) != nullptr) {
+    mount_points.insert(ent->mnt_dir);
+  }
+  endmntent(mounts);
+  return mount_points;
+}
+
+// Returns whether "path" or one of its parent directories is in "paths".
+static bool IsAtOrBelow(const std::string &path,
+                        const std::unordered_set<std::string> &paths) {
+  for (std::string dir = path;; dir = ParentPath(dir)) {
+    if (paths.count(dir) > 0) {
+      return true;
+    }
+    if (dir == "/") {
+      return false;
+    }
+  }
+}
+
+// Sets "names" to the sorted entries of directory "dir". Returns false if it
+// cannot be read, or one of the entries is a symlink or a mount point, which a
+// bind mount of the directory would not show the same way as a bind mount of
+// the entry.
+static bool ListPlainEntries(
+    const std::string &dir,
+    const std::unordered_set<std::string> &mount_points,
+    std::vector<std::string> *names) {
+  DIR *entries = opendir(dir.c_str());
+  if (entries == nullptr) {
+    return false;
+  }
+  bool plain = true;
+  struct dirent *dent;
+  while (plain && (dent = readdir(entries)) != nullptr) {
+    if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+    std::string path = (dir == "/" ? "" : dir) + "/" + dent->d_name;
+    struct stat st;
+    plain = lstat(path.c_str(), &st) == 0 && !S_ISLNK(st.st_mode) &&
+            mount_points.count(path) == 0;
+    names->push_back(dent->d_name);
+  }
+  closedir(entries);
+  std::sort(names->begin(), names->end());
+  return plain;
+}
+
+// Replaces the bind mounts (-M, -m) of all the entries of one directory onto
+// the same entries of another directory by one bind mount of the directory.
+// Big actions have thousands of them. Only where this changes nothing the
+// sandbox sees:
+//  - both directories have exactly the same entries, and none of them is a
+//    symlink or a mount point,
+//  - the target directory is not writable, as it would no longer be, and
+//  - nothing else is mounted at, above or below it.
+static void CoalesceBindMounts(
+    const std::unordered_set<std::string> &mount_points) {
+  std::unordered_set<std::string> writable(opt.writable_files.begin(),
+                                           opt.writable_files.end());
+  writable.insert(opt.tmpfs_dirs.begin(), opt.tmpfs_dirs.end());
+  writable.insert(opt.working_dir);
+
+  // The mounts of each pair of source and target directory, by target
+  // directory. Two sources for one target directory cannot be coalesced.
+  std::unordered_map<std::string, std::vector<size_t>> groups;
+  std::unordered_set<std::string> conflicts;
+  for (size_t i = 0; i < opt.bind_mount_sources.size(); i++) {
+    const std::string &source = opt.bind_mount_sources[i];
+    const std::string &target = opt.bind_mount_targets[i];
+    if (target == "/" || BaseName(source) != BaseName(target)) {
+      continue;
+    }
+    std::vector<size_t> &group = groups[ParentPath(target)];
+    if (!group.empty() && ParentPath(opt.bind_mount_sources[group[0]]) !=
+                              ParentPath(source)) {
+      conflicts.insert(ParentPath(target));
+    }
+    group.push_back(i);
+  }
+
+  // Any other mount at, above or below a target directory rules it out, as
+  // either would hide the other, or the order of the two would change.
+  std::unordered_map<std::string, bool> candidates;
+  for (const auto &group : groups) {
+    candidates[group.first] = group.first != "/" && group.second.size() > 1 &&
+                              conflicts.count(group.first) == 0 &&
+                              !IsAtOrBelow(group.first, writable);
+  }
+  std::unordered_set<std::string> others(writable), member_targets;
+  for (size_t i = 0; i < opt.bind_mount_targets.size(); i++) {
+    const std::string &target = opt.bind_mount_targets[i];
+    if (target != "/" && groups.count(ParentPath(target)) > 0 &&
+        BaseName(opt.bind_mount_sources[i]) == BaseName(target)) {
+      member_targets.insert(target);
+    } else {
+      others.insert(target);
+    }
+  }
+  auto rule_out_from = [&candidates](std::string dir) {
+    for (;; dir = ParentPath(dir)) {
+      auto candidate = candidates.find(dir);
+      if (candidate != candidates.end()) {
+        candidate->second = false;
+      }
+      if (dir == "/") {
+        return;
+      }
+    }
+  };
+  for (auto &candidate : candidates) {
+    if (IsAtOrBelow(candidate.first, others) ||
+        IsAtOrBelow(candidate.first, member_targets)) {
+      candidate.second = false;
+    }
+  }
+  for (const std::string &path : others) {
+    if (path != "/") {
+      rule_out_from(ParentPath(path));
+    }
+  }
+  for (const std::string &path : member_targets) {
+    if (ParentPath(path) != "/") {
+      rule_out_from(ParentPath(ParentPath(path)));
+    }
+  }
+
+  // Finally, both directories must have exactly the entries of the group.
+  for (auto &candidate : candidates) {
+    if (!candidate.second) {
+      continue;
+    }
+    const std::vector<size_t> &group = groups[candidate.first];
+    std::vector<std::string> names, source_names, target_names;
+    for (size_t member : group) {
+      names.push_back(BaseName(opt.bind_mount_targets[member]));
+    }
+    std::sort(names.begin(), names.end());
+    candidate.second =
+        ListPlainEntries(ParentPath(opt.bind_mount_sources[group[0]]),
+                         mount_points, &source_names) &&
+        ListPlainEntries(candidate.first, mount_points, &target_names) &&
+        names == source_names && names == target_names;
+  }
+
+  std::vector<std::string> sources, targets;
+  for (size_t i = 0; i < opt.bind_mount_sources.size(); i++) {
+    const std::string &source = opt.bind_mount_sources[i];
+    const std::string &target = opt.bind_mount_targets[i];
+    auto candidate = candidates.find(ParentPath(target));
+    if (target == "/" || candidate == candidates.end() ||
+        !candidate->second || BaseName(source) != BaseName(target)) {
+      sources.push_back(source);
+      targets.push_back(target);
+    } else if (groups[candidate->first][0] == i) {
+      // In place of the first mount of the group. The mounts in between are
+      // elsewhere in the tree, so that makes no difference.
+      PRINT_DEBUG("coalesced %zu bind mounts into %s -> %s",
+                  groups[candidate->first].size(), ParentPath(source).c_str(),
+                  candidate->first.c_str());
+      sources.push_back(ParentPath(source));
+      targets.push_back(candidate->first);
+    }
+  }
+  opt.bind_mount_sources.swap(sources);
+  opt.bind_mount_targets.swap(targets);
+}
+
+// Drops the writable paths (-w) that are writable without a mount of their
+// own: duplicates, and paths below the working directory, a tmpfs or another
+// writable path, on the same mount as that.
+static void DropRedundantWritableFiles(
+    const std::unordered_set<std::string> &mount_points) {
+  std::unordered_set<std::string> writable_roots(opt.writable_files.begin(),
+                                                 opt.writable_files.end());
+  writable_roots.insert(opt.tmpfs_dirs.begin(), opt.tmpfs_dirs.end());
+  writable_roots.insert(opt.working_dir);
+  const std::unordered_set<std::string> bind_mount_targets(
+      opt.bind_mount_targets.begin(), opt.bind_mount_targets.end());
+  const std::unordered_set<std::string> tmpfs_dirs(opt.tmpfs_dirs.begin(),
+                                                   opt.tmpfs_dirs.end());
+
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> needed;
+  for (const std::string &path : opt.writable_files) {
+    if (!seen.insert(path).second) {
+      continue;
+    }
+    bool redundant = path == opt.working_dir || tmpfs_dirs.count(path) > 0;
+    if (!redundant && path != "/" && mount_points.count(path) == 0 &&
+        bind_mount_targets.count(path) == 0) {
+      for (std::string dir = ParentPath(path);; dir = ParentPath(dir)) {
+        if (writable_roots.count(dir) > 0) {
+          redundant = true;
+          break;
+        }
+        if (dir == "/" || mount_points.count(dir) > 0 ||
+            bind_mount_targets.count(dir) > 0) {
+          break;
+        }
+      }
+    }
+    if (redundant) {
+      PRINT_DEBUG("writable already: %s", path.c_str());
+    } else {
+      needed.push_back(path);
+    }
+  }
+  opt.writable_files.swap(needed);
+}
+
 static void MountFilesystems() {
-  for (const std::string &tmpfs_dir : opt.tmpfs_dirs) {
-    PRINT_DEBUG("tmpfs: %s", tmpfs_dir.c_str());
+  // Before we mount anything ourselves. Both only ever leave out mounts.
+  const std::unordered_set<std::string> mount_points = MountPoints();
+  CoalesceBindMounts(mount_points);
+  DropRedundantWritableFiles(mount_points);
+
+  for (size_t i = 0; i < opt.tmpfs_dirs.size(); i++) {
+    const std::string &tmpfs_dir = opt.tmpfs_dirs.at(i);
+    const std::string &options = opt.tmpfs_options.at(i);
+    PRINT_DEBUG("tmpfs: %s (%s)", tmpfs_dir.c_str(), options.c_str());
     if (mount("tmpfs", tmpfs_dir.c_str(), "tmpfs",
-              MS_NOSUID | MS_NODEV | MS_NOATIME, nullptr) < 0) {
-      DIE("mount(tmpfs, %s, tmpfs, MS_NOSUID | MS_NODEV | MS_NOATIME, nullptr)",
-          tmpfs_dir.c_str());
+              MS_NOSUID | MS_NODEV | MS_NOATIME,
+              options.empty() ? nullptr : options.c_str()) < 0) {
+      DIE("mount(tmpfs, %s, tmpfs, MS_NOSUID | MS_NODEV | MS_NOATIME, %s)",
+          tmpfs_dir.c_str(), options.c_str());
     }
   }
 
@@ -174,8 +448,21 @@ static void MountFilesystems() {
   // do this is by bind-mounting it upon itself.
   PRINT_DEBUG("working dir: %s", opt.working_dir.c_str());
 
-  if (mount(opt.working_dir.c_str(), opt.working_dir.c_str(), nullptr, MS_BIND,
-            nullptr) < 0) {
+  if (!opt.input_layer.empty()) {
+    // Or, with an input layer, by mounting an overlay upon it. The working
+    // directory stays the upper layer, so that whatever the command writes is
+    // still there once the namespace (and with it the overlay) is gone.
+    PRINT_DEBUG("input layer: %s", opt.input_layer.c_str());
+    std::string options = "lowerdir=" + opt.input_layer +
+                          ",upperdir=" + opt.working_dir +
+                          ",workdir=" + opt.overlay_work_dir;
+    if (mount("overlay", opt.working_dir.c_str(), "overlay", 0,
+              options.c_str()) < 0) {
+      DIE("mount(overlay, %s, overlay, 0, %s)", opt.working_dir.c_str(),
+          options.c_str());
+    }
+  } else if (mount(opt.working_dir.c_str(), opt.working_dir.c_str(), nullptr,
+                   MS_BIND, nullptr) < 0) {
     DIE("mount(%s, %s, nullptr, MS_BIND, nullptr)", opt.working_dir.c_str(),
         opt.working_dir.c_str());
   }
@@ -200,31 +487,20 @@ static void MountFilesystems() {
   }
 }
 
-// We later remount everything read-only, except the paths for which this method
-// returns true.
-static bool ShouldBeWritable(const std::string &mnt_dir) {
-  if (mnt_dir == opt.working_dir) {
-    return true;
-  }
-
-  for (const std::string &writable_file : opt.writable_files) {
-    if (mnt_dir == writable_file) {
-      return true;
-    }
-  }
-
-  for (const std::string &tmpfs_dir : opt.tmpfs_dirs) {
-    if (mnt_dir == tmpfs_dir) {
-      return true;
-    }
-  }
-
-  return false;
+// We later remount everything read-only, except the paths returned by this
+// method. All of them are mount points, see MountFilesystems.
+static std::unordered_set<std::string> WritablePaths() {
+  std::unordered_set<std::string> writable(opt.writable_files.begin(),
+                                           opt.writable_files.end());
+  writable.insert(opt.tmpfs_dirs.begin(), opt.tmpfs_dirs.end());
+  writable.insert(opt.working_dir);
+  return writable;
 }
 
-// Makes the whole filesystem read-only, except for the paths for which
-// ShouldBeWritable returns true.
-static void MakeFilesystemMostlyReadOnly() {
+// Remounts every entry of /proc/self/mounts one by one, read-only unless it is
+// in "writable". Used on kernels without mount_setattr.
+static void RemountMostlyReadOnly(
+    const std::unordered_set<std::string> &writable) {
   FILE *mounts = setmntent("/proc/self/mounts", "r");
   if (mounts == nullptr) {
     DIE("setmntent");
@@ -257,7 +533,7 @@ static void MakeFilesystemMostlyReadOnly() {
       mountFlags |= MS_RELATIME;
     }
 
-    if (!ShouldBeWritable(ent->mnt_dir)) {
+    if (writable.count(ent->mnt_dir) == 0) {
       mountFlags |= MS_RDONLY;
     }
 
@@ -286,6 +562,50 @@ static void MakeFilesystemMostlyReadOnly() {
   endmntent(mounts);
 }
 
+// Makes the whole filesystem read-only with a single mount_setattr call, then
+// makes the writable paths writable again. Returns false without changing
+// anything if the kernel does not support this, or refuses to change one of
+// the mounts, so that the caller can fall back to RemountMostlyReadOnly.
+static bool SetMountTreeMostlyReadOnly(
+    const std::unordered_set<std::string> &writable) {
+  struct MountAttr attr = {};
+  attr.attr_set = MOUNT_ATTR_RDONLY;
+  // AT_RECURSIVE changes either all mounts below "/" or none of them. Unlike a
+  // remount, it leaves the other flags (nodev, noexec, ...) alone.
+  if (syscall(SYS_mount_setattr, AT_FDCWD, "/", AT_RECURSIVE, &attr,
+              sizeof(attr)) < 0) {
+    PRINT_DEBUG("mount_setattr(/, AT_RECURSIVE) failed: %s", strerror(errno));
+    return false;
+  }
+
+  attr.attr_set = 0;
+  attr.attr_clr = MOUNT_ATTR_RDONLY;
+  for (const std::string &path : writable) {
+    PRINT_DEBUG("remount rw: %s", path.c_str());
+    if (syscall(SYS_mount_setattr, AT_FDCWD, path.c_str(), 0, &attr,
+                sizeof(attr)) < 0) {
+      // EPERM means that the mount was read-only before we entered the user
+      // namespace. EINVAL means that the path is no longer the root of a
+      // mount, because a later mount hid it, e.g. a tmpfs below the working
+      // directory. RemountMostlyReadOnly ignores these cases as well.
+      if (errno != EACCES && errno != EPERM && errno != EINVAL &&
+          errno != ENOENT) {
+        DIE("mount_setattr(%s, MOUNT_ATTR_RDONLY)", path.c_str());
+      }
+    }
+  }
+  return true;
+}
+
+// Makes the whole filesystem read-only, except for the paths returned by
+// WritablePaths.
+static void MakeFilesystemMostlyReadOnly() {
+  const std::unordered_set<std::string> writable = WritablePaths();
+  if (!SetMountTreeMostlyReadOnly(writable)) {
+    RemountMostlyReadOnly(writable);
+  }
+}
+
 static void MountProc() {
   // Mount a new proc on top of the old one, because the old one still refers to
   // our parent PID namespace.
@@ -299,29 +619,7 @@ static void SetupNetworking() {
   // When running in a separate network namespace, enable the loopback interface
   // because some application may want to use it.
   if (opt.create_netns) {
-    int fd;
-    fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd < 0) {
-      DIE("socket");
-    }
-
-    struct ifreq ifr = {};
-    strncpy(ifr.ifr_name, "lo", IF_NAMESIZE);
-
-    // Verify that name is valid.
-    if (if_nametoindex(ifr.ifr_name) == 0) {
-      DIE("if_nametoindex");
-    }
-
-    // Enable the interface.
-    ifr.ifr_flags |= IFF_UP;
-    if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
-      DIE("ioctl");
-    }
-
-    if (close(fd) < 0) {
-      DIE("close");
-    }
+    EnableLoopbackInterface();
   }
 }
 
@@ -329,19 +627,16 @@ static void EnterSandbox() {
   if (chdir(opt.working_dir.c_str()) < 0) {
     DIE("chdir(%s)", opt.working_dir.c_str());
   }
+
+  // Here rather than in the child, which must not allocate, see SpawnChild.
+  if (!opt.scratch_dir.empty() &&
+      setenv("TMPDIR", opt.scratch_dir.c_str(), 1) < 0) {
+    DIE("setenv(TMPDIR, %s)", opt.scratch_dir.c_str());
+  }
 }
 
 // Reset the signal mask and restore the default handler for all signals.
 static void RestoreSignalHandlersAndMask() {
-  // Use an empty signal mask for the process (= unblock all signals).
-  sigset_t empty_set;
-  if (sigemptyset(&empty_set) < 0) {
-    DIE("sigemptyset");
-  }
-  if (sigprocmask(SIG_SETMASK, &empty_set, nullptr) < 0) {
-    DIE("sigprocmask(SIG_SETMASK, <empty set>, nullptr)");
-  }
-
   // Set the default signal handler for all signals.
   struct sigaction sa = {};
   if (sigemptyset(&sa.sa_mask) < 0) {
@@ -353,6 +648,17 @@ static void RestoreSignalHandlersAndMask() {
     // handler for certain signals, but we still want to try.
     sigaction(i, &sa, nullptr);
   }
+
+  // Use an empty signal mask for the process (= unblock all signals). This
+  // comes last, so that a blocked signal cannot reach one of our handlers in
+  // the vfork()ed child, see SpawnChild.
+  sigset_t empty_set;
+  if (sigemptyset(&empty_set) < 0) {
+    DIE("sigemptyset");
+  }
+  if (sigprocmask(SIG_SETMASK, &empty_set, nullptr) < 0) {
+    DIE("sigprocmask(SIG_SETMASK, <empty set>, nullptr)");
+  }
 }
 
 static void ForwardSignal(int signum) {
@@ -398,34 +704,53 @@ static void SetupSignalHandlers() {
 }
 
 static void SpawnChild() {
-  global_child_pid = fork();
+  // argv[] passed to execve() must be a null-terminated array. This has to
+  // happen before vfork(), as the child must not allocate memory.
+  opt.args.push_back(nullptr);
 
-  if (global_child_pid < 0) {
-    DIE("fork()");
-  } else if (global_child_pid == 0) {
+  // vfork() does not copy our page tables, which fork() would do for all the
+  // memory we touched setting up the sandbox. The child shares our memory
+  // until it calls execvp(), so it only changes process attributes. Block all
+  // signals until then, so that none of our handlers runs in the child.
+  sigset_t all_signals, old_mask;
+  if (sigfillset(&all_signals) < 0) {
+    DIE("sigfillset");
+  }
+  if (sigprocmask(SIG_SETMASK, &all_signals, &old_mask) < 0) {
+    DIE("sigprocmask(SIG_SETMASK, <full set>, ...)");
+  }
+
+  if (global_pid1_timestamps != nullptr) {
+    global_pid1_timestamps->child_start_usec = GetRealtimeMicros();
+  }
+  pid_t child_pid = vfork();
+  if (child_pid < 0) {
+    DIE("vfork()");
+  } else if (child_pid == 0) {
     // Put the child into its own process group.
     if (setpgid(0, 0) < 0) {
-      DIE("setpgid");
+      DIE_IN_CHILD("setpgid");
     }
 
     // Try to assign our terminal to the child process.
     if (tcsetpgrp(STDIN_FILENO, getpgrp()) < 0 && errno != ENOTTY) {
-      DIE("tcsetpgrp")
+      DIE_IN_CHILD("tcsetpgrp")
     }
 
-    // Unblock all signals, restore default handlers.
+    // Restore default handlers, unblock all signals.
     RestoreSignalHandlersAndMask();
 
     // Force umask to include read and execute for everyone, to make output
     // permissions predictable.
     umask(022);
 
-    // argv[] passed to execve() must be a null-terminated array.
-    opt.args.push_back(nullptr);
+    execvp(opt.args[0], opt.args.data());
+    DIE_IN_CHILD("execvp(%s, %p)", opt.args[0], opt.args.data());
+  }
 
-    if (execvp(opt.args[0], opt.args.data()) < 0) {
-      DIE("execvp(%s, %p)", opt.args[0], opt.args.data());
-    }
+  global_child_pid = child_pid;
+  if (sigprocmask(SIG_SETMASK, &old_mask, nullptr) < 0) {
+    DIE("sigprocmask(SIG_SETMASK, <old mask>, nullptr)");
   }
 }
 
@@ -446,6 +771,9 @@ static void WaitForChild() {
       DIE("waitpid")
     } else {
       if (killed_pid == global_child_pid) {
+        if (global_pid1_timestamps != nullptr) {
+          global_pid1_timestamps->child_exit_usec = GetRealtimeMicros();
+        }
         // If the child process we spawned earlier terminated, we'll also
         // terminate. We can simply _exit() here, because the Linux kernel will
         // kindly SIGKILL all remaining processes in our PID namespace once we
@@ -470,6 +798,9 @@ int Pid1Main(void *sync_pipe_param) {
   SetupSelfDestruction(reinterpret_cast<int *>(sync_pipe_param));
   SetupMountNamespace();
   SetupUserNamespace();
+  if (global_cgroup_procs_fd >= 0) {
+    JoinCgroup();
+  }
   if (opt.fake_hostname) {
     SetupUtsNamespace();
   }
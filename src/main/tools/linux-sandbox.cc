@@ -31,10 +31,15 @@
  *    will be killed.
  *  - If linux-sandbox's parent dies, it will kill itself, the process and all
  *    the children.
- *  - Network access is allowed, but can be disabled via -N.
+ *  - Network access is allowed, but can be disabled via -N, or by joining a
+ *    shared network namespace without network access via -n.
  *  - The hostname and domainname will be set to "sandbox".
  *  - The process runs in its own PID namespace, so other processes on the
  *    system are invisible.
+ *  - If option -C is passed, the process and all of its children run in a new
+ *    cgroup, which may limit their memory (-x) and CPU time (-c).
+ *  - The process can be restricted to some CPUs (-a) and have its memory
+ *    allocated on some NUMA nodes (-b). Option -A lists the NUMA nodes.
  */
 
 #include "src/main/tools/linux-sandbox.h"
@@ -43,33 +48,59 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <linux/mempolicy.h>
 #include <math.h>
+#include <net/if.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#ifndef NS_GET_USERNS
+#define NS_GET_USERNS _IO(0xb7, 0x1)
+#endif
+
+#include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/main/tools/linux-sandbox-options.h"
 #include "src/main/tools/linux-sandbox-pid1.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
+#include "src/main/tools/trace.h"
 
 int global_outer_uid;
 int global_outer_gid;
+int global_parent_uid;
+int global_parent_gid;
+int global_cgroup_procs_fd = -1;
+struct Pid1Timestamps *global_pid1_timestamps;
 
 static int global_child_pid;
 
+// The cgroup the action runs in, if any.
+static std::string global_cgroup_dir;
+
+// What we collect for the stats (-S) besides the timestamps of
+// linux-sandbox-pid1.
+static int64_t global_start_usec;
+static struct rusage global_pid1_rusage;
+static tools::protos::ExecutionStatistics global_stats;
+
 // The signal that will be sent to the child when a timeout occurs.
 static volatile sig_atomic_t global_next_timeout_signal = SIGTERM;
 
@@ -115,6 +146,392 @@ static void CloseFds() {
   }
 }
 
+// Writes "value" to the file "name" of the action's cgroup. On failure, removes
+// the cgroup again and dies.
+static void WriteCgroupFile(const char *name, const std::string &value) {
+  std::string path = global_cgroup_dir + "/" + name;
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0 || write(fd, value.data(), value.size()) < 0) {
+    int saved_errno = errno;
+    rmdir(global_cgroup_dir.c_str());
+    errno = saved_errno;
+    DIE("write(%s, %s)", path.c_str(), value.c_str());
+  }
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+}
+
+// Creates the action's cgroup below opt.cgroup_parent and applies the limits.
+// linux-sandbox-pid1 joins it before it starts the command, so that the
+// command and everything it spawns are accounted for in it.
+static void CreateCgroup() {
+  global_cgroup_dir =
+      opt.cgroup_parent + "/linux-sandbox." + std::to_string(getpid());
+  if (mkdir(global_cgroup_dir.c_str(), 0755) < 0) {
+    DIE("mkdir(%s)", global_cgroup_dir.c_str());
+  }
+  PRINT_DEBUG("cgroup: %s", global_cgroup_dir.c_str());
+
+  // Writing these fails with ENOENT unless the memory or cpu controller is
+  // enabled in the parent's cgroup.subtree_control.
+  if (opt.memory_limit_bytes > 0) {
+    WriteCgroupFile("memory.max", std::to_string(opt.memory_limit_bytes));
+  }
+  if (opt.cpu_limit > 0) {
+    const int64_t kCpuPeriodUsec = 100000;
+    int64_t quota = llround(opt.cpu_limit * kCpuPeriodUsec);
+    WriteCgroupFile("cpu.max", std::to_string(quota) + " " +
+                                   std::to_string(kCpuPeriodUsec));
+  }
+
+  std::string procs = global_cgroup_dir + "/cgroup.procs";
+  global_cgroup_procs_fd = open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+  if (global_cgroup_procs_fd < 0) {
+    DIE("open(%s)", procs.c_str());
+  }
+}
+
+// Calls "handle" for each "key value" pair in the whitespace-separated cgroup
+// file "name"; flat keyed files like cpu.stat have one pair per line, nested
+// keyed files like io.stat have a device and then "key=value" pairs per line.
+// Returns false if the file cannot be read.
+static bool ReadCgroupFile(const char *name,
+                           void (*handle)(const std::string &key,
+                                          int64_t value,
+                                          tools::protos::CgroupUsage *usage),
+                           tools::protos::CgroupUsage *usage) {
+  std::string path = global_cgroup_dir + "/" + name;
+  FILE *file = fopen(path.c_str(), "re");
+  if (file == nullptr) {
+    return false;
+  }
+  char token[256];
+  std::string key;
+  while (fscanf(file, "%255s", token) == 1) {
+    const char *equals = strchr(token, '=');
+    if (equals != nullptr) {
+      handle(std::string(token, equals - token),
+             strtoll(equals + 1, nullptr, 10), usage);
+      key.clear();
+    } else if (key.empty()) {
+      key = token;
+    } else {
+      handle(key, strtoll(token, nullptr, 10), usage);
+      key.clear();
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static void HandleMemoryEvent(const std::string &key, int64_t value,
+                              tools::protos::CgroupUsage *usage) {
+  if (key == "oom_kill") {
+    usage->set_oom_kills(value);
+  }
+}
+
+static void HandleCpuStat(const std::string &key, int64_t value,
+                          tools::protos::CgroupUsage *usage) {
+  if (key == "usage_usec") {
+    usage->set_cpu_usage_usec(value);
+  } else if (key == "user_usec") {
+    usage->set_cpu_user_usec(value);
+  } else if (key == "system_usec") {
+    usage->set_cpu_system_usec(value);
+  }
+}
+
+static void HandleIoStat(const std::string &key, int64_t value,
+                         tools::protos::CgroupUsage *usage) {
+  if (key == "rbytes") {
+    usage->set_io_read_bytes(usage->io_read_bytes() + value);
+  } else if (key == "wbytes") {
+    usage->set_io_write_bytes(usage->io_write_bytes() + value);
+  }
+}
+
+static void ReadCgroupUsage(tools::protos::CgroupUsage *usage) {
+  // memory.peak is a single number (Linux 5.19 and newer).
+  std::string path = global_cgroup_dir + "/memory.peak";
+  FILE *file = fopen(path.c_str(), "re");
+  if (file != nullptr) {
+    int64_t peak;
+    if (fscanf(file, "%" SCNd64, &peak) == 1) {
+      usage->set_memory_peak_bytes(peak);
+    }
+    fclose(file);
+  }
+  ReadCgroupFile("memory.events", HandleMemoryEvent, usage);
+  ReadCgroupFile("cpu.stat", HandleCpuStat, usage);
+  ReadCgroupFile("io.stat", HandleIoStat, usage);
+}
+
+// Removes the action's cgroup. The kernel may take a moment to notice that the
+// last process in it is gone, so EBUSY is retried for up to a second.
+static void RemoveCgroup() {
+  for (int i = 0; i < 100; i++) {
+    if (rmdir(global_cgroup_dir.c_str()) == 0 || errno == ENOENT) {
+      return;
+    }
+    if (errno != EBUSY) {
+      break;
+    }
+    usleep(10000);
+  }
+  PRINT_DEBUG("could not remove cgroup %s: %s", global_cgroup_dir.c_str(),
+              strerror(errno));
+}
+
+void EnableLoopbackInterface() {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    DIE("socket");
+  }
+
+  struct ifreq ifr = {};
+  strncpy(ifr.ifr_name, "lo", IF_NAMESIZE);
+
+  // Verify that name is valid.
+  if (if_nametoindex(ifr.ifr_name) == 0) {
+    DIE("if_nametoindex");
+  }
+
+  // Enable the interface, unless it is up already. Changing the flags takes a
+  // global kernel lock, reading them does not.
+  if (ioctl(fd, SIOCGIFFLAGS, &ifr) < 0) {
+    DIE("ioctl(SIOCGIFFLAGS)");
+  }
+  if ((ifr.ifr_flags & IFF_UP) == 0) {
+    ifr.ifr_flags |= IFF_UP;
+    if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
+      DIE("ioctl(SIOCSIFFLAGS)");
+    }
+  }
+
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+}
+
+// Returns whether the namespace files "fd1" and "fd2" refer to the same
+// namespace.
+static bool IsSameNamespace(int fd1, int fd2) {
+  struct stat st1, st2;
+  if (fstat(fd1, &st1) < 0 || fstat(fd2, &st2) < 0) {
+    DIE("fstat");
+  }
+  return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+// Dies unless the network namespace we are in has no interface but the
+// loopback one, so that a namespace with a way out cannot give network access
+// to the actions that must have none.
+static void CheckNoNetworkInterfaces() {
+  struct if_nameindex *interfaces = if_nameindex();
+  if (interfaces == nullptr) {
+    DIE("if_nameindex");
+  }
+  for (struct if_nameindex *i = interfaces; i->if_index != 0; ++i) {
+    if (strcmp(i->if_name, "lo") != 0) {
+      fprintf(stderr,
+              "network namespace %s has interface %s; only lo is allowed\n",
+              opt.netns_path.c_str(), i->if_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if_freenameindex(interfaces);
+}
+
+// Joins the network namespace at opt.netns_path, so that linux-sandbox-pid1
+// does not have to create one. Creating a network namespace serializes on a
+// global kernel lock, which limits how many sandboxes can start in parallel.
+//
+// We are only allowed to join the network namespace from the user namespace
+// that owns it, which typically is the one the namespace was created in with
+// "unshare --user --map-root-user --net". So we join that first, and
+// linux-sandbox-pid1 creates its user namespace inside of it. Nothing in the
+// sandbox is then allowed to reconfigure the shared network namespace.
+static void JoinNetworkNamespace() {
+  int netns_fd = open(opt.netns_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (netns_fd < 0) {
+    DIE("open(%s)", opt.netns_path.c_str());
+  }
+  int userns_fd = ioctl(netns_fd, NS_GET_USERNS);
+  if (userns_fd < 0) {
+    DIE("ioctl(%s, NS_GET_USERNS)", opt.netns_path.c_str());
+  }
+  int own_userns_fd = open("/proc/self/ns/user", O_RDONLY | O_CLOEXEC);
+  if (own_userns_fd < 0) {
+    DIE("open(/proc/self/ns/user)");
+  }
+  // setns() fails with EINVAL for the user namespace we are in already.
+  if (!IsSameNamespace(userns_fd, own_userns_fd) &&
+      setns(userns_fd, CLONE_NEWUSER) < 0) {
+    DIE("setns(<user namespace of %s>, CLONE_NEWUSER)",
+        opt.netns_path.c_str());
+  }
+  if (setns(netns_fd, CLONE_NEWNET) < 0) {
+    DIE("setns(%s, CLONE_NEWNET)", opt.netns_path.c_str());
+  }
+  if (close(own_userns_fd) < 0 || close(userns_fd) < 0 ||
+      close(netns_fd) < 0) {
+    DIE("close");
+  }
+  PRINT_DEBUG("joined network namespace %s", opt.netns_path.c_str());
+  CheckNoNetworkInterfaces();
+
+  // Once per namespace rather than once per action, but whoever created it
+  // may not have done it.
+  EnableLoopbackInterface();
+}
+
+// Where the kernel describes the NUMA nodes, if it supports them.
+static const char kNumaNodeDir[] = "/sys/devices/system/node";
+
+// The most CPUs the kernel supports (NR_CPUS).
+static const int kMaxCpus = 8192;
+
+// Reads a file holding a list like "0-3,8", e.g. the CPUs of a NUMA node.
+// Returns false if it cannot be read.
+static bool ReadIdListFile(const std::string &path, std::vector<int> *ids) {
+  FILE *file = fopen(path.c_str(), "re");
+  if (file == nullptr) {
+    return false;
+  }
+  char *line = nullptr;
+  size_t size = 0;
+  bool ok = getline(&line, &size, file) >= 0 && ParseIdList(line, ids);
+  free(line);
+  fclose(file);
+  return ok;
+}
+
+// Returns the list of ids as ParseIdList() reads it, with ranges.
+static std::string FormatIdList(const std::vector<int> &ids) {
+  std::string list;
+  for (size_t i = 0; i < ids.size();) {
+    size_t last = i;
+    while (last + 1 < ids.size() && ids[last + 1] == ids[last] + 1) {
+      ++last;
+    }
+    if (!list.empty()) {
+      list += ",";
+    }
+    list += std::to_string(ids[i]);
+    if (last > i) {
+      list += "-" + std::to_string(ids[last]);
+    }
+    i = last + 1;
+  }
+  return list;
+}
+
+// Returns the CPUs we may run on.
+static std::vector<int> GetAllowedCpus() {
+  cpu_set_t *set = CPU_ALLOC(kMaxCpus);
+  size_t set_size = CPU_ALLOC_SIZE(kMaxCpus);
+  if (sched_getaffinity(0, set_size, set) < 0) {
+    DIE("sched_getaffinity");
+  }
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < kMaxCpus; ++cpu) {
+    if (CPU_ISSET_S(cpu, set_size, set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  CPU_FREE(set);
+  return cpus;
+}
+
+// Returns the CPUs of the given NUMA node we may run on.
+static std::vector<int> GetNumaNodeCpus(int node,
+                                        const std::vector<int> &allowed) {
+  std::vector<int> cpus;
+  if (!ReadIdListFile(std::string(kNumaNodeDir) + "/node" +
+                          std::to_string(node) + "/cpulist",
+                      &cpus)) {
+    DIE("cannot read the CPUs of NUMA node %d", node);
+  }
+  std::vector<int> usable;
+  for (int cpu : cpus) {
+    if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+      usable.push_back(cpu);
+    }
+  }
+  return usable;
+}
+
+// Prints the NUMA nodes that have memory and CPUs we may run on (see -A).
+// Without NUMA support, all of our CPUs are on node 0.
+static void PrintNumaNodes() {
+  std::vector<int> allowed = GetAllowedCpus();
+  std::vector<int> nodes;
+  if (!ReadIdListFile(std::string(kNumaNodeDir) + "/has_memory", &nodes)) {
+    printf("0 %s\n", FormatIdList(allowed).c_str());
+    return;
+  }
+  for (int node : nodes) {
+    std::vector<int> cpus = GetNumaNodeCpus(node, allowed);
+    if (!cpus.empty()) {
+      printf("%d %s\n", node, FormatIdList(cpus).c_str());
+    }
+  }
+}
+
+// Restricts us to the CPUs (-a) and NUMA nodes (-b) of the options, or to
+// the CPUs of these nodes. The sandboxed process inherits both the affinity
+// and the memory policy.
+static void SetCpuAndMemoryPlacement() {
+  std::vector<int> cpus = opt.cpus;
+  if (cpus.empty() && !opt.numa_nodes.empty()) {
+    // Not leaving the CPUs we were restricted to.
+    std::vector<int> allowed = GetAllowedCpus();
+    for (int node : opt.numa_nodes) {
+      std::vector<int> node_cpus = GetNumaNodeCpus(node, allowed);
+      cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+    }
+    if (cpus.empty()) {
+      DIE("cannot run on any CPU of NUMA nodes %s",
+          FormatIdList(opt.numa_nodes).c_str());
+    }
+  }
+  if (!cpus.empty()) {
+    int max_cpu = *std::max_element(cpus.begin(), cpus.end());
+    if (max_cpu >= kMaxCpus) {
+      DIE("CPU %d does not exist", max_cpu);
+    }
+    cpu_set_t *set = CPU_ALLOC(max_cpu + 1);
+    size_t set_size = CPU_ALLOC_SIZE(max_cpu + 1);
+    CPU_ZERO_S(set_size, set);
+    for (int cpu : cpus) {
+      CPU_SET_S(cpu, set_size, set);
+    }
+    // Fails with EINVAL if our cpuset has none of the CPUs.
+    if (sched_setaffinity(0, set_size, set) < 0) {
+      DIE("sched_setaffinity(%s)", FormatIdList(cpus).c_str());
+    }
+    CPU_FREE(set);
+    PRINT_DEBUG("CPUs: %s", FormatIdList(cpus).c_str());
+  }
+  if (!opt.numa_nodes.empty()) {
+    const int kBitsPerWord = 8 * sizeof(unsigned long);
+    int max_node = *std::max_element(opt.numa_nodes.begin(),
+                                     opt.numa_nodes.end());
+    std::vector<unsigned long> node_mask(max_node / kBitsPerWord + 1);
+    for (int node : opt.numa_nodes) {
+      node_mask[node / kBitsPerWord] |= 1UL << (node % kBitsPerWord);
+    }
+    // The kernel reads one bit less than it is told to.
+    if (syscall(SYS_set_mempolicy, MPOL_BIND, node_mask.data(),
+                node_mask.size() * kBitsPerWord + 1) < 0) {
+      DIE("set_mempolicy(%s)", FormatIdList(opt.numa_nodes).c_str());
+    }
+    PRINT_DEBUG("NUMA nodes: %s", FormatIdList(opt.numa_nodes).c_str());
+  }
+}
+
 static void OnTimeout(int sig) {
   global_signal = sig;
   kill(global_child_pid, global_next_timeout_signal);
@@ -167,26 +584,21 @@ static void SpawnPid1() {
   if (close(sync_pipe[0]) < 0) {
     DIE("close");
   }
+  if (global_cgroup_procs_fd >= 0 && close(global_cgroup_procs_fd) < 0) {
+    DIE("close");
+  }
 }
 
 static int WaitForPid1() {
-  int err, status;
+  int status;
   if (!opt.stats_path.empty()) {
-    struct rusage child_rusage;
-    do {
-      err = wait4(global_child_pid, &status, 0, &child_rusage);
-    } while (err < 0 && errno == EINTR);
-    if (err < 0) {
-      DIE("wait4");
-    }
-    WriteStatsToFile(&child_rusage, opt.stats_path);
-  } else {
-    do {
-      err = waitpid(global_child_pid, &status, 0);
-    } while (err < 0 && errno == EINTR);
-    if (err < 0) {
-      DIE("waitpid");
+    status = WaitChildWithRusage(global_child_pid, &global_pid1_rusage,
+                                 global_stats.mutable_process_io());
+    if (!global_cgroup_dir.empty()) {
+      ReadCgroupUsage(global_stats.mutable_cgroup_usage());
     }
+  } else {
+    status = WaitChild(global_child_pid);
   }
 
   if (global_signal > 0) {
@@ -206,7 +618,21 @@ static int WaitForPid1() {
   }
 }
 
+// Writes the stats (-S) once we are done tearing down the sandbox.
+static void WriteStats() {
+  tools::protos::PhaseTimestamps *timestamps =
+      global_stats.mutable_timestamps();
+  timestamps->set_start_usec(global_start_usec);
+  timestamps->set_child_start_usec(global_pid1_timestamps->child_start_usec);
+  timestamps->set_child_exit_usec(global_pid1_timestamps->child_exit_usec);
+  timestamps->set_end_usec(GetRealtimeMicros());
+  WriteStatsToFile(&global_pid1_rusage, opt.stats_path, &global_stats);
+}
+
 int main(int argc, char *argv[]) {
+  global_start_usec = GetRealtimeMicros();
+  int64_t trace_start_usec = GetMonotonicMicros();
+
   // Ask the kernel to kill us with SIGKILL if our parent dies.
   if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0) {
     DIE("prctl");
@@ -215,19 +641,69 @@ int main(int argc, char *argv[]) {
   ParseOptions(argc, argv);
   global_debug = opt.debug;
 
-  Redirect(opt.stdout_path, STDOUT_FILENO);
-  Redirect(opt.stderr_path, STDERR_FILENO);
+  if (opt.print_numa_nodes) {
+    PrintNumaNodes();
+    return 0;
+  }
+
+  if (!opt.stream_output) {
+    Redirect(opt.stdout_path, STDOUT_FILENO);
+    Redirect(opt.stderr_path, STDERR_FILENO);
+  }
 
   global_outer_uid = getuid();
   global_outer_gid = getgid();
 
+  if (!opt.netns_path.empty()) {
+    JoinNetworkNamespace();
+  }
+  global_parent_uid = getuid();
+  global_parent_gid = getgid();
+
   CloseFds();
+  if (opt.stream_output) {
+    // After CloseFds, which would close the pipes.
+    StreamOutput(opt.stdout_path, opt.stderr_path, /* live= */ true);
+  }
 
   if (opt.timeout_secs > 0) {
     InstallSignalHandler(SIGALRM, OnTimeout);
     SetTimeout(opt.timeout_secs);
   }
 
+  if (!opt.cgroup_parent.empty()) {
+    CreateCgroup();
+  }
+
+  if (!opt.cpus.empty() || !opt.numa_nodes.empty()) {
+    SetCpuAndMemoryPlacement();
+  }
+
+  if (!opt.stats_path.empty()) {
+    void *timestamps =
+        mmap(nullptr, sizeof(struct Pid1Timestamps), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (timestamps == MAP_FAILED) {
+      DIE("mmap");
+    }
+    global_pid1_timestamps = static_cast<struct Pid1Timestamps *>(timestamps);
+  }
+
   SpawnPid1();
-  return WaitForPid1();
+  int64_t trace_spawned_usec = GetMonotonicMicros();
+  TraceEvent("linux-sandbox setup", trace_start_usec, trace_spawned_usec);
+  int exitcode = WaitForPid1();
+  FinishStreamingOutput();
+  int64_t trace_exited_usec = GetMonotonicMicros();
+  TraceEvent("linux-sandbox child", trace_spawned_usec, trace_exited_usec);
+  if (!global_cgroup_dir.empty()) {
+    RemoveCgroup();
+  }
+  if (!opt.stats_path.empty()) {
+    WriteStats();
+  }
+  int64_t trace_end_usec = GetMonotonicMicros();
+  TraceEvent("linux-sandbox teardown", trace_exited_usec, trace_end_usec);
+  TraceEvent("linux-sandbox", trace_start_usec, trace_end_usec);
+  return exitcode;
 }
@@ -15,7 +15,30 @@
 #ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_H_
 #define SRC_MAIN_TOOLS_LINUX_SANDBOX_H_
 
+#include <stdint.h>
+
 extern int global_outer_uid;
 extern int global_outer_gid;
 
+// Our uid and gid in the user namespace linux-sandbox-pid1 creates its own in:
+// the same as global_outer_uid and global_outer_gid, unless we joined the user
+// namespace owning a shared network namespace (-n).
+extern int global_parent_uid;
+extern int global_parent_gid;
+
+// The cgroup.procs file of the action's cgroup, opened by the outer process so
+// that linux-sandbox-pid1 can join it; -1 if there is no such cgroup.
+extern int global_cgroup_procs_fd;
+
+// Timestamps linux-sandbox-pid1 records for the stats (-S), in memory shared
+// with the outer process; global_pid1_timestamps is null without -S.
+struct Pid1Timestamps {
+  int64_t child_start_usec;
+  int64_t child_exit_usec;
+};
+extern struct Pid1Timestamps *global_pid1_timestamps;
+
+// Brings up the loopback interface of our network namespace.
+void EnableLoopbackInterface();
+
 #endif
@@ -29,6 +29,16 @@
     exit(EXIT_FAILURE);                                         \
   }
 
+// Like DIE, but for a child created with vfork(): _exit() does not run the
+// atexit handlers or flush the stdio buffers the child shares with its parent.
+#define DIE_IN_CHILD(...)                                       \
+  {                                                             \
+    fprintf(stderr, __FILE__ ":" S__LINE__ ": \"" __VA_ARGS__); \
+    fprintf(stderr, "\": ");                                    \
+    perror(nullptr);                                            \
+    _exit(EXIT_FAILURE);                                        \
+  }
+
 #define PRINT_DEBUG(...)                                        \
   do {                                                          \
     if (global_debug) {                                         \
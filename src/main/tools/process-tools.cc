@@ -17,6 +17,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,11 +30,26 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/main/tools/logging.h"
 
+#if defined(__linux__) && !defined(SYS_pidfd_open)
+#define SYS_pidfd_open 434
+#endif
+
 int SwitchToEuid() {
   int uid = getuid();
   int euid = geteuid();
@@ -80,6 +97,423 @@ void Redirect(const std::string &target_path, int fd) {
   }
 }
 
+// The state of a stream of StreamOutput.
+struct StreamedOutput {
+  // The descriptor the child writes to, stdout or stderr.
+  int fd;
+  // The read end of the pipe the child writes to; -1 at EOF.
+  int pipe_fd;
+  // The file that gets the output.
+  int file_fd;
+  // The descriptor the output was on before, which gets it live; -1 if the
+  // output is not streamed live or writing to it failed.
+  int live_fd;
+  // Whether live_fd is a pipe, for tee(2), and whether it is non-blocking.
+  bool live_is_pipe;
+  bool live_nonblocking;
+  // Output that could not be written to live_fd yet.
+  std::string backlog;
+  // The number of bytes that did not make it to live_fd.
+  uint64_t live_dropped;
+  // The number of bytes the child wrote.
+  int64_t total;
+  // How many more bytes go to the file directly; unlimited without
+  // OutputLimits::max_bytes.
+  int64_t head_left;
+  // The last bytes written beyond the head, in a ring buffer whose oldest
+  // byte is at tail_start once it is full.
+  std::string tail;
+  size_t tail_start;
+};
+
+static const size_t kMaxStreamBacklog = 4 << 20;
+static const size_t kStreamChunk = 64 << 10;
+
+static std::vector<StreamedOutput> streamed_outputs;
+static OutputLimits stream_limits;
+static std::atomic<pid_t> stream_kill_pgrp(0);
+static std::atomic<bool> stream_killed(false);
+static int stream_stop_pipe[2] = {-1, -1};
+static std::thread *stream_thread = nullptr;
+
+static void SetCloexec(int fd) {
+  if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+    DIE("fcntl(%d, F_SETFD)", fd);
+  }
+}
+
+static void SetNonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    DIE("fcntl(%d, F_SETFL)", fd);
+  }
+}
+
+// Writes all of "data" to "fd", which blocks.
+static bool WriteFully(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// Writes as much of the backlog of "out" to its live descriptor as it takes
+// without blocking.
+static void FlushBacklog(StreamedOutput *out) {
+  while (!out->backlog.empty() && out->live_fd >= 0) {
+    ssize_t written =
+        write(out->live_fd, out->backlog.data(), out->backlog.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // The reader went away; the file still gets everything.
+        out->live_dropped += out->backlog.size();
+        out->backlog.clear();
+        out->live_fd = -1;
+      }
+      return;
+    }
+    out->backlog.erase(0, written);
+  }
+}
+
+// Passes the output in "data" on to the live descriptor of "out", or queues
+// it if the live descriptor cannot take it right now.
+static void StreamLive(StreamedOutput *out, const char *data, size_t size) {
+  if (out->live_fd < 0) {
+    out->live_dropped += size;
+    return;
+  }
+  if (!out->live_nonblocking) {
+    // A terminal or a file: blocking on it is what writing to it directly
+    // would have done too.
+    if (!WriteFully(out->live_fd, data, size)) {
+      out->live_fd = -1;
+    }
+    return;
+  }
+  size_t room = kMaxStreamBacklog - out->backlog.size();
+  if (size > room) {
+    out->live_dropped += size - room;
+    size = room;
+  }
+  out->backlog.append(data, size);
+  FlushBacklog(out);
+}
+
+// Keeps "data" in the tail ring buffer of "out", which holds the last
+// max_bytes / 2 bytes written beyond the head.
+static void KeepTail(StreamedOutput *out, const char *data, size_t size) {
+  size_t capacity = stream_limits.max_bytes - stream_limits.max_bytes / 2;
+  if (size >= capacity) {
+    out->tail.assign(data + size - capacity, capacity);
+    out->tail_start = 0;
+    return;
+  }
+  if (out->tail.size() < capacity) {
+    size_t fill = std::min(size, capacity - out->tail.size());
+    out->tail.append(data, fill);
+    data += fill;
+    size -= fill;
+  }
+  while (size > 0) {
+    size_t n = std::min(size, capacity - out->tail_start);
+    out->tail.replace(out->tail_start, n, data, n);
+    out->tail_start = (out->tail_start + n) % capacity;
+    data += n;
+    size -= n;
+  }
+}
+
+// Accounts for "size" more bytes of output of "out", and kills the child once
+// a stream exceeds OutputLimits::kill_bytes.
+static void CountOutput(StreamedOutput *out, size_t size) {
+  out->total += size;
+  if (stream_limits.kill_bytes > 0 && out->total > stream_limits.kill_bytes &&
+      !stream_killed.exchange(true)) {
+    pid_t pgrp = stream_kill_pgrp;
+    if (pgrp > 0) {
+      kill(-pgrp, SIGKILL);
+    }
+  }
+}
+
+// Writes output that was read from the pipe of "out" to where it goes.
+static void DeliverOutput(StreamedOutput *out, const char *data, size_t size) {
+  CountOutput(out, size);
+  size_t head = std::min(static_cast<int64_t>(size), out->head_left);
+  if (!WriteFully(out->file_fd, data, head)) {
+    DIE("write");
+  }
+  out->head_left -= head;
+  if (head < size) {
+    KeepTail(out, data + head, size - head);
+  }
+  StreamLive(out, data, size);
+}
+
+// Moves what is available in the pipe of "out" on. Returns false at EOF or
+// when nothing was available.
+static bool PumpOutput(StreamedOutput *out) {
+#ifdef __linux__
+  // As long as the data goes to the file in full, it can stay in the kernel.
+  size_t direct = std::min(static_cast<int64_t>(kStreamChunk), out->head_left);
+  ssize_t moved = -1;
+  if (direct > 0 && out->live_fd < 0) {
+    moved = splice(out->pipe_fd, nullptr, out->file_fd, nullptr, direct,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved > 0) {
+      CountOutput(out, moved);
+      out->head_left -= moved;
+      return true;
+    }
+  } else if (direct > 0 && out->live_is_pipe && out->backlog.empty()) {
+    // Duplicate the data into the live pipe, then move the same amount into
+    // the file; neither copies it through user space.
+    moved = tee(out->pipe_fd, out->live_fd, direct, SPLICE_F_NONBLOCK);
+    if (moved > 0) {
+      CountOutput(out, moved);
+      out->head_left -= moved;
+      ssize_t left = moved;
+      while (left > 0) {
+        ssize_t n = splice(out->pipe_fd, nullptr, out->file_fd, nullptr, left,
+                           SPLICE_F_MOVE);
+        if (n <= 0) {
+          break;  // e.g. a file system without splice support
+        }
+        left -= n;
+      }
+      // Copy the rest of what was teed to the file by hand.
+      char buf[4096];
+      while (left > 0) {
+        ssize_t n = read(out->pipe_fd, buf,
+                         std::min(static_cast<size_t>(left), sizeof(buf)));
+        if (n <= 0) {
+          break;
+        }
+        if (!WriteFully(out->file_fd, buf, n)) {
+          DIE("write");
+        }
+        left -= n;
+      }
+      return true;
+    }
+    if (moved < 0 && errno == EINVAL) {
+      out->live_is_pipe = false;  // no tee(2) between these two
+    } else if (moved < 0 && errno == EPIPE) {
+      out->live_fd = -1;
+    }
+  }
+  if (moved == 0) {
+    close(out->pipe_fd);
+    out->pipe_fd = -1;
+    return false;
+  }
+  // Otherwise EAGAIN: either the pipe is empty or the live pipe is full. Find
+  // out by reading, which queues the data for the live pipe.
+#endif
+  char buf[kStreamChunk];
+  ssize_t n = read(out->pipe_fd, buf, sizeof(buf));
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return false;
+  }
+  if (n <= 0) {
+    close(out->pipe_fd);
+    out->pipe_fd = -1;
+    return false;
+  }
+  DeliverOutput(out, buf, n);
+  return true;
+}
+
+// The thread of StreamOutput: copies the output until it is asked to stop,
+// then copies what is left.
+static void PumpOutputs() {
+  bool stopping = false;
+  while (!stopping) {
+    std::vector<struct pollfd> fds;
+    for (const StreamedOutput &out : streamed_outputs) {
+      fds.push_back({out.pipe_fd, POLLIN, 0});
+      fds.push_back({out.backlog.empty() ? -1 : out.live_fd, POLLOUT, 0});
+    }
+    fds.push_back({stream_stop_pipe[0], POLLIN, 0});
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    for (size_t i = 0; i < streamed_outputs.size(); ++i) {
+      StreamedOutput *out = &streamed_outputs[i];
+      if (fds[2 * i + 1].revents != 0) {
+        FlushBacklog(out);
+      }
+      if (out->pipe_fd >= 0 && fds[2 * i].revents != 0) {
+        PumpOutput(out);
+      }
+    }
+    stopping = fds.back().revents != 0;
+  }
+
+  // The child is gone, but something it left behind may still hold the
+  // pipes, so copy only what is there now.
+  for (StreamedOutput &out : streamed_outputs) {
+    while (out.pipe_fd >= 0 && PumpOutput(&out)) {
+    }
+    // Give a slow reader a moment for the rest of the backlog.
+    for (int i = 0; i < 50 && !out.backlog.empty() && out.live_fd >= 0; ++i) {
+      struct pollfd fd = {out.live_fd, POLLOUT, 0};
+      poll(&fd, 1, 100);
+      FlushBacklog(&out);
+    }
+    out.live_dropped += out.backlog.size();
+    if (out.live_dropped > 0 && out.live_nonblocking) {
+      PRINT_DEBUG("%llu bytes of output were not streamed live",
+                  static_cast<unsigned long long>(out.live_dropped));  // NOLINT
+    }
+  }
+}
+
+void StreamOutput(const std::string &stdout_path,
+                  const std::string &stderr_path, bool live,
+                  const OutputLimits &limits) {
+  stream_limits = limits;
+  const std::string *paths[] = {&stdout_path, &stderr_path};
+  for (int fd = STDOUT_FILENO; fd <= STDERR_FILENO; ++fd) {
+    const std::string &path = *paths[fd - STDOUT_FILENO];
+    if (path.empty() || path == "-") {
+      continue;
+    }
+    StreamedOutput out = {};
+    out.fd = fd;
+    out.live_fd = -1;
+    out.head_left = limits.max_bytes > 0 ? limits.max_bytes / 2 : INT64_MAX;
+    // Not O_APPEND, which splice(2) does not write to; only we write to it.
+    out.file_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0666);
+    if (out.file_fd < 0) {
+      DIE("open(%s)", path.c_str());
+    }
+    if (live) {
+      out.live_fd = fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+      if (out.live_fd < 0) {
+        DIE("fcntl(%d, F_DUPFD_CLOEXEC)", fd);
+      }
+      struct stat st;
+      if (fstat(out.live_fd, &st) < 0) {
+        DIE("fstat");
+      }
+      out.live_is_pipe = S_ISFIFO(st.st_mode);
+      if (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)) {
+        // Only the server reads it; a terminal is shared with the user's
+        // shell.
+        SetNonblocking(out.live_fd);
+        out.live_nonblocking = true;
+      }
+    }
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+      DIE("pipe");
+    }
+    SetCloexec(pipe_fds[0]);
+    SetNonblocking(pipe_fds[0]);
+    if (dup2(pipe_fds[1], fd) < 0) {
+      DIE("dup2");
+    }
+    close(pipe_fds[1]);
+    out.pipe_fd = pipe_fds[0];
+    streamed_outputs.push_back(out);
+  }
+  if (streamed_outputs.empty()) {
+    return;
+  }
+  if (pipe(stream_stop_pipe) < 0) {
+    DIE("pipe");
+  }
+  SetCloexec(stream_stop_pipe[0]);
+  SetCloexec(stream_stop_pipe[1]);
+
+  // Signals are for the main thread, and SuperviseChild takes some from a
+  // signalfd, which only works if every thread blocks them.
+  sigset_t all, old_mask;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old_mask);
+  stream_thread = new std::thread(PumpOutputs);
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+}
+
+void SetOutputLimitProcessGroup(pid_t pgrp) {
+  stream_kill_pgrp = pgrp;
+  if (stream_killed) {
+    kill(-pgrp, SIGKILL);  // the limit was hit before we knew whom to kill
+  }
+}
+
+void FinishStreamingOutput(tools::protos::OutputTruncation *truncation) {
+  if (stream_thread == nullptr) {
+    return;
+  }
+  // Our own stdout and stderr are the write ends of the pipes, so the pipes
+  // never see EOF: tell the thread instead.
+  char stop = 0;
+  if (write(stream_stop_pipe[1], &stop, 1) < 0) {
+    DIE("write");
+  }
+  stream_thread->join();
+  delete stream_thread;
+  stream_thread = nullptr;
+  close(stream_stop_pipe[0]);
+  close(stream_stop_pipe[1]);
+  for (StreamedOutput &out : streamed_outputs) {
+    int64_t dropped = 0;
+    if (!out.tail.empty()) {
+      dropped = out.total - stream_limits.max_bytes / 2 - out.tail.size();
+      if (dropped > 0) {
+        std::string marker = "\n[... " + std::to_string(dropped) +
+                             " bytes of output dropped ...]\n";
+        WriteFully(out.file_fd, marker.data(), marker.size());
+      }
+      WriteFully(out.file_fd, out.tail.data() + out.tail_start,
+                 out.tail.size() - out.tail_start);
+      WriteFully(out.file_fd, out.tail.data(), out.tail_start);
+    }
+    if (truncation != nullptr) {
+      if (out.fd == STDOUT_FILENO) {
+        truncation->set_stdout_bytes(out.total);
+        truncation->set_stdout_dropped_bytes(dropped);
+      } else {
+        truncation->set_stderr_bytes(out.total);
+        truncation->set_stderr_dropped_bytes(dropped);
+      }
+    }
+    // Whatever we print from now on goes to the files, as with Redirect.
+    if (dup2(out.file_fd, out.fd) < 0) {
+      DIE("dup2");
+    }
+    close(out.file_fd);
+    if (out.pipe_fd >= 0) {
+      close(out.pipe_fd);
+    }
+    if (out.live_fd >= 0) {
+      close(out.live_fd);
+    }
+  }
+  if (truncation != nullptr) {
+    truncation->set_killed(stream_killed);
+  }
+  streamed_outputs.clear();
+}
+
 void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay) {
   if (gracefully) {
     kill(-pgrp, SIGTERM);
@@ -174,6 +608,119 @@ void SetTimeout(double timeout_secs) {
   }
 }
 
+#ifdef __linux__
+// Arms "timer_fd" to expire once, "secs" seconds from now.
+static void ArmTimer(int timer_fd, double secs) {
+  double int_val, fraction_val;
+  fraction_val = modf(secs, &int_val);
+
+  struct itimerspec timer = {};
+  timer.it_value.tv_sec = static_cast<time_t>(int_val);
+  timer.it_value.tv_nsec = static_cast<long>(fraction_val * 1e9);  // NOLINT
+  if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0) {
+    // An all-zero value would disarm the timer instead.
+    timer.it_value.tv_nsec = 1;
+  }
+
+  if (timerfd_settime(timer_fd, 0, &timer, nullptr) < 0) {
+    DIE("timerfd_settime");
+  }
+}
+
+int SuperviseChild(pid_t pid, double timeout_secs,
+                   double graceful_kill_delay) {
+  int pid_fd = syscall(SYS_pidfd_open, pid, 0);
+  if (pid_fd < 0) {
+    // Most likely a kernel older than 5.3.
+    PRINT_DEBUG("pidfd_open(%d) failed: %s", pid, strerror(errno));
+    return -1;
+  }
+
+  // Take SIGINT and SIGTERM from a signalfd rather than in signal handlers.
+  sigset_t signals, old_mask;
+  if (sigemptyset(&signals) < 0 || sigaddset(&signals, SIGINT) < 0 ||
+      sigaddset(&signals, SIGTERM) < 0) {
+    DIE("sigaddset");
+  }
+  if (sigprocmask(SIG_BLOCK, &signals, &old_mask) < 0) {
+    DIE("sigprocmask");
+  }
+  int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (signal_fd < 0) {
+    DIE("signalfd");
+  }
+
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (timer_fd < 0) {
+    DIE("timerfd_create");
+  }
+  if (timeout_secs > 0) {
+    ArmTimer(timer_fd, timeout_secs);
+  }
+
+  struct pollfd fds[3] = {{pid_fd, POLLIN, 0},
+                          {signal_fd, POLLIN, 0},
+                          {timer_fd, POLLIN, 0}};
+  int last_signal = 0;
+  bool sent_sigterm = false;
+  struct signalfd_siginfo info;
+  for (;;) {
+    if (poll(fds, 3, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+    if (fds[0].revents != 0) {
+      break;  // "pid" exited
+    }
+
+    if (fds[1].revents != 0) {
+      while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        last_signal = info.ssi_signo;
+      }
+      // Signals should kill the process quickly, as it's typically blocking
+      // the return of the prompt after a user hits "Ctrl-C".
+      kill(-pid, SIGKILL);
+    }
+
+    uint64_t expirations;
+    if (fds[2].revents != 0 &&
+        read(timer_fd, &expirations, sizeof(expirations)) ==
+            sizeof(expirations)) {
+      if (last_signal == 0) {
+        last_signal = SIGALRM;
+      }
+      if (!sent_sigterm && graceful_kill_delay > 0) {
+        // A timeout, so we give the process a bit of time to die gracefully
+        // if it needs it. Its exit ends the wait early.
+        kill(-pid, SIGTERM);
+        sent_sigterm = true;
+        ArmTimer(timer_fd, graceful_kill_delay);
+      } else {
+        if (!sent_sigterm) {
+          kill(-pid, SIGTERM);
+        }
+        kill(-pid, SIGKILL);
+      }
+    }
+  }
+
+  // Account for signals that came in after the exit; once unblocked below,
+  // further ones get whatever handling our caller set up.
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    last_signal = info.ssi_signo;
+  }
+  close(timer_fd);
+  close(signal_fd);
+  close(pid_fd);
+  if (sigprocmask(SIG_SETMASK, &old_mask, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  return last_signal;
+}
+#endif
+
 int WaitChild(pid_t pid) {
   int err, status;
 
@@ -188,9 +735,50 @@ int WaitChild(pid_t pid) {
   return status;
 }
 
-int WaitChildWithRusage(pid_t pid, struct rusage *rusage) {
+#ifdef __linux__
+// Reads /proc/<pid>/io, which is only there until "pid" is reaped.
+static void ReadProcessIo(pid_t pid, tools::protos::ProcessIo *io) {
+  std::string path = "/proc/" + std::to_string(pid) + "/io";
+  FILE *file = fopen(path.c_str(), "re");
+  if (file == nullptr) {
+    return;
+  }
+  char key[64];
+  long long value;  // NOLINT
+  while (fscanf(file, "%63[^:]: %lld\n", key, &value) == 2) {
+    if (strcmp(key, "rchar") == 0) {
+      io->set_rchar(value);
+    } else if (strcmp(key, "wchar") == 0) {
+      io->set_wchar(value);
+    } else if (strcmp(key, "read_bytes") == 0) {
+      io->set_read_bytes(value);
+    } else if (strcmp(key, "write_bytes") == 0) {
+      io->set_write_bytes(value);
+    }
+  }
+  fclose(file);
+}
+#endif
+
+int WaitChildWithRusage(pid_t pid, struct rusage *rusage,
+                        tools::protos::ProcessIo *io) {
   int err, status;
 
+#ifdef __linux__
+  if (io != nullptr) {
+    // Wait for the child to exit without reaping it, so that its /proc entry
+    // is still there.
+    siginfo_t info;
+    do {
+      err = waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+    } while (err == -1 && errno == EINTR);
+    if (err == -1) {
+      DIE("waitid");
+    }
+    ReadProcessIo(pid, io);
+  }
+#endif
+
   do {
     err = wait4(pid, &status, 0, rusage);
   } while (err == -1 && errno == EINTR);
@@ -232,8 +820,17 @@ CreateExecutionStatisticsProto(struct rusage *rusage) {
   return execution_statistics;
 }
 
+int64_t GetRealtimeMicros() {
+  struct timeval tv;
+  if (gettimeofday(&tv, nullptr) < 0) {
+    DIE("gettimeofday");
+  }
+  return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
 // Write execution statistics (e.g. resource usage) to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
+void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path,
+                      const tools::protos::ExecutionStatistics *extra) {
   const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
   int fd_out = open(stats_path.c_str(), flags, 0666);
   if (fd_out < 0) {
@@ -242,6 +839,9 @@ void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
 
   std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics =
       CreateExecutionStatisticsProto(rusage);
+  if (extra != nullptr) {
+    execution_statistics->MergeFrom(*extra);
+  }
 
   if (!execution_statistics->SerializeToFileDescriptor(fd_out)) {
     DIE("could not write resource usage to file: %s", stats_path.c_str());
@@ -16,9 +16,18 @@
 #define SRC_MAIN_TOOLS_PROCESS_TOOLS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <string>
 
+namespace tools {
+namespace protos {
+class ExecutionStatistics;
+class OutputTruncation;
+class ProcessIo;
+}  // namespace protos
+}  // namespace tools
+
 // Switch completely to the effective uid.
 // Some programs (notably, bash) ignore the euid and just use the uid. This
 // limits the ability for us to use process-wrapper as a setuid binary for
@@ -31,6 +40,42 @@ int SwitchToEgid();
 // Redirect fd to the file target_path (but not if target_path is empty or "-").
 void Redirect(const std::string &target_path, int fd);
 
+// Limits on the output of StreamOutput, per stream.
+struct OutputLimits {
+  // If positive, the file keeps only the first and the last max_bytes / 2
+  // bytes of the output, with a note of how much was dropped in between.
+  int64_t max_bytes;
+  // If positive, the process group set with SetOutputLimitProcessGroup is
+  // killed with SIGKILL once a stream exceeds this many bytes.
+  int64_t kill_bytes;
+
+  OutputLimits() : max_bytes(0), kill_bytes(0) {}
+};
+
+// Like Redirect for stdout and stderr, but stdout and stderr become pipes,
+// which a thread copies to the files, applying "limits". If "live" is true,
+// the output also streams live to the descriptors that stdout and stderr
+// were. On Linux the copy stays in the kernel (tee(2) and splice(2)) as long
+// as the file takes all of it and the live reader keeps up. When the original
+// descriptor is a pipe or socket that is not read fast enough, up to 4 MB per
+// stream are buffered, and the live copy of anything beyond that is dropped
+// rather than stalling the child. A stream whose path is empty or "-" is left
+// alone.
+void StreamOutput(const std::string &stdout_path,
+                  const std::string &stderr_path, bool live,
+                  const OutputLimits &limits = OutputLimits());
+
+// Sets the process group that is killed when the output exceeds
+// OutputLimits::kill_bytes.
+void SetOutputLimitProcessGroup(pid_t pgrp);
+
+// Once the child is gone, copies what is left in the pipes of StreamOutput,
+// writes the kept tails to the files, stops the thread and points stdout and
+// stderr at the files. Fills "truncation" if it is not null. No-op if
+// StreamOutput was not called.
+void FinishStreamingOutput(
+    tools::protos::OutputTruncation *truncation = nullptr);
+
 // Make sure the process group "pgrp" and all its subprocesses are killed.
 // If "gracefully" is true, sends SIGTERM first and after a timeout of
 // "graceful_kill_delay" seconds, sends SIGKILL.
@@ -54,15 +99,35 @@ void ClearSignalMask();
 // non-positive.
 void SetTimeout(double timeout_secs);
 
+#ifdef __linux__
+// Wait for "pid" to exit, without reaping it, in an event loop over a pidfd,
+// a signalfd and a timerfd. Meanwhile, the process group "pid" is killed like
+// KillEverything does: gracefully once "timeout_secs" passed (if positive),
+// and right away if we receive SIGINT or SIGTERM, which stay blocked while we
+// wait. Returns the signal we received (SIGALRM for the timeout), 0 if "pid"
+// exited on its own, or -1 if the kernel has no pidfd_open(2), in which case
+// nothing was done.
+int SuperviseChild(pid_t pid, double timeout_secs, double graceful_kill_delay);
+#endif
+
 // Wait for "pid" to exit and return its exit code.
 int WaitChild(pid_t pid);
 
 // Wait for "pid" to exit and return its exit code.
 // Resource usage is returned in "rusage" regardless of the exit status of the
-// child process.
-int WaitChildWithRusage(pid_t pid, struct rusage *rusage);
+// child process. If "io" is not null, the I/O counters of the child are read
+// into it before it is reaped, where the system provides them.
+int WaitChildWithRusage(pid_t pid, struct rusage *rusage,
+                        tools::protos::ProcessIo *io = nullptr);
+
+// Returns the wall-clock time in microseconds since the Unix epoch.
+int64_t GetRealtimeMicros();
 
-// Write execution statistics to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path);
+// Write execution statistics to a file. The resource usage comes from
+// "rusage"; whatever else the caller collected is merged in from "extra" if it
+// is not null.
+void WriteStatsToFile(
+    struct rusage *rusage, const std::string &stats_path,
+    const tools::protos::ExecutionStatistics *extra = nullptr);
 
 #endif  // PROCESS_TOOLS_H__
@@ -25,27 +25,41 @@
 #include <unistd.h>
 #include <vector>
 
+#include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 #include "src/main/tools/process-wrapper-options.h"
 #include "src/main/tools/process-wrapper.h"
+#include "src/main/tools/trace.h"
 
+int64_t LegacyProcessWrapper::start_usec = 0;
+int64_t LegacyProcessWrapper::child_start_usec = 0;
+int64_t LegacyProcessWrapper::trace_start_usec = 0;
+int64_t LegacyProcessWrapper::child_trace_start_usec = 0;
 pid_t LegacyProcessWrapper::child_pid = 0;
 volatile sig_atomic_t LegacyProcessWrapper::last_signal = 0;
 
-void LegacyProcessWrapper::RunCommand() {
+void LegacyProcessWrapper::RunCommand(int64_t start_usec) {
+  LegacyProcessWrapper::start_usec = start_usec;
+  trace_start_usec = GetMonotonicMicros();
   SpawnChild();
   WaitForChild();
 }
 
 void LegacyProcessWrapper::SpawnChild() {
-  child_pid = fork();
-  if (child_pid < 0) {
-    DIE("fork");
-  } else if (child_pid == 0) {
+  // vfork() saves copying our page tables just for the child to call
+  // execvp(). The child shares our memory until then, so it only changes
+  // process attributes, and it must not call exit(). No signal handlers of
+  // ours are installed yet, see WaitForChild.
+  child_start_usec = GetRealtimeMicros();
+  child_trace_start_usec = GetMonotonicMicros();
+  pid_t pid = vfork();
+  if (pid < 0) {
+    DIE("vfork");
+  } else if (pid == 0) {
     // In child.
     if (setsid() < 0) {
-      DIE("setsid");
+      DIE_IN_CHILD("setsid");
     }
     ClearSignalMask();
 
@@ -54,34 +68,66 @@ void LegacyProcessWrapper::SpawnChild() {
     umask(022);
 
     // Does not return unless something went wrong.
-    if (execvp(opt.args[0], opt.args.data()) < 0) {
-      DIE("execvp(%s, ...)", opt.args[0]);
-    }
+    execvp(opt.args[0], opt.args.data());
+    DIE_IN_CHILD("execvp(%s, ...)", opt.args[0]);
   }
+  child_pid = pid;
+  SetOutputLimitProcessGroup(child_pid);
 }
 
 void LegacyProcessWrapper::WaitForChild() {
-  // Set up a signal handler which kills all subprocesses when the given signal
-  // is triggered.
-  InstallSignalHandler(SIGALRM, OnSignal);
-  InstallSignalHandler(SIGTERM, OnSignal);
-  InstallSignalHandler(SIGINT, OnSignal);
-  if (opt.timeout_secs > 0) {
-    SetTimeout(opt.timeout_secs);
+  bool supervised = false;
+#ifdef __linux__
+  // Handle the timeout and signals in an event loop, which leaves the child to
+  // be reaped below, if the kernel supports it.
+  int sig = SuperviseChild(child_pid, opt.timeout_secs, opt.kill_delay_secs);
+  if (sig >= 0) {
+    last_signal = sig;
+    supervised = true;
+  }
+#endif
+  if (!supervised) {
+    // Set up a signal handler which kills all subprocesses when the given
+    // signal is triggered.
+    InstallSignalHandler(SIGALRM, OnSignal);
+    InstallSignalHandler(SIGTERM, OnSignal);
+    InstallSignalHandler(SIGINT, OnSignal);
+    if (opt.timeout_secs > 0) {
+      SetTimeout(opt.timeout_secs);
+    }
   }
 
   int status;
   if (!opt.stats_path.empty()) {
     struct rusage child_rusage;
-    status = WaitChildWithRusage(child_pid, &child_rusage);
-    WriteStatsToFile(&child_rusage, opt.stats_path);
+    tools::protos::ExecutionStatistics stats;
+    tools::protos::PhaseTimestamps *timestamps = stats.mutable_timestamps();
+    status = WaitChildWithRusage(child_pid, &child_rusage,
+                                 stats.mutable_process_io());
+    timestamps->set_child_exit_usec(GetRealtimeMicros());
+
+    // The child is done for, but may have grandchildren that we still have to
+    // kill.
+    kill(-child_pid, SIGKILL);
+    FinishStreamingOutput(opt.max_output_bytes > 0 || opt.kill_output_bytes > 0
+                              ? stats.mutable_output_truncation()
+                              : nullptr);
+
+    timestamps->set_start_usec(start_usec);
+    timestamps->set_child_start_usec(child_start_usec);
+    timestamps->set_end_usec(GetRealtimeMicros());
+    WriteStatsToFile(&child_rusage, opt.stats_path, &stats);
   } else {
     status = WaitChild(child_pid);
-  }
 
-  // The child is done for, but may have grandchildren that we still have to
-  // kill.
-  kill(-child_pid, SIGKILL);
+    // The child is done for, but may have grandchildren that we still have to
+    // kill.
+    kill(-child_pid, SIGKILL);
+    FinishStreamingOutput();
+  }
+  int64_t trace_end_usec = GetMonotonicMicros();
+  TraceEvent("process-wrapper child", child_trace_start_usec, trace_end_usec);
+  TraceEvent("process-wrapper", trace_start_usec, trace_end_usec);
 
   if (last_signal > 0) {
     // Don't trust the exit code if we got a timeout or signal.
@@ -16,6 +16,7 @@
 #define SRC_MAIN_TOOLS_PROCESS_WRAPPER_LEGACY_H_
 
 #include <signal.h>
+#include <stdint.h>
 #include <vector>
 
 // The process-wrapper implementation that was used until and including Bazel
@@ -34,14 +35,20 @@
 class LegacyProcessWrapper {
  public:
   // Run the command specified in the `opt.args` array and kill it after
-  // `opt.timeout_secs` seconds.
-  static void RunCommand();
+  // `opt.timeout_secs` seconds. `start_usec` is when process-wrapper started,
+  // for the stats.
+  static void RunCommand(int64_t start_usec);
 
  private:
   static void SpawnChild();
   static void WaitForChild();
   static void OnSignal(int sig);
 
+  static int64_t start_usec;
+  static int64_t child_start_usec;
+  // The same, from GetMonotonicMicros(), for the trace events.
+  static int64_t trace_start_usec;
+  static int64_t child_trace_start_usec;
   static pid_t child_pid;
   static volatile sig_atomic_t last_signal;
 };
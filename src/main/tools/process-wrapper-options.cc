@@ -14,6 +14,7 @@
 
 #include "src/main/tools/process-wrapper-options.h"
 
+#include <errno.h>
 #include <getopt.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -45,12 +46,30 @@ static void Usage(char *program_name, const char *fmt, ...) {
       "before killing the child with SIGKILL\n"
       "  -o/--stdout <file>  redirect stdout to a file\n"
       "  -e/--stderr <file>  redirect stderr to a file\n"
+      "  -O/--stream_output  also stream the redirected stdout and stderr "
+      "live to where they were\n"
+      "  --max_output_bytes <n>  keep only the first and last n/2 bytes of "
+      "each of the stdout and stderr files\n"
+      "  --kill_output_bytes <n>  kill the child once it wrote more than n "
+      "bytes to stdout or stderr\n"
       "  -s/--stats <file>  if set, write stats in protobuf format to a file\n"
       "  -d/--debug  if set, debug info will be printed\n"
       "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
 }
 
+// Parses a non-negative byte count.
+static bool ParseBytes(const char *value, int64_t *result) {
+  char *end;
+  errno = 0;
+  long long bytes = strtoll(value, &end, 10);  // NOLINT
+  if (errno != 0 || end == value || *end != '\0' || bytes < 0) {
+    return false;
+  }
+  *result = bytes;
+  return true;
+}
+
 // Parses command line flags from an argv array and puts the results into the
 // global `opt` struct.
 static void ParseCommandLine(const std::vector<char *> &args) {
@@ -59,6 +78,9 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       {"kill_delay", required_argument, 0, 'k'},
       {"stdout", required_argument, 0, 'o'},
       {"stderr", required_argument, 0, 'e'},
+      {"stream_output", no_argument, 0, 'O'},
+      {"max_output_bytes", required_argument, 0, 'M'},
+      {"kill_output_bytes", required_argument, 0, 'K'},
       {"stats", required_argument, 0, 's'},
       {"debug", no_argument, 0, 'd'},
       {0, 0, 0, 0}};
@@ -66,7 +88,7 @@ static void ParseCommandLine(const std::vector<char *> &args) {
   extern int optind, optopt;
   int c;
 
-  while ((c = getopt_long(args.size(), args.data(), "+:t:k:o:e:s:d",
+  while ((c = getopt_long(args.size(), args.data(), "+:t:k:o:e:Os:d",
                           long_options, nullptr)) != -1) {
     switch (c) {
       case 't':
@@ -95,6 +117,19 @@ static void ParseCommandLine(const std::vector<char *> &args) {
                 "Cannot redirect stderr (-e) to more than one destination.");
         }
         break;
+      case 'O':
+        opt.stream_output = true;
+        break;
+      case 'M':
+        if (!ParseBytes(optarg, &opt.max_output_bytes)) {
+          Usage(args.front(), "Invalid --max_output_bytes value: %s", optarg);
+        }
+        break;
+      case 'K':
+        if (!ParseBytes(optarg, &opt.kill_output_bytes)) {
+          Usage(args.front(), "Invalid --kill_output_bytes value: %s", optarg);
+        }
+        break;
       case 's':
         if (opt.stats_path.empty()) {
           opt.stats_path.assign(optarg);
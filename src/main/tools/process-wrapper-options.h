@@ -15,6 +15,7 @@
 #ifndef SRC_MAIN_TOOLS_PROCESS_WRAPPER_OPTIONS_H_
 #define SRC_MAIN_TOOLS_PROCESS_WRAPPER_OPTIONS_H_
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -28,6 +29,14 @@ struct Options {
   std::string stdout_path;
   // Where to redirect stderr (-e)
   std::string stderr_path;
+  // Whether to also stream stdout and stderr live to where they were (-O)
+  bool stream_output;
+  // Keep only the head and tail of this many bytes of each output file, 0 for
+  // no limit (--max_output_bytes)
+  int64_t max_output_bytes;
+  // Kill the command once an output exceeds this many bytes, 0 for no limit
+  // (--kill_output_bytes)
+  int64_t kill_output_bytes;
   // Whether to print debugging messages (-d)
   bool debug;
   // Where to write stats, in protobuf format (-s)
@@ -12,15 +12,433 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <iostream>
+// process-wrapper runs a subprocess with a given timeout (optional),
+// redirecting stdout and stderr to given files. The subprocess and all of its
+// descendants run in a job object, so that they are all killed when the
+// subprocess exits or times out, or when process-wrapper itself dies.
+//
+// On a timeout, the subprocess gets a Ctrl-Break event, then the job is
+// terminated after the kill delay. process-wrapper then exits with 142, the
+// exit code of a shell whose child died of SIGALRM, like on POSIX. Otherwise
+// the exit code is the one of the subprocess.
+//
+// The flags are the ones of the POSIX version, except that the output limits
+// are not supported.
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "src/main/native/windows/util.h"
+#include "src/main/protobuf/execution_statistics.pb.h"
+
+using std::wstring;
+
+namespace {
+
+// The exit code on a timeout: 128 + SIGALRM.
+const DWORD kTimeoutExitCode = 142;
+
+struct Options {
+  // How long to wait before killing the child (0 means no timeout).
+  double timeout_secs;
+  // How long to wait after the Ctrl-Break before terminating the job.
+  double kill_delay_secs;
+  // Where to redirect stdout (empty means no redirection).
+  wstring stdout_path;
+  // Where to redirect stderr (empty means no redirection).
+  wstring stderr_path;
+  // Where to write the ExecutionStatistics proto (empty means nowhere).
+  wstring stats_path;
+  // Whether to print debugging messages.
+  bool debug;
+  // The command to run.
+  std::vector<wstring> args;
+
+  Options() : timeout_secs(0), kill_delay_secs(0), debug(false) {}
+};
+
+Options opt;
+
+void Usage(const wchar_t* program_name, const wchar_t* fmt,
+           const wstring& arg) {
+  fwprintf(stderr, L"\nUsage: %s -- command arg1 @args\n", program_name);
+  fwprintf(stderr,
+           L"\nPossible arguments:\n"
+           L"  -t/--timeout <timeout>  timeout after which the child process "
+           L"will be terminated\n"
+           L"  -k/--kill_delay <timeout>  in case timeout occurs, how long to "
+           L"wait before terminating the job\n"
+           L"  -o/--stdout <file>  redirect stdout to a file\n"
+           L"  -e/--stderr <file>  redirect stderr to a file\n"
+           L"  -s/--stats <file>  if set, write stats in protobuf format to a "
+           L"file\n"
+           L"  -d/--debug  if set, debug info will be printed\n"
+           L"  --  command to run inside the job object, followed by "
+           L"arguments\n");
+  fwprintf(stderr, L"\n");
+  fwprintf(stderr, fmt, arg.c_str());
+  fwprintf(stderr, L"\n");
+  exit(EXIT_FAILURE);
+}
+
+#define PRINT_DEBUG(fmt, ...)                                       \
+  do {                                                              \
+    if (opt.debug) {                                                \
+      fwprintf(stderr, L"process-wrapper: " fmt L"\n", __VA_ARGS__); \
+    }                                                               \
+  } while (0)
+
+#define DIE(fmt, ...)                                                   \
+  do {                                                                  \
+    fwprintf(stderr, L"process-wrapper: " fmt L": %s\n", __VA_ARGS__,    \
+             bazel::windows::GetLastErrorString(GetLastError()).c_str()); \
+    exit(EXIT_FAILURE);                                                 \
+  } while (0)
+
+double ParseSeconds(const wchar_t* program_name, const wstring& arg) {
+  wchar_t* end;
+  double value = wcstod(arg.c_str(), &end);
+  if (arg.empty() || *end != L'\0' || value < 0) {
+    Usage(program_name, L"Not a valid number of seconds: %s", arg);
+  }
+  return value;
+}
+
+// Parses the flags of the POSIX process-wrapper. getopt_long(3) is not
+// available here, so this accepts the "--flag=value", "--flag value" and
+// "-f value" forms, up to the first argument that is not a flag or "--".
+void ParseOptions(int argc, wchar_t** argv) {
+  struct Flag {
+    const wchar_t* long_name;
+    const wchar_t* short_name;
+    wstring* path;
+    double* seconds;
+    bool* on;
+  };
+  const Flag flags[] = {
+      {L"--timeout", L"-t", nullptr, &opt.timeout_secs, nullptr},
+      {L"--kill_delay", L"-k", nullptr, &opt.kill_delay_secs, nullptr},
+      {L"--stdout", L"-o", &opt.stdout_path, nullptr, nullptr},
+      {L"--stderr", L"-e", &opt.stderr_path, nullptr, nullptr},
+      {L"--stats", L"-s", &opt.stats_path, nullptr, nullptr},
+      {L"--debug", L"-d", nullptr, nullptr, &opt.debug},
+  };
+
+  int i = 1;
+  for (; i < argc; ++i) {
+    wstring arg = argv[i];
+    if (arg == L"--") {
+      ++i;
+      break;
+    }
+    if (arg.empty() || arg[0] != L'-') {
+      break;
+    }
+    wstring name = arg;
+    wstring value;
+    bool has_value = false;
+    size_t eq = arg.find(L'=');
+    if (arg.compare(0, 2, L"--") == 0 && eq != wstring::npos) {
+      name = arg.substr(0, eq);
+      value = arg.substr(eq + 1);
+      has_value = true;
+    }
+    const Flag* flag = nullptr;
+    for (const Flag& f : flags) {
+      if (name == f.long_name || name == f.short_name) {
+        flag = &f;
+        break;
+      }
+    }
+    if (flag == nullptr) {
+      Usage(argv[0], L"Unrecognized argument: %s", arg);
+    }
+    if (flag->on != nullptr) {
+      if (has_value) {
+        Usage(argv[0], L"Flag takes no value: %s", arg);
+      }
+      *flag->on = true;
+      continue;
+    }
+    if (!has_value) {
+      if (++i == argc) {
+        Usage(argv[0], L"Missing value for %s", arg);
+      }
+      value = argv[i];
+    }
+    if (flag->seconds != nullptr) {
+      *flag->seconds = ParseSeconds(argv[0], value);
+    } else {
+      *flag->path = value;
+    }
+  }
+
+  for (; i < argc; ++i) {
+    opt.args.push_back(argv[i]);
+  }
+  if (opt.args.empty()) {
+    Usage(argv[0], L"%s", L"No command specified.");
+  }
+}
+
+// Quotes `arg` so that CommandLineToArgvW and the C runtime parse it back
+// unchanged.
+wstring QuoteArg(const wstring& arg) {
+  if (!arg.empty() && arg.find_first_of(L" \t\n\v\"") == wstring::npos) {
+    return arg;
+  }
+  wstring result = L"\"";
+  for (size_t i = 0;; ++i) {
+    size_t backslashes = 0;
+    while (i < arg.size() && arg[i] == L'\\') {
+      ++backslashes;
+      ++i;
+    }
+    if (i == arg.size()) {
+      // Double the backslashes so that the closing quote is not escaped.
+      result.append(backslashes * 2, L'\\');
+      break;
+    } else if (arg[i] == L'"') {
+      result.append(backslashes * 2 + 1, L'\\');
+      result.push_back(L'"');
+    } else {
+      result.append(backslashes, L'\\');
+      result.push_back(arg[i]);
+    }
+  }
+  result.push_back(L'"');
+  return result;
+}
+
+// Opens `path` for writing as an inheritable handle, appending to it so that
+// the subprocess and its descendants do not overwrite each other's output.
+HANDLE OpenOutput(const wstring& path) {
+  SECURITY_ATTRIBUTES sa = {0};
+  sa.nLength = sizeof(sa);
+  sa.bInheritHandle = TRUE;
+  HANDLE handle = CreateFileW(
+      /* lpFileName */ path.c_str(),
+      /* dwDesiredAccess */ FILE_APPEND_DATA,
+      /* dwShareMode */ FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      /* lpSecurityAttributes */ &sa,
+      /* dwCreationDisposition */ CREATE_ALWAYS,
+      /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
+      /* hTemplateFile */ NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    DIE(L"CreateFileW(%s)", path.c_str());
+  }
+  return handle;
+}
 
-int main(int argc, char** argv) {
-  // TODO(bazel-team): implement this program.
-  std::cout << "ERROR: process-wrapper is not yet implemented on Windows."
-            << std::endl
-            << "Called with args:" << std::endl;
-  for (int i = 0; i < argc; ++i) {
-    std::cout << "argv[" << i << "]=(" << argv[i] << ")" << std::endl;
+// Returns an inheritable duplicate of the standard handle `which`, or NULL.
+HANDLE InheritableStdHandle(DWORD which) {
+  HANDLE handle = GetStdHandle(which);
+  HANDLE result = NULL;
+  if (handle == NULL || handle == INVALID_HANDLE_VALUE ||
+      !DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(),
+                       &result, 0, TRUE, DUPLICATE_SAME_ACCESS)) {
+    return NULL;
   }
-  return 1;
+  return result;
+}
+
+// Returns the wall-clock time in microseconds since the Unix epoch.
+int64_t GetRealtimeMicros() {
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  // FILETIME counts 100 nanoseconds since 1601-01-01.
+  uint64_t ticks =
+      (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+  return static_cast<int64_t>((ticks - 116444736000000000ULL) / 10);
+}
+
+DWORD ToMillis(double seconds) {
+  return static_cast<DWORD>(seconds * 1000);
+}
+
+// Writes the resource usage of the job and `timestamps` to `stats_path`, as
+// the ExecutionStatistics proto the POSIX process-wrapper writes.
+void WriteStatsToFile(const wstring& stats_path, HANDLE job,
+                      tools::protos::PhaseTimestamps* timestamps) {
+  tools::protos::ExecutionStatistics stats;
+  JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting;
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+  if (QueryInformationJobObject(job, JobObjectBasicAndIoAccountingInformation,
+                                &accounting, sizeof(accounting), NULL) &&
+      QueryInformationJobObject(job, JobObjectExtendedLimitInformation,
+                                &limits, sizeof(limits), NULL)) {
+    // The job's times are in units of 100 nanoseconds.
+    int64_t user_usec = accounting.BasicInfo.TotalUserTime.QuadPart / 10;
+    int64_t kernel_usec = accounting.BasicInfo.TotalKernelTime.QuadPart / 10;
+
+    tools::protos::ResourceUsage* resource_usage =
+        stats.mutable_resource_usage();
+    resource_usage->set_utime_sec(user_usec / 1000000);
+    resource_usage->set_utime_usec(user_usec % 1000000);
+    resource_usage->set_stime_sec(kernel_usec / 1000000);
+    resource_usage->set_stime_usec(kernel_usec % 1000000);
+    // In kilobytes, like the largest process of the tree in getrusage(2).
+    resource_usage->set_maxrss(limits.PeakProcessMemoryUsed / 1024);
+    resource_usage->set_inblock(accounting.IoInfo.ReadOperationCount);
+    resource_usage->set_oublock(accounting.IoInfo.WriteOperationCount);
+
+    tools::protos::CgroupUsage* tree_usage = stats.mutable_cgroup_usage();
+    tree_usage->set_memory_peak_bytes(limits.PeakJobMemoryUsed);
+    tree_usage->set_cpu_usage_usec(user_usec + kernel_usec);
+    tree_usage->set_cpu_user_usec(user_usec);
+    tree_usage->set_cpu_system_usec(kernel_usec);
+    tree_usage->set_io_read_bytes(accounting.IoInfo.ReadTransferCount);
+    tree_usage->set_io_write_bytes(accounting.IoInfo.WriteTransferCount);
+  } else {
+    PRINT_DEBUG(L"QueryInformationJobObject failed: %s",
+                bazel::windows::GetLastErrorString(GetLastError()).c_str());
+  }
+  timestamps->set_end_usec(GetRealtimeMicros());
+  stats.mutable_timestamps()->Swap(timestamps);
+
+  std::ofstream stats_file(stats_path.c_str(), std::ios::out |
+                                                   std::ios::binary |
+                                                   std::ios::trunc);
+  if (!stats.SerializeToOstream(&stats_file)) {
+    fwprintf(stderr,
+             L"process-wrapper: could not write resource usage to file: %s\n",
+             stats_path.c_str());
+    exit(EXIT_FAILURE);
+  }
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t** argv) {
+  tools::protos::PhaseTimestamps timestamps;
+  timestamps.set_start_usec(GetRealtimeMicros());
+  ParseOptions(argc, argv);
+
+  // The job kills the whole process tree once its last handle is closed,
+  // which is at the latest when process-wrapper exits or is killed.
+  HANDLE job = CreateJobObjectW(NULL, NULL);
+  if (job == NULL) {
+    DIE(L"%s", L"CreateJobObjectW");
+  }
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info = {0};
+  job_info.BasicLimitInformation.LimitFlags =
+      JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+  if (!SetInformationJobObject(job, JobObjectExtendedLimitInformation,
+                               &job_info, sizeof(job_info))) {
+    DIE(L"%s", L"SetInformationJobObject");
+  }
+
+  STARTUPINFOW startup_info = {0};
+  startup_info.cb = sizeof(startup_info);
+  startup_info.dwFlags = STARTF_USESTDHANDLES;
+  startup_info.hStdInput = InheritableStdHandle(STD_INPUT_HANDLE);
+  startup_info.hStdOutput = opt.stdout_path.empty()
+                                ? InheritableStdHandle(STD_OUTPUT_HANDLE)
+                                : OpenOutput(opt.stdout_path);
+  if (opt.stderr_path.empty()) {
+    startup_info.hStdError = InheritableStdHandle(STD_ERROR_HANDLE);
+  } else if (opt.stderr_path == opt.stdout_path) {
+    startup_info.hStdError = startup_info.hStdOutput;
+  } else {
+    startup_info.hStdError = OpenOutput(opt.stderr_path);
+  }
+
+  wstring cmdline;
+  for (const wstring& arg : opt.args) {
+    if (!cmdline.empty()) {
+      cmdline.push_back(L' ');
+    }
+    cmdline += QuoteArg(arg);
+  }
+  PRINT_DEBUG(L"running %s", cmdline.c_str());
+
+  // CreateProcessW may modify the command line in place.
+  std::vector<wchar_t> mutable_cmdline(cmdline.begin(), cmdline.end());
+  mutable_cmdline.push_back(L'\0');
+  PROCESS_INFORMATION process_info = {0};
+  if (!CreateProcessW(
+          /* lpApplicationName */ NULL,
+          /* lpCommandLine */ mutable_cmdline.data(),
+          /* lpProcessAttributes */ NULL,
+          /* lpThreadAttributes */ NULL,
+          /* bInheritHandles */ TRUE,
+          /* dwCreationFlags */ CREATE_SUSPENDED |  // so that it is in the job
+                                                    // before it starts
+              CREATE_NEW_PROCESS_GROUP |  // so that it can get a Ctrl-Break
+              CREATE_UNICODE_ENVIRONMENT,
+          /* lpEnvironment */ NULL,
+          /* lpCurrentDirectory */ NULL,
+          /* lpStartupInfo */ &startup_info,
+          /* lpProcessInformation */ &process_info)) {
+    DIE(L"CreateProcessW(%s)", cmdline.c_str());
+  }
+  if (!AssignProcessToJobObject(job, process_info.hProcess)) {
+    DWORD error = GetLastError();
+    TerminateProcess(process_info.hProcess, EXIT_FAILURE);
+    SetLastError(error);
+    DIE(L"%s", L"AssignProcessToJobObject");
+  }
+  timestamps.set_child_start_usec(GetRealtimeMicros());
+  ResumeThread(process_info.hThread);
+  CloseHandle(process_info.hThread);
+
+  // Only the child needs these now.
+  HANDLE std_handles[] = {startup_info.hStdInput, startup_info.hStdOutput,
+                          startup_info.hStdError};
+  for (int i = 0; i < 3; ++i) {
+    if (std_handles[i] != NULL && (i < 2 || std_handles[i] != std_handles[1])) {
+      CloseHandle(std_handles[i]);
+    }
+  }
+
+  bool timed_out = false;
+  DWORD wait = WaitForSingleObject(
+      process_info.hProcess,
+      opt.timeout_secs > 0 ? ToMillis(opt.timeout_secs) : INFINITE);
+  if (wait == WAIT_TIMEOUT) {
+    timed_out = true;
+    PRINT_DEBUG(L"timed out after %g seconds", opt.timeout_secs);
+    // Give the process a bit of time to die gracefully, like SIGTERM does on
+    // POSIX. The event goes to the process group of the child, which has no
+    // console if process-wrapper has none, so this may fail harmlessly.
+    if (opt.kill_delay_secs > 0 &&
+        GenerateConsoleCtrlEvent(CTRL_BREAK_EVENT, process_info.dwProcessId)) {
+      wait = WaitForSingleObject(process_info.hProcess,
+                                 ToMillis(opt.kill_delay_secs));
+    }
+    if (wait != WAIT_OBJECT_0) {
+      TerminateJobObject(job, kTimeoutExitCode);
+      WaitForSingleObject(process_info.hProcess, INFINITE);
+    }
+  } else if (wait != WAIT_OBJECT_0) {
+    DIE(L"%s", L"WaitForSingleObject");
+  }
+  timestamps.set_child_exit_usec(GetRealtimeMicros());
+
+  DWORD exit_code;
+  if (!GetExitCodeProcess(process_info.hProcess, &exit_code)) {
+    DIE(L"%s", L"GetExitCodeProcess");
+  }
+  CloseHandle(process_info.hProcess);
+
+  // The child is done for, but may have descendants that we still have to
+  // kill. Terminate them before collecting the statistics, so that these
+  // cover the whole tree.
+  TerminateJobObject(job, exit_code);
+  if (!opt.stats_path.empty()) {
+    WriteStatsToFile(opt.stats_path, job, &timestamps);
+  }
+  CloseHandle(job);
+
+  // Don't trust the exit code if we got a timeout.
+  return timed_out ? kTimeoutExitCode : exit_code;
 }
@@ -44,15 +44,24 @@
 #include "src/main/tools/process-wrapper-options.h"
 
 int main(int argc, char *argv[]) {
+  int64_t start_usec = GetRealtimeMicros();
   ParseOptions(argc, argv);
 
   SwitchToEuid();
   SwitchToEgid();
 
-  Redirect(opt.stdout_path, STDOUT_FILENO);
-  Redirect(opt.stderr_path, STDERR_FILENO);
+  if (opt.stream_output || opt.max_output_bytes > 0 ||
+      opt.kill_output_bytes > 0) {
+    OutputLimits limits;
+    limits.max_bytes = opt.max_output_bytes;
+    limits.kill_bytes = opt.kill_output_bytes;
+    StreamOutput(opt.stdout_path, opt.stderr_path, opt.stream_output, limits);
+  } else {
+    Redirect(opt.stdout_path, STDOUT_FILENO);
+    Redirect(opt.stderr_path, STDERR_FILENO);
+  }
 
-  LegacyProcessWrapper::RunCommand();
+  LegacyProcessWrapper::RunCommand(start_usec);
 
   return 0;
 }
@@ -0,0 +1,59 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/tools/trace.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// The file descriptor of BAZEL_TRACE_FILE, -1 if tracing is off, or -2 if the
+// variable was not looked at yet.
+static int trace_fd = -2;
+
+int64_t GetMonotonicMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void TraceEvent(const char *name, int64_t start_usec, int64_t end_usec) {
+  if (trace_fd == -2) {
+    const char *path = getenv("BAZEL_TRACE_FILE");
+    trace_fd = path == nullptr || *path == 0
+                   ? -1
+                   : open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                          0666);
+  }
+  if (trace_fd < 0) {
+    return;
+  }
+  // The names are literals of the tools, so they need no JSON escaping. With
+  // O_APPEND, a single write() of a line keeps the lines of concurrent tools
+  // apart.
+  char line[512];
+  int len = snprintf(line, sizeof(line),
+                     "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64
+                     ",\"dur\":%" PRId64 ",\"pid\":%d,\"tid\":0}\n",
+                     name, start_usec, end_usec - start_usec,
+                     static_cast<int>(getpid()));
+  if (len > 0 && len < static_cast<int>(sizeof(line))) {
+    // Tracing is best effort: a failed write does not fail the tool.
+    ssize_t unused = write(trace_fd, line, len);
+    (void)unused;
+  }
+}
@@ -0,0 +1,53 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SRC_MAIN_TOOLS_TRACE_H_
+#define SRC_MAIN_TOOLS_TRACE_H_
+
+#include <stdint.h>
+
+// Trace events of the native tools, in the JSON trace file format of the
+// server's --experimental_generate_json_trace_profile output.
+//
+// Tracing is off unless the environment variable BAZEL_TRACE_FILE names a
+// file. Every event is then appended to that file as a line of its own, a JSON
+// object like the elements of the trace's JSON array, so several tools can
+// share the file. The events are labelled with the process id of the tool.
+// Timestamps are microseconds of CLOCK_MONOTONIC, the clock that the server's
+// System.nanoTime() reads on Linux, so they line up with the server's events
+// once shifted by the server's profile start time.
+
+// Returns the time in microseconds of CLOCK_MONOTONIC.
+int64_t GetMonotonicMicros();
+
+// Appends an event "name" that took from "start_usec" to "end_usec", both
+// obtained from GetMonotonicMicros(). Does nothing if tracing is off. Must not
+// be called in a child created with vfork().
+void TraceEvent(const char *name, int64_t start_usec, int64_t end_usec);
+
+// Records the time spent in its scope as an event. Since the tools often
+// exit() without unwinding, call TraceEvent() directly in such places.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name)
+      : name_(name), start_usec_(GetMonotonicMicros()) {}
+
+  ~TraceScope() { TraceEvent(name_, start_usec_, GetMonotonicMicros()); }
+
+ private:
+  const char *name_;
+  const int64_t start_usec_;
+};
+
+#endif  // SRC_MAIN_TOOLS_TRACE_H_
@@ -46,4 +46,8 @@ if [ -n "${EMBEDDED_TOOLS}" ]; then
   (cd ${PACKAGE_DIR}/embedded_tools && unzip -q "${WORKDIR}/${EMBEDDED_TOOLS}")
 fi
 
-(cd ${PACKAGE_DIR} && find . -type f | sort | zip -qDX@ "${WORKDIR}/${OUT}")
+# Files that are compressed already are stored as they are: deflating them
+# again barely shrinks them, but the client would have to inflate them on every
+# extraction.
+(cd ${PACKAGE_DIR} && find . -type f | sort | \
+    zip -qDX -n .jar:.zip:.gz:.tgz:.xz:.bz2 -@ "${WORKDIR}/${OUT}")
@@ -83,7 +83,16 @@ TEST_F(BazelStartupOptionsTest, ValidStartupFlags) {
   ExpectIsNullaryOption(options, "block_for_lock");
   ExpectIsNullaryOption(options, "client_debug");
   ExpectIsNullaryOption(options, "deep_execroot");
+  ExpectIsNullaryOption(options, "experimental_adaptive_host_jvm_args");
+  ExpectIsNullaryOption(options,
+                        "experimental_idle_shutdown_on_memory_pressure");
   ExpectIsNullaryOption(options, "experimental_oom_more_eagerly");
+  ExpectIsNullaryOption(options, "experimental_posix_spawn");
+  ExpectIsNullaryOption(options, "experimental_prefetch_install_base");
+  ExpectIsNullaryOption(options, "experimental_server_checkpoint");
+  ExpectIsNullaryOption(options, "experimental_server_class_data_sharing");
+  ExpectIsNullaryOption(options, "experimental_session");
+  ExpectIsNullaryOption(options, "experimental_unix_socket");
   ExpectIsNullaryOption(options, "fatal_event_bus_exceptions");
   ExpectIsNullaryOption(options, "host_jvm_debug");
   ExpectIsNullaryOption(options, "ignore_all_rc_files");
@@ -91,9 +100,12 @@ TEST_F(BazelStartupOptionsTest, ValidStartupFlags) {
   ExpectIsNullaryOption(options, "watchfs");
   ExpectIsNullaryOption(options, "write_command_log");
   ExpectIsUnaryOption(options, "bazelrc");
+  ExpectIsUnaryOption(options, "client_profile");
   ExpectIsUnaryOption(options, "command_port");
   ExpectIsUnaryOption(options, "connect_timeout_secs");
   ExpectIsUnaryOption(options, "experimental_oom_more_eagerly_threshold");
+  ExpectIsUnaryOption(options, "experimental_scheduling_profile");
+  ExpectIsUnaryOption(options, "experimental_shared_install_base_root");
   ExpectIsUnaryOption(options, "host_javabase");
   ExpectIsUnaryOption(options, "host_jvm_args");
   ExpectIsUnaryOption(options, "host_jvm_profile");
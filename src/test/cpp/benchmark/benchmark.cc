@@ -0,0 +1,176 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/test/cpp/benchmark/benchmark.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <sstream>
+
+namespace bazel_benchmark {
+
+using std::string;
+using std::vector;
+
+Result RunBenchmark(Benchmark *benchmark, const string &dir, int warmup,
+                    int iterations) {
+  Result result;
+  result.name = benchmark->name();
+  result.error = benchmark->Setup(dir);
+  if (!result.error.empty()) {
+    return result;
+  }
+  result.bytes_per_iteration = benchmark->bytes();
+  for (int i = 0; i < warmup + iterations; ++i) {
+    benchmark->Reset();
+    int64_t peak_rss_kb = 0;
+    const auto start = std::chrono::steady_clock::now();
+    if (!benchmark->Run(&peak_rss_kb, &result.error)) {
+      result.latencies_ms.clear();
+      return result;
+    }
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (i >= warmup) {
+      result.latencies_ms.push_back(elapsed.count());
+      result.peak_rss_kb = std::max(result.peak_rss_kb, peak_rss_kb);
+    }
+  }
+  return result;
+}
+
+double Percentile(const vector<double> &values, double percent) {
+  if (values.empty()) {
+    return 0;
+  }
+  const double rank = percent / 100 * (values.size() - 1);
+  const size_t below = static_cast<size_t>(rank);
+  if (below + 1 >= values.size()) {
+    return values.back();
+  }
+  return values[below] + (rank - below) * (values[below + 1] - values[below]);
+}
+
+static string JsonString(const string &s) {
+  std::ostringstream out;
+  out << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+string ToJson(const vector<Result> &results) {
+  std::ostringstream out;
+  out << "{\n  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &result = results[i];
+    out << (i ? ",\n" : "\n") << "    {\n      \"name\": "
+        << JsonString(result.name);
+    if (result.latencies_ms.empty()) {
+      out << ",\n      \"error\": " << JsonString(result.error) << "\n    }";
+      continue;
+    }
+    vector<double> sorted(result.latencies_ms);
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double latency : sorted) {
+      total += latency;
+    }
+    const double mean = total / sorted.size();
+    out << ",\n      \"iterations\": " << sorted.size()
+        << ",\n      \"latency_ms\": {\"min\": " << sorted.front()
+        << ", \"mean\": " << mean << ", \"p50\": " << Percentile(sorted, 50)
+        << ", \"p90\": " << Percentile(sorted, 90)
+        << ", \"p99\": " << Percentile(sorted, 99)
+        << ", \"max\": " << sorted.back() << "}";
+    if (result.bytes_per_iteration > 0 && mean > 0) {
+      out << ",\n      \"bytes_per_iteration\": " << result.bytes_per_iteration
+          << ",\n      \"throughput_mb_per_sec\": "
+          << static_cast<double>(result.bytes_per_iteration) / (1 << 20) /
+                 (mean / 1000);
+    }
+    out << ",\n      \"peak_rss_kb\": " << result.peak_rss_kb << "\n    }";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+bool RunProcess(const vector<string> &argv, const string &cwd,
+                int64_t *peak_rss_kb, string *error) {
+  vector<char *> args;
+  for (const string &arg : argv) {
+    args.push_back(const_cast<char *>(arg.c_str()));
+  }
+  args.push_back(nullptr);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    *error = string("fork: ") + strerror(errno);
+    return false;
+  }
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0 ||
+        dup2(null_fd, STDERR_FILENO) < 0 ||
+        (!cwd.empty() && chdir(cwd.c_str()) < 0)) {
+      _exit(127);
+    }
+    execv(args[0], args.data());
+    _exit(127);
+  }
+
+  int status;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) < 0) {
+    if (errno != EINTR) {
+      *error = string("wait4: ") + strerror(errno);
+      return false;
+    }
+  }
+#if defined(__APPLE__)
+  // In bytes on macOS, in kilobytes elsewhere.
+  *peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+  *peak_rss_kb = usage.ru_maxrss;
+#endif
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::ostringstream message;
+    message << argv[0] << " failed with status " << status;
+    *error = message.str();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace bazel_benchmark
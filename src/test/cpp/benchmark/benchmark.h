@@ -0,0 +1,88 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TEST_CPP_BENCHMARK_BENCHMARK_H_
+#define BAZEL_SRC_TEST_CPP_BENCHMARK_BENCHMARK_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace bazel_benchmark {
+
+// A benchmark of one of the native tools. Setup() prepares its input once,
+// then the runner times a number of Run() calls, each of which runs the tool
+// on that input.
+class Benchmark {
+ public:
+  explicit Benchmark(const std::string &name) : name_(name) {}
+  virtual ~Benchmark() {}
+
+  const std::string &name() const { return name_; }
+
+  // Creates the input of the benchmark under `dir`, an empty directory.
+  // Returns why the benchmark cannot run (e.g. the tool was not given), or ""
+  // if it can.
+  virtual std::string Setup(const std::string &dir) = 0;
+
+  // Undoes whatever the previous Run() left behind that the next one must not
+  // find, such as its output. Not timed.
+  virtual void Reset() {}
+
+  // Runs the tool once. Sets `peak_rss_kb` to the largest peak resident set
+  // size of the processes it ran, in kilobytes. Returns false and sets `error`
+  // if the tool failed.
+  virtual bool Run(int64_t *peak_rss_kb, std::string *error) = 0;
+
+  // The number of bytes of input a Run() processes, for the throughput, or 0.
+  virtual uint64_t bytes() const { return 0; }
+
+ private:
+  const std::string name_;
+};
+
+// The measurements of one benchmark.
+struct Result {
+  std::string name;
+  // Why the benchmark did not run or failed, if it did not complete.
+  std::string error;
+  // The wall time of each Run(), in milliseconds.
+  std::vector<double> latencies_ms;
+  uint64_t bytes_per_iteration = 0;
+  int64_t peak_rss_kb = 0;
+};
+
+// Sets up `benchmark` in `dir`, runs it `warmup` times without measuring, and
+// then `iterations` times.
+Result RunBenchmark(Benchmark *benchmark, const std::string &dir, int warmup,
+                    int iterations);
+
+// Returns the value below which `percent` percent of the `values` lie,
+// interpolating between the closest two. `values` must be sorted.
+double Percentile(const std::vector<double> &values, double percent);
+
+// Returns the results as a JSON object, with the latency percentiles and the
+// throughput of each benchmark.
+std::string ToJson(const std::vector<Result> &results);
+
+// Runs `argv` in `cwd` with its output discarded, and waits for it. Sets
+// `peak_rss_kb` to the peak resident set size of the process. Returns false
+// and sets `error` if it could not run or did not exit with 0.
+bool RunProcess(const std::vector<std::string> &argv, const std::string &cwd,
+                int64_t *peak_rss_kb, std::string *error);
+
+}  // namespace bazel_benchmark
+
+#endif  // BAZEL_SRC_TEST_CPP_BENCHMARK_BENCHMARK_H_
@@ -0,0 +1,170 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/test/cpp/benchmark/benchmark.h"
+#include "src/test/cpp/benchmark/corpus.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace bazel_benchmark {
+
+using std::string;
+using std::vector;
+
+static string ReadFile(const string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+class BenchmarkTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = string(getenv("TEST_TMPDIR")) + "/benchmark_test";
+    RemoveTree(root_);
+    ASSERT_EQ(0, mkdir(root_.c_str(), 0755));
+  }
+
+  void TearDown() override { RemoveTree(root_); }
+
+  string root_;
+};
+
+// Counts its calls, and fails the given one.
+class CountingBenchmark : public Benchmark {
+ public:
+  explicit CountingBenchmark(int fail_at)
+      : Benchmark("counting"), fail_at_(fail_at) {}
+
+  string Setup(const string &dir) override { return ""; }
+  void Reset() override { ++resets; }
+  bool Run(int64_t *peak_rss_kb, string *error) override {
+    *peak_rss_kb = ++runs;
+    if (runs == fail_at_) {
+      *error = "failed";
+      return false;
+    }
+    return true;
+  }
+  uint64_t bytes() const override { return 1024; }
+
+  int resets = 0;
+  int runs = 0;
+
+ private:
+  const int fail_at_;
+};
+
+TEST_F(BenchmarkTest, PercentileInterpolates) {
+  const vector<double> values = {1, 2, 3, 4, 5};
+  EXPECT_DOUBLE_EQ(1, Percentile(values, 0));
+  EXPECT_DOUBLE_EQ(3, Percentile(values, 50));
+  EXPECT_DOUBLE_EQ(4.6, Percentile(values, 90));
+  EXPECT_DOUBLE_EQ(5, Percentile(values, 100));
+  EXPECT_DOUBLE_EQ(7, Percentile({7}, 99));
+  EXPECT_DOUBLE_EQ(0, Percentile({}, 50));
+}
+
+TEST_F(BenchmarkTest, RunBenchmarkSkipsWarmup) {
+  CountingBenchmark benchmark(-1);
+  Result result = RunBenchmark(&benchmark, root_, 2, 3);
+  EXPECT_EQ("", result.error);
+  EXPECT_EQ(5, benchmark.runs);
+  EXPECT_EQ(5, benchmark.resets);
+  EXPECT_EQ(3u, result.latencies_ms.size());
+  EXPECT_EQ(1024u, result.bytes_per_iteration);
+  EXPECT_EQ(5, result.peak_rss_kb);
+}
+
+TEST_F(BenchmarkTest, RunBenchmarkStopsAtFailure) {
+  CountingBenchmark benchmark(2);
+  Result result = RunBenchmark(&benchmark, root_, 0, 3);
+  EXPECT_EQ("failed", result.error);
+  EXPECT_EQ(2, benchmark.runs);
+  EXPECT_TRUE(result.latencies_ms.empty());
+}
+
+TEST_F(BenchmarkTest, ToJson) {
+  Result skipped;
+  skipped.name = "skipped";
+  skipped.error = "--tool \"x\" not given";
+  Result ran;
+  ran.name = "ran";
+  ran.latencies_ms = {30, 10, 20};
+  ran.bytes_per_iteration = 1 << 20;
+  ran.peak_rss_kb = 100;
+
+  EXPECT_EQ(
+      "{\n"
+      "  \"benchmarks\": [\n"
+      "    {\n"
+      "      \"name\": \"skipped\",\n"
+      "      \"error\": \"--tool \\\"x\\\" not given\"\n"
+      "    },\n"
+      "    {\n"
+      "      \"name\": \"ran\",\n"
+      "      \"iterations\": 3,\n"
+      "      \"latency_ms\": {\"min\": 10, \"mean\": 20, \"p50\": 20, "
+      "\"p90\": 28, \"p99\": 29.8, \"max\": 30},\n"
+      "      \"bytes_per_iteration\": 1048576,\n"
+      "      \"throughput_mb_per_sec\": 50,\n"
+      "      \"peak_rss_kb\": 100\n"
+      "    }\n"
+      "  ]\n"
+      "}\n",
+      ToJson({skipped, ran}));
+}
+
+TEST_F(BenchmarkTest, RunProcessReportsFailure) {
+  int64_t peak_rss_kb = 0;
+  string error;
+  EXPECT_TRUE(RunProcess({"/bin/true"}, "", &peak_rss_kb, &error));
+  EXPECT_GT(peak_rss_kb, 0);
+  EXPECT_FALSE(RunProcess({"/bin/false"}, "", &peak_rss_kb, &error));
+  EXPECT_NE("", error);
+}
+
+TEST_F(BenchmarkTest, WriteTreeIsDeterministic) {
+  ASSERT_EQ(0, mkdir((root_ + "/a").c_str(), 0755));
+  ASSERT_EQ(0, mkdir((root_ + "/b").c_str(), 0755));
+  vector<string> files;
+  ASSERT_TRUE(WriteTree(root_ + "/a", 25, 100, &files));
+  ASSERT_EQ(25u, files.size());
+  EXPECT_EQ("f0.txt", files[0]);
+  EXPECT_EQ("d1/f12.txt", files[12]);
+  EXPECT_EQ(2500u, TotalSize(root_ + "/a", files));
+
+  vector<string> again;
+  ASSERT_TRUE(WriteTree(root_ + "/b", 25, 100, &again));
+  EXPECT_EQ(files, again);
+  for (const string &file : files) {
+    EXPECT_EQ(ReadFile(root_ + "/a/" + file), ReadFile(root_ + "/b/" + file));
+  }
+
+  ASSERT_TRUE(WriteRunfilesManifest(root_ + "/MANIFEST", "ws", root_ + "/a",
+                                    {files[0], files[12]}));
+  EXPECT_EQ("ws/f0.txt " + root_ + "/a/f0.txt\n" + "ws/d1/f12.txt " + root_ +
+                "/a/d1/f12.txt\n",
+            ReadFile(root_ + "/MANIFEST"));
+}
+
+}  // namespace bazel_benchmark
@@ -0,0 +1,115 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/test/cpp/benchmark/corpus.h"
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+
+namespace bazel_benchmark {
+
+using std::string;
+using std::vector;
+
+static const char *const kWords[] = {
+    "public", "static", "final",  "class",   "return",  "import",
+    "void",   "int",    "String", "private", "new",     "if",
+    "else",   "for",    "while",  "this",    "null",    "true",
+    "false",  "throws", "try",    "catch",   "package", "extends"};
+
+// Makes the parent directories of `root`/`path`.
+static bool MakeParents(const string &root, const string &path) {
+  for (size_t slash = path.find('/'); slash != string::npos;
+       slash = path.find('/', slash + 1)) {
+    string dir = root + "/" + path.substr(0, slash);
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteTree(const string &root, int file_count, size_t file_size,
+               vector<string> *files) {
+  files->clear();
+  // A linear congruential generator, so that the contents do not depend on
+  // the standard library.
+  uint32_t state = 42;
+  for (int i = 0; i < file_count; ++i) {
+    string path;
+    for (int rest = i / 10; rest > 0; rest /= 10) {
+      path = "d" + std::to_string(rest % 10) + "/" + path;
+    }
+    path += "f" + std::to_string(i) + ".txt";
+    if (!MakeParents(root, path)) {
+      return false;
+    }
+    string contents;
+    contents.reserve(file_size);
+    while (contents.size() < file_size) {
+      state = state * 1103515245 + 12345;
+      contents += kWords[(state >> 16) % (sizeof(kWords) / sizeof(kWords[0]))];
+      contents += (state >> 8) % 8 == 0 ? '\n' : ' ';
+    }
+    contents.resize(file_size);
+    std::ofstream out(root + "/" + path, std::ios::binary);
+    out << contents;
+    if (!out.good()) {
+      return false;
+    }
+    files->push_back(path);
+  }
+  return true;
+}
+
+bool WriteRunfilesManifest(const string &manifest, const string &workspace,
+                           const string &root, const vector<string> &files) {
+  std::ofstream out(manifest);
+  for (const string &file : files) {
+    out << workspace << "/" << file << " " << root << "/" << file << "\n";
+  }
+  return out.good();
+}
+
+uint64_t TotalSize(const string &root, const vector<string> &files) {
+  uint64_t total = 0;
+  for (const string &file : files) {
+    struct stat st;
+    if (stat((root + "/" + file).c_str(), &st) == 0) {
+      total += st.st_size;
+    }
+  }
+  return total;
+}
+
+static int RemoveEntry(const char *path, const struct stat *st, int type,
+                       struct FTW *ftw) {
+  return remove(path);
+}
+
+bool RemoveTree(const string &path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) < 0) {
+    return errno == ENOENT;
+  }
+  // Children first, and without following symlinks out of the tree.
+  return nftw(path.c_str(), RemoveEntry, 64, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+}  // namespace bazel_benchmark
@@ -0,0 +1,52 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TEST_CPP_BENCHMARK_CORPUS_H_
+#define BAZEL_SRC_TEST_CPP_BENCHMARK_CORPUS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Generates the inputs of the benchmarks. The same arguments always generate
+// the same files, so that results from different machines and releases can be
+// compared.
+namespace bazel_benchmark {
+
+// Writes `file_count` files of `file_size` bytes of text, which compresses
+// about as well as source code does, into a tree of directories under
+// `root`, ten entries per directory. Sets `files` to their paths relative to
+// `root`. Returns false if a file could not be written.
+bool WriteTree(const std::string &root, int file_count, size_t file_size,
+               std::vector<std::string> *files);
+
+// Writes a runfiles manifest to `manifest` that links "<workspace>/<file>" to
+// "<root>/<file>" for each of `files`.
+bool WriteRunfilesManifest(const std::string &manifest,
+                           const std::string &workspace,
+                           const std::string &root,
+                           const std::vector<std::string> &files);
+
+// Returns the total size of the given files under `root`.
+uint64_t TotalSize(const std::string &root,
+                   const std::vector<std::string> &files);
+
+// Removes `path` and everything under it, if it exists.
+bool RemoveTree(const std::string &path);
+
+}  // namespace bazel_benchmark
+
+#endif  // BAZEL_SRC_TEST_CPP_BENCHMARK_CORPUS_H_
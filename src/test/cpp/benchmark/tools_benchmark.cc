@@ -0,0 +1,358 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the native tools on generated inputs and prints the wall time
+// percentiles, the throughput and the peak RSS of each as JSON, so that
+// releases can be compared on the same machine.
+//
+// Usage:
+//   tools_benchmark [--iterations=N] [--warmup=N] [--files=N]
+//       [--file_size=BYTES] [--filter=SUBSTRING] [--output=FILE]
+//       [--tmpdir=DIR] [--zipper=PATH] [--singlejar=PATH] [--ijar=PATH]
+//       [--build_runfiles=PATH] [--process_wrapper=PATH]
+//       [--linux_sandbox=PATH] [--bazel=PATH]
+// The benchmarks of the tools that are not given are skipped. Most need
+// --zipper to create their input jars.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/test/cpp/benchmark/benchmark.h"
+#include "src/test/cpp/benchmark/corpus.h"
+
+namespace bazel_benchmark {
+namespace {
+
+using std::string;
+using std::vector;
+
+struct Flags {
+  int iterations = 10;
+  int warmup = 1;
+  int files = 1000;
+  size_t file_size = 4096;
+  string filter;
+  string output;
+  string tmpdir;
+  // The paths of the tools, by flag name.
+  std::map<string, string> tools;
+};
+
+// Runs one command line per iteration. The setup function creates the input
+// in the given directory and fills in the fields below.
+class CommandBenchmark : public Benchmark {
+ public:
+  typedef std::function<string(const string &dir, CommandBenchmark *self)>
+      SetupFunction;
+
+  CommandBenchmark(const string &name, const vector<string> &tool_flags,
+                   const Flags &flags, SetupFunction setup)
+      : Benchmark(name),
+        tool_flags_(tool_flags),
+        flags_(flags),
+        setup_(setup) {}
+
+  // The path of the tool given with --`flag`, or "".
+  string tool(const string &flag) const {
+    auto it = flags_.tools.find(flag);
+    return it == flags_.tools.end() ? "" : it->second;
+  }
+
+  const Flags &flags() const { return flags_; }
+
+  string Setup(const string &dir) override {
+    for (const string &flag : tool_flags_) {
+      if (tool(flag).empty()) {
+        return "--" + flag + " not given";
+      }
+    }
+    return setup_(dir, this);
+  }
+
+  void Reset() override {
+    for (const string &output : outputs) {
+      RemoveTree(output);
+    }
+    for (const string &dir : output_dirs) {
+      mkdir(dir.c_str(), 0755);
+    }
+  }
+
+  bool Run(int64_t *peak_rss_kb, string *error) override {
+    return RunProcess(argv, cwd, peak_rss_kb, error);
+  }
+
+  uint64_t bytes() const override { return input_bytes; }
+
+  vector<string> argv;
+  string cwd;
+  // Removed before each run.
+  vector<string> outputs;
+  // Created empty before each run.
+  vector<string> output_dirs;
+  uint64_t input_bytes = 0;
+
+ private:
+  const vector<string> tool_flags_;
+  const Flags &flags_;
+  SetupFunction setup_;
+};
+
+// Writes the file tree under `dir`/tree and zips it into `jar`, compressed,
+// using the paths in the tree as the entry names.
+string CreateJar(CommandBenchmark *self, const string &dir, const string &jar,
+                 vector<string> *files) {
+  const string root = dir + "/tree";
+  if (mkdir(root.c_str(), 0755) < 0 ||
+      !WriteTree(root, self->flags().files, self->flags().file_size, files)) {
+    return "cannot write the files under " + root;
+  }
+  vector<string> argv = {self->tool("zipper"), "cC", jar};
+  argv.insert(argv.end(), files->begin(), files->end());
+  int64_t rss;
+  string error;
+  if (!RunProcess(argv, root, &rss, &error)) {
+    return "cannot create " + jar + ": " + error;
+  }
+  return "";
+}
+
+uint64_t FileSize(const string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+vector<std::unique_ptr<Benchmark>> CreateBenchmarks(const Flags &flags) {
+  vector<std::unique_ptr<Benchmark>> benchmarks;
+  auto add = [&benchmarks, &flags](const string &name,
+                                   const vector<string> &tool_flags,
+                                   CommandBenchmark::SetupFunction setup) {
+    benchmarks.emplace_back(
+        new CommandBenchmark(name, tool_flags, flags, setup));
+  };
+
+  // What starting a process costs by itself, to tell it from the overhead of
+  // the tools that run another process.
+  add("baseline/true", {}, [](const string &dir, CommandBenchmark *self) {
+    self->argv = {"/bin/true"};
+    return string();
+  });
+
+  add("zipper/create", {"zipper"},
+      [](const string &dir, CommandBenchmark *self) {
+        const string root = dir + "/tree";
+        vector<string> files;
+        if (mkdir(root.c_str(), 0755) < 0 ||
+            !WriteTree(root, self->flags().files, self->flags().file_size,
+                       &files)) {
+          return "cannot write the files under " + root;
+        }
+        self->argv = {self->tool("zipper"), "cC", dir + "/out.zip"};
+        self->argv.insert(self->argv.end(), files.begin(), files.end());
+        self->cwd = root;
+        self->outputs = {dir + "/out.zip"};
+        self->input_bytes = TotalSize(root, files);
+        return string();
+      });
+
+  add("zipper/extract", {"zipper"},
+      [](const string &dir, CommandBenchmark *self) {
+        vector<string> files;
+        const string jar = dir + "/in.jar";
+        string error = CreateJar(self, dir, jar, &files);
+        self->argv = {self->tool("zipper"), "x", jar, "-d", dir + "/out"};
+        self->outputs = {dir + "/out"};
+        self->output_dirs = {dir + "/out"};
+        self->input_bytes = FileSize(jar);
+        return error;
+      });
+
+  add("singlejar", {"zipper", "singlejar"},
+      [](const string &dir, CommandBenchmark *self) {
+        vector<string> files;
+        const string jar = dir + "/in.jar";
+        string error = CreateJar(self, dir, jar, &files);
+        // Ten copies, with the duplicate entries singlejar has to drop.
+        self->argv = {self->tool("singlejar"), "--output", dir + "/out.jar",
+                      "--sources"};
+        for (int i = 0; i < 10; ++i) {
+          self->argv.push_back(jar);
+        }
+        self->outputs = {dir + "/out.jar"};
+        self->input_bytes = 10 * FileSize(jar);
+        return error;
+      });
+
+  // The generated jar has no classes, so this measures reading and writing
+  // the jar rather than stripping classes.
+  add("ijar", {"zipper", "ijar"},
+      [](const string &dir, CommandBenchmark *self) {
+        vector<string> files;
+        const string jar = dir + "/in.jar";
+        string error = CreateJar(self, dir, jar, &files);
+        self->argv = {self->tool("ijar"), jar, dir + "/out.jar"};
+        self->outputs = {dir + "/out.jar"};
+        self->input_bytes = FileSize(jar);
+        return error;
+      });
+
+  add("build-runfiles", {"build_runfiles"},
+      [](const string &dir, CommandBenchmark *self) {
+        const string root = dir + "/tree";
+        vector<string> files;
+        if (mkdir(root.c_str(), 0755) < 0 ||
+            !WriteTree(root, self->flags().files, self->flags().file_size,
+                       &files) ||
+            !WriteRunfilesManifest(dir + "/MANIFEST", "__main__", root,
+                                   files)) {
+          return "cannot write the files under " + root;
+        }
+        self->argv = {self->tool("build_runfiles"), dir + "/MANIFEST",
+                      dir + "/runfiles"};
+        self->outputs = {dir + "/runfiles"};
+        return string();
+      });
+
+  add("process-wrapper", {"process_wrapper"},
+      [](const string &dir, CommandBenchmark *self) {
+        self->argv = {self->tool("process_wrapper"), "--", "/bin/true"};
+        return string();
+      });
+
+  add("linux-sandbox", {"linux_sandbox"},
+      [](const string &dir, CommandBenchmark *self) {
+        self->argv = {self->tool("linux_sandbox"), "--", "/bin/true"};
+        return string();
+      });
+
+  // The client alone: "info output_base" is answered without a server.
+  add("client/info_output_base", {"bazel"},
+      [](const string &dir, CommandBenchmark *self) {
+        const string workspace = dir + "/workspace";
+        if (mkdir(workspace.c_str(), 0755) < 0 ||
+            !std::ofstream(workspace + "/WORKSPACE").good()) {
+          return "cannot create the workspace " + workspace;
+        }
+        self->argv = {self->tool("bazel"), "--ignore_all_rc_files",
+                      "--output_user_root=" + dir + "/output_user_root",
+                      "info", "output_base"};
+        self->cwd = workspace;
+        return string();
+      });
+
+  return benchmarks;
+}
+
+bool ParseFlags(int argc, char **argv, Flags *flags) {
+  static const char *const kTools[] = {
+      "zipper",          "singlejar",     "ijar", "build_runfiles",
+      "process_wrapper", "linux_sandbox", "bazel"};
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    const size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+      fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return false;
+    }
+    const string name = arg.substr(2, eq - 2);
+    const string value = arg.substr(eq + 1);
+    if (name == "iterations") {
+      flags->iterations = atoi(value.c_str());
+    } else if (name == "warmup") {
+      flags->warmup = atoi(value.c_str());
+    } else if (name == "files") {
+      flags->files = atoi(value.c_str());
+    } else if (name == "file_size") {
+      flags->file_size = strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "filter") {
+      flags->filter = value;
+    } else if (name == "output") {
+      flags->output = value;
+    } else if (name == "tmpdir") {
+      flags->tmpdir = value;
+    } else if (std::find(std::begin(kTools), std::end(kTools), name) !=
+               std::end(kTools)) {
+      flags->tools[name] = value;
+    } else {
+      fprintf(stderr, "Unknown flag: %s\n", argv[i]);
+      return false;
+    }
+  }
+  if (flags->tmpdir.empty()) {
+    const char *tmpdir = getenv("TEST_TMPDIR");
+    flags->tmpdir = tmpdir != nullptr ? tmpdir : "/tmp";
+  }
+  return flags->iterations > 0;
+}
+
+int Main(int argc, char **argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    return 2;
+  }
+  string root = flags.tmpdir + "/tools_benchmark.XXXXXX";
+  if (mkdtemp(&root[0]) == nullptr) {
+    fprintf(stderr, "Cannot create a directory under %s: %s\n",
+            flags.tmpdir.c_str(), strerror(errno));
+    return 1;
+  }
+
+  vector<Result> results;
+  int index = 0;
+  for (const auto &benchmark : CreateBenchmarks(flags)) {
+    if (benchmark->name().find(flags.filter) == string::npos) {
+      continue;
+    }
+    const string dir = root + "/" + std::to_string(index++);
+    mkdir(dir.c_str(), 0755);
+    fprintf(stderr, "Running %s...\n", benchmark->name().c_str());
+    results.push_back(
+        RunBenchmark(benchmark.get(), dir, flags.warmup, flags.iterations));
+    if (!results.back().error.empty()) {
+      fprintf(stderr, "  skipped: %s\n", results.back().error.c_str());
+    }
+    RemoveTree(dir);
+  }
+  RemoveTree(root);
+
+  const string json = ToJson(results);
+  if (flags.output.empty()) {
+    fputs(json.c_str(), stdout);
+  } else {
+    std::ofstream out(flags.output);
+    out << json;
+    if (!out.good()) {
+      fprintf(stderr, "Cannot write %s\n", flags.output.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace bazel_benchmark
+
+int main(int argc, char **argv) { return bazel_benchmark::Main(argc, argv); }
@@ -14,6 +14,7 @@
 
 #include <sys/types.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #include <inttypes.h>
@@ -27,6 +28,9 @@
 
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/exit_code.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path.h"
 #include "googletest/include/gtest/gtest.h"
 
 namespace blaze {
@@ -179,4 +183,83 @@ TEST_F(UnlimitResourcesTest, SuccessWithPossiblyInfiniteLimits) {
   }
 }
 
+TEST(BlazeUtilPosixTest, SharedLocksExcludeOnlyExclusiveOnes) {
+  const std::string output_base =
+      blaze_util::JoinPath(getenv("TEST_TMPDIR"), "shared_lock");
+  ASSERT_EQ(0, mkdir(output_base.c_str(), 0755));
+
+  BlazeLock first, second;
+  EXPECT_EQ(0u, AcquireLock(output_base, false, false, true, &first));
+  EXPECT_EQ(0u, AcquireLock(output_base, false, false, true, &second));
+  EXPECT_EXIT(
+      {
+        BlazeLock exclusive;
+        AcquireLock(output_base, false, false, false, &exclusive);
+      },
+      testing::ExitedWithCode(blaze_exit_code::BAD_ARGV),
+      "--noblock_for_lock");
+
+  ReleaseLock(&first);
+  ReleaseLock(&second);
+  BlazeLock exclusive;
+  EXPECT_EQ(0u, AcquireLock(output_base, false, false, false, &exclusive));
+  ReleaseLock(&exclusive);
+}
+
+
+#if defined(__linux__)
+// Writes `contents` to the cgroup control file `name` below `root`.
+static void WriteCgroupFile(const std::string &root, const std::string &name,
+                            const std::string &contents) {
+  const std::string path = blaze_util::JoinPath(root, name);
+  ASSERT_TRUE(blaze_util::MakeDirectories(blaze_util::Dirname(path), 0755));
+  ASSERT_TRUE(blaze_util::WriteFile(contents, path));
+}
+
+TEST(BlazeUtilLinuxTest, CapMemoryToCgroupLimit) {
+  const std::string root =
+      blaze_util::JoinPath(getenv("TEST_TMPDIR"), "cgroup_memory");
+  const uint64_t kGb = 1 << 30;
+  // No control files, as outside a container.
+  EXPECT_EQ(16 * kGb, CapMemoryToCgroupLimit(16 * kGb, root));
+
+  // cgroup v1 without a limit reports a huge number.
+  WriteCgroupFile(root, "memory/memory.limit_in_bytes",
+                  "9223372036854771712\n");
+  EXPECT_EQ(16 * kGb, CapMemoryToCgroupLimit(16 * kGb, root));
+  WriteCgroupFile(root, "memory/memory.limit_in_bytes", "4294967296\n");
+  EXPECT_EQ(4 * kGb, CapMemoryToCgroupLimit(16 * kGb, root));
+  EXPECT_EQ(2 * kGb, CapMemoryToCgroupLimit(2 * kGb, root));
+  EXPECT_EQ(4 * kGb, CapMemoryToCgroupLimit(0, root));
+
+  // cgroup v2 says "max" without a limit, and otherwise takes precedence.
+  WriteCgroupFile(root, "memory/memory.limit_in_bytes", "");
+  WriteCgroupFile(root, "memory.max", "max\n");
+  EXPECT_EQ(16 * kGb, CapMemoryToCgroupLimit(16 * kGb, root));
+  EXPECT_EQ(0u, CapMemoryToCgroupLimit(0, root));
+  WriteCgroupFile(root, "memory.max", "3221225472\n");
+  EXPECT_EQ(3 * kGb, CapMemoryToCgroupLimit(16 * kGb, root));
+}
+
+TEST(BlazeUtilLinuxTest, CapCpusToCgroupQuota) {
+  const std::string root =
+      blaze_util::JoinPath(getenv("TEST_TMPDIR"), "cgroup_cpu");
+  EXPECT_EQ(8u, CapCpusToCgroupQuota(8, root));
+
+  // cgroup v1 has no quota if it is -1.
+  WriteCgroupFile(root, "cpu/cpu.cfs_quota_us", "-1\n");
+  WriteCgroupFile(root, "cpu/cpu.cfs_period_us", "100000\n");
+  EXPECT_EQ(8u, CapCpusToCgroupQuota(8, root));
+  WriteCgroupFile(root, "cpu/cpu.cfs_quota_us", "250000\n");
+  EXPECT_EQ(3u, CapCpusToCgroupQuota(8, root));
+  EXPECT_EQ(2u, CapCpusToCgroupQuota(2, root));
+
+  // cgroup v2 has both in cpu.max, which takes precedence.
+  WriteCgroupFile(root, "cpu.max", "max 100000\n");
+  EXPECT_EQ(8u, CapCpusToCgroupQuota(8, root));
+  WriteCgroupFile(root, "cpu.max", "50000 100000\n");
+  EXPECT_EQ(1u, CapCpusToCgroupQuota(8, root));
+}
+#endif  // defined(__linux__)
+
 }  // namespace blaze
@@ -0,0 +1,374 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the client's own overhead per command, to catch regressions in it.
+//
+// Every iteration goes through the steps the client takes for a command whose
+// server is already running: it looks up the workspace, parses the options and
+// the rc files, takes the output base lock, finds and connects to the server,
+// sends it the command and reads the response, and tears the connection down.
+// The server is an in-process stub that answers at once, so that only the
+// client's side is measured.
+//
+// Usage:
+//   client_benchmark [--iterations=N] [--rc_files=N] [--rc_lines=N]
+//                    [--env_vars=N]
+//
+// Prints the median and the 99th percentile of every step, and of the whole
+// iteration, in microseconds.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <grpc++/channel.h>
+#include <grpc++/client_context.h>
+#include <grpc++/create_channel.h>
+#include <grpc++/security/credentials.h>
+#include <grpc++/security/server_credentials.h>
+#include <grpc++/server.h>
+#include <grpc++/server_builder.h>
+#include <grpc++/server_context.h>
+#include <grpc++/support/channel_arguments.h>
+
+#include "src/main/cpp/bazel_startup_options.h"
+#include "src/main/cpp/blaze_util.h"
+#include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/option_processor.h"
+#include "src/main/cpp/startup_options.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/numbers.h"
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/strings.h"
+#include "src/main/cpp/workspace_layout.h"
+#include "src/main/protobuf/command_server.grpc.pb.h"
+
+namespace blaze {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char kCookie[] = "benchmark-cookie";
+
+// Answers every request at once, like a server that has nothing to do.
+class StubCommandServer final : public command_server::CommandServer::Service {
+ public:
+  grpc::Status Run(grpc::ServerContext* context,
+                   const command_server::RunRequest* request,
+                   grpc::ServerWriter<command_server::RunResponse>* writer)
+      override {
+    command_server::RunResponse response;
+    response.set_cookie(kCookie);
+    response.set_command_id("benchmark");
+    response.set_standard_error("stub server\n");
+    response.set_finished(true);
+    response.set_exit_code(0);
+    writer->Write(response);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Cancel(grpc::ServerContext* context,
+                      const command_server::CancelRequest* request,
+                      command_server::CancelResponse* response) override {
+    response->set_cookie(kCookie);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Ping(grpc::ServerContext* context,
+                    const command_server::PingRequest* request,
+                    command_server::PingResponse* response) override {
+    response->set_cookie(kCookie);
+    return grpc::Status::OK;
+  }
+};
+
+struct Flags {
+  int iterations = 200;
+  int rc_files = 3;
+  int rc_lines = 20;
+  int env_vars = 50;
+};
+
+bool ParseFlag(const string& arg, const string& name, int* value) {
+  string prefix = "--" + name + "=";
+  if (!blaze_util::starts_with(arg, prefix)) {
+    return false;
+  }
+  if (!blaze_util::safe_strto32(arg.substr(prefix.size()), value) ||
+      *value < 0) {
+    fprintf(stderr, "Invalid value for --%s: '%s'\n", name.c_str(),
+            arg.c_str());
+    exit(2);
+  }
+  return true;
+}
+
+Flags ParseFlags(int argc, char** argv) {
+  Flags flags;
+  for (int i = 1; i < argc; ++i) {
+    string arg(argv[i]);
+    if (!ParseFlag(arg, "iterations", &flags.iterations) &&
+        !ParseFlag(arg, "rc_files", &flags.rc_files) &&
+        !ParseFlag(arg, "rc_lines", &flags.rc_lines) &&
+        !ParseFlag(arg, "env_vars", &flags.env_vars)) {
+      fprintf(stderr, "Unknown flag: '%s'\n", argv[i]);
+      exit(2);
+    }
+  }
+  if (flags.iterations == 0) {
+    flags.iterations = 1;
+  }
+  return flags;
+}
+
+void WriteFileOrDie(const string& content, const string& path) {
+  if (!blaze_util::WriteFile(content, path, 0644)) {
+    fprintf(stderr, "Couldn't write '%s'\n", path.c_str());
+    exit(1);
+  }
+}
+
+void MakeDirectoriesOrDie(const string& path) {
+  if (!blaze_util::MakeDirectories(path, 0755)) {
+    fprintf(stderr, "Couldn't create '%s'\n", path.c_str());
+    exit(1);
+  }
+}
+
+// Creates a workspace whose .bazelrc imports `rc_files` more rc files of
+// `rc_lines` lines each.
+void CreateWorkspace(const string& workspace, const Flags& flags) {
+  MakeDirectoriesOrDie(blaze_util::JoinPath(workspace, "rc"));
+  MakeDirectoriesOrDie(blaze_util::JoinPath(workspace, "pkg/sub"));
+  WriteFileOrDie("", blaze_util::JoinPath(workspace, "WORKSPACE"));
+
+  string workspace_rc;
+  for (int i = 0; i < flags.rc_files; ++i) {
+    string name = "rc/" + ToString(i) + ".bazelrc";
+    workspace_rc += "import %workspace%/" + name + "\n";
+    string rc;
+    for (int j = 0; j < flags.rc_lines; ++j) {
+      rc += "build --define=rc" + ToString(i) + "_" + ToString(j) + "=1\n";
+    }
+    WriteFileOrDie(rc, blaze_util::JoinPath(workspace, name));
+  }
+  WriteFileOrDie(workspace_rc, blaze_util::JoinPath(workspace, ".bazelrc"));
+}
+
+// The duration of every step, one entry per iteration.
+struct Timings {
+  vector<string> names;
+  vector<vector<int64_t>> micros;
+
+  void Add(size_t step, const string& name, Clock::time_point start,
+           Clock::time_point end) {
+    if (step == names.size()) {
+      names.push_back(name);
+      micros.emplace_back();
+    }
+    micros[step].push_back(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+            .count());
+  }
+};
+
+int64_t Percentile(vector<int64_t> values, int percentile) {
+  std::sort(values.begin(), values.end());
+  size_t index = (values.size() - 1) * percentile / 100;
+  return values[index];
+}
+
+}  // namespace
+
+int RunBenchmark(int argc, char** argv) {
+  Flags flags = ParseFlags(argc, argv);
+
+  string tmp = GetEnv("TEST_TMPDIR");
+  if (tmp.empty()) {
+    tmp = GetEnv("TMPDIR");
+  }
+  if (tmp.empty()) {
+    tmp = "/tmp";
+  }
+  string root = blaze_util::JoinPath(
+      tmp, "client_benchmark." + GetProcessIdAsString());
+  string workspace = blaze_util::JoinPath(root, "workspace");
+  string cwd = blaze_util::JoinPath(workspace, "pkg/sub");
+  string output_user_root = blaze_util::JoinPath(root, "output_user_root");
+  string output_base = blaze_util::JoinPath(output_user_root, "output_base");
+  CreateWorkspace(workspace, flags);
+  MakeDirectoriesOrDie(output_base);
+
+  for (int i = 0; i < flags.env_vars; ++i) {
+    SetEnv("CLIENT_BENCHMARK_VAR_" + ToString(i),
+           "some value of a typical length for variable " + ToString(i));
+  }
+
+  StubCommandServer service;
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  if (server == nullptr || port == 0) {
+    fprintf(stderr, "Couldn't start the stub server\n");
+    return 1;
+  }
+  // The files through which the client finds the server, with this process
+  // standing in for the server.
+  string server_dir = blaze_util::JoinPath(output_base, "server");
+  MakeDirectoriesOrDie(server_dir);
+  WriteFileOrDie("127.0.0.1:" + ToString(port),
+                 blaze_util::JoinPath(server_dir, "command_port"));
+  WriteFileOrDie(kCookie, blaze_util::JoinPath(server_dir, "request_cookie"));
+  WriteFileOrDie(kCookie, blaze_util::JoinPath(server_dir, "response_cookie"));
+
+  const vector<string> args = {
+      "bazel", "--output_user_root=" + output_user_root,
+      "--output_base=" + output_base, "build", "--nobuild", "//pkg/sub:all"};
+
+  Timings timings;
+  for (int iteration = 0; iteration < flags.iterations; ++iteration) {
+    size_t step = 0;
+    Clock::time_point iteration_start = Clock::now();
+    Clock::time_point start = iteration_start;
+    auto record = [&](const string& name) {
+      Clock::time_point end = Clock::now();
+      timings.Add(step++, name, start, end);
+      start = end;
+    };
+
+    WorkspaceLayout workspace_layout;
+    string found_workspace = workspace_layout.GetWorkspace(cwd);
+    if (found_workspace != workspace) {
+      fprintf(stderr, "Found the workspace '%s' instead of '%s'\n",
+              found_workspace.c_str(), workspace.c_str());
+      return 1;
+    }
+    record("FindWorkspace");
+
+    OptionProcessor option_processor(
+        &workspace_layout,
+        std::unique_ptr<StartupOptions>(
+            new BazelStartupOptions(&workspace_layout)));
+    string error;
+    if (option_processor.ParseOptions(args, workspace, cwd, &error) !=
+        blaze_exit_code::SUCCESS) {
+      fprintf(stderr, "Couldn't parse the options: %s\n", error.c_str());
+      return 1;
+    }
+    vector<string> command_args = option_processor.GetCommandArguments();
+    record("ParseOptions");
+
+    BlazeLock lock;
+    AcquireLock(output_base, false, true, false, &lock);
+    record("AcquireLock");
+
+    string address, request_cookie, response_cookie;
+    if (!blaze_util::ReadFile(blaze_util::JoinPath(server_dir, "command_port"),
+                              &address) ||
+        !blaze_util::ReadFile(
+            blaze_util::JoinPath(server_dir, "request_cookie"),
+            &request_cookie) ||
+        !blaze_util::ReadFile(
+            blaze_util::JoinPath(server_dir, "response_cookie"),
+            &response_cookie) ||
+        !VerifyServerProcess(std::stoi(GetProcessIdAsString()), output_base)) {
+      fprintf(stderr, "Couldn't find the stub server\n");
+      return 1;
+    }
+    grpc::ChannelArguments channel_args;
+    channel_args.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                        4 * 1024 * 1024);
+    std::unique_ptr<command_server::CommandServer::Stub> client(
+        command_server::CommandServer::NewStub(grpc::CreateCustomChannel(
+            address, grpc::InsecureChannelCredentials(), channel_args)));
+    {
+      grpc::ClientContext context;
+      command_server::PingRequest request;
+      command_server::PingResponse response;
+      request.set_cookie(request_cookie);
+      grpc::Status status = client->Ping(&context, request, &response);
+      if (!status.ok() || response.cookie() != response_cookie) {
+        fprintf(stderr, "Couldn't ping the stub server: %s\n",
+                status.error_message().c_str());
+        return 1;
+      }
+    }
+    record("Connect");
+
+    {
+      grpc::ClientContext context;
+      command_server::RunRequest request;
+      request.set_cookie(request_cookie);
+      request.set_block_for_lock(true);
+      request.set_client_description("pid=" + GetProcessIdAsString());
+      request.add_arg(option_processor.GetCommand());
+      for (const string& arg : command_args) {
+        request.add_arg(arg);
+      }
+      std::unique_ptr<grpc::ClientReader<command_server::RunResponse>> reader(
+          client->Run(&context, request));
+      command_server::RunResponse response;
+      while (reader->Read(&response)) {
+      }
+      grpc::Status status = reader->Finish();
+      if (!status.ok() || !response.finished()) {
+        fprintf(stderr, "The command failed: %s\n",
+                status.error_message().c_str());
+        return 1;
+      }
+    }
+    record("Run");
+
+    client.reset();
+    ReleaseLock(&lock);
+    record("Teardown");
+
+    timings.Add(step, "Total", iteration_start, Clock::now());
+  }
+
+  server->Shutdown();
+
+  printf("%d iterations, %d rc files of %d lines, %d extra env vars\n",
+         flags.iterations, flags.rc_files, flags.rc_lines, flags.env_vars);
+  printf("%-16s %10s %10s\n", "step", "p50 (us)", "p99 (us)");
+  for (size_t i = 0; i < timings.names.size(); ++i) {
+    printf("%-16s %10lld %10lld\n", timings.names[i].c_str(),
+           static_cast<long long>(Percentile(timings.micros[i], 50)),
+           static_cast<long long>(Percentile(timings.micros[i], 99)));
+  }
+
+  vector<string> files;
+  blaze_util::GetAllFilesUnder(root, &files);
+  for (const string& file : files) {
+    blaze_util::UnlinkPath(file);
+  }
+  return 0;
+}
+
+}  // namespace blaze
+
+int main(int argc, char** argv) { return blaze::RunBenchmark(argc, argv); }
@@ -0,0 +1,61 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/client_profile.h"
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze {
+
+using std::chrono::microseconds;
+
+TEST(ClientProfileTest, EmptyProfileNamesTheProcess) {
+  ClientProfile profile;
+  ASSERT_EQ(
+      "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+      "\"args\":{\"name\":\"client\"}}]\n",
+      profile.ToJson());
+}
+
+TEST(ClientProfileTest, PhasesAndInstantsAreRelativeToConstruction) {
+  ClientProfile profile;
+  ClientProfile::Clock::time_point now = ClientProfile::Clock::now();
+  profile.AddPhase("Connect", now + microseconds(5000000),
+                   now + microseconds(5001500));
+  profile.AddInstant("first \"output\"", now + microseconds(7000000));
+  std::string json = profile.ToJson();
+
+  // The timestamps are at least the offsets above, as the profile was created
+  // before `now`, but not by more than a second.
+  size_t pos = json.find("{\"name\":\"Connect\",\"ph\":\"X\",\"ts\":5");
+  ASSERT_NE(std::string::npos, pos) << json;
+  ASSERT_NE(std::string::npos,
+            json.find(",\"dur\":1500,\"pid\":0,\"tid\":0}", pos))
+      << json;
+  ASSERT_NE(std::string::npos,
+            json.find("{\"name\":\"first \\\"output\\\"\",\"ph\":\"i\","
+                      "\"s\":\"p\",\"ts\":7"))
+      << json;
+}
+
+TEST(ClientProfileTest, ScopedPhaseIsRecorded) {
+  ClientProfile profile;
+  { ScopedClientPhase phase(&profile, "ParseOptions"); }
+  ASSERT_NE(std::string::npos,
+            profile.ToJson().find("{\"name\":\"ParseOptions\",\"ph\":\"X\""));
+}
+
+}  // namespace blaze
@@ -169,6 +169,40 @@ TEST_F(OptionProcessorTest, CanParseDifferentStartupArgs) {
             option_processor_->GetExplicitCommandArguments());
 }
 
+TEST_F(OptionProcessorTest, CanParseCommandsOfSession) {
+  const std::vector<std::string> args = {"bazel", "--host_jvm_args=MyParam",
+                                         "--experimental_session"};
+  std::string error;
+  ASSERT_EQ(blaze_exit_code::SUCCESS,
+            option_processor_->ParseOptions(args, workspace_, cwd_, &error))
+      << error;
+  EXPECT_EQ("", option_processor_->GetCommand());
+
+  ASSERT_EQ(blaze_exit_code::SUCCESS,
+            option_processor_->ParseCommand({"build", "--flag", "//my:target"},
+                                            workspace_, cwd_, &error))
+      << error;
+  EXPECT_EQ("build", option_processor_->GetCommand());
+  EXPECT_EQ(std::vector<std::string>({"--flag", "//my:target"}),
+            option_processor_->GetExplicitCommandArguments());
+
+  ASSERT_EQ(blaze_exit_code::SUCCESS,
+            option_processor_->ParseCommand({"info"}, workspace_, cwd_, &error))
+      << error;
+  EXPECT_EQ("info", option_processor_->GetCommand());
+  EXPECT_EQ(std::vector<std::string>({}),
+            option_processor_->GetExplicitCommandArguments());
+
+  // The startup options stay those of the session.
+  EXPECT_EQ(blaze_exit_code::BAD_ARGV,
+            option_processor_->ParseCommand({"--batch", "info"}, workspace_,
+                                            cwd_, &error));
+  EXPECT_EQ("info", option_processor_->GetCommand());
+  EXPECT_EQ(size_t(1),
+            option_processor_->GetParsedStartupOptions()->host_jvm_args.size());
+  EXPECT_TRUE(option_processor_->GetParsedStartupOptions()->session);
+}
+
 TEST_F(OptionProcessorTest, SplitCommandLineWithEmptyArgs) {
   FailedSplitStartupOptionsTest(
       {},
@@ -228,6 +228,54 @@ TEST_F(GetRcFileTest, GetRcFilesReadsUserRcInWorkspace) {
   EXPECT_EQ(expected_user_rc_que, parsed_rcs[0].get()->sources());
 }
 
+TEST_F(GetRcFileTest, GetRcFilesCachesParsedRcFilesUntilTheyChange) {
+  const std::string output_user_root =
+      blaze_util::JoinPath(blaze::GetEnv("TEST_TMPDIR"), "rc_cache_root");
+  ASSERT_TRUE(blaze_util::MakeDirectories(output_user_root, 0755));
+  const std::string imported_rc_path =
+      blaze_util::JoinPath(workspace_, "myimportedbazelrc");
+  ASSERT_TRUE(blaze_util::WriteFile("build --copt=1", imported_rc_path, 0755));
+  std::string user_workspace_rc;
+  ASSERT_TRUE(SetUpUserRcFileInWorkspace(
+      "build --copt=0\nimport " + imported_rc_path + "\nbuild --copt=2",
+      &user_workspace_rc));
+
+  const CommandLine cmd_line = CommandLine(
+      binary_path_,
+      {"--nomaster_bazelrc", "--output_user_root=" + output_user_root},
+      "build", {});
+  auto get_copts = [&]() {
+    std::string error;
+    std::vector<std::unique_ptr<RcFile>> parsed_rcs;
+    EXPECT_EQ(blaze_exit_code::SUCCESS,
+              option_processor_->GetRcFiles(workspace_layout_.get(), workspace_,
+                                            cwd_, &cmd_line, &parsed_rcs,
+                                            &error))
+        << error;
+    EXPECT_EQ(1, parsed_rcs.size());
+    const std::deque<std::string> expected_sources = {user_workspace_rc,
+                                                      imported_rc_path};
+    EXPECT_EQ(expected_sources, parsed_rcs[0]->sources());
+    std::string copts;
+    for (const RcOption& option : parsed_rcs[0]->options().at("build")) {
+      copts += *option.source_path == imported_rc_path ? "i" : "u";
+      copts += option.option;
+    }
+    return copts;
+  };
+
+  EXPECT_EQ("u--copt=0i--copt=1u--copt=2", get_copts());
+  std::vector<std::string> cache_files;
+  blaze_util::GetAllFilesUnder(
+      blaze_util::JoinPath(output_user_root, "rc_cache"), &cache_files);
+  EXPECT_EQ(1, cache_files.size());
+  EXPECT_EQ("u--copt=0i--copt=1u--copt=2", get_copts());
+
+  // Changing an imported file invalidates the cached parse.
+  ASSERT_TRUE(blaze_util::WriteFile("build --copt=3", imported_rc_path, 0755));
+  EXPECT_EQ("u--copt=0i--copt=3u--copt=2", get_copts());
+}
+
 using ParseOptionsTest = RcFileTest;
 
 TEST_F(ParseOptionsTest, IgnoreAllRcFilesIgnoresAllMasterAndUserRcFiles) {
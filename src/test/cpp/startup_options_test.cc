@@ -17,6 +17,9 @@
 #include <stdlib.h>
 
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/path_platform.h"
 #include "src/main/cpp/workspace_layout.h"
 #include "src/test/cpp/test_util.h"
 #include "googletest/include/gtest/gtest.h"
@@ -182,4 +185,77 @@ TEST_F(StartupOptionsTest, ProcessArgsWithMultipleArgstest) {
             startup_options_->original_startup_options_[1].value);
 }
 
+TEST_F(StartupOptionsTest, AdaptiveJVMArgumentsForSmallContainer) {
+  std::vector<std::string> result;
+  StartupOptions::AddAdaptiveJVMArguments(uint64_t{8} << 30, 4, {}, &result);
+  const std::vector<std::string> expected = {
+      "-Xmx4096m", "-XX:+UseG1GC", "-XX:ParallelGCThreads=4"};
+  EXPECT_EQ(expected, result);
+
+  result.clear();
+  StartupOptions::AddAdaptiveJVMArguments(uint64_t{1} << 30, 1, {}, &result);
+  const std::vector<std::string> expected_tiny = {"-Xmx512m",
+                                                  "-XX:+UseSerialGC"};
+  EXPECT_EQ(expected_tiny, result);
+}
+
+TEST_F(StartupOptionsTest, AdaptiveJVMArgumentsForLargeWorkstation) {
+  std::vector<std::string> result;
+  StartupOptions::AddAdaptiveJVMArguments(uint64_t{256} << 30, 64, {}, &result);
+  // The heap stays below the limit for compressed object pointers.
+  const std::vector<std::string> expected = {
+      "-Xmx31744m", "-XX:+UseG1GC", "-XX:ParallelGCThreads=43"};
+  EXPECT_EQ(expected, result);
+}
+
+TEST_F(StartupOptionsTest, AdaptiveJVMArgumentsRespectUserOptions) {
+  std::vector<std::string> result;
+  StartupOptions::AddAdaptiveJVMArguments(
+      uint64_t{8} << 30, 4, {"-Xmx2g", "-XX:+UseParallelGC"}, &result);
+  const std::vector<std::string> expected = {"-XX:ParallelGCThreads=4"};
+  EXPECT_EQ(expected, result);
+
+  // Nothing is known, so nothing is added.
+  result.clear();
+  StartupOptions::AddAdaptiveJVMArguments(0, 0, {}, &result);
+  EXPECT_TRUE(result.empty());
+}
+
+TEST_F(StartupOptionsTest, ClassDataSharingArgumentsWriteThenMapArchive) {
+  const std::string dir = blaze_util::JoinPath(GetEnv("TEST_TMPDIR"), "cds");
+  ASSERT_TRUE(blaze_util::MakeDirectories(dir, 0755));
+  const std::string release = "IMPLEMENTOR=\"Azul Systems, Inc.\"\n"
+                              "JAVA_VERSION=\"13.0.1\"\n";
+  const std::string archive = blaze_util::JoinPath(dir, "server-13_0_1.jsa");
+
+  std::vector<std::string> result;
+  StartupOptions::AddClassDataSharingArguments(release, dir, {}, &result);
+  const std::vector<std::string> expected_first = {
+      "-XX:ArchiveClassesAtExit=" + blaze_util::PathAsJvmFlag(archive)};
+  EXPECT_EQ(expected_first, result);
+
+  ASSERT_TRUE(blaze_util::WriteFile("", archive));
+  result.clear();
+  StartupOptions::AddClassDataSharingArguments(release, dir, {}, &result);
+  const std::vector<std::string> expected_later = {
+      "-XX:SharedArchiveFile=" + blaze_util::PathAsJvmFlag(archive)};
+  EXPECT_EQ(expected_later, result);
+}
+
+TEST_F(StartupOptionsTest, ClassDataSharingArgumentsNeedJdk13) {
+  const std::string dir = GetEnv("TEST_TMPDIR");
+  std::vector<std::string> result;
+  StartupOptions::AddClassDataSharingArguments("JAVA_VERSION=\"9.0.7\"\n",
+                                               dir, {}, &result);
+  StartupOptions::AddClassDataSharingArguments(
+      "JAVA_VERSION=\"1.8.0_172\"\n", dir, {}, &result);
+  StartupOptions::AddClassDataSharingArguments("", dir, {}, &result);
+  EXPECT_TRUE(result.empty());
+
+  // The user's own sharing flags take precedence.
+  StartupOptions::AddClassDataSharingArguments(
+      "JAVA_VERSION=\"14\"\n", dir, {"-Xshare:off"}, &result);
+  EXPECT_TRUE(result.empty());
+}
+
 }  // namespace blaze
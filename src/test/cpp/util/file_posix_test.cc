@@ -79,6 +79,58 @@ TEST(FilePosixTest, GetAllFilesUnder) {
   ASSERT_EQ(expected, result);
 }
 
+TEST(FilePosixTest, GetAllFilesUnderWalksTreeInParallel) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  ASSERT_STRNE(tmp_dir, NULL);
+  string root = JoinPath(tmp_dir, "FilePosixTest.GetAllFilesUnder.root");
+  ASSERT_TRUE(MakeDirectories(root, 0700));
+
+  // A tree with enough directories to keep several threads busy, plus a
+  // symlink to a directory, which is listed but not followed.
+  vector<string> expected;
+  for (int i = 0; i < 20; ++i) {
+    string dir = JoinPath(root, "d" + std::to_string(i) + "/sub");
+    ASSERT_TRUE(MakeDirectories(dir, 0700));
+    for (int j = 0; j < 3; ++j) {
+      string file = JoinPath(dir, "f" + std::to_string(j));
+      ASSERT_TRUE(WriteFile("", file));
+      expected.push_back(file);
+    }
+  }
+  string dir_sym = JoinPath(root, "dir_sym");
+  ASSERT_EQ(0, symlink("d0", dir_sym.c_str()));
+  expected.push_back(dir_sym);
+  std::sort(expected.begin(), expected.end());
+
+  vector<string> result;
+  GetAllFilesUnder(root, &result);
+  std::sort(result.begin(), result.end());
+  ASSERT_EQ(expected, result);
+
+  // A path that is not a directory has no files under it.
+  result.clear();
+  GetAllFilesUnder(expected[0], &result);
+  ASSERT_TRUE(result.empty());
+}
+
+TEST(FilePosixTest, SyncFiles) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  ASSERT_STRNE(tmp_dir, NULL);
+  string dir = JoinPath(tmp_dir, "FilePosixTest.SyncFiles");
+  ASSERT_TRUE(MakeDirectories(dir, 0700));
+  vector<string> paths;
+  for (int i = 0; i < 5; ++i) {
+    paths.push_back(JoinPath(dir, "f" + std::to_string(i)));
+    ASSERT_TRUE(WriteFile("data", paths.back()));
+  }
+  paths.push_back(dir);
+  SyncFiles(paths);
+  SyncFiles(vector<string>(1, dir));
+  SyncFiles(vector<string>());
+  ASSERT_DEATH(SyncFiles(vector<string>(1, JoinPath(dir, "missing"))),
+               "failed to open");
+}
+
 TEST(FilePosixTest, MakeDirectories) {
   const char* tmp_dir = getenv("TEST_TMPDIR");
   ASSERT_STRNE(tmp_dir, NULL);
@@ -381,6 +381,85 @@ TEST(LoggingTest, BazelLogHandler_BufferedLogsGetDirectedToCerr) {
   EXPECT_THAT(stderr_output, HasSubstr(teststring));
 }
 
+// Tests for the asynchronous BazelLogHandler
+
+TEST(LoggingTest, BazelLogHandler_Async_FlushWritesQueuedLogs) {
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler(
+          100, blaze_util::BazelLogHandler::OverflowPolicy::BLOCK));
+  blaze_util::BazelLogHandler* handler_ptr = handler.get();
+  blaze_util::SetLogHandler(std::move(handler));
+
+  BAZEL_LOG(INFO) << "buffered before the stream is set";
+  std::unique_ptr<std::stringstream> stringbuf(new std::stringstream());
+  std::stringstream* stringbuf_ptr = stringbuf.get();
+  blaze_util::SetLoggingOutputStream(std::move(stringbuf));
+
+  // More statements than fit in the queue, so that some wait for room.
+  for (int i = 0; i < 1000; ++i) {
+    BAZEL_LOG(INFO) << "queued statement " << i << ".";
+  }
+  handler_ptr->Flush();
+
+  std::string output(stringbuf_ptr->str());
+  EXPECT_THAT(output, HasSubstr("buffered before the stream is set"));
+  EXPECT_THAT(output, HasSubstr("queued statement 0."));
+  EXPECT_THAT(output, HasSubstr("queued statement 999."));
+  EXPECT_LT(output.find("queued statement 0."),
+            output.find("queued statement 999."));
+  blaze_util::SetLogHandler(nullptr);
+}
+
+TEST(LoggingTest, BazelLogHandler_Async_WarningsAreWrittenAfterQueuedLogs) {
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler(
+          100, blaze_util::BazelLogHandler::OverflowPolicy::BLOCK));
+  blaze_util::SetLogHandler(std::move(handler));
+  std::unique_ptr<std::stringstream> stringbuf(new std::stringstream());
+  std::stringstream* stringbuf_ptr = stringbuf.get();
+  blaze_util::SetLoggingOutputStream(std::move(stringbuf));
+
+  BAZEL_LOG(INFO) << "an info statement";
+  BAZEL_LOG(WARNING) << "a warning";
+
+  // The warning is written before BAZEL_LOG returns, after the queued
+  // statements.
+  std::string output(stringbuf_ptr->str());
+  EXPECT_THAT(output, MatchesRegex(".*an info statement.*a warning.*"));
+  blaze_util::SetLogHandler(nullptr);
+}
+
+TEST(LoggingTest, BazelLogHandler_Async_DroppedLogsAreReported) {
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler(
+          1, blaze_util::BazelLogHandler::OverflowPolicy::DROP));
+  blaze_util::BazelLogHandler* handler_ptr = handler.get();
+  blaze_util::SetLogHandler(std::move(handler));
+  std::unique_ptr<std::stringstream> stringbuf(new std::stringstream());
+  std::stringstream* stringbuf_ptr = stringbuf.get();
+  blaze_util::SetLoggingOutputStream(std::move(stringbuf));
+
+  static const int kStatements = 10000;
+  for (int i = 0; i < kStatements; ++i) {
+    BAZEL_LOG(INFO) << "maybe dropped";
+  }
+  handler_ptr->Flush();
+
+  // Whether statements get dropped depends on the timing, but if they do, it
+  // is reported.
+  std::string output(stringbuf_ptr->str());
+  int written = 0;
+  for (size_t pos = output.find("maybe dropped"); pos != std::string::npos;
+       pos = output.find("maybe dropped", pos + 1)) {
+    written++;
+  }
+  EXPECT_GT(written, 0);
+  if (written < kStatements) {
+    EXPECT_THAT(output, HasSubstr("log statements because the log output"));
+  }
+  blaze_util::SetLogHandler(nullptr);
+}
+
 // We use the LoggingDeathTest test case to make sure that the death tests are
 // run in a single threaded environment, where it is safe to fork. These tests
 // are run before the other tests, which can be run in parallel.
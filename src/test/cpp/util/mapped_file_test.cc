@@ -0,0 +1,132 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif  // not _WIN32
+
+#include <string>
+
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/mapped_file.h"
+#include "src/main/cpp/util/path.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+using std::string;
+
+static string TestFile(const char* name, const string& contents) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  EXPECT_NE(nullptr, tmp_dir);
+  string path = JoinPath(tmp_dir, name);
+  EXPECT_TRUE(WriteFile(contents, path));
+  return path;
+}
+
+TEST(MappedFileTest, MapsTheContents) {
+  // Larger than kPopulateLimit, to be advised sequential.
+  string contents(3 * MappedFile::kPopulateLimit, 'x');
+  contents[contents.size() - 1] = 'y';
+  string path = TestFile("big", contents);
+  for (auto pattern :
+       {MappedFile::kRandomAccess, MappedFile::kSequentialAccess}) {
+    MappedFile file;
+    string error;
+    ASSERT_TRUE(file.Open(path, pattern, &error)) << error;
+    ASSERT_EQ(contents.size(), file.size());
+    EXPECT_EQ(0, memcmp(contents.data(), file.start(), file.size()));
+    file.Prefetch(1, 100);
+    file.AdviseSequential(1, file.size() - 1);
+    file.Release(1, file.size() - 1);
+    EXPECT_EQ('y', *file.address(contents.size() - 1));
+    file.Close();
+    EXPECT_FALSE(file.is_open());
+  }
+}
+
+TEST(MappedFileTest, MapsEmptyFile) {
+  string path = TestFile("empty", "");
+  MappedFile file;
+  string error;
+  ASSERT_TRUE(file.Open(path, MappedFile::kRandomAccess, &error)) << error;
+  EXPECT_EQ(0u, file.size());
+  EXPECT_FALSE(file.mapped(file.start()));
+}
+
+TEST(MappedFileTest, DiscardsThePrefix) {
+  string contents(4 * MappedFile::kPopulateLimit, 'z');
+  string path = TestFile("discard", contents);
+  MappedFile file;
+  string error;
+  ASSERT_TRUE(file.Open(path, MappedFile::kSequentialAccess, &error))
+      << error;
+  file.Discard(MappedFile::kPopulateLimit);
+  EXPECT_EQ('z', *file.address(MappedFile::kPopulateLimit));
+  file.Discard(contents.size());
+  file.Close();
+}
+
+#ifndef _WIN32
+TEST(MappedFileTest, MapsOpenFile) {
+  string path = TestFile("handle", "contents");
+  int fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  MappedFile file;
+  string error;
+  ASSERT_TRUE(file.OpenHandle(fd, MappedFile::kRandomAccess, &error))
+      << error;
+  EXPECT_NE(fd, file.fd());
+  file.Close();
+  // The handle is still open.
+  char c;
+  EXPECT_EQ(1, pread(fd, &c, 1, 0));
+  EXPECT_EQ('c', c);
+  close(fd);
+}
+#endif  // not _WIN32
+
+TEST(MappedFileTest, UsesMemory) {
+  string contents(2 * MappedFile::kPopulateLimit, 'm');
+  MappedFile file;
+  file.OpenMemory(contents.data(), contents.size());
+  EXPECT_TRUE(file.is_open());
+  EXPECT_EQ(reinterpret_cast<const unsigned char*>(contents.data()),
+            file.start());
+  EXPECT_EQ(contents.size(), file.size());
+  // The hints must leave the memory alone.
+  file.Prefetch(0, contents.size());
+  file.AdviseSequential(0, contents.size());
+  file.Release(0, contents.size());
+  file.Discard(MappedFile::kPopulateLimit);
+  file.Close();
+  EXPECT_FALSE(file.is_open());
+  EXPECT_EQ(string(contents.size(), 'm'), contents);
+}
+
+TEST(MappedFileTest, FailsOnMissingFile) {
+  const char* tmp_dir = getenv("TEST_TMPDIR");
+  ASSERT_NE(nullptr, tmp_dir);
+  MappedFile file;
+  string error;
+  EXPECT_FALSE(file.Open(JoinPath(tmp_dir, "missing"),
+                         MappedFile::kRandomAccess, &error));
+  EXPECT_FALSE(error.empty());
+  EXPECT_FALSE(file.is_open());
+}
+
+}  // namespace blaze_util
@@ -0,0 +1,208 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the path functions of src/main/cpp/util with the implementations
+// they replaced, which built a new std::string at every step. Prints the time
+// and the number of heap allocations per call of each.
+//
+// Usage:
+//   path_benchmark [--iterations=N]
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/path_platform.h"
+
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+  ++allocations;
+  void *result = malloc(size == 0 ? 1 : size);
+  if (result == nullptr) {
+    throw std::bad_alloc();
+  }
+  return result;
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+namespace {
+
+// The implementations before allocations were cut down.
+namespace legacy {
+
+std::string JoinPath(const std::string &path1, const std::string &path2) {
+  if (path1.empty()) {
+    return path2;
+  }
+  if (path1[path1.size() - 1] == '/') {
+    if (path2.find('/') == 0) {
+      return path1 + path2.substr(1);
+    } else {
+      return path1 + path2;
+    }
+  } else {
+    if (path2.find('/') == 0) {
+      return path1 + path2;
+    } else {
+      return path1 + "/" + path2;
+    }
+  }
+}
+
+std::string Dirname(const std::string &path) {
+  return blaze_util::SplitPath(path).first;
+}
+
+std::string Basename(const std::string &path) {
+  return blaze_util::SplitPath(path).second;
+}
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+bool IsPathSeparator(char ch) { return ch == '/' || ch == '\\'; }
+
+bool HasDriveSpecifierPrefix(const char *ch) {
+  return isalpha(ch[0]) && ch[1] == ':';
+}
+
+std::string NormalizeWindowsPath(std::string path) {
+  if (path.empty()) {
+    return "";
+  }
+  if (path.size() >= 4 && path[0] == '\\' && path[3] == '\\') {
+    path = path.substr(4);
+  }
+  std::vector<std::string> segments;
+  int segment_start = -1;
+  for (int i = 0;; ++i) {
+    if (!IsPathSeparator(path[i]) && path[i] != '\0') {
+      if (segment_start < 0) {
+        segment_start = i;
+      }
+    } else if (segment_start >= 0 && i > segment_start) {
+      std::string segment(path, segment_start, i - segment_start);
+      segment_start = -1;
+      if (segment == "..") {
+        if (!segments.empty() &&
+            !HasDriveSpecifierPrefix(segments[0].c_str())) {
+          segments.pop_back();
+        }
+      } else if (segment != ".") {
+        segments.push_back(segment);
+      }
+    }
+    if (path[i] == '\0') {
+      break;
+    }
+  }
+  if (segments.size() == 1 && segments[0].size() == 2 &&
+      HasDriveSpecifierPrefix(segments[0].c_str())) {
+    return segments[0] + '\\';
+  }
+  bool first = true;
+  std::ostringstream result;
+  for (const auto &s : segments) {
+    if (!first) {
+      result << '\\';
+    }
+    first = false;
+    result << s;
+  }
+  return result.str();
+}
+#endif  // defined(_WIN32) || defined(__CYGWIN__)
+
+}  // namespace legacy
+
+// A sink for the results, so that the calls are not optimized away.
+size_t total_size = 0;
+
+// Runs `fn` `iterations` times and prints the time and the allocations per
+// call.
+void Measure(const char *name, int iterations,
+             const std::function<std::string()> &fn) {
+  size_t allocations_before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    total_size += fn().size();
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  printf("%-28s %10.1f %10.2f\n", name, ns / iterations,
+         static_cast<double>(allocations - allocations_before) / iterations);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int iterations = 1000000;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--iterations=", 13) == 0) {
+      iterations = atoi(argv[i] + 13);
+    } else {
+      fprintf(stderr, "path_benchmark: unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (iterations < 1) {
+    fprintf(stderr, "path_benchmark: --iterations must be positive\n");
+    return 1;
+  }
+
+  // Long enough not to fit in the small string buffer, like the paths under
+  // an output base.
+  const std::string dir =
+      "/home/user/.cache/bazel/_bazel_user/0123456789abcdef0123456789abcdef";
+  const std::string file = "install/_embedded_binaries/embedded_tools/jdk";
+  const std::string path = dir + "/" + file;
+  const std::string dir_slash = dir + "/";
+  const std::string slash_file = "/" + file;
+
+  printf("%-28s %10s %10s\n", "function", "ns/call", "allocs/call");
+  Measure("JoinPath (legacy)", iterations,
+          [&]() { return legacy::JoinPath(dir_slash, slash_file); });
+  Measure("JoinPath", iterations,
+          [&]() { return blaze_util::JoinPath(dir_slash, slash_file); });
+  Measure("Dirname (legacy)", iterations,
+          [&]() { return legacy::Dirname(path); });
+  Measure("Dirname", iterations, [&]() { return blaze_util::Dirname(path); });
+  Measure("Basename (legacy)", iterations,
+          [&]() { return legacy::Basename(path); });
+  Measure("Basename", iterations,
+          [&]() { return blaze_util::Basename(path); });
+#if defined(_WIN32) || defined(__CYGWIN__)
+  const std::string windows_path =
+      "C:/users/user/_bazel_user/0123456789abcdef/./execroot/../install/"
+      "_embedded_binaries//embedded_tools/jdk/bin/java.exe";
+  Measure("NormalizeWindowsPath (legacy)", iterations,
+          [&]() { return legacy::NormalizeWindowsPath(windows_path); });
+  Measure("NormalizeWindowsPath", iterations,
+          [&]() { return blaze_util::NormalizeWindowsPath(windows_path); });
+#endif  // defined(_WIN32) || defined(__CYGWIN__)
+
+  return total_size == 0 ? 1 : 0;
+}
@@ -131,6 +131,31 @@ TEST(BlazeUtil, StripWhitespace) {
   ASSERT_EQ("abc", str);
 }
 
+TEST(BlazeUtil, FindTokenBreak) {
+  // Every break character at every offset of inputs longer and shorter than
+  // the 16 bytes scanned at once.
+  const string breaks = " \t\n\v\f\r\"'\\";
+  for (size_t len : {0, 1, 15, 16, 17, 40}) {
+    string plain(len, 'a');
+    ASSERT_EQ(plain.data() + len,
+              FindTokenBreak(plain.data(), plain.data() + len));
+    for (size_t pos = 0; pos < len; ++pos) {
+      for (char c : breaks) {
+        string str = plain;
+        str[pos] = c;
+        ASSERT_EQ(str.data() + pos,
+                  FindTokenBreak(str.data(), str.data() + len))
+            << "break " << static_cast<int>(c) << " at " << pos;
+      }
+    }
+  }
+
+  // Bytes close to the break characters, and non-ASCII bytes, are not breaks.
+  const string almost = "\x08\x0e\x1f!#&(\x5b\x5d\x7f\x80\x89\xa0\xff";
+  ASSERT_EQ(almost.data() + almost.size(),
+            FindTokenBreak(almost.data(), almost.data() + almost.size()));
+}
+
 TEST(BlazeUtil, Tokenize) {
   vector<string> result;
   string str = "a b c";
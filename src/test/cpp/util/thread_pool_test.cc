@@ -0,0 +1,214 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <mutex>   // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "src/main/cpp/util/thread_pool.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+  std::atomic<int> sum(0);
+  {
+    ThreadPool pool(4, 2);
+    for (int i = 1; i <= 1000; ++i) {
+      EXPECT_TRUE(pool.Submit([&sum, i]() { sum += i; }));
+    }
+    pool.Wait();
+    EXPECT_EQ(500500, sum);
+    EXPECT_TRUE(pool.Submit([&sum]() { sum += 1; }));
+  }
+  // The destructor waits for the last one.
+  EXPECT_EQ(500501, sum);
+}
+
+TEST(ThreadPoolTest, TasksCanSubmitTasks) {
+  std::atomic<int> count(0);
+  ThreadPool pool(2, 1);
+  for (int i = 0; i < 10; ++i) {
+    pool.Submit([&pool, &count]() {
+      for (int j = 0; j < 10; ++j) {
+        // With the queues full, this runs the task right away.
+        EXPECT_TRUE(pool.Submit([&count]() { ++count; }));
+      }
+    });
+  }
+  pool.Wait();
+  EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPoolTest, OtherWorkersStealQueuedTasks) {
+  ThreadPool pool(4, 16);
+  std::mutex mutex;
+  std::vector<std::thread::id> threads;
+  pool.Submit([&]() {
+    // All of these go to the queue of this worker, which is busy.
+    for (int i = 0; i < 8; ++i) {
+      pool.Submit([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(std::this_thread::get_id());
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  });
+  pool.Wait();
+  ASSERT_EQ(8u, threads.size());
+  bool stolen = false;
+  for (const auto &id : threads) {
+    stolen = stolen || id != threads[0];
+  }
+  EXPECT_TRUE(stolen);
+}
+
+TEST(ThreadPoolTest, CancelDropsQueuedTasks) {
+  ThreadPool pool(1, 100);
+  std::atomic<bool> started(false);
+  std::atomic<bool> release(false);
+  std::atomic<int> ran(0);
+  pool.Submit([&]() {
+    started = true;
+    while (!release) {
+      std::this_thread::yield();
+    }
+    ++ran;
+  });
+  while (!started) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < 50; ++i) {
+    pool.Submit([&ran]() { ++ran; });
+  }
+  pool.Cancel();
+  release = true;
+  pool.Wait();
+  EXPECT_TRUE(pool.cancelled());
+  EXPECT_EQ(1, ran);
+  EXPECT_FALSE(pool.Submit([&ran]() { ++ran; }));
+}
+
+TEST(ThreadPoolTest, RunOrderedCommitsInOrder) {
+  ThreadPool pool(4, 4);
+  std::vector<int> values(100);
+  std::vector<int> committed;
+  EXPECT_TRUE(RunOrdered(
+      &pool, values.size(), 8,
+      [&values](size_t ix) {
+        // Later items tend to be ready first.
+        std::this_thread::sleep_for(std::chrono::microseconds(100 - ix));
+        values[ix] = static_cast<int>(ix) * 2;
+      },
+      [&values, &committed](size_t ix) {
+        committed.push_back(values[ix]);
+        return true;
+      }));
+  ASSERT_EQ(100u, committed.size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i * 2, committed[i]);
+  }
+}
+
+TEST(ThreadPoolTest, RunOrderedStopsWhenCommitFails) {
+  ThreadPool pool(2, 4);
+  std::atomic<size_t> produced(0);
+  size_t committed = 0;
+  EXPECT_FALSE(RunOrdered(
+      &pool, 1000, 4, [&produced](size_t ix) { ++produced; },
+      [&committed](size_t ix) {
+        ++committed;
+        return ix < 9;
+      }));
+  EXPECT_EQ(10u, committed);
+  // No more than max_ahead past the failed one were produced.
+  EXPECT_LE(produced, 14u);
+}
+
+TEST(ThreadPoolTest, RunOrderedStopsWhenCancelled) {
+  ThreadPool pool(2, 4);
+  EXPECT_FALSE(RunOrdered(&pool, 1000, 4, [](size_t ix) {},
+                          [&pool](size_t ix) {
+                            if (ix == 5) {
+                              pool.Cancel();
+                            }
+                            return true;
+                          }));
+}
+
+TEST(ThreadPoolTest, RunOrderedWithoutPoolRunsInTurn) {
+  std::vector<std::string> calls;
+  EXPECT_FALSE(RunOrdered(
+      nullptr, 5, 2,
+      [&calls](size_t ix) { calls.push_back("p" + std::to_string(ix)); },
+      [&calls](size_t ix) {
+        calls.push_back("c" + std::to_string(ix));
+        return ix < 2;
+      }));
+  EXPECT_EQ(std::vector<std::string>({"p0", "c0", "p1", "c1", "p2", "c2"}),
+            calls);
+}
+
+TEST(ThreadPoolTest, ParallelForRunsEveryItemOnce) {
+  ThreadPool pool(4, 2);
+  for (size_t max_threads : {1, 2, 8}) {
+    std::vector<std::atomic<int>> runs(1000);
+    ParallelFor(&pool, runs.size(), max_threads,
+                [&runs](size_t ix) { ++runs[ix]; });
+    for (auto &count : runs) {
+      EXPECT_EQ(1, count);
+    }
+  }
+  std::vector<int> order;
+  ParallelFor(nullptr, 3, 8, [&order](size_t ix) { order.push_back(ix); });
+  EXPECT_EQ(std::vector<int>({0, 1, 2}), order);
+}
+
+TEST(ThreadPoolTest, ParallelForOnlyWaitsForItsItems) {
+  ThreadPool pool(2, 4);
+  std::mutex mutex;
+  std::unique_lock<std::mutex> blocked(mutex);
+  // Keeps one worker busy until the end of the test.
+  pool.Submit([&mutex]() { std::lock_guard<std::mutex> lock(mutex); });
+  std::atomic<int> sum(0);
+  ParallelFor(&pool, 100, 4, [&sum](size_t ix) { sum += ix; });
+  EXPECT_EQ(4950, sum);
+  blocked.unlock();
+}
+
+TEST(ThreadPoolTest, ParallelForFromTasks) {
+  ThreadPool pool(2, 1);
+  std::atomic<int> count(0);
+  ParallelFor(&pool, 10, 4, [&pool, &count](size_t) {
+    // Even with every worker in here, the calling threads make progress.
+    ParallelFor(&pool, 10, 4, [&count](size_t) { ++count; });
+  });
+  EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPoolTest, CpuLimitFromCgroup) {
+  EXPECT_EQ(0, CpuLimitFromCgroup("max 100000\n"));
+  EXPECT_EQ(0, CpuLimitFromCgroup("-1 100000 "));
+  EXPECT_EQ(0, CpuLimitFromCgroup(""));
+  EXPECT_EQ(2, CpuLimitFromCgroup("200000 100000\n"));
+  EXPECT_EQ(2, CpuLimitFromCgroup("150000 100000"));
+  EXPECT_EQ(1, CpuLimitFromCgroup("50000 100000"));
+  EXPECT_GE(DefaultThreadCount(), 1);
+}
+
+}  // namespace blaze_util
@@ -68,4 +68,27 @@ TEST_F(WorkspaceLayoutTest, GetWorkspace) {
   ASSERT_EQ(build_root_, workspace_layout_->GetWorkspace(cwd));
 }
 
+TEST_F(WorkspaceLayoutTest, GetWorkspaceWithHint) {
+  const std::string nested = blaze_util::JoinPath(build_root_, "nested");
+  ASSERT_TRUE(blaze_util::MakeDirectories(nested, 0755));
+  ASSERT_TRUE(blaze_util::WriteFile(
+      "", blaze_util::JoinPath(nested, "WORKSPACE"), 0755));
+  const std::string cwd = blaze_util::JoinPath(nested, "foo");
+
+  // The hint is taken as is, nested workspaces and all.
+  ASSERT_EQ(build_root_,
+            workspace_layout_->GetWorkspaceWithHint(cwd, build_root_));
+  ASSERT_EQ(build_root_,
+            workspace_layout_->GetWorkspaceWithHint(build_root_, build_root_));
+
+  // Without a usable hint, the nearest workspace is looked for.
+  ASSERT_EQ(nested, workspace_layout_->GetWorkspaceWithHint(cwd, ""));
+  ASSERT_EQ(nested, workspace_layout_->GetWorkspaceWithHint(
+                        cwd, blaze_util::JoinPath(build_root_, "nes")));
+  ASSERT_EQ(nested, workspace_layout_->GetWorkspaceWithHint(
+                        cwd, blaze_util::JoinPath(build_root_, "other")));
+  ASSERT_EQ(nested, workspace_layout_->GetWorkspaceWithHint(
+                        cwd, blaze_util::Dirname(build_root_)));
+}
+
 }  // namespace blaze
@@ -0,0 +1,89 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.actions;
+
+import static com.google.common.truth.Truth.assertThat;
+
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/**
+ * Tests for {@link LocalHostCapacity}.
+ *
+ * <p>The limits are what the client read from the cgroup files, which
+ * src/test/cpp/blaze_util_posix_test.cc covers; 0 stands for none, as for a cgroup v2 "max".
+ */
+@RunWith(JUnit4.class)
+public class LocalHostCapacityTest {
+
+  private ResourceSet machine;
+
+  @Before
+  public final void getMachineCapacity() {
+    LocalHostCapacity.setResourceLimits(0, 0);
+    machine = LocalHostCapacity.getLocalHostCapacity();
+  }
+
+  @After
+  public final void resetLimits() {
+    LocalHostCapacity.setResourceLimits(0, 0);
+  }
+
+  /** ResourceSet has no equals(). */
+  private void assertIsMachineCapacity(ResourceSet capacity) {
+    assertThat(capacity.getMemoryMb()).isEqualTo(machine.getMemoryMb());
+    assertThat(capacity.getCpuUsage()).isEqualTo(machine.getCpuUsage());
+    assertThat(capacity.getIoUsage()).isEqualTo(machine.getIoUsage());
+    assertThat(capacity.getLocalTestCount()).isEqualTo(machine.getLocalTestCount());
+  }
+
+  @Test
+  public void testLowerLimitsCapTheMachine() {
+    LocalHostCapacity.setResourceLimits(machine.getMemoryMb() / 2, machine.getCpuUsage() / 2);
+    ResourceSet capacity = LocalHostCapacity.getLocalHostCapacity();
+    assertThat(capacity.getMemoryMb()).isEqualTo(machine.getMemoryMb() / 2);
+    assertThat(capacity.getCpuUsage()).isEqualTo(machine.getCpuUsage() / 2);
+    assertThat(capacity.getIoUsage()).isEqualTo(machine.getIoUsage());
+    assertThat(capacity.getLocalTestCount()).isEqualTo(machine.getLocalTestCount());
+  }
+
+  @Test
+  public void testHigherLimitsDoNotRaiseTheMachine() {
+    LocalHostCapacity.setResourceLimits(machine.getMemoryMb() * 2, machine.getCpuUsage() * 2);
+    assertIsMachineCapacity(LocalHostCapacity.getLocalHostCapacity());
+  }
+
+  @Test
+  public void testUnlimitedResourceKeepsTheMachineValue() {
+    LocalHostCapacity.setResourceLimits(0, machine.getCpuUsage() / 2);
+    ResourceSet capacity = LocalHostCapacity.getLocalHostCapacity();
+    assertThat(capacity.getMemoryMb()).isEqualTo(machine.getMemoryMb());
+    assertThat(capacity.getCpuUsage()).isEqualTo(machine.getCpuUsage() / 2);
+
+    LocalHostCapacity.setResourceLimits(machine.getMemoryMb() / 2, 0);
+    capacity = LocalHostCapacity.getLocalHostCapacity();
+    assertThat(capacity.getMemoryMb()).isEqualTo(machine.getMemoryMb() / 2);
+    assertThat(capacity.getCpuUsage()).isEqualTo(machine.getCpuUsage());
+  }
+
+  @Test
+  public void testNewLimitsReplaceExplicitCapacity() {
+    LocalHostCapacity.setLocalHostCapacity(ResourceSet.createWithRamCpuIo(1, 1, 1));
+    LocalHostCapacity.setResourceLimits(0, 0);
+    assertIsMachineCapacity(LocalHostCapacity.getLocalHostCapacity());
+  }
+}
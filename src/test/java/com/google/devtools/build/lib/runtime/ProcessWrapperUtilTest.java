@@ -71,6 +71,9 @@ public final class ProcessWrapperUtilTest {
             .add("--kill_delay=" + killDelay.getSeconds())
             .add("--stdout=" + stdoutPath)
             .add("--stderr=" + stderrPath)
+            .add("--stream_output")
+            .add("--max_output_bytes=1048576")
+            .add("--kill_output_bytes=1073741824")
             .add("--stats=" + statisticsPath)
             .addAll(commandArguments)
             .build();
@@ -81,6 +84,9 @@ public final class ProcessWrapperUtilTest {
             .setKillDelay(killDelay)
             .setStdoutPath(stdoutPath)
             .setStderrPath(stderrPath)
+            .setStreamOutput(true)
+            .setMaxOutputBytes(1 << 20)
+            .setKillOutputBytes(1 << 30)
             .setStatisticsPath(statisticsPath)
             .build();
 
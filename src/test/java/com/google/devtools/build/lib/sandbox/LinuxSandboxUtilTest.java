@@ -56,6 +56,38 @@ public final class LinuxSandboxUtilTest {
     assertThat(e).hasMessageThat().contains("exclusive");
   }
 
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_networkNamespaceOptionsAreExclusive() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, flo");
+
+    Exception e =
+        assertThrows(
+            IllegalStateException.class,
+            () ->
+                LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+                    .setCreateNetworkNamespace(true)
+                    .setNetworkNamespace(testFS.getPath("/proc/1/ns/net"))
+                    .build());
+    assertThat(e).hasMessageThat().contains("exclusive");
+  }
+
+  @Test
+  public void testLinuxSandboxCommandLineBuilder_joinsNetworkNamespace() {
+    Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
+    ImmutableList<String> commandArguments = ImmutableList.of("echo", "hello, flo");
+
+    List<String> commandLine =
+        LinuxSandboxUtil.commandLineBuilder(linuxSandboxPath, commandArguments)
+            .setNetworkNamespace(testFS.getPath("/proc/1/ns/net"))
+            .build();
+
+    assertThat(commandLine)
+        .containsExactly(
+            linuxSandboxPath.getPathString(), "-n", "/proc/1/ns/net", "--", "echo", "hello, flo")
+        .inOrder();
+  }
+
   @Test
   public void testLinuxSandboxCommandLineBuilder_BuildsWithoutOptionalArguments() {
     Path linuxSandboxPath = testFS.getPath("/linux-sandbox");
@@ -84,6 +116,9 @@ public final class LinuxSandboxUtilTest {
     Duration timeout = Duration.ofSeconds(10);
     Duration killDelay = Duration.ofSeconds(2);
     Path statisticsPath = testFS.getPath("/stats.out");
+    Path cgroupParent = testFS.getPath("/sys/fs/cgroup/bazel");
+    long memoryLimitBytes = 1L << 30;
+    double cpuLimit = 1.5;
 
     Path workingDirectory = testFS.getPath("/all-work-and-no-play");
     Path stdoutPath = testFS.getPath("/stdout.txt");
@@ -115,9 +150,14 @@ public final class LinuxSandboxUtilTest {
     Path tmpfsDir1 = sandboxDir.getRelative("tmpfs1");
     Path tmpfsDir2 = sandboxDir.getRelative("tmpfs2");
 
+    Path inputLayer = workDir.getRelative("inputs");
+    Path overlayWorkDir = workDir.getRelative("overlay-work");
+
     ImmutableSet<Path> writableFilesAndDirectories = ImmutableSet.of(writableDir1, writableDir2);
 
     ImmutableSet<Path> tmpfsDirectories = ImmutableSet.of(tmpfsDir1, tmpfsDir2);
+    String tmpfsOptions = "size=1g,huge=within_size";
+    Path scratchDir = sandboxDir.getRelative("scratch");
 
     ImmutableSortedMap<Path, Path> bindMounts =
         ImmutableSortedMap.<Path, Path>naturalOrder()
@@ -134,16 +174,28 @@ public final class LinuxSandboxUtilTest {
             .add("-t", Long.toString(killDelay.getSeconds()))
             .add("-l", stdoutPath.getPathString())
             .add("-L", stderrPath.getPathString())
+            .add("-O")
             .add("-w", writableDir1.getPathString())
             .add("-w", writableDir2.getPathString())
             .add("-e", tmpfsDir1.getPathString())
+            .add("-E", tmpfsOptions)
             .add("-e", tmpfsDir2.getPathString())
+            .add("-E", tmpfsOptions)
+            .add("-s", scratchDir.getPathString())
+            .add("-E", tmpfsOptions)
             .add("-M", bindMountSameSourceAndTarget.getPathString())
             .add("-M", bindMountSource1.getPathString())
             .add("-m", bindMountTarget1.getPathString())
             .add("-M", bindMountSource2.getPathString())
             .add("-m", bindMountTarget2.getPathString())
+            .add("-I", inputLayer.getPathString())
+            .add("-i", overlayWorkDir.getPathString())
             .add("-S", statisticsPath.getPathString())
+            .add("-C", cgroupParent.getPathString())
+            .add("-x", Long.toString(memoryLimitBytes))
+            .add("-c", "1.5")
+            .add("-a", "0-3,8")
+            .add("-b", "0")
             .add("-H")
             .add("-N")
             .add("-U")
@@ -157,15 +209,24 @@ public final class LinuxSandboxUtilTest {
             .setWorkingDirectory(workingDirectory)
             .setStdoutPath(stdoutPath)
             .setStderrPath(stderrPath)
+            .setStreamOutput(true)
             .setTimeout(timeout)
             .setKillDelay(killDelay)
             .setWritableFilesAndDirectories(writableFilesAndDirectories)
             .setTmpfsDirectories(tmpfsDirectories)
+            .setTmpfsOptions(tmpfsOptions)
+            .setScratchDirectory(scratchDir)
             .setBindMounts(bindMounts)
+            .setInputLayer(inputLayer, overlayWorkDir)
             .setUseFakeHostname(useFakeHostname)
             .setCreateNetworkNamespace(createNetworkNamespace)
             .setUseFakeRoot(useFakeRoot)
             .setStatisticsPath(statisticsPath)
+            .setCgroupParent(cgroupParent)
+            .setMemoryLimitBytes(memoryLimitBytes)
+            .setCpuLimit(cpuLimit)
+            .setCpus("0-3,8")
+            .setNumaNodes("0")
             .setUseFakeUsername(useFakeUsername)
             .setUseDebugMode(useDebugMode)
             .build();
@@ -309,8 +309,8 @@ public class GrpcServerTest {
 
     when(mockSink.offer(any(RunResponse.class))).thenReturn(true);
 
-    String chunk1 = Strings.repeat("a", 8192);
-    String chunk2 = Strings.repeat("b", 8192);
+    String chunk1 = Strings.repeat("a", GrpcServerImpl.RpcOutputStream.CHUNK_SIZE);
+    String chunk2 = Strings.repeat("b", GrpcServerImpl.RpcOutputStream.CHUNK_SIZE);
     String chunk3 = Strings.repeat("c", 1024);
 
     underTest.write((chunk1 + chunk2 + chunk3).getBytes(StandardCharsets.ISO_8859_1));
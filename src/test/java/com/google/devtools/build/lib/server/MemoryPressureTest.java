@@ -0,0 +1,52 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.server;
+
+import static com.google.common.truth.Truth.assertThat;
+
+import com.google.devtools.build.lib.testutil.Suite;
+import com.google.devtools.build.lib.testutil.TestSpec;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Unit tests for {@link MemoryPressure}. */
+@TestSpec(size = Suite.SMALL_TESTS)
+@RunWith(JUnit4.class)
+public class MemoryPressureTest {
+
+  @Test
+  public void testLinuxPressureAboveThreshold() {
+    assertThat(
+            MemoryPressure.isLinuxPressureHigh(
+                "some avg10=23.51 avg60=8.02 avg300=1.90 total=48230117\n"
+                    + "full avg10=11.20 avg60=3.31 avg300=0.75 total=20511348\n"))
+        .isTrue();
+  }
+
+  @Test
+  public void testLinuxPressureBelowThreshold() {
+    assertThat(
+            MemoryPressure.isLinuxPressureHigh(
+                "some avg10=0.00 avg60=12.50 avg300=4.00 total=1303212\n"
+                    + "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"))
+        .isFalse();
+  }
+
+  @Test
+  public void testLinuxPressureUnparseable() {
+    assertThat(MemoryPressure.isLinuxPressureHigh("")).isFalse();
+    assertThat(MemoryPressure.isLinuxPressureHigh("some avg10=lots\n")).isFalse();
+  }
+}
@@ -16,6 +16,7 @@ package com.google.devtools.build.lib.shell;
 import static com.google.common.truth.Truth.assertThat;
 import static com.google.common.truth.Truth.assertWithMessage;
 import static com.google.devtools.build.lib.shell.TestUtil.assertArrayEquals;
+import static java.nio.charset.StandardCharsets.UTF_8;
 import static org.junit.Assert.fail;
 
 import com.google.common.collect.ImmutableMap;
@@ -27,6 +28,7 @@ import java.io.File;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
+import java.nio.file.Files;
 import java.time.Duration;
 import java.util.Collections;
 import java.util.Map;
@@ -189,6 +191,26 @@ public class CommandTest {
     assertThat(stdErr.toByteArray()).isEmpty();
   }
 
+  @Test
+  public void testOutputRedirectedToFiles() throws Exception {
+    File stdoutFile = File.createTempFile("command-test", "stdout");
+    File stderrFile = File.createTempFile("command-test", "stderr");
+    Command command =
+        new Command(new String[] {"/bin/sh", "-c", "echo out; echo err >&2; echo again"});
+    CommandResult result = command.execute(stdoutFile, stderrFile);
+    assertThat(result.getTerminationStatus().success()).isTrue();
+    assertThat(new String(Files.readAllBytes(stdoutFile.toPath()), UTF_8))
+        .isEqualTo("out\nagain\n");
+    assertThat(new String(Files.readAllBytes(stderrFile.toPath()), UTF_8)).isEqualTo("err\n");
+
+    // The redirection only applies to that one execution.
+    result = command.execute();
+    assertThat(new String(result.getStdout(), UTF_8)).isEqualTo("out\nagain\n");
+    assertThat(new String(result.getStderr(), UTF_8)).isEqualTo("err\n");
+    stdoutFile.delete();
+    stderrFile.delete();
+  }
+
   @Test
   public void testAsynchronous() throws Exception {
     File tempFile = File.createTempFile("googlecron-test", "tmp");
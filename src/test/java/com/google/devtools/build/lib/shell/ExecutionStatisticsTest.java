@@ -137,4 +137,68 @@ public final class ExecutionStatisticsTest {
     assertThat(resourceUsage.getInvoluntaryContextSwitches())
         .isEqualTo(riggedInvoluntaryContextSwitches);
   }
+
+  @Test
+  public void testNoCgroupUsage_whenNoCgroupUsageProto() throws Exception {
+    Path protoFilename =
+        createExecutionStatisticsProtoFile(
+            com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.getDefaultInstance());
+
+    assertThat(ExecutionStatistics.getCgroupUsage(protoFilename)).isEmpty();
+  }
+
+  @Test
+  public void testCgroupUsageProvided_fromProtoFilename() throws Exception {
+    com.google.devtools.build.lib.shell.Protos.CgroupUsage cgroupUsageProto =
+        com.google.devtools.build.lib.shell.Protos.CgroupUsage.newBuilder()
+            .setMemoryPeakBytes(1)
+            .setOomKills(2)
+            .setCpuUsageUsec(3000)
+            .setCpuUserUsec(2000)
+            .setCpuSystemUsec(1000)
+            .setIoReadBytes(4)
+            .setIoWriteBytes(5)
+            .build();
+    Path protoFilename =
+        createExecutionStatisticsProtoFile(
+            com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+                .setCgroupUsage(cgroupUsageProto)
+                .build());
+
+    Optional<ExecutionStatistics.CgroupUsage> maybeCgroupUsage =
+        ExecutionStatistics.getCgroupUsage(protoFilename);
+    assertThat(maybeCgroupUsage).isPresent();
+    ExecutionStatistics.CgroupUsage cgroupUsage = maybeCgroupUsage.get();
+
+    assertThat(cgroupUsage.getMemoryPeakBytes()).isEqualTo(1);
+    assertThat(cgroupUsage.getOomKills()).isEqualTo(2);
+    assertThat(cgroupUsage.getCpuTime()).isEqualTo(Duration.ofMillis(3));
+    assertThat(cgroupUsage.getUserCpuTime()).isEqualTo(Duration.ofMillis(2));
+    assertThat(cgroupUsage.getSystemCpuTime()).isEqualTo(Duration.ofMillis(1));
+    assertThat(cgroupUsage.getIoReadBytes()).isEqualTo(4);
+    assertThat(cgroupUsage.getIoWriteBytes()).isEqualTo(5);
+  }
+
+  @Test
+  public void testPhaseTimingsProvided_fromProtoFilename() throws Exception {
+    Path protoFilename =
+        createExecutionStatisticsProtoFile(
+            com.google.devtools.build.lib.shell.Protos.ExecutionStatistics.newBuilder()
+                .setTimestamps(
+                    com.google.devtools.build.lib.shell.Protos.PhaseTimestamps.newBuilder()
+                        .setStartUsec(1000)
+                        .setChildStartUsec(3000)
+                        .setChildExitUsec(10000)
+                        .setEndUsec(11000))
+                .build());
+
+    Optional<ExecutionStatistics.PhaseTimings> maybePhaseTimings =
+        ExecutionStatistics.getPhaseTimings(protoFilename);
+    assertThat(maybePhaseTimings).isPresent();
+    ExecutionStatistics.PhaseTimings phaseTimings = maybePhaseTimings.get();
+
+    assertThat(phaseTimings.getSetupTime()).isEqualTo(Duration.ofMillis(2));
+    assertThat(phaseTimings.getCommandTime()).isEqualTo(Duration.ofMillis(7));
+    assertThat(phaseTimings.getTeardownTime()).isEqualTo(Duration.ofMillis(1));
+  }
 }
@@ -120,6 +120,32 @@ public class MacOSXFsEventsDiffAwarenessTest {
     assertDiff(view2, view3, "a", "a/b", "a/b/c", "b", "b/c", "b/c/d");
   }
 
+  @Test
+  public void testResumesFromStateFile() throws Exception {
+    Path stateDir = com.google.common.io.Files.createTempDir().getCanonicalFile().toPath();
+    Path stateFile = stateDir.resolve("state");
+    MacOSXFsEventsDiffAwareness first =
+        new MacOSXFsEventsDiffAwareness(watchedPath.toString(), stateFile);
+    first.getCurrentView(watchFsEnabledProvider);
+    first.close();
+    assertThat(Files.exists(stateFile)).isTrue();
+
+    scratchFile("a/b");
+    Thread.sleep(200); // Let the change reach the event history
+    MacOSXFsEventsDiffAwareness second =
+        new MacOSXFsEventsDiffAwareness(watchedPath.toString(), stateFile);
+    try {
+      View view1 = second.getCurrentView(watchFsEnabledProvider);
+      Thread.sleep(200); // Wait until the replayed events propagate
+      View view2 = second.getCurrentView(watchFsEnabledProvider);
+      assertThat(toString(second.getDiff(view1, view2).modifiedSourceFiles()))
+          .containsAllOf("a", "a/b");
+    } finally {
+      second.close();
+      rmdirs(stateDir);
+    }
+  }
+
   /**
    * Only returns a fixed options class for {@link LocalDiffAwareness.Options}.
    */
@@ -15,6 +15,7 @@ package com.google.devtools.build.lib.unix;
 
 import static com.google.common.truth.Truth.assertThat;
 import static com.google.devtools.build.lib.testutil.MoreAsserts.assertThrows;
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
 import static java.nio.charset.StandardCharsets.UTF_8;
 import static org.junit.Assert.fail;
 import static org.junit.Assume.assumeTrue;
@@ -27,6 +28,7 @@ import com.google.devtools.build.lib.vfs.FileAccessException;
 import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.Symlinks;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
@@ -155,4 +157,139 @@ public class NativePosixFilesTest {
     assertThrows(
         FileNotFoundException.class, () -> NativePosixFiles.lgetxattr(nonexistentFile, "foo"));
   }
+
+  @Test
+  public void testDeleteTreesBelow() throws Exception {
+    Path dir = workingDir.getRelative("deletetree");
+    Path outside = workingDir.getRelative("outside");
+    FileSystemUtils.createDirectoryAndParents(dir.getRelative("a/b"));
+    FileSystemUtils.createDirectoryAndParents(dir.getRelative("c"));
+    FileSystemUtils.createDirectoryAndParents(outside);
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("a/b/file"), "x");
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("file"), "x");
+    FileSystemUtils.writeContentAsLatin1(outside.getRelative("kept"), "x");
+    dir.getRelative("a/link").createSymbolicLink(outside);
+    dir.getRelative("a/b").setWritable(false);
+    dir.getRelative("c").setReadable(false);
+
+    NativePosixFiles.deleteTreesBelow(dir.getPathString(), true);
+
+    assertThat(dir.isDirectory()).isTrue();
+    assertThat(dir.getDirectoryEntries()).isEmpty();
+    assertThat(outside.getRelative("kept").exists()).isTrue();
+  }
+
+  @Test
+  public void testDeleteTreesBelow_NotADirectory() throws Exception {
+    FileSystemUtils.writeContentAsLatin1(testFile, "x");
+
+    NativePosixFiles.deleteTreesBelow(testFile.getPathString(), false);
+    NativePosixFiles.deleteTreesBelow(workingDir.getChild("nonexistent").toString(), false);
+
+    assertThat(testFile.exists()).isTrue();
+  }
+
+  @Test
+  public void testChmodTree() throws Exception {
+    Path dir = workingDir.getRelative("chmodtree");
+    Path outside = workingDir.getRelative("chmodtree_outside");
+    FileSystemUtils.createDirectoryAndParents(dir.getRelative("a/b"));
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("a/b/file"), "x");
+    FileSystemUtils.writeContentAsLatin1(dir.getRelative("file"), "x");
+    FileSystemUtils.writeContentAsLatin1(outside, "x");
+    outside.chmod(0644);
+    dir.getRelative("a/link").createSymbolicLink(outside);
+    dir.getRelative("a/b").chmod(0700);
+
+    NativePosixFiles.chmodTree(dir.getPathString(), 0555, 1000000, true);
+
+    for (String entry : new String[] {"", "/a", "/a/b", "/a/b/file", "/file"}) {
+      FileStatus status = NativePosixFiles.lstat(dir.getPathString() + entry);
+      assertThat(status.getPermissions()).isEqualTo(0555);
+      assertThat(status.getLastModifiedTime()).isEqualTo(1000);
+    }
+    assertThat(NativePosixFiles.lstat(outside.getPathString()).getPermissions()).isEqualTo(0644);
+    NativePosixFiles.chmodTree(workingDir.getChild("nonexistent").toString(), 0555, -1, false);
+    NativePosixFiles.chmodTree(dir.getPathString(), 0755, -1, false);
+  }
+
+  @Test
+  public void testSymlinkTree() throws Exception {
+    Path root = workingDir.getRelative("symlinktree");
+    root.createDirectory();
+
+    NativePosixFiles.symlinkTree(
+        root.getPathString(),
+        new String[] {"a/b/c", "a/b/d", "a/e", "f"},
+        new String[] {"/target/c", "target/d", null, "/target/f"},
+        true);
+
+    assertThat(root.getRelative("a/b/c").readSymbolicLink().getPathString())
+        .isEqualTo("/target/c");
+    assertThat(root.getRelative("a/b/d").readSymbolicLink().getPathString())
+        .isEqualTo("target/d");
+    assertThat(root.getRelative("a/e").isFile(Symlinks.NOFOLLOW)).isTrue();
+    assertThat(root.getRelative("a/e").getFileSize()).isEqualTo(0);
+    assertThat(root.getRelative("f").readSymbolicLink().getPathString()).isEqualTo("/target/f");
+  }
+
+  @Test
+  public void testSymlinkTree_LinkBelowLinkFails() throws Exception {
+    Path root = workingDir.getRelative("symlinktree");
+    root.createDirectory();
+    workingDir.getRelative("outside").createDirectory();
+
+    assertThrows(
+        IOException.class,
+        () ->
+            NativePosixFiles.symlinkTree(
+                root.getPathString(),
+                new String[] {"a", "a/b"},
+                new String[] {workingDir.getRelative("outside").getPathString(), "/target"},
+                false));
+    assertThat(workingDir.getRelative("outside/b").exists(Symlinks.NOFOLLOW)).isFalse();
+  }
+
+  @Test
+  public void testCopyFile() throws Exception {
+    Path from = workingDir.getRelative("from");
+    Path to = workingDir.getRelative("to");
+    FileSystemUtils.writeContentAsLatin1(from, "contents");
+    from.chmod(0555);
+    from.setLastModifiedTime(1000000);
+    FileSystemUtils.writeContentAsLatin1(to, "previous contents");
+
+    NativePosixFiles.copyFile(from.getPathString(), to.getPathString());
+
+    assertThat(FileSystemUtils.readContent(to, ISO_8859_1)).isEqualTo("contents");
+    assertThat(to.isExecutable()).isTrue();
+    assertThat(to.isWritable()).isFalse();
+    assertThat(to.getLastModifiedTime()).isEqualTo(1000000);
+    assertThrows(
+        FileNotFoundException.class,
+        () ->
+            NativePosixFiles.copyFile(
+                workingDir.getRelative("missing").getPathString(), to.getPathString()));
+  }
+
+  @Test
+  public void testCopyFiles() throws Exception {
+    Path from = workingDir.getRelative("from");
+    FileSystemUtils.writeContentAsLatin1(from, "contents");
+    String[] targets = {
+      workingDir.getRelative("a").getPathString(), workingDir.getRelative("b").getPathString()
+    };
+    int[] errnos = new int[2];
+
+    NativePosixFiles.copyFiles(
+        new String[] {from.getPathString(), workingDir.getRelative("missing").getPathString()},
+        targets,
+        errnos);
+
+    assertThat(errnos[0]).isEqualTo(0);
+    assertThat(errnos[1]).isNotEqualTo(0);
+    assertThat(FileSystemUtils.readContent(workingDir.getRelative("a"), ISO_8859_1))
+        .isEqualTo("contents");
+    assertThat(workingDir.getRelative("b").exists()).isFalse();
+  }
 }
@@ -0,0 +1,108 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.unix;
+
+import static com.google.common.truth.Truth.assertThat;
+import static com.google.devtools.build.lib.testutil.MoreAsserts.assertThrows;
+import static java.nio.charset.StandardCharsets.UTF_8;
+import static org.junit.Assume.assumeTrue;
+
+import com.google.common.collect.ImmutableMap;
+import com.google.common.io.ByteStreams;
+import com.google.devtools.build.lib.shell.Subprocess;
+import com.google.devtools.build.lib.shell.SubprocessBuilder;
+import com.google.devtools.build.lib.testutil.TestUtils;
+import java.io.File;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.file.Files;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Tests for {@link UnixSubprocessFactory}. */
+@RunWith(JUnit4.class)
+public class UnixSubprocessFactoryTest {
+
+  @Before
+  public final void checkSpawn() {
+    assumeTrue(ProcessUtils.canSpawn());
+  }
+
+  private static Subprocess start(SubprocessBuilder builder) throws IOException {
+    return UnixSubprocessFactory.INSTANCE.create(builder);
+  }
+
+  @Test
+  public void testStreams() throws Exception {
+    File dir = new File(TestUtils.tmpDir()).getCanonicalFile();
+    Subprocess process =
+        start(
+            new SubprocessBuilder()
+                .setArgv("/bin/sh", "-c", "pwd; echo $FOO; cat; echo err >&2; exit 3")
+                .setEnv(ImmutableMap.of("FOO", "bar"))
+                .setWorkingDirectory(dir));
+    try (OutputStream stdin = process.getOutputStream()) {
+      stdin.write("input\n".getBytes(UTF_8));
+    }
+    String out = new String(ByteStreams.toByteArray(process.getInputStream()), UTF_8);
+    String err = new String(ByteStreams.toByteArray(process.getErrorStream()), UTF_8);
+    process.waitFor();
+    process.close();
+
+    assertThat(out).isEqualTo(dir.getPath() + "\nbar\ninput\n");
+    assertThat(err).isEqualTo("err\n");
+    assertThat(process.finished()).isTrue();
+    assertThat(process.exitValue()).isEqualTo(3);
+  }
+
+  @Test
+  public void testRedirectsAndPathLookup() throws Exception {
+    File stdout = new File(TestUtils.tmpDir(), "stdout");
+    Files.write(stdout.toPath(), "stale".getBytes(UTF_8));
+    Subprocess process =
+        start(
+            new SubprocessBuilder()
+                .setArgv("sh", "-c", "echo out; echo err >&2")
+                .setStdout(stdout)
+                .redirectErrorStream(true));
+    process.getOutputStream().close();
+    process.waitFor();
+    process.close();
+
+    assertThat(process.exitValue()).isEqualTo(0);
+    assertThat(new String(Files.readAllBytes(stdout.toPath()), UTF_8)).isEqualTo("out\nerr\n");
+  }
+
+  @Test
+  public void testTimeoutKillsProcess() throws Exception {
+    Subprocess process =
+        start(new SubprocessBuilder().setArgv("/bin/sleep", "60").setTimeoutMillis(100));
+    process.waitFor();
+    process.close();
+
+    assertThat(process.timedout()).isTrue();
+    assertThat(process.exitValue()).isEqualTo(128 + 15);
+  }
+
+  @Test
+  public void testMissingProgram() throws Exception {
+    IOException e =
+        assertThrows(
+            IOException.class,
+            () -> start(new SubprocessBuilder().setArgv("/nonexistent/program")));
+    assertThat(e).hasMessageThat().contains("Cannot run program \"/nonexistent/program\"");
+  }
+}
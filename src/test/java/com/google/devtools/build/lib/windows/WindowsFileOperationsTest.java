@@ -253,4 +253,69 @@ public class WindowsFileOperationsTest {
       assertThat(e.getMessage()).contains("GetLongPathName");
     }
   }
+
+  @Test
+  public void testReadDirectory() throws Exception {
+    String root = testUtil.scratchDir("dir").getParent().toAbsolutePath().toString();
+    testUtil.scratchFile("dir/file.txt", "hello");
+    testUtil.scratchDir("dir/sub");
+    testUtil.createJunctions(ImmutableMap.of("dir/junc", "dir/sub"));
+
+    Map<String, WindowsFileOperations.FileAttributes> entries = new HashMap<>();
+    for (WindowsFileOperations.FileAttributes e :
+        WindowsFileOperations.readDirectory(root + "\\dir")) {
+      entries.put(e.getName(), e);
+    }
+    assertThat(entries.keySet()).containsExactly("file.txt", "sub", "junc");
+    assertThat(entries.get("file.txt").isDirectory()).isFalse();
+    assertThat(entries.get("file.txt").getSize()).isEqualTo(5);
+    assertThat(entries.get("sub").isDirectory()).isTrue();
+    assertThat(entries.get("sub").isJunction()).isFalse();
+    assertThat(entries.get("junc").isJunction()).isTrue();
+
+    try {
+      WindowsFileOperations.readDirectory(root + "\\nonexistent");
+      fail("expected to throw");
+    } catch (IOException e) {
+      // Expected.
+    }
+  }
+
+  @Test
+  public void testGetAttributes() throws Exception {
+    String root = testUtil.scratchDir("dir").getParent().toAbsolutePath().toString();
+    testUtil.scratchFile("file.txt", "hello");
+    testUtil.createJunctions(ImmutableMap.of("junc", "dir"));
+
+    WindowsFileOperations.FileAttributes[] attrs =
+        WindowsFileOperations.getAttributes(
+            root + "\\file.txt", root + "\\dir", root + "\\junc", root + "\\nonexistent");
+    assertThat(attrs).hasLength(4);
+    assertThat(attrs[0].isDirectory()).isFalse();
+    assertThat(attrs[0].getSize()).isEqualTo(5);
+    assertThat(attrs[1].isDirectory()).isTrue();
+    assertThat(attrs[2].isJunction()).isTrue();
+    assertThat(attrs[3]).isNull();
+  }
+
+  @Test
+  public void testDeleteTreesBelow() throws Exception {
+    String root = testUtil.scratchDir("dir").getParent().toAbsolutePath().toString();
+    testUtil.scratchFile("dir/a/file.txt", "hello");
+    testUtil.scratchFile("dir/a/b/c/file.txt", "hello");
+    testUtil.scratchFile("dir/readonly.txt", "hello").toFile().setReadOnly();
+    testUtil.scratchFile("target/keep.txt", "hello");
+    testUtil.createJunctions(ImmutableMap.of("dir/junc", "target"));
+
+    WindowsFileOperations.deleteTreesBelow(root + "\\dir", /*parallel=*/ true);
+    assertThat(new File(root + "\\dir").list()).isEmpty();
+    // The junction was deleted, not followed.
+    assertThat(new File(root + "\\target\\keep.txt").exists()).isTrue();
+
+    // Neither a missing path nor a junction is an error, and nothing is deleted through the latter.
+    testUtil.createJunctions(ImmutableMap.of("junc2", "target"));
+    WindowsFileOperations.deleteTreesBelow(root + "\\nonexistent", /*parallel=*/ false);
+    WindowsFileOperations.deleteTreesBelow(root + "\\junc2", /*parallel=*/ false);
+    assertThat(new File(root + "\\target\\keep.txt").exists()).isTrue();
+  }
 }
@@ -23,6 +23,7 @@ import com.google.common.collect.ImmutableMap;
 import com.google.common.collect.Iterables;
 import com.google.devtools.build.lib.testutil.TestSpec;
 import com.google.devtools.build.lib.util.OS;
+import com.google.devtools.build.lib.vfs.Dirent;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.Symlinks;
@@ -32,6 +33,7 @@ import java.io.File;
 import java.io.IOException;
 import java.nio.file.Files;
 import java.util.Arrays;
+import java.util.Collection;
 import java.util.HashMap;
 import java.util.Map;
 import org.junit.After;
@@ -105,6 +107,33 @@ public class WindowsFileSystemTest {
     assertThat(juncBadPath.exists(Symlinks.NOFOLLOW)).isFalse();
   }
 
+  /** Lists directories both with the listing of {@link WindowsFileSystem} and with stat(). */
+  private static final class StatListingFileSystem extends WindowsFileSystem {
+    Collection<Dirent> readdirWithStat(Path path, boolean followSymlinks) throws IOException {
+      return super.readdir(path, followSymlinks);
+    }
+  }
+
+  @Test
+  public void testReaddirTypesMatchStat() throws Exception {
+    testUtil.scratchFile("root\\file.txt", "hello");
+    testUtil.scratchDir("root\\dir");
+    testUtil.scratchDir("target");
+    testUtil.scratchDir("gone");
+    testUtil.createJunctions(
+        ImmutableMap.of("root\\junc", "target", "root\\junc_bad", "gone"));
+    Files.delete(new File(scratchRoot, "gone").toPath());
+
+    StatListingFileSystem statFs = new StatListingFileSystem();
+    Path root = testUtil.createVfsPath(statFs, "root");
+    for (boolean followSymlinks : new boolean[] {false, true}) {
+      assertThat(statFs.readdir(root, followSymlinks))
+          .containsExactlyElementsIn(statFs.readdirWithStat(root, followSymlinks));
+    }
+    assertThat(statFs.readdir(root, /* followSymlinks= */ false))
+        .contains(new Dirent("junc", Dirent.Type.UNKNOWN));
+  }
+
   @Test
   public void testMockJunctionCreation() throws Exception {
     String root = testUtil.scratchDir("dir").getParent().toString();
@@ -0,0 +1,292 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <windows.h>
+
+#include <algorithm>  // replace
+#include <fstream>
+#include <memory>  // unique_ptr
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/main/cpp/util/strings.h"
+#include "src/main/native/windows/file.h"
+#include "src/test/cpp/util/windows_test_util.h"
+#include "tools/cpp/runfiles/runfiles.h"
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#error("This test should only be run on Windows")
+#endif  // !defined(_WIN32) && !defined(__CYGWIN__)
+
+namespace bazel {
+namespace windows {
+
+using bazel::tools::cpp::runfiles::Runfiles;
+using std::string;
+using std::unique_ptr;
+using std::wstring;
+
+// Tests src/main/tools/build-runfiles-windows.cc, like
+// src/test/shell/integration/build_runfiles_test.sh does for the POSIX one.
+class BuildRunfilesTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    wstring tmpdir = blaze_util::GetTestTmpDirW();
+    ASSERT_TRUE(blaze_util::DeleteAllUnder(tmpdir));
+    tmpdir_ = Narrow(tmpdir);
+    std::replace(tmpdir_.begin(), tmpdir_.end(), '\\', '/');
+    targets_ = tmpdir_ + "/targets";
+    out_ = tmpdir_ + "/out";
+    ASSERT_TRUE(CreateDirectoryW(Wide(targets_).c_str(), nullptr));
+    for (int i = 1; i <= 3; ++i) {
+      WriteFile(targets_ + "/t" + std::to_string(i),
+                "target " + std::to_string(i));
+    }
+    ASSERT_TRUE(CreateDirectoryW(Wide(targets_ + "/dir").c_str(), nullptr));
+    WriteFile(targets_ + "/dir/f", "in dir");
+
+    string error;
+    unique_ptr<Runfiles> runfiles(Runfiles::Create("", &error));
+    ASSERT_NE(nullptr, runfiles.get()) << error;
+    string path =
+        runfiles->Rlocation("io_bazel/src/main/tools/build-runfiles.exe");
+    ASSERT_FALSE(path.empty());
+    build_runfiles_ = Wide(path);
+    std::replace(build_runfiles_.begin(), build_runfiles_.end(), L'/', L'\\');
+  }
+
+  // Runs build-runfiles with `args`, and returns its exit code.
+  DWORD RunBuildRunfiles(const std::vector<string>& args) {
+    wstring cmdline = L"\"" + build_runfiles_ + L"\"";
+    for (const string& arg : args) {
+      cmdline += L" \"" + Wide(arg) + L"\"";
+    }
+    std::vector<wchar_t> mutable_cmdline(cmdline.begin(), cmdline.end());
+    mutable_cmdline.push_back(L'\0');
+    STARTUPINFOW startup_info = {0};
+    startup_info.cb = sizeof(startup_info);
+    PROCESS_INFORMATION process_info = {0};
+    if (!CreateProcessW(NULL, mutable_cmdline.data(), NULL, NULL, FALSE, 0,
+                        NULL, NULL, &startup_info, &process_info)) {
+      ADD_FAILURE() << "CreateProcessW failed: " << GetLastError();
+      return MAXDWORD;
+    }
+    CloseHandle(process_info.hThread);
+    WaitForSingleObject(process_info.hProcess, INFINITE);
+    DWORD exit_code = MAXDWORD;
+    EXPECT_TRUE(GetExitCodeProcess(process_info.hProcess, &exit_code));
+    CloseHandle(process_info.hProcess);
+    return exit_code;
+  }
+
+  // Writes a manifest with a few subtrees, a directory target and an empty
+  // file, whose entries depend on `version` so that two versions differ.
+  string WriteManifest(int version) {
+    string v = std::to_string(version);
+    string path = tmpdir_ + "/m" + v;
+    WriteFile(path,
+              "other_repo/f " + targets_ + "/t1\n"
+              "ws/a/f1 " + targets_ + "/t1\n"
+              "ws/a/f2 " + targets_ + "/t" + v + "\n"
+              "ws/b/empty \n"
+              "ws/dir " + targets_ + "/dir\n"
+              "ws/only_v" + v + "/f " + targets_ + "/t3\n");
+    return path;
+  }
+
+  // Returns every entry below `dir` with its kind, and the contents of the
+  // files and the entries of the junctions, so that two trees can be
+  // compared.
+  static string DescribeTree(const string& dir) {
+    std::vector<string> lines;
+    DescribeEntries(dir, "", &lines);
+    std::sort(lines.begin(), lines.end());
+    string result;
+    for (const string& line : lines) {
+      result += line + "\n";
+    }
+    return result;
+  }
+
+  static void DescribeEntries(const string& dir, const string& prefix,
+                              std::vector<string>* lines) {
+    WIN32_FIND_DATAW data;
+    HANDLE handle = FindFirstFileW(Wide(dir + "/*").c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    do {
+      string name = Narrow(data.cFileName);
+      if (name == "." || name == "..") {
+        continue;
+      }
+      string path = dir + "/" + name;
+      string rel = prefix + name;
+      if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        bool junction = data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT;
+        lines->push_back((junction ? "junction " : "dir ") + rel);
+        DescribeEntries(path, rel + "/", lines);
+      } else {
+        // Symlinks and copies read the same.
+        lines->push_back("file " + rel + ": " + ReadFile(path));
+      }
+    } while (FindNextFileW(handle, &data));
+    FindClose(handle);
+  }
+
+  static wstring Wide(const string& s) {
+    return blaze_util::CstringToWstring(s.c_str()).get();
+  }
+
+  static string Narrow(const wstring& s) {
+    return blaze_util::WstringToCstring(s.c_str()).get();
+  }
+
+  static void WriteFile(const string& path, const string& contents) {
+    std::ofstream file(Wide(path).c_str(), std::ios::binary);
+    file << contents;
+  }
+
+  static string ReadFile(const string& path) {
+    std::ifstream file(Wide(path).c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  static bool Exists(const string& path) {
+    return GetFileAttributesW(Wide(path).c_str()) != INVALID_FILE_ATTRIBUTES;
+  }
+
+  string tmpdir_;
+  string targets_;
+  string out_;
+  wstring build_runfiles_;
+};
+
+TEST_F(BuildRunfilesTest, CreatesTreeFromManifest) {
+  string manifest = WriteManifest(1);
+  ASSERT_EQ(0, RunBuildRunfiles({manifest, out_}));
+  EXPECT_EQ(
+      "dir other_repo\n"
+      "dir ws\n"
+      "dir ws/a\n"
+      "dir ws/b\n"
+      "dir ws/only_v1\n"
+      "file MANIFEST: " + ReadFile(manifest) + "\n"
+      "file other_repo/f: target 1\n"
+      "file ws/a/f1: target 1\n"
+      "file ws/a/f2: target 1\n"
+      "file ws/b/empty: \n"
+      "file ws/dir/f: in dir\n"
+      "file ws/only_v1/f: target 3\n"
+      "junction ws/dir\n",
+      DescribeTree(out_));
+}
+
+// A file target is linked to if symlinks are available, else copied; either
+// way the entry has its contents, and a link resolves to the target.
+TEST_F(BuildRunfilesTest, LinksOrCopiesFiles) {
+  ASSERT_EQ(0, RunBuildRunfiles({WriteManifest(1), out_}));
+  DWORD attrs = GetFileAttributesW(Wide(out_ + "/ws/a/f1").c_str());
+  ASSERT_NE(INVALID_FILE_ATTRIBUTES, attrs);
+  if (attrs & FILE_ATTRIBUTE_REPARSE_POINT) {
+    // A symlink: replacing the target shows through it.
+    WriteFile(targets_ + "/t1", "new target 1");
+    EXPECT_EQ("new target 1", ReadFile(out_ + "/ws/a/f1"));
+  } else {
+    // A copy: replacing the target does not.
+    WriteFile(targets_ + "/t1", "new target 1");
+    EXPECT_EQ("target 1", ReadFile(out_ + "/ws/a/f1"));
+  }
+}
+
+TEST_F(BuildRunfilesTest, RemovesStaleEntries) {
+  ASSERT_EQ(0, RunBuildRunfiles({WriteManifest(1), out_}));
+  // Something to delete, next to what is created, including a junction whose
+  // target must survive.
+  ASSERT_TRUE(CreateDirectoryW(Wide(out_ + "/stale").c_str(), nullptr));
+  WriteFile(out_ + "/stale/file", "stale");
+  WriteFile(out_ + "/ws/stale", "stale");
+  wstring junction = Wide(out_ + "/ws/stale_junction");
+  wstring junction_target = Wide(targets_ + "/dir");
+  std::replace(junction.begin(), junction.end(), L'/', L'\\');
+  std::replace(junction_target.begin(), junction_target.end(), L'/', L'\\');
+  ASSERT_EQ(L"", CreateJunction(junction, junction_target));
+
+  ASSERT_EQ(0, RunBuildRunfiles({WriteManifest(2), out_}));
+  EXPECT_FALSE(Exists(out_ + "/stale"));
+  EXPECT_FALSE(Exists(out_ + "/ws/stale"));
+  EXPECT_FALSE(Exists(out_ + "/ws/stale_junction"));
+  EXPECT_FALSE(Exists(out_ + "/ws/only_v1"));
+  EXPECT_EQ("target 3", ReadFile(out_ + "/ws/only_v2/f"));
+  EXPECT_EQ("target 2", ReadFile(out_ + "/ws/a/f2"));
+  // Deleting ws/dir and the stale junction did not follow them.
+  EXPECT_EQ("in dir", ReadFile(targets_ + "/dir/f"));
+}
+
+TEST_F(BuildRunfilesTest, JobsMatchSequentialRun) {
+  string m1 = WriteManifest(1);
+  string m2 = WriteManifest(2);
+  for (const char* jobs : {"1", "8"}) {
+    string out = out_ + jobs;
+    ASSERT_EQ(0, RunBuildRunfiles({string("--jobs=") + jobs, m1, out}));
+    ASSERT_EQ(0, RunBuildRunfiles({string("--jobs=") + jobs, m2, out}));
+  }
+  EXPECT_EQ(DescribeTree(out_ + "1"), DescribeTree(out_ + "8"));
+}
+
+TEST_F(BuildRunfilesTest, LaterLineReplacesEarlierOne) {
+  string manifest = tmpdir_ + "/m";
+  WriteFile(manifest, "ws/f " + targets_ + "/t1\r\n"
+                      "ws/f " + targets_ + "/t2\r\n");
+  ASSERT_EQ(0, RunBuildRunfiles({manifest, out_}));
+  EXPECT_EQ("target 2", ReadFile(out_ + "/ws/f"));
+}
+
+TEST_F(BuildRunfilesTest, SkipsMetadataLines) {
+  string manifest = tmpdir_ + "/m";
+  WriteFile(manifest, "ws/f " + targets_ + "/t1\n"
+                      "metadata that is not a manifest line\n");
+  ASSERT_EQ(0, RunBuildRunfiles({"--use_metadata", manifest, out_}));
+  EXPECT_EQ("target 1", ReadFile(out_ + "/ws/f"));
+}
+
+TEST_F(BuildRunfilesTest, AllowsRelativeTargets) {
+  string manifest = tmpdir_ + "/m";
+  // Relative to the directory of the link, ws\sub.
+  WriteFile(manifest, "ws/sub/f ../../../targets/t1\n");
+  EXPECT_EQ(1, RunBuildRunfiles({manifest, out_}));
+  ASSERT_EQ(0, RunBuildRunfiles({"--allow_relative", manifest, out_}));
+  EXPECT_EQ("target 1", ReadFile(out_ + "/ws/sub/f"));
+}
+
+TEST_F(BuildRunfilesTest, RejectsMalformedManifests) {
+  string manifest = tmpdir_ + "/m";
+  for (const string& contents :
+       {string("no_delimiter\n"), "ws/f " + targets_ + "/t1 extra\n",
+        "C:/absolute/link " + targets_ + "/t1\n",
+        "/absolute/link " + targets_ + "/t1\n",
+        "ws/f " + targets_ + "/t1"}) {
+    WriteFile(manifest, contents);
+    EXPECT_EQ(1, RunBuildRunfiles({manifest, out_})) << contents;
+    EXPECT_FALSE(Exists(out_ + "/MANIFEST")) << contents;
+  }
+  EXPECT_EQ(1, RunBuildRunfiles({"--jobs=0", manifest, out_}));
+  EXPECT_EQ(1, RunBuildRunfiles({manifest}));
+}
+
+}  // namespace windows
+}  // namespace bazel
@@ -0,0 +1,212 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <windows.h>
+
+#include <algorithm>  // replace
+#include <fstream>
+#include <memory>  // unique_ptr
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/main/cpp/util/strings.h"
+#include "src/test/cpp/util/windows_test_util.h"
+#include "tools/cpp/runfiles/runfiles.h"
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#error("This test should only be run on Windows")
+#endif  // !defined(_WIN32) && !defined(__CYGWIN__)
+
+namespace bazel {
+namespace windows {
+
+using bazel::tools::cpp::runfiles::Runfiles;
+using std::string;
+using std::unique_ptr;
+using std::wstring;
+
+// The exit code of process-wrapper on a timeout.
+static const DWORD kTimeoutExitCode = 142;
+
+class ProcessWrapperTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    tmpdir_ = blaze_util::GetTestTmpDirW();
+    ASSERT_TRUE(blaze_util::DeleteAllUnder(tmpdir_));
+
+    // "bazel test" exports the runfiles variables that Create() looks at.
+    string error;
+    unique_ptr<Runfiles> runfiles(Runfiles::Create("", &error));
+    ASSERT_NE(nullptr, runfiles.get()) << error;
+    string path =
+        runfiles->Rlocation("io_bazel/src/main/tools/process-wrapper.exe");
+    ASSERT_FALSE(path.empty());
+    wrapper_ = blaze_util::CstringToWstring(path.c_str()).get();
+    std::replace(wrapper_.begin(), wrapper_.end(), L'/', L'\\');
+  }
+
+  // Runs process-wrapper with `args`, and returns its exit code. Sets
+  // `*seconds` to how long it ran, if not null.
+  DWORD RunProcessWrapper(const std::vector<wstring>& args,
+                          double* seconds = nullptr) {
+    wstring cmdline = L"\"" + wrapper_ + L"\"";
+    for (const wstring& arg : args) {
+      cmdline += L" \"" + arg + L"\"";
+    }
+    std::vector<wchar_t> mutable_cmdline(cmdline.begin(), cmdline.end());
+    mutable_cmdline.push_back(L'\0');
+    STARTUPINFOW startup_info = {0};
+    startup_info.cb = sizeof(startup_info);
+    PROCESS_INFORMATION process_info = {0};
+    ULONGLONG start = GetTickCount64();
+    if (!CreateProcessW(NULL, mutable_cmdline.data(), NULL, NULL, FALSE, 0,
+                        NULL, NULL, &startup_info, &process_info)) {
+      ADD_FAILURE() << "CreateProcessW failed: " << GetLastError();
+      return MAXDWORD;
+    }
+    CloseHandle(process_info.hThread);
+    WaitForSingleObject(process_info.hProcess, INFINITE);
+    if (seconds != nullptr) {
+      *seconds = (GetTickCount64() - start) / 1000.0;
+    }
+    DWORD exit_code = MAXDWORD;
+    EXPECT_TRUE(GetExitCodeProcess(process_info.hProcess, &exit_code));
+    CloseHandle(process_info.hProcess);
+    return exit_code;
+  }
+
+  // Writes a batch file with the given lines to the temporary directory, and
+  // returns its path.
+  wstring WriteBatchFile(const wstring& name,
+                         const std::vector<string>& lines) {
+    wstring path = tmpdir_ + L"\\" + name;
+    std::ofstream file(path.c_str());
+    for (const string& line : lines) {
+      file << line << "\n";
+    }
+    return path;
+  }
+
+  // Returns a batch file that starts a detached process, which creates
+  // `marker` in about three seconds, and then runs `then`.
+  wstring WriteOrphanMaker(const wstring& name, const wstring& marker,
+                           const string& then) {
+    return WriteBatchFile(
+        name, {"@start \"\" /B cmd.exe /C \"ping -n 4 127.0.0.1 >nul & "
+               "echo late> " + Narrow(marker) + "\"",
+               "@" + then});
+  }
+
+  static string Narrow(const wstring& s) {
+    return blaze_util::WstringToCstring(s.c_str()).get();
+  }
+
+  static string ReadFile(const wstring& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  static bool Exists(const wstring& path) {
+    return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+  }
+
+  wstring tmpdir_;
+  wstring wrapper_;
+};
+
+TEST_F(ProcessWrapperTest, PropagatesExitCode) {
+  EXPECT_EQ(0, RunProcessWrapper({L"cmd.exe", L"/C", L"exit", L"0"}));
+  EXPECT_EQ(42, RunProcessWrapper({L"--", L"cmd.exe", L"/C", L"exit", L"42"}));
+}
+
+TEST_F(ProcessWrapperTest, RedirectsOutput) {
+  wstring bat = WriteBatchFile(L"output.bat", {"@echo out", "@1>&2 echo err"});
+  wstring out = tmpdir_ + L"\\out";
+  wstring err = tmpdir_ + L"\\err";
+  ASSERT_EQ(0, RunProcessWrapper({L"--stdout=" + out, L"--stderr", err, L"--",
+                                  L"cmd.exe", L"/C", bat}));
+  EXPECT_EQ("out\r\n", ReadFile(out));
+  EXPECT_EQ("err\r\n", ReadFile(err));
+}
+
+TEST_F(ProcessWrapperTest, TimesOut) {
+  wstring out = tmpdir_ + L"\\out";
+  for (const wchar_t* kill_delay : {L"0", L"1"}) {
+    // ping waits a second between its requests.
+    double seconds;
+    EXPECT_EQ(kTimeoutExitCode,
+              RunProcessWrapper({L"--timeout=1", L"--kill_delay", kill_delay,
+                                 L"--stdout=" + out, L"--", L"ping.exe", L"-n",
+                                 L"60", L"127.0.0.1"},
+                                &seconds));
+    EXPECT_LT(seconds, 30);
+  }
+}
+
+// A detached descendant outlives the command without process-wrapper, which
+// the tests below rely on to see that process-wrapper kills it.
+TEST_F(ProcessWrapperTest, OrphansSurviveWithoutProcessWrapper) {
+  wstring marker = tmpdir_ + L"\\marker";
+  wstring bat = WriteOrphanMaker(L"orphan.bat", marker, "exit /B 0");
+  wstring cmdline = L"cmd.exe /C \"" + bat + L"\"";
+  std::vector<wchar_t> mutable_cmdline(cmdline.begin(), cmdline.end());
+  mutable_cmdline.push_back(L'\0');
+  STARTUPINFOW startup_info = {0};
+  startup_info.cb = sizeof(startup_info);
+  PROCESS_INFORMATION process_info = {0};
+  ASSERT_TRUE(CreateProcessW(NULL, mutable_cmdline.data(), NULL, NULL, FALSE,
+                             0, NULL, NULL, &startup_info, &process_info));
+  CloseHandle(process_info.hThread);
+  WaitForSingleObject(process_info.hProcess, INFINITE);
+  CloseHandle(process_info.hProcess);
+  for (int i = 0; i < 20 && !Exists(marker); ++i) {
+    Sleep(500);
+  }
+  EXPECT_TRUE(Exists(marker));
+}
+
+TEST_F(ProcessWrapperTest, KillsDescendantsWhenCommandExits) {
+  wstring marker = tmpdir_ + L"\\marker";
+  wstring bat = WriteOrphanMaker(L"orphan.bat", marker, "exit /B 3");
+  EXPECT_EQ(3, RunProcessWrapper({L"--", L"cmd.exe", L"/C", bat}));
+  Sleep(6000);
+  EXPECT_FALSE(Exists(marker));
+}
+
+TEST_F(ProcessWrapperTest, KillsDescendantsOnTimeout) {
+  wstring marker = tmpdir_ + L"\\marker";
+  wstring bat = WriteOrphanMaker(L"orphan.bat", marker,
+                                 "ping -n 60 127.0.0.1 >nul");
+  double seconds;
+  EXPECT_EQ(kTimeoutExitCode,
+            RunProcessWrapper({L"--timeout=1", L"--", L"cmd.exe", L"/C", bat},
+                              &seconds));
+  EXPECT_LT(seconds, 30);
+  Sleep(6000);
+  EXPECT_FALSE(Exists(marker));
+}
+
+TEST_F(ProcessWrapperTest, WritesStats) {
+  wstring stats = tmpdir_ + L"\\stats";
+  ASSERT_EQ(0, RunProcessWrapper(
+                   {L"--stats=" + stats, L"--", L"cmd.exe", L"/C", L"exit"}));
+  // The timestamps alone make it non-empty.
+  EXPECT_FALSE(ReadFile(stats).empty());
+}
+
+}  // namespace windows
+}  // namespace bazel
@@ -337,5 +337,27 @@ TEST(WindowsUtilTest, TestAsExecutablePathForCreateProcessConversions) {
   DeleteDirsUnder(tmpdir, short_root);
 }
 
+TEST(WindowsUtilTest, TestPathConversionCacheEvictsLeastRecentlyUsed) {
+  PathConversionCache cache(2);
+  wstring result;
+  ASSERT_FALSE(cache.Get(L"a", &result));
+  cache.Put(L"a", L"A");
+  cache.Put(L"b", L"B");
+  ASSERT_TRUE(cache.Get(L"a", &result));
+  ASSERT_EQ(result, L"A");
+  // "b" is the least recently used now.
+  cache.Put(L"c", L"C");
+  ASSERT_FALSE(cache.Get(L"b", &result));
+  ASSERT_TRUE(cache.Get(L"a", &result));
+  ASSERT_TRUE(cache.Get(L"c", &result));
+  ASSERT_EQ(result, L"C");
+  cache.Put(L"c", L"D");
+  ASSERT_TRUE(cache.Get(L"c", &result));
+  ASSERT_EQ(result, L"D");
+  cache.Clear();
+  ASSERT_FALSE(cache.Get(L"a", &result));
+  ASSERT_FALSE(cache.Get(L"c", &result));
+}
+
 }  // namespace windows
 }  // namespace bazel
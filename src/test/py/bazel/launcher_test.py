@@ -540,6 +540,47 @@ class LauncherTest(test_base.TestBase):
     classpath = stdout[stdout.index('-classpath') + 1]
     self.assertRegexpMatches(classpath, r'foo-[A-Za-z0-9]+-classpath.jar$')
 
+    # The classpath jar is kept and reused by the next run.
+    self.assertTrue(os.path.exists(classpath))
+    exit_code, stdout, stderr = self.RunProgram(
+        [binary, '--classpath_limit=0', print_cmd])
+    self.AssertExitCode(exit_code, 0, stderr)
+    self.assertEqual(stdout[stdout.index('-classpath') + 1], classpath)
+
+  def testWindowsExeLauncherWritesStats(self):
+    # Skip this test on non-Windows platforms
+    if not self.IsWindows():
+      return
+    self.ScratchFile('WORKSPACE')
+    self.ScratchFile('foo/BUILD', [
+        'sh_binary(',
+        '  name = "bin",',
+        '  srcs = ["bin.sh"],',
+        ')',
+    ])
+    foo_sh = self.ScratchFile('foo/bin.sh', [
+        '#!/bin/bash',
+        'echo stats_file=${LAUNCHER_STATS_FILE:-}',
+    ])
+    os.chmod(foo_sh, stat.S_IRUSR | stat.S_IWUSR | stat.S_IXUSR)
+
+    exit_code, stdout, stderr = self.RunBazel(['info', 'bazel-bin'])
+    self.AssertExitCode(exit_code, 0, stderr)
+    bazel_bin = stdout[0]
+    exit_code, _, stderr = self.RunBazel(
+        ['build', '--windows_exe_launcher=1', '//foo:bin'])
+    self.AssertExitCode(exit_code, 0, stderr)
+
+    stats_file = os.path.join(self.ScratchDir('stats'), 'bin.stats')
+    exit_code, stdout, stderr = self.RunProgram(
+        [os.path.join(bazel_bin, 'foo', 'bin.exe')],
+        env_add={'LAUNCHER_STATS_FILE': stats_file})
+    self.AssertExitCode(exit_code, 0, stderr)
+    # The launcher writes the statistics of the whole process tree itself.
+    self.assertEqual(stdout, ['stats_file='])
+    self.assertTrue(os.path.exists(stats_file))
+    self.assertGreater(os.path.getsize(stats_file), 0)
+
   def AssertRunfilesManifestContains(self, manifest, entry):
     with open(manifest, 'r') as f:
       for l in f:
@@ -0,0 +1,206 @@
+#!/bin/bash
+#
+# Copyright 2018 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Tests src/main/tools/build-runfiles: that the trees it creates in parallel
+# and incrementally are the same as those of a sequential full scan.
+
+set -euo pipefail
+
+# Load the test setup defined in the parent directory
+CURRENT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${CURRENT_DIR}/../integration_test_setup.sh" \
+  || { echo "integration_test_setup.sh not found!" >&2; exit 1; }
+
+readonly BUILD_RUNFILES="${BAZEL_RUNFILES}/src/main/tools/build-runfiles"
+readonly TARGETS="${TEST_TMPDIR}/targets"
+readonly OUT_DIR="${TEST_TMPDIR}/out"
+
+function set_up() {
+  rm -rf "$TARGETS" "$OUT_DIR"
+  mkdir -p "$TARGETS" "$OUT_DIR"
+  for i in 1 2 3 4 5 6; do
+    echo "target $i" > "$TARGETS/t$i"
+  done
+}
+
+# Writes a manifest with a few top-level subtrees, nested directories and
+# empty files, whose entries depend on "$1" so that two versions differ.
+function write_manifest() {
+  local version="$1"
+  local manifest="$2"
+  {
+    for d in a b c d e; do
+      echo "ws/$d/x/f1 $TARGETS/t1"
+      echo "ws/$d/x/f2 $TARGETS/t$version"
+      echo "ws/$d/y/empty "
+    done
+    echo "ws/only_v$version/f $TARGETS/t3"
+    if [[ "$version" == 1 ]]; then
+      echo "ws/kind/becomes_dir $TARGETS/t4"
+      echo "ws/kind/becomes_file/f $TARGETS/t4"
+    else
+      echo "ws/kind/becomes_dir/f $TARGETS/t4"
+      echo "ws/kind/becomes_file $TARGETS/t4"
+    fi
+    echo "other_repo/f $TARGETS/t5"
+    echo "top_level_file $TARGETS/t6"
+  } | LC_ALL=C sort > "$manifest"
+}
+
+# Prints every entry of the tree "$1" with its type and its link target or
+# contents, so that two trees can be compared. Leaves out MANIFEST.index,
+# which records the mtime of the MANIFEST.
+function describe_tree() {
+  (
+    cd "$1"
+    find . ! -name MANIFEST.index | LC_ALL=C sort | while read -r path; do
+      if [[ -L "$path" ]]; then
+        echo "link $path -> $(readlink "$path")"
+      elif [[ -d "$path" ]]; then
+        echo "dir $path"
+      else
+        echo "file $path: $(cat "$path")"
+      fi
+    done
+  )
+}
+
+function assert_same_tree() {
+  describe_tree "$1" > "$TEST_TMPDIR/tree1"
+  describe_tree "$2" > "$TEST_TMPDIR/tree2"
+  diff "$TEST_TMPDIR/tree1" "$TEST_TMPDIR/tree2" >&$TEST_log \
+      || fail "trees '$1' and '$2' differ"
+}
+
+# Returns the value of statistic "$1" in stats file "$2".
+function get_stat() {
+  awk -v name="$1" '$1 == name { print $2 }' "$2"
+}
+
+function test_jobs_match_sequential_run() {
+  write_manifest 1 "$TEST_TMPDIR/m1"
+  write_manifest 2 "$TEST_TMPDIR/m2"
+  for jobs in 1 8; do
+    "$BUILD_RUNFILES" --jobs=$jobs "$TEST_TMPDIR/m1" "$OUT_DIR/jobs$jobs" \
+        >&$TEST_log 2>&1 || fail "build-runfiles --jobs=$jobs failed"
+    # Something to prune, next to what is created.
+    mkdir -p "$OUT_DIR/jobs$jobs/stale/dir"
+    touch "$OUT_DIR/jobs$jobs/stale/dir/file" "$OUT_DIR/jobs$jobs/ws/stale"
+  done
+  assert_same_tree "$OUT_DIR/jobs1" "$OUT_DIR/jobs8"
+
+  for jobs in 1 8; do
+    "$BUILD_RUNFILES" --jobs=$jobs "$TEST_TMPDIR/m2" "$OUT_DIR/jobs$jobs" \
+        >&$TEST_log 2>&1 || fail "build-runfiles --jobs=$jobs failed"
+  done
+  assert_same_tree "$OUT_DIR/jobs1" "$OUT_DIR/jobs8"
+  [[ ! -e "$OUT_DIR/jobs8/stale" ]] || fail "stale subtree was not pruned"
+  [[ ! -e "$OUT_DIR/jobs8/ws/stale" ]] || fail "stale file was not pruned"
+}
+
+function test_incremental_matches_full_run() {
+  write_manifest 1 "$TEST_TMPDIR/m1"
+  write_manifest 2 "$TEST_TMPDIR/m2"
+  for mode in full incremental; do
+    local flags="--jobs=4"
+    [[ "$mode" == incremental ]] && flags="$flags --incremental"
+    "$BUILD_RUNFILES" $flags "$TEST_TMPDIR/m1" "$OUT_DIR/$mode" \
+        >&$TEST_log 2>&1 || fail "build-runfiles ($mode) failed"
+    "$BUILD_RUNFILES" $flags --stats="$TEST_TMPDIR/$mode.stats" \
+        "$TEST_TMPDIR/m2" "$OUT_DIR/$mode" >&$TEST_log 2>&1 \
+        || fail "build-runfiles ($mode) failed"
+  done
+  assert_same_tree "$OUT_DIR/full" "$OUT_DIR/incremental"
+  expect_not_log "scanning the tree"
+  [[ "$(get_stat entries_scanned "$TEST_TMPDIR/incremental.stats")" == 0 ]] \
+      || fail "incremental run scanned the tree"
+  [[ "$(get_stat entries_scanned "$TEST_TMPDIR/full.stats")" -gt 0 ]] \
+      || fail "full run did not scan the tree"
+
+  # Back to the first version, incrementally and with nothing to change.
+  for mode in full incremental; do
+    local flags=""
+    [[ "$mode" == incremental ]] && flags="--incremental"
+    for i in 1 2; do
+      "$BUILD_RUNFILES" $flags "$TEST_TMPDIR/m1" "$OUT_DIR/$mode" \
+          >&$TEST_log 2>&1 || fail "build-runfiles ($mode) failed"
+    done
+  done
+  assert_same_tree "$OUT_DIR/full" "$OUT_DIR/incremental"
+}
+
+function test_incremental_falls_back_to_full_scan() {
+  write_manifest 1 "$TEST_TMPDIR/m1"
+  write_manifest 2 "$TEST_TMPDIR/m2"
+  "$BUILD_RUNFILES" "$TEST_TMPDIR/m2" "$OUT_DIR/full" >&$TEST_log 2>&1 \
+      || fail "build-runfiles failed"
+  "$BUILD_RUNFILES" --incremental "$TEST_TMPDIR/m1" "$OUT_DIR/incremental" \
+      >&$TEST_log 2>&1 || fail "build-runfiles failed"
+
+  # The tree no longer matches its MANIFEST: an entry that the update has to
+  # remove is gone, and there is an entry that no manifest has.
+  rm "$OUT_DIR/incremental/ws/kind/becomes_dir"
+  touch "$OUT_DIR/incremental/ws/a/unknown"
+  "$BUILD_RUNFILES" --incremental --stats="$TEST_TMPDIR/stats" \
+      "$TEST_TMPDIR/m2" "$OUT_DIR/incremental" >&$TEST_log 2>&1 \
+      || fail "build-runfiles failed"
+  expect_log "removing '.*/ws/kind/becomes_dir'.*; scanning the tree"
+  [[ "$(get_stat entries_scanned "$TEST_TMPDIR/stats")" -gt 0 ]] \
+      || fail "the tree was not scanned"
+  assert_same_tree "$OUT_DIR/full" "$OUT_DIR/incremental"
+
+  # A malformed MANIFEST is not trusted either.
+  echo "not a manifest line" > "$OUT_DIR/incremental/MANIFEST"
+  touch "$OUT_DIR/incremental/ws/b/unknown"
+  "$BUILD_RUNFILES" --incremental "$TEST_TMPDIR/m2" "$OUT_DIR/incremental" \
+      >&$TEST_log 2>&1 || fail "build-runfiles failed"
+  expect_log "ignoring malformed"
+  assert_same_tree "$OUT_DIR/full" "$OUT_DIR/incremental"
+}
+
+function test_hardlink_mode_replaces_stale_links() {
+  write_manifest 1 "$TEST_TMPDIR/m1"
+  for mode in full incremental; do
+    local flags="--link_mode=hardlink"
+    [[ "$mode" == incremental ]] && flags="$flags --incremental"
+    "$BUILD_RUNFILES" $flags "$TEST_TMPDIR/m1" "$OUT_DIR/$mode" \
+        >&$TEST_log 2>&1 || fail "build-runfiles ($mode) failed"
+    # -ef follows symlinks, so rule those out first.
+    [[ ! -L "$OUT_DIR/$mode/ws/a/x/f1" &&
+       "$OUT_DIR/$mode/ws/a/x/f1" -ef "$TARGETS/t1" ]] \
+        || fail "ws/a/x/f1 is not a hardlink to its target ($mode)"
+  done
+
+  # Replace a target with a new file: the old hardlinks now have the old
+  # contents, although the manifest did not change.
+  rm "$TARGETS/t1"
+  echo "new target 1" > "$TARGETS/t1"
+  for mode in full incremental; do
+    local flags="--link_mode=hardlink"
+    [[ "$mode" == incremental ]] && flags="$flags --incremental"
+    "$BUILD_RUNFILES" $flags "$TEST_TMPDIR/m1" "$OUT_DIR/$mode" \
+        >&$TEST_log 2>&1 || fail "build-runfiles ($mode) failed"
+    for d in a b c d e; do
+      [[ ! -L "$OUT_DIR/$mode/ws/$d/x/f1" &&
+         "$OUT_DIR/$mode/ws/$d/x/f1" -ef "$TARGETS/t1" ]] \
+          || fail "ws/$d/x/f1 still has the old target ($mode)"
+    done
+    assert_equals "new target 1" "$(cat "$OUT_DIR/$mode/ws/a/x/f1")"
+  done
+  assert_same_tree "$OUT_DIR/full" "$OUT_DIR/incremental"
+}
+
+run_suite "build-runfiles tests"
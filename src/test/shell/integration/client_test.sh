@@ -62,6 +62,32 @@ function test_multiple_requests_same_server() {
   expect_not_log "WARNING: Running B\\(azel\\|laze\\) server needs to be killed"
 }
 
+function test_unix_socket() {
+  if is_windows; then
+    # Unix domain sockets are not supported, the server falls back to TCP.
+    return
+  fi
+  # The path of the socket must fit in sockaddr_un, which the output base under
+  # $TEST_TMPDIR may not.
+  local output_base=$(mktemp -d /tmp/client_test.XXXXXX)
+  local server_pid1=$(bazel --output_base="$output_base" \
+      --experimental_unix_socket info server_pid 2>$TEST_log)
+  local server_pid2=$(bazel --output_base="$output_base" \
+      --experimental_unix_socket info server_pid 2>$TEST_log)
+  assert_equals "$server_pid1" "$server_pid2"
+  expect_not_log "WARNING: Running B\\(azel\\|laze\\) server needs to be killed"
+  assert_equals "unix:$output_base/server/command.sock" \
+      "$(cat "$output_base/server/command_port")"
+
+  # Switching back to TCP restarts the server.
+  local server_pid3=$(bazel --output_base="$output_base" info server_pid \
+      2>$TEST_log)
+  assert_not_equals "$server_pid1" "$server_pid3"
+  expect_log "WARNING: Running B\\(azel\\|laze\\) server needs to be killed"
+  bazel --output_base="$output_base" shutdown
+  rm -rf "$output_base"
+}
+
 function test_shutdown() {
   local server_pid1=$(bazel info server_pid 2>$TEST_log)
   bazel shutdown >& $TEST_log || fail "Expected success"
@@ -91,6 +117,113 @@ function test_output_base() {
   assert_equals $TEST_TMPDIR/output "$out"
 }
 
+function test_info_answered_by_client() {
+  local output_base=$(bazel --client_debug info output_base 2>$TEST_log)
+  assert_equals "$(bazel --batch info output_base 2>/dev/null)" "$output_base"
+  expect_log "Answering 'info output_base' without the server"
+  local workspace=$(bazel --client_debug info workspace 2>$TEST_log)
+  assert_equals "$(pwd -P)" "$workspace"
+  expect_log "Answering 'info workspace' without the server"
+
+  # Keys only the server knows still go to the server.
+  bazel --client_debug info server_pid >&$TEST_log || fail "info failed"
+  expect_not_log "without the server"
+}
+
+function test_shared_install_base_root() {
+  local shared="$TEST_TMPDIR/shared_install_bases"
+  mkdir -p "$shared"
+  bazel --output_user_root="$TEST_TMPDIR/user1" \
+      --experimental_shared_install_base_root="$shared" --batch version \
+      >&$TEST_log || fail "version failed"
+  bazel --output_user_root="$TEST_TMPDIR/user2" --client_debug \
+      --experimental_shared_install_base_root="$shared" --batch version \
+      >&$TEST_log || fail "version failed"
+  expect_log "Shared the installation at '$shared/"
+  expect_not_log "Extracting B\\(azel\\|laze\\) installation"
+  [[ "$(ls "$shared" | grep -v -e '\.lock$' -e '^cas$' | wc -l)" -eq 1 ]] \
+      || fail "Expected exactly one shared installation"
+  [[ -n "$(ls "$shared/cas")" ]] || fail "Expected the files to be stored"
+  local digests="$(echo "$shared"/*/content_digests)"
+  [[ -f "$digests" ]] || fail "Expected the installation to list its files"
+  for f in $(ls "$shared/cas"); do
+    grep -qx "$f" "$digests" || fail "Stored file $f is not listed"
+    [[ "$(md5sum < "$shared/cas/$f" | cut -d' ' -f1)" == "$f" ]] \
+        || fail "Stored file $f is not named by its MD5 digest"
+  done
+}
+
+function test_shared_install_base_root_prunes_content_store() {
+  local shared="$TEST_TMPDIR/shared_install_bases_pruned"
+  mkdir -p "$shared/cas"
+  echo stale > "$shared/cas/0123456789abcdef0123456789abcdef"
+  bazel --output_user_root="$TEST_TMPDIR/user3" \
+      --experimental_shared_install_base_root="$shared" --batch version \
+      >&$TEST_log || fail "version failed"
+  [[ ! -e "$shared/cas/0123456789abcdef0123456789abcdef" ]] \
+      || fail "Expected the unlisted file to be pruned"
+  [[ -n "$(ls "$shared/cas")" ]] || fail "Expected the files to be stored"
+}
+
+# Without a content store, the installation is still extracted once and
+# shared.
+function test_shared_install_base_root_without_content_store() {
+  if is_windows; then
+    # See test_shared_install_base_root_ignored_on_windows.
+    return
+  fi
+  local shared="$TEST_TMPDIR/shared_install_bases_no_store"
+  mkdir -p "$shared"
+  touch "$shared/cas"
+  bazel --output_user_root="$TEST_TMPDIR/user4" --client_debug \
+      --experimental_shared_install_base_root="$shared" --batch version \
+      >&$TEST_log || fail "version failed"
+  expect_log "couldn't create the content store '$shared/cas'"
+  bazel --output_user_root="$TEST_TMPDIR/user5" --client_debug \
+      --experimental_shared_install_base_root="$shared" --batch version \
+      >&$TEST_log || fail "version failed"
+  expect_log "Shared the installation at '$shared/"
+  expect_not_log "Extracting B\\(azel\\|laze\\) installation"
+  [[ -f "$shared/cas" ]] || fail "Expected the file in the way to stay"
+  if ls "$shared"/*/content_digests >/dev/null 2>&1; then
+    fail "Expected no list of stored files"
+  fi
+}
+
+# Files cannot be shared on Windows, so the client extracts as usual there.
+function test_shared_install_base_root_ignored_on_windows() {
+  if ! is_windows; then
+    return
+  fi
+  local shared="$TEST_TMPDIR/shared_install_bases_windows"
+  mkdir -p "$shared"
+  bazel --output_user_root="$TEST_TMPDIR/user6" \
+      --experimental_shared_install_base_root="$shared" --batch version \
+      >&$TEST_log || fail "version failed"
+  expect_log "shared_install_base_root is not supported on Windows"
+  expect_log "Extracting B\\(azel\\|laze\\) installation"
+  [[ -z "$(ls -A "$shared")" ]] || fail "Expected nothing in '$shared'"
+}
+
+# The clients have their own output bases, so the output base lock does not
+# keep them from extracting at the same time.
+function test_concurrent_clients_extract_once() {
+  local user_root="$TEST_TMPDIR/concurrent"
+  bazel --output_user_root="$user_root" --output_base="$user_root/out1" \
+      --batch version >"$TEST_TMPDIR/client1.log" 2>&1 &
+  local pid1=$!
+  bazel --output_user_root="$user_root" --output_base="$user_root/out2" \
+      --batch version >"$TEST_TMPDIR/client2.log" 2>&1 &
+  local pid2=$!
+  wait $pid1 || fail "first client failed"
+  wait $pid2 || fail "second client failed"
+  cat "$TEST_TMPDIR/client1.log" "$TEST_TMPDIR/client2.log" >$TEST_log
+  [[ "$(grep -c "Extracting B\(azel\|laze\) installation" $TEST_log)" \
+      -eq 1 ]] || fail "Expected exactly one client to extract"
+  [[ -z "$(ls "$user_root/install" | grep '\.tmp\.')" ]] \
+      || fail "Expected no leftover temporary installation"
+}
+
 function test_output_base_is_file() {
   bazel --output_base=/dev/null &>$TEST_log && fail "Expected non-zero exit"
   expect_log "FATAL: Output base directory '/dev/null' could not be created.*exists"
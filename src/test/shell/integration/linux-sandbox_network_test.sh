@@ -52,6 +52,38 @@ function test_ping_loopback() {
   expect_log "1 received"
 }
 
+function test_shared_network_namespace() {
+  unshare --user --map-root-user --net sleep 1000 &
+  local holder=$!
+  sleep 1
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -n /proc/$holder/ns/net -- \
+    /bin/sh -c 'readlink /proc/self/ns/net; /bin/ip link ls' &> $TEST_log \
+    || code=$?
+  local expected_netns="$(readlink /proc/$holder/ns/net)"
+  kill $holder
+  assert_equals 0 "${code:-0}"
+  expect_log "$expected_netns"
+  expect_log "LOOPBACK,UP"
+}
+
+function test_shared_network_namespace_with_interface_is_rejected() {
+  unshare --user --map-root-user --net \
+    /bin/sh -c '/bin/ip tuntap add dev tap0 mode tap && exec sleep 1000' &
+  local holder=$!
+  sleep 1
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -n /proc/$holder/ns/net -- /bin/true \
+    &> $TEST_log || code=$?
+  kill $holder
+  assert_equals 1 "${code:-0}"
+  expect_log "has interface tap0; only lo is allowed"
+}
+
+function test_shared_network_namespace_excludes_new_one() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -N -n /proc/self/ns/net -- /bin/true \
+    &> $TEST_log || code=$?
+  expect_log "The -n option cannot be used with -N or more than once."
+}
+
 # The test shouldn't fail if the environment doesn't support running it.
 check_supported_platform || exit 0
 check_sandbox_allowed || exit 0
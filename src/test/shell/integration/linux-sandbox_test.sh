@@ -200,6 +200,97 @@ function test_mount_additional_paths_multiple_sources_mount_to_one_target() {
   rm -rf ${MOUNT_TARGET_ROOT}/foo
 }
 
+function test_input_layer() {
+  mkdir -p ${TEST_TMPDIR}/inputs/pkg ${TEST_TMPDIR}/overlay-work
+  echo "input" > ${TEST_TMPDIR}/inputs/pkg/in.txt
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS \
+    -I ${TEST_TMPDIR}/inputs -i ${TEST_TMPDIR}/overlay-work \
+    -- /bin/bash -c "cp pkg/in.txt out.txt" &> $TEST_log || code=$?
+  # Unprivileged overlayfs mounts need Linux 5.11 or newer.
+  if grep -q "mount(overlay" $TEST_log; then
+    return 0
+  fi
+  assert_equals "input" "$(cat $SANDBOX_DIR/out.txt)"
+  # Only what the command wrote ends up in the working directory.
+  [[ ! -e $SANDBOX_DIR/pkg/in.txt ]] || fail "input leaked into the sandbox"
+}
+
+function test_input_layer_requires_overlay_work_dir() {
+  mkdir -p ${TEST_TMPDIR}/inputs
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -I ${TEST_TMPDIR}/inputs \
+    -- /bin/true &> $TEST_log || code=$?
+  expect_log "The -I and -i options must be used together.\$"
+}
+
+function test_tmpfs_options() {
+  mkdir -p ${TEST_TMPDIR}/scratch
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -s ${TEST_TMPDIR}/scratch -E size=1m \
+    -- /bin/bash -c 'echo "TMPDIR=$TMPDIR"; grep " ${TMPDIR} " /proc/mounts' \
+    &> $TEST_log || fail
+  expect_log "TMPDIR=${TEST_TMPDIR}/scratch\$"
+  expect_log "tmpfs ${TEST_TMPDIR}/scratch tmpfs .*size=1024k"
+}
+
+function test_tmpfs_options_without_tmpfs() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -E size=1m -- /bin/true \
+    &> $TEST_log || code=$?
+  expect_log "The -E option must be strictly preceded by an -e or -s option.\$"
+}
+
+function test_cpu_affinity() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -a 0 \
+    -- /bin/grep Cpus_allowed_list /proc/self/status &> $TEST_log || fail
+  expect_log "Cpus_allowed_list:[[:space:]]*0\$"
+}
+
+function test_numa_node_binding() {
+  $linux_sandbox -A > ${TEST_TMPDIR}/numa_nodes || fail
+  local node="$(head -n 1 ${TEST_TMPDIR}/numa_nodes | cut -d ' ' -f 1)"
+  local cpus="$(head -n 1 ${TEST_TMPDIR}/numa_nodes | cut -d ' ' -f 2)"
+  [[ -n "$cpus" ]] || fail "no NUMA node in $(cat ${TEST_TMPDIR}/numa_nodes)"
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -b "$node" \
+    -- /bin/grep Cpus_allowed_list /proc/self/status &> $TEST_log || fail
+  expect_log "Cpus_allowed_list:[[:space:]]*${cpus}\$"
+}
+
+function test_invalid_cpu_list() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -a 3-1 -- /bin/true \
+    &> $TEST_log || code=$?
+  expect_log "Invalid CPU list (-a) value: 3-1\$"
+}
+
+function test_coalesces_bind_mounts_of_whole_directory() {
+  mkdir -p ${TEST_TMPDIR}/coalesce/source ${TEST_TMPDIR}/coalesce/target
+  local args=()
+  for f in a b c; do
+    echo "$f" > ${TEST_TMPDIR}/coalesce/source/$f
+    touch ${TEST_TMPDIR}/coalesce/target/$f
+    args+=(-M ${TEST_TMPDIR}/coalesce/source/$f)
+    args+=(-m ${TEST_TMPDIR}/coalesce/target/$f)
+  done
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -D "${args[@]}" \
+    -- /bin/cat ${TEST_TMPDIR}/coalesce/target/c &> $TEST_log || fail
+  expect_log "coalesced 3 bind mounts into ${TEST_TMPDIR}/coalesce/source"
+  expect_log "^c\$"
+}
+
+function test_does_not_coalesce_bind_mounts_that_would_hide_files() {
+  mkdir -p ${TEST_TMPDIR}/partial/source ${TEST_TMPDIR}/partial/target
+  local args=()
+  for f in a b; do
+    echo "$f" > ${TEST_TMPDIR}/partial/source/$f
+    touch ${TEST_TMPDIR}/partial/target/$f
+    args+=(-M ${TEST_TMPDIR}/partial/source/$f)
+    args+=(-m ${TEST_TMPDIR}/partial/target/$f)
+  done
+  echo "other" > ${TEST_TMPDIR}/partial/target/other
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -D "${args[@]}" \
+    -- /bin/cat ${TEST_TMPDIR}/partial/target/{b,other} &> $TEST_log || fail
+  expect_not_log "coalesced"
+  expect_log "^b\$"
+  expect_log "^other\$"
+}
+
 function test_redirect_output() {
   $linux_sandbox $SANDBOX_DEFAULT_OPTS -l $OUT -L $ERR -- /bin/bash -c "echo out; echo err >&2" &> $TEST_log || code=$?
   assert_equals "out" "$(cat $OUT)"
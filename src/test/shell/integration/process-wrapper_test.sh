@@ -57,6 +57,41 @@ function test_to_stderr() {
   assert_output "" "hi there"
 }
 
+function test_stream_output() {
+  local live="${OUT_DIR}/live"
+  $process_wrapper --stdout=$OUT --stderr=$ERR --stream_output /bin/sh -c \
+    'echo out; echo err >&2' 2> "${live}.err" | cat > "$live" || fail
+  assert_output "out" "err"
+  assert_equals "out" "$(cat "$live")"
+  assert_equals "err" "$(cat "${live}.err")"
+}
+
+function test_stream_output_with_slow_reader() {
+  # The reader falls behind, but the file still gets all the output.
+  $process_wrapper --stdout=$OUT --stream_output /bin/sh -c \
+    'head -c 10000000 /dev/zero' | (sleep 2; cat > /dev/null) || fail
+  assert_equals 10000000 "$(wc -c < $OUT | tr -d ' ')"
+}
+
+function test_max_output_bytes() {
+  $process_wrapper --stdout=$OUT --stderr=$ERR --max_output_bytes=8 \
+    /bin/sh -c 'echo 123; echo 456; echo 789; echo abc' &> $TEST_log || fail
+  assert_output "123
+
+[... 8 bytes of output dropped ...]
+abc" ""
+}
+
+function test_kill_output_bytes() {
+  local code=0
+  $process_wrapper --stdout=$OUT --stderr=$ERR --kill_output_bytes=100000 \
+    --max_output_bytes=100 /bin/sh -c 'yes' &> $TEST_log || code=$?
+  # SIGKILL
+  assert_equals 137 "$code"
+  # The head and the tail, 25 lines each, around the note of what was dropped.
+  assert_equals 50 "$(grep -c '^y$' $OUT)"
+}
+
 function test_exit_code() {
   local code=0
   $process_wrapper --stdout=$OUT --stderr=$ERR /bin/sh -c "exit 71" &> $TEST_log || code=$?
@@ -117,6 +152,16 @@ function test_execvp_error_message() {
   assert_contains "\"execvp(/bin/notexisting, ...)\": No such file or directory" "$ERR"
 }
 
+function test_trace_events() {
+  local trace="${OUT_DIR}/trace"
+  BAZEL_TRACE_FILE="$trace" $process_wrapper --stdout=$OUT --stderr=$ERR \
+      /bin/echo hi there &> $TEST_log || fail
+  assert_stdout "hi there"
+  assert_contains '^{"name":"process-wrapper child","ph":"X",' "$trace"
+  assert_contains '^{"name":"process-wrapper","ph":"X","ts":[0-9]*,"dur":' \
+      "$trace"
+}
+
 function assert_process_wrapper_exec_time() {
   local user_time_low="$1"; shift
   local user_time_high="$1"; shift
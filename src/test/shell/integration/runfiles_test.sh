@@ -84,6 +84,8 @@ EOF
   # output manifest exists and is non-empty
   test    -f MANIFEST
   test    -s MANIFEST
+  # and so does its index
+  test    -s MANIFEST.index
 
   cd ${WORKSPACE_NAME}
 
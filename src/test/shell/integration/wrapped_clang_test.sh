@@ -0,0 +1,106 @@
+#!/bin/bash
+#
+# Copyright 2018 The Bazel Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Tests the cache of tool paths in tools/osx/crosstool/wrapped_clang.cc, with
+# a fake xcrun that runs on any platform.
+
+set -euo pipefail
+
+# Load the test setup defined in the parent directory
+CURRENT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+source "${CURRENT_DIR}/../integration_test_setup.sh" \
+  || { echo "integration_test_setup.sh not found!" >&2; exit 1; }
+
+readonly FAKE_DIR="${TEST_TMPDIR}/fake"
+readonly WRAPPED_CLANG="${TEST_TMPDIR}/bin/wrapped_clang"
+
+function set_up() {
+  rm -rf "$FAKE_DIR"
+  mkdir -p "$FAKE_DIR"
+  # Logs its calls, and reports a clang that prints the toolchains it is from.
+  cat > "$FAKE_DIR/xcrun" <<EOS
+#!/bin/sh
+echo "\$*" >> "$FAKE_DIR/xcrun.log"
+[ "\$1" = "--find" ] || exit 1
+tool="$FAKE_DIR/\${TOOLCHAINS:-default}/\$2"
+mkdir -p "\$(dirname "\$tool")"
+printf '#!/bin/sh\necho "%s \$*"\n' "\${TOOLCHAINS:-default}" > "\$tool"
+chmod +x "\$tool"
+echo "\$tool"
+EOS
+  chmod +x "$FAKE_DIR/xcrun"
+  : > "$FAKE_DIR/xcrun.log"
+
+  if [[ ! -x "$WRAPPED_CLANG" ]]; then
+    mkdir -p "$(dirname "$WRAPPED_CLANG")"
+    ${CXX:-c++} -std=c++11 -DXCRUN_PATH="\"$FAKE_DIR/xcrun\"" \
+        -o "$WRAPPED_CLANG" \
+        "${BAZEL_RUNFILES}/tools/osx/crosstool/wrapped_clang.cc" \
+        || fail "could not compile wrapped_clang"
+  fi
+
+  # A new key for each test, so that earlier runs cannot have cached it.
+  export DEVELOPER_DIR="${TEST_TMPDIR}/Xcode.$RANDOM.$$"
+  export SDKROOT="${DEVELOPER_DIR}/SDKs/MacOSX.sdk"
+  unset TOOLCHAINS
+}
+
+function xcrun_calls() {
+  grep -c -- "--find clang" "$FAKE_DIR/xcrun.log" || true
+}
+
+function test_caches_tool_path() {
+  "$WRAPPED_CLANG" -c foo.c >& $TEST_log || fail "wrapped_clang failed"
+  expect_log "default -c foo.c"
+  assert_equals 1 "$(xcrun_calls)"
+
+  "$WRAPPED_CLANG" -c bar.c >& $TEST_log || fail "wrapped_clang failed"
+  expect_log "default -c bar.c"
+  assert_equals 1 "$(xcrun_calls)"
+}
+
+function test_developer_dir_is_part_of_key() {
+  "$WRAPPED_CLANG" -c foo.c >& $TEST_log || fail "wrapped_clang failed"
+  DEVELOPER_DIR="${DEVELOPER_DIR}.other" "$WRAPPED_CLANG" -c foo.c \
+      >& $TEST_log || fail "wrapped_clang failed"
+  assert_equals 2 "$(xcrun_calls)"
+}
+
+function test_toolchains_is_part_of_key() {
+  "$WRAPPED_CLANG" -c foo.c >& $TEST_log || fail "wrapped_clang failed"
+  expect_log "default -c foo.c"
+
+  TOOLCHAINS=swift "$WRAPPED_CLANG" -c foo.c >& $TEST_log \
+      || fail "wrapped_clang failed"
+  expect_log "swift -c foo.c"
+  assert_equals 2 "$(xcrun_calls)"
+
+  TOOLCHAINS=swift "$WRAPPED_CLANG" -c foo.c >& $TEST_log \
+      || fail "wrapped_clang failed"
+  expect_log "swift -c foo.c"
+  assert_equals 2 "$(xcrun_calls)"
+}
+
+function test_falls_back_to_xcrun() {
+  # A cached path that is no longer executable counts as a miss.
+  "$WRAPPED_CLANG" -c foo.c >& $TEST_log || fail "wrapped_clang failed"
+  chmod -x "$FAKE_DIR/default/clang"
+  "$WRAPPED_CLANG" -c foo.c >& $TEST_log || fail "wrapped_clang failed"
+  expect_log "default -c foo.c"
+  assert_equals 2 "$(xcrun_calls)"
+}
+
+run_suite "wrapped_clang tests"
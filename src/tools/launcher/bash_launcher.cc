@@ -12,7 +12,6 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <sstream>
 #include <string>
 #include <vector>
 
@@ -22,12 +21,28 @@
 namespace bazel {
 namespace launcher {
 
-using std::ostringstream;
 using std::string;
 using std::vector;
 
 static constexpr const char* BASH_BIN_PATH = "bash_bin_path";
 
+// Quote `argument` for the command line parser of the MSYS runtime, which
+// unescapes backslashes and double quotes inside double quotes, and leaves
+// the text there alone otherwise. Unquoted arguments would be globbed.
+static string QuoteForMsys(const string& argument) {
+  string quoted;
+  quoted.reserve(argument.size() + 2);
+  quoted += '"';
+  for (const char ch : argument) {
+    if (ch == '"' || ch == '\\') {
+      quoted += '\\';
+    }
+    quoted += ch;
+  }
+  quoted += '"';
+  return quoted;
+}
+
 ExitCode BashBinaryLauncher::Launch() {
   string bash_binary = this->GetLaunchInfoByKey(BASH_BIN_PATH);
   // If specified bash binary path doesn't exist, then fall back to
@@ -36,21 +51,16 @@ ExitCode BashBinaryLauncher::Launch() {
     bash_binary = "bash.exe";
   }
 
+  // Let bash run the script as a file with the arguments as they are, rather
+  // than through "bash -c <command line>": that way bash neither parses nor
+  // expands the arguments again, and does not fork another process to run the
+  // script, which is slow under MSYS.
   vector<string> origin_args = this->GetCommandlineArguments();
-  ostringstream bash_command;
-  string bash_main_file = GetBinaryPathWithoutExtension(origin_args[0]);
-  bash_command << GetEscapedArgument(bash_main_file,
-                                     /*escape_backslash = */ true);
+  vector<string> args;
+  args.push_back(QuoteForMsys(GetBinaryPathWithoutExtension(origin_args[0])));
   for (int i = 1; i < origin_args.size(); i++) {
-    bash_command << ' ';
-    bash_command << GetEscapedArgument(origin_args[i],
-                                       /*escape_backslash = */ true);
+    args.push_back(QuoteForMsys(origin_args[i]));
   }
-
-  vector<string> args;
-  args.push_back("-c");
-  args.push_back(
-      GetEscapedArgument(bash_command.str(), /*escape_backslash = */ true));
   return this->LaunchProcess(bash_binary, args);
 }
 
@@ -12,6 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+
 #include <memory>
 #include <sstream>
 #include <string>
@@ -25,12 +30,12 @@
 #include "src/main/native/windows/file.h"
 #include "src/tools/launcher/java_launcher.h"
 #include "src/tools/launcher/util/launcher_util.h"
+#include "third_party/ijar/zip.h"
 
 namespace bazel {
 namespace launcher {
 
 using std::getline;
-using std::ofstream;
 using std::ostringstream;
 using std::string;
 using std::stringstream;
@@ -39,10 +44,12 @@ using std::wstring;
 
 // The runfile path of java binary, eg. local_jdk/bin/java.exe
 static constexpr const char* JAVA_BIN_PATH = "java_bin_path";
-static constexpr const char* JAR_BIN_PATH = "jar_bin_path";
 static constexpr const char* CLASSPATH = "classpath";
 static constexpr const char* JAVA_START_CLASS = "java_start_class";
 static constexpr const char* JVM_FLAGS = "jvm_flags";
+// "1" if the JVM should load the classes from a class data sharing archive
+// dumped by an earlier run, see GetClassDataArchive.
+static constexpr const char* CLASS_DATA_SHARING = "class_data_sharing";
 
 // Check if a string start with a certain prefix.
 // If it's true, store the substring without the prefix in value.
@@ -161,18 +168,90 @@ static void WriteJarClasspath(const string& jar_path,
   }
 }
 
-string JavaBinaryLauncher::GetJunctionBaseDir() {
+// Write a jar at `jar_path` holding nothing but `manifest` as its
+// META-INF/MANIFEST.MF, the way `jar cfm` would.
+static bool WriteClasspathJar(const string& jar_path, const string& manifest) {
+  std::unique_ptr<devtools_ijar::ZipBuilder> builder(
+      devtools_ijar::ZipBuilder::Create(jar_path.c_str()));
+  if (builder == nullptr) {
+    return false;
+  }
+  if (builder->WriteEmptyFile("META-INF/") < 0) {
+    return false;
+  }
+  devtools_ijar::u1* buffer =
+      builder->NewFile("META-INF/MANIFEST.MF", 0, manifest.size());
+  if (buffer == nullptr) {
+    return false;
+  }
+  memcpy(buffer, manifest.data(), manifest.size());
+  return builder->FinishFile(manifest.size(), /* compress */ false,
+                             /* compute_crc */ true) >= 0 &&
+         builder->Finish() >= 0;
+}
+
+// Append the last write time of `path` to `key`, if it exists.
+static void AppendLastWriteTime(const string& path, ostringstream* key) {
+  WIN32_FILE_ATTRIBUTE_DATA attrs;
+  if (GetFileAttributesExW(AsAbsoluteWindowsPath(path.c_str()).c_str(),
+                           GetFileExInfoStandard, &attrs)) {
+    *key << '\n'
+         << attrs.ftLastWriteTime.dwHighDateTime << ':'
+         << attrs.ftLastWriteTime.dwLowDateTime;
+  }
+}
+
+// Return the FNV-1a hash of `key` as 16 hex digits.
+static string HashKey(const string& key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : key) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+  return hex;
+}
+
+// Return the key of the classpath jar for `classpath`, a hash of everything
+// the jar depends on: the classpath, where the jar is, and the binary.
+static string GetClasspathJarKey(const string& classpath,
+                                 const string& abs_manifest_jar_dir_norm,
+                                 const string& binary) {
+  ostringstream key;
+  key << classpath << '\n' << abs_manifest_jar_dir_norm << '\n' << binary;
+  AppendLastWriteTime(binary, &key);
+  return HashKey(key.str());
+}
+
+// Return the key of the class data sharing archive for `classpath`, a hash of
+// everything the JVM checks before using the archive: the JVM and the jars on
+// the classpath, including when they were last written.
+static string GetClassDataArchiveKey(const string& java_bin,
+                                     const string& classpath) {
+  ostringstream key;
+  key << java_bin;
+  AppendLastWriteTime(java_bin, &key);
+  stringstream classpath_ss(classpath);
+  string jar;
+  while (getline(classpath_ss, jar, ';')) {
+    key << '\n' << jar;
+    AppendLastWriteTime(jar, &key);
+  }
+  return HashKey(key.str());
+}
+
+string JavaBinaryLauncher::GetJunctionBaseDir(const string& key) {
   string binary_base_path =
       GetBinaryPathWithExtension(this->GetCommandlineArguments()[0]);
   string result;
-  if (!NormalizePath(binary_base_path + ".j", &result)) {
+  if (!NormalizePath(binary_base_path + ".j-" + key, &result)) {
     die("Failed to get normalized junction base directory.");
   }
   return result;
 }
 
-void JavaBinaryLauncher::DeleteJunctionBaseDir() {
-  string junction_base_dir_norm = GetJunctionBaseDir();
+void JavaBinaryLauncher::DeleteJunctionBaseDir(const string& key) {
+  string junction_base_dir_norm = GetJunctionBaseDir(key);
   if (!DoesDirectoryPathExist(junction_base_dir_norm.c_str())) {
     return;
   }
@@ -188,11 +267,50 @@ void JavaBinaryLauncher::DeleteJunctionBaseDir() {
   }
 }
 
+void JavaBinaryLauncher::DeleteStaleClasspathJars(
+    const string& binary_base_path, const string& key) {
+  static const string kSuffix = "-classpath.jar";
+  string prefix = GetBaseNameFromPath(binary_base_path) + "-";
+  string dir = GetParentDirFromPath(binary_base_path);
+  WIN32_FIND_DATAA data;
+  HANDLE handle =
+      FindFirstFileA((binary_base_path + "-*" + kSuffix).c_str(), &data);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  do {
+    string name = data.cFileName;
+    if (name.size() <= prefix.size() + kSuffix.size()) {
+      continue;
+    }
+    string other_key = name.substr(
+        prefix.size(), name.size() - prefix.size() - kSuffix.size());
+    // A jar that is still in use cannot be deleted; its junctions are kept
+    // then, too.
+    if (other_key != key &&
+        DeleteFileByPath((dir.empty() ? name : dir + "\\" + name).c_str())) {
+      DeleteJunctionBaseDir(other_key);
+    }
+  } while (FindNextFileA(handle, &data));
+  FindClose(handle);
+}
+
 string JavaBinaryLauncher::CreateClasspathJar(const string& classpath) {
   string binary_base_path =
       GetBinaryPathWithoutExtension(this->GetCommandlineArguments()[0]);
   string abs_manifest_jar_dir_norm = GetManifestJarDir(binary_base_path);
 
+  // The jar is renamed into place last, so if it is there, so are the
+  // junctions it refers to.
+  string key = GetClasspathJarKey(
+      classpath, abs_manifest_jar_dir_norm,
+      GetBinaryPathWithExtension(this->GetCommandlineArguments()[0]));
+  string manifest_jar_path = binary_base_path + "-" + key + "-classpath.jar";
+  if (DoesFilePathExist(manifest_jar_path.c_str())) {
+    return manifest_jar_path;
+  }
+  DeleteStaleClasspathJars(binary_base_path, key);
+
   ostringstream manifest_classpath;
   manifest_classpath << "Class-Path:";
   stringstream classpath_ss(classpath);
@@ -201,10 +319,11 @@ string JavaBinaryLauncher::CreateClasspathJar(const string& classpath) {
   // A set to store all junctions created.
   // The key is the target path, the value is the junction path.
   std::unordered_map<string, string> jar_dirs;
-  string junction_base_dir_norm = GetJunctionBaseDir();
+  string junction_base_dir_norm = GetJunctionBaseDir(key);
   int junction_count = 0;
-  // Make sure the junction base directory doesn't exist already.
-  DeleteJunctionBaseDir();
+  // The directory may exist already, if an earlier run did not get to create
+  // the jar or another one is creating it concurrently. The junctions in it
+  // are the ones we need, as they depend on nothing but the key.
   blaze_util::MakeDirectories(junction_base_dir_norm, 0755);
 
   while (getline(classpath_ss, path, ';')) {
@@ -228,10 +347,13 @@ string JavaBinaryLauncher::CreateClasspathJar(const string& classpath) {
               blaze_util::CstringToWstring(junction.c_str()).get());
           wstring wjunction(
               blaze_util::CstringToWstring(jar_dir.c_str()).get());
-          wstring werror(bazel::windows::CreateJunction(wjar_dir, wjunction));
-          if (!werror.empty()) {
-            string error(werror.begin(), werror.end());
-            die("CreateClasspathJar failed: %s", error.c_str());
+          if (!DoesDirectoryPathExist(junction.c_str())) {
+            wstring werror(
+                bazel::windows::CreateJunction(wjar_dir, wjunction));
+            if (!werror.empty()) {
+              string error(werror.begin(), werror.end());
+              die("CreateClasspathJar failed: %s", error.c_str());
+            }
           }
 
           jar_dirs.insert(std::make_pair(jar_dir, junction));
@@ -248,40 +370,76 @@ string JavaBinaryLauncher::CreateClasspathJar(const string& classpath) {
     WriteJarClasspath(path, &manifest_classpath);
   }
 
-  string rand_id = "-" + GetRandomStr(10);
-  string jar_manifest_file_path = binary_base_path + rand_id + ".jar_manifest";
-  ofstream jar_manifest_file(jar_manifest_file_path);
-  jar_manifest_file << "Manifest-Version: 1.0\n";
+  string manifest = "Manifest-Version: 1.0\n";
   // No line in the MANIFEST.MF file may be longer than 72 bytes.
   // A space prefix indicates the line is still the content of the last
   // attribute.
   string manifest_classpath_str = manifest_classpath.str();
   for (size_t i = 0; i < manifest_classpath_str.length(); i += 71) {
     if (i > 0) {
-      jar_manifest_file << " ";
+      manifest += " ";
     }
-    jar_manifest_file << manifest_classpath_str.substr(i, 71) << "\n";
+    manifest += manifest_classpath_str.substr(i, 71) + "\n";
   }
-  jar_manifest_file.close();
-
-  // Create the command for generating classpath jar.
-  string manifest_jar_path = binary_base_path + rand_id + "-classpath.jar";
-  string jar_bin = this->Rlocation(this->GetLaunchInfoByKey(JAR_BIN_PATH));
-  vector<string> arguments;
-  arguments.push_back("cvfm");
-  arguments.push_back(manifest_jar_path);
-  arguments.push_back(jar_manifest_file_path);
 
-  if (this->LaunchProcess(jar_bin, arguments, /* suppressOutput */ true) != 0) {
-    die("Couldn't create classpath jar: %s", manifest_jar_path.c_str());
+  // Write the jar in-process, rather than spawning the JDK's jar tool, which
+  // starts a JVM and dominates the launcher's first run.
+  string temp_jar_path =
+      binary_base_path + "-" + GetRandomStr(10) + "-classpath.jar.tmp";
+  if (!WriteClasspathJar(temp_jar_path, manifest)) {
+    DeleteFileByPath(temp_jar_path.c_str());
+    die("Couldn't create classpath jar: %s", temp_jar_path.c_str());
   }
 
-  // Delete jar_manifest_file after classpath jar is created.
-  DeleteFileByPath(jar_manifest_file_path.c_str());
+  // Another run may have put the same jar into place concurrently, and be
+  // using it.
+  if (!MoveFileExW(AsAbsoluteWindowsPath(temp_jar_path.c_str()).c_str(),
+                   AsAbsoluteWindowsPath(manifest_jar_path.c_str()).c_str(),
+                   MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFileByPath(temp_jar_path.c_str());
+    if (!DoesFilePathExist(manifest_jar_path.c_str())) {
+      die("Couldn't create classpath jar: %s", manifest_jar_path.c_str());
+    }
+  }
 
   return manifest_jar_path;
 }
 
+void JavaBinaryLauncher::DeleteStaleClassDataArchives(
+    const string& binary_base_path, const string& key) {
+  static const string kSuffix = ".jsa";
+  string dir = GetParentDirFromPath(binary_base_path);
+  string current = GetBaseNameFromPath(binary_base_path) + "-" + key + kSuffix;
+  WIN32_FIND_DATAA data;
+  HANDLE handle =
+      FindFirstFileA((binary_base_path + "-*" + kSuffix).c_str(), &data);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  do {
+    string name = data.cFileName;
+    // An archive that is still in use cannot be deleted, and is left alone.
+    if (name != current) {
+      DeleteFileByPath((dir.empty() ? name : dir + "\\" + name).c_str());
+    }
+  } while (FindNextFileA(handle, &data));
+  FindClose(handle);
+}
+
+string JavaBinaryLauncher::GetClassDataArchive(const string& java_bin,
+                                               const string& classpath,
+                                               bool* exists) {
+  string binary_base_path =
+      GetBinaryPathWithoutExtension(this->GetCommandlineArguments()[0]);
+  string key = GetClassDataArchiveKey(java_bin, classpath);
+  string archive_path = binary_base_path + "-" + key + ".jsa";
+  *exists = DoesFilePathExist(archive_path.c_str());
+  if (!*exists) {
+    DeleteStaleClassDataArchives(binary_base_path, key);
+  }
+  return archive_path;
+}
+
 ExitCode JavaBinaryLauncher::Launch() {
   // Parse the original command line.
   vector<string> remaining_args = this->ProcessesCommandLine();
@@ -321,9 +479,13 @@ ExitCode JavaBinaryLauncher::Launch() {
       classpath << this->main_advice_classpath << ';';
     }
     string path;
+    vector<string> paths;
     stringstream classpath_ss(this->GetLaunchInfoByKey(CLASSPATH));
     while (getline(classpath_ss, path, ';')) {
-      classpath << this->Rlocation(path) << ';';
+      paths.push_back(path);
+    }
+    for (const string& jar : this->Rlocation(paths)) {
+      classpath << jar << ';';
     }
   }
 
@@ -372,13 +534,29 @@ ExitCode JavaBinaryLauncher::Launch() {
   // Check if CLASSPATH is over classpath length limit.
   // If it does, then we create a classpath jar to pass CLASSPATH value.
   string classpath_str = classpath.str();
-  string classpath_jar = "";
   if (classpath_str.length() > this->classpath_limit) {
-    classpath_jar = CreateClasspathJar(classpath_str);
-    arguments.push_back(classpath_jar);
+    arguments.push_back(CreateClasspathJar(classpath_str));
   } else {
     arguments.push_back(classpath_str);
   }
+  // Use the class data sharing archive of the classpath, or have the JVM dump
+  // one when it exits. It is dumped under a temporary name, and renamed into
+  // place once it is complete.
+  string class_data_sharing;
+  string archive_path;
+  string temp_archive_path;
+  if (this->GetLaunchInfoByKey(CLASS_DATA_SHARING, &class_data_sharing) &&
+      class_data_sharing == "1") {
+    bool archive_exists;
+    archive_path =
+        GetClassDataArchive(java_bin, classpath_str, &archive_exists);
+    if (archive_exists) {
+      arguments.push_back("-XX:SharedArchiveFile=" + archive_path);
+    } else {
+      temp_archive_path = archive_path + "." + GetRandomStr(10) + ".tmp";
+      arguments.push_back("-XX:ArchiveClassesAtExit=" + temp_archive_path);
+    }
+  }
   // Add JVM debug flags
   string jvm_debug_flags_str = jvm_debug_flags.str();
   if (!jvm_debug_flags_str.empty()) {
@@ -410,14 +588,18 @@ ExitCode JavaBinaryLauncher::Launch() {
         GetEscapedArgument(arg, /*escape_backslash = */ false));
   }
 
+  // The classpath jar, if any, is kept for the next run.
   ExitCode exit_code = this->LaunchProcess(java_bin, escaped_arguments);
 
-  // Delete classpath jar file after execution.
-  if (!classpath_jar.empty()) {
-    DeleteFileByPath(classpath_jar.c_str());
-    DeleteJunctionBaseDir();
+  // Another run may have put an archive into place concurrently, and be
+  // using it; that one is kept then.
+  if (!temp_archive_path.empty() &&
+      DoesFilePathExist(temp_archive_path.c_str()) &&
+      !MoveFileExW(AsAbsoluteWindowsPath(temp_archive_path.c_str()).c_str(),
+                   AsAbsoluteWindowsPath(archive_path.c_str()).c_str(),
+                   MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFileByPath(temp_archive_path.c_str());
   }
-
   return exit_code;
 }
 
@@ -86,17 +86,36 @@ class JavaBinaryLauncher : public BinaryLauncherBase {
   int classpath_limit;
 
   // Create a classpath jar to pass CLASSPATH value when its length is over
-  // limit.
+  // limit. The jar is cached next to the binary, keyed by the classpath and
+  // the binary, and reused by later runs.
   //
-  // Return the path of the classpath jar created.
+  // Return the path of the classpath jar.
   std::string CreateClasspathJar(const std::string& classpath);
 
-  // Creat a directory based on the binary path, all the junctions will be
-  // generated under this directory.
-  std::string GetJunctionBaseDir();
+  // Creat a directory based on the binary path and the classpath jar's key,
+  // all the junctions the classpath jar refers to will be generated under this
+  // directory.
+  std::string GetJunctionBaseDir(const std::string& key);
 
   // Delete all the junction directory and all the junctions under it.
-  void DeleteJunctionBaseDir();
+  void DeleteJunctionBaseDir(const std::string& key);
+
+  // Delete the classpath jars cached for keys other than `key`, and their
+  // junctions, unless they are still in use.
+  void DeleteStaleClasspathJars(const std::string& binary_base_path,
+                                const std::string& key);
+
+  // Return the path of the class data sharing archive of the classes `java_bin`
+  // loads from `classpath`. The archive is cached next to the binary, keyed by
+  // the JVM and the jars, and `exists` tells whether an earlier run dumped it
+  // already. If not, the archives cached for other keys are deleted.
+  std::string GetClassDataArchive(const std::string& java_bin,
+                                  const std::string& classpath, bool* exists);
+
+  // Delete the class data sharing archives cached for keys other than `key`,
+  // unless they are still in use.
+  void DeleteStaleClassDataArchives(const std::string& binary_base_path,
+                                    const std::string& key);
 };
 
 }  // namespace launcher
@@ -12,15 +12,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdint.h>
+#include <string.h>
 #include <windows.h>
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "src/main/cpp/util/path_platform.h"
+#include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/tools/launcher/launcher.h"
 #include "src/tools/launcher/util/data_parser.h"
 #include "src/tools/launcher/util/launcher_util.h"
@@ -28,10 +32,10 @@
 namespace bazel {
 namespace launcher {
 
-using std::ifstream;
+using std::ofstream;
 using std::ostringstream;
 using std::string;
-using std::unordered_map;
+using std::unordered_multimap;
 using std::vector;
 
 static std::string GetRunfilesDir(const char* argv0) {
@@ -55,12 +59,6 @@ BinaryLauncherBase::BinaryLauncherBase(
   for (int i = 0; i < argc; i++) {
     commandline_arguments.push_back(argv[i]);
   }
-  // Prefer to use the runfiles manifest, if it exists, but otherwise the
-  // runfiles directory will be used by default. On Windows, the manifest is
-  // used locally, and the runfiles directory is used remotely.
-  if (manifest_file != "") {
-    ParseManifestFile(&manifest_file_map, manifest_file);
-  }
 }
 
 static bool FindManifestFileImpl(const char* argv0, string* result) {
@@ -114,53 +112,107 @@ string BinaryLauncherBase::GetRunfilesPath() const {
   return runfiles_path;
 }
 
-void BinaryLauncherBase::ParseManifestFile(ManifestFileMap* manifest_file_map,
-                                           const string& manifest_path) {
-  ifstream manifest_file(AsAbsoluteWindowsPath(manifest_path.c_str()).c_str());
+// FNV-1a, to look up manifest keys without copying them out of the manifest.
+static uint64_t HashKey(const char* key, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ static_cast<unsigned char>(key[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
 
-  if (!manifest_file) {
-    die("Couldn't open MANIFEST file: %s", manifest_path.c_str());
+void BinaryLauncherBase::LookupManifest(const char* manifest,
+                                        int64_t manifest_size,
+                                        const vector<string>& keys,
+                                        vector<string>* targets) {
+  // The indices of the keys not found yet, by the hash of the key.
+  unordered_multimap<uint64_t, size_t> pending;
+  for (size_t i = 0; i < keys.size(); i++) {
+    pending.insert(std::make_pair(HashKey(keys[i].data(), keys[i].size()), i));
   }
+  targets->assign(keys.size(), string());
 
-  string line;
-  while (getline(manifest_file, line)) {
-    size_t space_pos = line.find_first_of(' ');
-    if (space_pos == string::npos) {
-      die("Wrong MANIFEST format at line: %s", line.c_str());
+  const char* end = manifest + manifest_size;
+  for (const char* line = manifest; line < end && !pending.empty();) {
+    const char* line_end = static_cast<const char*>(
+        memchr(line, '\n', end - line));
+    if (line_end == nullptr) {
+      line_end = end;
     }
-    string key = line.substr(0, space_pos);
-    string value = line.substr(space_pos + 1);
-    manifest_file_map->insert(make_pair(key, value));
+    const char* space = static_cast<const char*>(
+        memchr(line, ' ', line_end - line));
+    if (space == nullptr) {
+      die("Wrong MANIFEST format at line: %s",
+          string(line, line_end - line).c_str());
+    }
+    size_t key_length = space - line;
+    auto range = pending.equal_range(HashKey(line, key_length));
+    for (auto it = range.first; it != range.second;) {
+      const string& key = keys[it->second];
+      // The first entry of a key wins, as it did when the manifest was parsed
+      // into a map.
+      if (key.size() == key_length &&
+          memcmp(key.data(), line, key_length) == 0) {
+        (*targets)[it->second].assign(space + 1, line_end - space - 1);
+        it = pending.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    line = line_end + 1;
+  }
+  if (!pending.empty()) {
+    die("Rlocation failed on %s, path doesn't exist in MANIFEST file",
+        keys[pending.begin()->second].c_str());
   }
 }
 
 string BinaryLauncherBase::Rlocation(const string& path,
                                      bool need_workspace_name) const {
-  // If the manifest file map is empty, then we're using the runfiles directory
-  // instead.
-  if (manifest_file_map.empty()) {
-    if (blaze_util::IsAbsolute(path)) {
-      return path;
+  return Rlocation(vector<string>(1, path), need_workspace_name)[0];
+}
+
+vector<string> BinaryLauncherBase::Rlocation(const vector<string>& paths,
+                                             bool need_workspace_name) const {
+  // Prefer to use the runfiles manifest, if it exists, but otherwise the
+  // runfiles directory will be used by default. On Windows, the manifest is
+  // used locally, and the runfiles directory is used remotely.
+  const char* manifest = nullptr;
+  int64_t manifest_size = 0;
+  if (manifest_file != "" &&
+      !MapFile(manifest_file, &manifest, &manifest_size)) {
+    die("Couldn't open MANIFEST file: %s", manifest_file.c_str());
+  }
+
+  vector<string> result;
+  if (manifest != nullptr) {
+    vector<string> keys;
+    for (const string& path : paths) {
+      keys.push_back(need_workspace_name ? this->workspace_name + "/" + path
+                                         : path);
     }
+    LookupManifest(manifest, manifest_size, keys, &result);
+    // Do not keep the manifest mapped while the binary runs: the file could
+    // not be replaced by the next build in the meantime.
+    UnmapViewOfFile(manifest);
+    return result;
+  }
 
+  // Without a manifest file, or with an empty one, we're using the runfiles
+  // directory instead.
+  for (const string& path : paths) {
+    if (blaze_util::IsAbsolute(path)) {
+      result.push_back(path);
+      continue;
+    }
     string query_path = runfiles_dir;
     if (need_workspace_name) {
       query_path += "/" + this->workspace_name;
     }
     query_path += "/" + path;
-    return query_path;
+    result.push_back(query_path);
   }
-
-  string query_path = path;
-  if (need_workspace_name) {
-    query_path = this->workspace_name + "/" + path;
-  }
-  auto entry = manifest_file_map.find(query_path);
-  if (entry == manifest_file_map.end()) {
-    die("Rlocation failed on %s, path doesn't exist in MANIFEST file",
-        query_path.c_str());
-  }
-  return entry->second;
+  return result;
 }
 
 string BinaryLauncherBase::GetLaunchInfoByKey(const string& key) {
@@ -171,6 +223,16 @@ string BinaryLauncherBase::GetLaunchInfoByKey(const string& key) {
   return item->second;
 }
 
+bool BinaryLauncherBase::GetLaunchInfoByKey(const string& key,
+                                            string* value) const {
+  auto item = launch_info.find(key);
+  if (item == launch_info.end()) {
+    return false;
+  }
+  *value = item->second;
+  return true;
+}
+
 const vector<string>& BinaryLauncherBase::GetCommandlineArguments() const {
   return this->commandline_arguments;
 }
@@ -210,12 +272,76 @@ bool BinaryLauncherBase::PrintLauncherCommandLine(
   return has_print_cmd_flag;
 }
 
+// Return the wall-clock time in microseconds since the Unix epoch.
+static int64_t GetRealtimeMicros() {
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  // FILETIME counts 100 nanoseconds since 1601-01-01.
+  uint64_t ticks =
+      (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+  return static_cast<int64_t>((ticks - 116444736000000000ULL) / 10);
+}
+
+// Write the resource usage of the process tree in `job`, if any, and the
+// timestamps of the launch to `stats_path`, as an ExecutionStatistics proto.
+static void WriteStatsToFile(const string& stats_path, HANDLE job,
+                             tools::protos::PhaseTimestamps* timestamps) {
+  tools::protos::ExecutionStatistics stats;
+  JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting;
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+  if (job != NULL &&
+      QueryInformationJobObject(job, JobObjectBasicAndIoAccountingInformation,
+                                &accounting, sizeof(accounting), NULL) &&
+      QueryInformationJobObject(job, JobObjectExtendedLimitInformation,
+                                &limits, sizeof(limits), NULL)) {
+    // The job's times are in units of 100 nanoseconds.
+    int64_t user_usec = accounting.BasicInfo.TotalUserTime.QuadPart / 10;
+    int64_t kernel_usec = accounting.BasicInfo.TotalKernelTime.QuadPart / 10;
+
+    tools::protos::ResourceUsage* resource_usage =
+        stats.mutable_resource_usage();
+    resource_usage->set_utime_sec(user_usec / 1000000);
+    resource_usage->set_utime_usec(user_usec % 1000000);
+    resource_usage->set_stime_sec(kernel_usec / 1000000);
+    resource_usage->set_stime_usec(kernel_usec % 1000000);
+    // In kilobytes, like the largest process of the tree in getrusage(2).
+    resource_usage->set_maxrss(limits.PeakProcessMemoryUsed / 1024);
+    resource_usage->set_inblock(accounting.IoInfo.ReadOperationCount);
+    resource_usage->set_oublock(accounting.IoInfo.WriteOperationCount);
+
+    tools::protos::CgroupUsage* tree_usage = stats.mutable_cgroup_usage();
+    tree_usage->set_memory_peak_bytes(limits.PeakJobMemoryUsed);
+    tree_usage->set_cpu_usage_usec(user_usec + kernel_usec);
+    tree_usage->set_cpu_user_usec(user_usec);
+    tree_usage->set_cpu_system_usec(kernel_usec);
+    tree_usage->set_io_read_bytes(accounting.IoInfo.ReadTransferCount);
+    tree_usage->set_io_write_bytes(accounting.IoInfo.WriteTransferCount);
+  }
+  timestamps->set_end_usec(GetRealtimeMicros());
+  stats.mutable_timestamps()->Swap(timestamps);
+
+  ofstream stats_file(AsAbsoluteWindowsPath(stats_path.c_str()).c_str(),
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!stats.SerializeToOstream(&stats_file)) {
+    PrintError("Couldn't write execution statistics to %s",
+               stats_path.c_str());
+  }
+}
+
 ExitCode BinaryLauncherBase::LaunchProcess(const string& executable,
                                            const vector<string>& arguments,
                                            bool suppressOutput) const {
   if (PrintLauncherCommandLine(executable, arguments)) {
     return 0;
   }
+  tools::protos::PhaseTimestamps timestamps;
+  timestamps.set_start_usec(GetRealtimeMicros());
+  // The statistics cover the whole process tree, so launchers below this one
+  // need not write them too.
+  string stats_path;
+  if (GetEnv(STATS_FILE, &stats_path)) {
+    SetEnv(STATS_FILE, "");
+  }
   if (manifest_file != "") {
     SetEnv("RUNFILES_MANIFEST_ONLY", "1");
     SetEnv("RUNFILES_MANIFEST_FILE", manifest_file);
@@ -224,6 +350,21 @@ ExitCode BinaryLauncherBase::LaunchProcess(const string& executable,
   }
   CmdLine cmdline;
   CreateCommandLine(&cmdline, executable, arguments);
+
+  // Run the process in a job object, so that its descendants are accounted
+  // for and terminated along with it, or when the launcher itself is killed.
+  HANDLE job = CreateJobObject(NULL, NULL);
+  if (job != NULL) {
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info = {0};
+    job_info.BasicLimitInformation.LimitFlags =
+        JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    if (!SetInformationJobObject(job, JobObjectExtendedLimitInformation,
+                                 &job_info, sizeof(job_info))) {
+      CloseHandle(job);
+      job = NULL;
+    }
+  }
+
   PROCESS_INFORMATION processInfo = {0};
   STARTUPINFOA startupInfo = {0};
   startupInfo.cb = sizeof(startupInfo);
@@ -234,8 +375,9 @@ ExitCode BinaryLauncherBase::LaunchProcess(const string& executable,
       /* lpThreadAttributes */ NULL,
       /* bInheritHandles */ FALSE,
       /* dwCreationFlags */
-          suppressOutput ? CREATE_NO_WINDOW  // no console window => no output
-                         : 0,
+          (suppressOutput ? CREATE_NO_WINDOW  // no console window => no output
+                          : 0) |
+          CREATE_SUSPENDED,  // so that it is in the job before it starts
       /* lpEnvironment */ NULL,
       /* lpCurrentDirectory */ NULL,
       /* lpStartupInfo */ &startupInfo,
@@ -244,14 +386,34 @@ ExitCode BinaryLauncherBase::LaunchProcess(const string& executable,
     PrintError("Cannot launch process: %s\nReason: %s",
                cmdline.cmdline,
                GetLastErrorString().c_str());
-    return GetLastError();
+    DWORD error = GetLastError();
+    if (job != NULL) {
+      CloseHandle(job);
+    }
+    return error;
   }
+  if (job != NULL && !AssignProcessToJobObject(job, processInfo.hProcess)) {
+    // Before Windows 8, a process in a job cannot be put into another one.
+    // Run the process on its own then, as it did before.
+    CloseHandle(job);
+    job = NULL;
+  }
+  timestamps.set_child_start_usec(GetRealtimeMicros());
+  ResumeThread(processInfo.hThread);
   WaitForSingleObject(processInfo.hProcess, INFINITE);
+  timestamps.set_child_exit_usec(GetRealtimeMicros());
   ExitCode exit_code;
   GetExitCodeProcess(processInfo.hProcess,
                      reinterpret_cast<LPDWORD>(&exit_code));
   CloseHandle(processInfo.hProcess);
   CloseHandle(processInfo.hThread);
+  if (!stats_path.empty()) {
+    WriteStatsToFile(stats_path, job, &timestamps);
+  }
+  if (job != NULL) {
+    // Terminates the descendants that are still running.
+    CloseHandle(job);
+  }
   return exit_code;
 }
 
@@ -16,7 +16,6 @@
 #define BAZEL_SRC_TOOLS_LAUNCHER_LAUNCHER_H_
 
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "src/tools/launcher/util/data_parser.h"
@@ -27,6 +26,11 @@ namespace launcher {
 typedef int32_t ExitCode;
 static constexpr const char* WORKSPACE_NAME = "workspace_name";
 
+// The environment variable naming the file LaunchProcess writes the
+// execution statistics of the launched process tree to, as an
+// ExecutionStatistics proto (src/main/protobuf/execution_statistics.proto).
+static constexpr const char* STATS_FILE = "LAUNCHER_STATS_FILE";
+
 // The maximum length of lpCommandLine is 32768 characters.
 // https://msdn.microsoft.com/en-us/library/windows/desktop/ms682425(v=vs.85).aspx
 static const int MAX_CMDLINE_LENGTH = 32768;
@@ -36,8 +40,6 @@ struct CmdLine {
 };
 
 class BinaryLauncherBase {
-  typedef std::unordered_map<std::string, std::string> ManifestFileMap;
-
  public:
   BinaryLauncherBase(const LaunchDataParser::LaunchInfo& launch_info, int argc,
                      char* argv[]);
@@ -45,6 +47,11 @@ class BinaryLauncherBase {
   // Get launch information based on a launch info key.
   std::string GetLaunchInfoByKey(const std::string& key);
 
+  // Get launch information based on a launch info key, if the key exists.
+  //
+  // Return true if it does, and store its value in value.
+  bool GetLaunchInfoByKey(const std::string& key, std::string* value) const;
+
   // Get the original command line arguments passed to this binary.
   const std::vector<std::string>& GetCommandlineArguments() const;
 
@@ -57,10 +64,21 @@ class BinaryLauncherBase {
   std::string Rlocation(const std::string& path,
                         bool need_workspace_name = true) const;
 
+  // Map runfile paths to their absolute paths, in order.
+  //
+  // Looks up all paths in one pass over the manifest file, which stops as
+  // soon as all of them are found.
+  std::vector<std::string> Rlocation(const std::vector<std::string>& paths,
+                                     bool need_workspace_name = true) const;
+
   // Lauch a process with given executable and command line arguments.
   // If --print_launcher_command exists in arguments, then we print the full
   // command line instead of launching the real process.
   //
+  // The process and its descendants run in a job object, and are terminated
+  // when it exits. If $LAUNCHER_STATS_FILE is set, the resource usage of the
+  // job is written there once the process exits.
+  //
   // exectuable: the binary to be executed.
   // arguments:  the command line arguments to be passed to the exectuable,
   //             it doesn't include the exectuable itself.
@@ -95,9 +113,6 @@ class BinaryLauncherBase {
   // The workspace name of the repository this target belongs to.
   const std::string workspace_name;
 
-  // A map to store all entries of the manifest file.
-  std::unordered_map<std::string, std::string> manifest_file_map;
-
   // If --print_launcher_command is presented in arguments,
   // then print the command line.
   //
@@ -121,9 +136,15 @@ class BinaryLauncherBase {
   // or 2. <path>/<to>/<binary>/<target_name>.runfiles_manifest
   static std::string FindManifestFile(const char* argv0);
 
-  // Parse manifest file into a map
-  static void ParseManifestFile(ManifestFileMap* manifest_file_map,
-                                const std::string& manifest_path);
+  // Look up the keys in the manifest file's content, in one pass that stops
+  // once every key is found, and store their targets in the same order.
+  //
+  // Rather than parsing the whole manifest file into a map on every launch,
+  // the launcher scans it for the few paths it needs, so the launch cost does
+  // not grow with the number of runfiles.
+  static void LookupManifest(const char* manifest, int64_t manifest_size,
+                             const std::vector<std::string>& keys,
+                             std::vector<std::string>* targets);
 };
 
 }  // namespace launcher
@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <windows.h>
+#include <algorithm>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -22,9 +25,90 @@ namespace bazel {
 namespace launcher {
 
 using std::string;
+using std::stringstream;
 using std::vector;
+using std::wstring;
 
 static constexpr const char* PYTHON_BIN_PATH = "python_bin_path";
+static constexpr const char* PYTHON_MAIN = "python_main";
+static constexpr const char* PYTHON_IMPORTS = "python_imports";
+static constexpr const char* PYTHON_IMPORT_ALL = "python_import_all";
+
+// Append the repository directories at the top of the runfiles directory to
+// `python_path`, as the stub script does when importing all repositories.
+static void AppendRepositoryDirs(const string& module_space,
+                                 string* python_path) {
+  WIN32_FIND_DATAW entry;
+  HANDLE handle = FindFirstFileW(
+      AsAbsoluteWindowsPath((module_space + "\\*").c_str()).c_str(), &entry);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  do {
+    wstring name(entry.cFileName);
+    if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
+        name != L"." && name != L"..") {
+      // Repository names are ASCII.
+      *python_path +=
+          ";" + module_space + "\\" + string(name.begin(), name.end());
+    }
+  } while (FindNextFileW(handle, &entry));
+  FindClose(handle);
+}
+
+bool PythonBinaryLauncher::SetUpDirectLaunch(string* main_file) {
+  string main, imports, import_all;
+  if (!GetLaunchInfoByKey(PYTHON_MAIN, &main) ||
+      !GetLaunchInfoByKey(PYTHON_IMPORTS, &imports) ||
+      !GetLaunchInfoByKey(PYTHON_IMPORT_ALL, &import_all)) {
+    return false;  // built by a Bazel that doesn't support it
+  }
+  // Like the stub script, use the runfiles directory of the binary this one
+  // is a data-dependency of, if any.
+  string module_space;
+  if (!GetEnv("RUNFILES_DIR", &module_space)) {
+    module_space = this->GetRunfilesPath();
+  }
+  std::replace(module_space.begin(), module_space.end(), '/', '\\');
+  std::replace(main.begin(), main.end(), '/', '\\');
+  *main_file = module_space + "\\" + main;
+  // Without a runfiles tree, e.g. with only a runfiles manifest, the import
+  // paths don't exist: only the zip has the modules then.
+  if (!DoesFilePathExist(main_file->c_str())) {
+    return false;
+  }
+
+  // The same import path as the stub script computes at startup.
+  string python_path = module_space;
+  string import;
+  stringstream imports_ss(imports);
+  while (getline(imports_ss, import, ';')) {
+    std::replace(import.begin(), import.end(), '/', '\\');
+    python_path += ";" + module_space + "\\" + import;
+  }
+  if (import_all == "1") {
+    AppendRepositoryDirs(module_space, &python_path);
+  } else {
+    python_path +=
+        ";" + module_space + "\\" + this->GetLaunchInfoByKey(WORKSPACE_NAME);
+  }
+  string old_python_path;
+  if (GetEnv("PYTHONPATH", &old_python_path)) {
+    python_path += ";" + old_python_path;
+  }
+  SetEnv("PYTHONPATH", python_path);
+
+  // The stub script runs the main file from the workspace directory in this
+  // case, so that the data files are accessible.
+  string run_under_runfiles;
+  if (GetEnv("RUN_UNDER_RUNFILES", &run_under_runfiles) &&
+      run_under_runfiles == "1") {
+    string workspace_dir =
+        module_space + "\\" + this->GetLaunchInfoByKey(WORKSPACE_NAME);
+    SetCurrentDirectoryW(AsAbsoluteWindowsPath(workspace_dir.c_str()).c_str());
+  }
+  return true;
+}
 
 ExitCode PythonBinaryLauncher::Launch() {
   string python_binary = this->GetLaunchInfoByKey(PYTHON_BIN_PATH);
@@ -35,10 +119,15 @@ ExitCode PythonBinaryLauncher::Launch() {
   }
 
   vector<string> args = this->GetCommandlineArguments();
-  string python_zip_file = GetBinaryPathWithoutExtension(args[0]) + ".zip";
-
-  // Replace the first argument with python zip file path
-  args[0] = python_zip_file;
+  // Run the main file directly if the runfiles tree is there: then the stub
+  // script in the zip file need not extract the zip file to find the modules.
+  string main_file;
+  if (SetUpDirectLaunch(&main_file)) {
+    args[0] = GetEscapedArgument(main_file, /*escape_backslash = */ false);
+  } else {
+    // Replace the first argument with python zip file path
+    args[0] = GetBinaryPathWithoutExtension(args[0]) + ".zip";
+  }
 
   // Escape arguments that has spaces
   for (int i = 1; i < args.size(); i++) {
@@ -15,6 +15,8 @@
 #ifndef BAZEL_SRC_TOOLS_LAUNCHER_PYTHON_LAUNCHER_H_
 #define BAZEL_SRC_TOOLS_LAUNCHER_PYTHON_LAUNCHER_H_
 
+#include <string>
+
 #include "src/tools/launcher/launcher.h"
 
 namespace bazel {
@@ -26,6 +28,14 @@ class PythonBinaryLauncher : public BinaryLauncherBase {
                        int argc, char* argv[])
       : BinaryLauncherBase(launch_info, argc, argv){}
   ExitCode Launch();
+
+ private:
+  // Prepare to run the main file of the binary from the runfiles tree, with
+  // the import path in the launch data, rather than the python zip file.
+  //
+  // Return true and store the path of the main file in main_file if the launch
+  // data has the import path and the runfiles tree exists.
+  bool SetUpDirectLaunch(std::string* main_file);
 };
 
 }  // namespace launcher
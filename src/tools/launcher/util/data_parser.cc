@@ -12,8 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <fstream>
-#include <memory>
+#include <string.h>
+#include <windows.h>
+
 #include <string>
 #include <unordered_map>
 
@@ -23,24 +24,7 @@
 namespace bazel {
 namespace launcher {
 
-using std::ifstream;
-using std::ios;
-using std::make_unique;
 using std::string;
-using std::unique_ptr;
-
-int64_t LaunchDataParser::ReadDataSize(ifstream* binary) {
-  int64_t data_size;
-  binary->seekg(0 - sizeof(data_size), ios::end);
-  binary->read(reinterpret_cast<char*>(&data_size), sizeof(data_size));
-  return data_size;
-}
-
-void LaunchDataParser::ReadLaunchData(ifstream* binary, char* launch_data,
-                                      int64_t data_size) {
-  binary->seekg(0 - data_size - sizeof(data_size), ios::end);
-  binary->read(launch_data, data_size);
-}
 
 bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
                                        const char* launch_data,
@@ -49,14 +33,14 @@ bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
   start = 0;
   while (start < data_size) {
     // Move start to point to the next non-null character.
-    while (launch_data[start] == '\0' && start < data_size) {
+    while (start < data_size && launch_data[start] == '\0') {
       start++;
     }
     // Move end to the next null character or end of the string,
     // also find the first equal symbol appears.
     end = start;
     equal = -1;
-    while (launch_data[end] != '\0' && end < data_size) {
+    while (end < data_size && launch_data[end] != '\0') {
       if (equal == -1 && launch_data[end] == '=') {
         equal = end;
       }
@@ -86,19 +70,35 @@ bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
 
 bool LaunchDataParser::GetLaunchInfo(const string& binary_path,
                                      LaunchInfo* launch_info) {
-  unique_ptr<ifstream> binary =
-      make_unique<ifstream>(binary_path, ios::binary | ios::in);
-  int64_t data_size = ReadDataSize(binary.get());
+  // The launch data is parsed in place from a read-only view of the binary,
+  // rather than copied out of it. Only its last pages are ever read.
+  const char* binary;
+  int64_t binary_size;
+  if (!MapFile(binary_path, &binary, &binary_size)) {
+    PrintError("Cannot read %s: %s", binary_path.c_str(),
+               GetLastErrorString().c_str());
+    return false;
+  }
+  // The last 64 bits of the binary are the size of the launch data before it.
+  int64_t data_size = 0;
+  if (binary_size >= static_cast<int64_t>(sizeof(data_size))) {
+    memcpy(&data_size, binary + binary_size - sizeof(data_size),
+           sizeof(data_size));
+  }
+  int64_t data_end = binary_size - sizeof(data_size);
+  bool ok = false;
   if (data_size == 0) {
     PrintError("No data appended, cannot launch anything!");
-    return false;
+  } else if (data_size < 0 || data_size > data_end) {
+    PrintError("Launch data of %s is corrupted", binary_path.c_str());
+  } else {
+    ok = ParseLaunchData(launch_info, binary + data_end - data_size,
+                         data_size);
   }
-  unique_ptr<char[]> launch_data(new char[data_size]);
-  ReadLaunchData(binary.get(), launch_data.get(), data_size);
-  if (!ParseLaunchData(launch_info, launch_data.get(), data_size)) {
-    return false;
+  if (binary != nullptr) {
+    UnmapViewOfFile(binary);
   }
-  return true;
+  return ok;
 }
 
 }  // namespace launcher
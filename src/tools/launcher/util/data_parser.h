@@ -15,8 +15,8 @@
 #ifndef BAZEL_SRC_TOOLS_LAUNCHER_UTIL_DATA_PARSER_H_
 #define BAZEL_SRC_TOOLS_LAUNCHER_UTIL_DATA_PARSER_H_
 
-#include <fstream>
-#include <memory>
+#include <stdint.h>
+
 #include <string>
 #include <unordered_map>
 
@@ -32,13 +32,6 @@ class LaunchDataParser {
                             LaunchInfo* launch_info);
 
  private:
-  // Read the last 64 bit from the given binary to get the data size
-  static int64_t ReadDataSize(std::ifstream* binary);
-
-  // Read launch data at the end of the given binary into a buffer
-  static void ReadLaunchData(std::ifstream* binary, char* launch_data,
-                             int64_t data_size);
-
   // Parse the launch data into a map
   static bool ParseLaunchData(LaunchInfo* launch_info, const char* launch_data,
                               int64_t data_size);
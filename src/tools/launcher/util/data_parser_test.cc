@@ -185,5 +185,24 @@ TEST_F(LaunchDataParserTest, NoEqualSignLaunchInfoTest) {
                "LAUNCHER ERROR: Cannot find equal symbol in line: foo2bar2");
 }
 
+TEST_F(LaunchDataParserTest, CorruptedDataSizeLaunchInfoTest) {
+  string binary_file = test_tmpdir + "/corrupted_binary_file";
+  {
+    ofstream binary_file_stream(binary_file, ios::out | ios::binary);
+    binary_file_stream << "foo=bar";
+    binary_file_stream.put('\0');
+    int64_t data_size = 100;
+    binary_file_stream.write(reinterpret_cast<char*>(&data_size),
+                             sizeof(data_size));
+  }
+
+  parsed_launch_info = make_unique<LaunchDataParser::LaunchInfo>();
+  // ASSERT_DEATH requires TEMP environment variable to be set.
+  // Otherwise, it will try to write to C:/Windows, then fails.
+  // A workaround in Bazel is to use --action_env to set TEMP.
+  ASSERT_DEATH(ParseBinaryFile(binary_file, parsed_launch_info.get()),
+               "LAUNCHER ERROR: Launch data of .* is corrupted");
+}
+
 }  // namespace launcher
 }  // namespace bazel
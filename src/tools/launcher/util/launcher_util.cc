@@ -96,6 +96,32 @@ bool DoesDirectoryPathExist(const char* path) {
           (dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
 }
 
+bool MapFile(const string& path, const char** data, int64_t* size) {
+  HANDLE file = CreateFileW(AsAbsoluteWindowsPath(path.c_str()).c_str(),
+                            GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER file_size;
+  file_size.QuadPart = 0;
+  bool ok = GetFileSizeEx(file, &file_size) != FALSE;
+  *data = nullptr;
+  *size = file_size.QuadPart;
+  if (ok && *size > 0) {
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL) {
+      *data = static_cast<const char*>(
+          MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+      // The view keeps the mapping and the file open.
+      CloseHandle(mapping);
+    }
+    ok = *data != nullptr;
+  }
+  CloseHandle(file);
+  return ok;
+}
+
 bool DeleteFileByPath(const char* path) {
   return DeleteFileW(AsAbsoluteWindowsPath(path).c_str());
 }
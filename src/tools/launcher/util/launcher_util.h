@@ -17,6 +17,8 @@
 
 #define PRINTF_ATTRIBUTE(string_index, first_to_check)
 
+#include <stdint.h>
+
 #include <string>
 
 namespace bazel {
@@ -58,6 +60,13 @@ bool DoesFilePathExist(const char* path);
 // Check if a directory exists at a given path.
 bool DoesDirectoryPathExist(const char* path);
 
+// Map the file at a given path read-only into memory.
+//
+// Return true if succeeded, and store the address of the first byte of the
+// file in data and its size in size. An empty file is not mapped: data is then
+// nullptr. Otherwise, release the view with UnmapViewOfFile.
+bool MapFile(const std::string& path, const char** data, int64_t* size);
+
 // Delete a file at a given path.
 bool DeleteFileByPath(const char* path);
 
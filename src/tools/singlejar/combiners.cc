@@ -13,6 +13,11 @@
 // limitations under the License.
 
 #include "src/tools/singlejar/combiners.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "src/tools/singlejar/crc32.h"
 #include "src/tools/singlejar/diag.h"
 
 Combiner::~Combiner() {}
@@ -28,10 +33,8 @@ bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
   if (Z_NO_COMPRESSION == lh->compression_method()) {
     buffer_->ReadEntryContents(lh);
   } else if (Z_DEFLATED == lh->compression_method()) {
-    if (!inflater_.get()) {
-      inflater_.reset(new Inflater());
-    }
-    buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
+    InflaterPool::Ptr inflater = InflaterPool::Get();
+    buffer_->DecompressEntryContents(cdh, lh, inflater.get());
   } else {
     errx(2, "%s is neither stored nor deflated", filename_.c_str());
   }
@@ -111,6 +114,172 @@ void *Concatenator::OutputEntry(bool compress) {
   return reinterpret_cast<void *>(lh);
 }
 
+StreamingConcatenator::~StreamingConcatenator() {
+  if (spill_file_) {
+    fclose(spill_file_);
+  }
+}
+
+bool StreamingConcatenator::Merge(const CDH *cdh, const LH *lh) {
+  if (!spill_file_) {
+    if (!concatenator_.Merge(cdh, lh)) {
+      return false;
+    }
+    if (concatenator_.data_size() > memory_limit_) {
+      Spill();
+    }
+    return true;
+  }
+  // Separate the entries with a newline, as Concatenator does.
+  if (uncompressed_size_ && '\n' != last_byte_) {
+    StreamBytes(reinterpret_cast<const uint8_t *>("\n"), 1);
+  }
+  Concatenator entry(filename(), false);
+  if (!entry.Merge(cdh, lh)) {
+    return false;
+  }
+  if (entry.contents()) {
+    Stream(*entry.contents());
+  }
+  return true;
+}
+
+void StreamingConcatenator::Spill() {
+  spill_file_ = tmpfile();
+  if (spill_file_ == nullptr) {
+    diag_err(1, "%s:%d: cannot create temporary file for %s", __FILE__,
+             __LINE__, filename().c_str());
+  }
+  if (compress_) {
+    deflater_ = DeflaterPool::Get();
+  }
+  Stream(*concatenator_.contents());
+  concatenator_.Clear();
+}
+
+void StreamingConcatenator::Stream(const TransientBytes &bytes) {
+  bytes.stream_out([this](const void *chunk, uint64_t chunk_size) {
+    StreamBytes(reinterpret_cast<const uint8_t *>(chunk), chunk_size);
+  });
+}
+
+void StreamingConcatenator::StreamBytes(const uint8_t *data, uint64_t size) {
+  if (size == 0) {
+    return;
+  }
+  last_byte_ = data[size - 1];
+  uncompressed_size_ += size;
+  crc_ = Crc32(crc_, data, size);
+  if (!deflater_) {
+    WriteSpill(data, size);
+    return;
+  }
+  uint8_t buffer[64 << 10];
+  while (size > 0) {
+    // zlib cannot take more than 4GB-1 bytes at once.
+    uint32_t chunk_size = static_cast<uint32_t>(
+        std::min(size, static_cast<uint64_t>(0x40000000)));
+    deflater_->next_in = const_cast<uint8_t *>(data);
+    deflater_->avail_in = chunk_size;
+    do {
+      deflater_->next_out = buffer;
+      deflater_->avail_out = sizeof(buffer);
+      int ret = deflate(deflater_.get(), Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
+                  deflater_->msg);
+      }
+      WriteSpill(buffer, sizeof(buffer) - deflater_->avail_out);
+    } while (deflater_->avail_out == 0);
+    data += chunk_size;
+    size -= chunk_size;
+  }
+}
+
+void StreamingConcatenator::WriteSpill(const uint8_t *data, size_t size) {
+  if (fwrite(data, 1, size, spill_file_) != size) {
+    diag_err(1, "%s:%d: cannot write temporary file for %s", __FILE__,
+             __LINE__, filename().c_str());
+  }
+  spilled_size_ += size;
+}
+
+void StreamingConcatenator::FinishSpill() {
+  if (deflater_) {
+    uint8_t buffer[64 << 10];
+    deflater_->next_in = nullptr;
+    deflater_->avail_in = 0;
+    int ret;
+    do {
+      deflater_->next_out = buffer;
+      deflater_->avail_out = sizeof(buffer);
+      ret = deflate(deflater_.get(), Z_FINISH);
+      if (ret != Z_OK && ret != Z_STREAM_END) {
+        diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
+                  deflater_->msg);
+      }
+      WriteSpill(buffer, sizeof(buffer) - deflater_->avail_out);
+    } while (ret != Z_STREAM_END);
+    deflater_.reset();
+  }
+  if (fflush(spill_file_)) {
+    diag_err(1, "%s:%d: cannot write temporary file for %s", __FILE__,
+             __LINE__, filename().c_str());
+  }
+}
+
+void *StreamingConcatenator::SpilledEntryHeader() {
+  FinishSpill();
+  // OutputJar cannot write Zip64 combined entries yet.
+  if (ziph::zfield_needs_ext64(uncompressed_size_) ||
+      ziph::zfield_needs_ext64(spilled_size_)) {
+    diag_errx(1, "%s:%d: %s is too large (%" PRIu64 " bytes)", __FILE__,
+              __LINE__, filename().c_str(), uncompressed_size_);
+  }
+  const std::string &name = filename();
+  LH *lh = reinterpret_cast<LH *>(malloc(sizeof(LH) + name.size()));
+  if (lh == nullptr) {
+    return nullptr;
+  }
+  lh->signature();
+  lh->version(20);
+  lh->bit_flag(0x0);
+  lh->last_mod_file_time(1);   // 00:00:01
+  lh->last_mod_file_date(33);  // 1980-01-01
+  lh->crc32(crc_);
+  lh->compressed_file_size32(spilled_size_);
+  lh->uncompressed_file_size32(uncompressed_size_);
+  lh->file_name(name.c_str(), name.size());
+  lh->extra_fields(nullptr, 0);
+  lh->compression_method(compress_ ? Z_DEFLATED : Z_NO_COMPRESSION);
+  return lh;
+}
+
+int StreamingConcatenator::spill_fd() const { return fileno(spill_file_); }
+
+void *StreamingConcatenator::OutputEntry(bool compress) {
+  if (!spill_file_) {
+    return concatenator_.OutputEntry(compress);
+  }
+  if (compress != compress_) {
+    diag_errx(1, "%s:%d: %s has been %s", __FILE__, __LINE__,
+              filename().c_str(), compress_ ? "compressed" : "stored");
+  }
+  LH *header = reinterpret_cast<LH *>(SpilledEntryHeader());
+  size_t header_size = header->size();
+  LH *lh = reinterpret_cast<LH *>(realloc(header, header_size + spilled_size_));
+  if (lh == nullptr) {
+    free(header);
+    return nullptr;
+  }
+  if (fseek(spill_file_, 0, SEEK_SET) ||
+      fread(lh->data(), 1, spilled_size_, spill_file_) != spilled_size_) {
+    diag_err(1, "%s:%d: cannot read temporary file for %s", __FILE__,
+             __LINE__, filename().c_str());
+  }
+  return lh;
+}
+
 NullCombiner::~NullCombiner() {}
 
 bool NullCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
@@ -127,39 +296,95 @@ bool XmlCombiner::Merge(const CDH *cdh, const LH *lh) {
     concatenator_->Append(start_tag_);
     concatenator_->Append("\n");
   }
-  // To ensure xml concatentation is idempotent, read in the entry being added
-  // and remove the start and end tags if they are present.
-  TransientBytes bytes_;
-  if (Z_NO_COMPRESSION == lh->compression_method()) {
-    bytes_.ReadEntryContents(lh);
-  } else if (Z_DEFLATED == lh->compression_method()) {
-    if (!inflater_.get()) {
-      inflater_.reset(new Inflater());
+  // To ensure xml concatentation is idempotent, remove the start and end tags
+  // of the entry being added if they are present. The entry is inflated and
+  // appended chunk by chunk, holding back only the bytes that might be a tag.
+  pending_.clear();
+  at_entry_start_ = true;
+  if (Z_NO_COMPRESSION == cdh->compression_method()) {
+    AppendChunk(reinterpret_cast<const char *>(lh->data()),
+                cdh->uncompressed_file_size());
+  } else if (Z_DEFLATED == cdh->compression_method()) {
+    if (ziph::zfield_needs_ext64(cdh->compressed_file_size())) {
+      errx(2, "%s is too large", filename_.c_str());
     }
-    bytes_.DecompressEntryContents(cdh, lh, inflater_.get());
+    InflaterPool::Ptr inflater = InflaterPool::Get();
+    inflater->DataToInflate(lh->data(), cdh->compressed_file_size());
+    uint8_t buffer[64 << 10];
+    int ret;
+    do {
+      ret = inflater->Inflate(buffer, sizeof(buffer));
+      if (ret != Z_OK && ret != Z_STREAM_END) {
+        errx(2, "%s: inflate error %d(%s)", filename_.c_str(), ret,
+             inflater->error_message());
+      }
+      AppendChunk(reinterpret_cast<const char *>(buffer),
+                  sizeof(buffer) - inflater->available_out());
+    } while (ret != Z_STREAM_END);
   } else {
     errx(2, "%s is neither stored nor deflated", filename_.c_str());
   }
-  uint32_t checksum;
-  char *buf = reinterpret_cast<char *>(malloc(bytes_.data_size()));
-  // TODO(b/37631490): optimize this to avoid copying the bytes twice
-  bytes_.CopyOut(reinterpret_cast<uint8_t *>(buf), &checksum);
-  int start_offset = 0;
-  if (strncmp(buf, start_tag_.c_str(), start_tag_.length()) == 0) {
-    start_offset = start_tag_.length();
-  }
-  uint64_t end = bytes_.data_size();
-  while (end >= end_tag_.length() && std::isspace(buf[end - 1])) end--;
-  if (strncmp(buf + end - end_tag_.length(), end_tag_.c_str(),
-              end_tag_.length()) == 0) {
-    end -= end_tag_.length();
+  FinishEntry();
+  return true;
+}
+
+void XmlCombiner::AppendChunk(const char *data, size_t size) {
+  if (at_entry_start_) {
+    pending_.append(data, size);
+    if (pending_.size() < start_tag_.size()) {
+      return;
+    }
+    if (pending_.compare(0, start_tag_.size(), start_tag_) == 0) {
+      pending_.erase(0, start_tag_.size());
+    }
+    at_entry_start_ = false;
+    data = pending_.data();
+    size = 0;
+  }
+
+  // Everything but the trailing whitespace and the end_tag_.size() bytes
+  // preceding it can be appended.
+  size_t keep = size;
+  while (keep > 0 && std::isspace(data[keep - 1])) {
+    --keep;
+  }
+  if (keep > end_tag_.size()) {
+    concatenator_->Append(pending_.data(), pending_.size());
+    concatenator_->Append(data, keep - end_tag_.size());
+    pending_.assign(data + keep - end_tag_.size(), size - keep + end_tag_.size());
+    return;
+  }
+  // The cut is within the bytes held back.
+  pending_.append(data, size);
+  keep = pending_.size();
+  while (keep > 0 && std::isspace(pending_[keep - 1])) {
+    --keep;
+  }
+  if (keep > end_tag_.size()) {
+    concatenator_->Append(pending_.data(), keep - end_tag_.size());
+    pending_.erase(0, keep - end_tag_.size());
+  }
+}
+
+void XmlCombiner::FinishEntry() {
+  if (at_entry_start_ &&
+      pending_.compare(0, start_tag_.size(), start_tag_) == 0) {
+    pending_.erase(0, start_tag_.size());
+  }
+  at_entry_start_ = false;
+  size_t end = pending_.size();
+  while (end >= end_tag_.size() && std::isspace(pending_[end - 1])) {
+    --end;
+  }
+  if (end >= end_tag_.size() &&
+      pending_.compare(end - end_tag_.size(), end_tag_.size(), end_tag_) == 0) {
+    end -= end_tag_.size();
   } else {
     // Leave trailing whitespace alone if we didn't find a match.
-    end = bytes_.data_size();
+    end = pending_.size();
   }
-  concatenator_->Append(buf + start_offset, end - start_offset);
-  free(buf);
-  return true;
+  concatenator_->Append(pending_.data(), end);
+  pending_.clear();
 }
 
 void *XmlCombiner::OutputEntry(bool compress) {
@@ -176,3 +401,73 @@ PropertyCombiner::~PropertyCombiner() {}
 bool PropertyCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
   return false;  // This should not be called.
 }
+
+void *PropertyCombiner::OutputEntry(bool compress) {
+  Concatenator concatenator(filename_, false);
+  for (auto &line : lines_) {
+    concatenator.Append(line);
+    concatenator.Append("\n", 1);
+  }
+  return concatenator.OutputEntry(compress);
+}
+
+void PropertyCombiner::AddLine(const std::string &key,
+                               const std::string &line) {
+  auto got = key_lines_.emplace(key, lines_.size());
+  if (got.second) {
+    lines_.push_back(line);
+  } else {
+    lines_[got.first->second] = line;
+  }
+}
+
+// The syntax is that of java.util.Properties.load(): a logical line may be
+// continued with a backslash at the end, the key ends at the first unescaped
+// '=', ':' or whitespace, and the lines starting with '#' or '!' are
+// comments.
+void PropertyCombiner::AddProperties(const char *data, size_t size) {
+  const char *end = data + size;
+  while (data < end) {
+    // Find the end of the logical line.
+    const char *line_end = data;
+    while (true) {
+      while (line_end < end && *line_end != '\n' && *line_end != '\r') {
+        ++line_end;
+      }
+      size_t backslashes = 0;
+      while (line_end - backslashes > data &&
+             line_end[-1 - static_cast<ptrdiff_t>(backslashes)] == '\\') {
+        ++backslashes;
+      }
+      if (backslashes % 2 == 0 || line_end == end) {
+        break;
+      }
+      // Continued: skip the line terminator and go on.
+      if (*line_end == '\r' && line_end + 1 < end && line_end[1] == '\n') {
+        ++line_end;
+      }
+      ++line_end;
+    }
+    std::string line(data, line_end);
+    if (line_end < end && *line_end == '\r' && line_end + 1 < end &&
+        line_end[1] == '\n') {
+      ++line_end;
+    }
+    data = line_end < end ? line_end + 1 : end;
+
+    size_t key_start = line.find_first_not_of(" \t\f");
+    if (key_start == std::string::npos) {
+      continue;  // Blank line.
+    }
+    if (line[key_start] == '#' || line[key_start] == '!') {
+      lines_.push_back(line);
+      continue;
+    }
+    size_t key_end = key_start;
+    while (key_end < line.size() && !strchr("=: \t\f", line[key_end])) {
+      key_end += line[key_end] == '\\' ? 2 : 1;
+    }
+    AddLine(line.substr(key_start, std::min(key_end, line.size()) - key_start),
+            line);
+  }
+}
@@ -15,6 +15,8 @@
 #ifndef SRC_TOOLS_SINGLEJAR_COMBINERS_H_
 #define SRC_TOOLS_SINGLEJAR_COMBINERS_H_ 1
 
+#include <stdio.h>
+
 #include <map>
 #include <memory>
 #include <string>
@@ -62,6 +64,15 @@ class Concatenator : public Combiner {
 
   const std::string &filename() const { return filename_; }
 
+  // The number of bytes held.
+  uint64_t data_size() const { return buffer_ ? buffer_->data_size() : 0; }
+
+  // The bytes held, nullptr if there are none.
+  const TransientBytes *contents() const { return buffer_.get(); }
+
+  // Drops the bytes held.
+  void Clear() { buffer_.reset(); }
+
  private:
   void CreateBuffer() {
     if (!buffer_.get()) {
@@ -70,10 +81,67 @@ class Concatenator : public Combiner {
   }
   const std::string filename_;
   std::unique_ptr<TransientBytes> buffer_;
-  std::unique_ptr<Inflater> inflater_;
   bool insert_newlines_;
 };
 
+// A Concatenator with bounded memory usage. Until the contents exceed
+// `memory_limit' bytes, it is the same as Concatenator. Then the contents,
+// along with everything merged into it afterwards, is streamed (deflated if
+// `compress' is set) to a temporary file, so that only the entry being merged
+// is held in memory. In this spilled state, the entry can be written out
+// without reading it back into memory: see SpilledEntryHeader() and
+// spill_fd().
+class StreamingConcatenator : public Combiner {
+ public:
+  StreamingConcatenator(const std::string &filename, bool compress,
+                        uint64_t memory_limit)
+      : concatenator_(filename),
+        compress_(compress),
+        memory_limit_(memory_limit),
+        spill_file_(nullptr),
+        crc_(0),
+        uncompressed_size_(0),
+        spilled_size_(0),
+        last_byte_(0) {}
+
+  ~StreamingConcatenator() override;
+
+  bool Merge(const CDH *cdh, const LH *lh) override;
+
+  // If the contents has been spilled, reads it back into memory, so `compress'
+  // has to be the same as the one given to the constructor.
+  void *OutputEntry(bool compress) override;
+
+  const std::string &filename() const { return concatenator_.filename(); }
+
+  // True if the contents has been spilled to a temporary file.
+  bool spilled() const { return spill_file_ != nullptr; }
+
+  // Completes the spilled entry. Returns the Local Header (without payload)
+  // for it, the caller is responsible of freeing it. The payload consists of
+  // the first spilled_size() bytes of spill_fd().
+  void *SpilledEntryHeader();
+  int spill_fd() const;
+  uint64_t spilled_size() const { return spilled_size_; }
+
+ private:
+  void Spill();
+  void Stream(const TransientBytes &bytes);
+  void StreamBytes(const uint8_t *data, uint64_t size);
+  void WriteSpill(const uint8_t *data, size_t size);
+  void FinishSpill();
+
+  Concatenator concatenator_;
+  const bool compress_;
+  const uint64_t memory_limit_;
+  FILE *spill_file_;
+  DeflaterPool::Ptr deflater_;
+  uint32_t crc_;
+  uint64_t uncompressed_size_;
+  uint64_t spilled_size_;
+  uint8_t last_byte_;
+};
+
 // The combiner that does nothing. Useful to represent for instance directory
 // entries: once a directory entry has been created and added to the output
 // jar, the subsequent entries are ignored on input, and nothing is output.
@@ -91,7 +159,8 @@ class XmlCombiner : public Combiner {
   XmlCombiner(const std::string &filename, const std::string &xml_tag)
       : filename_(filename),
         start_tag_("<" + xml_tag + ">"),
-        end_tag_("</" + xml_tag + ">") {}
+        end_tag_("</" + xml_tag + ">"),
+        at_entry_start_(true) {}
   ~XmlCombiner() override;
 
   bool Merge(const CDH *cdh, const LH *lh) override;
@@ -101,39 +170,55 @@ class XmlCombiner : public Combiner {
   const std::string filename() const { return filename_; }
 
  private:
+  // Appends the next chunk of the entry being merged, holding back the bytes
+  // which may belong to its start or end tag.
+  void AppendChunk(const char *data, size_t size);
+  // Appends the rest of the entry being merged, without the tags.
+  void FinishEntry();
+
   const std::string filename_;
   const std::string start_tag_;
   const std::string end_tag_;
   std::unique_ptr<Concatenator> concatenator_;
-  std::unique_ptr<Inflater> inflater_;
+  std::string pending_;  // The bytes held back.
+  bool at_entry_start_;  // The start tag has not been checked for yet.
 };
 
-// A wrapper around Concatenator allowing to append
+// Creates a properties file from
 //   NAME=VALUE
-// lines to the contents.
+// lines. A property set more than once keeps its first position and its
+// last value. The comments are kept, too.
 // NOTE that it does not allow merging existing entries.
-class PropertyCombiner : public Concatenator {
+class PropertyCombiner : public Combiner {
  public:
-  PropertyCombiner(const std::string &filename) : Concatenator(filename) {}
-  ~PropertyCombiner();
+  PropertyCombiner(const std::string &filename) : filename_(filename) {}
+  ~PropertyCombiner() override;
 
   bool Merge(const CDH *cdh, const LH *lh) override;
 
+  void *OutputEntry(bool compress) override;
+
   void AddProperty(const char *key, const char *value) {
-    // TODO(asmundak): deduplicate properties.
-    Append(key);
-    Append("=", 1);
-    Append(value);
-    Append("\n", 1);
+    AddProperty(std::string(key), std::string(value));
   }
 
   void AddProperty(const std::string &key, const std::string &value) {
-    // TODO(asmundak): deduplicate properties.
-    Append(key);
-    Append("=", 1);
-    Append(value);
-    Append("\n", 1);
+    AddLine(key, key + "=" + value);
   }
+
+  // Adds the properties from the contents of a properties file (or a part
+  // of it consisting of the whole lines).
+  void AddProperties(const char *data, size_t size);
+
+  const std::string &filename() const { return filename_; }
+
+ private:
+  // Adds the line (without the line terminator) defining the given key.
+  void AddLine(const std::string &key, const std::string &line);
+
+  const std::string filename_;
+  std::vector<std::string> lines_;
+  std::unordered_map<std::string, size_t> key_lines_;  // Index in lines_.
 };
 
 #endif  //  SRC_TOOLS_SINGLEJAR_COMBINERS_H_
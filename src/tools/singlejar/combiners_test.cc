@@ -132,6 +132,85 @@ TEST_F(CombinersTest, ConcatenatorHuge) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// Test StreamingConcatenator below the memory limit: same as Concatenator.
+TEST_F(CombinersTest, StreamingConcatenatorSmall) {
+  InputJar input_jar;
+  StreamingConcatenator concatenator("concat", true, 1 << 20);
+  ASSERT_TRUE(input_jar.Open("combiners.zip"));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    if (cdh->file_name_is("tag1.xml") || cdh->file_name_is("tag2.xml")) {
+      ASSERT_TRUE(concatenator.Merge(cdh, lh));
+    }
+  }
+  EXPECT_FALSE(concatenator.spilled());
+
+  LH *entry = reinterpret_cast<LH *>(concatenator.OutputEntry(false));
+  EXPECT_TRUE(entry->is());
+  EXPECT_EQ(Z_NO_COMPRESSION, entry->compression_method());
+  EXPECT_EQ(
+      kConcatenatedContents,
+      std::string(reinterpret_cast<char *>(entry->data()),
+                  entry->uncompressed_file_size()));
+  EXPECT_TRUE(entry->file_name_is("concat"));
+  free(reinterpret_cast<void *>(entry));
+}
+
+// Test StreamingConcatenator exceeding the memory limit, with and without
+// compression.
+TEST_F(CombinersTest, StreamingConcatenatorSpilled) {
+  const uint32_t kCrc = crc32(
+      0, reinterpret_cast<const uint8_t *>(kConcatenatedContents),
+      strlen(kConcatenatedContents));
+  for (bool compress : {true, false}) {
+    InputJar input_jar;
+    StreamingConcatenator concatenator("concat", compress, 1);
+    ASSERT_TRUE(input_jar.Open("combiners.zip"));
+    const LH *lh;
+    const CDH *cdh;
+    while ((cdh = input_jar.NextEntry(&lh))) {
+      if (cdh->file_name_is("tag1.xml") || cdh->file_name_is("tag2.xml")) {
+        ASSERT_TRUE(concatenator.Merge(cdh, lh));
+        EXPECT_TRUE(concatenator.spilled());
+      }
+    }
+
+    // The header and the payload in the temporary file.
+    LH *header = reinterpret_cast<LH *>(concatenator.SpilledEntryHeader());
+    ASSERT_NE(nullptr, header);
+    EXPECT_TRUE(header->is());
+    EXPECT_EQ(20, header->version());
+    EXPECT_EQ(compress ? Z_DEFLATED : Z_NO_COMPRESSION,
+              header->compression_method());
+    EXPECT_EQ(kCrc, header->crc32());
+    EXPECT_EQ(strlen(kConcatenatedContents), header->uncompressed_file_size());
+    EXPECT_EQ(concatenator.spilled_size(), header->compressed_file_size());
+    EXPECT_TRUE(header->file_name_is("concat"));
+    EXPECT_EQ(0, header->extra_fields_length());
+    free(reinterpret_cast<void *>(header));
+
+    // The whole entry in memory.
+    LH *entry = reinterpret_cast<LH *>(concatenator.OutputEntry(compress));
+    ASSERT_NE(nullptr, entry);
+    uint64_t original_size = entry->uncompressed_file_size();
+    ASSERT_EQ(strlen(kConcatenatedContents), original_size);
+    uint8_t buffer[256];
+    memset(buffer, kPoison, sizeof(buffer));
+    if (compress) {
+      Inflater inflater;
+      inflater.DataToInflate(entry->data(), entry->compressed_file_size());
+      ASSERT_EQ(Z_STREAM_END, inflater.Inflate(buffer, sizeof(buffer)));
+    } else {
+      memcpy(buffer, entry->data(), original_size);
+    }
+    EXPECT_EQ(kPoison, buffer[original_size]);
+    EXPECT_EQ(kConcatenatedContents,
+              std::string(reinterpret_cast<char *>(buffer), original_size));
+    free(reinterpret_cast<void *>(entry));
+  }
+}
+
 // Test NullCombiner.
 TEST_F(CombinersTest, NullCombiner) {
   NullCombiner null_combiner;
@@ -194,6 +273,40 @@ TEST_F(CombinersTest, XmlCombiner) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// XmlCombiner strips the top level tags of the entries it merges, including
+// the large ones which are inflated in several chunks.
+TEST_F(CombinersTest, XmlCombinerStripsTags) {
+  std::string big_body;
+  for (int i = 0; big_body.size() < 200000; ++i) {
+    big_body += "<item>" + std::to_string(i * 7919 % 100003) + "</item>\n";
+  }
+  ASSERT_TRUE(CreateFile(
+      "big.xml", ("<toplevel>" + big_body + "</toplevel>\n \n").c_str()));
+  ASSERT_TRUE(CreateFile("small.xml", "<toplevel><a/></toplevel>"));
+  ASSERT_TRUE(CreateFile("untagged.xml", "<b/>  \n"));
+  ASSERT_EQ(0, system("zip -q xml_tags.zip big.xml small.xml untagged.xml"));
+  ASSERT_EQ(0,
+            system("zip -qm0 xml_tags0.zip big.xml small.xml untagged.xml"));
+
+  for (bool compressed_input : {true, false}) {
+    InputJar input_jar;
+    XmlCombiner xml_combiner("combined.xml", "toplevel");
+    ASSERT_TRUE(input_jar.Open(compressed_input ? "xml_tags.zip"
+                                                : "xml_tags0.zip"));
+    const LH *lh;
+    const CDH *cdh;
+    while ((cdh = input_jar.NextEntry(&lh))) {
+      ASSERT_TRUE(xml_combiner.Merge(cdh, lh));
+    }
+    LH *entry = reinterpret_cast<LH *>(xml_combiner.OutputEntry(false));
+    ASSERT_NE(nullptr, entry);
+    EXPECT_EQ("<toplevel>\n" + big_body + "<a/><b/>  \n</toplevel>\n",
+              std::string(reinterpret_cast<char *>(entry->data()),
+                          entry->uncompressed_file_size()));
+    free(reinterpret_cast<void *>(entry));
+  }
+}
+
 // Test PropertyCombiner.
 TEST_F(CombinersTest, PropertyCombiner) {
   static char kProperties[] =
@@ -246,4 +359,35 @@ TEST_F(CombinersTest, PropertyCombiner) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// PropertyCombiner keeps the first position and the last value of a property
+// set more than once.
+TEST_F(CombinersTest, PropertyCombinerDeduplicates) {
+  PropertyCombiner property_combiner("properties");
+  property_combiner.AddProperty("name", "value1");
+  const char kProperties[] =
+      "# A comment\n"
+      "\n"
+      "other = value2\r\n"
+      "name=value3\n"
+      "multi: line1 \\\n"
+      "   line2\n"
+      "esc\\=aped=value4\n"
+      "other=value5";
+  property_combiner.AddProperties(kProperties, strlen(kProperties));
+  property_combiner.AddProperty("esc\\=aped", "value6");
+
+  LH *entry = reinterpret_cast<LH *>(property_combiner.OutputEntry(false));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(
+      "name=value3\n"
+      "# A comment\n"
+      "other=value5\n"
+      "multi: line1 \\\n"
+      "   line2\n"
+      "esc\\=aped=value6\n",
+      std::string(reinterpret_cast<char *>(entry->data()),
+                  entry->uncompressed_file_size()));
+  free(reinterpret_cast<void *>(entry));
+}
+
 }  // anonymous namespace
@@ -0,0 +1,164 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/crc32.h"
+
+#include <limits.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SINGLEJAR_CRC32_PCLMUL 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define SINGLEJAR_CRC32_ARMV8 1
+#include <arm_acle.h>
+#include <string.h>
+#endif
+
+#include <zlib.h>
+
+// zlib's crc32() takes the length as uInt.
+static uint32_t ZlibCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    uInt chunk = size > UINT_MAX ? UINT_MAX : static_cast<uInt>(size);
+    crc = crc32(crc, data, chunk);
+    data += chunk;
+    size -= chunk;
+  }
+  return crc;
+}
+
+#if defined(SINGLEJAR_CRC32_PCLMUL)
+
+// Folds 'size' bytes (at least 64, a multiple of 16) into the bit-reflected
+// CRC register value 'crc' (that is, the inverted CRC-32), using the method
+// described in "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+// Instruction" by V. Gopal et al., Intel 2009. The constants are the powers
+// of x modulo the CRC-32 polynomial given in the paper.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t FoldPclmul(
+    uint32_t crc, const uint8_t *data, size_t size) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  const __m128i *p = reinterpret_cast<const __m128i *>(data);
+
+  // Fold 64 bytes at a time into four 128-bit accumulators.
+  __m128i x1 = _mm_loadu_si128(p + 0);
+  __m128i x2 = _mm_loadu_si128(p + 1);
+  __m128i x3 = _mm_loadu_si128(p + 2);
+  __m128i x4 = _mm_loadu_si128(p + 3);
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+  p += 4;
+  size -= 64;
+  while (size >= 64) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(p + 0));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(p + 1));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(p + 2));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(p + 3));
+    p += 4;
+    size -= 64;
+  }
+
+  // Fold the four accumulators into one.
+  __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // Fold the remaining 16-byte blocks.
+  while (size >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(p)), x5);
+    ++p;
+    size -= 16;
+  }
+
+  // Fold 128 bits to 64 bits.
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits.
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static bool HasPclmul() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+  static const bool has_pclmul = HasPclmul();
+  if (has_pclmul && size >= 64) {
+    size_t chunk = size & ~static_cast<size_t>(15);
+    crc = ~FoldPclmul(~crc, data, chunk);
+    data += chunk;
+    size -= chunk;
+  }
+  return size ? ZlibCrc32(crc, data, size) : crc;
+}
+
+const char *Crc32Implementation() {
+  return HasPclmul() ? "pclmul" : "zlib";
+}
+
+#elif defined(SINGLEJAR_CRC32_ARMV8)
+
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+  crc = ~crc;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc = __crc32d(crc, word);
+  }
+  for (; size > 0; ++data, --size) {
+    crc = __crc32b(crc, *data);
+  }
+  return ~crc;
+}
+
+const char *Crc32Implementation() { return "armv8"; }
+
+#else
+
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+  return ZlibCrc32(crc, data, size);
+}
+
+const char *Crc32Implementation() { return "zlib"; }
+
+#endif
@@ -0,0 +1,34 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_CRC32_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_CRC32_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Updates the running Zip (IEEE 802.3) CRC-32 checksum with the given bytes.
+ * The result is the same as that of zlib's crc32(crc, data, size), but it is
+ * computed with the carry-less multiplication (PCLMULQDQ) instructions on
+ * x86-64 CPUs which have them, and with the CRC32 instructions on ARMv8
+ * targets built with them enabled. Falls back to zlib otherwise.
+ */
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size);
+
+// The name of the implementation Crc32() uses on this machine ("pclmul",
+// "armv8" or "zlib").
+const char *Crc32Implementation();
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_CRC32_H_
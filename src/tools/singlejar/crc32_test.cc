@@ -0,0 +1,72 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "src/tools/singlejar/crc32.h"
+#include "googletest/include/gtest/gtest.h"
+
+#include <zlib.h>
+
+namespace {
+
+TEST(Crc32Test, KnownValue) {
+  fprintf(stderr, "Using %s\n", Crc32Implementation());
+  const char kData[] = "123456789";
+  EXPECT_EQ(0xCBF43926,
+            Crc32(0, reinterpret_cast<const uint8_t *>(kData), 9));
+  EXPECT_EQ(0, Crc32(0, nullptr, 0));
+}
+
+// Compare against zlib for all the sizes around the block boundaries of
+// the accelerated implementations, at different alignments and with
+// different initial values.
+TEST(Crc32Test, SameAsZlib) {
+  std::vector<uint8_t> data(1 << 16);
+  srand(42);
+  for (auto &byte : data) {
+    byte = static_cast<uint8_t>(rand());
+  }
+  for (size_t size = 0; size < 600; ++size) {
+    for (size_t offset = 0; offset < 8; ++offset) {
+      uint32_t initial = size * 8 + offset;
+      ASSERT_EQ(crc32(initial, data.data() + offset, size),
+                Crc32(initial, data.data() + offset, size))
+          << "size " << size << ", offset " << offset;
+    }
+  }
+  EXPECT_EQ(crc32(0, data.data(), data.size()),
+            Crc32(0, data.data(), data.size()));
+}
+
+// Checksum computed piecewise is the same as computed at once.
+TEST(Crc32Test, Incremental) {
+  std::vector<uint8_t> data(100000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+  }
+  uint32_t crc = 0;
+  for (size_t pos = 0, chunk = 1; pos < data.size(); chunk = chunk * 3 + 1) {
+    size_t size = std::min(chunk, data.size() - pos);
+    crc = Crc32(crc, data.data() + pos, size);
+    pos += size;
+  }
+  EXPECT_EQ(Crc32(0, data.data(), data.size()), crc);
+}
+
+}  // namespace
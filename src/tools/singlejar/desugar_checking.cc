@@ -22,10 +22,8 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
   if (Z_NO_COMPRESSION == lh->compression_method()) {
     buffer_->ReadEntryContents(lh);
   } else if (Z_DEFLATED == lh->compression_method()) {
-    if (!inflater_.get()) {
-      inflater_.reset(new Inflater());
-    }
-    buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
+    InflaterPool::Ptr inflater = InflaterPool::Get();
+    buffer_->DecompressEntryContents(cdh, lh, inflater.get());
   } else {
     errx(2, "META-INF/desugar_deps is neither stored nor deflated");
   }
@@ -62,19 +60,19 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
                                 missing.origin().binary_name());
   }
 
+  std::vector<uint32_t> extended;
   for (const auto &extends : deps_info.interface_with_supertypes()) {
     // Remember interface hierarchy the first time we see this interface, drop
     // subsequent ones for consistency with how singlejar will keep the first
     // occurrence of the file defining the interface.  We'll lazily derive
     // whether missing_interfaces_ inherit default methods with this data later.
     if (extends.extended_interface_size() > 0) {
-      std::vector<std::string> extended;
-      extended.reserve(extends.extended_interface_size());
+      extended.clear();
       for (const auto &itf : extends.extended_interface()) {
-        extended.push_back(itf.binary_name());
+        extended.push_back(InterfaceId(itf.binary_name()));
       }
-      extended_interfaces_.emplace(extends.origin().binary_name(),
-                                   std::move(extended));
+      SetExtendedInterfaces(InterfaceId(extends.origin().binary_name()),
+                            extended);
     }
   }
 
@@ -83,7 +81,8 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
     // For all other interfaces we'll transitively check extended interfaces
     // in HasDefaultMethods.
     if (companion.num_default_methods() > 0) {
-      has_default_methods_[companion.origin().binary_name()] = true;
+      interfaces_[InterfaceId(companion.origin().binary_name())]
+          .default_methods = kDefaultMethods;
     }
   }
   return true;
@@ -93,9 +92,15 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
   if (verbose_) {
     fprintf(stderr, "Needed deps: %lu\n", needed_deps_.size());
     fprintf(stderr, "Interfaces to check: %lu\n", missing_interfaces_.size());
-    fprintf(stderr, "Sub-interfaces: %lu\n", extended_interfaces_.size());
+    size_t sub_interfaces = 0;
+    size_t with_default_methods = 0;
+    for (const auto &info : interfaces_) {
+      sub_interfaces += info.has_supertypes;
+      with_default_methods += info.default_methods == kDefaultMethods;
+    }
+    fprintf(stderr, "Sub-interfaces: %lu\n", sub_interfaces);
     fprintf(stderr, "Interfaces w/ default methods: %lu\n",
-            has_default_methods_.size());
+            with_default_methods);
   }
   for (auto needed : needed_deps_) {
     if (verbose_) {
@@ -131,23 +136,81 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
   return nullptr;
 }
 
-bool Java8DesugarDepsChecker::HasDefaultMethods(
+uint32_t Java8DesugarDepsChecker::InterfaceId(
     const std::string &interface_name) {
-  auto cached = has_default_methods_.find(interface_name);
-  if (cached != has_default_methods_.end()) {
-    return cached->second;
+  auto it = interface_ids_.find(interface_name);
+  if (it != interface_ids_.end()) {
+    return it->second;
   }
+  uint32_t id = interfaces_.size();
+  interface_ids_.emplace(interface_name, id);
+  interfaces_.emplace_back();
+  return id;
+}
 
-  // Prime with false in case there's a cycle.  We'll update with the true value
-  // (ignoring the cycle) below.
-  has_default_methods_.emplace(interface_name, false);
+void Java8DesugarDepsChecker::SetExtendedInterfaces(
+    uint32_t interface_id, const std::vector<uint32_t> &extended_ids) {
+  InterfaceInfo &info = interfaces_[interface_id];
+  if (info.has_supertypes) {
+    return;
+  }
+  info.has_supertypes = true;
+  info.extended_begin = extended_ids_.size();
+  info.extended_count = extended_ids.size();
+  extended_ids_.insert(extended_ids_.end(), extended_ids.begin(),
+                       extended_ids.end());
+}
 
-  for (const std::string &extended : extended_interfaces_[interface_name]) {
-    if (HasDefaultMethods(extended)) {
-      has_default_methods_[interface_name] = true;
-      return true;
+// A depth-first search for an interface with default methods among the
+// given one and the interfaces it extends, transitively.  If one is found,
+// every interface on the path to it has default methods, too.  If none is,
+// then none of the visited interfaces has them.  Either way the results are
+// cached, so every interface is only looked at once per lookup that cannot
+// be answered from the cache.  Cycles (which shouldn't happen) are ignored.
+bool Java8DesugarDepsChecker::HasDefaultMethods(uint32_t interface_id) {
+  if (interfaces_[interface_id].default_methods != kUnknown) {
+    return interfaces_[interface_id].default_methods == kDefaultMethods;
+  }
+  visited_.resize(interfaces_.size());
+  visited_[interface_id] = true;
+  visited_ids_.push_back(interface_id);
+  // The path from interface_id, with the index of the next extended
+  // interface to look at for each node on it.
+  stack_.emplace_back(interface_id, 0);
+  bool found = false;
+  while (!stack_.empty()) {
+    const InterfaceInfo &info = interfaces_[stack_.back().first];
+    if (stack_.back().second == info.extended_count) {
+      stack_.pop_back();
+      continue;
+    }
+    uint32_t extended =
+        extended_ids_[info.extended_begin + stack_.back().second++];
+    if (visited_[extended] ||
+        interfaces_[extended].default_methods == kNoDefaultMethods) {
+      continue;
+    }
+    if (interfaces_[extended].default_methods == kDefaultMethods) {
+      found = true;
+      break;
+    }
+    visited_[extended] = true;
+    visited_ids_.push_back(extended);
+    stack_.emplace_back(extended, 0);
+  }
+
+  if (found) {
+    for (const auto &node : stack_) {
+      interfaces_[node.first].default_methods = kDefaultMethods;
+    }
+  }
+  for (uint32_t id : visited_ids_) {
+    if (!found) {
+      interfaces_[id].default_methods = kNoDefaultMethods;
     }
+    visited_[id] = false;
   }
-  has_default_methods_[interface_name] = false;
-  return false;
+  visited_ids_.clear();
+  stack_.clear();
+  return found;
 }
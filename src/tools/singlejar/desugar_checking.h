@@ -15,10 +15,13 @@
 #ifndef SRC_TOOLS_SINGLEJAR_DESUGAR_CHECKING_H_
 #define SRC_TOOLS_SINGLEJAR_DESUGAR_CHECKING_H_ 1
 
+#include <stdint.h>
+
 #include <functional>
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "src/tools/singlejar/combiners.h"
@@ -57,26 +60,60 @@ class Java8DesugarDepsChecker : public Combiner {
   /// Computes and caches whether the given interface has default methods.
   /// \param interface_name interface name as it would appear in bytecode, e.g.,
   ///        "java/lang/Runnable"
-  bool HasDefaultMethods(const std::string &interface_name);
+  bool HasDefaultMethods(const std::string &interface_name) {
+    return HasDefaultMethods(InterfaceId(interface_name));
+  }
+  bool HasDefaultMethods(uint32_t interface_id);
+
+  /// Returns the index of the given interface in interfaces_, adding it if
+  /// it is not there yet.
+  uint32_t InterfaceId(const std::string &interface_name);
+  /// Records the interfaces the given one extends, unless they are known.
+  void SetExtendedInterfaces(uint32_t interface_id,
+                             const std::vector<uint32_t> &extended_ids);
 
   const std::function<bool (const std::string&)> known_member_;
   const bool verbose_;
   const bool fail_on_error_;  // For testing
 
   std::unique_ptr<TransientBytes> buffer_;
-  std::unique_ptr<Inflater> inflater_;
   /// Reverse mapping from needed dependencies to one of the users.
   std::map<std::string, std::string> needed_deps_;
   /// Reverse mapping from missing interfaces to one of the classes that missed
   /// them.
   std::map<std::string, std::string> missing_interfaces_;
-  std::unordered_map<std::string, std::vector<std::string> >
-      extended_interfaces_;
-  /// Cache of interfaces known to definitely define or inherit default methods
-  /// or definitely not define and not inherit default methods.  Merge()
-  /// populates initial entries and HasDefaultMethods() adds to the cache as
-  /// needed.
-  std::unordered_map<std::string, bool> has_default_methods_;
+
+  /// What is known about an interface.
+  enum DefaultMethods : uint8_t {
+    kUnknown,
+    kNoDefaultMethods,
+    kDefaultMethods,
+  };
+  struct InterfaceInfo {
+    InterfaceInfo()
+        : extended_begin(0),
+          extended_count(0),
+          has_supertypes(false),
+          default_methods(kUnknown) {}
+    // The interfaces it extends, in extended_ids_.
+    uint32_t extended_begin;
+    uint32_t extended_count;
+    bool has_supertypes;
+    /// Merge() sets kDefaultMethods for the interfaces that define default
+    /// methods, HasDefaultMethods() caches the results of the lookups.
+    DefaultMethods default_methods;
+  };
+  /// Interned interface names and the interface graph: every interface is
+  /// identified by its index in interfaces_, and the extended interfaces of
+  /// all of them are stored back to back in extended_ids_, in the order they
+  /// are declared.
+  std::unordered_map<std::string, uint32_t> interface_ids_;
+  std::vector<InterfaceInfo> interfaces_;
+  std::vector<uint32_t> extended_ids_;
+  /// HasDefaultMethods() scratch space.
+  std::vector<bool> visited_;
+  std::vector<uint32_t> visited_ids_;
+  std::vector<std::pair<uint32_t, uint32_t> > stack_;
   bool error_;
 
   friend class Java8DesugarDepsCheckerTest;
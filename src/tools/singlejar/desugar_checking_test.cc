@@ -23,15 +23,42 @@
 // Tests are instance methods to avoid gUnit dep in .h file.
 class Java8DesugarDepsCheckerTest : public ::testing::Test {
  protected:
+  static void SetHasDefaultMethods(Java8DesugarDepsChecker *checker,
+                                   const std::string &interface_name) {
+    checker->interfaces_[checker->InterfaceId(interface_name)]
+        .default_methods = Java8DesugarDepsChecker::kDefaultMethods;
+  }
+
+  static void SetExtendedInterfaces(
+      Java8DesugarDepsChecker *checker, const std::string &interface_name,
+      const std::vector<std::string> &extended_names) {
+    std::vector<uint32_t> extended;
+    for (const auto &name : extended_names) {
+      extended.push_back(checker->InterfaceId(name));
+    }
+    checker->SetExtendedInterfaces(checker->InterfaceId(interface_name),
+                                   extended);
+  }
+
+  // Whether the checker has cached that the interface does not have
+  // default methods.
+  static bool CachedNoDefaultMethods(Java8DesugarDepsChecker *checker,
+                                     const std::string &interface_name) {
+    auto it = checker->interface_ids_.find(interface_name);
+    return it != checker->interface_ids_.end() &&
+           checker->interfaces_[it->second].default_methods ==
+               Java8DesugarDepsChecker::kNoDefaultMethods;
+  }
+
   static void TestHasDefaultMethods() {
     Java8DesugarDepsChecker checker([](const std::string &) { return false; },
                                     /*verbose=*/false);
-    checker.has_default_methods_["a"] = true;
-    checker.extended_interfaces_["c"] = {"b", "a"};
+    SetHasDefaultMethods(&checker, "a");
+    SetExtendedInterfaces(&checker, "c", {"b", "a"});
 
     // Induce cycle (shouldn't happen but make sure we don't crash)
-    checker.extended_interfaces_["d"] = {"e"};
-    checker.extended_interfaces_["e"] = {"d", "a"};
+    SetExtendedInterfaces(&checker, "d", {"e"});
+    SetExtendedInterfaces(&checker, "e", {"d", "a"});
 
     EXPECT_TRUE(checker.HasDefaultMethods("a"));
     EXPECT_FALSE(checker.HasDefaultMethods("b"));
@@ -40,6 +67,20 @@ class Java8DesugarDepsCheckerTest : public ::testing::Test {
     EXPECT_FALSE(checker.error_);
   }
 
+  // An interface on a cycle is not cached as having no default methods just
+  // because the lookup that reached it was still in progress.
+  static void TestHasDefaultMethodsCycle() {
+    Java8DesugarDepsChecker checker([](const std::string &) { return false; },
+                                    /*verbose=*/false);
+    SetHasDefaultMethods(&checker, "a");
+    SetExtendedInterfaces(&checker, "d", {"e", "a"});
+    SetExtendedInterfaces(&checker, "e", {"d"});
+
+    EXPECT_TRUE(checker.HasDefaultMethods("d"));
+    EXPECT_FALSE(CachedNoDefaultMethods(&checker, "e"));
+    EXPECT_TRUE(checker.HasDefaultMethods("e"));  // Through d
+  }
+
   static void TestOutputEntry() {
     bool checkedA = false;
     Java8DesugarDepsChecker checker(
@@ -48,19 +89,19 @@ class Java8DesugarDepsCheckerTest : public ::testing::Test {
           return binary_name == "a$$CC.class";
         },
         /*verbose=*/false);
-    checker.has_default_methods_["a"] = true;
-    checker.extended_interfaces_["b"] = {"c", "d"};
-    checker.extended_interfaces_["c"] = {"e"};
+    SetHasDefaultMethods(&checker, "a");
+    SetExtendedInterfaces(&checker, "b", {"c", "d"});
+    SetExtendedInterfaces(&checker, "c", {"e"});
     checker.needed_deps_["a$$CC.class"] = "f";
     checker.missing_interfaces_["b"] = "g";
     EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
     EXPECT_TRUE(checkedA);
 
     // Make sure we checked b and its extended interfaces for default methods
-    EXPECT_FALSE(checker.has_default_methods_.at("b"));  // should be cached
-    EXPECT_FALSE(checker.has_default_methods_.at("c"));  // should be cached
-    EXPECT_FALSE(checker.has_default_methods_.at("d"));  // should be cached
-    EXPECT_FALSE(checker.has_default_methods_.at("e"));  // should be cached
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "b"));  // should be cached
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "c"));  // should be cached
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "d"));  // should be cached
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "e"));  // should be cached
     EXPECT_FALSE(checker.error_);
   }
 
@@ -77,8 +118,8 @@ class Java8DesugarDepsCheckerTest : public ::testing::Test {
     Java8DesugarDepsChecker checker([](const std::string &) { return true; },
                                     /*verbose=*/false,
                                     /*fail_on_error=*/false);
-    checker.has_default_methods_["b"] = true;
-    checker.extended_interfaces_["a"] = {"b", "a"};
+    SetHasDefaultMethods(&checker, "b");
+    SetExtendedInterfaces(&checker, "a", {"b", "a"});
     checker.missing_interfaces_["a"] = "g";
     EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
     EXPECT_TRUE(checker.error_);
@@ -89,6 +130,10 @@ TEST_F(Java8DesugarDepsCheckerTest, HasDefaultMethods) {
   TestHasDefaultMethods();
 }
 
+TEST_F(Java8DesugarDepsCheckerTest, HasDefaultMethodsCycle) {
+  TestHasDefaultMethodsCycle();
+}
+
 TEST_F(Java8DesugarDepsCheckerTest, OutputEntry) {
   TestOutputEntry();
 }
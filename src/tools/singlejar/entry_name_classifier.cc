@@ -0,0 +1,91 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/entry_name_classifier.h"
+
+#include <algorithm>
+
+EntryNameClassifier::EntryNameClassifier(
+    const std::vector<std::string> &include_prefixes,
+    const std::vector<std::string> &nocompress_suffixes,
+    const std::vector<std::string> &page_align_suffixes)
+    : all_included_(include_prefixes.empty()) {
+  for (auto &prefix : include_prefixes) {
+    prefixes_.Add(prefix, kIncluded, false);
+  }
+  prefixes_.Add("META-INF/services/", kService, false);
+  prefixes_.Add("j$/", kDesugarLib, false);
+
+  for (auto &suffix : nocompress_suffixes) {
+    suffixes_.Add(suffix, kNoCompress, true);
+  }
+  for (auto &suffix : page_align_suffixes) {
+    suffixes_.Add(suffix, kNoCompress | kPageAlign, true);
+  }
+  suffixes_.Add(".SF", kSignature, true);
+  suffixes_.Add(".RSA", kSignature, true);
+  suffixes_.Add(".DSA", kSignature, true);
+  suffixes_.Add(".class", kClass, true);
+}
+
+uint32_t EntryNameClassifier::Classify(const char *name, size_t length) const {
+  uint32_t classes = prefixes_.Match(name, length, false) |
+                     suffixes_.Match(name, length, true);
+  return all_included_ ? classes | kIncluded : classes;
+}
+
+void EntryNameClassifier::Trie::Add(const std::string &pattern,
+                                    uint32_t classes, bool reversed) {
+  uint32_t node = 0;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    uint8_t byte = pattern[reversed ? pattern.size() - 1 - i : i];
+    uint32_t next = Child(node, byte);
+    if (next == 0) {
+      next = nodes_.size();
+      auto &children = nodes_[node].children;
+      children.insert(
+          std::lower_bound(children.begin(), children.end(),
+                           std::make_pair(byte, static_cast<uint32_t>(0))),
+          std::make_pair(byte, next));
+      nodes_.emplace_back();
+    }
+    node = next;
+  }
+  nodes_[node].classes |= classes;
+}
+
+uint32_t EntryNameClassifier::Trie::Match(const char *name, size_t length,
+                                          bool reversed) const {
+  uint32_t classes = nodes_[0].classes;
+  uint32_t node = 0;
+  for (size_t i = 0; i < length; ++i) {
+    node = Child(node, name[reversed ? length - 1 - i : i]);
+    if (node == 0) {
+      break;
+    }
+    classes |= nodes_[node].classes;
+  }
+  return classes;
+}
+
+// Returns the child of the node for the given byte, or 0 (the root, which
+// is nobody's child) if there is none.
+uint32_t EntryNameClassifier::Trie::Child(uint32_t node, uint8_t byte) const {
+  for (auto &child : nodes_[node].children) {
+    if (child.first >= byte) {
+      return child.first == byte ? child.second : 0;
+    }
+  }
+  return 0;
+}
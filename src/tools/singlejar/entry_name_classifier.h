@@ -0,0 +1,91 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_CLASSIFIER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_CLASSIFIER_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Tells which of the name patterns singlejar cares about a jar entry name
+ * matches: the --include_prefixes, --nocompress_suffixes and
+ * --page_align_suffixes given on the command line and the built-in ones (signature files, service files, etc.).
+ * All the prefixes are kept in a trie and all the suffixes in a trie of the
+ * reversed strings, so the cost of Classify() depends on the length of the
+ * name rather than on the number of patterns.
+ */
+class EntryNameClassifier {
+ public:
+  // The bits of the Classify() result.
+  enum : uint32_t {
+    kIncluded = 1,     // Starts with one of the include prefixes, if any.
+    kNoCompress = 2,   // Ends with one of the nocompress suffixes.
+    kService = 4,      // META-INF/services/...
+    kDesugarLib = 8,   // j$/... (desugar_jdk_libs)
+    kSignature = 16,   // *.SF, *.RSA, *.DSA
+    kClass = 32,       // *.class
+    kPageAlign = 64,   // Ends with one of the page align suffixes.
+  };
+
+  EntryNameClassifier()
+      : EntryNameClassifier(std::vector<std::string>(),
+                            std::vector<std::string>()) {}
+
+  // The names ending with one of the page align suffixes are also kNoCompress:
+  // only stored entries can be aligned.
+  EntryNameClassifier(const std::vector<std::string> &include_prefixes,
+                      const std::vector<std::string> &nocompress_suffixes,
+                      const std::vector<std::string> &page_align_suffixes =
+                          std::vector<std::string>());
+
+  // Returns the bitwise OR of the classes the name belongs to.
+  uint32_t Classify(const char *name, size_t length) const;
+  uint32_t Classify(const std::string &name) const {
+    return Classify(name.c_str(), name.size());
+  }
+
+ private:
+  // A byte trie whose nodes are tagged with the classes of the patterns
+  // ending at them.
+  class Trie {
+   public:
+    Trie() : nodes_(1) {}
+    void Add(const std::string &pattern, uint32_t classes, bool reversed);
+    // Returns the classes of all the patterns the name starts with (or ends
+    // with, if `reversed').
+    uint32_t Match(const char *name, size_t length, bool reversed) const;
+
+   private:
+    struct Node {
+      Node() : classes(0) {}
+      uint32_t classes;
+      // Sorted by the byte. Most nodes have a single child.
+      std::vector<std::pair<uint8_t, uint32_t> > children;
+    };
+    uint32_t Child(uint32_t node, uint8_t byte) const;
+
+    std::vector<Node> nodes_;
+  };
+
+  Trie prefixes_;
+  Trie suffixes_;
+  bool all_included_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_CLASSIFIER_H_
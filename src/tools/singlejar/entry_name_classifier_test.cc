@@ -0,0 +1,93 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/entry_name_classifier.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+typedef EntryNameClassifier C;
+
+TEST(EntryNameClassifierTest, BuiltIn) {
+  EntryNameClassifier classifier;
+  EXPECT_EQ(C::kIncluded, classifier.Classify("foo/Bar.java"));
+  EXPECT_EQ(C::kIncluded | C::kClass, classifier.Classify("foo/Bar.class"));
+  EXPECT_EQ(C::kIncluded | C::kSignature,
+            classifier.Classify("META-INF/FOO.SF"));
+  EXPECT_EQ(C::kIncluded | C::kSignature,
+            classifier.Classify("META-INF/FOO.RSA"));
+  EXPECT_EQ(C::kIncluded | C::kSignature,
+            classifier.Classify("META-INF/FOO.DSA"));
+  EXPECT_EQ(C::kIncluded | C::kService,
+            classifier.Classify("META-INF/services/foo.Bar"));
+  EXPECT_EQ(C::kIncluded | C::kDesugarLib | C::kClass,
+            classifier.Classify("j$/util/Optional.class"));
+  EXPECT_EQ(C::kIncluded, classifier.Classify("META-INF/services"));
+  EXPECT_EQ(C::kIncluded, classifier.Classify(".clas"));
+  EXPECT_EQ(C::kIncluded, classifier.Classify(""));
+}
+
+TEST(EntryNameClassifierTest, PrefixesAndSuffixes) {
+  EntryNameClassifier classifier({"com/", "org/foo", "org/foobar/"},
+                                 {".png", ".so", "o"});
+  EXPECT_EQ(C::kIncluded, classifier.Classify("com/Foo.java"));
+  EXPECT_EQ(C::kIncluded | C::kClass, classifier.Classify("org/foo.class"));
+  EXPECT_EQ(C::kIncluded | C::kNoCompress,
+            classifier.Classify("org/foobar/pic.png"));
+  EXPECT_EQ(C::kIncluded | C::kNoCompress, classifier.Classify("com/lib.so"));
+  EXPECT_EQ(C::kNoCompress, classifier.Classify("net/foo"));
+  EXPECT_EQ(0, classifier.Classify("net/pic.pn"));
+  EXPECT_EQ(C::kService, classifier.Classify("META-INF/services/foo.Bar"));
+  EXPECT_EQ(0, classifier.Classify("cm"));
+  EXPECT_EQ(0, classifier.Classify(""));
+
+  // The names do not have to be zero-terminated.
+  EXPECT_EQ(C::kIncluded | C::kNoCompress,
+            classifier.Classify("com/lib.soxxx", 10));
+}
+
+// An empty prefix includes everything, an empty suffix matches everything.
+TEST(EntryNameClassifierTest, EmptyPatterns) {
+  EntryNameClassifier classifier({""}, {""});
+  EXPECT_EQ(C::kIncluded | C::kNoCompress, classifier.Classify("foo"));
+  EXPECT_EQ(C::kIncluded | C::kNoCompress, classifier.Classify(""));
+}
+
+// The page aligned entries are also stored.
+TEST(EntryNameClassifierTest, PageAlignSuffixes) {
+  EntryNameClassifier classifier({}, {".png"}, {".so"});
+  EXPECT_EQ(C::kIncluded | C::kNoCompress | C::kPageAlign,
+            classifier.Classify("lib/arm64-v8a/libfoo.so"));
+  EXPECT_EQ(C::kIncluded | C::kNoCompress, classifier.Classify("pic.png"));
+  EXPECT_EQ(C::kIncluded, classifier.Classify("libfoo.so.txt"));
+}
+
+TEST(EntryNameClassifierTest, ManyPrefixes) {
+  std::vector<std::string> prefixes;
+  for (int i = 0; i < 1000; ++i) {
+    prefixes.push_back("pkg" + std::to_string(i) + "/");
+  }
+  EntryNameClassifier classifier(prefixes, {});
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(C::kIncluded,
+              classifier.Classify("pkg" + std::to_string(i) + "/Foo.txt"));
+  }
+  EXPECT_EQ(0, classifier.Classify("pkg1000/Foo.txt"));
+  EXPECT_EQ(0, classifier.Classify("pkg1"));
+}
+
+}  // namespace
@@ -0,0 +1,161 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_TABLE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_TABLE_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * A hash table mapping archive entry names to values, tailored for the
+ * output jar, which looks up every entry of every input. It uses open
+ * addressing with linear probing, and keeps the names in an arena rather
+ * than in individual heap strings, so that looking up or inserting a name
+ * never allocates unless the table grows. The hash of a name can be computed
+ * beforehand (e.g., on the thread scanning the input jar) with Hash().
+ * Entries are never removed. The value pointers returned by the methods
+ * below remain valid only until the next insertion.
+ */
+template <class Value>
+class EntryNameTable {
+ public:
+  EntryNameTable()
+      : size_(0),
+        slots_(kInitialCapacity),
+        arena_next_(nullptr),
+        arena_left_(0) {}
+
+  // FNV-1a hash of the name.
+  static uint32_t Hash(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+      hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+    }
+    return hash;
+  }
+
+  // Returns the value for the given name, or nullptr if it is not present.
+  Value *Find(const char *name, size_t length, uint32_t hash) {
+    Slot &slot = Probe(name, length, hash);
+    return slot.name ? &slot.value : nullptr;
+  }
+  Value *Find(const std::string &name) {
+    return Find(name.data(), name.size(), Hash(name.data(), name.size()));
+  }
+
+  // Adds the name with the given value unless it is already present.
+  // Returns the value for the name and whether it has been added.
+  std::pair<Value *, bool> Emplace(const char *name, size_t length,
+                                   uint32_t hash, const Value &value) {
+    Slot *slot = &Probe(name, length, hash);
+    if (slot->name) {
+      return std::make_pair(&slot->value, false);
+    }
+    if (2 * (size_ + 1) > slots_.size()) {
+      Grow();
+      slot = &Probe(name, length, hash);
+    }
+    slot->name = Store(name, length);
+    slot->length = length;
+    slot->hash = hash;
+    slot->value = value;
+    ++size_;
+    return std::make_pair(&slot->value, true);
+  }
+  std::pair<Value *, bool> Emplace(const std::string &name,
+                                   const Value &value) {
+    return Emplace(name.data(), name.size(), Hash(name.data(), name.size()),
+                   value);
+  }
+
+  bool Contains(const std::string &name) { return Find(name) != nullptr; }
+  size_t size() const { return size_; }
+
+ private:
+  // Both are powers of 2.
+  static const size_t kInitialCapacity = 1024;
+  static const size_t kArenaChunkSize = 64 << 10;
+
+  struct Slot {
+    Slot() : name(nullptr), length(0), hash(0) {}
+    const char *name;  // Points to the arena, nullptr if the slot is free.
+    size_t length;
+    uint32_t hash;
+    Value value;
+  };
+
+  // Returns the slot holding the name, or the free slot where it belongs.
+  Slot &Probe(const char *name, size_t length, uint32_t hash) {
+    const size_t mask = slots_.size() - 1;
+    for (size_t ix = hash & mask;; ix = (ix + 1) & mask) {
+      Slot &slot = slots_[ix];
+      if (slot.name == nullptr ||
+          (slot.hash == hash && slot.length == length &&
+           !memcmp(slot.name, name, length))) {
+        return slot;
+      }
+    }
+  }
+
+  void Grow() {
+    std::vector<Slot> old_slots(2 * slots_.size());
+    old_slots.swap(slots_);
+    const size_t mask = slots_.size() - 1;
+    for (auto &old_slot : old_slots) {
+      if (old_slot.name) {
+        size_t ix = old_slot.hash & mask;
+        while (slots_[ix].name) {
+          ix = (ix + 1) & mask;
+        }
+        slots_[ix] = old_slot;
+      }
+    }
+  }
+
+  // Copies the name to the arena.
+  const char *Store(const char *name, size_t length) {
+    char *copy;
+    if (length > kArenaChunkSize / 4) {
+      // Do not waste the rest of the current chunk on a long name.
+      arena_.emplace_back(new char[length]);
+      copy = arena_.back().get();
+    } else {
+      if (arena_next_ == nullptr || length > arena_left_) {
+        arena_.emplace_back(new char[kArenaChunkSize]);
+        arena_next_ = arena_.back().get();
+        arena_left_ = kArenaChunkSize;
+      }
+      copy = arena_next_;
+      arena_next_ += length;
+      arena_left_ -= length;
+    }
+    memcpy(copy, name, length);
+    return copy;
+  }
+
+  size_t size_;
+  std::vector<Slot> slots_;
+  std::vector<std::unique_ptr<char[]> > arena_;
+  char *arena_next_;
+  size_t arena_left_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_NAME_TABLE_H_
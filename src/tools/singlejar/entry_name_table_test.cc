@@ -0,0 +1,67 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "src/tools/singlejar/entry_name_table.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(EntryNameTableTest, Emplace) {
+  EntryNameTable<int> table;
+  EXPECT_EQ(0, table.size());
+  EXPECT_FALSE(table.Contains("a"));
+
+  auto got = table.Emplace("a", 1);
+  EXPECT_TRUE(got.second);
+  EXPECT_EQ(1, *got.first);
+  got = table.Emplace("a", 2);
+  EXPECT_FALSE(got.second);
+  EXPECT_EQ(1, *got.first);
+  EXPECT_EQ(1, table.size());
+
+  // The name does not have to be a zero-terminated string.
+  const char kNames[] = "abc";
+  got = table.Emplace(kNames, 2, EntryNameTable<int>::Hash(kNames, 2), 3);
+  EXPECT_TRUE(got.second);
+  EXPECT_TRUE(table.Contains("ab"));
+  EXPECT_FALSE(table.Contains("abc"));
+
+  // Empty and long names are fine, too.
+  EXPECT_TRUE(table.Emplace("", 4).second);
+  std::string long_name(100000, 'x');
+  EXPECT_TRUE(table.Emplace(long_name, 5).second);
+  EXPECT_EQ(4, *table.Find(""));
+  EXPECT_EQ(5, *table.Find(long_name));
+  EXPECT_EQ(4, table.size());
+}
+
+TEST(EntryNameTableTest, Grow) {
+  const int kCount = 100000;
+  EntryNameTable<int> table;
+  for (int i = 0; i < kCount; ++i) {
+    ASSERT_TRUE(table.Emplace("entry" + std::to_string(i), i).second);
+  }
+  EXPECT_EQ(kCount, table.size());
+  for (int i = 0; i < kCount; ++i) {
+    int *value = table.Find("entry" + std::to_string(i));
+    ASSERT_NE(nullptr, value);
+    EXPECT_EQ(i, *value);
+  }
+  EXPECT_EQ(nullptr, table.Find("entry"));
+  EXPECT_EQ(nullptr, table.Find("entry" + std::to_string(kCount)));
+}
+
+}  // namespace
@@ -25,6 +25,33 @@ bool InputJar::Open(const std::string &path) {
     mapped_file_.Close();
     return false;
   }
+  return LocateCentralDirectory(path);
+}
+
+bool InputJar::Open(const std::string &name, int fd) {
+  if (!path_.empty()) {
+    diag_errx(1, "%s:%d: This instance is already handling %s\n", __FILE__,
+              __LINE__, path_.c_str());
+  }
+  if (!mapped_file_.Open(fd, name)) {
+    diag_warnx("%s:%d: Cannot open input jar %s", __FILE__, __LINE__,
+               name.c_str());
+    mapped_file_.Close();
+    return false;
+  }
+  return LocateCentralDirectory(name);
+}
+
+bool InputJar::Open(const std::string &name, const void *data, size_t size) {
+  if (!path_.empty()) {
+    diag_errx(1, "%s:%d: This instance is already handling %s\n", __FILE__,
+              __LINE__, path_.c_str());
+  }
+  mapped_file_.OpenMemory(data, size);
+  return LocateCentralDirectory(name);
+}
+
+bool InputJar::LocateCentralDirectory(const std::string &path) {
   if (mapped_file_.size() < sizeof(ECD)) {
     diag_warnx(
         "%s:%d: %s is only 0x%lx"
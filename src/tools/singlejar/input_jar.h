@@ -48,6 +48,13 @@ class InputJar {
   // Opens the file, memory maps it and locates Central Directory.
   bool Open(const std::string& path);
 
+  // The same for the jar read from the open file `fd`, which is not closed,
+  // or held in the `size` bytes at `data`, which are not copied and must
+  // outlive this instance. `name` stands for the path in the messages. A jar
+  // in memory has no fd().
+  bool Open(const std::string &name, int fd);
+  bool Open(const std::string &name, const void *data, size_t size);
+
   // Returns the next Central Directory Header or NULL.
   const CDH *NextEntry(const LH **local_header_ptr) {
     if (path_.empty()) {
@@ -92,7 +99,25 @@ class InputJar {
     return mapped_file_.address(0);
   }
 
+  size_t size() const { return mapped_file_.size(); }
+
+  // Starts reading `count' bytes at the given offset in the background.
+  void Prefetch(uint64_t offset, size_t count) const {
+    mapped_file_.Prefetch(offset, count);
+  }
+
+  // See MappedFile::AdviseSequential() and MappedFile::Release().
+  void AdviseSequential(uint64_t offset, size_t count) const {
+    mapped_file_.AdviseSequential(offset, count);
+  }
+  void Release(uint64_t offset, size_t count) const {
+    mapped_file_.Release(offset, count);
+  }
+
  private:
+  // Locates Central Directory in the just mapped jar.
+  bool LocateCentralDirectory(const std::string &path);
+
   std::string path_;
   MappedFile mapped_file_;
   const CDH *cdh_;  // current directory entry
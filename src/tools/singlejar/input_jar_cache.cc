@@ -0,0 +1,136 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/input_jar_cache.h"
+
+#include <sys/stat.h>
+
+#include "src/tools/singlejar/diag.h"
+
+bool IndexedInputJar::Open(const std::string &path) {
+  if (!input_jar.Open(path)) {
+    return false;
+  }
+  ReadEntries(path);
+  return true;
+}
+
+bool IndexedInputJar::Open(const std::string &name, int fd) {
+  if (!input_jar.Open(name, fd)) {
+    return false;
+  }
+  ReadEntries(name);
+  return true;
+}
+
+bool IndexedInputJar::Open(const std::string &name, const void *data,
+                           size_t size) {
+  if (!input_jar.Open(name, data, size)) {
+    return false;
+  }
+  ReadEntries(name);
+  return true;
+}
+
+void IndexedInputJar::ReadEntries(const std::string &name) {
+  const CDH *jar_entry;
+  const LH *lh;
+  while ((jar_entry = input_jar.NextEntry(&lh))) {
+    if (!jar_entry->file_name_length()) {
+      diag_errx(
+          1, "%s:%d: Bad central directory record in %s at offset 0x%" PRIx64,
+          __FILE__, __LINE__, name.c_str(),
+          input_jar.CentralDirectoryRecordOffset(jar_entry));
+    }
+    entries.emplace_back(jar_entry, lh);
+  }
+}
+
+bool InputJarCache::GetFileKey(const std::string &path, FileKey *key) {
+  struct stat st;
+  if (stat(path.c_str(), &st)) {
+    return false;
+  }
+  key->device = st.st_dev;
+  key->inode = st.st_ino;
+  key->size = st.st_size;
+#if defined(__APPLE__)
+  key->mtime_sec = st.st_mtimespec.tv_sec;
+  key->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+  key->mtime_sec = st.st_mtim.tv_sec;
+  key->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+std::shared_ptr<const IndexedInputJar> InputJarCache::Get(
+    const std::string &path) {
+  FileKey key;
+  if (!GetFileKey(path, &key)) {
+    diag_warn("%s:%d: Cannot open input jar %s", __FILE__, __LINE__,
+              path.c_str());
+    return nullptr;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      auto it = entries_.find(path);
+      if (it != entries_.end()) {
+        if (it->second.key == key) {
+          lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+          return it->second.jar;
+        }
+        // The file has changed.
+        lru_.erase(it->second.lru_position);
+        entries_.erase(it);
+      }
+      // Wait for the jar if another thread is opening it already, rather
+      // than opening it a second time.
+      if (opening_.insert(path).second) {
+        break;
+      }
+      opened_.wait(lock);
+    }
+  }
+
+  // Open the jar without holding the lock, so that the other threads can
+  // open theirs meanwhile.
+  std::shared_ptr<IndexedInputJar> jar(new IndexedInputJar);
+  bool ok = jar->Open(path);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  opening_.erase(path);
+  opened_.notify_all();
+  if (!ok) {
+    return nullptr;
+  }
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    lru_.erase(it->second.lru_position);
+    entries_.erase(it);
+  }
+  lru_.push_front(path);
+  entries_[path] = CacheEntry{key, jar, lru_.begin()};
+  while (lru_.size() > capacity_) {
+    entries_.erase(lru_.back());
+    lru_.pop_back();
+  }
+  return jar;
+}
+
+size_t InputJarCache::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
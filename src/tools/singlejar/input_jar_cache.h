@@ -0,0 +1,103 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_CACHE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_CACHE_H_ 1
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "src/tools/singlejar/input_jar.h"
+
+/*
+ * An open input jar along with the list of its entries, in the Central
+ * Directory order. Once opened, it is immutable, and thus can be shared by
+ * several threads.
+ */
+struct IndexedInputJar {
+  // Opens the jar and reads its Central Directory.
+  bool Open(const std::string &path);
+  // The same for a jar in an open file or in memory, see InputJar::Open().
+  bool Open(const std::string &name, int fd);
+  bool Open(const std::string &name, const void *data, size_t size);
+
+  // Reads the Central Directory of the open input_jar.
+  void ReadEntries(const std::string &name);
+
+  InputJar input_jar;
+  std::vector<std::pair<const CDH *, const LH *> > entries;
+};
+
+/*
+ * A cache of the recently used indexed input jars, allowing a long-running
+ * process (e.g., a persistent worker) to avoid reopening and rescanning the
+ * same input jars over and over. A cached jar is reused as long as the file
+ * it has been opened from has not changed, the least recently used jars are
+ * closed when there are more than `capacity' of them. Thread-safe: a jar
+ * requested by several threads at once is opened by one of them, the others
+ * wait for it.
+ */
+class InputJarCache {
+ public:
+  explicit InputJarCache(size_t capacity) : capacity_(capacity) {}
+
+  // Returns the indexed jar for the given path, or nullptr if it cannot be
+  // opened.
+  std::shared_ptr<const IndexedInputJar> Get(const std::string &path);
+
+  // The number of cached jars.
+  size_t size();
+
+ private:
+  // What we know about the file the jar has been opened from.
+  struct FileKey {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    bool operator==(const FileKey &other) const {
+      return device == other.device && inode == other.inode &&
+             size == other.size && mtime_sec == other.mtime_sec &&
+             mtime_nsec == other.mtime_nsec;
+    }
+  };
+  static bool GetFileKey(const std::string &path, FileKey *key);
+
+  struct CacheEntry {
+    FileKey key;
+    std::shared_ptr<const IndexedInputJar> jar;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  const size_t capacity_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, CacheEntry> entries_;
+  std::list<std::string> lru_;  // Most recently used first.
+  // The paths of the jars being opened, and the condition signaled when one
+  // of them is done.
+  std::unordered_set<std::string> opening_;
+  std::condition_variable opened_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_CACHE_H_
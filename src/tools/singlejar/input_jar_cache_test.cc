@@ -0,0 +1,114 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/tools/singlejar/input_jar_cache.h"
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using singlejar_test_util::CreateTextFile;
+using singlejar_test_util::OutputFilePath;
+using singlejar_test_util::RunCommand;
+
+// Creates a zip file with given name containing the given text files.
+std::string CreateZip(const std::string &zip_name,
+                      const std::vector<std::string> &files) {
+  std::string zip_path = OutputFilePath(zip_name);
+  unlink(zip_path.c_str());
+  for (auto &file : files) {
+    CreateTextFile(file, file.c_str());
+    EXPECT_EQ(0, RunCommand("cd", OutputFilePath("").c_str(), ";", "zip", "-m",
+                            zip_name.c_str(), file.c_str(), nullptr));
+  }
+  return zip_path;
+}
+
+TEST(InputJarCacheTest, ReusesUnchangedJars) {
+  std::string zip_path = CreateZip("cache1.zip", {"file1", "file2"});
+  InputJarCache cache(10);
+  auto jar = cache.Get(zip_path);
+  ASSERT_NE(nullptr, jar);
+  ASSERT_EQ(2, jar->entries.size());
+  EXPECT_EQ("file1", jar->entries[0].first->file_name_string());
+  EXPECT_EQ("file2", jar->entries[1].first->file_name_string());
+  EXPECT_EQ(jar, cache.Get(zip_path));
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST(InputJarCacheTest, ReopensChangedJars) {
+  std::string zip_path = CreateZip("cache2.zip", {"file1"});
+  InputJarCache cache(10);
+  auto jar = cache.Get(zip_path);
+  ASSERT_NE(nullptr, jar);
+  ASSERT_EQ(1, jar->entries.size());
+
+  CreateZip("cache2.zip", {"file1", "file2", "file3"});
+  auto new_jar = cache.Get(zip_path);
+  ASSERT_NE(nullptr, new_jar);
+  EXPECT_NE(jar, new_jar);
+  EXPECT_EQ(3, new_jar->entries.size());
+  // The jar handed out before is still valid.
+  EXPECT_EQ("file1", jar->entries[0].first->file_name_string());
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST(InputJarCacheTest, EvictsLeastRecentlyUsed) {
+  std::string zip1_path = CreateZip("cache3.zip", {"file1"});
+  std::string zip2_path = CreateZip("cache4.zip", {"file2"});
+  std::string zip3_path = CreateZip("cache5.zip", {"file3"});
+  InputJarCache cache(2);
+  auto jar1 = cache.Get(zip1_path);
+  auto jar2 = cache.Get(zip2_path);
+  EXPECT_EQ(jar1, cache.Get(zip1_path));
+  cache.Get(zip3_path);  // Evicts zip2.
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(jar1, cache.Get(zip1_path));
+  EXPECT_NE(jar2, cache.Get(zip2_path));
+}
+
+// A jar requested by several threads at once is opened once.
+TEST(InputJarCacheTest, ConcurrentGets) {
+  std::string zip_path = CreateZip("cache6.zip", {"file1", "file2"});
+  InputJarCache cache(2);
+  std::vector<std::shared_ptr<const IndexedInputJar> > jars(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < jars.size(); ++i) {
+    threads.emplace_back([&cache, &jars, &zip_path, i]() {
+      jars[i] = cache.Get(zip_path);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  ASSERT_NE(nullptr, jars[0]);
+  for (auto &jar : jars) {
+    EXPECT_EQ(jars[0], jar);
+  }
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST(InputJarCacheTest, MissingJar) {
+  InputJarCache cache(2);
+  EXPECT_EQ(nullptr, cache.Get(OutputFilePath("no_such.zip")));
+  EXPECT_EQ(0, cache.size());
+}
+
+}  // namespace
@@ -0,0 +1,70 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/jar_merger.h"
+
+#include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar_cache.h"
+
+JarMerger::JarMerger() {
+  // The same as singlejar_main.cc.
+  output_jar_.ExtraCombiner("META-INF/desugar_deps", new NullCombiner());
+  output_jar_.ExtraCombiner("reference.conf",
+                            new Concatenator("reference.conf"));
+}
+
+bool JarMerger::AddInputJar(const std::string &name, const void *data,
+                            size_t size) {
+  std::shared_ptr<IndexedInputJar> jar(new IndexedInputJar);
+  if (!jar->Open(name, data, size)) {
+    return false;
+  }
+  return AddOpenInputJar(name, jar);
+}
+
+bool JarMerger::AddInputJar(const std::string &name, int fd) {
+  std::shared_ptr<IndexedInputJar> jar(new IndexedInputJar);
+  if (!jar->Open(name, fd)) {
+    return false;
+  }
+  return AddOpenInputJar(name, jar);
+}
+
+void JarMerger::AddInputJarFile(const std::string &path) {
+  options_.input_jars.emplace_back(path, "");
+}
+
+bool JarMerger::AddOpenInputJar(const std::string &name,
+                                std::shared_ptr<const IndexedInputJar> jar) {
+  if (!input_names_.insert(name).second) {
+    diag_warnx("%s:%d: There is another input jar named %s", __FILE__,
+               __LINE__, name.c_str());
+    return false;
+  }
+  options_.input_jars.emplace_back(name, "");
+  output_jar_.AddOpenInputJar(name, jar);
+  return true;
+}
+
+int JarMerger::Merge(const std::string &name, int fd) {
+  if (options_.check_desugar_deps) {
+    diag_errx(1, "%s:%d: Desugar checking not currently supported in Bazel.",
+              __FILE__, __LINE__);
+  }
+  options_.output_jar = name;
+  options_.Validate();
+  output_jar_.SetOutputFd(fd);
+  return output_jar_.Doit(&options_);
+}
@@ -0,0 +1,80 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_JAR_MERGER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_JAR_MERGER_H_ 1
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/output_jar.h"
+
+struct IndexedInputJar;
+
+/*
+ * Merges jars in process the way the singlejar binary does, without a
+ * command line, from jars held in memory or in open files into an open
+ * file. The usage pattern is:
+ *   JarMerger merger;
+ *   merger.options()->normalize_timestamps = true;
+ *   if (!merger.AddInputJar("lib.jar", data, size) ||
+ *       !merger.AddInputJar("other.jar", fd)) { fail... }
+ *   int status = merger.Merge("app.jar", output_fd);
+ * As in the binary, the errors are reported on stderr, and the ones that
+ * make it fail exit the process.
+ */
+class JarMerger {
+ public:
+  JarMerger();
+
+  // The options, as the command line would set them. The output and the
+  // input jars are set by the methods below instead.
+  Options *options() { return &options_; }
+
+  // Adds the jar held in the `size` bytes at `data`, which are not copied
+  // and must not change until Merge() returns. `name` stands for the jar in
+  // the messages and has to be unique. Returns false if it is not a jar.
+  bool AddInputJar(const std::string &name, const void *data, size_t size);
+
+  // Adds the jar read from the open file `fd`, which is not closed.
+  bool AddInputJar(const std::string &name, int fd);
+
+  // Adds the jar file under `path`, opened by Merge().
+  void AddInputJarFile(const std::string &path);
+
+  // Writes the merged jar to `fd`, which is not closed, from its current
+  // position; it can be a pipe. `name` is the output in the build data.
+  // Returns 0 on success. Can be called only once.
+  int Merge(const std::string &name, int fd);
+
+ private:
+  // Gives access to the validation a parsed command line goes through.
+  class MergerOptions : public Options {
+   public:
+    void Validate() { PostValidateOptions(); }
+  };
+
+  bool AddOpenInputJar(const std::string &name,
+                       std::shared_ptr<const IndexedInputJar> jar);
+
+  MergerOptions options_;
+  OutputJar output_jar_;
+  std::unordered_set<std::string> input_names_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_JAR_MERGER_H_
@@ -0,0 +1,113 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "src/main/cpp/util/file.h"
+#include "src/tools/singlejar/jar_merger.h"
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using singlejar_test_util::GetEntryContents;
+using singlejar_test_util::OutputFilePath;
+using singlejar_test_util::VerifyZip;
+
+using std::string;
+
+#if !defined(DATA_DIR_TOP)
+#define DATA_DIR_TOP
+#endif
+
+const char kPathLibData1[] = DATA_DIR_TOP "src/tools/singlejar/libdata1.jar";
+const char kPathLibData2[] = DATA_DIR_TOP "src/tools/singlejar/libdata2.jar";
+const char kEntry1[] = "tools/singlejar/data/extra_file1";
+const char kEntry2[] = "tools/singlejar/data/extra_file2";
+const char kEntry3[] = "tools/singlejar/data/extra_file3";
+
+// The jar in memory, the other one read from its open file.
+TEST(JarMergerTest, MergesJarsInMemoryAndInFiles) {
+  string data1;
+  ASSERT_TRUE(blaze_util::ReadFile(kPathLibData1, &data1));
+  int fd2 = open(kPathLibData2, O_RDONLY);
+  ASSERT_GE(fd2, 0);
+  string out_path = OutputFilePath("out.jar");
+  int out_fd = open(out_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  ASSERT_GE(out_fd, 0);
+
+  JarMerger merger;
+  merger.options()->normalize_timestamps = true;
+  ASSERT_TRUE(merger.AddInputJar("data1.jar", data1.data(), data1.size()));
+  ASSERT_TRUE(merger.AddInputJar("data2.jar", fd2));
+  ASSERT_EQ(0, merger.Merge("app.jar", out_fd));
+  EXPECT_EQ(0, close(fd2));
+  EXPECT_EQ(0, close(out_fd));
+
+  EXPECT_EQ(0, VerifyZip(out_path));
+  EXPECT_EQ(GetEntryContents(kPathLibData1, kEntry1),
+            GetEntryContents(out_path, kEntry1));
+  EXPECT_EQ(GetEntryContents(kPathLibData1, kEntry2),
+            GetEntryContents(out_path, kEntry2));
+  EXPECT_EQ(GetEntryContents(kPathLibData2, kEntry3),
+            GetEntryContents(out_path, kEntry3));
+  EXPECT_NE(string::npos, GetEntryContents(out_path, "build-data.properties")
+                              .find("build.target=app.jar"));
+}
+
+TEST(JarMergerTest, WritesToPipe) {
+  string data1;
+  ASSERT_TRUE(blaze_util::ReadFile(kPathLibData1, &data1));
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  string output;
+  std::thread reader([&pipe_fds, &output]() {
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+      output.append(buffer, n);
+    }
+  });
+
+  JarMerger merger;
+  ASSERT_TRUE(merger.AddInputJar("data1.jar", data1.data(), data1.size()));
+  merger.AddInputJarFile(kPathLibData2);
+  int result = merger.Merge("app.jar", pipe_fds[1]);
+  close(pipe_fds[1]);
+  reader.join();
+  close(pipe_fds[0]);
+  ASSERT_EQ(0, result);
+
+  string out_path = OutputFilePath("piped.jar");
+  ASSERT_TRUE(blaze_util::WriteFile(output, out_path));
+  EXPECT_EQ(0, VerifyZip(out_path));
+  EXPECT_EQ(GetEntryContents(kPathLibData2, kEntry3),
+            GetEntryContents(out_path, kEntry3));
+}
+
+TEST(JarMergerTest, RejectsBadInputs) {
+  string data1;
+  ASSERT_TRUE(blaze_util::ReadFile(kPathLibData1, &data1));
+  const char not_a_jar[] = "This is not a jar, it does not end with an ECD";
+  JarMerger merger;
+  EXPECT_FALSE(merger.AddInputJar("bad.jar", not_a_jar, sizeof(not_a_jar)));
+  EXPECT_TRUE(merger.AddInputJar("data1.jar", data1.data(), data1.size()));
+  EXPECT_FALSE(merger.AddInputJar("data1.jar", data1.data(), data1.size()));
+}
+
+}  // namespace
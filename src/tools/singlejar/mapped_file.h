@@ -17,57 +17,46 @@
 
 #include <string>
 
+#include "src/main/cpp/util/mapped_file.h"
+#include "src/tools/singlejar/diag.h"
+
 /*
  * A mapped read-only file with auto closing.
  *
- * MappedFile::Open maps a file with specified name to memory as read-only.
- * It is assumed that the address space is large enough for that.
- * MappedFile::Close deletes the mapping. The destructor calls it, too.
- * A predictable set of methods provide conversion between file offsets and
- * mapped addresses, returns map size, etc.
+ * MappedFile::Open maps a file with specified name (or, with a handle, the
+ * open file it calls so) to memory as read-only, reporting failures as
+ * warnings. The mapping itself, and the access hints,
+ * are shared with the other archive tools, see blaze_util::MappedFile.
  */
-class MappedFile {
+class MappedFile : public blaze_util::MappedFile {
  public:
-#ifdef _WIN32
-  typedef /* HANDLE = void* */ void *FileHandleType;
-#else   // not _WIN32
-  typedef int FileHandleType;
-#endif  // _WIN32
-
-  MappedFile();
-
-  ~MappedFile() { Close(); }
-
-  bool Open(const std::string &path);
-
-  void Close();
-
-  bool mapped(const void *addr) const {
-    return mapped_start_ <= addr && addr < mapped_end_;
+  bool Open(const std::string &path) {
+    if (is_open()) {
+      diag_errx(1, "%s:%d: This instance is already open", __FILE__,
+                __LINE__);
+    }
+    std::string error;
+    if (!blaze_util::MappedFile::Open(path, kRandomAccess, &error)) {
+      diag_warnx("%s:%d: %s: %s", __FILE__, __LINE__, path.c_str(),
+                 error.c_str());
+      return false;
+    }
+    return true;
   }
 
-  const unsigned char *start() const { return mapped_start_; }
-  const unsigned char *end() const { return mapped_end_; }
-  const unsigned char *address(off_t offset) const {
-    return mapped_start_ + offset;
-  }
-  off_t offset(const void *address) const {
-    return reinterpret_cast<const unsigned char *>(address) - mapped_start_;
+  bool Open(int fd, const std::string &name) {
+    if (is_open()) {
+      diag_errx(1, "%s:%d: This instance is already open", __FILE__,
+                __LINE__);
+    }
+    std::string error;
+    if (!blaze_util::MappedFile::OpenHandle(fd, kRandomAccess, &error)) {
+      diag_warnx("%s:%d: %s: %s", __FILE__, __LINE__, name.c_str(),
+                 error.c_str());
+      return false;
+    }
+    return true;
   }
-  FileHandleType fd() const { return fd_; }
-  size_t size() const { return mapped_end_ - mapped_start_; }
-  bool is_open() const;
-
- private:
-  unsigned char *mapped_start_;
-  unsigned char *mapped_end_;
-  FileHandleType fd_;
 };
 
-#ifdef _WIN32
-#include "src/tools/singlejar/mapped_file_windows.inc"
-#else  // not _WIN32
-#include "src/tools/singlejar/mapped_file_posix.inc"
-#endif  // _WIN32
-
 #endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_MAPPED_FILE_H_
@@ -0,0 +1,130 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/mapped_output_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "src/main/cpp/util/mapped_file.h"
+#include "src/tools/singlejar/diag.h"
+
+// The mapping never shrinks below this.
+static const size_t kMinCapacity = 1 << 20;
+
+MappedOutputFile::~MappedOutputFile() {
+  if (is_open()) {
+    diag_warnx("%s:%d: Close() should be called first", __FILE__, __LINE__);
+    Close();
+  }
+}
+
+bool MappedOutputFile::Open(const char *path, int mode,
+                            size_t estimated_size) {
+  if (is_open()) {
+    diag_errx(1, "%s:%d: This instance is already open", __FILE__, __LINE__);
+  }
+  // The file has to be readable for the mapping.
+  fd_ = open(path, O_CREAT | O_RDWR | O_TRUNC, mode);
+  if (fd_ < 0) {
+    diag_warn("%s:%d: %s", __FILE__, __LINE__, path);
+    return false;
+  }
+  size_ = 0;
+  if (!Grow(std::max(estimated_size, kMinCapacity))) {
+    diag_warn("%s:%d: cannot map %s", __FILE__, __LINE__, path);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+uint8_t *MappedOutputFile::Reserve(size_t count) {
+  if (size_ + count > capacity_ &&
+      !Grow(std::max(size_ + count, capacity_ + capacity_ / 2))) {
+    diag_err(1, "%s:%d: cannot grow the output to %zu bytes", __FILE__,
+             __LINE__, size_ + count);
+  }
+  return start_ + size_;
+}
+
+void MappedOutputFile::Write(const void *data, size_t count) {
+  memcpy(Reserve(count), data, count);
+  Commit(count);
+}
+
+bool MappedOutputFile::Close() {
+  if (!is_open()) {
+    return true;
+  }
+  bool ok = munmap(start_, capacity_) == 0;
+  start_ = nullptr;
+  capacity_ = 0;
+  ok = ftruncate(fd_, size_) == 0 && ok;
+  ok = close(fd_) == 0 && ok;
+  fd_ = -1;
+  return ok;
+}
+
+// Allocates the disk space for the new capacity, then extends the mapping.
+// Large mappings are sized in whole huge pages, and asked to use them.
+bool MappedOutputFile::Grow(size_t min_capacity) {
+  size_t alignment = blaze_util::HugePageAlignment(min_capacity);
+  size_t new_capacity = (min_capacity + alignment - 1) & ~(alignment - 1);
+#if defined(__linux__) || defined(__FreeBSD__)
+  int error = posix_fallocate(fd_, 0, new_capacity);
+  if (error == EINVAL || error == EOPNOTSUPP) {
+    // Not supported by the filesystem: the space will be allocated on
+    // demand.
+    error = ftruncate(fd_, new_capacity) ? errno : 0;
+  }
+#else
+  int error = ftruncate(fd_, new_capacity) ? errno : 0;
+#endif
+  if (error) {
+    errno = error;
+    return false;
+  }
+
+  void *address;
+#if defined(__linux__)
+  if (start_ != nullptr) {
+    address = mremap(start_, capacity_, new_capacity, MREMAP_MAYMOVE);
+  } else {
+    address = mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd_, 0);
+  }
+#else
+  if (start_ != nullptr) {
+    munmap(start_, capacity_);
+    start_ = nullptr;
+    capacity_ = 0;
+  }
+  address = mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd_, 0);
+#endif
+  if (address == MAP_FAILED) {
+    return false;
+  }
+  start_ = static_cast<uint8_t *>(address);
+  capacity_ = new_capacity;
+  blaze_util::AdviseHugePages(start_, capacity_);
+  return true;
+}
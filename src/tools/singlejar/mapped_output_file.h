@@ -0,0 +1,68 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_MAPPED_OUTPUT_FILE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_MAPPED_OUTPUT_FILE_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * An output file written by copying to its memory mapping.
+ *
+ * MappedOutputFile::Open creates the file, allocates the disk space for the
+ * estimated file size up front (so that running out of it does not result in
+ * SIGBUS later) and maps it. The file is written sequentially: Reserve()
+ * returns the address of the next bytes, which can be filled by any thread,
+ * Commit() appends them to the file. The mapping grows as needed; that
+ * invalidates the previously returned addresses. Close() truncates the file
+ * to the committed size.
+ */
+class MappedOutputFile {
+ public:
+  MappedOutputFile()
+      : fd_(-1), start_(nullptr), capacity_(0), size_(0) {}
+
+  ~MappedOutputFile();
+
+  // Creates (or truncates) the file with given mode and maps it.
+  bool Open(const char *path, int mode, size_t estimated_size);
+
+  // Returns the address for the next `count' bytes of the file.
+  uint8_t *Reserve(size_t count);
+
+  // Appends `count' reserved bytes to the file.
+  void Commit(size_t count) { size_ += count; }
+
+  // Appends the given bytes to the file.
+  void Write(const void *data, size_t count);
+
+  // Unmaps the file and truncates it to the written size.
+  bool Close();
+
+  bool is_open() const { return fd_ >= 0; }
+  int fd() const { return fd_; }
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  bool Grow(size_t min_capacity);
+
+  int fd_;
+  uint8_t *start_;
+  size_t capacity_;
+  size_t size_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_MAPPED_OUTPUT_FILE_H_
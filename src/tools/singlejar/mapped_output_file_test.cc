@@ -0,0 +1,111 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "src/main/cpp/util/file.h"
+#include "src/tools/singlejar/mapped_output_file.h"
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using singlejar_test_util::OutputFilePath;
+
+TEST(MappedOutputFileTest, Write) {
+  std::string path = OutputFilePath("mapped_output");
+  MappedOutputFile output;
+  ASSERT_TRUE(output.Open(path.c_str(), 0644, 10));
+  EXPECT_TRUE(output.is_open());
+  EXPECT_LE(10, output.capacity());
+
+  output.Write("Hello", 5);
+  uint8_t *reserved = output.Reserve(100);
+  memcpy(reserved, ", world", 7);
+  output.Commit(7);
+  EXPECT_EQ(12, output.size());
+  ASSERT_TRUE(output.Close());
+  EXPECT_FALSE(output.is_open());
+
+  std::string contents;
+  ASSERT_TRUE(blaze_util::ReadFile(path, &contents));
+  EXPECT_EQ("Hello, world", contents);
+  struct stat st;
+  ASSERT_EQ(0, stat(path.c_str(), &st));
+  EXPECT_EQ(0644, st.st_mode & 0777);
+}
+
+// The mapping grows past the estimated size, keeping what has been written.
+TEST(MappedOutputFileTest, Grow) {
+  std::string path = OutputFilePath("mapped_output_grow");
+  MappedOutputFile output;
+  ASSERT_TRUE(output.Open(path.c_str(), 0644, 0));
+  size_t initial_capacity = output.capacity();
+  std::string expected;
+  for (int i = 0; expected.size() < 3 * initial_capacity; ++i) {
+    std::string chunk = "chunk " + std::to_string(i) + "\n";
+    output.Write(chunk.data(), chunk.size());
+    expected += chunk;
+  }
+  EXPECT_LT(initial_capacity, output.capacity());
+  EXPECT_EQ(expected.size(), output.size());
+  ASSERT_TRUE(output.Close());
+
+  std::string contents;
+  ASSERT_TRUE(blaze_util::ReadFile(path, &contents));
+  EXPECT_TRUE(expected == contents);
+}
+
+// The mapping keeps growing once it is large enough to be advised to use huge
+// pages, which must not keep mremap() from extending it.
+TEST(MappedOutputFileTest, GrowPastHugePages) {
+  std::string path = OutputFilePath("mapped_output_grow_huge");
+  MappedOutputFile output;
+  ASSERT_TRUE(output.Open(path.c_str(), 0644, 0));
+  size_t capacity = output.capacity();
+  int grown = 0;
+  std::string expected;
+  for (int i = 0; expected.size() < (24 << 20); ++i) {
+    std::string chunk = std::string(64 * 1024, 'a' + i % 26);
+    output.Write(chunk.data(), chunk.size());
+    expected += chunk;
+    if (output.capacity() != capacity) {
+      capacity = output.capacity();
+      ++grown;
+    }
+  }
+  EXPECT_LE(5, grown);
+  EXPECT_LT(8u << 20, output.capacity());
+  ASSERT_TRUE(output.Close());
+
+  std::string contents;
+  ASSERT_TRUE(blaze_util::ReadFile(path, &contents));
+  EXPECT_TRUE(expected == contents);
+}
+
+// An empty output is an empty file.
+TEST(MappedOutputFileTest, Empty) {
+  std::string path = OutputFilePath("mapped_output_empty");
+  MappedOutputFile output;
+  ASSERT_TRUE(output.Open(path.c_str(), 0644, 1 << 20));
+  ASSERT_TRUE(output.Close());
+  struct stat st;
+  ASSERT_EQ(0, stat(path.c_str(), &st));
+  EXPECT_EQ(0, st.st_size);
+}
+
+}  // namespace
@@ -14,6 +14,10 @@
 
 #include "src/tools/singlejar/options.h"
 
+#include <stdlib.h>
+
+#include <utility>
+
 #include "src/tools/singlejar/diag.h"
 
 void Options::ParseCommandLine(int argc, const char * const argv[]) {
@@ -36,6 +40,10 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
   if (tokens->MatchAndSet("--output", &output_jar) ||
       tokens->MatchAndSet("--main_class", &main_class) ||
       tokens->MatchAndSet("--java_launcher", &java_launcher) ||
+      tokens->MatchAndSet("--incremental_base", &incremental_base) ||
+      tokens->MatchAndSet("--stats_output", &stats_output) ||
+      tokens->MatchAndSet("--entry_digests_output", &entry_digests_output) ||
+      tokens->MatchAndSet("--entry_order_profile", &entry_order_profile) ||
       tokens->MatchAndSet("--deploy_manifest_lines", &manifest_lines) ||
       tokens->MatchAndSet("--sources", &input_jars) ||
       tokens->MatchAndSet("--resources", &resources) ||
@@ -50,13 +58,68 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
       tokens->MatchAndSet("--warn_duplicate_resources",
                           &warn_duplicate_resources) ||
       tokens->MatchAndSet("--nocompress_suffixes", &nocompress_suffixes) ||
-      tokens->MatchAndSet("--check_desugar_deps", &check_desugar_deps)) {
+      tokens->MatchAndSet("--page_align_suffixes", &page_align_suffixes) ||
+      tokens->MatchAndSet("--check_desugar_deps", &check_desugar_deps) ||
+      tokens->MatchAndSet("--ignore_identical_duplicates",
+                          &ignore_identical_duplicates) ||
+      tokens->MatchAndSet("--compare_duplicate_contents",
+                          &compare_duplicate_contents) ||
+      tokens->MatchAndSet("--mmap_output", &mmap_output) ||
+      tokens->MatchAndSet("--prefetch_inputs", &prefetch_inputs) ||
+      tokens->MatchAndSet("--jar_index", &jar_index) ||
+      tokens->MatchAndSet("--verify_input_crc", &verify_input_crc) ||
+      tokens->MatchAndSet("--sort_entries", &sort_entries)) {
     return true;
   } else if (tokens->MatchAndSet("--build_info_file", &optarg)) {
-    build_info_files.push_back(optarg);
+    build_info_files.push_back(std::move(optarg));
     return true;
   } else if (tokens->MatchAndSet("--extra_build_info", &optarg)) {
-    build_info_lines.push_back(optarg);
+    build_info_lines.push_back(std::move(optarg));
+    return true;
+  } else if (tokens->MatchAndSet("--threads", &optarg)) {
+    char *end;
+    long value = strtol(optarg.c_str(), &end, 10);
+    if (*end || value < 1 || value > 1024) {
+      diag_errx(1, "--threads value should be an integer in [1..1024], got %s",
+                optarg.c_str());
+    }
+    threads = static_cast<int>(value);
+    return true;
+  } else if (tokens->MatchAndSet("--combiner_memory_limit", &optarg)) {
+    char *end;
+    unsigned long long value = strtoull(optarg.c_str(), &end, 10);
+    if (*end || optarg.empty() || optarg[0] == '-' || value == 0) {
+      diag_errx(1, "--combiner_memory_limit value should be a positive "
+                "integer, got %s", optarg.c_str());
+    }
+    combiner_memory_limit = value;
+    return true;
+  } else if (tokens->MatchAndSet("--align", &optarg)) {
+    char *end;
+    long value = strtol(optarg.c_str(), &end, 10);
+    if (*end || value < 1 || value > 32768 || (value & (value - 1))) {
+      diag_errx(1, "--align value should be a power of two in [1..32768], "
+                "got %s", optarg.c_str());
+    }
+    alignment = static_cast<uint32_t>(value);
+    return true;
+  } else if (tokens->MatchAndSet("--chunk_align", &optarg)) {
+    char *end;
+    long value = strtol(optarg.c_str(), &end, 10);
+    if (*end || value < 1 || value > 32768 || (value & (value - 1))) {
+      diag_errx(1, "--chunk_align value should be a power of two in "
+                "[1..32768], got %s", optarg.c_str());
+    }
+    chunk_alignment = static_cast<uint32_t>(value);
+    return true;
+  } else if (tokens->MatchAndSet("--input_window_size", &optarg)) {
+    char *end;
+    unsigned long long value = strtoull(optarg.c_str(), &end, 10);
+    if (*end || optarg.empty() || optarg[0] == '-' || value == 0) {
+      diag_errx(1, "--input_window_size value should be a positive "
+                "integer, got %s", optarg.c_str());
+    }
+    input_window_size = value;
     return true;
   }
 
@@ -72,4 +135,10 @@ void Options::PostValidateOptions() {
         1,
         "--compression and --dont_change_compression are mutually exclusive");
   }
+  if (compare_duplicate_contents) {
+    ignore_identical_duplicates = true;
+  }
+  entry_name_classifier =
+      EntryNameClassifier(include_prefixes, nocompress_suffixes,
+                          page_align_suffixes);
 }
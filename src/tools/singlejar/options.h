@@ -15,8 +15,11 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_OPTIONS_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_OPTIONS_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
+#include "src/tools/singlejar/entry_name_classifier.h"
 #include "src/tools/singlejar/token_stream.h"
 
 /* Command line options. */
@@ -31,7 +34,19 @@ class Options {
         preserve_compression(false),
         verbose(false),
         warn_duplicate_resources(false),
-        check_desugar_deps(false) {}
+        check_desugar_deps(false),
+        ignore_identical_duplicates(false),
+        compare_duplicate_contents(false),
+        mmap_output(false),
+        prefetch_inputs(false),
+        jar_index(false),
+        verify_input_crc(false),
+        sort_entries(false),
+        threads(1),
+        combiner_memory_limit(32 << 20),
+        alignment(0),
+        chunk_alignment(0),
+        input_window_size(0) {}
 
   virtual ~Options() {}
 
@@ -41,6 +56,15 @@ class Options {
   std::string output_jar;
   std::string main_class;
   std::string java_launcher;
+  // The output of the previous run, whose recompressed entries are reused.
+  std::string incremental_base;
+  // Where to write the statistics of the run (in JSON).
+  std::string stats_output;
+  // Where to write the SHA-256 digests of the output entries.
+  std::string entry_digests_output;
+  // A list of entry names, one per line, in the order a program loads them.
+  // The plain entries it lists are written ahead of the other input entries.
+  std::string entry_order_profile;
   std::vector<std::string> manifest_lines;
   std::vector<std::pair<std::string, std::string> > input_jars;
   std::vector<std::string> resources;
@@ -49,6 +73,9 @@ class Options {
   std::vector<std::string> build_info_lines;
   std::vector<std::string> include_prefixes;
   std::vector<std::string> nocompress_suffixes;
+  // The entries with these suffixes are stored, with their data starting at
+  // a page boundary, so that they can be mapped from the output.
+  std::vector<std::string> page_align_suffixes;
   bool exclude_build_data;
   bool force_compression;
   bool normalize_timestamps;
@@ -58,6 +85,44 @@ class Options {
   bool verbose;
   bool warn_duplicate_resources;
   bool check_desugar_deps;
+  // Duplicate entries with the same CRC-32 and size as the first copy are
+  // dropped silently even with --no_duplicates. The others are reported.
+  bool ignore_identical_duplicates;
+  // The same, comparing the contents, too. Implies the above.
+  bool compare_duplicate_contents;
+  // Write the output through its memory mapping, with the disk space for it
+  // allocated up front.
+  bool mmap_output;
+  // Ask the OS to start reading the entries to be merged from an input jar
+  // as soon as it is scanned, so that many reads are in flight at once.
+  bool prefetch_inputs;
+  // Add META-INF/INDEX.LIST listing the packages in the output.
+  bool jar_index;
+  // Check the CRC-32 and size of every input entry written or merged to the
+  // output, inflating it if needed, and fail on a mismatch.
+  bool verify_input_crc;
+  // Write the entries of each input jar in name order, that is, package by
+  // package, whatever the order of the jar.
+  bool sort_entries;
+  int threads;  // Number of threads to use; 1 means everything is sequential.
+  // The size (in bytes) a combined META-INF/services/ entry may reach before
+  // it is streamed to a temporary file.
+  uint64_t combiner_memory_limit;
+  // The data of all the stored entries starts at a multiple of this (a power
+  // of two); 0 means no alignment.
+  uint32_t alignment;
+  // The data of all the non-empty entries, compressed ones included, starts
+  // at a multiple of this (a power of two), so that an unchanged entry
+  // occupies the same chunks of the output whatever precedes it; 0 means no
+  // alignment.
+  uint32_t chunk_alignment;
+  // If set, the input entries are read in order, and the pages of an input
+  // jar are released (also from the page cache) as soon as the merge is
+  // that many bytes past them, so that multi-GB inputs do not stay resident.
+  uint64_t input_window_size;
+  // Matches the entry names against include_prefixes, nocompress_suffixes,
+  // page_align_suffixes and the built-in patterns. Set up after parsing.
+  EntryNameClassifier entry_name_classifier;
 
  protected:
   /*
@@ -37,6 +37,12 @@ TEST(OptionsTest, Flags1) {
   EXPECT_FALSE(options.verbose);
   EXPECT_FALSE(options.warn_duplicate_resources);
   EXPECT_FALSE(options.check_desugar_deps);
+  EXPECT_FALSE(options.ignore_identical_duplicates);
+  EXPECT_FALSE(options.mmap_output);
+  EXPECT_FALSE(options.prefetch_inputs);
+  EXPECT_FALSE(options.jar_index);
+  EXPECT_FALSE(options.verify_input_crc);
+  EXPECT_FALSE(options.sort_entries);
   EXPECT_EQ("output_jar", options.output_jar);
 }
 
@@ -45,6 +51,12 @@ TEST(OptionsTest, Flags2) {
                         "--verbose",
                         "--warn_duplicate_resources",
                         "--check_desugar_deps",
+                        "--compare_duplicate_contents",
+                        "--mmap_output",
+                        "--prefetch_inputs",
+                        "--jar_index",
+                        "--verify_input_crc",
+                        "--sort_entries",
                         "--output", "output_jar"};
   Options options;
   options.ParseCommandLine(arraysize(args), args);
@@ -57,12 +69,25 @@ TEST(OptionsTest, Flags2) {
   ASSERT_TRUE(options.verbose);
   ASSERT_TRUE(options.warn_duplicate_resources);
   ASSERT_TRUE(options.check_desugar_deps);
+  ASSERT_TRUE(options.compare_duplicate_contents);
+  ASSERT_TRUE(options.ignore_identical_duplicates);
+  ASSERT_TRUE(options.mmap_output);
+  ASSERT_TRUE(options.prefetch_inputs);
+  ASSERT_TRUE(options.jar_index);
+  ASSERT_TRUE(options.verify_input_crc);
+  ASSERT_TRUE(options.sort_entries);
 }
 
 TEST(OptionsTest, SingleOptargs) {
   const char *args[] = {"--output", "output_jar",
                         "--main_class", "com.google.Main",
                         "--java_launcher", "//tools:mylauncher",
+                        "--incremental_base", "previous_jar",
+                        "--stats_output", "stats.json",
+                        "--entry_digests_output", "digests.txt",
+                        "--entry_order_profile", "startup.txt",
+                        "--combiner_memory_limit", "1048576",
+                        "--input_window_size", "67108864",
                         "--build_info_file", "build_file1",
                         "--extra_build_info", "extra_build_line1",
                         "--build_info_file", "build_file2",
@@ -73,6 +98,13 @@ TEST(OptionsTest, SingleOptargs) {
   EXPECT_EQ("output_jar", options.output_jar);
   EXPECT_EQ("com.google.Main", options.main_class);
   EXPECT_EQ("//tools:mylauncher", options.java_launcher);
+  EXPECT_EQ("previous_jar", options.incremental_base);
+  EXPECT_EQ("stats.json", options.stats_output);
+  EXPECT_EQ("digests.txt", options.entry_digests_output);
+  EXPECT_EQ("startup.txt", options.entry_order_profile);
+  EXPECT_EQ(1048576, options.combiner_memory_limit);
+  EXPECT_EQ(67108864, options.input_window_size);
+  EXPECT_EQ(1, options.threads);
   ASSERT_EQ(2, options.build_info_files.size());
   EXPECT_EQ("build_file1", options.build_info_files[0]);
   EXPECT_EQ("build_file2", options.build_info_files[1]);
@@ -108,6 +140,8 @@ TEST(OptionsTest, MultiOptargs) {
   EXPECT_EQ(2, options.nocompress_suffixes.size());
   EXPECT_EQ(".png", options.nocompress_suffixes[0]);
   EXPECT_EQ(".so", options.nocompress_suffixes[1]);
+  EXPECT_EQ(EntryNameClassifier::kIncluded | EntryNameClassifier::kNoCompress,
+            options.entry_name_classifier.Classify("prefix2/foo.so"));
 }
 
 TEST(OptionsTest, EmptyMultiOptargs) {
@@ -126,3 +160,28 @@ TEST(OptionsTest, EmptyMultiOptargs) {
   EXPECT_EQ(0, options.classpath_resources.size());
   EXPECT_EQ(1, options.include_prefixes.size());
 }
+
+TEST(OptionsTest, Threads) {
+  const char *args[] = {"--output", "output_file", "--threads", "8"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+
+  EXPECT_EQ(8, options.threads);
+}
+
+TEST(OptionsTest, Alignment) {
+  const char *args[] = {"--output", "output_file", "--align", "4",
+                        "--chunk_align", "1024",
+                        "--page_align_suffixes", ".so", ".bin"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+
+  EXPECT_EQ(4, options.alignment);
+  EXPECT_EQ(1024, options.chunk_alignment);
+  ASSERT_EQ(2, options.page_align_suffixes.size());
+  EXPECT_EQ(".so", options.page_align_suffixes[0]);
+  EXPECT_EQ(".bin", options.page_align_suffixes[1]);
+  EXPECT_EQ(EntryNameClassifier::kIncluded | EntryNameClassifier::kNoCompress |
+                EntryNameClassifier::kPageAlign,
+            options.entry_name_classifier.Classify("lib/x86/libfoo.so"));
+}
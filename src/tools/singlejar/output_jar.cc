@@ -17,24 +17,40 @@
  */
 #include "src/tools/singlejar/output_jar.h"
 
+#include <ctype.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 
 #include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/crc32.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/entry_name_classifier.h"
 #include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/input_jar_cache.h"
 #include "src/tools/singlejar/mapped_file.h"
 #include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/sha256.h"
 #include "src/tools/singlejar/zip_headers.h"
+#include "src/tools/singlejar/zlib_interface.h"
 
 #include <zlib.h>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <unordered_set>
+
 #define TODO(cond, msg)                                              \
   if (!(cond)) {                                                     \
     diag_errx(2, "%s:%d: TODO(asmundak): " msg, __FILE__, __LINE__); \
@@ -42,31 +58,44 @@
 
 OutputJar::OutputJar()
     : options_(nullptr),
+      input_jar_cache_(nullptr),
+      output_fd_(-1),
       file_(nullptr),
       outpos_(0),
       buffer_(nullptr),
       entries_(0),
       duplicate_entries_(0),
-      cen_(nullptr),
+      reused_entries_(0),
+      profiled_entries_(0),
       cen_size_(0),
-      cen_capacity_(0),
+      try_copy_file_range_(true),
+      try_sendfile_(true),
       spring_handlers_("META-INF/spring.handlers"),
       spring_schemas_("META-INF/spring.schemas"),
       protobuf_meta_handler_("protobuf.meta", false),
       manifest_("META-INF/MANIFEST.MF"),
-      build_properties_("build-data.properties") {
-  known_members_.emplace(spring_handlers_.filename(),
+      build_properties_("build-data.properties"),
+      bytes_copied_(0),
+      bytes_recompressed_(0) {
+  known_members_.Emplace(spring_handlers_.filename(),
                          EntryInfo{&spring_handlers_});
-  known_members_.emplace(spring_schemas_.filename(),
+  known_members_.Emplace(spring_schemas_.filename(),
                          EntryInfo{&spring_schemas_});
-  known_members_.emplace(manifest_.filename(), EntryInfo{&manifest_});
-  known_members_.emplace(protobuf_meta_handler_.filename(),
+  known_members_.Emplace(manifest_.filename(), EntryInfo{&manifest_});
+  known_members_.Emplace(protobuf_meta_handler_.filename(),
                          EntryInfo{&protobuf_meta_handler_});
   manifest_.Append(
       "Manifest-Version: 1.0\r\n"
       "Created-By: singlejar\r\n");
 }
 
+// Monotonic time in seconds, for the phase timing.
+static double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 static std::string Basename(const std::string& path) {
   size_t pos = path.rfind('/');
   if (pos == std::string::npos) {
@@ -76,20 +105,73 @@ static std::string Basename(const std::string& path) {
   }
 }
 
+static const char kJarIndexName[] = "META-INF/INDEX.LIST";
+
+// The alignment of the data of the entries matching --page_align_suffixes.
+static const uint32_t kPageAlignment = 4096;
+
+struct OutputJar::ScannedJar {
+  ScannedJar() : ok(false) {}
+  std::shared_ptr<const IndexedInputJar> jar;
+  // Central Directory Headers and Local Headers of the entries to merge,
+  // in the Central Directory order.
+  std::vector<std::pair<const CDH *, const LH *> > entries;
+  // The hashes of the entry names, for the known_members_ lookups.
+  std::vector<uint32_t> name_hashes;
+  // What EntryNameClassifier says about the entry names.
+  std::vector<uint32_t> name_classes;
+  bool ok;  // Scan result.
+};
+
+// An input jar entry to be written to the output. The entry is either copied
+// as is, or, if its compression has to change, re-encoded into `recompressed'
+// (which can happen on a worker thread).
+struct OutputJar::PendingEntry {
+  PendingEntry(const CDH *cdh, const LH *lh, uint32_t alignment,
+               bool recompress, bool output_compressed,
+               const CDH *reuse = nullptr)
+      : cdh(cdh),
+        lh(lh),
+        alignment(alignment),
+        recompress(recompress),
+        output_compressed(output_compressed),
+        reuse(reuse),
+        recompressed(nullptr),
+        crc_ok(true) {}
+  const CDH *cdh;
+  const LH *lh;
+  uint32_t alignment;  // Of the data, if the entry is stored.
+  bool recompress;
+  bool output_compressed;
+  const CDH *reuse;    // The same entry in the --incremental_base jar.
+  void *recompressed;  // Local header followed by the payload.
+  bool crc_ok;         // Checked with --verify_input_crc.
+};
+
 int OutputJar::Doit(Options *options) {
   if (nullptr != options_) {
     diag_errx(1, "%s:%d: Doit() can be called only once.", __FILE__, __LINE__);
   }
   options_ = options;
+  double start_time = Now();
+  if (options_->threads > 1) {
+    pool_.reset(new blaze_util::ThreadPool(options_->threads, 16));
+  }
 
   // Register the handler for the build-data.properties file unless
   // --exclude_build_data is present. Otherwise we do not generate this file,
   // and it will be copied from the first source archive containing it.
   if (!options_->exclude_build_data) {
-    known_members_.emplace(build_properties_.filename(),
+    known_members_.Emplace(build_properties_.filename(),
                            EntryInfo{&build_properties_});
   }
 
+  // The index of the input jars does not describe the output; the output
+  // gets its own with --jar_index.
+  if (options_->jar_index) {
+    known_members_.Emplace(kJarIndexName, EntryInfo{&null_combiner_});
+  }
+
   build_properties_.AddProperty("build.target", options_->output_jar.c_str());
   if (options_->verbose) {
     fprintf(stderr, "combined_file_name=%s\n", options_->output_jar.c_str());
@@ -104,6 +186,19 @@ int OutputJar::Doit(Options *options) {
     fprintf(stderr, "%ld manifest lines\n", options_->manifest_lines.size());
   }
 
+  if (!options_->incremental_base.empty() && !OpenIncrementalBase()) {
+    exit(1);
+  }
+
+  if (!options_->entry_order_profile.empty()) {
+    LoadEntryOrderProfile();
+  }
+
+  if (output_fd_ >= 0 && !options_->entry_digests_output.empty()) {
+    diag_errx(1, "%s:%d: --entry_digests_output needs an output file",
+              __FILE__, __LINE__);
+  }
+
   if (!Open()) {
     exit(1);
   }
@@ -113,12 +208,11 @@ int OutputJar::Doit(Options *options) {
     const char *const launcher_path = options_->java_launcher.c_str();
     int in_fd = open(launcher_path, O_RDONLY);
     struct stat statbuf;
-    if (file_ == nullptr || fstat(in_fd, &statbuf)) {
+    if (!IsOpen() || fstat(in_fd, &statbuf)) {
       diag_err(1, "%s", launcher_path);
     }
-    // TODO(asmundak):  Consider going back to sendfile() or reflink
-    // (BTRFS_IOC_CLONE/XFS_IOC_CLONE) here.  The launcher preamble can
-    // be very large for targets with many native deps.
+    // The launcher preamble can be very large for targets with many native
+    // deps. AppendFile lets the kernel copy it where possible.
     ssize_t byte_count = AppendFile(in_fd, 0, statbuf.st_size);
     if (byte_count < 0) {
       diag_err(1, "%s:%d: Cannot copy %s to %s", __FILE__, __LINE__,
@@ -151,8 +245,8 @@ int OutputJar::Doit(Options *options) {
   }
 
   for (auto &build_info_line : options_->build_info_lines) {
-    build_properties_.Append(build_info_line);
-    build_properties_.Append("\n");
+    build_properties_.AddProperties(build_info_line.data(),
+                                    build_info_line.size());
   }
 
   for (auto &build_info_file : options_->build_info_files) {
@@ -161,19 +255,9 @@ int OutputJar::Doit(Options *options) {
       diag_err(1, "%s:%d: Bad build info file %s", __FILE__, __LINE__,
                build_info_file.c_str());
     }
-    const char *data = reinterpret_cast<const char *>(mapped_file.start());
-    const char *data_end = reinterpret_cast<const char *>(mapped_file.end());
-    // TODO(asmundak): this isn't right, we should parse properties file.
-    while (data < data_end) {
-      const char *next_data = strchr(static_cast<const char *>(data), '\n');
-      if (next_data) {
-        ++next_data;
-      } else {
-        next_data = data_end;
-      }
-      build_properties_.Append(data, next_data - data);
-      data = next_data;
-    }
+    build_properties_.AddProperties(
+        reinterpret_cast<const char *>(mapped_file.start()),
+        mapped_file.size());
     mapped_file.Close();
   }
 
@@ -207,20 +291,15 @@ int OutputJar::Doit(Options *options) {
     WriteEntry(build_properties_.OutputEntry(compress));
   }
 
+  // Then the input entries a program loads first, so that they are read
+  // from a contiguous part of the output.
+  if (entry_order_.size() && !AddProfiledEntries()) {
+    exit(1);
+  }
+
   // Then classpath resources.
-  for (auto &classpath_resource : classpath_resources_) {
-    bool do_compress = compress;
-    if (do_compress && !options_->nocompress_suffixes.empty()) {
-      for (auto &suffix : options_->nocompress_suffixes) {
-        auto entry_name = classpath_resource->filename();
-        if (entry_name.length() >= suffix.size() &&
-            !entry_name.compare(entry_name.length() - suffix.size(),
-                                suffix.size(), suffix)) {
-          do_compress = false;
-          break;
-        }
-      }
-    }
+  for (size_t ix = 0; ix < classpath_resources_.size(); ++ix) {
+    auto &classpath_resource = classpath_resources_[ix];
 
     // Add parent directory entries.
     size_t pos = classpath_resource->filename().find('/');
@@ -232,23 +311,36 @@ int OutputJar::Doit(Options *options) {
       pos = classpath_resource->filename().find('/', pos + 1);
     }
 
-    WriteEntry(classpath_resource->OutputEntry(do_compress));
+    if (classpath_resource_files_[ix].empty()) {
+      WriteEntry(classpath_resource->OutputEntry(
+          CompressResource(classpath_resource->filename())));
+    } else {
+      WriteStoredFile(classpath_resource->filename(),
+                      classpath_resource_files_[ix]);
+    }
   }
 
   // Then copy source files' contents.
-  for (size_t ix = 0; ix < options_->input_jars.size(); ++ix) {
-    if (!AddJar(ix)) {
-      exit(1);
-    }
+  double add_time = Now();
+  phase_times_.open = add_time - start_time;
+  if (!AddJars()) {
+    exit(1);
   }
+  phase_times_.write = Now() - add_time - phase_times_.scan;
 
   // All entries written, write Central Directory and close.
   Close();
+  if (!options_->stats_output.empty() && !WriteStats()) {
+    exit(1);
+  }
+  if (!options_->entry_digests_output.empty() && !WriteEntryDigests()) {
+    exit(1);
+  }
   return 0;
 }
 
 OutputJar::~OutputJar() {
-  if (file_) {
+  if (IsOpen()) {
     diag_warnx("%s:%d: Close() should be called first", __FILE__, __LINE__);
   }
 }
@@ -257,12 +349,33 @@ OutputJar::~OutputJar() {
 // (128KB is the default max request size for fuse filesystems.)
 static const size_t kBufferSize = 128<<10;
 
+// Input entries at least this large are copied to the output by AppendFile
+// rather than written from the mapped input file. Below that, flushing the
+// output buffer costs more than copying the bytes.
+static const size_t kKernelCopyThreshold = 256 << 10;
+
 bool OutputJar::Open() {
-  if (file_) {
+  if (IsOpen()) {
     diag_errx(1, "%s:%d: Cannot open output archive twice", __FILE__, __LINE__);
   }
+  outpos_ = 0;
+  if (options_->mmap_output && output_fd_ < 0) {
+    size_t estimated_size = EstimateOutputSize();
+    mapped_output_.reset(new MappedOutputFile());
+    // Set execute bits since we may produce an executable output file.
+    if (!mapped_output_->Open(path(), 0777, estimated_size)) {
+      mapped_output_.reset();
+      return false;
+    }
+    if (options_->verbose) {
+      fprintf(stderr, "Writing to %s (mapped, %zu bytes allocated)\n", path(),
+              mapped_output_->capacity());
+    }
+    return true;
+  }
   // Set execute bits since we may produce an executable output file.
-  int fd = open(path(), O_CREAT|O_WRONLY|O_TRUNC, 0777);
+  int fd = output_fd_ >= 0 ? dup(output_fd_)
+                           : open(path(), O_CREAT|O_WRONLY|O_TRUNC, 0777);
   if (fd < 0) {
     diag_warn("%s:%d: %s", __FILE__, __LINE__, path());
     return false;
@@ -282,70 +395,321 @@ bool OutputJar::Open() {
   return true;
 }
 
-bool OutputJar::AddJar(int jar_path_index) {
-  const std::string &input_jar_path =
-      options_->input_jars[jar_path_index].first;
-  const std::string &input_jar_aux_label =
-      options_->input_jars[jar_path_index].second;
+// Much like ijar's ZipBuilder::EstimateSize: the inputs, the headers and
+// the Central Directory for them. The mapping grows if it is not enough.
+size_t OutputJar::EstimateOutputSize() const {
+  size_t size = 1 << 16;  // Manifest, build data and directories.
+  struct stat st;
+  auto add_file = [&size, &st](const std::string &path) {
+    if (!stat(path.c_str(), &st)) {
+      size += st.st_size;
+    }
+  };
+  if (!options_->java_launcher.empty()) {
+    add_file(options_->java_launcher);
+  }
+  for (auto &input_jar : options_->input_jars) {
+    auto open_jar = open_input_jars_.find(input_jar.first);
+    if (open_jar != open_input_jars_.end()) {
+      size += open_jar->second->input_jar.size();
+    } else {
+      add_file(input_jar.first);
+    }
+  }
+  for (auto &resources : {&options_->resources,
+                          &options_->classpath_resources}) {
+    for (auto &resource : *resources) {
+      // Local header, data descriptor and Central Directory header, with
+      // the name twice.
+      size += 88 + 2 * resource.size();
+      add_file(resource.substr(0, resource.find(':')));
+    }
+  }
+  return size;
+}
 
-  InputJar input_jar;
-  if (!input_jar.Open(input_jar_path)) {
+std::shared_ptr<const IndexedInputJar> OutputJar::OpenInputJar(
+    const std::string &input_jar_path) const {
+  auto open_jar = open_input_jars_.find(input_jar_path);
+  if (open_jar != open_input_jars_.end()) {
+    return open_jar->second;
+  }
+  if (input_jar_cache_ != nullptr) {
+    return input_jar_cache_->Get(input_jar_path);
+  }
+  std::shared_ptr<IndexedInputJar> jar(new IndexedInputJar);
+  if (!jar->Open(input_jar_path)) {
+    return nullptr;
+  }
+  return jar;
+}
+
+bool OutputJar::ScanJar(int jar_path_index, ScannedJar *scanned_jar) {
+  scanned_jar->jar = OpenInputJar(options_->input_jars[jar_path_index].first);
+  if (!scanned_jar->jar) {
     return false;
   }
-  const CDH *jar_entry;
-  const LH *lh;
-  while ((jar_entry = input_jar.NextEntry(&lh))) {
+  for (auto &jar_entry_and_lh : scanned_jar->jar->entries) {
+    const CDH *jar_entry = jar_entry_and_lh.first;
     const char *file_name = jar_entry->file_name();
     auto file_name_length = jar_entry->file_name_length();
-    if (!file_name_length) {
-      diag_errx(
-          1, "%s:%d: Bad central directory record in %s at offset 0x%" PRIx64,
-          __FILE__, __LINE__, input_jar_path.c_str(),
-          input_jar.CentralDirectoryRecordOffset(jar_entry));
-    }
     // Special files that cannot be handled by looking up known_members_ map:
     // * ignore *.SF, *.RSA, *.DSA
     //   (TODO(asmundak): should this be done only in META-INF?
     //
-    if (ends_with(file_name, file_name_length, ".SF") ||
-        ends_with(file_name, file_name_length, ".RSA") ||
-        ends_with(file_name, file_name_length, ".DSA")) {
+    uint32_t name_classes = options_->entry_name_classifier.Classify(
+        file_name, file_name_length);
+    if (name_classes & EntryNameClassifier::kSignature) {
       continue;
     }
+    if (!(name_classes & EntryNameClassifier::kIncluded)) {
+      continue;
+    }
+    scanned_jar->entries.push_back(jar_entry_and_lh);
+    scanned_jar->name_hashes.push_back(
+        EntryNameTable<EntryInfo>::Hash(file_name, file_name_length));
+    scanned_jar->name_classes.push_back(name_classes);
+  }
+  if (options_->prefetch_inputs) {
+    PrefetchEntries(*scanned_jar);
+  }
+  return true;
+}
 
-    bool include_entry = true;
-    if (!options_->include_prefixes.empty()) {
-      for (auto& prefix : options_->include_prefixes) {
-        if ((include_entry =
-                 (prefix.size() <= file_name_length &&
-                  0 == strncmp(file_name, prefix.c_str(), prefix.size())))) {
-          break;
-        }
+// Reports the given input entry as corrupt and exits.
+static void ReportCorruptEntry(const CDH *jar_entry,
+                               const std::string &input_jar_path) {
+  diag_errx(1, "%s:%d: %.*s in %s is corrupt: its data does not match its "
+            "CRC-32 and size", __FILE__, __LINE__,
+            jar_entry->file_name_length(), jar_entry->file_name(),
+            input_jar_path.c_str());
+}
+
+// Entries separated by less than this are prefetched as a single range.
+static const uint64_t kPrefetchGap = 64 << 10;
+
+// Returns the offset of the end of the given input entry: of its local
+// header, its payload and a possible data descriptor.
+static uint64_t InputEntryEnd(const InputJar &input_jar, const CDH *jar_entry,
+                              const LH *lh) {
+  return input_jar.LocalHeaderOffset(lh) + lh->size() +
+         jar_entry->compressed_file_size() + sizeof(DDR);
+}
+
+void OutputJar::PrefetchEntries(const ScannedJar &scanned_jar) {
+  const InputJar &input_jar = scanned_jar.jar->input_jar;
+  uint64_t range_start = 0;
+  uint64_t range_end = 0;
+  for (auto &entry : scanned_jar.entries) {
+    const CDH *jar_entry = entry.first;
+    uint64_t start = input_jar.LocalHeaderOffset(entry.second);
+    uint64_t end = InputEntryEnd(input_jar, jar_entry, entry.second);
+    if (range_end != 0 && start >= range_start &&
+        start <= range_end + kPrefetchGap) {
+      range_end = std::max(range_end, end);
+      continue;
+    }
+    if (range_end != 0) {
+      input_jar.Prefetch(range_start, range_end - range_start);
+    }
+    range_start = start;
+    range_end = end;
+  }
+  if (range_end != 0) {
+    input_jar.Prefetch(range_start, range_end - range_start);
+  }
+}
+
+void OutputJar::LoadEntryOrderProfile() {
+  const std::string &profile_path = options_->entry_order_profile;
+  MappedFile profile;
+  if (!profile.Open(profile_path)) {
+    diag_err(1, "%s:%d: Bad entry order profile %s", __FILE__, __LINE__,
+             profile_path.c_str());
+  }
+  // One entry name per line; blank lines and lines starting with '#' are
+  // skipped. A name listed twice keeps its first position.
+  const char *line = reinterpret_cast<const char *>(profile.start());
+  const char *end = line + profile.size();
+  uint32_t position = 0;
+  while (line < end) {
+    const char *eol =
+        static_cast<const char *>(memchr(line, '\n', end - line));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    const char *name_end = eol;
+    while (name_end > line && isspace(name_end[-1])) {
+      --name_end;
+    }
+    while (line < name_end && isspace(*line)) {
+      ++line;
+    }
+    if (line < name_end && *line != '#') {
+      size_t length = name_end - line;
+      entry_order_.Emplace(line, length,
+                           EntryNameTable<uint32_t>::Hash(line, length),
+                           position++);
+    }
+    line = eol + 1;
+  }
+  profile.Close();
+}
+
+bool OutputJar::AddProfiledEntries() {
+  // The jars are handled one at a time, so that a long profile does not
+  // keep all of them open at once.
+  for (size_t jar_ix = 0; jar_ix < options_->input_jars.size(); ++jar_ix) {
+    const std::string &input_jar_path = options_->input_jars[jar_ix].first;
+    const std::string &input_jar_aux_label =
+        options_->input_jars[jar_ix].second;
+    std::shared_ptr<const IndexedInputJar> jar = OpenInputJar(input_jar_path);
+    if (!jar) {
+      return false;
+    }
+
+    // The entries this jar contributes, with their profile positions.
+    struct ProfiledEntry {
+      uint32_t position;
+      uint32_t name_classes;
+      const CDH *cdh;
+      const LH *lh;
+    };
+    std::vector<ProfiledEntry> profiled;
+    for (auto &jar_entry_and_lh : jar->entries) {
+      const CDH *jar_entry = jar_entry_and_lh.first;
+      const char *file_name = jar_entry->file_name();
+      auto file_name_length = jar_entry->file_name_length();
+      if (file_name[file_name_length - 1] == '/') {
+        continue;
+      }
+      uint32_t hash =
+          EntryNameTable<EntryInfo>::Hash(file_name, file_name_length);
+      const uint32_t *position =
+          entry_order_.Find(file_name, file_name_length, hash);
+      if (position == nullptr ||
+          known_members_.Find(file_name, file_name_length, hash) != nullptr) {
+        continue;
+      }
+      // AddJar() takes care of the entries that are dropped or merged.
+      uint32_t name_classes = options_->entry_name_classifier.Classify(
+          file_name, file_name_length);
+      if (!(name_classes & EntryNameClassifier::kIncluded) ||
+          (name_classes &
+           (EntryNameClassifier::kSignature | EntryNameClassifier::kService |
+            EntryNameClassifier::kDesugarLib))) {
+        continue;
+      }
+      ExtraHandler(jar_entry, &input_jar_aux_label);
+      if (known_members_
+              .Emplace(file_name, file_name_length, hash,
+                       EntryInfo{nullptr, static_cast<int>(jar_ix),
+                                 jar_entry->crc32(),
+                                 jar_entry->uncompressed_file_size(), true})
+              .second) {
+        profiled.push_back(ProfiledEntry{*position, name_classes, jar_entry,
+                                         jar_entry_and_lh.second});
       }
     }
-    if (!include_entry) {
+    if (profiled.empty()) {
       continue;
     }
 
+    std::sort(profiled.begin(), profiled.end(),
+              [](const ProfiledEntry &a, const ProfiledEntry &b) {
+                return a.position < b.position;
+              });
+    std::vector<PendingEntry> pending_entries;
+    size_t recompress_count = 0;
+    for (auto &entry : profiled) {
+      AddPendingFileEntry(entry.cdh, entry.lh, entry.name_classes,
+                          &pending_entries, &recompress_count);
+    }
+    WritePendingEntries(jar->input_jar, input_jar_path, &pending_entries,
+                        recompress_count);
+    profiled_entries_ += profiled.size();
+  }
+  return true;
+}
+
+bool OutputJar::AddJars() {
+  const size_t jar_count = options_->input_jars.size();
+  std::vector<ScannedJar> scanned_jars(jar_count);
+  if (options_->compare_duplicate_contents) {
+    retained_jars_.resize(jar_count);
+  }
+  // Merge in the input order, so that the output does not depend on the
+  // number of threads. At most that many jars are scanned ahead of the one
+  // being merged, which bounds the number of input files open at once.
+  // Whatever time passes between two merges is spent waiting for the scan.
+  double wait_time = Now();
+  return blaze_util::RunOrdered(
+      pool_.get(), jar_count, 4 * options_->threads,
+      [this, &scanned_jars](size_t ix) {
+        scanned_jars[ix].ok = ScanJar(ix, &scanned_jars[ix]);
+      },
+      [this, &scanned_jars, &wait_time](size_t ix) {
+        double merge_time = Now();
+        phase_times_.scan += merge_time - wait_time;
+        int entries = entries_;
+        bool ok = scanned_jars[ix].ok && AddJar(ix, &scanned_jars[ix]);
+        wait_time = Now();
+        jar_stats_.push_back(
+            JarStats{wait_time - merge_time, entries_ - entries});
+        scanned_jars[ix] = ScannedJar();
+        return ok;
+      });
+}
+
+bool OutputJar::AddJar(int jar_path_index, ScannedJar *scanned_jar) {
+  const std::string &input_jar_path =
+      options_->input_jars[jar_path_index].first;
+  const std::string &input_jar_aux_label =
+      options_->input_jars[jar_path_index].second;
+  const InputJar &input_jar = scanned_jar->jar->input_jar;
+  if (options_->compare_duplicate_contents) {
+    retained_jars_[jar_path_index].jar = scanned_jar->jar;
+  }
+
+  // Decide what to do with each entry and update known_members_ first,
+  // without writing anything.
+  std::vector<PendingEntry> pending_entries;
+  size_t recompress_count = 0;
+  for (size_t ix = 0; ix < scanned_jar->entries.size(); ++ix) {
+    const CDH *jar_entry = scanned_jar->entries[ix].first;
+    const LH *lh = scanned_jar->entries[ix].second;
+    const char *file_name = jar_entry->file_name();
+    auto file_name_length = jar_entry->file_name_length();
+    uint32_t name_classes = scanned_jar->name_classes[ix];
     bool is_file = (file_name[file_name_length - 1] != '/');
-    if (is_file &&
-        begins_with(file_name, file_name_length, "META-INF/services/")) {
+    if (is_file && profiled_entries_) {
+      // Already written by AddProfiledEntries()?
+      const EntryInfo *entry_info = known_members_.Find(
+          file_name, file_name_length, scanned_jar->name_hashes[ix]);
+      if (entry_info != nullptr && entry_info->profiled_ &&
+          entry_info->input_jar_index_ == jar_path_index) {
+        continue;
+      }
+    }
+    if (is_file && (name_classes & EntryNameClassifier::kService)) {
       // The contents of the META-INF/services/<SERVICE> on the output is the
       // concatenation of the META-INF/services/<SERVICE> files from all inputs.
       std::string service_path(file_name, file_name_length);
       if (NewEntry(service_path)) {
         // Create a concatenator and add it to the known_members_ map.
         // The call to Merge() below will then take care of the rest.
-        Concatenator *service_handler = new Concatenator(service_path);
+        StreamingConcatenator *service_handler = new StreamingConcatenator(
+            service_path, options_->force_compression,
+            options_->combiner_memory_limit);
         service_handlers_.emplace_back(service_handler);
-        known_members_.emplace(service_path, EntryInfo{service_handler});
+        known_members_.Emplace(service_path, EntryInfo{service_handler});
       }
     } else {
       ExtraHandler(jar_entry, &input_jar_aux_label);
     }
 
     if (options_->check_desugar_deps &&
-        begins_with(file_name, file_name_length, "j$/")) {
+        (name_classes & EntryNameClassifier::kDesugarLib)) {
       diag_errx(1, "%s:%d: desugar_jdk_libs file %.*s unexpectedly found in %s",
                 __FILE__, __LINE__, file_name_length, file_name,
                 input_jar_path.c_str());
@@ -356,153 +720,597 @@ bool OutputJar::AddJar(int jar_path_index) {
     // will add either a directory entry whose handler will ignore subsequent
     // duplicates, or an ordinary plain entry, for which we save the index of
     // the first input jar (in order to provide diagnostics on duplicate).
-    auto got =
-        known_members_.emplace(std::string(file_name, file_name_length),
-                               EntryInfo{is_file ? nullptr : &null_combiner_,
-                                         is_file ? jar_path_index: -1});
+    auto got = known_members_.Emplace(
+        file_name, file_name_length, scanned_jar->name_hashes[ix],
+        EntryInfo{is_file ? nullptr : &null_combiner_,
+                  is_file ? jar_path_index : -1, jar_entry->crc32(),
+                  jar_entry->uncompressed_file_size()});
     if (!got.second) {
-      auto &entry_info = got.first->second;
+      auto &entry_info = *got.first;
       // Handle special entries (the ones that have a combiner).
       if (entry_info.combiner_ != nullptr) {
+        if (options_->verify_input_crc &&
+            entry_info.combiner_ != &null_combiner_ &&
+            !InputCrcMatches(jar_entry, lh)) {
+          ReportCorruptEntry(jar_entry, input_jar_path);
+        }
         // TODO(kmb,asmundak): Should be checking Merge() return value but fails
         // for build-data.properties when merging deploy jars into deploy jars.
         entry_info.combiner_->Merge(jar_entry, lh);
+        if (!options_->stats_output.empty() &&
+            entry_info.combiner_ != &null_combiner_) {
+          ++merge_counts_[std::string(file_name, file_name_length)];
+        }
         continue;
       }
 
       // Plain file entry. If duplicates are not allowed, bail out. Otherwise
-      // just ignore this entry.
-      if (options_->no_duplicates ||
-          (options_->no_duplicate_classes &&
-           ends_with(file_name, file_name_length, ".class"))) {
-        diag_errx(
-            1, "%s:%d: %.*s is present both in %s and %s", __FILE__, __LINE__,
-            file_name_length, file_name,
-            options_->input_jars[entry_info.input_jar_index_].first.c_str(),
-            input_jar_path.c_str());
-      } else {
-        duplicate_entries_++;
-        continue;
+      // just ignore this entry. With --ignore_identical_duplicates, only
+      // the duplicates that differ from the first copy are reported.
+      bool identical = options_->ignore_identical_duplicates &&
+                       IsIdenticalDuplicate(entry_info, jar_entry, lh);
+      const std::string &first_jar_path =
+          options_->input_jars[entry_info.input_jar_index_].first;
+      if (!identical &&
+          (options_->no_duplicates ||
+           (options_->no_duplicate_classes &&
+            (name_classes & EntryNameClassifier::kClass)))) {
+        diag_errx(1, "%s:%d: %.*s is present both in %s and %s", __FILE__,
+                  __LINE__, file_name_length, file_name,
+                  first_jar_path.c_str(), input_jar_path.c_str());
+      }
+      if (options_->ignore_identical_duplicates && !identical) {
+        diag_warnx("%s:%d: %.*s in %s differs from the one in %s, ignoring it",
+                   __FILE__, __LINE__, file_name_length, file_name,
+                   input_jar_path.c_str(), first_jar_path.c_str());
       }
+      duplicate_entries_++;
+      continue;
     }
 
-    // For the file entries, decide whether output should be compressed.
     if (is_file) {
-      bool input_compressed =
-          jar_entry->compression_method() != Z_NO_COMPRESSION;
-      bool output_compressed =
-          options_->force_compression ||
-          (options_->preserve_compression && input_compressed);
-      if (output_compressed && !options_->nocompress_suffixes.empty()) {
-        for (auto &suffix : options_->nocompress_suffixes) {
-          if (file_name_length >= suffix.size() &&
-              !strncmp(file_name + file_name_length - suffix.size(),
-                       suffix.c_str(), suffix.size())) {
-            output_compressed = false;
-            break;
+      AddPendingFileEntry(jar_entry, lh, name_classes, &pending_entries,
+                          &recompress_count);
+    } else {
+      pending_entries.emplace_back(jar_entry, lh, 0, false, false);
+    }
+  }
+  if (options_->sort_entries) {
+    std::stable_sort(pending_entries.begin(), pending_entries.end(),
+                     [](const PendingEntry &a, const PendingEntry &b) {
+                       return std::lexicographical_compare(
+                           a.cdh->file_name(),
+                           a.cdh->file_name() + a.cdh->file_name_length(),
+                           b.cdh->file_name(),
+                           b.cdh->file_name() + b.cdh->file_name_length());
+                     });
+  }
+  WritePendingEntries(input_jar, input_jar_path, &pending_entries,
+                      recompress_count);
+  return true;
+}
+
+void OutputJar::AddPendingFileEntry(const CDH *jar_entry, const LH *lh,
+                                    uint32_t name_classes,
+                                    std::vector<PendingEntry> *pending_entries,
+                                    size_t *recompress_count) const {
+  // Decide whether output should be compressed.
+  bool input_compressed = jar_entry->compression_method() != Z_NO_COMPRESSION;
+  bool output_compressed = options_->force_compression ||
+                           (options_->preserve_compression && input_compressed);
+  if (name_classes & EntryNameClassifier::kNoCompress) {
+    output_compressed = false;
+  }
+  if (input_compressed != output_compressed) {
+    pending_entries->emplace_back(
+        jar_entry, lh, Alignment(name_classes), true, output_compressed,
+        FindReusableEntry(jar_entry, output_compressed));
+    ++*recompress_count;
+  } else {
+    pending_entries->emplace_back(jar_entry, lh, Alignment(name_classes),
+                                  false, false);
+  }
+}
+
+void OutputJar::WritePendingEntries(const InputJar &input_jar,
+                                    const std::string &input_jar_path,
+                                    std::vector<PendingEntry> *pending_entries,
+                                    size_t recompress_count) {
+  // The output Central Directory grows by about as much as the input one.
+  size_t cen_growth = 0;
+  for (auto &entry : *pending_entries) {
+    cen_growth += entry.cdh->size();
+  }
+  PresizeCen(cen_growth);
+
+  // With --input_window_size, the input range of the entries is read in
+  // order and released behind the writer, a window at a time.
+  const uint64_t window_size = options_->input_window_size;
+  uint64_t window_start = 0;
+  uint64_t input_end = 0;
+  if (window_size && !pending_entries->empty()) {
+    window_start = std::numeric_limits<uint64_t>::max();
+    for (auto &entry : *pending_entries) {
+      window_start =
+          std::min(window_start, input_jar.LocalHeaderOffset(entry.lh));
+      input_end =
+          std::max(input_end, InputEntryEnd(input_jar, entry.cdh, entry.lh));
+    }
+    input_jar.AdviseSequential(window_start, input_end - window_start);
+  }
+
+  // Now write the entries out. Entries whose compression changes are
+  // inflated and deflated again ahead of the writer by the worker threads.
+  const size_t entry_count = pending_entries->size();
+  // With --verify_input_crc, they check every entry, too.
+  const bool verify = options_->verify_input_crc;
+  // Runs of entries which are copied as is are copied at once, with the last
+  // entry of the run.
+  size_t run_start = 0;
+  size_t run_end = 0;
+  blaze_util::RunOrdered(
+      recompress_count || verify ? pool_.get() : nullptr, entry_count,
+      16 * options_->threads,
+      [this, pending_entries, verify](size_t ix) {
+        PendingEntry &entry = (*pending_entries)[ix];
+        if (verify) {
+          entry.crc_ok = InputCrcMatches(entry.cdh, entry.lh);
+          if (!entry.crc_ok) {
+            return;
           }
         }
-      }
-      if (input_compressed != output_compressed) {
-        Concatenator combiner(jar_entry->file_name_string());
-        if (!combiner.Merge(jar_entry, lh)) {
-          diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
-                   jar_entry->file_name_length(), jar_entry->file_name());
+        if (entry.reuse) {
+          entry.recompressed = ReuseEntry(entry.reuse);
+        } else if (entry.recompress) {
+          entry.recompressed = Recompress(entry.cdh, entry.lh,
+                                          entry.output_compressed);
         }
-        WriteEntry(combiner.OutputEntry(output_compressed));
-        continue;
+      },
+      [&](size_t ix) {
+        PendingEntry &entry = (*pending_entries)[ix];
+        if (!entry.crc_ok) {
+          ReportCorruptEntry(entry.cdh, input_jar_path);
+        }
+        off_t entry_position = Position();
+        if (entry.recompress) {
+          if (entry.reuse) {
+            ++reused_entries_;
+          }
+          WriteEntry(entry.recompressed);
+          entry.recompressed = nullptr;
+          bytes_recompressed_ += Position() - entry_position;
+        } else {
+          if (ix >= run_end) {
+            run_start = ix;
+            run_end = ix + std::max<size_t>(
+                               PlainEntryRun(&entry, entry_count - ix), 1);
+          }
+          if (ix + 1 < run_end) {
+            return true;
+          }
+          if (run_end - run_start > 1) {
+            CopyPlainEntries(input_jar, input_jar_path,
+                             &(*pending_entries)[run_start],
+                             run_end - run_start);
+          } else {
+            CopyEntry(input_jar, input_jar_path, entry.cdh, entry.lh,
+                      entry.alignment);
+          }
+          bytes_copied_ += Position() - entry_position;
+        }
+        if (window_size) {
+          uint64_t end = InputEntryEnd(input_jar, entry.cdh, entry.lh);
+          if (end >= window_start + window_size) {
+            input_jar.Release(window_start, end - window_start);
+            window_start = end;
+          }
+        }
+        return true;
+      });
+  if (window_size && input_end > window_start) {
+    input_jar.Release(window_start, input_end - window_start);
+  }
+}
+
+bool OutputJar::IsIdenticalDuplicate(const EntryInfo &first_copy,
+                                     const CDH *jar_entry, const LH *lh) {
+  // Cheap check first: both are in the Central Directory.
+  if (first_copy.crc32_ != jar_entry->crc32() ||
+      first_copy.size_ != jar_entry->uncompressed_file_size()) {
+    return false;
+  }
+  if (!options_->compare_duplicate_contents) {
+    return true;
+  }
+  RetainedJar &retained = retained_jars_[first_copy.input_jar_index_];
+  if (!retained.entries) {
+    retained.entries.reset(
+        new EntryNameTable<std::pair<const CDH *, const LH *> >());
+    for (auto &entry : retained.jar->entries) {
+      retained.entries->Emplace(entry.first->file_name(),
+                                entry.first->file_name_length(),
+                                EntryNameTable<EntryInfo>::Hash(
+                                    entry.first->file_name(),
+                                    entry.first->file_name_length()),
+                                entry);
+    }
+  }
+  const char *file_name = jar_entry->file_name();
+  auto file_name_length = jar_entry->file_name_length();
+  auto *original = retained.entries->Find(
+      file_name, file_name_length,
+      EntryNameTable<EntryInfo>::Hash(file_name, file_name_length));
+  return original != nullptr &&
+         SameContents(original->first, original->second, jar_entry, lh);
+}
+
+bool OutputJar::SameContents(const CDH *cdh1, const LH *lh1, const CDH *cdh2,
+                             const LH *lh2) {
+  // Identical entries are usually encoded the same way, then there is no
+  // need to inflate them.
+  if (cdh1->compression_method() == cdh2->compression_method() &&
+      cdh1->compressed_file_size() == cdh2->compressed_file_size() &&
+      !memcmp(lh1->data(), lh2->data(), cdh1->compressed_file_size())) {
+    return true;
+  }
+  Concatenator contents1(cdh1->file_name_string(), false);
+  Concatenator contents2(cdh2->file_name_string(), false);
+  if (!contents1.Merge(cdh1, lh1) || !contents2.Merge(cdh2, lh2)) {
+    return false;
+  }
+  if (contents1.contents() == nullptr || contents2.contents() == nullptr) {
+    return contents1.data_size() == contents2.data_size();
+  }
+  std::string bytes1, bytes2;
+  contents1.contents()->stream_out(
+      [&bytes1](const void *chunk, uint64_t chunk_size) {
+        bytes1.append(reinterpret_cast<const char *>(chunk), chunk_size);
+      });
+  contents2.contents()->stream_out(
+      [&bytes2](const void *chunk, uint64_t chunk_size) {
+        bytes2.append(reinterpret_cast<const char *>(chunk), chunk_size);
+      });
+  return bytes1 == bytes2;
+}
+
+bool OutputJar::InputCrcMatches(const CDH *jar_entry, const LH *lh) {
+  const uint8_t *data = lh->data();
+  uint64_t size = jar_entry->uncompressed_file_size();
+  uint32_t crc = 0;
+  if (jar_entry->compression_method() == Z_NO_COMPRESSION) {
+    if (jar_entry->compressed_file_size() != size) {
+      return false;
+    }
+    crc = Crc32(crc, data, size);
+  } else if (jar_entry->compression_method() == Z_DEFLATED) {
+    InflaterPool::Ptr inflater = InflaterPool::Get();
+    uint64_t in_left = jar_entry->compressed_file_size();
+    uint64_t inflated = 0;
+    uint8_t buffer[64 << 10];
+    int ret;
+    do {
+      if (inflater->available_in() == 0) {
+        if (in_left == 0) {
+          return false;  // Truncated.
+        }
+        // A single region to inflate cannot exceed 4GB-1.
+        uint32_t chunk_size = static_cast<uint32_t>(
+            std::min(in_left, static_cast<uint64_t>(0xFFFFFFFF)));
+        inflater->DataToInflate(data, chunk_size);
+        data += chunk_size;
+        in_left -= chunk_size;
       }
+      ret = inflater->Inflate(buffer, sizeof(buffer));
+      if (ret != Z_OK && ret != Z_STREAM_END) {
+        return false;
+      }
+      size_t chunk_size = sizeof(buffer) - inflater->available_out();
+      crc = Crc32(crc, buffer, chunk_size);
+      inflated += chunk_size;
+    } while (ret != Z_STREAM_END);
+    if (inflated != size) {
+      return false;
     }
+  } else {
+    return false;
+  }
+  return crc == jar_entry->crc32();
+}
 
-    // Now we have to copy:
-    //  local header
-    //  file data
-    //  data descriptor, if present.
-    off_t copy_from = jar_entry->local_header_offset();
-    size_t num_bytes = lh->size();
-    if (jar_entry->no_size_in_local_header()) {
-      const DDR *ddr = reinterpret_cast<const DDR *>(
-          lh->data() + jar_entry->compressed_file_size());
-      num_bytes +=
-          jar_entry->compressed_file_size() +
-          ddr->size(
-              ziph::zfield_has_ext64(jar_entry->compressed_file_size32()),
-              ziph::zfield_has_ext64(jar_entry->uncompressed_file_size32()));
-    } else {
-      num_bytes += lh->compressed_file_size();
-    }
-    off_t local_header_offset = Position();
-
-    // When normalize_timestamps is set, entry's timestamp is to be set to
-    // 01/01/1980 00:00:00 (or to 01/01/1980 00:00:02, if an entry is a .class
-    // file). This is somewhat expensive because we have to copy the local
-    // header to memory as input jar is memory mapped as read-only. Try to copy
-    // as little as possible.
-    uint16_t normalized_time = 0;
-    const UnixTimeExtraField *lh_field_to_remove = nullptr;
-    bool fix_timestamp = false;
-    if (options_->normalize_timestamps) {
-      if (ends_with(file_name, file_name_length, ".class")) {
-        normalized_time = 1;
+void *OutputJar::Recompress(const CDH *jar_entry, const LH *lh,
+                            bool output_compressed) {
+  Concatenator combiner(jar_entry->file_name_string());
+  if (!combiner.Merge(jar_entry, lh)) {
+    diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
+             jar_entry->file_name_length(), jar_entry->file_name());
+  }
+  return combiner.OutputEntry(output_compressed);
+}
+
+bool OutputJar::OpenIncrementalBase() {
+  const char *base_path = options_->incremental_base.c_str();
+  // Opening the output truncates it, the base has to be a different file.
+  struct stat base_stat, output_stat;
+  if (stat(base_path, &base_stat)) {
+    diag_warn("%s:%d: %s", __FILE__, __LINE__, base_path);
+    return false;
+  }
+  if (!stat(path(), &output_stat) && base_stat.st_dev == output_stat.st_dev &&
+      base_stat.st_ino == output_stat.st_ino) {
+    diag_warnx("%s:%d: %s cannot be the incremental base for itself",
+               __FILE__, __LINE__, path());
+    return false;
+  }
+  incremental_base_.reset(new IndexedInputJar());
+  if (!incremental_base_->Open(options_->incremental_base)) {
+    return false;
+  }
+  for (auto &entry : incremental_base_->entries) {
+    incremental_base_entries_.emplace(entry.first->file_name_string(),
+                                      entry.first);
+  }
+  if (options_->verbose) {
+    fprintf(stderr, "Incremental base %s has %ld entries\n", base_path,
+            incremental_base_entries_.size());
+  }
+  return true;
+}
+
+const CDH *OutputJar::FindReusableEntry(const CDH *jar_entry,
+                                        bool output_compressed) const {
+  if (incremental_base_entries_.empty()) {
+    return nullptr;
+  }
+  auto it = incremental_base_entries_.find(jar_entry->file_name_string());
+  if (it == incremental_base_entries_.end()) {
+    return nullptr;
+  }
+  // The contents is considered to be the same if both CRC and size match.
+  // Huge entries are never reused, they need Zip64 extra field.
+  const CDH *base_entry = it->second;
+  uint64_t size = jar_entry->uncompressed_file_size();
+  if (base_entry->crc32() != jar_entry->crc32() ||
+      base_entry->uncompressed_file_size() != size ||
+      ziph::zfield_needs_ext64(size)) {
+    return nullptr;
+  }
+  // Recompress() output has no extra fields, and its payload is deflated
+  // by us iff the output has to be compressed. An entry that has been copied
+  // from some input jar as is may have been deflated by some other tool, so
+  // its payload cannot be reused.
+  const LH *base_lh = incremental_base_->input_jar.LocalHeader(base_entry);
+  if (!base_lh->is() || base_lh->version() != 20 || base_lh->bit_flag() ||
+      base_lh->extra_fields_length() || base_entry->extra_fields_length()) {
+    return nullptr;
+  }
+  uint16_t method = base_entry->compression_method();
+  if (output_compressed ? method != Z_DEFLATED : method != Z_NO_COMPRESSION) {
+    return nullptr;
+  }
+  return base_entry;
+}
+
+void *OutputJar::ReuseEntry(const CDH *base_entry) const {
+  const LH *base_lh = incremental_base_->input_jar.LocalHeader(base_entry);
+  size_t name_length = base_entry->file_name_length();
+  size_t compressed_size = base_entry->compressed_file_size();
+  LH *lh = reinterpret_cast<LH *>(
+      malloc(sizeof(LH) + name_length + compressed_size));
+  if (lh == nullptr) {
+    diag_err(1, "%s:%d: cannot allocate %ld bytes for %.*s", __FILE__,
+             __LINE__, sizeof(LH) + name_length + compressed_size,
+             static_cast<int>(name_length), base_entry->file_name());
+  }
+  // Same Local Header as the one created by Concatenator::OutputEntry.
+  lh->signature();
+  lh->version(20);
+  lh->bit_flag(0x0);
+  lh->last_mod_file_time(1);   // 00:00:01
+  lh->last_mod_file_date(33);  // 1980-01-01
+  lh->crc32(base_entry->crc32());
+  lh->compressed_file_size32(compressed_size);
+  lh->uncompressed_file_size32(base_entry->uncompressed_file_size());
+  lh->file_name(base_entry->file_name(), name_length);
+  lh->extra_fields(nullptr, 0);
+  lh->compression_method(base_entry->compression_method());
+  memcpy(lh->data(), base_lh->data(), compressed_size);
+  return lh;
+}
+
+// Returns the size of the input entry: the local header, the file data and
+// the data descriptor, if present.
+static size_t EntrySize(const CDH *jar_entry, const LH *lh) {
+  size_t num_bytes = lh->size();
+  if (jar_entry->no_size_in_local_header()) {
+    const DDR *ddr = reinterpret_cast<const DDR *>(
+        lh->data() + jar_entry->compressed_file_size());
+    num_bytes +=
+        jar_entry->compressed_file_size() +
+        ddr->size(
+            ziph::zfield_has_ext64(jar_entry->compressed_file_size32()),
+            ziph::zfield_has_ext64(jar_entry->uncompressed_file_size32()));
+  } else {
+    num_bytes += lh->compressed_file_size();
+  }
+  return num_bytes;
+}
+
+bool OutputJar::NeedsTimestampFix(const CDH *jar_entry, const LH *lh,
+                                  uint16_t *normalized_time) const {
+  *normalized_time = 0;
+  if (!options_->normalize_timestamps) {
+    return false;
+  }
+  if (ends_with(jar_entry->file_name(), jar_entry->file_name_length(),
+                ".class")) {
+    *normalized_time = 1;
+  }
+  return jar_entry->last_mod_file_date() != 33 ||
+         jar_entry->last_mod_file_time() != *normalized_time ||
+         lh->unix_time_extra_field() != nullptr;
+}
+
+void OutputJar::CopyEntry(const InputJar &input_jar,
+                          const std::string &input_jar_path,
+                          const CDH *jar_entry, const LH *lh,
+                          uint32_t alignment) {
+  const char *file_name = jar_entry->file_name();
+  auto file_name_length = jar_entry->file_name_length();
+  off_t copy_from = jar_entry->local_header_offset();
+  size_t num_bytes = EntrySize(jar_entry, lh);
+  off_t local_header_offset = Position();
+
+  // Fixing the timestamp or aligning the data is somewhat expensive because
+  // we have to copy the local header to memory as input jar is memory mapped
+  // as read-only. Try to copy as little as possible.
+  uint16_t normalized_time;
+  bool fix_timestamp =
+      NeedsTimestampFix(jar_entry, lh, &normalized_time);
+  const UnixTimeExtraField *lh_field_to_remove =
+      fix_timestamp ? lh->unix_time_extra_field() : nullptr;
+  size_t removed_size =
+      lh_field_to_remove != nullptr ? lh_field_to_remove->size() : 0;
+  alignment = DataAlignment(jar_entry->compression_method(),
+                            jar_entry->compressed_file_size(), alignment);
+  size_t padding = AlignmentExtraField::padding_needed(
+      local_header_offset + lh->size() - removed_size, alignment);
+  if (lh->extra_fields_length() - removed_size + padding > 0xFFFF) {
+    padding = 0;  // No room for the padding.
+  }
+  if (fix_timestamp || padding > 0) {
+    uint8_t lh_buffer[512];
+    size_t lh_size = lh->size();
+    LH *lh_new = lh_size + padding > sizeof(lh_buffer)
+                     ? reinterpret_cast<LH *>(malloc(lh_size + padding))
+                     : reinterpret_cast<LH *>(lh_buffer);
+    // Remove Unix timestamp field.
+    if (lh_field_to_remove != nullptr) {
+      auto from_end = ziph::byte_ptr(lh) + lh->size();
+      size_t chunk1_size =
+          ziph::byte_ptr(lh_field_to_remove) - ziph::byte_ptr(lh);
+      size_t chunk2_size = lh->size() - (chunk1_size + removed_size);
+      memcpy(lh_new, lh, chunk1_size);
+      if (chunk2_size) {
+        memcpy(reinterpret_cast<uint8_t *>(lh_new) + chunk1_size,
+               from_end - chunk2_size, chunk2_size);
       }
-      lh_field_to_remove = lh->unix_time_extra_field();
-      fix_timestamp = jar_entry->last_mod_file_date() != 33 ||
-                      jar_entry->last_mod_file_time() != normalized_time ||
-                      lh_field_to_remove != nullptr;
+      lh_new->extra_fields(lh_new->extra_fields(),
+                           lh->extra_fields_length() - removed_size);
+    } else {
+      memcpy(lh_new, lh, lh_size);
     }
     if (fix_timestamp) {
-      uint8_t lh_buffer[512];
-      size_t lh_size = lh->size();
-      LH *lh_new = lh_size > sizeof(lh_buffer)
-                       ? reinterpret_cast<LH *>(malloc(lh_size))
-                       : reinterpret_cast<LH *>(lh_buffer);
-      // Remove Unix timestamp field.
-      if (lh_field_to_remove != nullptr) {
-        auto from_end = ziph::byte_ptr(lh) + lh->size();
-        size_t removed_size = lh_field_to_remove->size();
-        size_t chunk1_size =
-            ziph::byte_ptr(lh_field_to_remove) - ziph::byte_ptr(lh);
-        size_t chunk2_size = lh->size() - (chunk1_size + removed_size);
-        memcpy(lh_new, lh, chunk1_size);
-        if (chunk2_size) {
-          memcpy(reinterpret_cast<uint8_t *>(lh_new) + chunk1_size,
-                 from_end - chunk2_size, chunk2_size);
-        }
-        lh_new->extra_fields(lh_new->extra_fields(),
-                             lh->extra_fields_length() - removed_size);
-      } else {
-        memcpy(lh_new, lh, lh_size);
-      }
       lh_new->last_mod_file_date(33);
       lh_new->last_mod_file_time(normalized_time);
-      // Now write these few bytes and adjust read/write positions accordingly.
-      if (!WriteBytes(lh_new, lh_new->size())) {
-        diag_err(1, "%s:%d: Cannot copy modified local header for %.*s",
-                 __FILE__, __LINE__, file_name_length, file_name);
-      }
-      copy_from += lh_size;
-      num_bytes -= lh_size;
-      if (reinterpret_cast<uint8_t *>(lh_new) != lh_buffer) {
-        free(lh_new);
-      }
     }
+    if (padding > 0) {
+      reinterpret_cast<AlignmentExtraField *>(lh_new->data())
+          ->fill(alignment, padding);
+      lh_new->extra_fields(lh_new->extra_fields(),
+                           lh_new->extra_fields_length() + padding);
+    }
+    // Now write these few bytes and adjust read/write positions accordingly.
+    if (!WriteBytes(lh_new, lh_new->size())) {
+      diag_err(1, "%s:%d: Cannot copy modified local header for %.*s",
+               __FILE__, __LINE__, file_name_length, file_name);
+    }
+    copy_from += lh_size;
+    num_bytes -= lh_size;
+    if (reinterpret_cast<uint8_t *>(lh_new) != lh_buffer) {
+      free(lh_new);
+    }
+  }
+
+  if (!CopyInputBytes(input_jar, copy_from, num_bytes)) {
+    diag_err(1, "%s:%d: Cannot write %ld bytes of %.*s from %s", __FILE__,
+             __LINE__, num_bytes, file_name_length, file_name,
+             input_jar_path.c_str());
+  }
+
+  AppendToDirectoryBuffer(jar_entry, local_header_offset, normalized_time,
+                          fix_timestamp);
+  ++entries_;
+}
 
-    // Do the actual copy.
-    if (!WriteBytes(input_jar.mapped_start() + copy_from, num_bytes)) {
-      diag_err(1, "%s:%d: Cannot write %ld bytes of %.*s from %s", __FILE__,
-               __LINE__, num_bytes, file_name_length, file_name,
-               input_jar_path.c_str());
+size_t OutputJar::PlainEntryRun(const PendingEntry *entries,
+                                size_t count) const {
+  off_t run_start = entries[0].cdh->local_header_offset();
+  off_t output_start = outpos_;
+  off_t run_end = run_start;
+  const uint8_t *next_cdh = ziph::byte_ptr(entries[0].cdh);
+  size_t ix = 0;
+  for (; ix < count; ++ix) {
+    const PendingEntry &entry = entries[ix];
+    uint16_t normalized_time;
+    if (entry.recompress || ziph::byte_ptr(entry.cdh) != next_cdh ||
+        entry.cdh->local_header_offset() != static_cast<uint64_t>(run_end) ||
+        entry.cdh->zip64_extra_field() != nullptr ||
+        NeedsTimestampFix(entry.cdh, entry.lh, &normalized_time)) {
+      break;
+    }
+    // The data has to land on its alignment as is.
+    if (AlignmentExtraField::padding_needed(
+            output_start + (run_end - run_start) + entry.lh->size(),
+            DataAlignment(entry.cdh->compression_method(),
+                          entry.cdh->compressed_file_size(),
+                          entry.alignment)) > 0) {
+      break;
+    }
+    off_t entry_end = run_end + EntrySize(entry.cdh, entry.lh);
+    // The output offsets of the entries have to fit into 32 bits, too.
+    if (ziph::zfield_needs_ext64(output_start + (entry_end - run_start))) {
+      break;
     }
+    run_end = entry_end;
+    next_cdh += entry.cdh->size();
+  }
+  return ix;
+}
 
-    AppendToDirectoryBuffer(jar_entry, local_header_offset, normalized_time,
-                            fix_timestamp);
-    ++entries_;
+void OutputJar::CopyPlainEntries(const InputJar &input_jar,
+                                 const std::string &input_jar_path,
+                                 const PendingEntry *entries, size_t count) {
+  off_t copy_from = entries[0].cdh->local_header_offset();
+  const PendingEntry &last = entries[count - 1];
+  size_t num_bytes = last.cdh->local_header_offset() +
+                     EntrySize(last.cdh, last.lh) - copy_from;
+  off_t local_header_offset = Position();
+  if (!CopyInputBytes(input_jar, copy_from, num_bytes)) {
+    diag_err(1, "%s:%d: Cannot write %ld bytes of %d entries from %s",
+             __FILE__, __LINE__, num_bytes, static_cast<int>(count),
+             input_jar_path.c_str());
   }
-  return input_jar.Close();
+
+  // The Central Directory Headers of the entries are adjacent in the input,
+  // too, and they need no changes but for the local header offsets.
+  const uint8_t *first_cdh = ziph::byte_ptr(entries[0].cdh);
+  size_t cen_bytes = ziph::byte_ptr(last.cdh) + last.cdh->size() - first_cdh;
+  uint8_t *out_cdh = ReserveCdr(cen_bytes);
+  memcpy(out_cdh, first_cdh, cen_bytes);
+  uint32_t delta = static_cast<uint32_t>(local_header_offset - copy_from);
+  for (uint8_t *cdh_ptr = out_cdh; cdh_ptr < out_cdh + cen_bytes;) {
+    CDH *cdh = reinterpret_cast<CDH *>(cdh_ptr);
+    cdh->local_header_offset32(cdh->local_header_offset32() + delta);
+    cdh_ptr += cdh->size();
+  }
+  entries_ += count;
+}
+
+bool OutputJar::CopyInputBytes(const InputJar &input_jar, off_t offset,
+                               size_t count) {
+  // Large ranges are copied from file to file by the kernel, small ones are
+  // cheaper to copy from the mapped input. A mapped output is always copied
+  // to directly, and so is an input held in memory.
+  if (count >= kKernelCopyThreshold && !mapped_output_ &&
+      input_jar.fd() >= 0) {
+    return AppendFile(input_jar.fd(), offset, count) ==
+           static_cast<ssize_t>(count);
+  }
+  return WriteBytes(input_jar.mapped_start() + offset, count);
 }
 
 off_t OutputJar::Position() {
-  if (file_ == nullptr) {
+  if (!IsOpen()) {
     diag_err(1, "%s:%d: output file is not open", __FILE__, __LINE__);
   }
   // You'd think this could be "return ftell(file_);", but that
@@ -511,6 +1319,30 @@ off_t OutputJar::Position() {
   return outpos_;
 }
 
+// Returns the alignment of the data of a stored entry whose name has the
+// given classes: a page for --page_align_suffixes, else that of --align.
+uint32_t OutputJar::Alignment(uint32_t name_classes) const {
+  uint32_t alignment = options_->alignment;
+  if (name_classes & EntryNameClassifier::kPageAlign) {
+    alignment = std::max(alignment, kPageAlignment);
+  }
+  return alignment;
+}
+
+// Returns the alignment of the data of an entry given the alignment it has if
+// it is stored: --chunk_align applies to any entry with data.
+uint32_t OutputJar::DataAlignment(uint16_t compression_method,
+                                  uint64_t data_size,
+                                  uint32_t alignment) const {
+  if (compression_method != Z_NO_COMPRESSION) {
+    alignment = 0;
+  }
+  if (data_size > 0) {
+    alignment = std::max(alignment, options_->chunk_alignment);
+  }
+  return alignment;
+}
+
 // Writes an entry. The argument is the pointer to the contiguous block of
 // memory containing Local Header for the entry, immediately followed by
 // the data. The memory is freed after the data has been written.
@@ -519,6 +1351,110 @@ void OutputJar::WriteEntry(void *buffer) {
     return;
   }
   LH *entry = reinterpret_cast<LH *>(buffer);
+  PrepareEntryHeader(entry);
+  off_t output_position = Position();
+  WriteLocalHeader(entry);
+  if (!WriteBytes(entry->data(), entry->in_zip_size())) {
+    diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+  }
+  AppendEntryToDirectory(entry, output_position);
+  free(reinterpret_cast<void *>(entry));
+}
+
+void OutputJar::WriteLocalHeader(const LH *entry) {
+  off_t output_position = Position();
+  size_t padding = 0;
+  uint32_t alignment = 0;
+  const char *name = entry->file_name();
+  size_t name_length = entry->file_name_length();
+  if (name_length > 0 && name[name_length - 1] != '/') {
+    alignment = DataAlignment(
+        entry->compression_method(), entry->in_zip_size(),
+        entry->compression_method() == Z_NO_COMPRESSION
+            ? Alignment(options_->entry_name_classifier.Classify(name,
+                                                                 name_length))
+            : 0);
+    padding = AlignmentExtraField::padding_needed(
+        output_position + entry->size(), alignment);
+    if (entry->extra_fields_length() + padding > 0xFFFF) {
+      padding = 0;  // No room for the padding.
+    }
+  }
+  if (padding > 0) {
+    // The Local Header gets the padding, the Central Directory Header does
+    // not: write the header separately from the data.
+    std::unique_ptr<uint8_t[]> header(new uint8_t[entry->size() + padding]);
+    LH *padded = reinterpret_cast<LH *>(header.get());
+    memcpy(padded, entry, entry->size());
+    reinterpret_cast<AlignmentExtraField *>(padded->data())
+        ->fill(alignment, padding);
+    padded->extra_fields(padded->extra_fields(),
+                         padded->extra_fields_length() + padding);
+    if (!WriteBytes(padded, padded->size())) {
+      diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+    }
+  } else if (!WriteBytes(entry, entry->size())) {
+    diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+  }
+}
+
+void OutputJar::WriteStoredFile(const std::string &entry_name,
+                                const std::string &path) {
+  MappedFile file;
+  if (!file.Open(path)) {
+    diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path.c_str());
+  }
+  const size_t size = file.size();
+  // OutputJar cannot write Zip64 combined entries yet.
+  if (ziph::zfield_needs_ext64(size)) {
+    diag_errx(1, "%s:%d: %s is too large (%zu bytes)", __FILE__, __LINE__,
+              path.c_str(), size);
+  }
+  std::unique_ptr<uint8_t[]> header(
+      new uint8_t[sizeof(LH) + entry_name.size()]);
+  LH *lh = reinterpret_cast<LH *>(header.get());
+  lh->signature();
+  lh->version(20);
+  lh->bit_flag(0x0);
+  lh->last_mod_file_time(1);   // 00:00:01
+  lh->last_mod_file_date(33);  // 1980-01-01
+  lh->crc32(Crc32(0, file.start(), size));
+  lh->compressed_file_size32(size);
+  lh->uncompressed_file_size32(size);
+  lh->file_name(entry_name.c_str(), entry_name.size());
+  lh->extra_fields(nullptr, 0);
+  lh->compression_method(Z_NO_COMPRESSION);
+  PrepareEntryHeader(lh);
+  off_t output_position = Position();
+  WriteLocalHeader(lh);
+  if (AppendFile(file.fd(), 0, size) != static_cast<ssize_t>(size)) {
+    diag_err(1, "%s:%d: cannot copy %s", __FILE__, __LINE__, path.c_str());
+  }
+  AppendEntryToDirectory(lh, output_position);
+}
+
+// Writes the entry a StreamingConcatenator has spilled to a temporary file,
+// copying the payload from that file.
+void OutputJar::WriteSpilledEntry(StreamingConcatenator *combiner) {
+  LH *entry = reinterpret_cast<LH *>(combiner->SpilledEntryHeader());
+  if (entry == nullptr) {
+    diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
+  }
+  PrepareEntryHeader(entry);
+  off_t output_position = Position();
+  WriteLocalHeader(entry);
+  size_t payload_size = combiner->spilled_size();
+  if (AppendFile(combiner->spill_fd(), 0, payload_size) !=
+      static_cast<ssize_t>(payload_size)) {
+    diag_err(1, "%s:%d: cannot copy %s", __FILE__, __LINE__,
+             combiner->filename().c_str());
+  }
+  AppendEntryToDirectory(entry, output_position);
+  free(reinterpret_cast<void *>(entry));
+}
+
+// Reports the combined entry if requested and sets its timestamp.
+void OutputJar::PrepareEntryHeader(LH *entry) {
   if (options_->verbose) {
     fprintf(stderr, "%-.*s combiner has %lu bytes, %s to %lu\n",
             entry->file_name_length(), entry->file_name(),
@@ -551,13 +1487,13 @@ void OutputJar::WriteEntry(void *buffer) {
     entry->last_mod_file_time(dos_time);
     entry->last_mod_file_date(dos_date);
   }
+}
 
-  uint8_t *data = reinterpret_cast<uint8_t *>(entry);
-  off_t output_position = Position();
-  if (!WriteBytes(data, entry->data() + entry->in_zip_size() - data)) {
-    diag_err(1, "%s:%d: write", __FILE__, __LINE__);
-  }
-  // Data written, allocate CDH space and populate CDH.
+// Creates the Central Directory Header for the entry written at the given
+// output position.
+void OutputJar::AppendEntryToDirectory(const LH *entry,
+                                       off_t output_position) {
+  // Allocate CDH space and populate CDH.
   // Space needed for the CDH varies depending on whether output position field
   // fits into 32 bits (we do not handle compressed/uncompressed entry sizes
   // exceeding 32 bits at the moment).
@@ -602,7 +1538,6 @@ void OutputJar::WriteEntry(void *buffer) {
   cdh->internal_attributes(0);
   cdh->external_attributes(0);
   ++entries_;
-  free(reinterpret_cast<void *>(entry));
 }
 
 void OutputJar::WriteMetaInf() {
@@ -633,7 +1568,7 @@ void OutputJar::WriteDirEntry(const std::string &name,
   lh->uncompressed_file_size32(0);
   lh->file_name(name.c_str(), name.size());
   lh->extra_fields(extra_fields, n_extra_fields);
-  known_members_.emplace(name, EntryInfo{&null_combiner_});
+  known_members_.Emplace(name, EntryInfo{&null_combiner_});
   WriteEntry(lh);
 }
 
@@ -745,16 +1680,21 @@ void OutputJar::AppendToDirectoryBuffer(const CDH *cdh, off_t lh_pos,
   }
 }
 
-uint8_t *OutputJar::ReserveCdr(size_t chunk_size) {
-  if (cen_size_ + chunk_size > cen_capacity_) {
-    cen_capacity_ += 1000000;
-    cen_ = reinterpret_cast<uint8_t *>(realloc(cen_, cen_capacity_));
-    if (!cen_) {
-      diag_errx(1, "%s:%d: Cannot allocate %ld bytes for the directory",
-                __FILE__, __LINE__, cen_capacity_);
-    }
+// The minimum size of a CEN block.
+static const size_t kCenBlockSize = 1000000;
+
+void OutputJar::PresizeCen(size_t size) {
+  if (cen_blocks_.empty() ||
+      cen_blocks_.back().size + size > cen_blocks_.back().capacity) {
+    cen_blocks_.emplace_back(std::max(size, kCenBlockSize));
   }
-  uint8_t *entry = cen_ + cen_size_;
+}
+
+uint8_t *OutputJar::ReserveCdr(size_t chunk_size) {
+  PresizeCen(chunk_size);
+  CenBlock &block = cen_blocks_.back();
+  uint8_t *entry = block.data.get() + block.size;
+  block.size += chunk_size;
   cen_size_ += chunk_size;
   return entry;
 }
@@ -763,14 +1703,53 @@ uint8_t *OutputJar::ReserveCdh(size_t size) {
   return static_cast<uint8_t *>(memset(ReserveCdr(size), 0, size));
 }
 
+// Writes META-INF/INDEX.LIST the way `jar -i' does: the packages are the
+// directories of the entries (or the names of the top level entries), in
+// the order they first appear in the Central Directory. Everything else is
+// written by then.
+void OutputJar::WriteJarIndex() {
+  Concatenator jar_index(kJarIndexName);
+  jar_index.Append("JarIndex-Version: 1.0\n\n");
+  jar_index.Append(Basename(options_->output_jar));
+  jar_index.Append("\n");
+  std::unordered_set<std::string> packages;
+  for (auto &block : cen_blocks_) {
+    const uint8_t *cdh_ptr = block.data.get();
+    while (cdh_ptr < block.data.get() + block.size) {
+      const CDH *cdh = reinterpret_cast<const CDH *>(cdh_ptr);
+      cdh_ptr += cdh->size();
+      std::string name(cdh->file_name(), cdh->file_name_length());
+      if (name == "META-INF/" || name == "META-INF/MANIFEST.MF" ||
+          name.compare(0, 18, "META-INF/versions/") == 0) {
+        continue;
+      }
+      size_t pos = name.rfind('/');
+      if (pos != std::string::npos) {
+        name.resize(pos);
+      }
+      if (packages.insert(name).second) {
+        jar_index.Append(name);
+        jar_index.Append("\n");
+      }
+    }
+  }
+  jar_index.Append("\n");
+  WriteEntry(jar_index.OutputEntry(options_->force_compression));
+}
+
 // Write out combined jar.
 bool OutputJar::Close() {
-  if (file_ == nullptr) {
+  if (!IsOpen()) {
     return true;
   }
 
+  double combine_time = Now();
   for (auto &service_handler : service_handlers_) {
-    WriteEntry(service_handler->OutputEntry(options_->force_compression));
+    if (service_handler->spilled()) {
+      WriteSpilledEntry(service_handler.get());
+    } else {
+      WriteEntry(service_handler->OutputEntry(options_->force_compression));
+    }
   }
   for (auto &extra_combiner : extra_combiners_) {
     WriteEntry(extra_combiner->OutputEntry(options_->force_compression));
@@ -778,7 +1757,12 @@ bool OutputJar::Close() {
   WriteEntry(spring_handlers_.OutputEntry(options_->force_compression));
   WriteEntry(spring_schemas_.OutputEntry(options_->force_compression));
   WriteEntry(protobuf_meta_handler_.OutputEntry(options_->force_compression));
+  if (options_->jar_index) {
+    WriteJarIndex();
+  }
   // TODO(asmundak): handle manifest;
+  double close_time = Now();
+  phase_times_.combine = close_time - combine_time;
   off_t output_position = Position();
   bool write_zip64_ecd = output_position >= 0xFFFFFFFF || entries_ >= 0xFFFF ||
                          cen_size_ >= 0xFFFFFFFF;
@@ -828,29 +1812,170 @@ bool OutputJar::Close() {
   }
 
   // Save Central Directory and wrap up.
-  if (!WriteBytes(cen_, cen_size_)) {
-    diag_err(1, "%s:%d: Cannot write central directory", __FILE__, __LINE__);
+  for (auto &block : cen_blocks_) {
+    if (!WriteBytes(block.data.get(), block.size)) {
+      diag_err(1, "%s:%d: Cannot write central directory", __FILE__,
+               __LINE__);
+    }
+    block.data.reset();
   }
-  free(cen_);
+  cen_blocks_.clear();
 
-  if (fclose(file_)) {
+  if (mapped_output_) {
+    if (!mapped_output_->Close()) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
+    }
+    mapped_output_.reset();
+  } else if (fclose(file_)) {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
   }
   file_ = nullptr;
   // Free the buffer only after fclose(); stdio may flush data from the
   // buffer on close.
   buffer_.reset();
+  phase_times_.close = Now() - close_time;
 
   if (options_->verbose) {
     fprintf(stderr, "Wrote %s with %d entries", path(), entries_);
     if (duplicate_entries_) {
       fprintf(stderr, ", skipped %d entries", duplicate_entries_);
     }
+    if (reused_entries_) {
+      fprintf(stderr, ", reused %d entries of %s", reused_entries_,
+              options_->incremental_base.c_str());
+    }
     fprintf(stderr, "\n");
   }
   return true;
 }
 
+// Writes the string as a JSON string literal.
+static void WriteJsonString(FILE *file, const std::string &str) {
+  fputc('"', file);
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+bool OutputJar::WriteStats() const {
+  const char *stats_path = options_->stats_output.c_str();
+  FILE *file = fopen(stats_path, "w");
+  if (file == nullptr) {
+    diag_warn("%s:%d: %s", __FILE__, __LINE__, stats_path);
+    return false;
+  }
+  fprintf(file, "{\n  \"output\": ");
+  WriteJsonString(file, options_->output_jar);
+  fprintf(file,
+          ",\n  \"entries\": %d,\n  \"duplicate_entries\": %d,\n"
+          "  \"reused_entries\": %d,\n  \"profiled_entries\": %d,\n"
+          "  \"bytes_copied\": %" PRIu64 ",\n"
+          "  \"bytes_recompressed\": %" PRIu64 ",\n"
+          "  \"cen_size\": %zu,\n  \"output_size\": %" PRIu64 ",\n",
+          entries_, duplicate_entries_, reused_entries_, profiled_entries_,
+          bytes_copied_, bytes_recompressed_, cen_size_,
+          static_cast<uint64_t>(outpos_));
+  fprintf(file,
+          "  \"seconds\": {\"open\": %.6f, \"scan\": %.6f, "
+          "\"write\": %.6f, \"combine\": %.6f, \"close\": %.6f},\n",
+          phase_times_.open, phase_times_.scan, phase_times_.write,
+          phase_times_.combine, phase_times_.close);
+  fprintf(file, "  \"inputs\": [");
+  for (size_t ix = 0; ix < jar_stats_.size(); ++ix) {
+    fprintf(file, "%s\n    {\"path\": ", ix ? "," : "");
+    WriteJsonString(file, options_->input_jars[ix].first);
+    fprintf(file, ", \"seconds\": %.6f, \"entries\": %d}",
+            jar_stats_[ix].seconds, jar_stats_[ix].entries);
+  }
+  fprintf(file, "%s],\n  \"merges\": {", jar_stats_.empty() ? "" : "\n  ");
+  bool first = true;
+  for (auto &merge_count : merge_counts_) {
+    fprintf(file, "%s\n    ", first ? "" : ",");
+    WriteJsonString(file, merge_count.first);
+    fprintf(file, ": %d", merge_count.second);
+    first = false;
+  }
+  fprintf(file, "%s}\n}\n", first ? "" : "\n  ");
+  if (fclose(file)) {
+    diag_warn("%s:%d: %s", __FILE__, __LINE__, stats_path);
+    return false;
+  }
+  return true;
+}
+
+// The output is read back rather than hashed as it is written: most of it
+// is copied by the kernel and never passes through the user space, and it
+// is still in the page cache anyway.
+bool OutputJar::WriteEntryDigests() const {
+  const char *digests_path = options_->entry_digests_output.c_str();
+  InputJar output;
+  if (!output.Open(options_->output_jar)) {
+    return false;
+  }
+  // Every entry spans from its local header to the next local header (or
+  // to the Central Directory), which includes its data descriptor.
+  struct Range {
+    uint64_t start;
+    uint64_t end;
+    const CDH *cdh;
+    bool operator<(const Range &other) const { return start < other.start; }
+  };
+  std::vector<Range> ranges;
+  const CDH *cdh;
+  const LH *lh;
+  uint64_t cen_start = 0;
+  while ((cdh = output.NextEntry(&lh))) {
+    if (ranges.empty()) {
+      cen_start = output.CentralDirectoryRecordOffset(cdh);
+    }
+    ranges.push_back(Range{output.LocalHeaderOffset(lh), 0, cdh});
+  }
+  std::sort(ranges.begin(), ranges.end());
+  for (size_t ix = 0; ix < ranges.size(); ++ix) {
+    ranges[ix].end =
+        ix + 1 < ranges.size() ? ranges[ix + 1].start : cen_start;
+  }
+
+  FILE *file = fopen(digests_path, "w");
+  if (file == nullptr) {
+    diag_warn("%s:%d: %s", __FILE__, __LINE__, digests_path);
+    return false;
+  }
+  // Hash on the worker threads, write in the output order.
+  std::vector<std::string> digests(ranges.size());
+  blaze_util::RunOrdered(
+      pool_.get(), ranges.size(), 64 * options_->threads,
+      [&ranges, &digests, &output](size_t ix) {
+        Sha256 sha256;
+        sha256.Update(output.mapped_start() + ranges[ix].start,
+                      ranges[ix].end - ranges[ix].start);
+        uint8_t digest[Sha256::kDigestSize];
+        sha256.Finish(digest);
+        digests[ix] = Sha256::ToHex(digest);
+      },
+      [&ranges, &digests, file](size_t ix) {
+        fprintf(file, "%s %" PRIu64 " %" PRIu64 " %.*s\n",
+                digests[ix].c_str(), ranges[ix].start,
+                ranges[ix].end - ranges[ix].start,
+                ranges[ix].cdh->file_name_length(),
+                ranges[ix].cdh->file_name());
+        digests[ix].clear();
+        return true;
+      });
+  if (fclose(file)) {
+    diag_warn("%s:%d: %s", __FILE__, __LINE__, digests_path);
+    return false;
+  }
+  return true;
+}
+
 bool IsDir(const std::string &path) {
   struct stat st;
   if (stat(path.c_str(), &st)) {
@@ -860,9 +1985,15 @@ bool IsDir(const std::string &path) {
   return S_ISDIR(st.st_mode);
 }
 
+bool OutputJar::CompressResource(const std::string &resource_name) const {
+  return (options_->force_compression || options_->preserve_compression) &&
+         !(options_->entry_name_classifier.Classify(resource_name) &
+           EntryNameClassifier::kNoCompress);
+}
+
 void OutputJar::ClasspathResource(const std::string &resource_name,
                                   const std::string &resource_path) {
-  if (known_members_.count(resource_name)) {
+  if (known_members_.Contains(resource_name)) {
     if (options_->warn_duplicate_resources) {
       diag_warnx(
           "%s:%d: Duplicate resource name %s in the --classpath_resource or "
@@ -877,16 +2008,25 @@ void OutputJar::ClasspathResource(const std::string &resource_name,
   MappedFile mapped_file;
   if (mapped_file.Open(resource_path)) {
     Concatenator *classpath_resource = new Concatenator(resource_name);
-    classpath_resource->Append(
-        reinterpret_cast<const char *>(mapped_file.start()),
-        mapped_file.size());
+    if (mapped_file.size() >= kKernelCopyThreshold &&
+        !CompressResource(resource_name)) {
+      // A large stored resource is copied from its file when it is written,
+      // rather than held in memory until then.
+      classpath_resource_files_.push_back(resource_path);
+    } else {
+      classpath_resource->Append(
+          reinterpret_cast<const char *>(mapped_file.start()),
+          mapped_file.size());
+      classpath_resource_files_.emplace_back();
+    }
     classpath_resources_.emplace_back(classpath_resource);
-    known_members_.emplace(resource_name, EntryInfo{classpath_resource});
+    known_members_.Emplace(resource_name, EntryInfo{classpath_resource});
   } else if (IsDir(resource_path)) {
     // add an empty entry for the directory so its path ends up in the
     // manifest
     classpath_resources_.emplace_back(new Concatenator(resource_name + "/"));
-    known_members_.emplace(resource_name, EntryInfo{&null_combiner_});
+    classpath_resource_files_.emplace_back();
+    known_members_.Emplace(resource_name, EntryInfo{&null_combiner_});
   } else {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, resource_path.c_str());
   }
@@ -896,11 +2036,32 @@ ssize_t OutputJar::AppendFile(int in_fd, off_t offset, size_t count) {
   if (count == 0) {
     return 0;
   }
+  if (mapped_output_) {
+    // Read straight into the output.
+    uint8_t *output = mapped_output_->Reserve(count);
+    size_t total_read = 0;
+    while (total_read < count) {
+      ssize_t n_read = pread(in_fd, output + total_read, count - total_read,
+                             offset + total_read);
+      if (n_read < 0) {
+        return -1;
+      } else if (n_read == 0) {
+        break;
+      }
+      total_read += n_read;
+    }
+    mapped_output_->Commit(total_read);
+    outpos_ += total_read;
+    return total_read;
+  }
+  ssize_t total_written = KernelCopy(in_fd, offset, count);
+  if (static_cast<size_t>(total_written) == count) {
+    return total_written;
+  }
   std::unique_ptr<void, decltype(free)*> buffer(malloc(kBufferSize), free);
   if (buffer == nullptr) {
     diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
   }
-  ssize_t total_written = 0;
 
   while (static_cast<size_t>(total_written) < count) {
     size_t len = std::min(kBufferSize, count - total_written);
@@ -920,13 +2081,65 @@ ssize_t OutputJar::AppendFile(int in_fd, off_t offset, size_t count) {
   return total_written;
 }
 
+ssize_t OutputJar::KernelCopy(int in_fd, off_t offset, size_t count) {
+#if defined(__linux__)
+  if (!try_copy_file_range_ && !try_sendfile_) {
+    return 0;
+  }
+  // Whatever is in the stdio buffer precedes the copied bytes.
+  if (fflush(file_)) {
+    return 0;
+  }
+  const int out_fd = fileno(file_);
+  size_t copied = 0;
+  while (copied < count) {
+    ssize_t n = -1;
+#if defined(__NR_copy_file_range)
+    if (try_copy_file_range_) {
+      loff_t in_offset = offset + copied;
+      n = syscall(__NR_copy_file_range, in_fd, &in_offset, out_fd, nullptr,
+                  count - copied, 0);
+      if (n < 0) {
+        // Old kernel, or the files are on different filesystems, or either
+        // filesystem does not support it. Do not try again.
+        try_copy_file_range_ = false;
+      }
+    }
+#else
+    try_copy_file_range_ = false;
+#endif
+    if (n < 0 && try_sendfile_) {
+      off_t in_offset = offset + copied;
+      n = sendfile(out_fd, in_fd, &in_offset, count - copied);
+      if (n < 0) {
+        try_sendfile_ = false;
+      }
+    }
+    if (n <= 0) {
+      break;
+    }
+    copied += n;
+  }
+  outpos_ += copied;
+  return copied;
+#else
+  // Elsewhere the caller copies through the buffer.
+  return 0;
+#endif
+}
+
 void OutputJar::ExtraCombiner(const std::string &entry_name,
                               Combiner *combiner) {
   extra_combiners_.emplace_back(combiner);
-  known_members_.emplace(entry_name, EntryInfo{combiner});
+  known_members_.Emplace(entry_name, EntryInfo{combiner});
 }
 
 bool OutputJar::WriteBytes(const void *buffer, size_t count) {
+  if (mapped_output_) {
+    mapped_output_->Write(buffer, count);
+    outpos_ += count;
+    return true;
+  }
   size_t written = fwrite(buffer, 1, count, file_);
   outpos_ += written;
   return written == count;
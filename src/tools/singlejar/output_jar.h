@@ -18,14 +18,22 @@
 #include <stdio.h>
 
 #include <cinttypes>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "src/main/cpp/util/thread_pool.h"
 #include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/entry_name_table.h"
+#include "src/tools/singlejar/mapped_output_file.h"
 #include "src/tools/singlejar/options.h"
 
+class InputJar;
+class InputJarCache;
+struct IndexedInputJar;
+
 /*
  * Jar file we are writing.
  */
@@ -43,12 +51,37 @@ class OutputJar {
   // Additional file handler to be redefined by a subclass.
   virtual void ExtraHandler(const CDH *entry,
                             const std::string *input_jar_aux_label);
+  // Use the given cache to open input jars. The cache is not owned, and
+  // can be shared by several OutputJar instances.
+  void SetInputJarCache(InputJarCache *cache) { input_jar_cache_ = cache; }
+  // Merge the given open jar where the input jars list `name`, rather than
+  // opening the file of that name.
+  void AddOpenInputJar(const std::string &name,
+                       std::shared_ptr<const IndexedInputJar> jar) {
+    open_input_jars_[name] = jar;
+  }
+  // Write the output to `fd`, which is not closed, from its current
+  // position, rather than to the output jar file, which then only names the
+  // output. The output is written sequentially, so `fd` can be a pipe;
+  // --mmap_output is ignored and --entry_digests_output is not supported.
+  void SetOutputFd(int fd) { output_fd_ = fd; }
   // Return jar path.
   const char *path() const { return options_->output_jar.c_str(); }
   // True if an entry with given name have not been added to this archive.
   bool NewEntry(const std::string& entry_name) {
-    return known_members_.count(entry_name) == 0;
+    return !known_members_.Contains(entry_name);
   }
+  // Wall time spent in the phases of Doit(), in seconds.
+  struct PhaseTimes {
+    PhaseTimes() : open(0), scan(0), write(0), combine(0), close(0) {}
+    double open;     // Opening the output, writing manifest, resources and
+                     // the entries listed in --entry_order_profile.
+    double scan;     // Waiting for the input jars to be opened and scanned.
+    double write;    // Merging the scanned input jars into the output.
+    double combine;  // Writing the entries produced by the combiners.
+    double close;    // Writing the Central Directory and closing the output.
+  };
+  const PhaseTimes &phase_times() const { return phase_times_; }
 
  protected:
   // The purpose  of these two tiny utility methods is to avoid creating a
@@ -67,12 +100,121 @@ class OutputJar {
  private:
   // Open output jar.
   bool Open();
-  // Add the contents of the given input jar.
-  bool AddJar(int jar_path_index);
+  // True if the output is open.
+  bool IsOpen() const { return file_ != nullptr || mapped_output_; }
+  // Estimate the output size from the sizes of the inputs.
+  size_t EstimateOutputSize() const;
+  // An input jar which has been opened and whose Central Directory has been
+  // walked, but which has not been merged into the output yet.
+  struct ScannedJar;
+  // Open the given input jar, through input_jar_cache_ if it is set.
+  std::shared_ptr<const IndexedInputJar> OpenInputJar(
+      const std::string &input_jar_path) const;
+  // Open the given input jar and collect the entries that may end up in the
+  // output. Does not modify the output state and thus can be run by several
+  // threads at once.
+  bool ScanJar(int jar_path_index, ScannedJar *scanned_jar);
+  // Starts reading the entries to merge from the scanned jar (for the
+  // --prefetch_inputs option).
+  static void PrefetchEntries(const ScannedJar &scanned_jar);
+  // Add the contents of the given scanned input jar.
+  bool AddJar(int jar_path_index, ScannedJar *scanned_jar);
+  // What is known about an entry in the output.
+  struct EntryInfo;
+  // Return true if the given duplicate of a plain entry is the same as the
+  // copy already in the output.
+  bool IsIdenticalDuplicate(const EntryInfo &first_copy, const CDH *jar_entry,
+                            const LH *lh);
+  // Return true if the two entries have the same uncompressed contents.
+  static bool SameContents(const CDH *cdh1, const LH *lh1, const CDH *cdh2,
+                           const LH *lh2);
+  // Read --entry_order_profile into entry_order_.
+  void LoadEntryOrderProfile();
+  // Write the plain entries listed in entry_order_ ahead of the other input
+  // entries, jar by jar in the command line order, each jar's ones in the
+  // profile order. Each comes from the jar AddJars() would take it from,
+  // and AddJars() then skips it.
+  bool AddProfiledEntries();
+  // Add the contents of all input jars, scanning them on worker threads
+  // ahead of merging. Jars are merged in the command line order.
+  bool AddJars();
+  // An input jar entry waiting to be written.
+  struct PendingEntry;
+  // Append the plan for writing the given input file entry: copied as is,
+  // or re-encoded if its compression has to change.
+  void AddPendingFileEntry(const CDH *jar_entry, const LH *lh,
+                           uint32_t name_classes,
+                           std::vector<PendingEntry> *pending_entries,
+                           size_t *recompress_count) const;
+  // Write the pending entries of the given input jar, in order.
+  void WritePendingEntries(const InputJar &input_jar,
+                           const std::string &input_jar_path,
+                           std::vector<PendingEntry> *pending_entries,
+                           size_t recompress_count);
+  // Return true if the payload of the given input entry inflates (if it is
+  // deflated) to as many bytes as its Central Directory Header says, with the
+  // CRC-32 it says. Can be called on any thread.
+  static bool InputCrcMatches(const CDH *jar_entry, const LH *lh);
+  // Return the entry (Local Header followed by the payload) re-encoded
+  // with or without compression. Can be called on any thread.
+  static void *Recompress(const CDH *jar_entry, const LH *lh,
+                          bool output_compressed);
+  // Open the output of the previous run given by --incremental_base.
+  bool OpenIncrementalBase();
+  // Return the entry of the previous output that Recompress() would produce
+  // again for the given input entry, or nullptr if there is no such entry.
+  const CDH *FindReusableEntry(const CDH *jar_entry,
+                               bool output_compressed) const;
+  // Return the entry (Local Header followed by the payload) built from the
+  // given entry of the previous output, exactly as Recompress() would build
+  // it. Can be called on any thread.
+  void *ReuseEntry(const CDH *base_entry) const;
+  // Copy the entry from the input jar as is (except for the timestamp
+  // normalization and the padding aligning the data of a stored entry) and
+  // create its Central Directory Header.
+  void CopyEntry(const InputJar &input_jar, const std::string &input_jar_path,
+                 const CDH *jar_entry, const LH *lh, uint32_t alignment);
+  // When normalize_timestamps is set, entry's timestamp is to be set to
+  // 01/01/1980 00:00:00 (or to 01/01/1980 00:00:02, if an entry is a .class
+  // file). Returns true if the entry's headers have to be changed for that.
+  bool NeedsTimestampFix(const CDH *jar_entry, const LH *lh,
+                         uint16_t *normalized_time) const;
+  // Returns how many of the given entries, starting with the first one, can
+  // be copied by CopyPlainEntries(): the ones that are copied as is, need no
+  // Zip64 extra field nor alignment padding and are adjacent in the input
+  // jar, both their data and their Central Directory Headers.
+  size_t PlainEntryRun(const PendingEntry *entries, size_t count) const;
+  // Copy such entries with a single write and their Central Directory Headers
+  // with a single memcpy.
+  void CopyPlainEntries(const InputJar &input_jar,
+                        const std::string &input_jar_path,
+                        const PendingEntry *entries, size_t count);
+  // Copy the given range of the input jar to the output.
+  bool CopyInputBytes(const InputJar &input_jar, off_t offset, size_t count);
   // Returns the current output position.
   off_t Position();
+  // Returns the alignment of the data of a stored entry whose name has the
+  // given EntryNameClassifier classes (0 or 1 for none).
+  uint32_t Alignment(uint32_t name_classes) const;
+  uint32_t DataAlignment(uint16_t compression_method, uint64_t data_size,
+                         uint32_t alignment) const;
   // Write Jar entry.
   void WriteEntry(void *local_header_and_payload);
+  // Write the Local Header of the entry starting at the current position,
+  // padded to align the data if the entry is stored.
+  void WriteLocalHeader(const LH *entry);
+  // Write the given file as a stored entry with the given name, copying its
+  // contents by AppendFile().
+  void WriteStoredFile(const std::string &entry_name, const std::string &path);
+  // Write the entry spilled by the given combiner.
+  void WriteSpilledEntry(StreamingConcatenator *combiner);
+  // Write META-INF/INDEX.LIST for the entries written so far.
+  void WriteJarIndex();
+  // Report the entry being written and set its timestamp.
+  void PrepareEntryHeader(LH *entry);
+  // Create output Central Directory Header for the entry written at the
+  // given position and append it to CEN buffer.
+  void AppendEntryToDirectory(const LH *entry, off_t output_position);
   // Write META_INF/ entry (the first entry on output).
   void WriteMetaInf();
   // Write a directory entry.
@@ -82,6 +224,9 @@ class OutputJar {
   // append it to CEN (Central Directory) buffer.
   void AppendToDirectoryBuffer(const CDH *cdh, off_t local_header_offset,
                                uint16_t normalized_time, bool fix_timestamp);
+  // Make sure that at least 'size' bytes can be reserved in CEN buffer
+  // without allocating more memory.
+  void PresizeCen(size_t size);
   // Reserve space in CEN buffer.
   uint8_t *ReserveCdr(size_t chunk_size);
   // Reserve space for the Central Directory Header in CEN buffer.
@@ -91,38 +236,106 @@ class OutputJar {
   // Set classpath resource with given resource name and path.
   void ClasspathResource(const std::string& resource_name,
                          const std::string& resource_path);
+  // True if the classpath resource with given name is written compressed.
+  bool CompressResource(const std::string &resource_name) const;
   // Copy 'count' bytes starting at 'offset' from the given file.
   ssize_t AppendFile(int in_fd, off_t offset, size_t count);
+  // Have the kernel copy 'count' bytes starting at 'offset' from the given
+  // file to the output, avoiding copying them to the user space. Returns the
+  // number of bytes copied, which is less than 'count' (possibly 0) if the
+  // platform or the filesystems involved do not support it.
+  ssize_t KernelCopy(int in_fd, off_t offset, size_t count);
   // Write bytes to the output file, return true on success.
   bool WriteBytes(const void *buffer, size_t count);
+  // Write the statistics collected by Doit() to the --stats_output file.
+  bool WriteStats() const;
+  // Write the digests of the entries of the closed output to the
+  // --entry_digests_output file.
+  bool WriteEntryDigests() const;
 
 
   Options *options_;
+  InputJarCache *input_jar_cache_;
+  std::unordered_map<std::string, std::shared_ptr<const IndexedInputJar> >
+      open_input_jars_;
+  int output_fd_;  // Or -1 to write to options_->output_jar.
+  // The workers of the phases which run on --threads threads, if above 1.
+  std::unique_ptr<blaze_util::ThreadPool> pool_;
+  std::unique_ptr<IndexedInputJar> incremental_base_;
+  // The entries of the previous output, by name.
+  std::unordered_map<std::string, const CDH *> incremental_base_entries_;
   struct EntryInfo {
-    EntryInfo(Combiner *combiner, int index = -1)
-        : combiner_(combiner), input_jar_index_(index) {}
+    EntryInfo(Combiner *combiner = nullptr, int index = -1, uint32_t crc32 = 0,
+              uint64_t size = 0, bool profiled = false)
+        : combiner_(combiner),
+          input_jar_index_(index),
+          crc32_(crc32),
+          size_(size),
+          profiled_(profiled) {}
     Combiner *combiner_;
     int input_jar_index_;  // Input jar index for the plain entry or -1.
+    uint32_t crc32_;       // CRC-32 and uncompressed size of the plain entry.
+    uint64_t size_;
+    bool profiled_;        // Written by AddProfiledEntries().
   };
 
-  std::unordered_map<std::string, struct EntryInfo> known_members_;
+  EntryNameTable<struct EntryInfo> known_members_;
+  // The position of each entry name in --entry_order_profile.
+  EntryNameTable<uint32_t> entry_order_;
+  // With --compare_duplicate_contents, the input jars are kept open (and
+  // indexed by entry name on demand), so that the duplicates can be compared
+  // to the first copy.
+  struct RetainedJar {
+    std::shared_ptr<const IndexedInputJar> jar;
+    std::unique_ptr<EntryNameTable<std::pair<const CDH *, const LH *> > >
+        entries;
+  };
+  std::vector<RetainedJar> retained_jars_;
   FILE *file_;
+  // With --mmap_output, the output is written to its mapping rather than by
+  // stdio to file_.
+  std::unique_ptr<MappedOutputFile> mapped_output_;
   off_t outpos_;
   std::unique_ptr<char[]> buffer_;
   int entries_;
   int duplicate_entries_;
-  uint8_t *cen_;
-  size_t cen_size_;
-  size_t cen_capacity_;
+  int reused_entries_;
+  int profiled_entries_;
+  // CEN (Central Directory) buffer. It is a list of blocks which are written
+  // out in order, so that growing it never moves the data.
+  struct CenBlock {
+    explicit CenBlock(size_t capacity)
+        : data(new uint8_t[capacity]), size(0), capacity(capacity) {}
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+    size_t capacity;
+  };
+  std::vector<CenBlock> cen_blocks_;
+  size_t cen_size_;  // The total size of CEN blocks.
+  bool try_copy_file_range_;
+  bool try_sendfile_;
   Concatenator spring_handlers_;
   Concatenator spring_schemas_;
   Concatenator protobuf_meta_handler_;
   Concatenator manifest_;
   PropertyCombiner build_properties_;
   NullCombiner null_combiner_;
-  std::vector<std::unique_ptr<Concatenator> > service_handlers_;
+  std::vector<std::unique_ptr<StreamingConcatenator> > service_handlers_;
   std::vector<std::unique_ptr<Concatenator> > classpath_resources_;
+  // For each classpath resource, the file to copy it from when it is written,
+  // or an empty string if the concatenator holds its contents.
+  std::vector<std::string> classpath_resource_files_;
   std::vector<std::unique_ptr<Combiner> > extra_combiners_;
+  PhaseTimes phase_times_;
+  // Statistics for --stats_output.
+  struct JarStats {
+    double seconds;  // Time spent in AddJar.
+    int entries;     // Entries written to the output.
+  };
+  std::vector<JarStats> jar_stats_;
+  uint64_t bytes_copied_;
+  uint64_t bytes_recompressed_;
+  std::map<std::string, int> merge_counts_;  // By the entry name.
 };
 
 #endif  //   SRC_TOOLS_SINGLEJAR_COMBINED_JAR_H_
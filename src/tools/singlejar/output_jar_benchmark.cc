@@ -0,0 +1,358 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Benchmark for OutputJar. Usage:
+ *   output_jar_benchmark [BENCHMARK_OPTION...] [-- SINGLEJAR_OPTION...]
+ * Benchmark options:
+ *   --jars N          number of the generated input jars (20)
+ *   --entries N       number of entries in each generated jar (5000)
+ *   --entry_size N    average size of an entry, in bytes (2000)
+ *   --duplicates F    fraction of the entries of a jar whose names are also
+ *                     present in the previous jar (0.1)
+ *   --stored F        fraction of the stored (uncompressed) entries (0.2)
+ *   --iterations N    number of times to run OutputJar::Doit (3)
+ *   --corpus_dir DIR  where to create the corpus and the output ($TMPDIR)
+ * If SINGLEJAR_OPTIONs contain --sources, no corpus is generated and the
+ * given (real world) jars are benchmarked instead. The output is written to
+ * the corpus directory unless --output is given.
+ * Reports the time spent in each phase of OutputJar::Doit, the throughput
+ * and the peak RSS of the process.
+ */
+
+#define __STDC_FORMAT_MACROS 1
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/zip_headers.h"
+
+namespace {
+
+struct BenchmarkOptions {
+  BenchmarkOptions()
+      : jars(20),
+        entries(5000),
+        entry_size(2000),
+        duplicates(0.1),
+        stored(0.2),
+        iterations(3) {
+    const char *tmpdir = getenv("TEST_TMPDIR");
+    if (tmpdir == nullptr) {
+      tmpdir = getenv("TMPDIR");
+    }
+    corpus_dir = tmpdir ? tmpdir : "/tmp";
+  }
+  int jars;
+  int entries;
+  int entry_size;
+  double duplicates;
+  double stored;
+  int iterations;
+  std::string corpus_dir;
+  std::vector<std::string> singlejar_args;
+};
+
+// A small deterministic pseudorandom number generator (xorshift), so that
+// the corpus is the same on every run.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed ? seed : 1) {}
+  uint64_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+  // Returns a number in [0..n).
+  uint64_t Uniform(uint64_t n) { return Next() % n; }
+  // Returns true with the given probability.
+  bool Bernoulli(double p) {
+    return static_cast<double>(Next() % 1000000) < p * 1000000;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+// Writes a zip file entry by entry.
+class CorpusJar {
+ public:
+  bool Open(const std::string &path) {
+    file_ = fopen(path.c_str(), "wb");
+    position_ = 0;
+    entries_ = 0;
+    return file_ != nullptr;
+  }
+
+  void Add(const std::string &name, const std::string &contents,
+           bool compress) {
+    Concatenator concatenator(name, false);
+    concatenator.Append(contents);
+    LH *lh = reinterpret_cast<LH *>(concatenator.OutputEntry(compress));
+    if (lh == nullptr) {
+      // Concatenator does not create empty entries.
+      return;
+    }
+    lh->last_mod_file_time(0);
+    lh->last_mod_file_date(33);
+    size_t entry_size = lh->size() + lh->in_zip_size();
+    Write(lh, entry_size);
+
+    size_t cdh_offset = cen_.size();
+    cen_.resize(cdh_offset + sizeof(CDH) + name.size());
+    CDH *cdh = reinterpret_cast<CDH *>(&cen_[cdh_offset]);
+    cdh->signature();
+    cdh->version(20);
+    cdh->version_to_extract(20);
+    cdh->bit_flag(0);
+    cdh->compression_method(lh->compression_method());
+    cdh->last_mod_file_time(lh->last_mod_file_time());
+    cdh->last_mod_file_date(lh->last_mod_file_date());
+    cdh->crc32(lh->crc32());
+    cdh->compressed_file_size32(lh->compressed_file_size32());
+    cdh->uncompressed_file_size32(lh->uncompressed_file_size32());
+    cdh->file_name(name.c_str(), name.size());
+    cdh->extra_fields(nullptr, 0);
+    cdh->comment_length(0);
+    cdh->start_disk_nr(0);
+    cdh->internal_attributes(0);
+    cdh->external_attributes(0);
+    cdh->local_header_offset32(position_);
+    free(lh);
+    position_ += entry_size;
+    ++entries_;
+  }
+
+  void Close() {
+    ECD ecd;
+    memset(&ecd, 0, sizeof(ecd));
+    ecd.signature();
+    ecd.this_disk_entries16(entries_);
+    ecd.total_entries16(entries_);
+    ecd.cen_size32(cen_.size());
+    ecd.cen_offset32(position_);
+    Write(cen_.data(), cen_.size());
+    Write(&ecd, sizeof(ecd));
+    if (fclose(file_)) {
+      diag_err(1, "%s:%d: fclose", __FILE__, __LINE__);
+    }
+    file_ = nullptr;
+    cen_.clear();
+  }
+
+ private:
+  void Write(const void *data, size_t size) {
+    if (fwrite(data, 1, size, file_) != size) {
+      diag_err(1, "%s:%d: fwrite", __FILE__, __LINE__);
+    }
+  }
+
+  FILE *file_;
+  size_t position_;
+  int entries_;
+  std::vector<uint8_t> cen_;
+};
+
+// Returns compressible pseudorandom text of about the given size.
+std::string EntryContents(Random *random, int average_size) {
+  static const char *const kWords[] = {
+      "public", "static", "final", "class", "void", "return", "new",
+      "java/lang/Object", "java/lang/String", "<init>", "this", "int",
+      "com/example/Service", "Ljava/util/List;", "()V",
+      "(I)Ljava/lang/String;"};
+  size_t size = average_size / 2 + random->Uniform(average_size + 1);
+  std::string contents;
+  contents.reserve(size + 32);
+  while (contents.size() < size) {
+    if (random->Bernoulli(0.1)) {
+      contents += static_cast<char>(random->Uniform(256));
+    } else {
+      contents += kWords[random->Uniform(sizeof(kWords) / sizeof(kWords[0]))];
+      contents += ' ';
+    }
+  }
+  return contents;
+}
+
+std::string EntryName(int jar, int entry) {
+  return "com/example/jar" + std::to_string(jar) + "/pkg" +
+         std::to_string(entry / 100) + "/Class" + std::to_string(entry) +
+         ".class";
+}
+
+// Generates the corpus, returns the paths of the created jars.
+std::vector<std::string> CreateCorpus(const BenchmarkOptions &options) {
+  std::vector<std::string> paths;
+  Random random(42);
+  for (int jar = 0; jar < options.jars; ++jar) {
+    std::string path =
+        options.corpus_dir + "/corpus" + std::to_string(jar) + ".jar";
+    CorpusJar corpus_jar;
+    if (!corpus_jar.Open(path)) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path.c_str());
+    }
+    // Service files are to be concatenated by singlejar.
+    corpus_jar.Add("META-INF/services/com.example.Service",
+                   "com.example.jar" + std::to_string(jar) + ".Impl\n", true);
+    for (int entry = 0; entry < options.entries; ++entry) {
+      bool duplicate = jar > 0 && random.Bernoulli(options.duplicates);
+      corpus_jar.Add(EntryName(duplicate ? jar - 1 : jar, entry),
+                     EntryContents(&random, options.entry_size),
+                     !random.Bernoulli(options.stored));
+    }
+    corpus_jar.Close();
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+void ParseCommandLine(int argc, char *argv[], BenchmarkOptions *options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--") {
+      options->singlejar_args.assign(argv + i + 1, argv + argc);
+      return;
+    }
+    if (i + 1 >= argc) {
+      diag_errx(1, "Bad command line argument %s", arg.c_str());
+    }
+    const char *value = argv[++i];
+    if (arg == "--jars") {
+      options->jars = atoi(value);
+    } else if (arg == "--entries") {
+      options->entries = atoi(value);
+    } else if (arg == "--entry_size") {
+      options->entry_size = atoi(value);
+    } else if (arg == "--duplicates") {
+      options->duplicates = atof(value);
+    } else if (arg == "--stored") {
+      options->stored = atof(value);
+    } else if (arg == "--iterations") {
+      options->iterations = atoi(value);
+    } else if (arg == "--corpus_dir") {
+      options->corpus_dir = value;
+    } else {
+      diag_errx(1, "Bad command line argument %s", arg.c_str());
+    }
+  }
+}
+
+// Peak resident set size of this process, in megabytes.
+double PeakRssMegabytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);  // In bytes.
+#else
+  return usage.ru_maxrss / 1024.0;  // In kilobytes.
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  BenchmarkOptions options;
+  ParseCommandLine(argc, argv, &options);
+
+  std::vector<std::string> args = options.singlejar_args;
+  bool has_sources = false, has_output = false;
+  for (auto &arg : args) {
+    has_sources |= arg == "--sources";
+    has_output |= arg == "--output";
+  }
+  if (!has_output) {
+    args.push_back("--output");
+    args.push_back(options.corpus_dir + "/benchmark_output.jar");
+  }
+  if (!has_sources) {
+    fprintf(stderr, "Creating %d jars with %d entries in %s\n", options.jars,
+            options.entries, options.corpus_dir.c_str());
+    args.push_back("--sources");
+    for (auto &path : CreateCorpus(options)) {
+      args.push_back(path);
+    }
+  }
+
+  // Count the input entries and bytes once, outside of the timed runs.
+  Options parsed_options;
+  {
+    std::vector<const char *> argv_list;
+    for (auto &arg : args) {
+      argv_list.push_back(arg.c_str());
+    }
+    parsed_options.ParseCommandLine(argv_list.size(), argv_list.data());
+  }
+  uint64_t input_bytes = 0;
+  uint64_t input_entries = 0;
+  for (auto &input_jar_path : parsed_options.input_jars) {
+    InputJar input_jar;
+    if (!input_jar.Open(input_jar_path.first)) {
+      diag_errx(1, "%s:%d: Cannot open input jar %s", __FILE__, __LINE__,
+                input_jar_path.first.c_str());
+    }
+    const LH *lh;
+    while (input_jar.NextEntry(&lh)) {
+      ++input_entries;
+    }
+    input_jar.Close();
+    struct stat st;
+    if (stat(input_jar_path.first.c_str(), &st)) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__,
+               input_jar_path.first.c_str());
+    }
+    input_bytes += st.st_size;
+  }
+  printf("%" PRIu64 " input entries, %.1f MB\n", input_entries,
+         input_bytes / (1024.0 * 1024));
+
+  printf("%-4s %9s %9s %9s %9s %9s %9s %9s %11s\n", "run", "total", "open",
+         "scan", "write", "combine", "close", "MB/s", "entries/s");
+  for (int iteration = 0; iteration < options.iterations; ++iteration) {
+    std::vector<const char *> argv_list;
+    for (auto &arg : args) {
+      argv_list.push_back(arg.c_str());
+    }
+    Options run_options;
+    run_options.ParseCommandLine(argv_list.size(), argv_list.data());
+    OutputJar output_jar;
+    auto start = std::chrono::steady_clock::now();
+    if (output_jar.Doit(&run_options)) {
+      diag_errx(1, "%s:%d: OutputJar::Doit failed", __FILE__, __LINE__);
+    }
+    double total = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    const OutputJar::PhaseTimes &times = output_jar.phase_times();
+    printf("%-4d %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.1f %11.0f\n",
+           iteration, total, times.open, times.scan, times.write,
+           times.combine, times.close, input_bytes / total / (1024 * 1024),
+           input_entries / total);
+  }
+  printf("Peak RSS %.1f MB\n", PeakRssMegabytes());
+  return 0;
+}
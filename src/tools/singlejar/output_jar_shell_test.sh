@@ -42,6 +42,54 @@ function test_new_entries() {
     { echo "build-data.properties is not readable" >&2; exit 1; }
 }
 
+# Test that --multi_output builds each output from its own params file.
+function test_multi_output() {
+  cd "${TEST_TMPDIR}"
+  mkdir -p multi/lib multi/res
+  echo lib > multi/lib/lib.txt
+  echo res > multi/res/res.txt
+  (cd multi && zip -q ../multi_in.zip lib/lib.txt res/res.txt)
+  cat > lib.params <<EOF
+--output lib.jar
+--sources multi_in.zip
+--include_prefixes lib/
+EOF
+  cat > res.params <<EOF
+--output res.jar
+--sources multi_in.zip
+--include_prefixes res/
+EOF
+  "$singlejar" --multi_output lib.params @res.params
+  unzip -l lib.jar > lib.list
+  unzip -l res.jar > res.list
+  grep -q lib/lib.txt lib.list || fail "lib.jar lacks lib/lib.txt"
+  grep -q res/res.txt lib.list && fail "lib.jar has res/res.txt"
+  grep -q res/res.txt res.list || fail "res.jar lacks res/res.txt"
+  grep -q lib/lib.txt res.list && fail "res.jar has lib/lib.txt"
+  true
+}
+
+# Test that --verify_input_crc reports an input entry whose data does not
+# match its CRC-32, naming the entry and the input jar.
+function test_verify_input_crc() {
+  cd "${TEST_TMPDIR}"
+  mkdir -p crc/c
+  echo "hello world" > crc/c/data.txt
+  (cd crc && zip -q -0 -X ../crc_in.zip c/data.txt)
+  "$singlejar" --output crc_good.jar --verify_input_crc --sources crc_in.zip \
+    || fail "intact input reported as corrupt"
+  # The data of the only entry follows its 30 + 10 bytes long local header.
+  printf 'J' | dd of=crc_in.zip bs=1 seek=40 conv=notrunc 2>/dev/null
+  "$singlejar" --output crc_plain.jar --sources crc_in.zip \
+    || fail "corrupt input rejected without --verify_input_crc"
+  if "$singlejar" --output crc_bad.jar --verify_input_crc \
+      --sources crc_in.zip 2> crc.err; then
+    fail "corrupt input not reported"
+  fi
+  grep -q "c/data.txt in crc_in.zip is corrupt" crc.err \
+    || fail "unexpected error: $(cat crc.err)"
+}
+
 run_suite "Misc shell tests"
 #!/bin/bash
 
@@ -14,12 +14,16 @@
 
 #include <stdlib.h>
 
+#include <sstream>
+
 #include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/port.h"
 #include "src/main/cpp/util/strings.h"
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/options.h"
 #include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/sha256.h"
 #include "src/tools/singlejar/test_util.h"
 #include "googletest/include/gtest/gtest.h"
 
@@ -105,6 +109,48 @@ class OutputJarSimpleTest : public ::testing::Test {
     return out_path;
   }
 
+  // Creates the output with and without --threads and verifies that
+  // the results are identical.
+  void ExpectSameOutputWithThreads(const std::vector<string> &args) {
+    string out_path = OutputFilePath("out.jar");
+    CreateOutput(out_path, args);
+
+    string threaded_out_path = OutputFilePath("out_threads.jar");
+    std::vector<const char *> threaded_args = {
+        "--output", threaded_out_path.c_str(), "--threads", "4"};
+    for (auto &arg : args) {
+      threaded_args.push_back(arg.c_str());
+    }
+    Options threaded_options;
+    threaded_options.ParseCommandLine(threaded_args.size(),
+                                      threaded_args.data());
+    EXPECT_EQ(4, threaded_options.threads);
+    OutputJar threaded_output_jar;
+    ASSERT_EQ(0, threaded_output_jar.Doit(&threaded_options));
+    EXPECT_EQ(0, VerifyZip(threaded_out_path));
+
+    string contents, threaded_contents;
+    ASSERT_TRUE(blaze_util::ReadFile(out_path, &contents));
+    ASSERT_TRUE(blaze_util::ReadFile(threaded_out_path, &threaded_contents));
+    EXPECT_TRUE(contents == threaded_contents)
+        << "Output differs when using --threads";
+  }
+
+  // Creates the output with a fresh OutputJar instance, so that it can be
+  // called several times in a test.
+  void CreateAnotherOutput(const string &out_path,
+                           const std::vector<string> &args) {
+    std::vector<const char *> option_list = {"--output", out_path.c_str()};
+    for (auto &arg : args) {
+      option_list.push_back(arg.c_str());
+    }
+    Options options;
+    options.ParseCommandLine(option_list.size(), option_list.data());
+    OutputJar output_jar;
+    ASSERT_EQ(0, output_jar.Doit(&options));
+    EXPECT_EQ(0, VerifyZip(out_path));
+  }
+
   OutputJar output_jar_;
   Options options_;
 };
@@ -241,6 +287,64 @@ TEST_F(OutputJarSimpleTest, JavaLauncher) {
   input_jar.Close();
 }
 
+// Large entries are copied by AppendFile rather than from the mapped input.
+TEST_F(OutputJarSimpleTest, LargeEntry) {
+  string out_dir = OutputFilePath("");
+  string large_contents;
+  for (int i = 0; large_contents.size() < (1 << 20); ++i) {
+    large_contents += "line " + std::to_string(i) + "\n";
+  }
+  CreateTextFile("large_entry", large_contents.c_str());
+  CreateTextFile("small_entry", "small\n");
+  string testzip_path = OutputFilePath("large.zip");
+  unlink(testzip_path.c_str());
+  ASSERT_EQ(0, RunCommand("cd ", out_dir.c_str(), ";", "zip", "-0m",
+                          "large.zip", "small_entry", "large_entry",
+                          nullptr));
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--sources", testzip_path});
+  EXPECT_EQ("small\n", GetEntryContents(out_path, "small_entry"));
+  EXPECT_EQ(large_contents, GetEntryContents(out_path, "large_entry"));
+}
+
+// The Central Directory of an output with many entries spans several CEN
+// buffer blocks.
+TEST_F(OutputJarSimpleTest, ManyEntries) {
+  const int kEntriesPerJar = 15000;
+  string out_dir = OutputFilePath("");
+  std::vector<string> args = {"--sources"};
+  for (const char *dir : {"many1", "many2"}) {
+    ASSERT_EQ(0, RunCommand("mkdir", "-p", OutputFilePath(dir).c_str(),
+                            nullptr));
+    for (int i = 0; i < kEntriesPerJar; ++i) {
+      CreateTextFile(string(dir) + "/entry" + std::to_string(i), "");
+    }
+    string testzip_path = OutputFilePath(string(dir) + ".zip");
+    unlink(testzip_path.c_str());
+    ASSERT_EQ(0, RunCommand("cd ", out_dir.c_str(), ";", "zip", "-qrm",
+                            testzip_path.c_str(), dir, nullptr));
+    args.push_back(testzip_path);
+  }
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, args);
+
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int file_entries = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    ASSERT_TRUE(cdh->is());
+    ASSERT_TRUE(lh->is());
+    if (!strncmp(cdh->file_name(), "many", 4)) {
+      ++file_entries;
+    }
+  }
+  input_jar.Close();
+  // Two directory entries and all the files.
+  EXPECT_EQ(2 + 2 * kEntriesPerJar, file_entries);
+}
+
 // --main_class option.
 TEST_F(OutputJarSimpleTest, MainClass) {
   string out_path = OutputFilePath("out.jar");
@@ -298,6 +402,24 @@ TEST_F(OutputJarSimpleTest, BuildInfoFile) {
   EXPECT_PRED2(HasSubstr, build_properties, "property=value\n");
 }
 
+// A property set more than once is written once, with the last value.
+TEST_F(OutputJarSimpleTest, DuplicateBuildInfo) {
+  string build_info_path1 =
+      CreateTextFile("buildinfo1", "property1=value1\nproperty2=value2\n");
+  string build_info_path2 =
+      CreateTextFile("buildinfo2", "property1=value3\nproperty2=value2\n");
+
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--build_info_file", build_info_path1,
+                          "--build_info_file", build_info_path2});
+  string build_properties = GetEntryContents(out_path, "build-data.properties");
+  EXPECT_PRED2(HasSubstr, build_properties,
+               "\nproperty1=value3\nproperty2=value2\n");
+  EXPECT_EQ(string::npos, build_properties.find("value1"));
+  EXPECT_EQ(build_properties.find("property2"),
+            build_properties.rfind("property2"));
+}
+
 // --resources option.
 TEST_F(OutputJarSimpleTest, Resources) {
   string res11_path = CreateTextFile("res11", "res11.line1\nres11.line2\n");
@@ -386,6 +508,45 @@ TEST_F(OutputJarSimpleTest, ClasspathResources) {
   EXPECT_EQ("line1\nline2\n", res);
 }
 
+// Large stored resources are copied straight from their files; the others
+// are still compressed.
+TEST_F(OutputJarSimpleTest, LargeResources) {
+  string contents;
+  for (int i = 0; contents.size() < (300 << 10); ++i) {
+    contents += "line " + std::to_string(i) + "\n";
+  }
+  string bin_path = CreateTextFile("big.bin", contents.c_str());
+  string so_path = CreateTextFile("big.so", contents.c_str());
+  string txt_path = CreateTextFile("big.txt", contents.c_str());
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--compression", "--nocompress_suffixes", ".bin",
+                          "--page_align_suffixes", ".so", "--align", "4",
+                          "--resources", bin_path + ":res/big.bin",
+                          so_path + ":lib/big.so", txt_path + ":res/big.txt"});
+  EXPECT_EQ(contents, GetEntryContents(out_path, "res/big.bin"));
+  EXPECT_EQ(contents, GetEntryContents(out_path, "lib/big.so"));
+  EXPECT_EQ(contents, GetEntryContents(out_path, "res/big.txt"));
+
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    string name = cdh->file_name_string();
+    size_t offset = lh->data() - input_jar.mapped_start();
+    if (name == "res/big.bin") {
+      EXPECT_EQ(Z_NO_COMPRESSION, lh->compression_method());
+      EXPECT_EQ(0, offset % 4);
+    } else if (name == "lib/big.so") {
+      EXPECT_EQ(Z_NO_COMPRESSION, lh->compression_method());
+      EXPECT_EQ(0, offset % 4096);
+    } else if (name == "res/big.txt") {
+      EXPECT_EQ(Z_DEFLATED, lh->compression_method());
+    }
+  }
+  input_jar.Close();
+}
+
 // Duplicate entries for --resources or --classpath_resources
 TEST_F(OutputJarSimpleTest, DuplicateResources) {
   string cp_res_path = CreateTextFile("cp_res", "line1\nline2\n");
@@ -408,6 +569,43 @@ TEST_F(OutputJarSimpleTest, DuplicateResources) {
   EXPECT_EQ("resline1\nresline2\n", foo);
 }
 
+// --no_duplicates with --compare_duplicate_contents accepts the duplicates
+// which are the same as the first copy, however they are compressed.
+TEST_F(OutputJarSimpleTest, IdenticalDuplicates) {
+  string out_dir = OutputFilePath("");
+  CreateTextFile("identical.txt", "identical contents\n");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-m", "-9",
+                          "identical1.zip", "identical.txt", nullptr));
+  CreateTextFile("identical.txt", "identical contents\n");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-m", "-0",
+                          "identical2.zip", "identical.txt", nullptr));
+
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--no_duplicates", "--compare_duplicate_contents",
+                          "--sources", OutputFilePath("identical1.zip"),
+                          OutputFilePath("identical2.zip")});
+  EXPECT_EQ("identical contents\n",
+            GetEntryContents(out_path, "identical.txt"));
+}
+
+// With --ignore_identical_duplicates alone, a conflicting duplicate is
+// reported and the first copy is kept.
+TEST_F(OutputJarSimpleTest, ConflictingDuplicates) {
+  string out_dir = OutputFilePath("");
+  CreateTextFile("conflicting.txt", "first\n");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-m",
+                          "conflicting1.zip", "conflicting.txt", nullptr));
+  CreateTextFile("conflicting.txt", "second\n");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-m",
+                          "conflicting2.zip", "conflicting.txt", nullptr));
+
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--ignore_identical_duplicates", "--sources",
+                          OutputFilePath("conflicting1.zip"),
+                          OutputFilePath("conflicting2.zip")});
+  EXPECT_EQ("first\n", GetEntryContents(out_path, "conflicting.txt"));
+}
+
 // Extra combiners
 TEST_F(OutputJarSimpleTest, ExtraCombiners) {
   string out_path = OutputFilePath("out.jar");
@@ -589,6 +787,28 @@ TEST_F(OutputJarSimpleTest, Services) {
             GetEntryContents(out_path, "META-INF/spring.handlers"));
 }
 
+// Service entries exceeding --combiner_memory_limit are streamed to a
+// temporary file and copied from there.
+TEST_F(OutputJarSimpleTest, CombinerMemoryLimit) {
+  string out_dir = OutputFilePath("");
+  CreateTextFile("META-INF/services/spi.DateProvider",
+                 "my.DateProviderImpl1\n");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-mr",
+                          "services1.zip", "META-INF", nullptr));
+  CreateTextFile("META-INF/services/spi.DateProvider", "my.DateProviderImpl2");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-mr",
+                          "services2.zip", "META-INF", nullptr));
+  string zip1_path = OutputFilePath("services1.zip");
+  string zip2_path = OutputFilePath("services2.zip");
+
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--compression", "--combiner_memory_limit", "8",
+                          "--sources", zip1_path, zip2_path, zip1_path});
+  EXPECT_EQ("my.DateProviderImpl1\n" "my.DateProviderImpl2\n"
+            "my.DateProviderImpl1\n",
+            GetEntryContents(out_path, "META-INF/services/spi.DateProvider"));
+}
+
 // Test that in the absence of the compression option all the plain files in
 // the output archive are not compressed but just stored.
 TEST_F(OutputJarSimpleTest, NoCompressionOption) {
@@ -730,4 +950,426 @@ TEST_F(OutputJarSimpleTest, Nocompress) {
   input_jar.Close();
 }
 
+// Test that the data of the stored entries with suffixes in
+// --page_align_suffixes starts at a page boundary, and that of the other
+// stored entries at a multiple of --align.
+TEST_F(OutputJarSimpleTest, Alignment) {
+  CreateTextFile("align/lib/libfoo.so", "foo");
+  CreateTextFile("align/lib/libbar.so", "barbar");
+  CreateTextFile("align/res/a.txt", "aaaaa");
+  string align_dir = OutputFilePath("align");
+  ASSERT_EQ(0, RunCommand("cd", align_dir.c_str(), ";", "zip", "-q", "-0",
+                          "../align.zip", "lib/libfoo.so", "res/a.txt",
+                          "lib/libbar.so", nullptr));
+  string res_path = CreateTextFile("libres.so", "res");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path,
+               {"--compression", "--page_align_suffixes", ".so", "--align",
+                "4", "--sources", OutputFilePath("align.zip"),
+                DATA_DIR_TOP "src/tools/singlejar/stored.jar", "--resources",
+                res_path + ":lib/libres.so"});
+  EXPECT_EQ("foo", GetEntryContents(out_path, "lib/libfoo.so"));
+  EXPECT_EQ("barbar", GetEntryContents(out_path, "lib/libbar.so"));
+  EXPECT_EQ("aaaaa", GetEntryContents(out_path, "res/a.txt"));
+  EXPECT_EQ("res", GetEntryContents(out_path, "lib/libres.so"));
+
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int page_aligned = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    string name = cdh->file_name_string();
+    size_t offset = lh->data() - input_jar.mapped_start();
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".so") == 0) {
+      EXPECT_EQ(Z_NO_COMPRESSION, lh->compression_method()) << name;
+      EXPECT_EQ(0, offset % 4096) << name;
+      ++page_aligned;
+    } else if (lh->compression_method() == Z_NO_COMPRESSION &&
+               name.back() != '/') {
+      EXPECT_EQ(0, offset % 4) << name;
+    }
+  }
+  EXPECT_EQ(3, page_aligned);
+  input_jar.Close();
+}
+
+// --sort_entries writes the entries of each jar in name order, and with
+// --chunk_align the data of all the non-empty entries starts at a multiple of
+// it, compressed or not.
+TEST_F(OutputJarSimpleTest, ChunkAlignment) {
+  string text;
+  for (int i = 0; i < 100; ++i) {
+    text += "line " + std::to_string(i) + "\n";
+  }
+  CreateTextFile("chunk/pkg/b/B.txt", text.c_str());
+  CreateTextFile("chunk/pkg/a/A.txt", text.c_str());
+  CreateTextFile("chunk/pkg/a/C.txt", "c");
+  CreateTextFile("chunk/pkg/a/empty.txt", "");
+  string chunk_dir = OutputFilePath("chunk");
+  ASSERT_EQ(0, RunCommand("cd", chunk_dir.c_str(), ";", "zip", "-q", "-X",
+                          "../chunk.zip", "pkg/b/B.txt", "pkg/a/C.txt",
+                          "pkg/a/empty.txt", "pkg/a/A.txt", nullptr));
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--exclude_build_data", "--dont_change_compression",
+                          "--sort_entries", "--chunk_align", "512", "--sources",
+                          OutputFilePath("chunk.zip")});
+  EXPECT_EQ(text, GetEntryContents(out_path, "pkg/a/A.txt"));
+  EXPECT_EQ(text, GetEntryContents(out_path, "pkg/b/B.txt"));
+
+  std::vector<string> expected_entries(
+      {"META-INF/", "META-INF/MANIFEST.MF", "pkg/a/A.txt", "pkg/a/C.txt",
+       "pkg/a/empty.txt", "pkg/b/B.txt"});
+  std::vector<string> jar_entries;
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int deflated = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    string name = cdh->file_name_string();
+    jar_entries.push_back(name);
+    if (cdh->compressed_file_size() > 0) {
+      size_t offset = lh->data() - input_jar.mapped_start();
+      EXPECT_EQ(0, offset % 512) << name;
+    }
+    if (cdh->compression_method() == Z_DEFLATED) {
+      ++deflated;
+    }
+  }
+  input_jar.Close();
+  EXPECT_EQ(expected_entries, jar_entries);
+  EXPECT_LE(2, deflated);
+}
+
+// --entry_order_profile writes the listed entries first, jar by jar, each
+// jar's ones in the profile order. Each comes from the first jar that has it.
+TEST_F(OutputJarSimpleTest, EntryOrderProfile) {
+  CreateTextFile("order/a/1.txt", "a1");
+  CreateTextFile("order/a/2.txt", "a2");
+  CreateTextFile("order/a/3.txt", "a3");
+  CreateTextFile("order/b/x.txt", "bx");
+  CreateTextFile("order/b/y.txt", "by");
+  string order_dir = OutputFilePath("order");
+  ASSERT_EQ(0, RunCommand("cd", order_dir.c_str(), ";", "zip", "-q",
+                          "../a.zip", "a/1.txt", "a/2.txt", "a/3.txt",
+                          nullptr));
+  CreateTextFile("order/a/2.txt", "a2 again");
+  ASSERT_EQ(0, RunCommand("cd", order_dir.c_str(), ";", "zip", "-q",
+                          "../b.zip", "b/x.txt", "a/2.txt", "b/y.txt",
+                          nullptr));
+  string profile_path = CreateTextFile(
+      "profile.txt", "# startup\nb/y.txt\na/3.txt\n\n"
+                     "a/2.txt\r\nmissing\nb/x.txt");
+  string stats_path = OutputFilePath("stats.json");
+  std::vector<string> args = {
+      "--normalize", "--exclude_build_data", "--entry_order_profile",
+      profile_path, "--stats_output", stats_path, "--sources",
+      OutputFilePath("a.zip"), OutputFilePath("b.zip")};
+  ExpectSameOutputWithThreads(args);
+
+  string out_path = OutputFilePath("out.jar");
+  std::vector<string> expected_entries(
+      {"META-INF/", "META-INF/MANIFEST.MF", "a/3.txt", "a/2.txt", "b/y.txt",
+       "b/x.txt", "a/1.txt"});
+  std::vector<string> jar_entries;
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    jar_entries.push_back(cdh->file_name_string());
+  }
+  input_jar.Close();
+  EXPECT_EQ(expected_entries, jar_entries);
+  EXPECT_EQ("a2", GetEntryContents(out_path, "a/2.txt"));
+
+  string stats;
+  ASSERT_TRUE(blaze_util::ReadFile(stats_path, &stats));
+  EXPECT_NE(string::npos, stats.find("\"profiled_entries\": 4"));
+  EXPECT_NE(string::npos, stats.find("\"duplicate_entries\": 1"));
+}
+
+// Test that --threads does not change the output.
+TEST_F(OutputJarSimpleTest, Threads) {
+  ExpectSameOutputWithThreads(
+      {"--normalize", "--exclude_build_data", "--sources",
+       DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+       DATA_DIR_TOP "src/tools/singlejar/libtest2.jar", kPathLibData1,
+       kPathLibData2, DATA_DIR_TOP "src/tools/singlejar/stored.jar"});
+}
+
+// Same, when the compression of the input entries changes.
+TEST_F(OutputJarSimpleTest, ThreadsRecompression) {
+  ExpectSameOutputWithThreads(
+      {"--normalize", "--exclude_build_data", "--compression",
+       "--nocompress_suffixes", ".h", "--sources",
+       DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+       DATA_DIR_TOP "src/tools/singlejar/libtest2.jar",
+       DATA_DIR_TOP "src/tools/singlejar/stored.jar"});
+}
+
+// --mmap_output writes the same output as stdio does, also when the output
+// outgrows the initial mapping.
+TEST_F(OutputJarSimpleTest, MmapOutput) {
+  string out_dir = OutputFilePath("");
+  string large_contents;
+  for (int i = 0; large_contents.size() < (4 << 20); ++i) {
+    large_contents += "line " + std::to_string(i) + "\n";
+  }
+  CreateTextFile("mmap_large_entry", large_contents.c_str());
+  string testzip_path = OutputFilePath("mmap_large.zip");
+  ASSERT_EQ(0, RunCommand("cd ", out_dir.c_str(), ";", "zip", "-9",
+                          "mmap_large.zip", "mmap_large_entry", nullptr));
+  const std::vector<string> args = {
+      "--normalize", "--exclude_build_data", "--sources", testzip_path,
+      DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+      DATA_DIR_TOP "src/tools/singlejar/stored.jar", "--resources",
+      OutputFilePath("mmap_large_entry") + ":large_resource"};
+
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, args);
+  string mmap_out_path = OutputFilePath("out_mmap.jar");
+  std::vector<string> mmap_args = args;
+  mmap_args.push_back("--mmap_output");
+  CreateAnotherOutput(mmap_out_path, mmap_args);
+
+  string contents, mmap_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &contents));
+  ASSERT_TRUE(blaze_util::ReadFile(mmap_out_path, &mmap_contents));
+  EXPECT_GT(mmap_contents.size(), 4 << 20);
+  EXPECT_TRUE(contents == mmap_contents)
+      << "Output differs when using --mmap_output";
+  EXPECT_EQ(large_contents,
+            GetEntryContents(mmap_out_path, "mmap_large_entry"));
+}
+
+// --prefetch_inputs does not change the output.
+TEST_F(OutputJarSimpleTest, PrefetchInputs) {
+  const std::vector<string> args = {
+      "--normalize", "--exclude_build_data", "--sources",
+      DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+      DATA_DIR_TOP "src/tools/singlejar/libtest2.jar",
+      DATA_DIR_TOP "src/tools/singlejar/stored.jar"};
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, args);
+  string prefetch_out_path = OutputFilePath("out_prefetch.jar");
+  std::vector<string> prefetch_args = args;
+  prefetch_args.push_back("--prefetch_inputs");
+  CreateAnotherOutput(prefetch_out_path, prefetch_args);
+
+  string contents, prefetch_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &contents));
+  ASSERT_TRUE(blaze_util::ReadFile(prefetch_out_path, &prefetch_contents));
+  EXPECT_TRUE(contents == prefetch_contents)
+      << "Output differs when using --prefetch_inputs";
+}
+
+// --input_window_size does not change the output, even if the window is
+// smaller than an entry.
+TEST_F(OutputJarSimpleTest, InputWindow) {
+  const std::vector<string> args = {
+      "--normalize", "--exclude_build_data", "--compression", "--sources",
+      DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+      DATA_DIR_TOP "src/tools/singlejar/libtest2.jar",
+      DATA_DIR_TOP "src/tools/singlejar/stored.jar"};
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, args);
+  string window_out_path = OutputFilePath("out_window.jar");
+  std::vector<string> window_args = args;
+  window_args.push_back("--input_window_size");
+  window_args.push_back("1");
+  CreateAnotherOutput(window_out_path, window_args);
+
+  string contents, window_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &contents));
+  ASSERT_TRUE(blaze_util::ReadFile(window_out_path, &window_contents));
+  EXPECT_TRUE(contents == window_contents)
+      << "Output differs when using --input_window_size";
+}
+
+// Runs of entries copied as is are copied at once, together with their
+// Central Directory Headers. A combined entry breaks the run.
+TEST_F(OutputJarSimpleTest, PlainEntryRuns) {
+  CreateTextFile("runs/a.txt", "a");
+  CreateTextFile("runs/b.txt", "bb");
+  CreateTextFile("runs/META-INF/services/spi.Foo", "Foo");
+  CreateTextFile("runs/c.txt", "ccc");
+  CreateTextFile("runs/d.txt", "dddd");
+  string runs_dir = OutputFilePath("runs");
+  ASSERT_EQ(0, RunCommand("cd", runs_dir.c_str(), ";", "zip", "-q",
+                          "../runs.zip", "a.txt", "b.txt",
+                          "META-INF/services/spi.Foo", "c.txt", "d.txt",
+                          nullptr));
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--exclude_build_data", "--sources",
+                          OutputFilePath("runs.zip"),
+                          DATA_DIR_TOP "src/tools/singlejar/stored.jar"});
+  EXPECT_EQ("a", GetEntryContents(out_path, "a.txt"));
+  EXPECT_EQ("bb", GetEntryContents(out_path, "b.txt"));
+  EXPECT_EQ("ccc", GetEntryContents(out_path, "c.txt"));
+  EXPECT_EQ("dddd", GetEntryContents(out_path, "d.txt"));
+  EXPECT_EQ("Foo", GetEntryContents(out_path, "META-INF/services/spi.Foo"));
+
+  // The Central Directory points to the right local headers.
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int entries = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    ASSERT_TRUE(lh->is()) << cdh->file_name_string();
+    EXPECT_EQ(cdh->file_name_string(), lh->file_name_string());
+    ++entries;
+  }
+  EXPECT_LT(6, entries);
+}
+
+// --jar_index replaces the indices of the inputs with that of the output.
+TEST_F(OutputJarSimpleTest, JarIndex) {
+  CreateTextFile("index/a/b/C.class", "C");
+  CreateTextFile("index/a/b/D.class", "D");
+  CreateTextFile("index/a/E.txt", "E");
+  CreateTextFile("index/top.txt", "top");
+  CreateTextFile("index/META-INF/services/spi.Foo", "Foo");
+  CreateTextFile("index/META-INF/INDEX.LIST",
+                 "JarIndex-Version: 1.0\n\nindex_input.jar\na\n\n");
+  string index_dir = OutputFilePath("index");
+  ASSERT_EQ(0, RunCommand("cd", index_dir.c_str(), ";", "zip", "-q",
+                          "../index_input.zip", "a/b/C.class", "top.txt",
+                          "a/b/D.class", "a/E.txt", "META-INF/services/spi.Foo",
+                          "META-INF/INDEX.LIST", nullptr));
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--exclude_build_data", "--jar_index", "--sources",
+                          OutputFilePath("index_input.zip")});
+  EXPECT_EQ(
+      "JarIndex-Version: 1.0\n\nout.jar\n"
+      "a/b\ntop.txt\na\nMETA-INF/services\n\n",
+      GetEntryContents(out_path, "META-INF/INDEX.LIST"));
+}
+
+// --stats_output option.
+TEST_F(OutputJarSimpleTest, StatsOutput) {
+  CreateTextFile("META-INF/services/spi.DateProvider",
+                 "my.DateProviderImpl1\n");
+  string out_dir = OutputFilePath("");
+  ASSERT_EQ(0, RunCommand("cd", out_dir.c_str(), ";", "zip", "-mr",
+                          "stats_input.zip", "META-INF", nullptr));
+  string zip_path = OutputFilePath("stats_input.zip");
+  string stats_path = OutputFilePath("stats.json");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--stats_output", stats_path, "--sources", zip_path,
+                          zip_path});
+
+  string stats;
+  ASSERT_TRUE(blaze_util::ReadFile(stats_path, &stats));
+  EXPECT_EQ('{', stats.front());
+  EXPECT_NE(string::npos, stats.find("\"output\": \"" + out_path + "\""));
+  EXPECT_NE(string::npos, stats.find("\"cen_size\": "));
+  EXPECT_NE(string::npos, stats.find("\"close\": "));
+  EXPECT_NE(string::npos,
+            stats.find("{\"path\": \"" + zip_path + "\", \"seconds\": "));
+  // The service file is merged once per input.
+  EXPECT_NE(string::npos,
+            stats.find("\"META-INF/services/spi.DateProvider\": 2"));
+}
+
+// --entry_digests_output lists the output entries in the file order, with
+// the byte ranges they occupy and their SHA-256 digests. The digests do not
+// depend on the number of threads.
+TEST_F(OutputJarSimpleTest, EntryDigestsOutput) {
+  string digests_path = OutputFilePath("digests.txt");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path,
+               {"--normalize", "--exclude_build_data", "--compression",
+                "--entry_digests_output", digests_path, "--sources",
+                DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+                DATA_DIR_TOP "src/tools/singlejar/stored.jar"});
+
+  string digests, contents;
+  ASSERT_TRUE(blaze_util::ReadFile(digests_path, &digests));
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &contents));
+  std::istringstream lines(digests);
+  string digest, name;
+  uint64_t offset, length;
+  uint64_t expected_offset = 0;
+  int entries = 0;
+  while (lines >> digest >> offset >> length >> name) {
+    EXPECT_EQ(expected_offset, offset) << name;
+    ASSERT_LE(offset + length, contents.size());
+    Sha256 sha256;
+    sha256.Update(contents.data() + offset, length);
+    uint8_t expected_digest[Sha256::kDigestSize];
+    sha256.Finish(expected_digest);
+    EXPECT_EQ(Sha256::ToHex(expected_digest), digest) << name;
+    expected_offset = offset + length;
+    ++entries;
+  }
+  EXPECT_TRUE(lines.eof());
+
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int expected_entries = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    if (expected_entries++ == 0) {
+      // The entries are followed by the Central Directory.
+      EXPECT_EQ(input_jar.CentralDirectoryRecordOffset(cdh), expected_offset);
+    }
+  }
+  EXPECT_EQ(expected_entries, entries);
+
+  string threaded_digests_path = OutputFilePath("threaded_digests.txt");
+  CreateAnotherOutput(
+      OutputFilePath("out_threads.jar"),
+      {"--normalize", "--exclude_build_data", "--compression", "--threads",
+       "4", "--entry_digests_output", threaded_digests_path, "--sources",
+       DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+       DATA_DIR_TOP "src/tools/singlejar/stored.jar"});
+  string threaded_digests;
+  ASSERT_TRUE(blaze_util::ReadFile(threaded_digests_path, &threaded_digests));
+  EXPECT_EQ(digests, threaded_digests);
+}
+
+// Verify that the output created incrementally from the previous output is
+// identical to the one created from scratch, whether the inputs change or not.
+TEST_F(OutputJarSimpleTest, IncrementalBase) {
+  const std::vector<string> old_args = {
+      "--normalize", "--exclude_build_data", "--compression",
+      "--nocompress_suffixes", ".h", "--sources",
+      DATA_DIR_TOP "src/tools/singlejar/libtest1.jar",
+      DATA_DIR_TOP "src/tools/singlejar/stored.jar"};
+  string base_path = OutputFilePath("base.jar");
+  CreateAnotherOutput(base_path, old_args);
+
+  string same_path = OutputFilePath("same.jar");
+  std::vector<string> same_args = old_args;
+  same_args.push_back("--incremental_base");
+  same_args.push_back(base_path);
+  CreateAnotherOutput(same_path, same_args);
+
+  const std::vector<string> new_args = {
+      "--normalize", "--exclude_build_data", "--compression",
+      "--nocompress_suffixes", ".h", "--sources",
+      DATA_DIR_TOP "src/tools/singlejar/libtest2.jar",
+      DATA_DIR_TOP "src/tools/singlejar/stored.jar",
+      DATA_DIR_TOP "src/tools/singlejar/libtest1.jar"};
+  string full_path = OutputFilePath("full.jar");
+  CreateAnotherOutput(full_path, new_args);
+  string incremental_path = OutputFilePath("incremental.jar");
+  std::vector<string> incremental_args = new_args;
+  incremental_args.push_back("--incremental_base");
+  incremental_args.push_back(base_path);
+  CreateAnotherOutput(incremental_path, incremental_args);
+
+  string base, same, full, incremental;
+  ASSERT_TRUE(blaze_util::ReadFile(base_path, &base));
+  ASSERT_TRUE(blaze_util::ReadFile(same_path, &same));
+  ASSERT_TRUE(blaze_util::ReadFile(full_path, &full));
+  ASSERT_TRUE(blaze_util::ReadFile(incremental_path, &incremental));
+  EXPECT_TRUE(base == same) << "Unchanged output differs";
+  EXPECT_TRUE(full == incremental) << "Incremental output differs";
+}
+
 }  // namespace
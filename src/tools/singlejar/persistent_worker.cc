@@ -0,0 +1,175 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/persistent_worker.h"
+
+#include <string.h>
+
+#include "src/tools/singlejar/diag.h"
+
+namespace singlejar_worker {
+
+namespace {
+
+// Protocol buffer wire types.
+const int kVarint = 0;
+const int k64Bit = 1;
+const int kLengthDelimited = 2;
+const int k32Bit = 5;
+
+// WorkRequest and WorkResponse field numbers.
+const int kRequestArguments = 1;
+const int kResponseExitCode = 1;
+const int kResponseOutput = 2;
+
+// Reads a varint from the stream. Returns false on EOF before the first byte.
+bool ReadVarint(FILE *in, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc(in);
+    if (c == EOF) {
+      if (shift == 0) {
+        return false;
+      }
+      diag_errx(1, "%s:%d: Truncated work request", __FILE__, __LINE__);
+    }
+    *value |= static_cast<uint64_t>(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  diag_errx(1, "%s:%d: Malformed varint in work request", __FILE__, __LINE__);
+  return false;
+}
+
+// Decodes a varint from the buffer, advancing `pos'.
+uint64_t DecodeVarint(const std::string &buffer, size_t *pos) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64 && *pos < buffer.size(); shift += 7) {
+    uint8_t c = buffer[(*pos)++];
+    value |= static_cast<uint64_t>(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return value;
+    }
+  }
+  diag_errx(1, "%s:%d: Malformed varint in work request", __FILE__, __LINE__);
+  return 0;
+}
+
+void EncodeVarint(uint64_t value, std::string *buffer) {
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<char>(value));
+}
+
+}  // namespace
+
+bool IsPersistentWorker(int argc, const char *const argv[]) {
+  for (int i = 0; i < argc; ++i) {
+    if (!strcmp(argv[i], "--persistent_worker")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadWorkRequest(FILE *in, std::vector<std::string> *arguments) {
+  uint64_t message_size;
+  if (!ReadVarint(in, &message_size)) {
+    return false;
+  }
+  std::string message(message_size, '\0');
+  if (message_size &&
+      fread(&message[0], 1, message_size, in) != message_size) {
+    diag_errx(1, "%s:%d: Truncated work request", __FILE__, __LINE__);
+  }
+
+  arguments->clear();
+  size_t pos = 0;
+  while (pos < message.size()) {
+    uint64_t tag = DecodeVarint(message, &pos);
+    int wire_type = tag & 7;
+    uint64_t field = tag >> 3;
+    uint64_t length;
+    switch (wire_type) {
+      case kVarint:
+        DecodeVarint(message, &pos);
+        break;
+      case k64Bit:
+        pos += 8;
+        break;
+      case kLengthDelimited:
+        length = DecodeVarint(message, &pos);
+        if (length > message.size() - pos) {
+          diag_errx(1, "%s:%d: Malformed work request", __FILE__, __LINE__);
+        }
+        if (field == kRequestArguments) {
+          arguments->push_back(message.substr(pos, length));
+        }
+        // Inputs (field 2) are not used.
+        pos += length;
+        break;
+      case k32Bit:
+        pos += 4;
+        break;
+      default:
+        diag_errx(1, "%s:%d: Unexpected wire type %d in work request",
+                  __FILE__, __LINE__, wire_type);
+    }
+  }
+  if (pos != message.size()) {
+    diag_errx(1, "%s:%d: Malformed work request", __FILE__, __LINE__);
+  }
+  return true;
+}
+
+bool WriteWorkResponse(FILE *out, int32_t exit_code,
+                       const std::string &output) {
+  std::string message;
+  if (exit_code != 0) {
+    EncodeVarint((kResponseExitCode << 3) | kVarint, &message);
+    // Negative int32 values are sign-extended to 64 bits.
+    EncodeVarint(static_cast<uint64_t>(static_cast<int64_t>(exit_code)),
+                 &message);
+  }
+  if (!output.empty()) {
+    EncodeVarint((kResponseOutput << 3) | kLengthDelimited, &message);
+    EncodeVarint(output.size(), &message);
+    message += output;
+  }
+  std::string delimited;
+  EncodeVarint(message.size(), &delimited);
+  delimited += message;
+  return fwrite(delimited.data(), 1, delimited.size(), out) ==
+             delimited.size() &&
+         fflush(out) == 0;
+}
+
+int RunPersistentWorker(
+    FILE *in, FILE *out,
+    const std::function<int(const std::vector<std::string> &)> &run_request) {
+  std::vector<std::string> arguments;
+  while (ReadWorkRequest(in, &arguments)) {
+    int exit_code = run_request(arguments);
+    if (!WriteWorkResponse(out, exit_code, "")) {
+      diag_warn("%s:%d: Cannot write work response", __FILE__, __LINE__);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace singlejar_worker
@@ -0,0 +1,58 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_PERSISTENT_WORKER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_PERSISTENT_WORKER_H_ 1
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Bazel persistent worker support. Bazel starts the worker with the
+ * --persistent_worker flag and sends it WorkRequest messages on the standard
+ * input, expecting a WorkResponse message on the standard output for each
+ * of them (see src/main/protobuf/worker_protocol.proto). The messages are
+ * length-delimited protocol buffers.
+ *
+ * singlejar is also built from its sources in the embedded tools, where
+ * the protobuf library is not available, so the few fields singlejar needs
+ * are encoded and decoded here directly.
+ */
+namespace singlejar_worker {
+
+// Returns true if the command line asks to run as a persistent worker.
+bool IsPersistentWorker(int argc, const char *const argv[]);
+
+// Reads the next WorkRequest from `in' and stores its arguments. Returns
+// false at the end of the input. Exits on malformed input.
+bool ReadWorkRequest(FILE *in, std::vector<std::string> *arguments);
+
+// Writes a WorkResponse with given exit code and output to `out'.
+bool WriteWorkResponse(FILE *out, int32_t exit_code,
+                       const std::string &output);
+
+// Processes work requests from `in' until end of the input, running each of
+// them with `run_request' and writing responses to `out'. Returns the worker
+// process exit code.
+int RunPersistentWorker(
+    FILE *in, FILE *out,
+    const std::function<int(const std::vector<std::string> &)> &run_request);
+
+}  // namespace singlejar_worker
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_PERSISTENT_WORKER_H_
@@ -0,0 +1,106 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/persistent_worker.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using singlejar_worker::ReadWorkRequest;
+using singlejar_worker::RunPersistentWorker;
+using singlejar_worker::WriteWorkResponse;
+
+// Returns the contents of the given file from the beginning.
+std::string Contents(FILE *fp) {
+  std::string contents;
+  rewind(fp);
+  int c;
+  while ((c = getc(fp)) != EOF) {
+    contents.push_back(c);
+  }
+  return contents;
+}
+
+// A WorkRequest with arguments "--output", "out.jar" and an input with
+// path "in.jar" and digest "ab", as serialized by protobuf.
+const char kRequest[] =
+    "\x21"
+    "\x0a\x08--output"
+    "\x0a\x07out.jar"
+    "\x12\x0c\x0a\x06in.jar\x12\x02\x61\x62";
+
+TEST(PersistentWorkerTest, IsPersistentWorker) {
+  const char *worker_args[] = {"--persistent_worker"};
+  const char *args[] = {"--output", "out.jar"};
+  EXPECT_TRUE(singlejar_worker::IsPersistentWorker(1, worker_args));
+  EXPECT_FALSE(singlejar_worker::IsPersistentWorker(2, args));
+}
+
+TEST(PersistentWorkerTest, ReadWorkRequest) {
+  FILE *in = tmpfile();
+  ASSERT_NE(nullptr, in);
+  fwrite(kRequest, 1, sizeof(kRequest) - 1, in);
+  fwrite(kRequest, 1, sizeof(kRequest) - 1, in);
+  rewind(in);
+  std::vector<std::string> arguments;
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(ReadWorkRequest(in, &arguments));
+    ASSERT_EQ(2, arguments.size());
+    EXPECT_EQ("--output", arguments[0]);
+    EXPECT_EQ("out.jar", arguments[1]);
+  }
+  EXPECT_FALSE(ReadWorkRequest(in, &arguments));
+  fclose(in);
+}
+
+TEST(PersistentWorkerTest, WriteWorkResponse) {
+  FILE *out = tmpfile();
+  ASSERT_NE(nullptr, out);
+  ASSERT_TRUE(WriteWorkResponse(out, 0, ""));
+  ASSERT_TRUE(WriteWorkResponse(out, 1, "oops"));
+  ASSERT_TRUE(WriteWorkResponse(out, -1, ""));
+  EXPECT_EQ(std::string("\x00", 1) +
+                "\x08\x08\x01\x12\x04oops"
+                "\x0b\x08\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01",
+            Contents(out));
+  fclose(out);
+}
+
+TEST(PersistentWorkerTest, RunPersistentWorker) {
+  FILE *in = tmpfile();
+  FILE *out = tmpfile();
+  ASSERT_NE(nullptr, in);
+  ASSERT_NE(nullptr, out);
+  fwrite(kRequest, 1, sizeof(kRequest) - 1, in);
+  fwrite(kRequest, 1, sizeof(kRequest) - 1, in);
+  rewind(in);
+  int request_count = 0;
+  EXPECT_EQ(0, RunPersistentWorker(
+                   in, out, [&request_count](
+                                const std::vector<std::string> &arguments) {
+                     EXPECT_EQ(2, arguments.size());
+                     return request_count++;
+                   }));
+  EXPECT_EQ(2, request_count);
+  EXPECT_EQ(std::string("\x00\x02\x08\x01", 4), Contents(out));
+  fclose(in);
+  fclose(out);
+}
+
+}  // namespace
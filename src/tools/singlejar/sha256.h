@@ -0,0 +1,53 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_SHA256_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_SHA256_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * SHA-256 (FIPS 180-4) message digest. The usage pattern is:
+ *   Sha256 sha256;
+ *   sha256.Update(data, size);  // as many times as needed.
+ *   uint8_t digest[Sha256::kDigestSize];
+ *   sha256.Finish(digest);
+ * An instance cannot be updated after Finish().
+ */
+class Sha256 {
+ public:
+  static const size_t kDigestSize = 32;
+
+  Sha256();
+
+  void Update(const void *data, size_t size);
+
+  void Finish(uint8_t digest[kDigestSize]);
+
+  // Returns the digest as lowercase hex.
+  static std::string ToHex(const uint8_t digest[kDigestSize]);
+
+ private:
+  void Transform(const uint8_t block[64]);
+
+  uint32_t state_[8];
+  uint64_t length_;  // Bytes hashed so far.
+  uint8_t buffer_[64];
+  size_t buffered_;  // Bytes in buffer_.
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_SHA256_H_
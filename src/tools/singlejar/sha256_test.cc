@@ -0,0 +1,63 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "src/tools/singlejar/sha256.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+std::string Digest(const std::string &data) {
+  Sha256 sha256;
+  sha256.Update(data.data(), data.size());
+  uint8_t digest[Sha256::kDigestSize];
+  sha256.Finish(digest);
+  return Sha256::ToHex(digest);
+}
+
+// The FIPS 180-2 examples.
+TEST(Sha256Test, KnownValues) {
+  EXPECT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+            Digest(""));
+  EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+            Digest("abc"));
+  EXPECT_EQ("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+            Digest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"));
+  EXPECT_EQ("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+            Digest(std::string(1000000, 'a')));
+}
+
+// Digest computed piecewise is the same as computed at once, for all the
+// sizes around the padding boundary.
+TEST(Sha256Test, Incremental) {
+  std::string data;
+  for (int i = 0; i < 200; ++i) {
+    data.push_back(static_cast<char>(i * 7));
+  }
+  for (size_t size = 0; size < data.size(); ++size) {
+    std::string expected = Digest(data.substr(0, size));
+    for (size_t split = 0; split <= size; split += 13) {
+      Sha256 sha256;
+      sha256.Update(data.data(), split);
+      sha256.Update(data.data() + split, size - split);
+      uint8_t digest[Sha256::kDigestSize];
+      sha256.Finish(digest);
+      ASSERT_EQ(expected, Sha256::ToHex(digest))
+          << "size " << size << ", split " << split;
+    }
+  }
+}
+
+}  // namespace
@@ -12,15 +12,30 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar_cache.h"
 #include "src/tools/singlejar/options.h"
 #include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/persistent_worker.h"
 
-int main(int argc, char *argv[]) {
+// The number of input jars a persistent worker keeps open between requests.
+static const size_t kInputJarCacheCapacity = 512;
+
+static int Run(int argc, const char *const argv[], InputJarCache *cache) {
   Options options;
-  options.ParseCommandLine(argc - 1, argv + 1);
+  options.ParseCommandLine(argc, argv);
   OutputJar output_jar;
+  if (cache != nullptr) {
+    output_jar.SetInputJarCache(cache);
+  }
   // TODO(b/67733424): support desugar deps checking in Bazel
   if (options.check_desugar_deps) {
     diag_errx(1, "%s:%d: Desugar checking not currently supported in Bazel.",
@@ -32,3 +47,64 @@ int main(int argc, char *argv[]) {
                            new Concatenator("reference.conf"));
   return output_jar.Doit(&options);
 }
+
+// With --multi_output, each of the following arguments is a params file
+// holding the command line of one output. The outputs are built concurrently
+// and share the cache of input jars, so that an input jar they have in
+// common is opened and its Central Directory read only once.
+static int RunMultiOutput(int argc, const char *const argv[],
+                          InputJarCache *cache) {
+  if (argc < 2) {
+    diag_errx(1, "%s:%d: --multi_output requires at least one params file",
+              __FILE__, __LINE__);
+  }
+  std::unique_ptr<InputJarCache> own_cache;
+  if (cache == nullptr) {
+    own_cache.reset(new InputJarCache(kInputJarCacheCapacity));
+    cache = own_cache.get();
+  }
+  std::vector<std::string> params_files;
+  for (int i = 1; i < argc; ++i) {
+    params_files.push_back(argv[i][0] == '@' ? std::string(argv[i])
+                                             : std::string("@") + argv[i]);
+  }
+  std::vector<int> results(params_files.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < params_files.size(); ++i) {
+    threads.emplace_back([&params_files, &results, cache, i]() {
+      const char *args[] = {params_files[i].c_str()};
+      results[i] = Run(1, args, cache);
+    });
+  }
+  int result = 0;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+    if (result == 0) {
+      result = results[i];
+    }
+  }
+  return result;
+}
+
+static int RunAny(int argc, const char *const argv[], InputJarCache *cache) {
+  if (argc > 0 && !strcmp(argv[0], "--multi_output")) {
+    return RunMultiOutput(argc, argv, cache);
+  }
+  return Run(argc, argv, cache);
+}
+
+int main(int argc, char *argv[]) {
+  if (singlejar_worker::IsPersistentWorker(argc - 1, argv + 1)) {
+    // Input jars are shared by many of the requests, keep them open.
+    InputJarCache cache(kInputJarCacheCapacity);
+    return singlejar_worker::RunPersistentWorker(
+        stdin, stdout, [&cache](const std::vector<std::string> &arguments) {
+          std::vector<const char *> args;
+          for (auto &arg : arguments) {
+            args.push_back(arg.c_str());
+          }
+          return RunAny(args.size(), args.data(), &cache);
+        });
+  }
+  return RunAny(argc - 1, argv + 1, nullptr);
+}
@@ -18,12 +18,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif  // _WIN32
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "src/main/cpp/util/strings.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/mapped_file.h"
 
 /*
  * Tokenize command line containing indirect command line arguments.
@@ -53,10 +58,23 @@ class ArgTokenStream {
    */
 
  private:
-  // Internal class to handle indirect command files.
+  // Internal class to handle indirect command files. Regular files are mapped
+  // instead of read, and the characters between quotes, backslashes and
+  // whitespace are copied in bulk: params files of large targets can be tens
+  // of megabytes. Backslash-newline sequences are skipped where they are
+  // found, so that the mapping can stay read-only.
   class FileTokenStream {
    public:
-    FileTokenStream(const char *filename) {
+    FileTokenStream(const char *filename) : filename_(filename) {
+#ifndef _WIN32
+      struct stat st;
+      if (stat(filename, &st) == 0 && S_ISREG(st.st_mode) &&
+          mapped_.Open(filename)) {
+        p_ = reinterpret_cast<const char *>(mapped_.start());
+        end_ = reinterpret_cast<const char *>(mapped_.end());
+        return;
+      }
+#endif  // _WIN32
       // TODO(laszlocsomor): use the fopen and related file handling API
       // implementations from ProtoBuf, in order to support long paths:
       // https://github.com/google/protobuf/blob/
@@ -64,120 +82,137 @@ class ArgTokenStream {
       //   src/google/protobuf/stubs/io_win32.cc
       // Best would be to extract that library to a common location and use
       // here, in ProtoBuf, and in Bazel itself.
-      if (!(fp_ = fopen(filename, "r"))) {
+      FILE *fp = fopen(filename, "r");
+      if (!fp) {
+        diag_err(1, "%s", filename);
+      }
+      char buf[64 * 1024];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        contents_.append(buf, n);
+      }
+      if (ferror(fp)) {
         diag_err(1, "%s", filename);
       }
-      filename_ = filename;
-      next_char();
+      fclose(fp);
+      p_ = contents_.data();
+      end_ = p_ + contents_.size();
     }
 
-    ~FileTokenStream() { close(); }
-
     // Assign next token to TOKEN, return true on success, false on EOF.
     bool next_token(std::string *token) {
-      if (!fp_) {
-        return false;
-      }
-      *token = "";
-      while (current_char_ != EOF && isspace(current_char_)) {
-        next_char();
+      token->clear();
+      for (;;) {
+        if (p_ < end_ && blaze_util::ascii_isspace(*p_)) {
+          ++p_;
+        } else if (!skip_continuation()) {
+          break;
+        }
       }
-      if (current_char_ == EOF) {
+      if (p_ == end_) {
         close();
         return false;
       }
       for (;;) {
-        if (current_char_ == '\'' || current_char_ == '"') {
+        append_plain(token);
+        if (p_ == end_) {
+          return true;
+        }
+        char c = *p_;
+        if (c == '\'' || c == '"') {
           process_quoted(token);
-          if (isspace(current_char_)) {
-            next_char();
-            return true;
-          } else {
-            next_char();
+          ++p_;  // the closing quote
+        } else if (c == '\\') {
+          if (skip_continuation()) {
+            continue;
+          }
+          ++p_;
+          while (skip_continuation()) {
           }
-        } else if (current_char_ == '\\') {
-          next_char();
-          if ((current_char_ != EOF)) {
-            token->push_back(current_char_);
-            next_char();
-          } else {
+          if (p_ == end_) {
             diag_errx(1, "Expected character after \\, got EOF in %s",
                       filename_.c_str());
           }
-        } else if (current_char_ == EOF || isspace(current_char_)) {
-          next_char();
-          return true;
+          token->push_back(*p_++);
         } else {
-          token->push_back(current_char_);
-          next_char();
+          ++p_;  // the whitespace
+          return true;
         }
       }
     }
 
    private:
     void close() {
-      if (fp_) {
-        fclose(fp_);
-        fp_ = nullptr;
-      }
+      mapped_.Close();
+      contents_.clear();
+      p_ = end_ = nullptr;
       filename_.clear();
     }
 
+    // If the current characters are a backslash and a newline, skip them and
+    // return true.
+    bool skip_continuation() {
+      if (end_ - p_ >= 2 && p_[0] == '\\' && p_[1] == '\n') {
+        p_ += 2;
+        return true;
+      }
+      return false;
+    }
+
+    // Append the characters from the current one up to the next quote,
+    // backslash or whitespace to TOKEN.
+    void append_plain(std::string *token) {
+      const char *end = blaze_util::FindTokenBreak(p_, end_);
+      token->append(p_, end);
+      p_ = end;
+    }
+
     // Append the quoted string to the TOKEN. The quote character (which can be
     // single or double quote) is in the current character. Everything up to the
-    // matching quote character is appended.
+    // matching quote character is appended, and the matching quote becomes the
+    // current character.
     void process_quoted(std::string *token) {
-      char quote = current_char_;
-      next_char();
-      while (current_char_ != quote) {
-        if (current_char_ == '\\' && quote == '"') {
+      char quote = *p_++;
+      for (;;) {
+        while (skip_continuation()) {
+        }
+        if (p_ == end_) {
+          diag_errx(1, "No closing %c in %s", quote, filename_.c_str());
+        }
+        char c = *p_;
+        if (c == quote) {
+          return;
+        }
+        if (c == '\\' && quote == '"') {
           // In the "-quoted token, \" stands for ", and \x
           // is copied literally for any other x.
-          next_char();
-          if (current_char_ == '"') {
-            token->push_back('"');
-            next_char();
-          } else if (current_char_ != EOF) {
-            token->push_back('\\');
-            token->push_back(current_char_);
-            next_char();
-          } else {
+          ++p_;
+          while (skip_continuation()) {
+          }
+          if (p_ == end_) {
             diag_errx(1, "No closing %c in %s", quote, filename_.c_str());
           }
-        } else if (current_char_ != EOF) {
-          token->push_back(current_char_);
-          next_char();
-        } else {
-          diag_errx(1, "No closing %c in %s", quote, filename_.c_str());
-        }
-      }
-    }
-
-    // Get the next character from the input stream. Skip backslash followed
-    // by the newline.
-    void next_char() {
-      if (feof(fp_)) {
-        current_char_ = EOF;
-        return;
-      }
-      current_char_ = getc(fp_);
-      // Eat "\\\n" sequence.
-      while (current_char_ == '\\') {
-        int c = getc(fp_);
-        if (c == '\n') {
-          current_char_ = getc(fp_);
-        } else {
-          if (c != EOF) {
-            ungetc(c, fp_);
+          if (*p_ != '"') {
+            token->push_back('\\');
           }
-          break;
+          token->push_back(*p_++);
+        } else {
+          // Whitespace, the other quote and the backslash in a '-quoted token
+          // are plain characters here.
+          token->push_back(c);
+          ++p_;
+          append_plain(token);
         }
       }
     }
 
-    FILE *fp_;
+    MappedFile mapped_;
+    // The file contents if they could not be mapped.
+    std::string contents_;
+    // The unread part of the file.
+    const char *p_;
+    const char *end_;
     std::string filename_;
-    int current_char_;
   };
 
  public:
@@ -210,7 +245,7 @@ class ArgTokenStream {
     if (AtEnd()) {
       diag_errx(1, "%s requires argument", option);
     }
-    *optarg = token_;
+    *optarg = std::move(token_);
     next();
     return true;
   }
@@ -225,7 +260,7 @@ class ArgTokenStream {
     }
     next();
     while (!AtEnd() && '-' != token_.at(0)) {
-      optargs->push_back(token_);
+      optargs->push_back(std::move(token_));
       next();
     }
     return true;
@@ -244,11 +279,13 @@ class ArgTokenStream {
     while (!AtEnd() && '-' != token_.at(0)) {
       size_t commapos = token_.find(',');
       if (commapos == std::string::npos) {
-        optargs->push_back(std::pair<std::string, std::string>(token_, ""));
+        optargs->push_back(
+            std::pair<std::string, std::string>(std::move(token_), ""));
       } else {
         std::string first = token_.substr(0, commapos);
         token_.erase(0, commapos + 1);
-        optargs->push_back(std::pair<std::string, std::string>(first, token_));
+        optargs->push_back(std::pair<std::string, std::string>(
+            std::move(first), std::move(token_)));
       }
 
       next();
@@ -256,7 +293,9 @@ class ArgTokenStream {
     return true;
   }
 
-  // Current token.
+  // Current token. The MatchAndSet methods move the tokens they store into
+  // their arguments, so that a params file with many entries is not copied
+  // token by token.
   const std::string &token() const { return token_; }
 
   // Read the next token.
@@ -0,0 +1,130 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how fast ArgTokenStream reads a params file, and how fast
+// blaze_util::FindTokenBreak scans compared with a byte-at-a-time loop.
+//
+// Writes a params file of resource-like paths, a few of them quoted, of the
+// given size, then reads it with ArgTokenStream `iterations` times.
+//
+// Usage:
+//   token_stream_benchmark [--megabytes=N] [--iterations=N]
+// The params file is written to $TEST_TMPDIR, else $TMPDIR, else /tmp.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <functional>
+#include <string>
+
+#include "src/main/cpp/util/strings.h"
+#include "src/tools/singlejar/token_stream.h"
+
+namespace {
+
+// Runs `fn` `iterations` times and returns the fastest wall time in seconds.
+double Fastest(int iterations, const std::function<void()> &fn) {
+  double fastest = 0;
+  for (int i = 0; i < iterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    fastest = i == 0 ? seconds : std::min(fastest, seconds);
+  }
+  return fastest;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int megabytes = 40;
+  int iterations = 5;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--megabytes=", 12) == 0) {
+      megabytes = atoi(argv[i] + 12);
+    } else if (strncmp(argv[i], "--iterations=", 13) == 0) {
+      iterations = atoi(argv[i] + 13);
+    } else {
+      fprintf(stderr, "token_stream_benchmark: unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (megabytes < 1 || iterations < 1) {
+    fprintf(stderr, "token_stream_benchmark: option out of range\n");
+    return 1;
+  }
+
+  const char *tmp = getenv("TEST_TMPDIR");
+  if (tmp == nullptr) {
+    tmp = getenv("TMPDIR");
+  }
+  std::string params = std::string(tmp != nullptr ? tmp : "/tmp") +
+                       "/token_stream_benchmark.params";
+  std::string contents;
+  for (int i = 0; contents.size() < megabytes * 1024u * 1024u; ++i) {
+    contents += "--resources bazel-out/k8-fastbuild/bin/some/package/lib" +
+                std::to_string(i) + "/_javac/classes/com/example/Foo" +
+                std::to_string(i) + ".class";
+    contents += i % 100 == 0 ? " 'quoted name with spaces'\n" : "\n";
+  }
+  FILE *fp = fopen(params.c_str(), "w");
+  if (fp == nullptr ||
+      fwrite(contents.data(), 1, contents.size(), fp) != contents.size() ||
+      fclose(fp) != 0) {
+    fprintf(stderr, "token_stream_benchmark: cannot write %s\n",
+            params.c_str());
+    return 1;
+  }
+
+  const char *end = contents.data() + contents.size();
+  size_t breaks = 0;
+  double scan = Fastest(iterations, [&]() {
+    for (const char *p = contents.data(); p < end; ++p) {
+      p = blaze_util::FindTokenBreak(p, end);
+      ++breaks;
+    }
+  });
+  double scalar_scan = Fastest(iterations, [&]() {
+    for (const char *p = contents.data(); p < end; ++p) {
+      while (p < end && !blaze_util::IsTokenBreak(*p)) {
+        ++p;
+      }
+      ++breaks;
+    }
+  });
+
+  std::string arg = "@" + params;
+  const char *args[] = {arg.c_str()};
+  size_t tokens = 0;
+  double tokenize = Fastest(iterations, [&]() {
+    for (ArgTokenStream stream(1, args); !stream.AtEnd(); stream.next()) {
+      ++tokens;
+    }
+  });
+  remove(params.c_str());
+
+  double mb = contents.size() / (1024.0 * 1024.0);
+  printf("%-28s %10s %10s\n", "benchmark", "ms", "MB/s");
+  printf("%-28s %10.1f %10.1f\n", "FindTokenBreak", scan * 1000, mb / scan);
+  printf("%-28s %10.1f %10.1f\n", "byte-at-a-time scan", scalar_scan * 1000,
+         mb / scalar_scan);
+  printf("%-28s %10.1f %10.1f\n", "ArgTokenStream", tokenize * 1000,
+         mb / tokenize);
+  return breaks > 0 && tokens > 0 ? 0 : 1;
+}
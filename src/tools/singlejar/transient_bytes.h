@@ -18,8 +18,10 @@
 
 #include <inttypes.h>
 #include <algorithm>
+#include <mutex>
 #include <ostream>
 
+#include "src/tools/singlejar/crc32.h"
 #include "src/tools/singlejar/diag.h"
 #include "src/tools/singlejar/zip_headers.h"
 #include "src/tools/singlejar/zlib_interface.h"
@@ -42,11 +44,8 @@ class TransientBytes {
         last_block_(nullptr) {}
 
   ~TransientBytes() {
-    while (first_block_) {
-      auto block = first_block_;
-      first_block_ = first_block_->next_block_;
-      delete block;
-    }
+    DataBlock::Release(first_block_);
+    first_block_ = nullptr;
     last_block_ = nullptr;
   }
 
@@ -153,7 +152,8 @@ class TransientBytes {
       return Z_NO_COMPRESSION;
     }
 
-    Deflater deflater;
+    DeflaterPool::Ptr deflater_ptr = DeflaterPool::Get();
+    Deflater &deflater = *deflater_ptr;
     deflater.next_out = buffer;
     uint16_t compression_method = Z_DEFLATED;
 
@@ -170,7 +170,7 @@ class TransientBytes {
       // can compress no more than this block.
       uint32_t chunk_size = static_cast<uint32_t>(std::min(
           static_cast<uint64_t>(sizeof(data_block->data_)), to_compress));
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
+      *checksum = Crc32(*checksum, data_block->data_, chunk_size);
       deflater.avail_in = chunk_size;
       to_compress -= chunk_size;
       int ret = deflater.Deflate(data_block->data_, chunk_size,
@@ -216,7 +216,7 @@ class TransientBytes {
          data_block = data_block->next_block_) {
       size_t chunk_size =
           std::min(static_cast<uint64_t>(sizeof(data_block->data_)), to_copy);
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
+      *checksum = Crc32(*checksum, data_block->data_, chunk_size);
       memcpy(buffer_end - to_copy, data_block->data_, chunk_size);
       to_copy -= chunk_size;
     }
@@ -259,7 +259,7 @@ class TransientBytes {
   // Ensures there is some space to write to, returns the amount available.
   uint64_t ensure_space() {
     if (!free_size()) {
-      auto *data_block = new DataBlock();
+      auto *data_block = DataBlock::New();
       if (last_block_) {
         last_block_->next_block_ = data_block;
       }
@@ -297,12 +297,69 @@ class TransientBytes {
   uint64_t free_size() const { return allocated_ - data_size_; }
 
   // The bytes are kept in an linked list of the DataBlock instances.
-  // TODO(asmundak): perhaps use mmap to allocate these?
   struct DataBlock {
     struct DataBlock *next_block_;
     uint8_t data_[0x40000 - 8];
     DataBlock() : next_block_(nullptr) {}
     uint8_t *End() { return data_ + sizeof(data_); }
+
+    // The blocks are recycled through a free list shared by all threads.
+    // A block is too large for the malloc arenas, so allocating a new one
+    // costs an mmap() and page faults; most entries need just one.
+    static DataBlock *New() {
+      FreeList &free_list = GetFreeList();
+      {
+        std::lock_guard<std::mutex> lock(free_list.mutex);
+        if (free_list.head) {
+          DataBlock *block = free_list.head;
+          free_list.head = block->next_block_;
+          --free_list.count;
+          block->next_block_ = nullptr;
+          return block;
+        }
+      }
+      return new DataBlock();
+    }
+
+    // Returns the given list of blocks to the free list.
+    static void Release(DataBlock *block) {
+      FreeList &free_list = GetFreeList();
+      std::lock_guard<std::mutex> lock(free_list.mutex);
+      while (block) {
+        DataBlock *next = block->next_block_;
+        if (free_list.count < kMaxFree) {
+          block->next_block_ = free_list.head;
+          free_list.head = block;
+          ++free_list.count;
+        } else {
+          delete block;
+        }
+        block = next;
+      }
+    }
+
+   private:
+    // At most that many idle blocks (8MB) are kept.
+    static const size_t kMaxFree = 32;
+
+    struct FreeList {
+      FreeList() : head(nullptr), count(0) {}
+      ~FreeList() {
+        while (head) {
+          DataBlock *next = head->next_block_;
+          delete head;
+          head = next;
+        }
+      }
+      std::mutex mutex;
+      DataBlock *head;
+      size_t count;
+    };
+
+    static FreeList &GetFreeList() {
+      static FreeList free_list;
+      return free_list;
+    }
   };
 
   uint64_t allocated_;
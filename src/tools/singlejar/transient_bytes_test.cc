@@ -146,6 +146,18 @@ TEST_F(TransientBytesTest, AppendBytes) {
   }
 }
 
+// The data blocks of a destroyed instance are reused by the next one.
+TEST_F(TransientBytesTest, ReuseBlocks) {
+  transient_bytes_->Append(kBytesSmall);
+  transient_bytes_->Append(kBytesSmall);
+  transient_bytes_.reset(new TransientBytes());
+  EXPECT_EQ(0, transient_bytes_->data_size());
+  transient_bytes_->Append(kBytesSmall);
+  std::ostringstream out;
+  out << *transient_bytes_.get();
+  EXPECT_EQ(kBytesSmall, out.str());
+}
+
 TEST_F(TransientBytesTest, ReadEntryContents) {
   ASSERT_EQ(0, chdir(getenv("TEST_TMPDIR")));
   CreateStoredJar();
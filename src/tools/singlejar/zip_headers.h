@@ -206,6 +206,52 @@ class UnixTimeExtraField : public ExtraField {
 static_assert(5 == sizeof(UnixTimeExtraField),
               "UnixTimeExtraField layout is incorrect");
 
+/* Alignment Extra Field, as written by Android's zipalign.
+ * It pads the Local Header of a stored entry so that the entry's data starts
+ * at a multiple of the given alignment, and records that alignment. The
+ * padding consists of zero bytes following the alignment.
+ */
+class AlignmentExtraField : public ExtraField {
+ public:
+  static const AlignmentExtraField *find(const uint8_t *start,
+                                         const uint8_t *end) {
+    return reinterpret_cast<const AlignmentExtraField *>(
+        ExtraField::find(0xD935, start, end));
+  }
+  bool is() const { return ExtraField::is(0xD935); }
+  void signature() { ExtraField::signature(0xD935); }
+
+  uint16_t alignment() const { return le16toh(alignment_); }
+  void alignment(uint16_t v) { alignment_ = htole16(v); }
+
+  // Sets up the field to occupy `size' bytes, at least sizeof(*this).
+  void fill(uint16_t alignment, uint16_t size) {
+    signature();
+    payload_size(size - sizeof(ExtraField));
+    this->alignment(alignment);
+    memset(padding_, 0, size - sizeof(*this));
+  }
+
+  // Returns how many bytes the field must occupy for the data starting at
+  // `data_offset' without it to be aligned, or 0 if the data is aligned.
+  static size_t padding_needed(uint64_t data_offset, uint32_t alignment) {
+    if (alignment <= 1 || data_offset % alignment == 0) {
+      return 0;
+    }
+    size_t padding = alignment - data_offset % alignment;
+    while (padding < sizeof(AlignmentExtraField)) {
+      padding += alignment;
+    }
+    return padding;
+  }
+
+ private:
+  uint16_t alignment_;
+  uint8_t padding_[];
+} attr_packed;
+static_assert(6 == sizeof(AlignmentExtraField),
+              "AlignmentExtraField layout is incorrect");
+
 /* Local Header precedes each archive file data (section 4.3.7).  */
 class LH {
  public:
@@ -314,5 +314,28 @@ TEST(ZipHeadersTest, Zip64ExtraFieldTest) {
   EXPECT_EQ(kPoison, bytes[z64->size()]);
 }
 
+TEST(ZipHeadersTest, AlignmentExtraFieldTest) {
+  EXPECT_EQ(0, AlignmentExtraField::padding_needed(8192, 4096));
+  EXPECT_EQ(0, AlignmentExtraField::padding_needed(8191, 0));
+  EXPECT_EQ(0, AlignmentExtraField::padding_needed(8191, 1));
+  EXPECT_EQ(4095, AlignmentExtraField::padding_needed(8193, 4096));
+  // The field takes at least 6 bytes.
+  EXPECT_EQ(6, AlignmentExtraField::padding_needed(4090, 4096));
+  EXPECT_EQ(4101, AlignmentExtraField::padding_needed(4091, 4096));
+  EXPECT_EQ(9, AlignmentExtraField::padding_needed(3, 4));
+  EXPECT_EQ(7, AlignmentExtraField::padding_needed(1, 4));
+
+  uint8_t bytes[256];
+  memset(bytes, kPoison, sizeof(bytes));
+  AlignmentExtraField *field = reinterpret_cast<AlignmentExtraField *>(bytes);
+  field->fill(4096, 10);
+  EXPECT_TRUE(field->is());
+  EXPECT_EQ(4096, field->alignment());
+  EXPECT_EQ(10, field->size());
+  EXPECT_EQ(0, bytes[9]);
+  EXPECT_EQ(kPoison, bytes[10]);
+  EXPECT_EQ(field, AlignmentExtraField::find(bytes, bytes + 10));
+}
+
 }  // namespace
 
@@ -16,6 +16,9 @@
 #define BAZEL_SRC_TOOLS_SINGLEJAR_ZLIB_INTERFACE_H_
 
 #include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "src/tools/singlejar/diag.h"
 #include <zlib.h>
@@ -64,6 +67,7 @@ class Inflater {
   }
 
   const uint8_t *next_in() const { return zstream_.next_in; }
+  uint32_t available_in() const { return zstream_.avail_in; }
   uint64_t total_in() const { return zstream_.total_in; }
 
   uint32_t available_out() const { return zstream_.avail_out; }
@@ -96,6 +100,8 @@ struct Deflater : z_stream {
 
   ~Deflater() { deflateEnd(this); }
 
+  void reset() { deflateReset(this); }
+
   int Deflate(const uint8_t *data, uint32_t data_size, int flag) {
     next_in = const_cast<uint8_t *>(data);
     avail_in = data_size;
@@ -103,4 +109,61 @@ struct Deflater : z_stream {
   }
 };
 
+// A pool of Inflater or Deflater instances shared by all threads. Setting up
+// a zlib stream allocates its state (some 270KB for a deflater), so rather
+// than creating a stream for every entry, the combiners take one from the
+// pool and put it back reset when they are done with it. Usage:
+//   InflaterPool::Ptr inflater = InflaterPool::Get();
+//   ... use *inflater; it goes back to the pool when `inflater' goes ...
+template <class Stream>
+class ZStreamPool {
+ public:
+  struct Release {
+    void operator()(Stream *stream) const { Put(stream); }
+  };
+  typedef std::unique_ptr<Stream, Release> Ptr;
+
+  static Ptr Get() {
+    {
+      State &state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (!state.free.empty()) {
+        Stream *stream = state.free.back().release();
+        state.free.pop_back();
+        return Ptr(stream);
+      }
+    }
+    return Ptr(new Stream());
+  }
+
+ private:
+  // At most that many idle streams are kept, which is more than there are
+  // threads using them at once.
+  static const size_t kMaxIdle = 32;
+
+  struct State {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Stream> > free;
+  };
+
+  static State &GetState() {
+    static State state;
+    return state;
+  }
+
+  static void Put(Stream *stream) {
+    stream->reset();
+    State &state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.free.size() < kMaxIdle) {
+      state.free.emplace_back(stream);
+    } else {
+      delete stream;
+    }
+  }
+};
+
+typedef ZStreamPool<Inflater> InflaterPool;
+typedef ZStreamPool<Deflater> DeflaterPool;
+
 #endif  // BAZEL_SRC_TOOLS_SINGLEJAR_ZLIB_INTERFACE_H_
@@ -91,4 +91,42 @@ TEST(ZlibInterfaceTest, InflateToChunks) {
   EXPECT_EQ(0, memcmp(bytes, uncompressed, sizeof(bytes)));
 }
 
+// A stream comes back from the pool reset, even if it was put back in the
+// middle of the data.
+TEST(ZlibInterfaceTest, Pools) {
+  Deflater *first_deflater;
+  uint8_t compressed[256];
+  {
+    DeflaterPool::Ptr deflater = DeflaterPool::Get();
+    first_deflater = deflater.get();
+    deflater->next_out = compressed;
+    deflater->avail_out = sizeof(compressed);
+    EXPECT_EQ(Z_OK, deflater->Deflate(bytes, 4, Z_NO_FLUSH));
+  }
+  DeflaterPool::Ptr deflater = DeflaterPool::Get();
+  EXPECT_EQ(first_deflater, deflater.get());
+  EXPECT_EQ(0, deflater->total_in);
+  deflater->next_out = compressed;
+  deflater->avail_out = sizeof(compressed);
+  EXPECT_EQ(Z_STREAM_END, deflater->Deflate(bytes, sizeof(bytes), Z_FINISH));
+  size_t compressed_size = sizeof(compressed) - deflater->avail_out;
+
+  Inflater *first_inflater;
+  uint8_t uncompressed[256];
+  {
+    InflaterPool::Ptr inflater = InflaterPool::Get();
+    first_inflater = inflater.get();
+    inflater->DataToInflate(compressed, compressed_size);
+    EXPECT_EQ(Z_OK, inflater->Inflate(uncompressed, 3));
+  }
+  InflaterPool::Ptr inflater = InflaterPool::Get();
+  EXPECT_EQ(first_inflater, inflater.get());
+  EXPECT_EQ(0, inflater->total_out());
+  inflater->DataToInflate(compressed, compressed_size);
+  memset(uncompressed, 0, sizeof(uncompressed));
+  EXPECT_EQ(Z_STREAM_END,
+            inflater->Inflate(uncompressed, sizeof(uncompressed)));
+  EXPECT_EQ(0, memcmp(bytes, uncompressed, sizeof(bytes)));
+}
+
 }  //  namespace
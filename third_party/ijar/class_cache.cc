@@ -0,0 +1,119 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "third_party/ijar/class_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif  // _WIN32
+
+#include <atomic>
+
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/path_platform.h"
+#include "third_party/ijar/platform_utils.h"
+
+namespace devtools_ijar {
+
+// Part of every key. Change it whenever the output of StripClass() changes,
+// so that the entries written by older versions of ijar are not used.
+static const char kCacheVersion[] = "ijar-class-cache-1";
+
+// The first byte of a cache entry, followed by the stripped class.
+static const u1 kKeep = 'K';
+static const u1 kDrop = 'D';
+
+// Creating the subdirectories needs an absolute path.
+ClassCache::ClassCache(const char *dir) : dir_(blaze_util::MakeAbsolute(dir)) {}
+
+std::string ClassCache::Key(const u1 *data, size_t size) {
+  blaze_util::Md5Digest digest;
+  digest.Update(kCacheVersion, sizeof(kCacheVersion));
+  digest.Update(data, size);
+  unsigned char result[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(result);
+  return digest.String();
+}
+
+// The entries are spread over 256 subdirectories by the first two digits of
+// the key.
+std::string ClassCache::Path(const std::string &key) const {
+  return dir_ + "/" + key.substr(0, 2) + "/" + key;
+}
+
+bool ClassCache::Lookup(const std::string &key, bool *keep, u1 **data,
+                        size_t *size) const {
+  std::string path = Path(key);
+  FILE *in = fopen(path.c_str(), "rb");
+  if (in == NULL) {
+    return false;
+  }
+  bool ok = false;
+  long length;
+  if (fseek(in, 0, SEEK_END) == 0 && (length = ftell(in)) > 0 &&
+      fseek(in, 0, SEEK_SET) == 0) {
+    u1 *buf = reinterpret_cast<u1 *>(malloc(length));
+    if (fread(buf, 1, length, in) == static_cast<size_t>(length) &&
+        (buf[0] == kKeep || buf[0] == kDrop)) {
+      *keep = buf[0] == kKeep;
+      *size = length - 1;
+      memmove(buf, buf + 1, *size);
+      *data = buf;
+      ok = true;
+    } else {
+      free(buf);
+    }
+  }
+  fclose(in);
+  if (!ok && verbose) {
+    fprintf(stderr, "INFO: ignoring bad class cache entry %s\n", path.c_str());
+  }
+  return ok;
+}
+
+void ClassCache::Store(const std::string &key, bool keep, const u1 *data,
+                       size_t size) const {
+  static std::atomic<unsigned> counter(0);
+  std::string path = Path(key);
+  if (!make_dirs(path.c_str(), 0755)) {
+    return;
+  }
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = getpid();
+#endif  // _WIN32
+  std::string tmp_path = path + ".tmp." + std::to_string(pid) + "." +
+                         std::to_string(counter++);
+  FILE *out = fopen(tmp_path.c_str(), "wb");
+  if (out == NULL) {
+    return;
+  }
+  u1 tag = keep ? kKeep : kDrop;
+  bool ok = fwrite(&tag, 1, 1, out) == 1 &&
+            fwrite(data, 1, size, out) == size;
+  ok = fclose(out) == 0 && ok;
+  // Another process may have stored the same entry in the meantime; either
+  // copy will do.
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+  }
+}
+
+}  // namespace devtools_ijar
@@ -0,0 +1,56 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_IJAR_CLASS_CACHE_H_
+#define THIRD_PARTY_IJAR_CLASS_CACHE_H_
+
+#include <string>
+
+#include "third_party/ijar/common.h"
+
+namespace devtools_ijar {
+
+// An on-disk cache of stripped classes, keyed by the digest of the input
+// class and the version of the stripping. The same classes show up in many
+// jars (shaded copies, repackaged libraries), and the cache lets ijar strip
+// each of them only once. The cache directory can be shared by concurrent
+// ijar processes: entries are written to a temporary file and renamed into
+// place. Failing to read or write the cache is not an error; the class is
+// then stripped again.
+class ClassCache {
+ public:
+  explicit ClassCache(const char *dir);
+
+  // Returns the cache key of the given input class.
+  static std::string Key(const u1 *data, size_t size);
+
+  // Looks up the stripped class with the given key. On a hit, returns true,
+  // sets `*keep` to whether the class is kept and `*data` to a buffer with
+  // the stripped class, to be released with free().
+  bool Lookup(const std::string &key, bool *keep, u1 **data,
+              size_t *size) const;
+
+  // Stores the stripped class with the given key.
+  void Store(const std::string &key, bool keep, const u1 *data,
+             size_t size) const;
+
+ private:
+  std::string Path(const std::string &key) const;
+
+  std::string dir_;
+};
+
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_CLASS_CACHE_H_
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <set>
 #include <sstream>
 #include <string>
@@ -110,21 +111,92 @@ enum TARGET_TYPE {
 
 struct Constant;
 
-// TODO(adonovan) these globals are unfortunate
-static std::vector<Constant*>        const_pool_in; // input constant pool
-static std::vector<Constant*>        const_pool_out; // output constant_pool
-static std::set<std::string>         used_class_names;
-static Constant *                    class_name;
+// A bump allocator: the memory it hands out is released all at once, when
+// the arena is destroyed.
+class Arena {
+ public:
+  Arena() : next_(NULL), end_(NULL) {}
 
-// Returns the Constant object, given an index into the input constant pool.
+  ~Arena() {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+      free(blocks_[i]);
+    }
+  }
+
+  void *Allocate(size_t size) {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if (size > static_cast<size_t>(end_ - next_)) {
+      size_t block_size = std::max(size, kBlockSize);
+      next_ = static_cast<char *>(malloc(block_size));
+      if (next_ == NULL) {
+        fprintf(stderr, "Cannot allocate %zu bytes\n", block_size);
+        abort();
+      }
+      blocks_.push_back(next_);
+      end_ = next_ + block_size;
+    }
+    void *result = next_;
+    next_ += size;
+    return result;
+  }
+
+ private:
+  static const size_t kAlignment = 16;
+  static const size_t kBlockSize = 64 * 1024;
+
+  std::vector<char *> blocks_;
+  char *next_;
+  char *end_;
+};
+
+// The state of stripping a single class. It used to be kept in globals;
+// StripClass() now creates one for each call and makes it current for the
+// calling thread, so that several threads can strip classes at once.
+struct ClassContext {
+  ClassContext() : class_name(NULL) {}
+
+  // The input constant pool is decoded lazily: const_pool_entries holds the
+  // position of each entry in the class data (NULL for the dummy entry zero
+  // and the second slot of longs and doubles), const_pool_in the Constant
+  // objects decoded so far. Only the constants reachable from what the
+  // output retains are ever decoded.
+  std::vector<const u1*> const_pool_entries;
+  std::vector<Constant*> const_pool_in;  // input constant pool
+  std::vector<Constant*> const_pool_out;  // output constant_pool
+  std::set<std::string> used_class_names;
+  Constant *class_name;
+  // All the objects describing the class live here.
+  Arena arena;
+};
+
+static thread_local ClassContext *context = NULL;
+
+// The base of the objects describing a class. They are allocated in the
+// arena of the current ClassContext; deleting one only runs its destructor.
+struct ArenaObject {
+  static void *operator new(size_t size) {
+    return context->arena.Allocate(size);
+  }
+  static void operator delete(void * /*object*/) {}
+};
+
+// Creates the Constant object for the constant pool entry at p.
+static Constant *DecodeConstant(const u1 *p);
+
+// Returns the Constant object, given an index into the input constant pool,
+// decoding it on first use.
 // Note: constant(0) == NULL; this invariant is exploited by the
 // InnerClassesAttribute, inter alia.
 inline Constant *constant(int idx) {
-  if (idx < 0 || (unsigned)idx >= const_pool_in.size()) {
+  if (idx < 0 || (unsigned)idx >= context->const_pool_entries.size()) {
     fprintf(stderr, "Illegal constant pool index: %d\n", idx);
     abort();
   }
-  return const_pool_in[idx];
+  Constant *&result = context->const_pool_in[idx];
+  if (result == NULL && context->const_pool_entries[idx] != NULL) {
+    result = DecodeConstant(context->const_pool_entries[idx]);
+  }
+  return result;
 }
 
 /**********************************************************************
@@ -134,7 +206,7 @@ inline Constant *constant(int idx) {
  **********************************************************************/
 
 // See sec.4.4 of JVM spec.
-struct Constant {
+struct Constant : ArenaObject {
 
   Constant(u1 tag) :
       slot_(0),
@@ -163,7 +235,7 @@ struct Constant {
   u2 slot() {
     if (slot_ == 0) {
       Keep();
-      slot_ = const_pool_out.size(); // BugBot's "narrowing" warning
+      slot_ = context->const_pool_out.size(); // BugBot's "narrowing" warning
                                      // is bogus.  The number of
                                      // output constants can't exceed
                                      // the number of input constants.
@@ -171,9 +243,9 @@ struct Constant {
         fprintf(stderr, "Constant::slot() called before output phase.\n");
         abort();
       }
-      const_pool_out.push_back(this);
+      context->const_pool_out.push_back(this);
       if (tag_ == CONSTANT_Long || tag_ == CONSTANT_Double) {
-        const_pool_out.push_back(NULL);
+        context->const_pool_out.push_back(NULL);
       }
     }
     return slot_;
@@ -183,8 +255,8 @@ struct Constant {
   u1 tag_;
 };
 
-// Extracts class names from a signature and puts them into the global
-// variable used_class_names.
+// Extracts class names from a signature and puts them into the
+// used_class_names of the current context.
 //
 // desc: the descriptor class names should be extracted from.
 // p: the position where the extraction should tart.
@@ -420,7 +492,7 @@ struct Constant_InvokeDynamic : Constant
  **********************************************************************/
 
 // See sec.4.7 of JVM spec.
-struct Attribute {
+struct Attribute : ArenaObject {
 
   virtual ~Attribute() {}
   virtual void Write(u1 *&p) = 0;
@@ -461,7 +533,7 @@ struct ExceptionsAttribute : Attribute {
 // See sec.4.7.6 of JVM spec.
 struct InnerClassesAttribute : Attribute {
 
-  struct Entry {
+  struct Entry : ArenaObject {
     Constant *inner_class_info;
     Constant *outer_class_info;
     Constant *inner_name;
@@ -505,9 +577,10 @@ struct InnerClassesAttribute : Attribute {
            ++i_entry) {
         Entry* entry = entries_[i_entry];
         if (entry->inner_class_info->Kept() ||
-            used_class_names.find(entry->inner_class_info->Display()) !=
-                used_class_names.end() ||
-            entry->outer_class_info == class_name) {
+            context->used_class_names.find(
+                entry->inner_class_info->Display()) !=
+                context->used_class_names.end() ||
+            entry->outer_class_info == context->class_name) {
           if (entry->inner_name == NULL) {
             // JVMS 4.7.6: inner_name_index is zero iff the class is anonymous
             continue;
@@ -582,7 +655,7 @@ struct EnclosingMethodAttribute : Attribute {
 
 // See sec.4.7.16.1 of JVM spec.
 // Used by AnnotationDefault and other attributes.
-struct ElementValue {
+struct ElementValue : ArenaObject {
   virtual ~ElementValue() {}
   virtual void Write(u1 *&p) = 0;
   virtual void ExtractClassNames() {}
@@ -671,7 +744,7 @@ struct ArrayTypeElementValue : ElementValue {
 };
 
 // See sec.4.7.16 of JVM spec.
-struct Annotation {
+struct Annotation : ArenaObject {
   virtual ~Annotation() {
     for (size_t i = 0; i < element_value_pairs_.size(); i++) {
       delete element_value_pairs_[i]->element_value_;
@@ -706,7 +779,7 @@ struct Annotation {
     return value;
   }
   Constant *type_;
-  struct ElementValuePair {
+  struct ElementValuePair : ArenaObject {
     Constant *element_name_;
     ElementValue *element_value_;
   };
@@ -743,7 +816,7 @@ struct Annotation {
 //   element_value_pairs[num_element_value_pairs];
 // }
 //
-struct TypeAnnotation {
+struct TypeAnnotation : ArenaObject {
   virtual ~TypeAnnotation() {
     delete target_info_;
     delete type_path_;
@@ -770,7 +843,7 @@ struct TypeAnnotation {
     return value;
   }
 
-  struct TargetInfo {
+  struct TargetInfo : ArenaObject {
     virtual ~TargetInfo() {}
     virtual void Write(u1 *&p) = 0;
   };
@@ -868,7 +941,7 @@ struct TypeAnnotation {
     }
   }
 
-  struct TypePath {
+  struct TypePath : ArenaObject {
     void Write(u1 *&p) {
       put_u1(p, path_.size());
       for (TypePathEntry entry : path_) {
@@ -1182,7 +1255,7 @@ struct MethodParametersAttribute : Attribute {
     put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
   }
 
-  struct MethodParameter {
+  struct MethodParameter : ArenaObject {
     Constant *name_;
     u2 access_flags_;
   };
@@ -1216,7 +1289,7 @@ struct GeneralAttribute : Attribute {
  *                                                                    *
  **********************************************************************/
 
-struct HasAttrs {
+struct HasAttrs : ArenaObject {
   std::vector<Attribute*> attributes;
 
   void WriteAttrs(u1 *&p);
@@ -1300,6 +1373,7 @@ struct ClassFile : HasAttrs {
     put_u2be(p, major);
     put_u2be(p, minor);
 
+    const std::vector<Constant*> &const_pool_out = context->const_pool_out;
     put_u2be(p, const_pool_out.size());
     for (u2 ii = 1; ii < const_pool_out.size(); ++ii) {
       if (const_pool_out[ii] != NULL) { // NB: NULLs appear after long/double.
@@ -1426,13 +1500,79 @@ void HasAttrs::WriteAttrs(u1 *&p) {
 }
 
 // See sec.4.4 of JVM spec.
+static Constant *DecodeConstant(const u1 *p) {
+  u1 tag = get_u1(p);
+  switch(tag) {
+    case CONSTANT_Class: {
+      u2 name_index = get_u2be(p);
+      return new Constant_Class(name_index);
+    }
+    case CONSTANT_FieldRef:
+    case CONSTANT_Methodref:
+    case CONSTANT_Interfacemethodref: {
+      u2 class_index = get_u2be(p);
+      u2 nti = get_u2be(p);
+      return new Constant_FMIref(tag, class_index, nti);
+    }
+    case CONSTANT_String: {
+      u2 string_index = get_u2be(p);
+      return new Constant_String(string_index);
+    }
+    case CONSTANT_NameAndType: {
+      u2 name_index = get_u2be(p);
+      u2 descriptor_index = get_u2be(p);
+      return new Constant_NameAndType(name_index, descriptor_index);
+    }
+    case CONSTANT_Utf8: {
+      u2 length = get_u2be(p);
+      return new Constant_Utf8(length, p);
+    }
+    case CONSTANT_Integer:
+    case CONSTANT_Float: {
+      u4 bytes = get_u4be(p);
+      return new Constant_IntegerOrFloat(tag, bytes);
+    }
+    case CONSTANT_Long:
+    case CONSTANT_Double: {
+      u4 high_bytes = get_u4be(p);
+      u4 low_bytes = get_u4be(p);
+      return new Constant_LongOrDouble(tag, high_bytes, low_bytes);
+    }
+    case CONSTANT_MethodHandle: {
+      u1 reference_kind = get_u1(p);
+      u2 reference_index = get_u2be(p);
+      return new Constant_MethodHandle(reference_kind, reference_index);
+    }
+    case CONSTANT_MethodType: {
+      u2 descriptor_index = get_u2be(p);
+      return new Constant_MethodType(descriptor_index);
+    }
+    case CONSTANT_InvokeDynamic: {
+      u2 bootstrap_method_attr = get_u2be(p);
+      u2 name_name_type_index = get_u2be(p);
+      return new Constant_InvokeDynamic(bootstrap_method_attr,
+                                        name_name_type_index);
+    }
+    default: {
+      // ReadConstantPool() has rejected the class.
+      fprintf(stderr, "Unknown constant: %02x.\n", tag);
+      abort();
+    }
+  }
+}
+
+// Only records where each entry starts; DecodeConstant() does the rest when
+// the constant is needed.
 bool ClassFile::ReadConstantPool(const u1 *&p) {
+  std::vector<const u1*> &const_pool_entries = context->const_pool_entries;
 
-  const_pool_in.clear();
-  const_pool_in.push_back(NULL); // dummy first item
+  const_pool_entries.clear();
+  const_pool_entries.push_back(NULL); // dummy first item
 
   u2 cp_count = get_u2be(p);
+  const_pool_entries.reserve(cp_count);
   for (int ii = 1; ii < cp_count; ++ii) {
+    const_pool_entries.push_back(p);
     u1 tag = get_u1(p);
 
     if (devtools_ijar::verbose) {
@@ -1440,80 +1580,41 @@ bool ClassFile::ReadConstantPool(const u1 *&p) {
     }
 
     switch(tag) {
-      case CONSTANT_Class: {
-        u2 name_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_Class(name_index));
+      case CONSTANT_Class:
+      case CONSTANT_String:
+      case CONSTANT_MethodType:
+        p += 2;
+        break;
+      case CONSTANT_MethodHandle:
+        p += 3;
         break;
-      }
       case CONSTANT_FieldRef:
       case CONSTANT_Methodref:
-      case CONSTANT_Interfacemethodref: {
-        u2 class_index = get_u2be(p);
-        u2 nti = get_u2be(p);
-        const_pool_in.push_back(new Constant_FMIref(tag, class_index, nti));
-        break;
-      }
-      case CONSTANT_String: {
-        u2 string_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_String(string_index));
-        break;
-      }
-      case CONSTANT_NameAndType: {
-        u2 name_index = get_u2be(p);
-        u2 descriptor_index = get_u2be(p);
-        const_pool_in.push_back(
-            new Constant_NameAndType(name_index, descriptor_index));
+      case CONSTANT_Interfacemethodref:
+      case CONSTANT_NameAndType:
+      case CONSTANT_Integer:
+      case CONSTANT_Float:
+      case CONSTANT_InvokeDynamic:
+        p += 4;
         break;
-      }
       case CONSTANT_Utf8: {
         u2 length = get_u2be(p);
         if (devtools_ijar::verbose) {
           fprintf(stderr, "Utf8: \"%s\" (%d)\n",
                   std::string((const char*) p, length).c_str(), length);
         }
-
-        const_pool_in.push_back(new Constant_Utf8(length, p));
         p += length;
         break;
       }
-      case CONSTANT_Integer:
-      case CONSTANT_Float: {
-        u4 bytes = get_u4be(p);
-        const_pool_in.push_back(new Constant_IntegerOrFloat(tag, bytes));
-        break;
-      }
       case CONSTANT_Long:
-      case CONSTANT_Double: {
-        u4 high_bytes = get_u4be(p);
-        u4 low_bytes = get_u4be(p);
-        const_pool_in.push_back(
-            new Constant_LongOrDouble(tag, high_bytes, low_bytes));
+      case CONSTANT_Double:
+        p += 8;
         // Longs and doubles occupy two constant pool slots.
         // ("In retrospect, making 8-byte constants take two "constant
         // pool entries was a poor choice." --JVM Spec.)
-        const_pool_in.push_back(NULL);
+        const_pool_entries.push_back(NULL);
         ii++;
         break;
-      }
-      case CONSTANT_MethodHandle: {
-        u1 reference_kind = get_u1(p);
-        u2 reference_index = get_u2be(p);
-        const_pool_in.push_back(
-            new Constant_MethodHandle(reference_kind, reference_index));
-        break;
-      }
-      case CONSTANT_MethodType: {
-        u2 descriptor_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_MethodType(descriptor_index));
-        break;
-      }
-      case CONSTANT_InvokeDynamic: {
-        u2 bootstrap_method_attr = get_u2be(p);
-        u2 name_name_type_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_InvokeDynamic(
-            bootstrap_method_attr, name_name_type_index));
-        break;
-      }
       default: {
         fprintf(stderr, "Unknown constant: %02x. Passing class through.\n",
                 tag);
@@ -1521,6 +1622,7 @@ bool ClassFile::ReadConstantPool(const u1 *&p) {
       }
     }
   }
+  context->const_pool_in.assign(const_pool_entries.size(), NULL);
 
   return true;
 }
@@ -1558,7 +1660,7 @@ static ClassFile *ReadClass(const void *classdata, size_t length) {
 
   clazz->access_flags = get_u2be(p);
   clazz->this_class = constant(get_u2be(p));
-  class_name = clazz->this_class;
+  context->class_name = clazz->this_class;
 
   u2 super_class_id = get_u2be(p);
   clazz->super_class = super_class_id == 0 ? NULL : constant(super_class_id);
@@ -1654,7 +1756,7 @@ void ParseClassTypeSignatureSuffix(const std::string& desc, size_t* p) {
 void ParseIdentifier(const std::string& desc, size_t* p) {
   size_t next = desc.find_first_of(SIGNATURE_NON_IDENTIFIER_CHARS, *p);
   std::string id = desc.substr(*p, next - *p);
-  used_class_names.insert(id);
+  context->used_class_names.insert(id);
   *p = next;
 }
 
@@ -1757,7 +1859,7 @@ void ExtractClassNames(const std::string& desc, size_t* p) {
 }
 
 void ClassFile::WriteClass(u1 *&p) {
-  used_class_names.clear();
+  context->used_class_names.clear();
   std::vector<Member *> members;
   members.insert(members.end(), fields.begin(), fields.end());
   members.insert(members.end(), methods.begin(), methods.end());
@@ -1770,17 +1872,20 @@ void ClassFile::WriteClass(u1 *&p) {
 
   // We have to write the body out before the header in order to reference
   // the essential constants and populate the output constant pool:
-  u1 *body = new u1[length];
+  u1 *body = static_cast<u1 *>(context->arena.Allocate(length));
   u1 *q = body;
   WriteBody(q); // advances q
   u4 body_length = q - body;
 
   WriteHeader(p); // advances p
   put_n(p, body, body_length);
-  delete[] body;
 }
 
 bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
+  ClassContext class_context;
+  ClassContext *saved_context = context;
+  context = &class_context;
+
   ClassFile *clazz = ReadClass(classdata_in, in_length);
   bool keep = true;
   if (clazz == NULL) {
@@ -1793,20 +1898,18 @@ bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
     // Constant pool item zero is a dummy entry.  Setting it marks the
     // beginning of the output phase; calls to Constant::slot() will
     // fail if called prior to this.
-    const_pool_out.push_back(NULL);
+    context->const_pool_out.push_back(NULL);
     clazz->WriteClass(classdata_out);
-
-    delete clazz;
   }
 
-  // Now clean up all the mess we left behind.
-
-  for (size_t i = 0; i < const_pool_in.size(); i++) {
-    delete const_pool_in[i];
+  // Now clean up all the mess we left behind. The destructors release the
+  // memory the objects hold outside the arena (e.g. their vectors).
+  delete clazz;
+  for (size_t i = 0; i < context->const_pool_in.size(); i++) {
+    delete context->const_pool_in[i];
   }
 
-  const_pool_in.clear();
-  const_pool_out.clear();
+  context = saved_context;
   return keep;
 }
 
@@ -20,9 +20,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "third_party/ijar/class_cache.h"
+#include "third_party/ijar/persistent_worker.h"
+#include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
+#include "src/main/cpp/util/md5.h"
+#include "src/main/cpp/util/thread_pool.h"
 
 namespace devtools_ijar {
 
@@ -53,6 +65,33 @@ const size_t TARGET_LABEL_KEY_LENGTH = strlen(TARGET_LABEL_KEY);
 const char *INJECTING_RULE_KIND_KEY = "Injecting-Rule-Kind: ";
 const size_t INJECTING_RULE_KIND_KEY_LENGTH = strlen(INJECTING_RULE_KIND_KEY);
 
+// Returns the maximum size of a manifest written from scratch by
+// WriteManifest.
+static size_t MaxManifestLength(const char *target_label,
+                                const char *injecting_rule_kind) {
+  if (target_label == nullptr) {
+    return 0;
+  }
+  size_t length = MANIFEST_HEADER_LENGTH;
+  // target label manifest entry, including newline
+  length += TARGET_LABEL_KEY_LENGTH + strlen(target_label) + 2;
+  if (injecting_rule_kind) {
+    // injecting rule kind manifest entry, including newline
+    length += INJECTING_RULE_KIND_KEY_LENGTH + strlen(injecting_rule_kind) + 2;
+  }
+  return length;
+}
+
+// Returns the digest of the stripped class, in hex. Two versions of a class
+// have the same digest iff they have the same ABI.
+static std::string AbiDigest(const u1 *data, size_t size) {
+  blaze_util::Md5Digest digest;
+  digest.Update(data, size);
+  unsigned char result[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(result);
+  return digest.String();
+}
+
 class JarExtractorProcessor : public ZipExtractorProcessor {
  public:
   // Set the ZipBuilder to add the ijar class to the output zip file.
@@ -61,28 +100,157 @@ class JarExtractorProcessor : public ZipExtractorProcessor {
   void SetZipBuilder(ZipBuilder *builder) { this->builder_ = builder; }
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind) = 0;
+  // Writes out the files still pending. Called after the last Process().
+  virtual void Finish() {}
+
+  // Makes the processor record the ABI digest of each stripped class it
+  // writes out, for WriteAbiDigests(). Must be called before Process().
+  void RecordAbiDigests() { record_abi_digests_ = true; }
+
+  // Writes the recorded ABI digests to `path': one line per class, in the
+  // output order, with the class name (its path in the jar without the
+  // .class extension), a tab and the digest. Returns false on error.
+  bool WriteAbiDigests(const char *path) const;
 
  protected:
   // Not owned by JarStripperProcessor, see SetZipBuilder().
   ZipBuilder *builder_;
+  bool record_abi_digests_ = false;
+  // The class names and the digests of their stripped versions.
+  std::vector<std::pair<std::string, std::string>> abi_digests_;
 };
 
+bool JarExtractorProcessor::WriteAbiDigests(const char *path) const {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  for (const auto &entry : abi_digests_) {
+    const std::string &name = entry.first;
+    size_t length = name.size() - std::min(name.size(), CLASS_EXTENSION_LENGTH);
+    fprintf(out, "%.*s\t%s\n", static_cast<int>(length), name.c_str(),
+            entry.second.c_str());
+  }
+  if (fclose(out) != 0) {
+    fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
 // ZipExtractorProcessor that select only .class file and use
 // StripClass to generate an interface class, storing as a new file
 // in the specified ZipBuilder.
+// With a thread pool, the classes are stripped on its workers, and the
+// stripped classes are written out in the input order as they become ready.
+// The stripped classes are looked up in and stored into the cache, if any.
+// With `store', the files copied unchanged are decompressed, so that every
+// file of the output is stored.
 class JarStripperProcessor : public JarExtractorProcessor {
  public:
-  JarStripperProcessor() {}
-  virtual ~JarStripperProcessor() {}
+  // The pool and the cache are not owned and may be null.
+  JarStripperProcessor(blaze_util::ThreadPool *pool, const ClassCache *cache,
+                       bool store);
+  virtual ~JarStripperProcessor();
 
   virtual void Process(const char *filename, const u4 attr, const u1 *data,
                        const size_t size);
   virtual bool Accept(const char *filename, const u4 attr);
+  virtual bool AcceptRaw(const char *filename, const u4 attr);
+  virtual void ProcessRaw(const char *filename, const u4 attr, const u1 *data,
+                          const size_t compressed_size,
+                          const u2 compression_method, const u4 crc,
+                          const size_t size);
 
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind);
+  virtual void Finish();
+
+ private:
+  // A file waiting to be written out.
+  struct PendingFile {
+    PendingFile(const char *filename, const u1 *data, size_t size, bool strip)
+        : filename(filename),
+          data(data, data + size),
+          strip(strip),
+          stripped(nullptr),
+          stripped_length(0),
+          keep(true),
+          done(!strip),
+          raw(false),
+          compression_method(0),
+          crc(0),
+          length(0) {}
+    // A file copied without decompressing it: `data' holds the compressed
+    // bytes.
+    PendingFile(const char *filename, const u1 *data, size_t compressed_size,
+                u2 compression_method, u4 crc, size_t length)
+        : PendingFile(filename, data, compressed_size, false) {
+      raw = true;
+      this->compression_method = compression_method;
+      this->crc = crc;
+      this->length = length;
+    }
+    ~PendingFile() { free(stripped); }
+
+    std::string filename;
+    std::vector<u1> data;
+    // Whether the file is a class to strip, rather than to copy.
+    bool strip;
+    u1 *stripped;
+    size_t stripped_length;
+    bool keep;
+    // Whether the file is ready to be written out. Guarded by mutex_.
+    bool done;
+    bool raw;
+    u2 compression_method;
+    u4 crc;
+    size_t length;
+    // The ABI digest of the stripped class, if recorded.
+    std::string abi_digest;
+  };
+
+  // Strips the class of the file on a worker, and marks it done.
+  void StripPending(PendingFile *file);
+  // Strips the class, or finds it in the cache. Sets `*stripped` to a buffer
+  // with the stripped class, to be released with free(). Returns whether the
+  // class should be kept.
+  bool Strip(const u1 *data, size_t size, u1 **stripped,
+             size_t *stripped_length);
+  void WriteFile(const char *filename, const u1 *data, size_t size);
+  // Queues the file, to be written out once the ones before it are.
+  void AddPending(PendingFile *file);
+  // Writes out the files at the head of pending_ that are done, waiting for
+  // them as long as more than `max_pending' remain.
+  void WritePending(size_t max_pending);
+
+  blaze_util::ThreadPool *pool_;
+  const ClassCache *cache_;
+  const bool store_;
+  // The files not written out yet, in the input order.
+  std::deque<std::unique_ptr<PendingFile>> pending_;
+  size_t max_pending_;
+  // The classes being stripped on the pool. Guarded by mutex_.
+  size_t stripping_;
+  std::mutex mutex_;
+  std::condition_variable done_cond_;
 };
 
+JarStripperProcessor::JarStripperProcessor(blaze_util::ThreadPool *pool,
+                                           const ClassCache *cache, bool store)
+    : pool_(pool),
+      cache_(cache),
+      store_(store),
+      max_pending_(pool ? 4 * pool->thread_count() : 0),
+      stripping_(0) {}
+
+JarStripperProcessor::~JarStripperProcessor() {
+  // The workers still stripping classes hold pointers into pending_.
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this]() { return stripping_ == 0; });
+}
+
 static bool StartsWith(const char *str, const size_t str_len,
                        const char *prefix, const size_t prefix_len) {
   return str_len >= prefix_len && strncmp(str, prefix, prefix_len) == 0;
@@ -124,28 +292,145 @@ static bool IsModuleInfo(const char *filename) {
   return strcmp(slash, "module-info.class") == 0;
 }
 
+// The module-info classes and the Kotlin modules are copied unchanged, so
+// they are not even decompressed, unless the output is stored.
+bool JarStripperProcessor::AcceptRaw(const char *filename, const u4 /*attr*/) {
+  return !store_ &&
+         (IsModuleInfo(filename) || IsKotlinModule(filename, strlen(filename)));
+}
+
+void JarStripperProcessor::ProcessRaw(const char *filename, const u4 /*attr*/,
+                                      const u1 *data,
+                                      const size_t compressed_size,
+                                      const u2 compression_method,
+                                      const u4 crc, const size_t size) {
+  if (verbose) {
+    fprintf(stderr, "INFO: CopyFile: %s\n", filename);
+  }
+  if (pool_ == nullptr) {
+    builder_->WriteRawFile(filename, 0, data, compressed_size,
+                           compression_method, crc, size);
+    return;
+  }
+  AddPending(new PendingFile(filename, data, compressed_size,
+                             compression_method, crc, size));
+}
+
 void JarStripperProcessor::Process(const char *filename, const u4 /*attr*/,
                                    const u1 *data, const size_t size) {
   if (verbose) {
     fprintf(stderr, "INFO: StripClass: %s\n", filename);
   }
-  if (IsModuleInfo(filename) || IsKotlinModule(filename, strlen(filename))) {
-    u1 *q = builder_->NewFile(filename, 0);
-    memcpy(q, data, size);
-    builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
-  } else {
-    u1 *buf = reinterpret_cast<u1 *>(malloc(size));
-    u1 *classdata_out = buf;
-    if (!StripClass(buf, data, size)) {
-      free(classdata_out);
+  bool strip =
+      !IsModuleInfo(filename) && !IsKotlinModule(filename, strlen(filename));
+  if (pool_ == nullptr) {
+    if (!strip) {
+      WriteFile(filename, data, size);
       return;
     }
-    u1 *q = builder_->NewFile(filename, 0);
-    size_t out_length = buf - classdata_out;
-    memcpy(q, classdata_out, out_length);
-    builder_->FinishFile(out_length, /* compress: */ false,
-                         /* compute_crc: */ true);
-    free(classdata_out);
+    u1 *stripped;
+    size_t stripped_length;
+    if (Strip(data, size, &stripped, &stripped_length)) {
+      WriteFile(filename, stripped, stripped_length);
+      if (record_abi_digests_) {
+        abi_digests_.emplace_back(filename,
+                                  AbiDigest(stripped, stripped_length));
+      }
+    }
+    free(stripped);
+    return;
+  }
+
+  // The data are only valid during this call, so the file keeps a copy.
+  AddPending(new PendingFile(filename, data, size, strip));
+}
+
+void JarStripperProcessor::AddPending(PendingFile *file) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.emplace_back(file);
+    if (file->strip) {
+      ++stripping_;
+    }
+  }
+  if (file->strip) {
+    pool_->Submit([this, file]() { StripPending(file); });
+  }
+  WritePending(max_pending_);
+}
+
+void JarStripperProcessor::Finish() { WritePending(0); }
+
+void JarStripperProcessor::StripPending(PendingFile *file) {
+  file->keep = Strip(file->data.data(), file->data.size(), &file->stripped,
+                     &file->stripped_length);
+  if (file->keep && record_abi_digests_) {
+    file->abi_digest = AbiDigest(file->stripped, file->stripped_length);
+  }
+  // Notify with the lock held: once stripping_ drops to 0, the destructor
+  // may run.
+  std::lock_guard<std::mutex> lock(mutex_);
+  file->done = true;
+  --stripping_;
+  done_cond_.notify_all();
+}
+
+bool JarStripperProcessor::Strip(const u1 *data, size_t size, u1 **stripped,
+                                 size_t *stripped_length) {
+  std::string key;
+  bool keep;
+  if (cache_ != nullptr) {
+    key = ClassCache::Key(data, size);
+    if (cache_->Lookup(key, &keep, stripped, stripped_length)) {
+      return keep;
+    }
+  }
+  u1 *buf = reinterpret_cast<u1 *>(malloc(size));
+  *stripped = buf;
+  keep = StripClass(buf, data, size);
+  *stripped_length = buf - *stripped;
+  if (cache_ != nullptr) {
+    cache_->Store(key, keep, *stripped, *stripped_length);
+  }
+  return keep;
+}
+
+void JarStripperProcessor::WriteFile(const char *filename, const u1 *data,
+                                     size_t size) {
+  u1 *q = builder_->NewFile(filename, 0, size);
+  memcpy(q, data, size);
+  builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
+}
+
+void JarStripperProcessor::WritePending(size_t max_pending) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!pending_.empty()) {
+    PendingFile *file = pending_.front().get();
+    if (!file->done) {
+      if (pending_.size() <= max_pending) {
+        return;
+      }
+      done_cond_.wait(lock, [file]() { return file->done; });
+    }
+    std::unique_ptr<PendingFile> ready(std::move(pending_.front()));
+    pending_.pop_front();
+    lock.unlock();
+    if (ready->raw) {
+      builder_->WriteRawFile(ready->filename.c_str(), 0, ready->data.data(),
+                             ready->data.size(), ready->compression_method,
+                             ready->crc, ready->length);
+    } else if (!ready->strip) {
+      WriteFile(ready->filename.c_str(), ready->data.data(),
+                ready->data.size());
+    } else if (ready->keep) {
+      WriteFile(ready->filename.c_str(), ready->stripped,
+                ready->stripped_length);
+      if (record_abi_digests_) {
+        abi_digests_.emplace_back(ready->filename,
+                                  std::move(ready->abi_digest));
+      }
+    }
+    lock.lock();
   }
 }
 
@@ -173,7 +458,8 @@ void JarStripperProcessor::WriteManifest(const char *target_label,
     return;
   }
   builder_->WriteEmptyFile(MANIFEST_DIR_PATH);
-  u1 *start = builder_->NewFile(MANIFEST_PATH, 0);
+  u1 *start = builder_->NewFile(
+      MANIFEST_PATH, 0, MaxManifestLength(target_label, injecting_rule_kind));
   u1 *buf = start;
   buf = WriteStr(buf, MANIFEST_HEADER);
   buf = WriteManifestAttr(buf, TARGET_LABEL_KEY, target_label);
@@ -185,14 +471,21 @@ void JarStripperProcessor::WriteManifest(const char *target_label,
                        /* compute_crc: */ true);
 }
 
+// ZipExtractorProcessor that copies every file unchanged. With `store', the
+// files are decompressed, so that every file of the output is stored.
 class JarCopierProcessor : public JarExtractorProcessor {
  public:
-  JarCopierProcessor(const char *jar) : jar_(jar) {}
+  JarCopierProcessor(const char *jar, bool store) : jar_(jar), store_(store) {}
   virtual ~JarCopierProcessor() {}
 
   virtual void Process(const char *filename, const u4 /*attr*/, const u1 *data,
                        const size_t size);
   virtual bool Accept(const char *filename, const u4 /*attr*/);
+  virtual bool AcceptRaw(const char *filename, const u4 /*attr*/);
+  virtual void ProcessRaw(const char *filename, const u4 attr, const u1 *data,
+                          const size_t compressed_size,
+                          const u2 compression_method, const u4 crc,
+                          const size_t size);
 
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind);
@@ -219,6 +512,7 @@ class JarCopierProcessor : public JarExtractorProcessor {
   };
 
   const char *jar_;
+  const bool store_;
 
   u1 *AppendTargetLabelToManifest(u1 *buf, const u1 *manifest_data,
                                   const size_t size, const char *target_label,
@@ -235,7 +529,7 @@ void JarCopierProcessor::Process(const char *filename, const u4 /*attr*/,
       strcmp(filename, MANIFEST_PATH) == 0) {
     return;
   }
-  u1 *q = builder_->NewFile(filename, 0);
+  u1 *q = builder_->NewFile(filename, 0, size);
   memcpy(q, data, size);
   builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
 }
@@ -244,6 +538,30 @@ bool JarCopierProcessor::Accept(const char * /*filename*/, const u4 /*attr*/) {
   return true;
 }
 
+// Every file is copied unchanged, without decompressing it, unless the
+// output is stored.
+bool JarCopierProcessor::AcceptRaw(const char * /*filename*/,
+                                   const u4 /*attr*/) {
+  return !store_;
+}
+
+void JarCopierProcessor::ProcessRaw(const char *filename, const u4 /*attr*/,
+                                    const u1 *data,
+                                    const size_t compressed_size,
+                                    const u2 compression_method, const u4 crc,
+                                    const size_t size) {
+  if (verbose) {
+    fprintf(stderr, "INFO: CopyFile: %s\n", filename);
+  }
+  // We already handled the manifest in WriteManifest
+  if (strcmp(filename, MANIFEST_DIR_PATH) == 0 ||
+      strcmp(filename, MANIFEST_PATH) == 0) {
+    return;
+  }
+  builder_->WriteRawFile(filename, 0, data, compressed_size,
+                         compression_method, crc, size);
+}
+
 void JarCopierProcessor::WriteManifest(const char *target_label,
                                        const char *injecting_rule_kind) {
   ManifestLocator manifest_locator;
@@ -255,7 +573,11 @@ void JarCopierProcessor::WriteManifest(const char *target_label,
       manifest_locator.manifest_buf_ != nullptr || target_label != nullptr;
   if (wants_manifest) {
     builder_->WriteEmptyFile(MANIFEST_DIR_PATH);
-    u1 *start = builder_->NewFile(MANIFEST_PATH, 0);
+    // A merged manifest is at most the old one plus the new attributes.
+    u1 *start = builder_->NewFile(
+        MANIFEST_PATH, 0,
+        manifest_locator.manifest_size_ +
+            MaxManifestLength(target_label, injecting_rule_kind));
     u1 *buf = start;
     // Three cases:
     // 1. We need to merge the target label into a pre-existing manifest
@@ -315,42 +637,78 @@ u1 *JarCopierProcessor::AppendTargetLabelToManifest(
   return buf;
 }
 
-// WriteManifest, including zip file format overhead.
-static size_t EstimateManifestOutputSize(const char *target_label,
-                                         const char *injecting_rule_kind) {
-  if (target_label == nullptr) {
-    return 0;
+// Lists the entries of the central directory, without processing them.
+class EntryLister : public ZipExtractorProcessor {
+ public:
+  virtual bool Accept(const char * /*filename*/, const u4 /*attr*/) {
+    return false;
   }
-  // local headers
-  size_t length = 30 * 2 + MANIFEST_DIR_PATH_LENGTH + MANIFEST_PATH_LENGTH;
-  // central directory
-  length += 46 * 2 + MANIFEST_DIR_PATH_LENGTH + MANIFEST_PATH_LENGTH;
-  // zip64 EOCD entries
-  length += 56 * 2;
+  virtual void Process(const char * /*filename*/, const u4 /*attr*/,
+                       const u1 * /*data*/, const size_t /*size*/) {}
+};
 
-  // manifest content
-  length += MANIFEST_HEADER_LENGTH;
-  // target label manifest entry, including newline
-  length += TARGET_LABEL_KEY_LENGTH + strlen(target_label) + 2;
-  if (injecting_rule_kind) {
-    // injecting rule kind manifest entry, including newline
-    length += INJECTING_RULE_KIND_KEY_LENGTH + strlen(injecting_rule_kind) + 2;
+// Tells whether the jars have the same entries: the same names, attributes,
+// sizes and CRCs, in the same order. As ijar writes every entry the same way
+// each time, the jars are then identical.
+static bool SameEntries(const char *jar1, const char *jar2) {
+  Stat stat1, stat2;
+  if (!stat_file(jar1, &stat1) || !stat_file(jar2, &stat2) ||
+      stat1.total_size != stat2.total_size) {
+    return false;
   }
-  return length;
+  const char *jars[] = {jar1, jar2};
+  std::vector<ZipEntry> entries[2];
+  EntryLister lister;
+  for (int ii = 0; ii < 2; ++ii) {
+    std::unique_ptr<ZipExtractor> jar(ZipExtractor::Create(jars[ii], &lister));
+    if (jar.get() == NULL || jar->GetEntries(&entries[ii]) < 0) {
+      return false;
+    }
+  }
+  if (entries[0].size() != entries[1].size()) {
+    return false;
+  }
+  for (size_t ii = 0; ii < entries[0].size(); ++ii) {
+    const ZipEntry &entry1 = entries[0][ii];
+    const ZipEntry &entry2 = entries[1][ii];
+    if (entry1.filename != entry2.filename || entry1.attr != entry2.attr ||
+        entry1.crc32 != entry2.crc32 ||
+        entry1.compressed_size != entry2.compressed_size ||
+        entry1.uncompressed_size != entry2.uncompressed_size ||
+        entry1.local_header_offset != entry2.local_header_offset) {
+      return false;
+    }
+  }
+  return true;
 }
 
 // Opens "file_in" (a .jar file) for reading, and writes an interface
-// .jar to "file_out".
+// .jar to "file_out". With keep_unchanged, an existing "file_out" is left
+// untouched, modification time included, if it has the same contents as
+// the new interface jar. With store, every file of the interface jar is
+// stored rather than deflated, and with an alignment above 1 the data of
+// the files is aligned to that many bytes. If "abi_digests" is not null, the
+// ABI digests of the stripped classes are written to that file. The classes
+// are stripped on the workers of "pool", unless it is null.
 static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
-                                   bool strip_jar, const char *target_label,
-                                   const char *injecting_rule_kind) {
+                                   bool strip_jar,
+                                   blaze_util::ThreadPool *pool,
+                                   const ClassCache *cache,
+                                   bool keep_unchanged, bool store,
+                                   size_t alignment,
+                                   const char *target_label,
+                                   const char *injecting_rule_kind,
+                                   const char *abi_digests) {
   std::unique_ptr<JarExtractorProcessor> processor;
   if (strip_jar) {
-    processor =
-        std::unique_ptr<JarExtractorProcessor>(new JarStripperProcessor());
+    processor = std::unique_ptr<JarExtractorProcessor>(
+        new JarStripperProcessor(pool, cache, store));
   } else {
-    processor =
-        std::unique_ptr<JarExtractorProcessor>(new JarCopierProcessor(file_in));
+    processor = std::unique_ptr<JarExtractorProcessor>(
+        new JarCopierProcessor(file_in, store));
+  }
+  if (abi_digests != NULL) {
+    processor->RecordAbiDigests();
   }
   std::unique_ptr<ZipExtractor> in(
       ZipExtractor::Create(file_in, processor.get()));
@@ -359,15 +717,20 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
             strerror(errno));
     abort();
   }
-  u8 output_length =
-      in->CalculateOutputLength() +
-      EstimateManifestOutputSize(target_label, injecting_rule_kind);
-  std::unique_ptr<ZipBuilder> out(ZipBuilder::Create(file_out, output_length));
+  // The new jar is written next to the existing one, to be compared.
+  std::string new_file_out;
+  Stat file_out_stat;
+  if (keep_unchanged && stat_file(file_out, &file_out_stat)) {
+    new_file_out = std::string(file_out) + ".ijar-new";
+  }
+  const char *write_to = new_file_out.empty() ? file_out : new_file_out.c_str();
+  std::unique_ptr<ZipBuilder> out(ZipBuilder::Create(write_to));
   if (out.get() == NULL) {
-    fprintf(stderr, "Unable to open output file %s: %s\n", file_out,
+    fprintf(stderr, "Unable to open output file %s: %s\n", write_to,
             strerror(errno));
     abort();
   }
+  out->SetAlignment(alignment);
   processor->SetZipBuilder(out.get());
   processor->WriteManifest(target_label, injecting_rule_kind);
 
@@ -376,6 +739,10 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
     fprintf(stderr, "%s\n", in->GetError());
     abort();
   }
+  processor->Finish();
+  if (abi_digests != NULL && !processor->WriteAbiDigests(abi_digests)) {
+    abort();
+  }
 
   // Add dummy file, since javac doesn't like truly empty jars.
   if (out->GetNumberFiles() == 0) {
@@ -393,7 +760,119 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
     fprintf(stderr, "INFO: produced interface jar: %s -> %s (%d%%).\n", file_in,
             file_out, static_cast<int>(100.0 * out_length / in_length));
   }
+
+  if (!new_file_out.empty()) {
+    if (SameEntries(file_out, write_to)) {
+      if (verbose) {
+        fprintf(stderr, "INFO: %s is unchanged.\n", file_out);
+      }
+      remove(write_to);
+    } else if (rename(write_to, file_out) != 0 &&
+               // Windows does not replace an existing file.
+               (remove(file_out) != 0 || rename(write_to, file_out) != 0)) {
+      fprintf(stderr, "Unable to replace %s: %s\n", file_out,
+              strerror(errno));
+      abort();
+    }
+  }
+}
+
+// A jar to process in the batch mode.
+struct BatchJar {
+  std::string file_in;
+  std::string file_out;
+  std::string target_label;
+  std::string injecting_rule_kind;
+  std::string abi_digests;
+};
+
+// Reads the jars to process from the batch file: one jar per line, with the
+// input jar, the output jar and optionally the target label, the injecting
+// rule kind and the ABI digests file separated by tabs. Returns false on
+// malformed input.
+static bool ReadBatchFile(const char *batch_file, std::vector<BatchJar> *jars) {
+  FILE *in = fopen(batch_file, "r");
+  if (in == NULL) {
+    fprintf(stderr, "Unable to open batch file %s: %s\n", batch_file,
+            strerror(errno));
+    return false;
+  }
+  std::string line;
+  bool ok = true;
+  for (int c = getc(in); ok && c != EOF; c = getc(in)) {
+    if (c != '\n') {
+      line.push_back(c);
+      continue;
+    }
+    std::vector<std::string> fields(1);
+    for (size_t ii = 0; ii < line.size(); ++ii) {
+      if (line[ii] == '\t') {
+        fields.emplace_back();
+      } else if (line[ii] != '\r') {
+        fields.back().push_back(line[ii]);
+      }
+    }
+    line.clear();
+    if (fields.size() == 1 && fields[0].empty()) {
+      continue;
+    }
+    if (fields.size() < 2 || fields.size() > 5) {
+      fprintf(stderr, "Malformed line in batch file %s: expected 2 to 5 "
+              "tab-separated fields\n", batch_file);
+      ok = false;
+      break;
+    }
+    fields.resize(5);
+    BatchJar jar = {fields[0], fields[1], fields[2], fields[3], fields[4]};
+    jars->push_back(jar);
+  }
+  if (ok && !line.empty()) {
+    fprintf(stderr, "Batch file %s does not end with a newline\n",
+            batch_file);
+    ok = false;
+  }
+  fclose(in);
+  return ok;
+}
+
+static const char *OrNull(const std::string &s) {
+  return s.empty() ? NULL : s.c_str();
+}
+
+// Processes the jars listed in the batch file on the pool, if any, each jar on
+// a single thread; a single jar has the pool to itself.
+static bool ProcessBatch(const char *batch_file, bool strip_jar,
+                         blaze_util::ThreadPool *pool, const ClassCache *cache,
+                         bool keep_unchanged, bool store, size_t alignment) {
+  std::vector<BatchJar> jars;
+  if (!ReadBatchFile(batch_file, &jars)) {
+    return false;
+  }
+  for (size_t ii = 0; ii < jars.size(); ++ii) {
+    if (!strip_jar && !jars[ii].abi_digests.empty()) {
+      fprintf(stderr, "ABI digests need stripped jars, see %s\n", batch_file);
+      return false;
+    }
+  }
+  if (jars.size() == 1) {
+    OpenFilesAndProcessJar(
+        jars[0].file_out.c_str(), jars[0].file_in.c_str(), strip_jar, pool,
+        cache, keep_unchanged, store, alignment, OrNull(jars[0].target_label),
+        OrNull(jars[0].injecting_rule_kind), OrNull(jars[0].abi_digests));
+    return true;
+  }
+  blaze_util::ParallelFor(
+      pool, jars.size(), pool == nullptr ? 1 : pool->thread_count(),
+      [&](size_t ii) {
+        OpenFilesAndProcessJar(
+            jars[ii].file_out.c_str(), jars[ii].file_in.c_str(), strip_jar,
+            nullptr, cache, keep_unchanged, store, alignment,
+            OrNull(jars[ii].target_label), OrNull(jars[ii].injecting_rule_kind),
+            OrNull(jars[ii].abi_digests));
+      });
+  return true;
 }
+
 }  // namespace devtools_ijar
 
 //
@@ -402,48 +881,137 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
 static void usage() {
   fprintf(stderr,
           "Usage: ijar "
-          "[-v] [--[no]strip_jar] "
+          "[-v] [--[no]strip_jar] [--threads n] [--class_cache dir] "
+          "[--keep_unchanged_output] [--store [--align n]] "
           "[--target label label] [--injecting_rule_kind kind] "
-          "x.jar [x_interface.jar>]\n");
+          "[--abi_digests file] x.jar [x_interface.jar>]\n"
+          "       ijar [-v] [--[no]strip_jar] [--threads n] "
+          "[--class_cache dir] [--keep_unchanged_output] "
+          "[--store [--align n]] --batch batch_file\n"
+          "       ijar --persistent_worker\n");
   fprintf(stderr, "Creates an interface jar from the specified jar file.\n");
-  exit(1);
+  fprintf(stderr,
+          "With --store, every file of the interface jar is stored "
+          "uncompressed,\nand --align aligns their data to n bytes, "
+          "e.g. 4096 for pages.\n"
+          "With --abi_digests, a digest of each stripped class is written to "
+          "the file,\nso that changes in the ABI can be told apart per "
+          "class.\n");
 }
 
-int main(int argc, char **argv) {
+// Runs ijar with the given command line arguments (excluding the program
+// name). Returns the exit code.
+static int RunIjar(const std::vector<const char *> &args) {
   bool strip_jar = true;
+  int threads = blaze_util::DefaultThreadCount();
   const char *target_label = NULL;
   const char *injecting_rule_kind = NULL;
+  const char *batch_file = NULL;
+  const char *class_cache_dir = NULL;
+  const char *abi_digests = NULL;
+  bool keep_unchanged = false;
+  bool store = false;
+  int alignment = 0;
   const char *filename_in = NULL;
   const char *filename_out = NULL;
 
-  for (int ii = 1; ii < argc; ++ii) {
-    if (strcmp(argv[ii], "-v") == 0) {
+  devtools_ijar::verbose = false;
+  for (size_t ii = 0; ii < args.size(); ++ii) {
+    if (strcmp(args[ii], "-v") == 0) {
       devtools_ijar::verbose = true;
-    } else if (strcmp(argv[ii], "--strip_jar") == 0) {
+    } else if (strcmp(args[ii], "--strip_jar") == 0) {
       strip_jar = true;
-    } else if (strcmp(argv[ii], "--nostrip_jar") == 0) {
+    } else if (strcmp(args[ii], "--nostrip_jar") == 0) {
       strip_jar = false;
-    } else if (strcmp(argv[ii], "--target_label") == 0) {
-      if (++ii >= argc) {
+    } else if (strcmp(args[ii], "--threads") == 0) {
+      if (++ii >= args.size()) {
+        usage();
+        return 1;
+      }
+      threads = atoi(args[ii]);
+    } else if (strcmp(args[ii], "--target_label") == 0) {
+      if (++ii >= args.size()) {
         usage();
+        return 1;
       }
-      target_label = argv[ii];
-    } else if (strcmp(argv[ii], "--injecting_rule_kind") == 0) {
-      if (++ii >= argc) {
+      target_label = args[ii];
+    } else if (strcmp(args[ii], "--injecting_rule_kind") == 0) {
+      if (++ii >= args.size()) {
         usage();
+        return 1;
       }
-      injecting_rule_kind = argv[ii];
+      injecting_rule_kind = args[ii];
+    } else if (strcmp(args[ii], "--class_cache") == 0) {
+      if (++ii >= args.size()) {
+        usage();
+        return 1;
+      }
+      class_cache_dir = args[ii];
+    } else if (strcmp(args[ii], "--abi_digests") == 0) {
+      if (++ii >= args.size()) {
+        usage();
+        return 1;
+      }
+      abi_digests = args[ii];
+    } else if (strcmp(args[ii], "--keep_unchanged_output") == 0) {
+      keep_unchanged = true;
+    } else if (strcmp(args[ii], "--store") == 0) {
+      store = true;
+    } else if (strcmp(args[ii], "--align") == 0) {
+      if (++ii >= args.size()) {
+        usage();
+        return 1;
+      }
+      alignment = atoi(args[ii]);
+    } else if (strcmp(args[ii], "--batch") == 0) {
+      if (++ii >= args.size()) {
+        usage();
+        return 1;
+      }
+      batch_file = args[ii];
     } else if (filename_in == NULL) {
-      filename_in = argv[ii];
+      filename_in = args[ii];
     } else if (filename_out == NULL) {
-      filename_out = argv[ii];
+      filename_out = args[ii];
     } else {
       usage();
+      return 1;
+    }
+  }
+
+  // The alignment is written in a 16-bit field, and is pointless for
+  // deflated files. Only stripped classes have ABI digests.
+  if (alignment < 0 || alignment > 32768 || (alignment > 1 && !store) ||
+      (abi_digests != NULL && !strip_jar)) {
+    usage();
+    return 1;
+  }
+
+  std::unique_ptr<devtools_ijar::ClassCache> cache;
+  if (class_cache_dir != NULL) {
+    cache.reset(new devtools_ijar::ClassCache(class_cache_dir));
+  }
+  std::unique_ptr<blaze_util::ThreadPool> pool;
+  if (threads > 1) {
+    pool.reset(new blaze_util::ThreadPool(threads, 4));
+  }
+
+  if (batch_file != NULL) {
+    if (filename_in != NULL || target_label != NULL ||
+        injecting_rule_kind != NULL || abi_digests != NULL) {
+      usage();
+      return 1;
     }
+    return devtools_ijar::ProcessBatch(batch_file, strip_jar, pool.get(),
+                                       cache.get(), keep_unchanged, store,
+                                       alignment)
+               ? 0
+               : 1;
   }
 
   if (filename_in == NULL) {
     usage();
+    return 1;
   }
 
   // Guess output filename from input:
@@ -467,6 +1035,36 @@ int main(int argc, char **argv) {
   }
 
   devtools_ijar::OpenFilesAndProcessJar(filename_out, filename_in, strip_jar,
-                                        target_label, injecting_rule_kind);
+                                        pool.get(), cache.get(), keep_unchanged,
+                                        store, alignment, target_label,
+                                        injecting_rule_kind, abi_digests);
+  return 0;
+}
+
+// Serves work requests, each of them an ijar command line, until the end of
+// the standard input. Errors in processing a jar still terminate the worker.
+static int RunPersistentWorker() {
+  std::vector<std::string> arguments;
+  while (devtools_ijar::ReadWorkRequest(stdin, &arguments)) {
+    std::vector<const char *> args;
+    for (size_t ii = 0; ii < arguments.size(); ++ii) {
+      args.push_back(arguments[ii].c_str());
+    }
+    int exit_code = RunIjar(args);
+    if (!devtools_ijar::WriteWorkResponse(stdout, exit_code, "")) {
+      fprintf(stderr, "Cannot write work response\n");
+      return 1;
+    }
+  }
   return 0;
 }
+
+int main(int argc, char **argv) {
+  std::vector<const char *> args(argv + 1, argv + argc);
+  for (size_t ii = 0; ii < args.size(); ++ii) {
+    if (strcmp(args[ii], "--persistent_worker") == 0) {
+      return RunPersistentWorker();
+    }
+  }
+  return RunIjar(args);
+}
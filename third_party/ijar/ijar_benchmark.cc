@@ -0,0 +1,279 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// ijar_benchmark.cc -- times StripClass and the zip reading and writing.
+//
+// Usage:
+//   ijar_benchmark [--iterations N] [--output_dir DIR] x.jar...
+// Options:
+//   --iterations N    number of times to run each benchmark (3)
+//   --output_dir DIR  where the round-trip benchmark writes ($TEST_TMPDIR,
+//                     $TMPDIR or /tmp)
+//
+// Two benchmarks are run over the given (real world) jars:
+//  - strip: StripClass on every class of the jars, held in memory, so that
+//    only the class file processing is measured;
+//  - zip: ZipExtractor::ProcessAll over every jar, each entry being inflated
+//    and written out with a ZipBuilder, like ijar --nostrip_jar did before
+//    it learned to copy the compressed entries.
+// Each run reports the throughput, in entries and megabytes (of uncompressed
+// input) per second, and the number of operator new calls per entry. Memory
+// obtained with malloc(), like the arena blocks of StripClass, is not
+// counted.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/zip.h"
+
+namespace devtools_ijar {
+
+bool verbose = false;
+
+// See ijar.cc.
+bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length);
+
+}  // namespace devtools_ijar
+
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *result = malloc(size ? size : 1);
+  if (result == NULL) {
+    throw std::bad_alloc();
+  }
+  return result;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+namespace devtools_ijar {
+
+namespace {
+
+struct ClassFileData {
+  std::string name;
+  std::vector<u1> data;
+};
+
+const char *CLASS_EXTENSION = ".class";
+
+bool IsClass(const char *filename) {
+  size_t length = strlen(filename);
+  size_t extension_length = strlen(CLASS_EXTENSION);
+  return length >= extension_length &&
+         strcmp(filename + length - extension_length, CLASS_EXTENSION) == 0;
+}
+
+// Copies the classes of a jar into memory.
+class ClassCollector : public ZipExtractorProcessor {
+ public:
+  explicit ClassCollector(std::vector<ClassFileData> *classes)
+      : classes_(classes) {}
+
+  virtual bool Accept(const char *filename, const u4 /*attr*/) {
+    return IsClass(filename);
+  }
+
+  virtual void Process(const char *filename, const u4 /*attr*/,
+                       const u1 *data, const size_t size) {
+    classes_->push_back(ClassFileData());
+    classes_->back().name = filename;
+    classes_->back().data.assign(data, data + size);
+  }
+
+ private:
+  std::vector<ClassFileData> *classes_;
+};
+
+// Writes every entry of a jar, inflated, to a ZipBuilder.
+class Copier : public ZipExtractorProcessor {
+ public:
+  explicit Copier(ZipBuilder *builder)
+      : builder_(builder), entries_(0), bytes_(0) {}
+
+  virtual bool Accept(const char * /*filename*/, const u4 /*attr*/) {
+    return true;
+  }
+
+  virtual void Process(const char *filename, const u4 attr, const u1 *data,
+                       const size_t size) {
+    u1 *q = builder_->NewFile(filename, attr, size);
+    memcpy(q, data, size);
+    if (builder_->FinishFile(size, /* compress: */ false,
+                             /* compute_crc: */ true) < 0) {
+      fprintf(stderr, "Cannot write %s: %s\n", filename,
+              builder_->GetError());
+      exit(1);
+    }
+    ++entries_;
+    bytes_ += size;
+  }
+
+  uint64_t entries() const { return entries_; }
+  uint64_t bytes() const { return bytes_; }
+
+ private:
+  ZipBuilder *builder_;
+  uint64_t entries_;
+  uint64_t bytes_;
+};
+
+void ProcessJar(const char *jar, ZipExtractorProcessor *processor) {
+  ZipExtractor *extractor = ZipExtractor::Create(jar, processor);
+  if (extractor == NULL) {
+    fprintf(stderr, "Unable to open %s: %s\n", jar, strerror(errno));
+    exit(1);
+  }
+  if (extractor->ProcessAll() < 0) {
+    fprintf(stderr, "%s: %s\n", jar, extractor->GetError());
+    exit(1);
+  }
+  delete extractor;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void PrintHeader(const char *benchmark) {
+  printf("%-6s %-4s %9s %11s %9s %12s\n", benchmark, "run", "seconds",
+         "entries/s", "MB/s", "allocs/entry");
+}
+
+void PrintRun(int iteration, double seconds, uint64_t entries,
+              uint64_t bytes, uint64_t run_allocations) {
+  printf("%-6s %-4d %9.3f %11.0f %9.1f %12.1f\n", "", iteration, seconds,
+         entries / seconds, bytes / seconds / (1024 * 1024),
+         entries ? static_cast<double>(run_allocations) / entries : 0.0);
+}
+
+void BenchmarkStripClass(const std::vector<const char *> &jars,
+                         int iterations) {
+  std::vector<ClassFileData> classes;
+  ClassCollector collector(&classes);
+  for (const char *jar : jars) {
+    ProcessJar(jar, &collector);
+  }
+  uint64_t bytes = 0;
+  size_t max_size = 0;
+  for (const ClassFileData &clazz : classes) {
+    bytes += clazz.data.size();
+    max_size = std::max(max_size, clazz.data.size());
+  }
+  printf("%zu classes, %.1f MB\n", classes.size(), bytes / (1024.0 * 1024));
+
+  // The output of StripClass is never larger than its input.
+  std::vector<u1> output(max_size);
+  PrintHeader("strip");
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    uint64_t start_allocations = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (const ClassFileData &clazz : classes) {
+      u1 *p = output.data();
+      StripClass(p, clazz.data.data(), clazz.data.size());
+    }
+    double seconds = Seconds(start);
+    PrintRun(iteration, seconds, classes.size(), bytes,
+             allocations.load() - start_allocations);
+  }
+}
+
+void BenchmarkZip(const std::vector<const char *> &jars, int iterations,
+                  const std::string &output_dir) {
+  std::string output = output_dir + "/ijar_benchmark_output.jar";
+  PrintHeader("zip");
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+    uint64_t start_allocations = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (const char *jar : jars) {
+      ZipBuilder *builder = ZipBuilder::Create(output.c_str());
+      if (builder == NULL) {
+        fprintf(stderr, "Unable to create %s: %s\n", output.c_str(),
+                strerror(errno));
+        exit(1);
+      }
+      Copier copier(builder);
+      ProcessJar(jar, &copier);
+      if (builder->Finish() < 0) {
+        fprintf(stderr, "%s: %s\n", output.c_str(), builder->GetError());
+        exit(1);
+      }
+      delete builder;
+      entries += copier.entries();
+      bytes += copier.bytes();
+    }
+    double seconds = Seconds(start);
+    PrintRun(iteration, seconds, entries, bytes,
+             allocations.load() - start_allocations);
+  }
+  remove(output.c_str());
+}
+
+void usage(const char *progname) {
+  fprintf(stderr,
+          "Usage: %s [--iterations n] [--output_dir dir] x.jar...\n"
+          "Times StripClass and the zip round trip of the given jars.\n",
+          progname);
+  exit(1);
+}
+
+}  // namespace
+
+}  // namespace devtools_ijar
+
+int main(int argc, char **argv) {
+  int iterations = 3;
+  const char *output_dir = getenv("TEST_TMPDIR");
+  if (output_dir == NULL) {
+    output_dir = getenv("TMPDIR");
+  }
+  if (output_dir == NULL) {
+    output_dir = "/tmp";
+  }
+  std::vector<const char *> jars;
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strcmp(argv[ii], "--iterations") == 0 && ii + 1 < argc) {
+      iterations = atoi(argv[++ii]);
+    } else if (strcmp(argv[ii], "--output_dir") == 0 && ii + 1 < argc) {
+      output_dir = argv[++ii];
+    } else if (argv[ii][0] == '-') {
+      devtools_ijar::usage(argv[0]);
+    } else {
+      jars.push_back(argv[ii]);
+    }
+  }
+  if (jars.empty() || iterations < 1) {
+    devtools_ijar::usage(argv[0]);
+  }
+
+  devtools_ijar::BenchmarkStripClass(jars, iterations);
+  devtools_ijar::BenchmarkZip(jars, iterations, output_dir);
+  return 0;
+}
@@ -0,0 +1,51 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "src/main/cpp/util/mapped_file.h"
+#include "third_party/ijar/mapped_file.h"
+
+namespace devtools_ijar {
+
+// The input files are mapped by the mapping shared with singlejar. ZIP files
+// are read front to back, so they are mapped for sequential access.
+struct MappedInputFileImpl {
+  blaze_util::MappedFile file_;
+  std::string error_;
+};
+
+MappedInputFile::MappedInputFile(const char* name) {
+  impl_ = new MappedInputFileImpl();
+  opened_ = impl_->file_.Open(name, blaze_util::MappedFile::kSequentialAccess,
+                              &impl_->error_);
+  errmsg_ = impl_->error_.c_str();
+  buffer_ = const_cast<u1*>(impl_->file_.start());
+  length_ = impl_->file_.size();
+}
+
+MappedInputFile::~MappedInputFile() {
+  delete impl_;
+}
+
+void MappedInputFile::Discard(size_t bytes) {
+  impl_->file_.Discard(bytes);
+}
+
+int MappedInputFile::Close() {
+  impl_->file_.Close();
+  return 0;
+}
+
+}  // namespace devtools_ijar
@@ -20,7 +20,7 @@
 namespace devtools_ijar {
 
 struct MappedInputFileImpl;
-struct MappedOutputFileImpl;
+struct OutputFileImpl;
 
 // A memory mapped input file.
 class MappedInputFile {
@@ -54,19 +54,18 @@ class MappedInputFile {
   int Close();
 };
 
-class MappedOutputFile {
+// An output file written sequentially.
+class OutputFile {
  private:
-  MappedOutputFileImpl *impl_;
+  OutputFileImpl *impl_;
 
  protected:
   const char* errmsg_;
   bool opened_;
-  u1* buffer_;
-  size_t estimated_size_;
 
  public:
-  MappedOutputFile(const char* name, size_t estimated_size);
-  virtual ~MappedOutputFile();
+  OutputFile(const char* name);
+  virtual ~OutputFile();
 
   // If opening the file succeeded or not.
   bool Opened() const { return opened_; }
@@ -74,9 +73,9 @@ class MappedOutputFile {
   // Description of the last error that happened.
   const char* Error() const { return errmsg_; }
 
-  // The mapped contents of the file.
-  u1* Buffer() const { return buffer_; }
-  int Close(size_t size);
+  // Appends the given bytes to the file. Returns -1 on error.
+  int Write(const u1* data, size_t size);
+  int Close();
 };
 
 }  // namespace devtools_ijar
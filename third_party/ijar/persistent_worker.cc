@@ -0,0 +1,149 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "third_party/ijar/persistent_worker.h"
+
+#include <stdlib.h>
+
+namespace devtools_ijar {
+
+// Protocol buffer wire types.
+static const int kVarint = 0;
+static const int k64Bit = 1;
+static const int kLengthDelimited = 2;
+static const int k32Bit = 5;
+
+// WorkRequest and WorkResponse field numbers.
+static const int kRequestArguments = 1;
+static const int kResponseExitCode = 1;
+static const int kResponseOutput = 2;
+
+static void MalformedRequest() {
+  fprintf(stderr, "Malformed work request\n");
+  exit(1);
+}
+
+// Reads a varint from the stream. Returns false on EOF before the first byte.
+static bool ReadVarint(FILE *in, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc(in);
+    if (c == EOF) {
+      if (shift == 0) {
+        return false;
+      }
+      MalformedRequest();
+    }
+    *value |= static_cast<uint64_t>(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  MalformedRequest();
+  return false;
+}
+
+// Decodes a varint from the buffer, advancing `pos`.
+static uint64_t DecodeVarint(const std::string &buffer, size_t *pos) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64 && *pos < buffer.size(); shift += 7) {
+    uint8_t c = buffer[(*pos)++];
+    value |= static_cast<uint64_t>(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return value;
+    }
+  }
+  MalformedRequest();
+  return 0;
+}
+
+static void EncodeVarint(uint64_t value, std::string *buffer) {
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<char>(value));
+}
+
+bool ReadWorkRequest(FILE *in, std::vector<std::string> *arguments) {
+  uint64_t message_size;
+  if (!ReadVarint(in, &message_size)) {
+    return false;
+  }
+  std::string message(message_size, '\0');
+  if (message_size &&
+      fread(&message[0], 1, message_size, in) != message_size) {
+    MalformedRequest();
+  }
+
+  arguments->clear();
+  size_t pos = 0;
+  while (pos < message.size()) {
+    uint64_t tag = DecodeVarint(message, &pos);
+    int wire_type = tag & 7;
+    uint64_t length;
+    switch (wire_type) {
+      case kVarint:
+        DecodeVarint(message, &pos);
+        break;
+      case k64Bit:
+        pos += 8;
+        break;
+      case kLengthDelimited:
+        length = DecodeVarint(message, &pos);
+        if (length > message.size() - pos) {
+          MalformedRequest();
+        }
+        // The inputs (field 2) are not used.
+        if ((tag >> 3) == kRequestArguments) {
+          arguments->push_back(message.substr(pos, length));
+        }
+        pos += length;
+        break;
+      case k32Bit:
+        pos += 4;
+        break;
+      default:
+        MalformedRequest();
+    }
+  }
+  if (pos != message.size()) {
+    MalformedRequest();
+  }
+  return true;
+}
+
+bool WriteWorkResponse(FILE *out, int32_t exit_code,
+                       const std::string &output) {
+  std::string message;
+  if (exit_code != 0) {
+    EncodeVarint((kResponseExitCode << 3) | kVarint, &message);
+    // Negative int32 values are sign-extended to 64 bits.
+    EncodeVarint(static_cast<uint64_t>(static_cast<int64_t>(exit_code)),
+                 &message);
+  }
+  if (!output.empty()) {
+    EncodeVarint((kResponseOutput << 3) | kLengthDelimited, &message);
+    EncodeVarint(output.size(), &message);
+    message += output;
+  }
+  std::string delimited;
+  EncodeVarint(message.size(), &delimited);
+  delimited += message;
+  return fwrite(delimited.data(), 1, delimited.size(), out) ==
+             delimited.size() &&
+         fflush(out) == 0;
+}
+
+}  // namespace devtools_ijar
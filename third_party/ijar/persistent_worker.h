@@ -0,0 +1,45 @@
+// Copyright 2018 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_IJAR_PERSISTENT_WORKER_H_
+#define THIRD_PARTY_IJAR_PERSISTENT_WORKER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace devtools_ijar {
+
+// Bazel persistent worker support. Bazel starts the worker with the
+// --persistent_worker flag and sends it WorkRequest messages on the standard
+// input, expecting a WorkResponse message on the standard output for each of
+// them (see src/main/protobuf/worker_protocol.proto). The messages are
+// length-delimited protocol buffers. ijar is built from its sources without
+// the protobuf library, so the few fields it needs are encoded and decoded
+// here directly.
+
+// Reads the next WorkRequest from `in` and stores its arguments.
+// Returns false at the end of the input. Exits on malformed input.
+bool ReadWorkRequest(FILE *in, std::vector<std::string> *arguments);
+
+// Writes a WorkResponse with the given exit code and output to `out`.
+// Returns false if it cannot be written.
+bool WriteWorkResponse(FILE *out, int32_t exit_code,
+                       const std::string &output);
+
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_PERSISTENT_WORKER_H_
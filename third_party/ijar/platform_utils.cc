@@ -20,6 +20,9 @@
 #if defined(_WIN32) || defined(__CYGWIN__)
 #include <windows.h>
 #else  // !(defined(_WIN32) || defined(__CYGWIN__))
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -86,6 +89,63 @@ bool write_file(const char* path, unsigned int perm, const void* data,
   return blaze_util::WriteFile(data, size, path, perm);
 }
 
+int open_dir(const char* path) {
+#if defined(_WIN32) || defined(__CYGWIN__)
+  return -1;
+#else   // !(defined(_WIN32) || defined(__CYGWIN__))
+  return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif  // defined(_WIN32) || defined(__CYGWIN__)
+}
+
+void close_dir(int dirfd) {
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+  if (dirfd >= 0) {
+    close(dirfd);
+  }
+#endif  // !defined(_WIN32) && !defined(__CYGWIN__)
+}
+
+bool write_file_at(int dirfd, const char* name, unsigned int perm,
+                   const void* data, size_t size) {
+#if defined(_WIN32) || defined(__CYGWIN__)
+  BAZEL_DIE(255) << "write_file_at: not supported on this platform";
+  return false;
+#else   // !(defined(_WIN32) || defined(__CYGWIN__))
+  unlinkat(dirfd, name, 0);  // We don't care about the success of this.
+  int fd = openat(dirfd, name, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, perm);
+  if (fd < 0) {
+    fprintf(stderr, "Cannot open %s for writing: %s\n", name,
+            strerror(errno));
+    return false;
+  }
+#ifdef __linux__
+  if (size > 0) {
+    // Best effort: lets the file system lay the file out in one go.
+    posix_fallocate(fd, 0, size);
+  }
+#endif  // __linux__
+  const u1* p = static_cast<const u1*>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Cannot write %s: %s\n", name, strerror(errno));
+      close(fd);
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  if (close(fd) != 0) {
+    fprintf(stderr, "Cannot close %s: %s\n", name, strerror(errno));
+    return false;
+  }
+  return true;
+#endif  // defined(_WIN32) || defined(__CYGWIN__)
+}
+
 bool read_file(const char* path, void* buffer, size_t size) {
   return blaze_util::ReadFile(path, buffer, size);
 }
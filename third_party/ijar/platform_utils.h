@@ -55,6 +55,21 @@ bool stat_file(const char* path, Stat* result);
 bool write_file(const char* path, unsigned int perm, const void* data,
                 size_t size);
 
+// Opens the directory under `path` for write_file_at().
+// Returns a descriptor, or -1 if the directory cannot be opened or if
+// descriptor-relative writes are not supported on this platform; callers then
+// fall back to write_file(). Doesn't report any errors.
+int open_dir(const char* path);
+
+// Closes a descriptor returned by open_dir().
+void close_dir(int dirfd);
+
+// Like write_file(), but writes the file `name` of the directory `dirfd`
+// returned by open_dir(). The file is preallocated to `size` bytes first
+// where the platform supports it.
+bool write_file_at(int dirfd, const char* name, unsigned int perm,
+                   const void* data, size_t size);
+
 // Reads at most `size` bytes into `buffer` from the file under `path`.
 // Returns true upon success: file is opened and all data is read.
 // Returns false upon failure and reports the error to stderr.
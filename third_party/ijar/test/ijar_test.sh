@@ -361,6 +361,163 @@ function test_invokedynamic() {
   check_eq 0 $lines "Interface jar should have no method bodies!"
 }
 
+function test_threads() {
+  # Check that stripping on several threads gives the same output as
+  # stripping sequentially.
+  $IJAR --threads 1 $LANGTOOLS8 $TEST_TMPDIR/sequential.jar ||
+    fail "ijar failed"
+  $IJAR --threads 4 $LANGTOOLS8 $TEST_TMPDIR/parallel.jar ||
+    fail "ijar failed"
+  cmp $TEST_TMPDIR/sequential.jar $TEST_TMPDIR/parallel.jar ||
+    fail "parallel output differs"
+}
+
+function test_batch() {
+  # Check that the jars of a batch file come out the same as when processed
+  # one by one.
+  $IJAR --target_label //foo:bar $LANGTOOLS8 $TEST_TMPDIR/single1.jar ||
+    fail "ijar failed"
+  $IJAR --nostrip_jar $LANGTOOLS8 $TEST_TMPDIR/single2.jar ||
+    fail "ijar failed"
+  printf "%s\t%s\t//foo:bar\n%s\t%s\n" \
+    $LANGTOOLS8 $TEST_TMPDIR/batch1.jar \
+    $LANGTOOLS8 $TEST_TMPDIR/batch2.jar > $TEST_TMPDIR/batch.txt
+  $IJAR --threads 2 --batch $TEST_TMPDIR/batch.txt || fail "ijar failed"
+  cmp $TEST_TMPDIR/single1.jar $TEST_TMPDIR/batch1.jar ||
+    fail "batch output differs"
+  $IJAR --nostrip_jar --batch $TEST_TMPDIR/batch.txt || fail "ijar failed"
+  cmp $TEST_TMPDIR/single2.jar $TEST_TMPDIR/batch2.jar ||
+    fail "batch output differs"
+}
+
+# Appends a WorkRequest with the given arguments, each shorter than 128
+# bytes, to the file $1.
+function write_work_request() {
+  local out=$1
+  shift
+  local message=$TEST_TMPDIR/message.bin
+  : > $message
+  for arg in "$@"; do
+    printf "\\x0a\\x$(printf %02x ${#arg})%s" "$arg" >> $message
+  done
+  printf "\\x$(printf %02x $(wc -c < $message))" >> $out
+  cat $message >> $out
+}
+
+function test_persistent_worker() {
+  cp $LANGTOOLS8 $TEST_TMPDIR/in.jar
+  $IJAR $TEST_TMPDIR/in.jar $TEST_TMPDIR/expected.jar || fail "ijar failed"
+  : > $TEST_TMPDIR/requests.bin
+  write_work_request $TEST_TMPDIR/requests.bin in.jar out1.jar
+  write_work_request $TEST_TMPDIR/requests.bin --threads 1 in.jar out2.jar
+  write_work_request $TEST_TMPDIR/requests.bin
+  (cd $TEST_TMPDIR &&
+    $IJAR --persistent_worker < requests.bin > responses.bin) ||
+    fail "ijar worker failed"
+  # Two empty responses, then one with exit code 1 for the bad request.
+  check_eq "0000020801" \
+    "$(od -An -tx1 $TEST_TMPDIR/responses.bin | tr -d ' \n')" \
+    "unexpected work responses"
+  cmp $TEST_TMPDIR/expected.jar $TEST_TMPDIR/out1.jar ||
+    fail "worker output differs"
+  cmp $TEST_TMPDIR/expected.jar $TEST_TMPDIR/out2.jar ||
+    fail "worker output differs"
+}
+
+function test_class_cache() {
+  # Check that the output is the same with an empty cache, a full cache and
+  # a cache with damaged entries.
+  CACHE=$TEST_TMPDIR/class_cache
+  $IJAR $LANGTOOLS8 $TEST_TMPDIR/expected.jar || fail "ijar failed"
+  $IJAR --class_cache $CACHE $LANGTOOLS8 $TEST_TMPDIR/cold.jar ||
+    fail "ijar failed"
+  [[ -n "$(find $CACHE -type f)" ]] || fail "cache is empty"
+  $IJAR --class_cache $CACHE $LANGTOOLS8 $TEST_TMPDIR/warm.jar ||
+    fail "ijar failed"
+  find $CACHE -type f | head -n 10 | while read entry; do
+    : > $entry
+  done
+  $IJAR --class_cache $CACHE $LANGTOOLS8 $TEST_TMPDIR/damaged.jar ||
+    fail "ijar failed"
+  for jar in cold warm damaged; do
+    cmp $TEST_TMPDIR/expected.jar $TEST_TMPDIR/$jar.jar ||
+      fail "output with the $jar cache differs"
+  done
+}
+
+function test_keep_unchanged_output() {
+  # Check that --keep_unchanged_output leaves an unchanged output alone, and
+  # replaces a changed one.
+  OUT=$TEST_TMPDIR/unchanged.jar
+  $IJAR $LANGTOOLS8 $OUT || fail "ijar failed"
+  cp $OUT $TEST_TMPDIR/expected.jar
+  touch -t 200001010000 $OUT
+  touch -t 200101010000 $TEST_TMPDIR/marker
+  $IJAR --keep_unchanged_output $LANGTOOLS8 $OUT || fail "ijar failed"
+  [[ $OUT -nt $TEST_TMPDIR/marker ]] && fail "unchanged output was rewritten"
+  cmp $OUT $TEST_TMPDIR/expected.jar || fail "unchanged output differs"
+
+  $IJAR --nostrip_jar $LANGTOOLS8 $TEST_TMPDIR/expected.jar ||
+    fail "ijar failed"
+  $IJAR --keep_unchanged_output --nostrip_jar $LANGTOOLS8 $OUT ||
+    fail "ijar failed"
+  cmp $OUT $TEST_TMPDIR/expected.jar || fail "changed output not replaced"
+  [[ -e $OUT.ijar-new ]] && fail "temporary output left behind"
+  return 0
+}
+
+function test_nostrip_keeps_compression() {
+  # Check that --nostrip_jar copies the entries as they are compressed in the
+  # input, with their CRC.
+  $IJAR --nostrip_jar $LANGTOOLS8 $TEST_TMPDIR/copy.jar || fail "ijar failed"
+  $UNZIP -tq $TEST_TMPDIR/copy.jar > /dev/null || fail "bad CRC in the copy"
+  $UNZIP -v $LANGTOOLS8 | grep -v META-INF/MANIFEST.MF | grep -c Defl: \
+    > $TEST_TMPDIR/input_deflated
+  $UNZIP -v $TEST_TMPDIR/copy.jar | grep -v META-INF/MANIFEST.MF | \
+    grep -c Defl: > $TEST_TMPDIR/copy_deflated
+  cmp $TEST_TMPDIR/input_deflated $TEST_TMPDIR/copy_deflated ||
+    fail "the copy did not keep the compression of the entries"
+}
+
+function test_store() {
+  # Check that --store writes every entry stored, with the same contents, and
+  # that --align aligns their data.
+  $IJAR --nostrip_jar $LANGTOOLS8 $TEST_TMPDIR/deflated.jar ||
+    fail "ijar failed"
+  $IJAR --nostrip_jar --store --align 4096 $LANGTOOLS8 \
+    $TEST_TMPDIR/stored.jar || fail "ijar failed"
+  $UNZIP -tq $TEST_TMPDIR/stored.jar > /dev/null || fail "bad stored jar"
+  $UNZIP -v $TEST_TMPDIR/stored.jar | grep -q Defl: &&
+    fail "--store left deflated entries"
+  for jar in deflated stored; do
+    mkdir -p $TEST_TMPDIR/$jar
+    (cd $TEST_TMPDIR/$jar && $UNZIP -q ../$jar.jar) || fail "unzip failed"
+  done
+  diff -r $TEST_TMPDIR/deflated $TEST_TMPDIR/stored ||
+    fail "--store changed the contents"
+  $IJAR --align 4096 $LANGTOOLS8 $TEST_TMPDIR/bad.jar &&
+    fail "--align without --store accepted"
+  return 0
+}
+
+function test_abi_digests() {
+  # Check that --abi_digests lists every class of the interface jar, the same
+  # way with any number of threads, and that the digests follow the ABI.
+  $IJAR --threads 1 --abi_digests $TEST_TMPDIR/digests1.txt $LANGTOOLS8 \
+    $TEST_TMPDIR/digests1.jar || fail "ijar failed"
+  $IJAR --threads 4 --abi_digests $TEST_TMPDIR/digests4.txt $LANGTOOLS8 \
+    $TEST_TMPDIR/digests4.jar || fail "ijar failed"
+  cmp $TEST_TMPDIR/digests1.txt $TEST_TMPDIR/digests4.txt ||
+    fail "parallel digests differ"
+  check_eq "$($UNZIP -Z1 $TEST_TMPDIR/digests1.jar | grep '\.class$' | \
+      sed 's/\.class$//')" "$(cut -f1 $TEST_TMPDIR/digests1.txt)" \
+    "the digests do not list the classes"
+  $UNZIP -p $TEST_TMPDIR/digests1.jar "$(head -n 1 $TEST_TMPDIR/digests1.txt | \
+      cut -f1).class" | md5sum | cut -d' ' -f1 > $TEST_TMPDIR/expected_digest
+  head -n 1 $TEST_TMPDIR/digests1.txt | cut -f2 | \
+    cmp - $TEST_TMPDIR/expected_digest || fail "unexpected digest"
+}
+
 function test_object_class() {
   # Check that Object.class can be processed
   mkdir -p $TEST_TMPDIR/java/lang
@@ -168,6 +168,50 @@ function test_zipper_compression() {
       || fail "Unzip after zipper output differ"
 }
 
+# Test that -j produces the same zip as the sequential mode.
+function test_zipper_threads() {
+  rm -fr ${TEST_TMPDIR}/threads
+  mkdir -p ${TEST_TMPDIR}/threads/dir
+  for i in $(seq 1 100); do
+    seq 1 $((i * 50)) > ${TEST_TMPDIR}/threads/dir/file$i
+  done
+  touch ${TEST_TMPDIR}/threads/dir/empty
+  local filelist="$(cd ${TEST_TMPDIR}/threads && find dir | sort)"
+  (cd ${TEST_TMPDIR}/threads && $ZIPPER cC ${TEST_TMPDIR}/seq.zip \
+      ${filelist}) || fail "zipper failed"
+  (cd ${TEST_TMPDIR}/threads && $ZIPPER cC ${TEST_TMPDIR}/par.zip -j 4 \
+      ${filelist}) || fail "zipper -j failed"
+  cmp ${TEST_TMPDIR}/seq.zip ${TEST_TMPDIR}/par.zip \
+      || fail "zipper -j output differs"
+  assert_unzip_same_as_zipper ${TEST_TMPDIR}/par.zip
+}
+
+# Test that -j extracts the same files as the sequential mode.
+function test_zipper_extract_threads() {
+  rm -fr ${TEST_TMPDIR}/xthreads
+  mkdir -p ${TEST_TMPDIR}/xthreads/in/a/b ${TEST_TMPDIR}/xthreads/in/c
+  for i in $(seq 1 50); do
+    seq 1 $((i * 50)) > ${TEST_TMPDIR}/xthreads/in/a/b/file$i
+    seq 1 $i > ${TEST_TMPDIR}/xthreads/in/c/file$i
+  done
+  touch ${TEST_TMPDIR}/xthreads/in/empty
+  chmod +x ${TEST_TMPDIR}/xthreads/in/c/file1
+  local filelist="$(cd ${TEST_TMPDIR}/xthreads/in && find . | sed 's|^./||' \
+      | grep -v '^.$')"
+  (cd ${TEST_TMPDIR}/xthreads/in && $ZIPPER cC ${TEST_TMPDIR}/xthreads.zip \
+      ${filelist}) || fail "zipper failed"
+  mkdir -p ${TEST_TMPDIR}/xthreads/seq ${TEST_TMPDIR}/xthreads/par
+  (cd ${TEST_TMPDIR}/xthreads && $ZIPPER x ${TEST_TMPDIR}/xthreads.zip -d seq) \
+      || fail "zipper x failed"
+  (cd ${TEST_TMPDIR}/xthreads && \
+      $ZIPPER x ${TEST_TMPDIR}/xthreads.zip -d par -j 4) \
+      || fail "zipper x -j failed"
+  diff -r ${TEST_TMPDIR}/xthreads/seq ${TEST_TMPDIR}/xthreads/par &> $TEST_log \
+      || fail "zipper x -j output differs"
+  [[ -x ${TEST_TMPDIR}/xthreads/par/c/file1 ]] \
+      || fail "zipper x -j lost the permissions"
+}
+
 function test_zipper_specify_path() {
   mkdir -p ${TEST_TMPDIR}/files
   echo "toto" > ${TEST_TMPDIR}/files/a.txt
@@ -188,4 +232,24 @@ function test_zipper_specify_path() {
       || fail "Unzip after zipper output is not expected"
 }
 
+# Writes more than 4GB of output, which needs the zip64 format. The files
+# are sparse, so they take no space on disk but the output does.
+function test_zz_zipper_output_over_4gb() {
+  rm -fr ${TEST_TMPDIR}/big ${TEST_TMPDIR}/out
+  mkdir -p ${TEST_TMPDIR}/big ${TEST_TMPDIR}/out
+  for i in 1 2 3; do
+    dd if=/dev/zero of=${TEST_TMPDIR}/big/large$i bs=1 count=0 \
+        seek=$((1500*1024*1024)) 2>/dev/null || fail "dd failed"
+  done
+  echo "toto" > ${TEST_TMPDIR}/big/small
+  (cd ${TEST_TMPDIR}/big && $ZIPPER c ${TEST_TMPDIR}/output.zip \
+      large1 large2 large3 small) || fail "zipper failed"
+  rm -fr ${TEST_TMPDIR}/big
+  (cd ${TEST_TMPDIR}/out && $UNZIP -q ${TEST_TMPDIR}/output.zip small) ||
+      fail "unzip failed"
+  [[ "$(cat ${TEST_TMPDIR}/out/small)" == "toto" ]] ||
+      fail "small file past 4GB has wrong content"
+  rm -f ${TEST_TMPDIR}/output.zip
+}
+
 run_suite "zipper tests"
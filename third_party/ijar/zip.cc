@@ -31,7 +31,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <algorithm>
 #include <limits>
+#include <string>
 #include <vector>
 
 #include "third_party/ijar/mapped_file.h"
@@ -57,6 +59,17 @@
 // version to extract: 1.0 - default value from APPNOTE.TXT.
 // Output JAR files contain no extra ZIP features, so this is enough.
 #define ZIP_VERSION_TO_EXTRACT                10
+// version to extract: 4.5, for the entries with zip64 extra fields.
+#define ZIP64_VERSION_TO_EXTRACT              45
+#define ZIP64_EXTRA_FIELD_TAG                 0x0001
+// The extra field padding the local headers to align the data of the files,
+// as zipalign writes it: the tag, the size, the alignment and zeros.
+#define ALIGNMENT_EXTRA_FIELD_TAG             0xd935
+#define ALIGNMENT_EXTRA_FIELD_MIN_SIZE        6
+
+#define LOCAL_FILE_HEADER_SIZE 30
+#define CENTRAL_FILE_HEADER_SIZE 46
+#define EOCD_SIZE 22
 #define COMPRESSION_METHOD_STORED             0   // no compression
 #define COMPRESSION_METHOD_DEFLATED           8
 
@@ -69,9 +82,8 @@
   | GENERAL_PURPOSE_BIT_FLAG_COMPRESSION_SPEED)
 
 namespace devtools_ijar {
-// In the absence of ZIP64 support, zip files are limited to 4GB.
-// http://www.info-zip.org/FAQ.html#limits
-static const size_t kMaximumOutputSize = std::numeric_limits<uint32_t>::max();
+// The output is written out in chunks of at least this size.
+static const size_t kOutputFlushSize = 1 << 20;
 
 static const u4 kDefaultTimestamp =
     30 << 25 | 1 << 21 | 1 << 16;  // January 1, 2010 in DOS time
@@ -101,10 +113,15 @@ class InputZipFile : public ZipExtractor {
 
   virtual u8 CalculateOutputLength();
 
+  virtual int GetEntries(std::vector<ZipEntry> *entries);
+  virtual int ExtractEntry(const ZipEntry &entry,
+                           ZipExtractorProcessor *processor,
+                           std::string *error) const;
+
   virtual bool ProcessCentralDirEntry(const u1 *&p, size_t *compressed_size,
                                       size_t *uncompressed_size, char *filename,
                                       size_t filename_size, u4 *attr,
-                                      u4 *offset);
+                                      u4 *offset, u4 *crc);
 
  private:
   ZipExtractorProcessor *processor;
@@ -140,6 +157,7 @@ class InputZipFile : public ZipExtractor {
   u2 extract_version_;
   u2 general_purpose_bit_flag_;
   u2 compression_method_;
+  u4 crc32_;  // from the central directory
   u4 uncompressed_size_;
   u4 compressed_size_;
   u2 file_name_length_;
@@ -192,6 +210,9 @@ class InputZipFile : public ZipExtractor {
 
   // Process a file
   int ProcessFile(const bool compressed);
+
+  // Pass the file to the processor without decompressing it
+  int ProcessRawFile(const bool compressed);
 };
 
 //
@@ -199,11 +220,19 @@ class InputZipFile : public ZipExtractor {
 //
 class OutputZipFile : public ZipBuilder {
  public:
-  OutputZipFile(const char *filename, size_t estimated_size)
+  OutputZipFile(const char *filename)
       : output_file_(NULL),
         filename_(filename),
-        estimated_size_(estimated_size),
-        finished_(false) {
+        finished_(false),
+        offset_(0),
+        buffer_(NULL),
+        buffer_size_(0),
+        buffer_capacity_(0),
+        entry_start_(0),
+        entry_data_start_(0),
+        entry_max_length_(0),
+        entry_extra_length_(0),
+        alignment_(0) {
     errmsg[0] = 0;
   }
 
@@ -214,24 +243,28 @@ class OutputZipFile : public ZipBuilder {
     return errmsg;
   }
 
-  virtual ~OutputZipFile() { Finish(); }
-  virtual u1* NewFile(const char* filename, const u4 attr);
+  virtual ~OutputZipFile();
+  virtual u1* NewFile(const char* filename, const u4 attr, size_t max_length);
   virtual int FinishFile(size_t filelength, bool compress = false,
                          bool compute_crc = false);
+  virtual int WriteRawFile(const char* filename, const u4 attr,
+                           const u1* data, size_t compressed_length,
+                           u2 compression_method, u4 crc, size_t length);
   virtual int WriteEmptyFile(const char *filename);
   virtual size_t GetSize() {
-    return Offset(q);
+    return offset_;
   }
   virtual int GetNumberFiles() {
     return entries_.size();
   }
+  virtual void SetAlignment(size_t alignment) { alignment_ = alignment; }
   virtual int Finish();
   bool Open();
 
  private:
   struct LocalFileEntry {
-    // Start of the local header (in the output buffer).
-    size_t local_header_offset;
+    // Start of the local header (in the output file).
+    u8 local_header_offset;
 
     // Sizes of the file entry
     size_t uncompressed_length;
@@ -246,27 +279,32 @@ class OutputZipFile : public ZipBuilder {
     // external attributes field
     u4 external_attr;
 
-    // Start/length of the file_name in the local header.
-    u1 *file_name;
-    u2 file_name_length;
-
-    // Start/length of the extra_field in the local header.
-    const u1 *extra_field;
-    u2 extra_field_length;
+    std::string file_name;
   };
 
-  MappedOutputFile* output_file_;
+  OutputFile* output_file_;
   const char* filename_;
-  size_t estimated_size_;
   bool finished_;
 
-  // OutputZipFile is responsible for maintaining the following
-  // pointers. They are allocated by the Create() method before
-  // the object is actually created using mmap.
-  u1 *zipdata_out_;        // start of output file mmap
-  u1 *q;  // output cursor
+  // The size of the output so far, including the buffered bytes.
+  u8 offset_;
+
+  // The bytes not written out yet. While a file is open, they are followed by
+  // the room for its local header and data.
+  u1 *buffer_;
+  size_t buffer_size_;
+  size_t buffer_capacity_;
 
-  u1 *header_ptr;  // Current pointer to "compression method" entry.
+  // The positions in buffer_ of the local header and of the data of the open
+  // file, and the room reserved for the data.
+  size_t entry_start_;
+  size_t entry_data_start_;
+  size_t entry_max_length_;
+  // The length of the alignment extra field of the open file.
+  size_t entry_extra_length_;
+
+  // See SetAlignment().
+  size_t alignment_;
 
   // List of entries to write the central directory
   std::vector<LocalFileEntry*> entries_;
@@ -282,28 +320,20 @@ class OutputZipFile : public ZipBuilder {
     return -1;
   }
 
-  // Write the ZIP central directory structure for each local file
-  // entry in "entries".
-  void WriteCentralDirectory();
+  // Makes room for `count` more bytes at the end of buffer_ and returns
+  // their address.
+  u1 *Reserve(size_t count);
 
-  // Returns the offset of the pointer relative to the start of the
-  // output zip file.
-  size_t Offset(const u1 *const x) {
-    return x - zipdata_out_;
-  }
+  // Writes out the buffered bytes.
+  int Flush();
 
-  // Write ZIP file header in the output. Since the compressed size is not
-  // known in advance, it must be recorded later. This method returns a pointer
-  // to "compressed size" in the file header that should be passed to
-  // WriteFileSizeInLocalFileHeader() later.
-  u1* WriteLocalFileHeader(const char *filename, const u4 attr);
+  // Writes the local header of the open file, whose entry is complete, and
+  // commits the file to the buffer.
+  int FinishEntry();
 
-  // Fill in the "compressed size" and "uncompressed size" fields in a local
-  // file header previously written by WriteLocalFileHeader().
-  size_t WriteFileSizeInLocalFileHeader(u1 *header_ptr,
-                                        size_t out_length,
-                                        bool compress = false,
-                                        const u4 crc = 0);
+  // Write the ZIP central directory structure for each local file
+  // entry in "entries".
+  void WriteCentralDirectory();
 };
 
 //
@@ -315,7 +345,7 @@ bool InputZipFile::ProcessNext() {
   size_t compressed, uncompressed;
   u4 offset;
   if (!ProcessCentralDirEntry(central_dir_current_, &compressed, &uncompressed,
-                              filename, PATH_MAX, &attr, &offset)) {
+                              filename, PATH_MAX, &attr, &offset, &crc32_)) {
     return false;
   }
 
@@ -404,7 +434,11 @@ int InputZipFile::ProcessLocalFileEntry(
   }
 
   if (processor->Accept(filename, attr)) {
-    if (ProcessFile(is_compressed) < 0) {
+    if (processor->AcceptRaw(filename, attr)) {
+      if (ProcessRawFile(is_compressed) < 0) {
+        return -1;
+      }
+    } else if (ProcessFile(is_compressed) < 0) {
       return -1;
     }
   } else {
@@ -497,6 +531,20 @@ int InputZipFile::ProcessFile(const bool compressed) {
   return 0;
 }
 
+int InputZipFile::ProcessRawFile(const bool compressed) {
+  if (!compressed && compressed_size_ != uncompressed_size_) {
+    return error("compressed size != uncompressed size, although the file "
+                 "is uncompressed.\n");
+  }
+  if (EnsureRemaining(compressed_size_, "file_data") < 0) {
+    return -1;
+  }
+  processor->ProcessRaw(filename, attr, p, compressed_size_,
+                        compression_method_, crc32_, uncompressed_size_);
+  p += compressed_size_;
+  return 0;
+}
+
 
 // Reads and returns some metadata of the next file from the central directory:
 // - compressed size
@@ -511,7 +559,7 @@ int InputZipFile::ProcessFile(const bool compressed) {
 bool InputZipFile::ProcessCentralDirEntry(const u1 *&p, size_t *compressed_size,
                                           size_t *uncompressed_size,
                                           char *filename, size_t filename_size,
-                                          u4 *attr, u4 *offset) {
+                                          u4 *attr, u4 *offset, u4 *crc) {
   u4 signature = get_u4le(p);
 
   if (signature != CENTRAL_FILE_HEADER_SIGNATURE) {
@@ -522,7 +570,8 @@ bool InputZipFile::ProcessCentralDirEntry(const u1 *&p, size_t *compressed_size,
     return false;
   }
 
-  p += 16;  // skip to 'compressed size' field
+  p += 12;  // skip to 'crc32' field
+  *crc = get_u4le(p);
   *compressed_size = get_u4le(p);
   *uncompressed_size = get_u4le(p);
   u2 file_name_length = get_u2le(p);
@@ -555,13 +604,14 @@ u8 InputZipFile::CalculateOutputLength() {
   u8 skipped_compressed_size = 0;
   u4 attr;
   u4 offset;
+  u4 crc;
   char filename[PATH_MAX];
 
   while (true) {
     size_t file_compressed, file_uncompressed;
     if (!ProcessCentralDirEntry(current,
                                 &file_compressed, &file_uncompressed,
-                                filename, PATH_MAX, &attr, &offset)) {
+                                filename, PATH_MAX, &attr, &offset, &crc)) {
       break;
     }
 
@@ -777,6 +827,92 @@ void InputZipFile::Reset() {
   p = zipdata_in_ + in_offset_;
 }
 
+int InputZipFile::GetEntries(std::vector<ZipEntry> *entries) {
+  if (bytes_unmapped_ > 0) {
+    return error("GetEntries() called after the file has been processed\n");
+  }
+  const u1 *current = central_dir_;
+  size_t compressed, uncompressed;
+  u4 entry_attr;
+  u4 offset;
+  u4 crc;
+  char entry_filename[PATH_MAX];
+  while (ProcessCentralDirEntry(current, &compressed, &uncompressed,
+                                entry_filename, PATH_MAX, &entry_attr, &offset,
+                                &crc)) {
+    ZipEntry entry;
+    entry.filename = entry_filename;
+    entry.attr = entry_attr;
+    entry.crc32 = crc;
+    entry.compressed_size = compressed;
+    entry.uncompressed_size = uncompressed;
+    entry.local_header_offset = offset;
+    entries->push_back(entry);
+  }
+  return GetError() != NULL ? -1 : 0;
+}
+
+// Only reads the mapping, and decompresses with a Decompressor of the calling
+// thread, so that it is thread-safe.
+int InputZipFile::ExtractEntry(const ZipEntry &entry,
+                               ZipExtractorProcessor *processor,
+                               std::string *error) const {
+  static thread_local Decompressor decompressor;
+  const char *name = entry.filename.c_str();
+  size_t length = input_file_->Length();
+  size_t header_offset = in_offset_ + entry.local_header_offset;
+  if (header_offset > length || length - header_offset < 30) {
+    *error = std::string("local file header of ") + name + " out of the file";
+    return -1;
+  }
+  const u1 *q = zipdata_in_ + header_offset;
+  if (get_u4le(q) != LOCAL_FILE_HEADER_SIGNATURE) {
+    *error = std::string("local file header signature for file ") + name +
+             " not found";
+    return -1;
+  }
+  q += 4;  // skip to 'compression method' field
+  u2 compression_method = get_u2le(q);
+  q += 16;  // skip to 'file name length' field
+  u2 file_name_length = get_u2le(q);
+  u2 extra_field_length = get_u2le(q);
+  size_t data_offset = header_offset + 30 + file_name_length +
+                       extra_field_length;
+  if (data_offset > length || length - data_offset < entry.compressed_size) {
+    *error = std::string("data of ") + name + " out of the file";
+    return -1;
+  }
+  const u1 *data = zipdata_in_ + data_offset;
+
+  if (compression_method == COMPRESSION_METHOD_STORED) {
+    if (entry.compressed_size != entry.uncompressed_size) {
+      *error = std::string("compressed size != uncompressed size, although ") +
+               name + " is uncompressed";
+      return -1;
+    }
+    processor->Process(name, entry.attr, data, entry.uncompressed_size);
+    return 0;
+  }
+  if (compression_method != COMPRESSION_METHOD_DEFLATED) {
+    *error = std::string("unsupported compression method of ") + name;
+    return -1;
+  }
+  DecompressedFile *decompressed_file =
+      decompressor.UncompressFile(data, entry.compressed_size);
+  if (decompressed_file == NULL) {
+    const char *decompressor_error = decompressor.GetError();
+    *error = std::string(name) + ": " +
+             (decompressor_error != NULL ? decompressor_error
+                                         : "cannot decompress");
+    return -1;
+  }
+  u1 *uncompressed_data = decompressed_file->uncompressed_data;
+  size_t uncompressed_size = decompressed_file->uncompressed_size;
+  free(decompressed_file);
+  processor->Process(name, entry.attr, uncompressed_data, uncompressed_size);
+  return 0;
+}
+
 int ZipExtractor::ProcessAll() {
   while (ProcessNext()) {}
   if (GetError() != NULL) {
@@ -853,16 +989,50 @@ InputZipFile::~InputZipFile() {
 //
 // Implementation of OutputZipFile
 //
+OutputZipFile::~OutputZipFile() {
+  if (output_file_ != NULL) {
+    Finish();
+  }
+  for (size_t ii = 0; ii < entries_.size(); ++ii) {
+    delete entries_[ii];
+  }
+  free(buffer_);
+}
+
+u1 *OutputZipFile::Reserve(size_t count) {
+  if (buffer_size_ + count > buffer_capacity_) {
+    size_t capacity = std::max(buffer_size_ + count, 2 * buffer_capacity_);
+    u1 *buffer = reinterpret_cast<u1 *>(realloc(buffer_, capacity));
+    if (buffer == NULL) {
+      fprintf(stderr, "Cannot allocate %zu bytes for the output\n", capacity);
+      abort();
+    }
+    buffer_ = buffer;
+    buffer_capacity_ = capacity;
+  }
+  return buffer_ + buffer_size_;
+}
+
+int OutputZipFile::Flush() {
+  if (buffer_size_ > 0 && output_file_->Write(buffer_, buffer_size_) < 0) {
+    return error("%s", output_file_->Error());
+  }
+  buffer_size_ = 0;
+  return 0;
+}
+
 int OutputZipFile::WriteEmptyFile(const char *filename) {
   const u1* file_name = (const u1*) filename;
   size_t file_name_length = strlen(filename);
 
   LocalFileEntry *entry = new LocalFileEntry;
-  entry->local_header_offset = Offset(q);
+  entry->local_header_offset = offset_;
   entry->external_attr = 0;
   entry->crc32 = 0;
 
   // Output the ZIP local_file_header:
+  u1 *q = Reserve(LOCAL_FILE_HEADER_SIZE + file_name_length);
+  u1 *start = q;
   put_u4le(q, LOCAL_FILE_HEADER_SIGNATURE);
   put_u2le(q, 10);  // extract_version
   put_u2le(q, 0);  // general_purpose_bit_flag
@@ -874,14 +1044,13 @@ int OutputZipFile::WriteEmptyFile(const char *filename) {
   put_u2le(q, file_name_length);
   put_u2le(q, 0);  // extra_field_length
   put_n(q, file_name, file_name_length);
+  buffer_size_ += q - start;
+  offset_ += q - start;
 
-  entry->file_name_length = file_name_length;
-  entry->extra_field_length = 0;
   entry->compressed_length = 0;
   entry->uncompressed_length = 0;
   entry->compression_method = 0;
-  entry->extra_field = (const u1 *)"";
-  entry->file_name = (u1*) strdup((const char *) file_name);
+  entry->file_name = filename;
   entries_.push_back(entry);
 
   return 0;
@@ -889,37 +1058,54 @@ int OutputZipFile::WriteEmptyFile(const char *filename) {
 
 void OutputZipFile::WriteCentralDirectory() {
   // central directory:
-  const u1 *central_directory_start = q;
+  u8 central_directory_start = offset_;
   for (size_t ii = 0; ii < entries_.size(); ++ii) {
     LocalFileEntry *entry = entries_[ii];
+    // Local headers past 4GB are located through a zip64 extra field.
+    bool zip64 = entry->local_header_offset > U4_MAX;
+    u2 extra_field_length = zip64 ? 12 : 0;
+    size_t length = CENTRAL_FILE_HEADER_SIZE + entry->file_name.size() +
+                    extra_field_length;
+    u1 *q = Reserve(length);
     put_u4le(q, CENTRAL_FILE_HEADER_SIGNATURE);
     put_u2le(q, 0);  // version made by
 
-    put_u2le(q, ZIP_VERSION_TO_EXTRACT);  // version to extract
+    // version to extract
+    put_u2le(q, zip64 ? ZIP64_VERSION_TO_EXTRACT : ZIP_VERSION_TO_EXTRACT);
     put_u2le(q, 0);  // general purpose bit flag
     put_u2le(q, entry->compression_method);  // compression method:
     put_u4le(q, kDefaultTimestamp);          // last_mod_file date and time
     put_u4le(q, entry->crc32);  // crc32
     put_u4le(q, entry->compressed_length);    // compressed_size
     put_u4le(q, entry->uncompressed_length);  // uncompressed_size
-    put_u2le(q, entry->file_name_length);
-    put_u2le(q, entry->extra_field_length);
+    put_u2le(q, entry->file_name.size());
+    put_u2le(q, extra_field_length);
 
     put_u2le(q, 0);  // file comment length
     put_u2le(q, 0);  // disk number start
     put_u2le(q, 0);  // internal file attributes
     put_u4le(q, entry->external_attr);  // external file attributes
     // relative offset of local header:
-    put_u4le(q, entry->local_header_offset);
-
-    put_n(q, entry->file_name, entry->file_name_length);
-    put_n(q, entry->extra_field, entry->extra_field_length);
+    put_u4le(q, zip64 ? U4_MAX : entry->local_header_offset);
+
+    put_n(q, reinterpret_cast<const u1 *>(entry->file_name.data()),
+          entry->file_name.size());
+    if (zip64) {
+      put_u2le(q, ZIP64_EXTRA_FIELD_TAG);
+      put_u2le(q, 8);  // size of the extra field data
+      put_u8le(q, entry->local_header_offset);
+    }
+    buffer_size_ += length;
+    offset_ += length;
   }
-  u8 central_directory_size = q - central_directory_start;
+  u8 central_directory_size = offset_ - central_directory_start;
 
   if (entries_.size() > U2_MAX || central_directory_size > U4_MAX ||
-      Offset(central_directory_start) > U4_MAX) {
-    u1 *zip64_end_of_central_directory_start = q;
+      central_directory_start > U4_MAX) {
+    u8 zip64_end_of_central_directory_start = offset_;
+    size_t length =
+        ZIP64_EOCD_FIXED_SIZE + ZIP64_EOCD_LOCATOR_SIZE + EOCD_SIZE;
+    u1 *q = Reserve(length);
 
     put_u4le(q, ZIP64_EOCD_SIGNATURE);
     // signature and size field doesn't count towards size
@@ -932,13 +1118,13 @@ void OutputZipFile::WriteCentralDirectory() {
     put_u8le(q, entries_.size());  // total # entries in the central directory
     put_u8le(q, central_directory_size);  // size of the central directory
     // offset of start of central directory wrt starting disk
-    put_u8le(q, Offset(central_directory_start));
+    put_u8le(q, central_directory_start);
 
     put_u4le(q, ZIP64_EOCD_LOCATOR_SIGNATURE);
     // number of the disk with the start of the zip64 end of central directory
     put_u4le(q, 0);
     // relative offset of the zip64 end of central directory record
-    put_u8le(q, Offset(zip64_end_of_central_directory_start));
+    put_u8le(q, zip64_end_of_central_directory_start);
     // total number of disks
     put_u4le(q, 1);
 
@@ -953,12 +1139,13 @@ void OutputZipFile::WriteCentralDirectory() {
     put_u4le(q,
              central_directory_size > U4_MAX ? U4_MAX : central_directory_size);
     // offset of start of central
-    put_u4le(q, Offset(central_directory_start) > U4_MAX
-                    ? U4_MAX
-                    : Offset(central_directory_start));
+    put_u4le(q, central_directory_start > U4_MAX ? U4_MAX
+                                                 : central_directory_start);
     put_u2le(q, 0);  // .ZIP file comment length
-
+    buffer_size_ += length;
+    offset_ += length;
   } else {
+    u1 *q = Reserve(EOCD_SIZE);
     put_u4le(q, EOCD_SIGNATURE);
     put_u2le(q, 0);  // number of this disk
     put_u2le(q, 0);  // # of the disk with the start of the central directory
@@ -966,64 +1153,13 @@ void OutputZipFile::WriteCentralDirectory() {
     put_u2le(q, entries_.size());  // total # entries in the central directory
     put_u4le(q, central_directory_size);  // size of the central directory
     // offset of start of central directory wrt starting disk
-    put_u4le(q, Offset(central_directory_start));
+    put_u4le(q, central_directory_start);
     put_u2le(q, 0);  // .ZIP file comment length
+    buffer_size_ += EOCD_SIZE;
+    offset_ += EOCD_SIZE;
   }
 }
 
-u1* OutputZipFile::WriteLocalFileHeader(const char* filename, const u4 attr) {
-  off_t file_name_length_ = strlen(filename);
-  LocalFileEntry *entry = new LocalFileEntry;
-  entry->local_header_offset = Offset(q);
-  entry->file_name_length = file_name_length_;
-  entry->file_name = new u1[file_name_length_];
-  entry->external_attr = attr;
-  memcpy(entry->file_name, filename, file_name_length_);
-  entry->extra_field_length = 0;
-  entry->extra_field = (const u1 *)"";
-  entry->crc32 = 0;
-
-  // Output the ZIP local_file_header:
-  put_u4le(q, LOCAL_FILE_HEADER_SIGNATURE);
-  put_u2le(q, ZIP_VERSION_TO_EXTRACT);     // version to extract
-  put_u2le(q, 0);                          // general purpose bit flag
-  u1 *header_ptr = q;
-  put_u2le(q, COMPRESSION_METHOD_STORED);  // compression method = placeholder
-  put_u4le(q, kDefaultTimestamp);          // last_mod_file date and time
-  put_u4le(q, entry->crc32);               // crc32
-  put_u4le(q, 0);  // compressed_size = placeholder
-  put_u4le(q, 0);  // uncompressed_size = placeholder
-  put_u2le(q, entry->file_name_length);
-  put_u2le(q, entry->extra_field_length);
-
-  put_n(q, entry->file_name, entry->file_name_length);
-  put_n(q, entry->extra_field, entry->extra_field_length);
-  entries_.push_back(entry);
-
-  return header_ptr;
-}
-
-size_t OutputZipFile::WriteFileSizeInLocalFileHeader(u1 *header_ptr,
-                                                     size_t out_length,
-                                                     bool compress,
-                                                     const u4 crc) {
-  size_t compressed_size = out_length;
-  if (compress) {
-    compressed_size = TryDeflate(q, out_length);
-  }
-  // compression method
-  if (compressed_size < out_length) {
-    put_u2le(header_ptr, COMPRESSION_METHOD_DEFLATED);
-  } else {
-    put_u2le(header_ptr, COMPRESSION_METHOD_STORED);
-  }
-  header_ptr += 4;
-  put_u4le(header_ptr, crc);              // crc32
-  put_u4le(header_ptr, compressed_size);  // compressed_size
-  put_u4le(header_ptr, out_length);       // uncompressed_size
-  return compressed_size;
-}
-
 int OutputZipFile::Finish() {
   if (finished_) {
     return 0;
@@ -1031,7 +1167,10 @@ int OutputZipFile::Finish() {
 
   finished_ = true;
   WriteCentralDirectory();
-  if (output_file_->Close(GetSize()) < 0) {
+  if (Flush() < 0) {
+    return -1;
+  }
+  if (output_file_->Close() < 0) {
     return error("%s", output_file_->Error());
   }
   delete output_file_;
@@ -1039,54 +1178,130 @@ int OutputZipFile::Finish() {
   return 0;
 }
 
-u1* OutputZipFile::NewFile(const char* filename, const u4 attr) {
-  header_ptr = WriteLocalFileHeader(filename, attr);
-  return q;
+// The local header of the file is only written by FinishFile(), when the
+// sizes are known; NewFile() just reserves the room for it.
+u1* OutputZipFile::NewFile(const char* filename, const u4 attr,
+                           size_t max_length) {
+  LocalFileEntry *entry = new LocalFileEntry;
+  entry->local_header_offset = offset_;
+  entry->file_name = filename;
+  entry->external_attr = attr;
+  entry->crc32 = 0;
+  entries_.push_back(entry);
+
+  entry_start_ = buffer_size_;
+  entry_extra_length_ = 0;
+  if (alignment_ > 1) {
+    size_t header_length = LOCAL_FILE_HEADER_SIZE + entry->file_name.size();
+    size_t misalignment = (offset_ + header_length) % alignment_;
+    if (misalignment != 0) {
+      entry_extra_length_ = alignment_ - misalignment;
+      while (entry_extra_length_ < ALIGNMENT_EXTRA_FIELD_MIN_SIZE) {
+        entry_extra_length_ += alignment_;
+      }
+    }
+  }
+  entry_data_start_ = entry_start_ + LOCAL_FILE_HEADER_SIZE +
+                      entry->file_name.size() + entry_extra_length_;
+  entry_max_length_ = max_length;
+  Reserve(entry_data_start_ - entry_start_ + max_length);
+  return buffer_ + entry_data_start_;
 }
 
 int OutputZipFile::FinishFile(size_t filelength, bool compress,
                               bool compute_crc) {
+  LocalFileEntry *entry = entries_.back();
+  if (filelength > entry_max_length_) {
+    return error("%s: %zu bytes written, only %zu reserved",
+                 entry->file_name.c_str(), filelength, entry_max_length_);
+  }
+  if (filelength > U4_MAX) {
+    return error("%s: files over 4GB are not supported",
+                 entry->file_name.c_str());
+  }
+  u1 *data = buffer_ + entry_data_start_;
   u4 crc = 0;
   if (compute_crc) {
-    crc = ComputeCrcChecksum(q, filelength);
+    crc = ComputeCrcChecksum(data, filelength);
 
     if (filelength > 0 && crc == 0) {
       fprintf(stderr, "Error calculating CRC32 checksum.\n");
       return -1;
     }
   }
-  size_t compressed_size =
-      WriteFileSizeInLocalFileHeader(header_ptr, filelength, compress, crc);
+  size_t compressed_size = filelength;
+  if (compress) {
+    compressed_size = TryDeflate(data, filelength);
+  }
 
   if (compressed_size == 0 && filelength > 0) {
     fprintf(stderr, "Error compressing files.\n");
     return -1;
   }
 
-  entries_.back()->crc32 = crc;
-  entries_.back()->compressed_length = compressed_size;
-  entries_.back()->uncompressed_length = filelength;
+  entry->crc32 = crc;
+  entry->compressed_length = compressed_size;
+  entry->uncompressed_length = filelength;
   if (compressed_size < filelength) {
-    entries_.back()->compression_method = COMPRESSION_METHOD_DEFLATED;
+    entry->compression_method = COMPRESSION_METHOD_DEFLATED;
   } else {
-    entries_.back()->compression_method = COMPRESSION_METHOD_STORED;
+    entry->compression_method = COMPRESSION_METHOD_STORED;
   }
-  q += compressed_size;
-  return 0;
+  return FinishEntry();
 }
 
-bool OutputZipFile::Open() {
-  if (estimated_size_ > kMaximumOutputSize) {
-    fprintf(stderr,
-            "Uncompressed input jar has size %lu, "
-            "which exceeds the maximum supported output size %lu.\n"
-            "Assuming that ijar will be smaller and hoping for the best.\n",
-            estimated_size_, kMaximumOutputSize);
-    estimated_size_ = kMaximumOutputSize;
+int OutputZipFile::WriteRawFile(const char* filename, const u4 attr,
+                                const u1* data, size_t compressed_length,
+                                u2 compression_method, u4 crc, size_t length) {
+  if (length > U4_MAX || compressed_length > U4_MAX) {
+    return error("%s: files over 4GB are not supported", filename);
+  }
+  memcpy(NewFile(filename, attr, compressed_length), data, compressed_length);
+  LocalFileEntry *entry = entries_.back();
+  entry->crc32 = crc;
+  entry->compressed_length = compressed_length;
+  entry->uncompressed_length = length;
+  entry->compression_method = compression_method;
+  return FinishEntry();
+}
+
+int OutputZipFile::FinishEntry() {
+  LocalFileEntry *entry = entries_.back();
+  size_t compressed_size = entry->compressed_length;
+
+  // Output the ZIP local_file_header:
+  u1 *q = buffer_ + entry_start_;
+  put_u4le(q, LOCAL_FILE_HEADER_SIGNATURE);
+  put_u2le(q, ZIP_VERSION_TO_EXTRACT);     // version to extract
+  put_u2le(q, 0);                          // general purpose bit flag
+  put_u2le(q, entry->compression_method);  // compression method
+  put_u4le(q, kDefaultTimestamp);          // last_mod_file date and time
+  put_u4le(q, entry->crc32);               // crc32
+  put_u4le(q, compressed_size);            // compressed_size
+  put_u4le(q, entry->uncompressed_length);  // uncompressed_size
+  put_u2le(q, entry->file_name.size());
+  put_u2le(q, entry_extra_length_);        // extra_field_length
+  put_n(q, reinterpret_cast<const u1 *>(entry->file_name.data()),
+        entry->file_name.size());
+  if (entry_extra_length_ > 0) {
+    put_u2le(q, ALIGNMENT_EXTRA_FIELD_TAG);
+    put_u2le(q, entry_extra_length_ - 4);
+    put_u2le(q, alignment_);
+    memset(q, 0, entry_extra_length_ - ALIGNMENT_EXTRA_FIELD_MIN_SIZE);
+  }
+
+  size_t entry_length = entry_data_start_ - entry_start_ + compressed_size;
+  buffer_size_ += entry_length;
+  offset_ += entry_length;
+  entry_max_length_ = 0;
+  if (buffer_size_ >= kOutputFlushSize) {
+    return Flush();
   }
+  return 0;
+}
 
-  MappedOutputFile* output_file = new MappedOutputFile(
-      filename_, estimated_size_);
+bool OutputZipFile::Open() {
+  OutputFile* output_file = new OutputFile(filename_);
   if (!output_file->Opened()) {
     snprintf(errmsg, sizeof(errmsg), "%s", output_file->Error());
     delete output_file;
@@ -1094,13 +1309,11 @@ bool OutputZipFile::Open() {
   }
 
   output_file_ = output_file;
-  q = output_file->Buffer();
-  zipdata_out_ = output_file->Buffer();
   return true;
 }
 
-ZipBuilder *ZipBuilder::Create(const char *zip_file, size_t estimated_size) {
-  OutputZipFile* result = new OutputZipFile(zip_file, estimated_size);
+ZipBuilder *ZipBuilder::Create(const char *zip_file) {
+  OutputZipFile* result = new OutputZipFile(zip_file);
   if (!result->Open()) {
     fprintf(stderr, "%s\n", result->GetError());
     delete result;
@@ -1110,32 +1323,4 @@ ZipBuilder *ZipBuilder::Create(const char *zip_file, size_t estimated_size) {
   return result;
 }
 
-u8 ZipBuilder::EstimateSize(char const* const* files,
-                            char const* const* zip_paths,
-                            int nb_entries) {
-  Stat file_stat;
-  // Digital signature field size = 6, End of central directory = 22, Total = 28
-  u8 size = 28;
-  // Count the size of all the files in the input to estimate the size of the
-  // output.
-  for (int i = 0; i < nb_entries; i++) {
-    file_stat.total_size = 0;
-    if (files[i] != NULL && !stat_file(files[i], &file_stat)) {
-      fprintf(stderr, "File %s does not seem to exist.", files[i]);
-      return 0;
-    }
-    size += file_stat.total_size;
-    // Add sizes of Zip meta data
-    // local file header = 30 bytes
-    // data descriptor = 12 bytes
-    // central directory descriptor = 46 bytes
-    //    Total: 88bytes
-    size += 88;
-    // The filename is stored twice (once in the central directory
-    // and once in the local file header).
-    size += strlen((zip_paths[i] != NULL) ? zip_paths[i] : files[i]) * 2;
-  }
-  return size;
-}
-
 }  // namespace devtools_ijar
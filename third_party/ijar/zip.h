@@ -22,6 +22,9 @@
 
 #include <sys/stat.h>
 
+#include <string>
+#include <vector>
+
 #include "third_party/ijar/common.h"
 
 namespace devtools_ijar {
@@ -48,12 +51,13 @@ class ZipBuilder {
 
   // Add a new file to the ZIP, the file will have path "filename"
   // and external attributes "attr". This function returns a pointer
-  // to a memory buffer to write the data of the file into. This buffer
-  // is owned by ZipBuilder and should not be free'd by the caller. The
-  // file length is then specified when the files is finished written
-  // using the FinishFile(size_t) function.
+  // to a memory buffer of "max_length" bytes to write the data of the file
+  // into. This buffer is owned by ZipBuilder and should not be free'd by the
+  // caller. The file length is then specified when the files is finished
+  // written using the FinishFile(size_t) function.
   // On failure, returns NULL and GetError() will return an non-empty message.
-  virtual u1* NewFile(const char* filename, const u4 attr) = 0;
+  virtual u1* NewFile(const char* filename, const u4 attr,
+                      size_t max_length) = 0;
 
   // Finish writing a file and specify its length. After calling this method
   // one should not reuse the pointer given by NewFile. The file can be
@@ -65,8 +69,16 @@ class ZipBuilder {
                          bool compress = false,
                          bool compute_crc = false) = 0;
 
+  // Write a file whose content is already compressed with
+  // "compression_method" (stored or deflated). "crc" and "length" are the
+  // CRC32 and the length of the uncompressed content.
+  // On failure, returns -1 and GetError() will return an non-empty message.
+  virtual int WriteRawFile(const char* filename, const u4 attr,
+                           const u1* data, size_t compressed_length,
+                           u2 compression_method, u4 crc, size_t length) = 0;
+
   // Write an empty file, it is equivalent to:
-  //   NewFile(filename, 0);
+  //   NewFile(filename, 0, 0);
   //   FinishFile(0);
   // On failure, returns -1 and GetError() will return an non-empty message.
   virtual int WriteEmptyFile(const char* filename) = 0;
@@ -88,18 +100,17 @@ class ZipBuilder {
   // Returns the current number of files stored in the ZIP.
   virtual int GetNumberFiles() = 0;
 
-  // Create a new ZipBuilder writing the file zip_file and the size of the
-  // output will be at most estimated_size. Use ZipBuilder::EstimateSize() or
-  // ZipExtractor::CalculateOuputLength() to have an estimated_size depending on
-  // a list of file to store.
-  // On failure, returns NULL. Refer to errno for error code.
-  static ZipBuilder* Create(const char* zip_file, size_t estimated_size);
+  // Aligns the data of the files added from now on by NewFile() or
+  // WriteRawFile() to a multiple of "alignment" bytes from the start of the
+  // ZIP, so that stored files can be mapped in place. The local headers are
+  // padded with an extra field for this. 0 or 1 disables the alignment.
+  virtual void SetAlignment(size_t alignment) = 0;
 
-  // Estimate the maximum size of the ZIP files containing files in the "files"
-  // null-terminated array.
-  // Returns 0 on error.
-  static u8 EstimateSize(char const* const* files, char const* const* zip_paths,
-                         int nb_entries);
+  // Create a new ZipBuilder writing the file zip_file. The files are written
+  // out as they are finished, and the central directory by Finish(); past
+  // 4GB of output, the zip64 format is used.
+  // On failure, returns NULL. Refer to errno for error code.
+  static ZipBuilder* Create(const char* zip_file);
 };
 
 //
@@ -121,6 +132,35 @@ class ZipExtractorProcessor {
   // in the buffer pointed by "data".
   virtual void Process(const char* filename, const u4 attr,
                        const u1* data, const size_t size) = 0;
+
+  // Tells whether the file "filename", accepted by Accept, is copied
+  // unchanged. Such files are passed to ProcessRaw instead of Process, without
+  // decompressing them.
+  virtual bool AcceptRaw(const char* /*filename*/, const u4 /*attr*/) {
+    return false;
+  }
+
+  // Process a file accepted by AcceptRaw. The buffer pointed by "data" holds
+  // the "compressed_size" bytes of the file as stored in the ZIP, with
+  // "compression_method"; "crc" and "size" are the CRC32 and the length of
+  // the uncompressed content.
+  virtual void ProcessRaw(const char* /*filename*/, const u4 /*attr*/,
+                          const u1* /*data*/, const size_t /*compressed_size*/,
+                          const u2 /*compression_method*/, const u4 /*crc*/,
+                          const size_t /*size*/) {}
+};
+
+// An entry of the central directory of a ZIP file, see
+// ZipExtractor::GetEntries().
+struct ZipEntry {
+  std::string filename;
+  // The external file attributes.
+  u4 attr;
+  u4 crc32;
+  size_t compressed_size;
+  size_t uncompressed_size;
+  // The offset of the local file header, from the start of the ZIP.
+  size_t local_header_offset;
 };
 
 //
@@ -149,6 +189,21 @@ class ZipExtractor {
   // Return the size of the ZIP file.
   virtual size_t GetSize() = 0;
 
+  // Appends the entries of the central directory to "entries", in order,
+  // without calling the processor. They can then be extracted with
+  // ExtractEntry(), in any order. Must be called before ProcessNext(), which
+  // unmaps the processed part of the file as it goes.
+  // Returns -1 on error (GetError() will be populated on error).
+  virtual int GetEntries(std::vector<ZipEntry> *entries) = 0;
+
+  // Passes the content of "entry", decompressed, to processor->Process().
+  // Accept() is not called. Unlike the other methods, ExtractEntry() can be
+  // called from several threads at once, each with its own processor.
+  // Returns -1 on error, and sets "*error" to the message.
+  virtual int ExtractEntry(const ZipEntry &entry,
+                           ZipExtractorProcessor *processor,
+                           std::string *error) const = 0;
+
   // Return the size of the resulting zip file by keeping only file
   // accepted by the processor and storing them uncompressed. This
   // method can be used to create a ZipBuilder for storing a subset
@@ -27,12 +27,19 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
 
 namespace devtools_ijar {
 
@@ -97,26 +104,42 @@ void concat_path(char* out, const size_t size,
   }
 }
 
-void UnzipProcessor::Process(const char* filename, const u4 attr,
-                             const u1* data, const size_t size) {
-  mode_t perm = zipattr_to_perm(attr);
-  bool isdir = zipattr_is_dir(attr);
-  const char *output_file_name = filename;
+// Works out how the entry "filename" with external attributes "attr" is
+// extracted: its permissions, whether it is a directory and its path under
+// the output root. Returns false if the entry is skipped.
+static bool entry_output(const char *filename, const u4 attr, bool flatten,
+                         mode_t *perm, bool *isdir,
+                         const char **output_file_name) {
+  *perm = zipattr_to_perm(attr);
+  *isdir = zipattr_is_dir(attr);
+  *output_file_name = filename;
   if (attr == 0) {
     // Fallback when the external attribute is not set.
-    isdir = filename[strlen(filename)-1] == '/';
-    perm = 0777;
+    *isdir = filename[strlen(filename)-1] == '/';
+    *perm = 0777;
   }
 
-  if (flatten_) {
-    if (isdir) {
-      return;
+  if (flatten) {
+    if (*isdir) {
+      return false;
     }
     const char *p = strrchr(filename, '/');
     if (p != NULL) {
-      output_file_name = p + 1;
+      *output_file_name = p + 1;
     }
   }
+  return true;
+}
+
+void UnzipProcessor::Process(const char* filename, const u4 attr,
+                             const u1* data, const size_t size) {
+  mode_t perm;
+  bool isdir;
+  const char *output_file_name;
+  if (!entry_output(filename, attr, flatten_, &perm, &isdir,
+                    &output_file_name)) {
+    return;
+  }
 
   if (verbose_) {
     printf("%c %o %s\n", isdir ? 'd' : 'f', perm, output_file_name);
@@ -131,6 +154,156 @@ void UnzipProcessor::Process(const char* filename, const u4 attr,
   }
 }
 
+// A file to extract with -j.
+struct PendingEntry {
+  const ZipEntry *entry;  // NULL if a later entry overwrites this one.
+  std::string dir;        // The output directory, with a trailing slash.
+  std::string name;       // The name of the output file in dir.
+  mode_t perm;
+  int dirfd;              // As returned by open_dir() for dir.
+};
+
+//
+// A ZipExtractorProcessor that writes the entry passed to it by
+// ZipExtractor::ExtractEntry() to the output file of a PendingEntry.
+//
+class EntryWriter : public ZipExtractorProcessor {
+ public:
+  explicit EntryWriter(const PendingEntry *pending)
+      : pending_(pending), ok_(false) {}
+
+  virtual ~EntryWriter() {}
+
+  virtual bool Accept(const char* filename, const u4 attr) { return true; }
+  virtual void Process(const char* filename, const u4 attr,
+                       const u1* data, const size_t size) {
+    if (pending_->dirfd >= 0) {
+      ok_ = write_file_at(pending_->dirfd, pending_->name.c_str(),
+                          pending_->perm, data, size);
+    } else {
+      ok_ = write_file((pending_->dir + pending_->name).c_str(),
+                       pending_->perm, data, size);
+    }
+  }
+
+  bool ok() const { return ok_; }
+
+ private:
+  const PendingEntry *pending_;
+  bool ok_;
+};
+
+// Extracts the entries accepted by "processor" into output_root, inflating
+// and writing them on "threads" threads. The directories are created up
+// front from the central directory and kept open, so that the threads only
+// create files, relative to their directory.
+int extract_parallel(ZipExtractor *extractor, UnzipProcessor *processor,
+                     const char *output_root, bool verbose, bool flatten,
+                     int threads) {
+  std::vector<ZipEntry> entries;
+  if (extractor->GetEntries(&entries) < 0) {
+    fprintf(stderr, "%s.\n", extractor->GetError());
+    return -1;
+  }
+
+  std::vector<PendingEntry> pending;
+  std::map<std::string, int> dirfds;
+  std::map<std::string, size_t> by_path;
+  int result = 0;
+  for (const ZipEntry &entry : entries) {
+    const char *filename = entry.filename.c_str();
+    mode_t perm;
+    bool isdir;
+    const char *output_file_name;
+    if (!processor->Accept(filename, entry.attr) ||
+        !entry_output(filename, entry.attr, flatten, &perm, &isdir,
+                      &output_file_name)) {
+      continue;
+    }
+    if (verbose) {
+      printf("%c %o %s\n", isdir ? 'd' : 'f', perm, output_file_name);
+    }
+    char path[PATH_MAX];
+    concat_path(path, PATH_MAX, output_root, output_file_name);
+    if (isdir) {
+      if (!make_dirs(path, perm)) {
+        result = -1;
+        break;
+      }
+      continue;
+    }
+
+    PendingEntry file;
+    file.entry = &entry;
+    const char *slash = strrchr(path, '/');
+    file.dir.assign(path, slash + 1 - path);
+    file.name = slash + 1;
+    file.perm = perm;
+    auto dir = dirfds.find(file.dir);
+    if (dir == dirfds.end()) {
+      if (!make_dirs(path, perm)) {
+        result = -1;
+        break;
+      }
+      // If we run out of descriptors, files are written by path instead.
+      dir = dirfds.emplace(file.dir, open_dir(file.dir.c_str())).first;
+    }
+    file.dirfd = dir->second;
+    auto previous = by_path.find(path);
+    if (previous != by_path.end()) {
+      pending[previous->second].entry = NULL;
+      previous->second = pending.size();
+    } else {
+      by_path.emplace(path, pending.size());
+    }
+    pending.push_back(file);
+  }
+
+  if (result == 0) {
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex mutex;
+    std::string error;  // Guarded by mutex.
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+      workers.emplace_back([&]() {
+        for (size_t ix = next++; ix < pending.size() && !failed;
+             ix = next++) {
+          const PendingEntry &file = pending[ix];
+          if (file.entry == NULL) {
+            continue;
+          }
+          EntryWriter writer(&file);
+          std::string entry_error;
+          if (extractor->ExtractEntry(*file.entry, &writer, &entry_error) <
+                  0 ||
+              !writer.ok()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failed.exchange(true)) {
+              error = entry_error;
+            }
+          }
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    if (failed) {
+      // Write errors are reported by write_file() and write_file_at().
+      if (!error.empty()) {
+        fprintf(stderr, "%s.\n", error.c_str());
+      }
+      result = -1;
+    }
+  }
+
+  for (const auto &dir : dirfds) {
+    close_dir(dir.second);
+  }
+  return result;
+}
+
 // Get the basename of path and store it in output. output_size
 // is the size of the output buffer.
 void basename(const char *path, char *output, size_t output_size) {
@@ -146,7 +319,7 @@ void basename(const char *path, char *output, size_t output_size) {
 
 // Execute the extraction (or just listing if just v is provided)
 int extract(char *zipfile, char *exdir, char **files, bool verbose,
-            bool extract, bool flatten) {
+            bool extract, bool flatten, int threads) {
   std::string cwd = get_cwd();
   if (cwd.empty()) {
     return -1;
@@ -168,6 +341,10 @@ int extract(char *zipfile, char *exdir, char **files, bool verbose,
     return -1;
   }
 
+  if (extract && threads > 1) {
+    return extract_parallel(extractor.get(), &processor, output_root, verbose,
+                            flatten, threads);
+  }
   if (extractor->ProcessAll() < 0) {
     fprintf(stderr, "%s.\n", extractor->GetError());
     return -1;
@@ -175,9 +352,41 @@ int extract(char *zipfile, char *exdir, char **files, bool verbose,
   return 0;
 }
 
-// add a file to the zip
-int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
-             char *zip_path, bool flatten, bool verbose, bool compress) {
+// The compression methods, as in zip.cc.
+static const u2 kCompressionMethodStored = 0;
+static const u2 kCompressionMethodDeflated = 8;
+
+// A file to add to the zip. With -j, its contents are read and compressed by
+// a worker thread, and written out by the main thread in the argument order.
+struct PendingFile {
+  PendingFile()
+      : file(NULL),
+        attr(0),
+        size(0),
+        data_length(0),
+        compression_method(kCompressionMethodStored),
+        crc(0),
+        ok(false),
+        done(false) {}
+
+  const char *file;  // NULL for an empty file or a directory.
+  std::string path;
+  u4 attr;
+  size_t size;
+  // The contents, compressed if compression_method says so.
+  std::vector<u1> data;
+  size_t data_length;
+  u2 compression_method;
+  u4 crc;
+  bool ok;
+  bool done;  // Guarded by the mutex of create_parallel().
+};
+
+// Works out the path in the zip and the attributes of a file to add to it,
+// printing them if verbose. Returns -1 on error, 0 if the file is skipped
+// and 1 otherwise.
+int describe_file(char *file, char *zip_path, bool flatten, bool verbose,
+                  PendingFile *pending) {
   Stat file_stat = {0, 0666, false};
   if (file != NULL) {
     if (!stat_file(file, &file_stat)) {
@@ -217,18 +426,138 @@ int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
     printf("%c %o %s\n", isdir ? 'd' : 'f', perm, path);
   }
 
-  u1 *buffer = builder->NewFile(path, stat_to_zipattr(file_stat));
-  if (isdir || file_stat.total_size == 0) {
+  pending->path = path;
+  pending->attr = stat_to_zipattr(file_stat);
+  if (!isdir && file_stat.total_size > 0) {
+    pending->file = file;
+    pending->size = file_stat.total_size;
+  }
+  return 1;
+}
+
+// add a file to the zip
+int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
+             char *zip_path, bool flatten, bool verbose, bool compress) {
+  PendingFile pending;
+  int described = describe_file(file, zip_path, flatten, verbose, &pending);
+  if (described <= 0) {
+    return described;
+  }
+
+  u1 *buffer =
+      builder->NewFile(pending.path.c_str(), pending.attr, pending.size);
+  if (pending.file == NULL) {
     builder->FinishFile(0);
   } else {
-    if (!read_file(file, buffer, file_stat.total_size)) {
+    if (!read_file(pending.file, buffer, pending.size)) {
       return -1;
     }
-    builder->FinishFile(file_stat.total_size, compress, true);
+    builder->FinishFile(pending.size, compress, true);
   }
   return 0;
 }
 
+// Reads the contents of the file, then computes its CRC-32 and compresses
+// it if requested, the way ZipBuilder::FinishFile() does.
+bool load_file(PendingFile *pending, bool compress) {
+  if (pending->file == NULL) {
+    return true;
+  }
+  pending->data.resize(pending->size);
+  u1 *data = pending->data.data();
+  if (!read_file(pending->file, data, pending->size)) {
+    return false;
+  }
+  pending->crc = ComputeCrcChecksum(data, pending->size);
+  if (pending->crc == 0) {
+    fprintf(stderr, "Error calculating CRC32 checksum.\n");
+    return false;
+  }
+  pending->data_length =
+      compress ? TryDeflate(data, pending->size) : pending->size;
+  if (pending->data_length == 0) {
+    fprintf(stderr, "Error compressing files.\n");
+    return false;
+  }
+  pending->compression_method = pending->data_length < pending->size
+                                    ? kCompressionMethodDeflated
+                                    : kCompressionMethodStored;
+  return true;
+}
+
+// Adds the files to the zip, reading and compressing them on `threads`
+// worker threads. The main thread writes them out in the argument order, so
+// the zip is the same as the one add_file() produces. At most a few files
+// per thread are held in memory at once.
+int create_parallel(std::unique_ptr<ZipBuilder> const &builder,
+                    std::vector<PendingFile> *files, bool compress,
+                    int threads) {
+  const size_t max_pending = 4 * threads;
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t next = 0;     // The next file to load.
+  size_t written = 0;  // The number of files written out.
+  bool stopping = false;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&]() {
+      for (;;) {
+        PendingFile *pending;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() {
+            return stopping || next == files->size() ||
+                   next < written + max_pending;
+          });
+          if (stopping || next == files->size()) {
+            return;
+          }
+          pending = &(*files)[next++];
+        }
+        bool ok = load_file(pending, compress);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          pending->ok = ok;
+          pending->done = true;
+        }
+        cond.notify_all();
+      }
+    });
+  }
+
+  int result = 0;
+  for (size_t ix = 0; ix < files->size(); ++ix) {
+    PendingFile &pending = (*files)[ix];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return pending.done; });
+    }
+    if (!pending.ok ||
+        builder->WriteRawFile(pending.path.c_str(), pending.attr,
+                              pending.data.data(), pending.data_length,
+                              pending.compression_method, pending.crc,
+                              pending.size) < 0) {
+      result = -1;
+      break;
+    }
+    std::vector<u1>().swap(pending.data);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written;
+    }
+    cond.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return result;
+}
+
 // Read a list of files separated by newlines. The resulting array can be
 // freed using the free method.
 char **read_filelist(char *filename) {
@@ -310,7 +639,7 @@ char **parse_filelist(char *zipfile, char **file_entries, int nb_entries,
 
 // Execute the create operation
 int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
-           bool compress) {
+           bool compress, int threads) {
   int nb_entries = 0;
   while (file_entries[nb_entries] != NULL) {
     nb_entries++;
@@ -321,22 +650,38 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
     return -1;
   }
 
-  u8 size = ZipBuilder::EstimateSize(files, zip_paths, nb_entries);
-  if (size == 0) {
-    return -1;
-  }
-  std::unique_ptr<ZipBuilder> builder(ZipBuilder::Create(zipfile, size));
+  std::unique_ptr<ZipBuilder> builder(ZipBuilder::Create(zipfile));
   if (builder.get() == NULL) {
     fprintf(stderr, "Unable to create zip file %s: %s.\n",
             zipfile, strerror(errno));
     return -1;
   }
 
-  for (int i = 0; i < nb_entries; i++) {
-    if (add_file(builder, files[i], zip_paths[i], flatten, verbose, compress) <
-        0) {
+  if (threads > 1) {
+    std::vector<PendingFile> pending(nb_entries);
+    size_t count = 0;
+    for (int i = 0; i < nb_entries; i++) {
+      int described = describe_file(files[i], zip_paths[i], flatten, verbose,
+                                    &pending[count]);
+      if (described < 0) {
+        return -1;
+      }
+      count += described;
+    }
+    pending.resize(count);
+    if (create_parallel(builder, &pending, compress, threads) < 0) {
+      if (builder->GetError() != NULL) {
+        fprintf(stderr, "%s\n", builder->GetError());
+      }
       return -1;
     }
+  } else {
+    for (int i = 0; i < nb_entries; i++) {
+      if (add_file(builder, files[i], zip_paths[i], flatten, verbose,
+                   compress) < 0) {
+        return -1;
+      }
+    }
   }
   if (builder->Finish() < 0) {
     fprintf(stderr, "%s\n", builder->GetError());
@@ -352,8 +697,8 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
 //
 static void usage(char *progname) {
   fprintf(stderr,
-          "Usage: %s [vxc[fC]] x.zip [-d exdir] [[zip_path1=]file1 ... "
-          "[zip_pathn=]filen]\n",
+          "Usage: %s [vxc[fC]] x.zip [-d exdir] [-j threads] "
+          "[[zip_path1=]file1 ... [zip_pathn=]filen]\n",
           progname);
   fprintf(stderr, "  v verbose - list all file in x.zip\n");
   fprintf(stderr,
@@ -366,6 +711,9 @@ static void usage(char *progname) {
           "extract operation\n");
   fprintf(stderr,
           "  C compress - compress files when using the create operation\n");
+  fprintf(stderr,
+          "  -j threads - read and compress the files to add, or inflate and "
+          "write\n               the extracted files, on that many threads\n");
   fprintf(stderr, "x and c cannot be used in the same command-line.\n");
   fprintf(stderr,
           "\nFor every file, a path in the zip can be specified. Examples:\n");
@@ -387,6 +735,7 @@ int main(int argc, char **argv) {
   bool create = false;
   bool compress = false;
   bool flatten = false;
+  int threads = 1;
 
   if (argc < 3) {
     usage(argv[0]);
@@ -420,11 +769,20 @@ int main(int argc, char **argv) {
   }
 
   // Calculate the argument index of the first entry file.
-  int filelist_start_index;
-  if (argc > 3 && strcmp(argv[3], "-d") == 0) {
-    filelist_start_index = 5;
-  } else {
-    filelist_start_index = 3;
+  char* exdir = NULL;
+  int filelist_start_index = 3;
+  while (argc > filelist_start_index + 1) {
+    if (strcmp(argv[filelist_start_index], "-d") == 0) {
+      exdir = argv[filelist_start_index + 1];
+    } else if (strcmp(argv[filelist_start_index], "-j") == 0) {
+      threads = atoi(argv[filelist_start_index + 1]);
+      if (threads < 1) {
+        usage(argv[0]);
+      }
+    } else {
+      break;
+    }
+    filelist_start_index += 2;
   }
 
   char** filelist = NULL;
@@ -453,15 +811,11 @@ int main(int argc, char **argv) {
 
   if (create) {
     // Create a zip
-    return devtools_ijar::create(argv[2], filelist, flatten, verbose, compress);
+    return devtools_ijar::create(argv[2], filelist, flatten, verbose, compress,
+                                 threads);
   } else {
-    char* exdir = NULL;
-    if (argc > 3 && strcmp(argv[3], "-d") == 0) {
-      exdir = argv[4];
-    }
-
     // Extraction / list mode
     return devtools_ijar::extract(argv[2], exdir, filelist, verbose, extract,
-                                  flatten);
+                                  flatten, threads);
   }
 }
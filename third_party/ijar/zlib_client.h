@@ -17,6 +17,8 @@
 
 #include <limits.h>
 
+#include <limits>
+
 #include "third_party/ijar/common.h"
 
 namespace devtools_ijar {
@@ -16,7 +16,12 @@
 #ifdef _WIN32
 #include <windows.h>
 #else  // not _WIN32
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -24,13 +29,10 @@
 
 #include <fstream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <vector>
 
-#ifdef _WIN32
-#include <memory>
-#endif  // _WIN32
-
 namespace bazel {
 namespace tools {
 namespace cpp {
@@ -42,26 +44,82 @@ using std::pair;
 using std::string;
 using std::vector;
 
+// An index of a runfiles manifest, which build-runfiles writes next to the
+// MANIFEST in a runfiles directory as MANIFEST.index. It consists of a
+// header and an open-addressing hash table of the manifest's lines, keyed by
+// the FNV-1a hash of the runfiles path:
+//
+//   char magic[8];                // "RFINDEX1"
+//   uint64_t manifest_size;       // of the manifest the index is for
+//   int64_t manifest_mtime_sec;   // likewise
+//   int64_t manifest_mtime_nsec;  // likewise
+//   uint64_t bucket_count;        // a power of 2
+//   uint32_t buckets[bucket_count];  // offset of a line plus 1; 0 if empty
+//
+// in native byte order. Both files are mapped into memory, so a lookup is a
+// hash probe with no parsing up front. Runfiles::ExportManifestIndex writes
+// the same format to a temporary file.
+class ManifestIndex {
+ public:
+  // Returns the index of `manifest` in `index_file`, or nullptr if there is
+  // none or it is not for the manifest as it is now.
+  static ManifestIndex* Open(const string& manifest, const string& index_file);
+
+  // Writes an index of `manifest` to a new temporary file and sets `path` to
+  // its path. Returns false, and sets `error` if not null, on failure.
+  static bool Write(const string& manifest, string* path, string* error);
+
+  ~ManifestIndex();
+
+  // Looks up `path` and returns whether the manifest has a line for it.
+  bool Lookup(const string& path, string* target) const;
+
+ private:
+  struct Header {
+    char magic[8];
+    uint64_t manifest_size;
+    int64_t manifest_mtime_sec;
+    int64_t manifest_mtime_nsec;
+    uint64_t bucket_count;
+  };
+
+  ManifestIndex(const char* manifest, size_t manifest_size, void* index,
+                size_t index_size)
+      : manifest_(manifest),
+        manifest_size_(manifest_size),
+        index_(index),
+        index_size_(index_size) {}
+
+  const char* manifest_;
+  size_t manifest_size_;
+  void* index_;
+  size_t index_size_;
+};
+
 namespace {
 
-bool starts_with(const string& s, const char* prefix) {
-  if (!prefix || !*prefix) {
-    return true;
-  }
-  if (s.empty()) {
+// Returns whether `path` is normalized as Rlocation requires: not empty, and
+// without "." or ".." segments or empty segments. Scans the path once.
+bool IsNormalized(const string& path) {
+  if (path.empty() || path.compare(0, 2, "./") == 0 ||
+      path.compare(0, 3, "../") == 0) {
     return false;
   }
-  return s.find(prefix) == 0;
-}
-
-bool contains(const string& s, const char* substr) {
-  if (!substr || !*substr) {
-    return true;
-  }
-  if (s.empty()) {
-    return false;
+  for (string::size_type i = path.find('/'); i != string::npos;
+       i = path.find('/', i + 1)) {
+    if (i + 1 == path.size()) {
+      break;
+    }
+    char next = path[i + 1];
+    if (next == '/') {
+      return false;  // "//"
+    }
+    if (next == '.' &&
+        (i + 2 == path.size() || path[i + 2] == '.' || path[i + 2] == '/')) {
+      return false;  // "/." at the end, "/.." or "/./"
+    }
   }
-  return s.find(substr) != string::npos;
+  return true;
 }
 
 bool ends_with(const string& s, const string& suffix) {
@@ -78,6 +136,14 @@ bool IsReadableFile(const string& path) {
   return std::ifstream(path).is_open();
 }
 
+bool Exists(const string& path) {
+#ifdef _WIN32
+  return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+  return access(path.c_str(), F_OK) == 0;
+#endif
+}
+
 bool IsDirectory(const string& path) {
 #ifdef _WIN32
   DWORD attrs = GetFileAttributesA(path.c_str());
@@ -100,9 +166,289 @@ bool ParseManifest(const string& path, map<string, string>* result,
 
 }  // namespace
 
+#ifdef _WIN32
+ManifestIndex* ManifestIndex::Open(const string& manifest,
+                                   const string& index_file) {
+  return nullptr;
+}
+
+bool ManifestIndex::Write(const string& manifest, string* path,
+                          string* error) {
+  if (error) {
+    *error = "ERROR: runfiles manifest indexes are not supported on Windows";
+  }
+  return false;
+}
+
+ManifestIndex::~ManifestIndex() {}
+
+bool ManifestIndex::Lookup(const string& path, string* target) const {
+  return false;
+}
+#else   // not _WIN32
+namespace {
+
+// Maps the file at `path` into memory, or returns nullptr. Sets `st` to its
+// status.
+void* MapFile(const string& path, struct stat* st) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  void* result = nullptr;
+  if (fstat(fd, st) == 0 && st->st_size > 0) {
+    result = mmap(nullptr, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (result == MAP_FAILED) {
+      result = nullptr;
+    }
+  }
+  close(fd);
+  return result;
+}
+
+uint64_t HashPath(const char* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+ManifestIndex* ManifestIndex::Open(const string& manifest,
+                                   const string& index_file) {
+  struct stat index_st, manifest_st;
+  void* index = MapFile(index_file, &index_st);
+  if (index == nullptr) {
+    return nullptr;
+  }
+  const Header* header = static_cast<const Header*>(index);
+  void* data = nullptr;
+  size_t index_size = index_st.st_size;
+  if (index_size >= sizeof(Header) &&
+      memcmp(header->magic, "RFINDEX1", 8) == 0 && header->bucket_count > 0 &&
+      (header->bucket_count & (header->bucket_count - 1)) == 0 &&
+      header->bucket_count <=
+          (index_size - sizeof(Header)) / sizeof(uint32_t)) {
+    data = MapFile(manifest, &manifest_st);
+  }
+  if (data == nullptr ||
+      header->manifest_size != static_cast<uint64_t>(manifest_st.st_size) ||
+      header->manifest_mtime_sec != manifest_st.st_mtim.tv_sec ||
+      header->manifest_mtime_nsec != manifest_st.st_mtim.tv_nsec) {
+    if (data != nullptr) {
+      munmap(data, manifest_st.st_size);
+    }
+    munmap(index, index_size);
+    return nullptr;
+  }
+  return new ManifestIndex(static_cast<const char*>(data),
+                           manifest_st.st_size, index, index_size);
+}
+
+namespace {
+
+// Builds the hash table of an index of the manifest `data`, as
+// build-runfiles does. Like ParseManifest, stops at the first empty line,
+// fails at a line without a space, and lets the last line for a path win.
+bool BuildIndexTable(const char* data, size_t size, vector<uint32_t>* table) {
+  vector<pair<uint32_t, uint32_t> > lines;  // offset and length of the path
+  for (size_t offset = 0; offset < size && data[offset] != '\n';) {
+    const char* end =
+        static_cast<const char*>(memchr(data + offset, '\n', size - offset));
+    size_t line_size = (end == nullptr ? data + size : end) - (data + offset);
+    const char* space =
+        static_cast<const char*>(memchr(data + offset, ' ', line_size));
+    if (space == nullptr) {
+      return false;
+    }
+    lines.emplace_back(offset, space - (data + offset));
+    offset += line_size + 1;
+  }
+  uint64_t buckets = 16;
+  while (buckets < 2 * lines.size()) {
+    buckets *= 2;
+  }
+  table->assign(buckets, 0);
+  for (const auto& line : lines) {
+    const char* path = data + line.first;
+    for (uint64_t bucket = HashPath(path, line.second);; ++bucket) {
+      uint32_t& slot = (*table)[bucket & (buckets - 1)];
+      // An earlier line for the same path has the same hash, so it is met on
+      // the way to an empty bucket.
+      if (slot == 0 || (size - (slot - 1) > line.second &&
+                        memcmp(data + slot - 1, path, line.second) == 0 &&
+                        data[slot - 1 + line.second] == ' ')) {
+        slot = line.first + 1;
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns the directory to create temporary files in.
+string TempDir() {
+  for (const char* name : {"TEST_TMPDIR", "TMPDIR"}) {
+    const char* value = getenv(name);
+    if (value != nullptr && value[0] != '\0') {
+      return value;
+    }
+  }
+  return "/tmp";
+}
+
+}  // namespace
+
+bool ManifestIndex::Write(const string& manifest, string* path,
+                          string* error) {
+  struct stat st;
+  const char* data = static_cast<const char*>(MapFile(manifest, &st));
+  vector<uint32_t> table;
+  bool indexed = data != nullptr &&
+                 static_cast<uint64_t>(st.st_size) < UINT32_MAX &&
+                 BuildIndexTable(data, st.st_size, &table);
+  if (data != nullptr) {
+    munmap(const_cast<char*>(data), st.st_size);
+  }
+  if (!indexed) {
+    if (error) {
+      std::ostringstream err;
+      err << "ERROR: " << __FILE__ << "(" << __LINE__
+          << "): cannot index runfiles manifest \"" << manifest << "\"";
+      *error = err.str();
+    }
+    return false;
+  }
+
+  Header header;
+  memcpy(header.magic, "RFINDEX1", sizeof header.magic);
+  header.manifest_size = st.st_size;
+  header.manifest_mtime_sec = st.st_mtim.tv_sec;
+  header.manifest_mtime_nsec = st.st_mtim.tv_nsec;
+  header.bucket_count = table.size();
+
+  string temp = TempDir() + "/runfiles_index.XXXXXX";
+  int fd = mkstemp(&temp[0]);
+  bool written = false;
+  if (fd >= 0) {
+    FILE* out = fdopen(fd, "w");
+    written = out != nullptr && fwrite(&header, sizeof header, 1, out) == 1 &&
+              fwrite(table.data(), sizeof table[0], table.size(), out) ==
+                  table.size();
+    if (out == nullptr) {
+      close(fd);
+    } else if (fclose(out) != 0) {
+      written = false;
+    }
+    if (!written) {
+      unlink(temp.c_str());
+    }
+  }
+  if (!written) {
+    if (error) {
+      std::ostringstream err;
+      err << "ERROR: " << __FILE__ << "(" << __LINE__
+          << "): cannot write an index of runfiles manifest \"" << manifest
+          << "\" to \"" << temp << "\"";
+      *error = err.str();
+    }
+    return false;
+  }
+  *path = temp;
+  return true;
+}
+
+ManifestIndex::~ManifestIndex() {
+  munmap(const_cast<char*>(manifest_), manifest_size_);
+  munmap(index_, index_size_);
+}
+
+bool ManifestIndex::Lookup(const string& path, string* target) const {
+  const Header* header = static_cast<const Header*>(index_);
+  const uint32_t* buckets = reinterpret_cast<const uint32_t*>(header + 1);
+  uint64_t mask = header->bucket_count - 1;
+  for (uint64_t bucket = HashPath(path.data(), path.size());
+       buckets[bucket & mask] != 0; ++bucket) {
+    size_t offset = buckets[bucket & mask] - 1;
+    if (offset >= manifest_size_ ||
+        manifest_size_ - offset <= path.size() ||
+        memcmp(manifest_ + offset, path.data(), path.size()) != 0 ||
+        manifest_[offset + path.size()] != ' ') {
+      continue;
+    }
+    const char* begin = manifest_ + offset + path.size() + 1;
+    const char* end = static_cast<const char*>(
+        memchr(begin, '\n', manifest_ + manifest_size_ - begin));
+    target->assign(begin, end == nullptr ? manifest_ + manifest_size_ : end);
+    return true;
+  }
+  return false;
+}
+#endif  // _WIN32
+
+Runfiles::Runfiles(
+    const map<string, string>&& runfiles_map,
+    std::unique_ptr<ManifestIndex> manifest_index, const string&& manifest,
+    const string&& lazy_manifest, const string&& directory,
+    const vector<pair<string, string> >&& envvars)
+    : runfiles_map_(std::move(runfiles_map)),
+      manifest_index_(std::move(manifest_index)),
+      manifest_(std::move(manifest)),
+      lazy_manifest_(std::move(lazy_manifest)),
+      directory_(std::move(directory)),
+      envvars_(std::move(envvars)) {}
+
+Runfiles::~Runfiles() {
+#ifndef _WIN32
+  if (!exported_index_.empty()) {
+    unlink(exported_index_.c_str());
+  }
+#endif  // _WIN32
+}
+
+bool Runfiles::ExportManifestIndex(string* error) {
+  // With an index, subprocesses find it next to the manifest or through the
+  // RUNFILES_MANIFEST_INDEX this process got and passes on.
+  if (manifest_.empty() || manifest_index_ != nullptr ||
+      !exported_index_.empty()) {
+    return true;
+  }
+  if (!ManifestIndex::Write(manifest_, &exported_index_, error)) {
+    return false;
+  }
+  envvars_.push_back({"RUNFILES_MANIFEST_INDEX", exported_index_});
+  return true;
+}
+
 Runfiles* Runfiles::Create(const string& argv0,
                            const string& runfiles_manifest_file,
                            const string& runfiles_dir, string* error) {
+  return Runfiles::Create(argv0, runfiles_manifest_file, runfiles_dir, false,
+                          error);
+}
+
+Runfiles* Runfiles::Create(const string& argv0,
+                           const string& runfiles_manifest_file,
+                           const string& runfiles_dir, bool manifest_only,
+                           string* error) {
+  return New(argv0, runfiles_manifest_file, runfiles_dir, manifest_only, false,
+             "", error);
+}
+
+Runfiles* Runfiles::CreateLazily(const string& argv0,
+                                 const string& runfiles_manifest_file,
+                                 const string& runfiles_dir, string* error) {
+  return New(argv0, runfiles_manifest_file, runfiles_dir, false, true, "",
+             error);
+}
+
+Runfiles* Runfiles::New(const string& argv0,
+                        const string& runfiles_manifest_file,
+                        const string& runfiles_dir, bool manifest_only,
+                        bool lazy, const string& manifest_index_file,
+                        string* error) {
   string manifest, directory;
   if (!PathsFrom(argv0, runfiles_manifest_file, runfiles_dir,
                  [](const string& path) {
@@ -122,23 +468,55 @@ Runfiles* Runfiles::Create(const string& argv0,
     }
     return nullptr;
   }
+  if (manifest_only && manifest.empty()) {
+    if (error) {
+      std::ostringstream err;
+      err << "ERROR: " << __FILE__ << "(" << __LINE__
+          << "): cannot find runfiles manifest (argv0=\"" << argv0 << "\")";
+      *error = err.str();
+    }
+    return nullptr;
+  }
 
-  const vector<pair<string, string> > envvars = {
+  vector<pair<string, string> > envvars = {
       {"RUNFILES_MANIFEST_FILE", manifest},
       {"RUNFILES_DIR", directory},
       // TODO(laszlocsomor): remove JAVA_RUNFILES once the Java launcher can
       // pick up RUNFILES_DIR.
       {"JAVA_RUNFILES", directory}};
+  if (manifest_only) {
+    envvars.push_back({"RUNFILES_MANIFEST_ONLY", "1"});
+    // The directory is only passed on to subprocesses; Rlocation must not
+    // look into it.
+    directory.clear();
+  }
 
   map<string, string> runfiles;
+  std::unique_ptr<ManifestIndex> index;
+  string lazy_manifest;
   if (!manifest.empty()) {
-    if (!ParseManifest(manifest, &runfiles, error)) {
-      return nullptr;
+    if (!manifest_index_file.empty()) {
+      index.reset(ManifestIndex::Open(manifest, manifest_index_file));
+      if (index != nullptr) {
+        envvars.push_back({"RUNFILES_MANIFEST_INDEX", manifest_index_file});
+      }
+    }
+    if (index == nullptr) {
+      index.reset(ManifestIndex::Open(manifest, manifest + ".index"));
+    }
+    if (index == nullptr) {
+      if (lazy) {
+        lazy_manifest = manifest;
+      } else if (!ParseManifest(manifest, &runfiles, error)) {
+        return nullptr;
+      }
     }
   }
 
-  return new Runfiles(std::move(runfiles), std::move(directory),
-                      std::move(envvars));
+  string manifest_path = manifest;
+  return new Runfiles(std::move(runfiles), std::move(index),
+                      std::move(manifest_path), std::move(lazy_manifest),
+                      std::move(directory), std::move(envvars));
 }
 
 bool IsAbsolute(const string& path) {
@@ -168,22 +546,91 @@ string GetEnv(const string& key) {
 }
 
 string Runfiles::Rlocation(const string& path) const {
-  if (path.empty() || starts_with(path, "../") || contains(path, "/..") ||
-      starts_with(path, "./") || contains(path, "/./") ||
-      ends_with(path, "/.") || contains(path, "//")) {
-    return string();
+  string result;
+  Rlocation(path, &result);
+  return result;
+}
+
+void Runfiles::Rlocation(const string& path, string* result) const {
+  result->clear();
+  if (!IsNormalized(path)) {
+    return;
   }
   if (IsAbsolute(path)) {
-    return path;
+    result->assign(path);
+    return;
   }
-  const auto value = runfiles_map_.find(path);
-  if (value != runfiles_map_.end()) {
-    return value->second;
+  if (!lazy_manifest_.empty() && !directory_.empty()) {
+    result->assign(directory_).append("/").append(path);
+    if (Exists(*result)) {
+      return;
+    }
+    result->clear();
+  }
+  if (LookupManifest(path, result) || LookupManifestDirectory(path, result)) {
+    return;
   }
   if (!directory_.empty()) {
-    return directory_ + "/" + path;
+    result->assign(directory_).append("/").append(path);
+  }
+}
+
+bool Runfiles::LookupManifest(const string& path, string* result) const {
+  if (manifest_index_ != nullptr) {
+    return manifest_index_->Lookup(path, result);
   }
-  return "";
+  const map<string, string>& runfiles = RunfilesMap();
+  const auto value = runfiles.find(path);
+  if (value == runfiles.end()) {
+    return false;
+  }
+  result->assign(value->second);
+  return true;
+}
+
+bool Runfiles::LookupManifestDirectory(const string& path,
+                                       string* result) const {
+  string::size_type slash = path.rfind('/');
+  if (slash == string::npos) {
+    return false;
+  }
+  string parent = path.substr(0, slash);
+  std::lock_guard<std::mutex> lock(directory_cache_mutex_);
+  auto cached = directory_cache_.find(parent);
+  if (cached == directory_cache_.end()) {
+    // Only the directory itself is listed in the manifest, so look for the
+    // longest prefix of `parent` that is. A prefix with no target is an empty
+    // file, which has nothing below it.
+    string target;
+    string::size_type end = parent.size();
+    while (!LookupManifest(parent.substr(0, end), &target) || target.empty()) {
+      target.clear();
+      end = end == 0 ? string::npos : parent.rfind('/', end - 1);
+      if (end == string::npos) {
+        break;
+      }
+    }
+    if (!target.empty()) {
+      target.append(parent, end, string::npos);
+    }
+    cached = directory_cache_.emplace(parent, std::move(target)).first;
+  }
+  if (cached->second.empty()) {
+    return false;
+  }
+  result->assign(cached->second).append(path, slash, string::npos);
+  return true;
+}
+
+const map<string, string>& Runfiles::RunfilesMap() const {
+  if (!lazy_manifest_.empty()) {
+    std::call_once(lazy_manifest_parsed_, [this]() {
+      if (!ParseManifest(lazy_manifest_, &runfiles_map_, nullptr)) {
+        runfiles_map_.clear();
+      }
+    });
+  }
+  return runfiles_map_;
 }
 
 namespace {
@@ -239,8 +686,15 @@ bool TestOnly_IsAbsolute(const string& path) { return IsAbsolute(path); }
 }  // namespace testing
 
 Runfiles* Runfiles::Create(const string& argv0, string* error) {
-  return Runfiles::Create(argv0, GetEnv("RUNFILES_MANIFEST_FILE"),
-                          GetEnv("RUNFILES_DIR"), error);
+  return New(argv0, GetEnv("RUNFILES_MANIFEST_FILE"), GetEnv("RUNFILES_DIR"),
+             GetEnv("RUNFILES_MANIFEST_ONLY") == "1", false,
+             GetEnv("RUNFILES_MANIFEST_INDEX"), error);
+}
+
+Runfiles* Runfiles::CreateLazily(const string& argv0, string* error) {
+  return New(argv0, GetEnv("RUNFILES_MANIFEST_FILE"), GetEnv("RUNFILES_DIR"),
+             GetEnv("RUNFILES_MANIFEST_ONLY") == "1", true,
+             GetEnv("RUNFILES_MANIFEST_INDEX"), error);
 }
 
 namespace {
@@ -37,7 +37,10 @@
 // The Runfiles::Create function uses the runfiles manifest and the runfiles
 // directory from the RUNFILES_MANIFEST_FILE and RUNFILES_DIR environment
 // variables. If not present, the function looks for the manifest and directory
-// near argv[0], the path of the main program.
+// near argv[0], the path of the main program. If build-runfiles left an index
+// of the manifest next to it, the manifest is looked up through that index
+// rather than parsed up front. So is an index a parent process exported with
+// `ExportManifestIndex` and named in RUNFILES_MANIFEST_INDEX.
 //
 // To start child processes that also need runfiles, you need to set the right
 // environment variables for them:
@@ -65,7 +68,9 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace bazel {
@@ -73,9 +78,11 @@ namespace tools {
 namespace cpp {
 namespace runfiles {
 
+class ManifestIndex;
+
 class Runfiles {
  public:
-  virtual ~Runfiles() {}
+  virtual ~Runfiles();
 
   // Returns a new `Runfiles` instance.
   //
@@ -85,6 +92,8 @@ class Runfiles {
   // This method looks at the RUNFILES_MANIFEST_FILE and RUNFILES_DIR
   // environment variables. If either is empty, the method looks for the
   // manifest or directory using the other environment variable, or using argv0.
+  // If the RUNFILES_MANIFEST_ONLY environment variable is "1", runfiles are
+  // only looked up in the manifest, see below.
   static Runfiles* Create(const std::string& argv0,
                           std::string* error = nullptr);
 
@@ -98,6 +107,39 @@ class Runfiles {
                           const std::string& runfiles_dir,
                           std::string* error = nullptr);
 
+  // Returns a new `Runfiles` instance.
+  //
+  // Same as `Create(argv0, runfiles_manifest_file, runfiles_dir, error)`,
+  // except that if `manifest_only` is true, a manifest is required and
+  // `Rlocation` resolves paths purely through it: the runfiles directory may
+  // not have been populated, e.g. by `build-runfiles` or with
+  // --nobuild_runfile_links, so `Rlocation` never falls back to it.
+  // `EnvVars` then also contains RUNFILES_MANIFEST_ONLY=1.
+  static Runfiles* Create(const std::string& argv0,
+                          const std::string& runfiles_manifest_file,
+                          const std::string& runfiles_dir, bool manifest_only,
+                          std::string* error = nullptr);
+
+  // Returns a new `Runfiles` instance.
+  //
+  // Same as `Create(argv0, error)`, except that the manifest is not parsed up
+  // front. If there is a runfiles directory, `Rlocation` first looks for the
+  // runfile in it, and only the first lookup that does not find it there
+  // parses the manifest. Meant for programs that look up few runfiles while
+  // the manifest is large. A malformed manifest is treated as empty.
+  static Runfiles* CreateLazily(const std::string& argv0,
+                                std::string* error = nullptr);
+
+  // Returns a new `Runfiles` instance.
+  //
+  // Same as `CreateLazily(argv0, error)`, except it uses
+  // `runfiles_manifest_file` and `runfiles_dir` as the corresponding
+  // environment variable values, like the corresponding `Create`.
+  static Runfiles* CreateLazily(const std::string& argv0,
+                                const std::string& runfiles_manifest_file,
+                                const std::string& runfiles_dir,
+                                std::string* error = nullptr);
+
   // Returns the runtime path of a runfile.
   //
   // Runfiles are data-dependencies of Bazel-built binaries and tests.
@@ -105,6 +147,9 @@ class Runfiles {
   // The returned path may not exist. The caller should verify the path's
   // existence.
   //
+  // A runfile below a directory listed in the manifest, such as the contents
+  // of a tree artifact, is resolved relative to that directory's target.
+  //
   // The function may return an empty string if it cannot find a runfile.
   //
   // Args:
@@ -115,6 +160,24 @@ class Runfiles {
   //   an empty string if the method doesn't know about this runfile
   std::string Rlocation(const std::string& path) const;
 
+  // Same as `Rlocation(path)`, but stores the path of the runfile in `result`,
+  // reusing its storage. Callers that look up many runfiles in a loop can
+  // pass the same string every time and so avoid allocating per lookup.
+  void Rlocation(const std::string& path, std::string* result) const;
+
+  // Writes an index of the manifest to a temporary file, in the format of the
+  // index build-runfiles writes next to the manifest, and adds its path to
+  // `EnvVars` as RUNFILES_MANIFEST_INDEX. Subprocesses then map the index
+  // instead of parsing the manifest again, so a test that starts many helper
+  // binaries parses the manifest once rather than once per process. Call it
+  // before taking `EnvVars`. The file is removed when this object is
+  // destroyed; a subprocess that finds it gone parses the manifest.
+  //
+  // Does nothing if there is no manifest, or if it is already looked up
+  // through an index that subprocesses find as well. Returns false on error,
+  // and on Windows, where manifests are not indexed.
+  bool ExportManifestIndex(std::string* error = nullptr);
+
   // Returns environment variables for subprocesses.
   //
   // The caller should set the returned key-value pairs in the environment of
@@ -125,20 +188,51 @@ class Runfiles {
   }
 
  private:
+  static Runfiles* New(const std::string& argv0,
+                       const std::string& runfiles_manifest_file,
+                       const std::string& runfiles_dir, bool manifest_only,
+                       bool lazy, const std::string& manifest_index_file,
+                       std::string* error);
+
   Runfiles(const std::map<std::string, std::string>&& runfiles_map,
+           std::unique_ptr<ManifestIndex> manifest_index,
+           const std::string&& manifest, const std::string&& lazy_manifest,
            const std::string&& directory,
-           const std::vector<std::pair<std::string, std::string> >&& envvars)
-      : runfiles_map_(std::move(runfiles_map)),
-        directory_(std::move(directory)),
-        envvars_(std::move(envvars)) {}
+           const std::vector<std::pair<std::string, std::string> >&& envvars);
   Runfiles(const Runfiles&) = delete;
   Runfiles(Runfiles&&) = delete;
   Runfiles& operator=(const Runfiles&) = delete;
   Runfiles& operator=(Runfiles&&) = delete;
 
-  const std::map<std::string, std::string> runfiles_map_;
+  // Returns the manifest's entries, parsing `lazy_manifest_` first if needed.
+  const std::map<std::string, std::string>& RunfilesMap() const;
+
+  // Looks up `path` itself in the manifest.
+  bool LookupManifest(const std::string& path, std::string* result) const;
+
+  // Looks up `path` below a directory listed in the manifest.
+  bool LookupManifestDirectory(const std::string& path,
+                               std::string* result) const;
+
+  // The manifest's entries, unless `manifest_index_` looks them up instead.
+  // Filled in by the first `RunfilesMap` call if `lazy_manifest_` is set.
+  mutable std::map<std::string, std::string> runfiles_map_;
+  const std::unique_ptr<ManifestIndex> manifest_index_;
+  // The path of the manifest, or empty if there is none.
+  const std::string manifest_;
+  // The index `ExportManifestIndex` wrote, or empty.
+  std::string exported_index_;
+  // The manifest to parse on demand, or empty if it was parsed up front.
+  const std::string lazy_manifest_;
+  mutable std::once_flag lazy_manifest_parsed_;
   const std::string directory_;
-  const std::vector<std::pair<std::string, std::string> > envvars_;
+  // Maps the parent directory of a path `LookupManifestDirectory` was asked
+  // for to where it resolves, or to an empty string if no directory listed in
+  // the manifest contains it. Saves walking the prefixes of every runfile in
+  // a large data directory.
+  mutable std::mutex directory_cache_mutex_;
+  mutable std::unordered_map<std::string, std::string> directory_cache_;
+  std::vector<std::pair<std::string, std::string> > envvars_;
 };
 
 // The "testing" namespace contains functions that allow unit testing the code.
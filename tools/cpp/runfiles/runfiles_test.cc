@@ -16,6 +16,12 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else  // not _WIN32
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif  // _WIN32
 
 #include <fstream>
@@ -305,6 +311,256 @@ TEST_F(RunfilesTest, ManifestAndDirectoryBasedRunfilesRlocationAndEnvVars) {
   AssertEnvvars(*r, mf->Path(), dir);
 }
 
+TEST_F(RunfilesTest, ManifestBasedRunfilesRlocationBelowDirectory) {
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" LINE() ".runfiles/MANIFEST",
+      {"a/b /x/y", "a/b/c/d e", "f ", "g/h/i /j"}));
+  EXPECT_TRUE(mf != nullptr);
+  string dir = mf->DirName();
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a/b"), "/x/y");
+  EXPECT_EQ(r->Rlocation("a/b/c"), "/x/y/c");
+  EXPECT_EQ(r->Rlocation("a/b/c/d"), "e");
+  EXPECT_EQ(r->Rlocation("a/b/c/e"), "/x/y/c/e");
+  EXPECT_EQ(r->Rlocation("a/b/c/f"), "/x/y/c/f");
+  EXPECT_EQ(r->Rlocation("a/bc/d"), dir + "/a/bc/d");
+  EXPECT_EQ(r->Rlocation("f/g"), dir + "/f/g");
+  EXPECT_EQ(r->Rlocation("g/h/i/j/k"), "/j/j/k");
+  EXPECT_EQ(r->Rlocation("g/h/j"), dir + "/g/h/j");
+}
+
+TEST_F(RunfilesTest, LazilyCreatedRunfilesRlocation) {
+  unique_ptr<MockFile> mf(MockFile::Create("foo" LINE() ".runfiles/MANIFEST",
+                                           {"a/b c/d", "e/f g/h"}));
+  EXPECT_TRUE(mf != nullptr);
+  string dir = mf->DirName();
+  unique_ptr<MockFile> ef(
+      MockFile::Create(dir.substr(RunfilesTest::GetTemp().size() + 1) + "/e/f"));
+  EXPECT_TRUE(ef != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::CreateLazily("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  // Found in the directory, without looking at the manifest.
+  EXPECT_EQ(r->Rlocation("e/f"), dir + "/e/f");
+  EXPECT_EQ(r->Rlocation("a/b"), "c/d");
+  EXPECT_EQ(r->Rlocation("foo"), dir + "/foo");
+  EXPECT_EQ(r->Rlocation("../foo"), "");
+  EXPECT_EQ(r->Rlocation("/Foo"), "/Foo");
+}
+
+TEST_F(RunfilesTest, LazilyCreatedRunfilesIgnoreBadManifest) {
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" LINE() ".runfiles_manifest", {"a b", "nospace"}));
+  EXPECT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::CreateLazily("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a"), "");
+}
+
+TEST_F(RunfilesTest, RlocationIntoResult) {
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" LINE() ".runfiles/MANIFEST", {"a/b c/d"}));
+  EXPECT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+  ASSERT_NE(r, nullptr);
+
+  string result("previous");
+  r->Rlocation("a/b", &result);
+  EXPECT_EQ(result, "c/d");
+  r->Rlocation("foo", &result);
+  EXPECT_EQ(result, mf->DirName() + "/foo");
+  r->Rlocation("f", &result);
+  EXPECT_EQ(result, mf->DirName() + "/f");
+  r->Rlocation("foo/../bar", &result);
+  EXPECT_EQ(result, "");
+  r->Rlocation("/Foo", &result);
+  EXPECT_EQ(result, "/Foo");
+}
+
+TEST_F(RunfilesTest, ManifestOnlyRunfilesRlocationAndEnvVars) {
+  unique_ptr<MockFile> mf(
+      MockFile::Create("foo" LINE() ".runfiles/MANIFEST", {"a/b c/d"}));
+  EXPECT_TRUE(mf != nullptr);
+  string dir = mf->DirName();
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", true, &error));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a/b"), "c/d");
+  EXPECT_EQ(r->Rlocation("c/d"), "");
+  EXPECT_EQ(r->Rlocation("foo"), "");
+  EXPECT_EQ(r->Rlocation("/Foo"), "/Foo");
+  vector<pair<string, string> > expected = {
+      {"RUNFILES_MANIFEST_FILE", mf->Path()},
+      {"RUNFILES_DIR", dir},
+      {"JAVA_RUNFILES", dir},
+      {"RUNFILES_MANIFEST_ONLY", "1"}};
+  ASSERT_EQ(r->EnvVars(), expected);
+}
+
+TEST_F(RunfilesTest, CannotCreateManifestOnlyRunfilesWithoutManifest) {
+  unique_ptr<MockFile> dummy(
+      MockFile::Create("foo" LINE() ".runfiles/dummy", {"a/b c/d"}));
+  EXPECT_TRUE(dummy != nullptr);
+  string dir = dummy->DirName();
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", "", dir, true, &error));
+
+  ASSERT_EQ(r, nullptr);
+  EXPECT_NE(error.find("cannot find runfiles manifest"), string::npos);
+}
+
+#ifndef _WIN32
+// Writes an index of `manifest` to `manifest`.index, as build-runfiles would,
+// but of only the lines for `links`.
+bool WriteManifestIndex(const string& manifest, const vector<string>& links) {
+  string contents;
+  struct stat st;
+  std::ifstream in(manifest);
+  if (!std::getline(in, contents, '\0') || stat(manifest.c_str(), &st) != 0) {
+    return false;
+  }
+  struct {
+    char magic[8];
+    uint64_t manifest_size;
+    int64_t manifest_mtime_sec;
+    int64_t manifest_mtime_nsec;
+    uint64_t bucket_count;
+  } header;
+  memcpy(header.magic, "RFINDEX1", sizeof header.magic);
+  header.manifest_size = st.st_size;
+  header.manifest_mtime_sec = st.st_mtim.tv_sec;
+  header.manifest_mtime_nsec = st.st_mtim.tv_nsec;
+  header.bucket_count = 16;
+  uint32_t buckets[16] = {0};
+  for (const string& link : links) {
+    size_t offset = contents.find(link + " ");
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : link) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    while (buckets[hash & 15] != 0) {
+      ++hash;
+    }
+    buckets[hash & 15] = offset + 1;
+  }
+  std::ofstream out(manifest + ".index", std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof header);
+  out.write(reinterpret_cast<const char*>(buckets), sizeof buckets);
+  return out.good();
+}
+
+TEST_F(RunfilesTest, ManifestBasedRunfilesRlocationThroughIndex) {
+  unique_ptr<MockFile> mf(MockFile::Create("foo" LINE() ".runfiles/MANIFEST",
+                                           {"a/b c/d", "e/f g/h", "e/fg i"}));
+  EXPECT_TRUE(mf != nullptr);
+  unique_ptr<MockFile> index(MockFile::Create(
+      mf->Path().substr(RunfilesTest::GetTemp().size() + 1) + ".index"));
+  EXPECT_TRUE(index != nullptr);
+  // Leave "a/b" out, to tell whether the index is used.
+  ASSERT_TRUE(WriteManifestIndex(mf->Path(), {"e/f", "e/fg"}));
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("e/f"), "g/h");
+  EXPECT_EQ(r->Rlocation("e/fg"), "i");
+  EXPECT_EQ(r->Rlocation("e"), mf->DirName() + "/e");
+  EXPECT_EQ(r->Rlocation("a/b"), mf->DirName() + "/a/b");
+  EXPECT_EQ(r->Rlocation("/Foo"), "/Foo");
+}
+
+TEST_F(RunfilesTest, ManifestBasedRunfilesIgnoreStaleIndex) {
+  unique_ptr<MockFile> mf(MockFile::Create("foo" LINE() ".runfiles/MANIFEST",
+                                           {"a/b c/d", "e/f g/h"}));
+  EXPECT_TRUE(mf != nullptr);
+  unique_ptr<MockFile> index(MockFile::Create(
+      mf->Path().substr(RunfilesTest::GetTemp().size() + 1) + ".index"));
+  EXPECT_TRUE(index != nullptr);
+  ASSERT_TRUE(WriteManifestIndex(mf->Path(), {"e/f"}));
+  {
+    std::ofstream out(mf->Path(), std::ios::app);
+    out << "i/j k/l" << std::endl;
+  }
+
+  string error;
+  unique_ptr<Runfiles> r(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+
+  ASSERT_NE(r, nullptr);
+  EXPECT_TRUE(error.empty());
+  EXPECT_EQ(r->Rlocation("a/b"), "c/d");
+  EXPECT_EQ(r->Rlocation("e/f"), "g/h");
+  EXPECT_EQ(r->Rlocation("i/j"), "k/l");
+}
+
+TEST_F(RunfilesTest, ManifestBasedRunfilesExportIndexToSubprocesses) {
+  unique_ptr<MockFile> mf(MockFile::Create(
+      "foo" LINE() ".runfiles_manifest", {"a/b c/d", "e/f g/h", "a/b i/j"}));
+  EXPECT_TRUE(mf != nullptr);
+
+  string error;
+  unique_ptr<Runfiles> parent(
+      Runfiles::Create("ignore-argv0", mf->Path(), "", &error));
+  ASSERT_NE(parent, nullptr);
+  ASSERT_TRUE(parent->ExportManifestIndex(&error));
+  EXPECT_TRUE(error.empty());
+  string index;
+  for (const auto& envvar : parent->EnvVars()) {
+    if (envvar.first == "RUNFILES_MANIFEST_INDEX") {
+      index = envvar.second;
+    }
+  }
+  ASSERT_FALSE(index.empty());
+  // Exporting again changes nothing.
+  size_t envvar_count = parent->EnvVars().size();
+  ASSERT_TRUE(parent->ExportManifestIndex(&error));
+  EXPECT_EQ(parent->EnvVars().size(), envvar_count);
+
+  // What a subprocess does with the environment of the parent.
+  ASSERT_EQ(setenv("RUNFILES_MANIFEST_FILE", mf->Path().c_str(), 1), 0);
+  ASSERT_EQ(setenv("RUNFILES_MANIFEST_INDEX", index.c_str(), 1), 0);
+  unique_ptr<Runfiles> child(Runfiles::Create("ignore-argv0", &error));
+  unsetenv("RUNFILES_MANIFEST_FILE");
+  unsetenv("RUNFILES_MANIFEST_INDEX");
+  ASSERT_NE(child, nullptr);
+  EXPECT_EQ(child->Rlocation("a/b"), "i/j");
+  EXPECT_EQ(child->Rlocation("e/f"), "g/h");
+  EXPECT_EQ(child->Rlocation("e/f/k"), "g/h/k");
+  // The child found the index, so it passes it on.
+  EXPECT_EQ(child->EnvVars(), parent->EnvVars());
+
+  parent.reset();
+  EXPECT_NE(access(index.c_str(), F_OK), 0);
+}
+#endif  // not _WIN32
+
 TEST_F(RunfilesTest, ManifestBasedRunfilesEnvVars) {
   const vector<string> suffixes({"/MANIFEST", ".runfiles_manifest",
                                  "runfiles_manifest", ".runfiles", ".manifest",
@@ -24,6 +24,10 @@
 //    link action generating the dsym file.
 // "DSYM_HINT_DSYM_PATH": Workspace-relative path to dSYM directory.
 // "DSYM_HINT_DSYM_BUNDLE_ZIP": Workspace-relative path to dSYM zip.
+// The following "DSYM_HINT" flag is optional, e.g. to be passed with
+// --linkopt, and is ignored if no dsym is generated.
+// "DSYM_HINT_NUM_THREADS": Number of threads for dsymutil to use, passed as
+//    its --num-threads flag.
 //
 // Likewise, this wrapper also contains a workaround for a bug in ld that causes
 // flaky builds when using Bitcode symbol maps. ld allows the
@@ -36,15 +40,28 @@
 // To address this, we prepend a special "BITCODE_TOUCH_SYMBOL_MAP=" flag to the
 // symbol map filename and touch it before passing it along to clang, forcing
 // the file to exist.
+//
+// To avoid paying for xcrun's SDK and toolchain discovery on every action, the
+// path that "xcrun --find" reports for a tool is cached in a per-user
+// directory, keyed by DEVELOPER_DIR, SDKROOT, TOOLCHAINS and the tool name,
+// and the tool is executed directly. If the tool cannot be found that way, the
+// wrapper falls back to running it through xcrun.
 
+#include <fcntl.h>
 #include <libgen.h>
 #include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <cerrno>
+#include <cctype>
 #include <climits>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -56,6 +73,11 @@
 
 extern char **environ;
 
+// Overridden by the tests, which run it with a fake xcrun.
+#ifndef XCRUN_PATH
+#define XCRUN_PATH "/usr/bin/xcrun"
+#endif
+
 namespace {
 
 // Returns the base name of the given filepath. For example, given
@@ -89,9 +111,9 @@ void ExecProcess(const std::vector<std::string> &args) {
   abort();
 }
 
-// Spawns a subprocess for given arguments args. The first argument is used
-// for the executable path.
-void RunSubProcess(const std::vector<std::string> &args) {
+// Spawns a subprocess for given arguments args and returns its exit code.
+// The first argument is used for the executable path.
+int RunSubProcessForExitCode(const std::vector<std::string> &args) {
   std::vector<const char *> exec_argv = ConvertToCArgs(args);
   pid_t pid;
   int status = posix_spawn(&pid, args[0].c_str(), NULL, NULL,
@@ -106,11 +128,7 @@ void RunSubProcess(const std::vector<std::string> &args) {
                 << strerror(errno) << "\n";
       abort();
     }
-    if (WEXITSTATUS(status) != 0) {
-      std::cerr << "Error in child process '" <<  args[0] << "'. "
-                << WEXITSTATUS(status) << "\n";
-      abort();
-    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
   } else {
     std::cerr << "Error forking process '" <<  args[0] << "'. "
               << strerror(status) << "\n";
@@ -118,14 +136,288 @@ void RunSubProcess(const std::vector<std::string> &args) {
   }
 }
 
-// Finds and replaces all instances of oldsub with newsub, in-place on str.
-void FindAndReplace(const std::string &oldsub, const std::string &newsub,
-                    std::string *str) {
-  int start = 0;
-  while ((start = str->find(oldsub, start)) != std::string::npos) {
-    str->replace(start, oldsub.length(), newsub);
-    start += newsub.length();
+// Spawns a subprocess for given arguments args. The first argument is used
+// for the executable path. Aborts if the subprocess fails.
+void RunSubProcess(const std::vector<std::string> &args) {
+  int exit_code = RunSubProcessForExitCode(args);
+  if (exit_code != 0) {
+    std::cerr << "Error in child process '" <<  args[0] << "'. "
+              << exit_code << "\n";
+    abort();
+  }
+}
+
+// Runs the given arguments like RunSubProcess, and stores what the subprocess
+// writes to stdout in output. Returns false if the subprocess could not be
+// run or failed.
+bool RunSubProcessForOutput(const std::vector<std::string> &args,
+                            std::string *output) {
+  std::vector<const char *> exec_argv = ConvertToCArgs(args);
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addclose(&actions, fds[0]);
+  posix_spawn_file_actions_addclose(&actions, fds[1]);
+  pid_t pid;
+  int status = posix_spawn(&pid, args[0].c_str(), &actions, NULL,
+                           const_cast<char **>(exec_argv.data()), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);
+  if (status != 0) {
+    close(fds[0]);
+    return false;
+  }
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+    if (n > 0) {
+      output->append(buf, n);
+    } else if (errno != EINTR) {
+      break;
+    }
+  }
+  close(fds[0]);
+  int wait_status;
+  do {
+    wait_status = waitpid(pid, &status, 0);
+  } while ((wait_status == -1) && (errno == EINTR));
+  return wait_status == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Returns the per-user directory of the tool path cache, creating it if
+// needed, or an empty string if it is unusable. The directory is in /tmp, which
+// sandboxed actions can write to, so it must be a directory owned by the
+// current user and nobody else may write to it.
+std::string GetToolCacheDir() {
+  std::string dir = "/tmp/wrapped_clang_cache." + std::to_string(getuid());
+  mkdir(dir.c_str(), 0700);
+  struct stat st;
+  if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+      st.st_uid != getuid() || (st.st_mode & 022) != 0) {
+    return "";
+  }
+  return dir;
+}
+
+// Returns the name of the cache file for the given key: a hash, as the key
+// contains paths.
+std::string ToolCacheFileName(const std::string &key) {
+  uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+  for (unsigned char c : key) {
+    hash = (hash ^ c) * 1099511628211ULL;
   }
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(hash));
+  return name;
+}
+
+// Returns the path of the given tool in the current Xcode, SDK and toolchain,
+// from the cache or else from "xcrun --find", or an empty string if it could
+// not be determined.
+std::string ResolveXcrunTool(const std::string &tool,
+                             const std::string &developer_dir,
+                             const std::string &sdk_root) {
+  // The key is stored in the cache file too, and compared on a hit, so that
+  // hash collisions cannot return the wrong tool.
+  // xcrun picks the tool from the toolchains that TOOLCHAINS names, if set.
+  const char *toolchains = getenv("TOOLCHAINS");
+  std::string key = developer_dir + "\n" + sdk_root + "\n" +
+                    (toolchains != nullptr ? toolchains : "") + "\n" + tool +
+                    "\n";
+  std::string cache_dir = GetToolCacheDir();
+  std::string cache_file;
+  if (!cache_dir.empty()) {
+    cache_file = cache_dir + "/" + ToolCacheFileName(key);
+    std::ifstream cached(cache_file);
+    std::stringstream contents;
+    contents << cached.rdbuf();
+    std::string entry = contents.str();
+    if (entry.size() > key.size() && entry.compare(0, key.size(), key) == 0) {
+      std::string path = entry.substr(key.size());
+      if (access(path.c_str(), X_OK) == 0) {
+        return path;
+      }
+    }
+  }
+
+  std::string path;
+  if (!RunSubProcessForOutput({XCRUN_PATH, "--find", tool}, &path)) {
+    return "";
+  }
+  while (!path.empty() && isspace(path.back())) {
+    path.pop_back();
+  }
+  if (path.empty() || path[0] != '/' || access(path.c_str(), X_OK) != 0) {
+    return "";
+  }
+
+  if (!cache_file.empty()) {
+    // Write a new file and rename it into place, so that concurrent actions
+    // never read a partial entry. Errors only mean that the next action asks
+    // xcrun again.
+    std::string tmp = cache_file + "." + std::to_string(getpid());
+    {
+      std::ofstream out(tmp);
+      out << key << path;
+    }
+    if (rename(tmp.c_str(), cache_file.c_str()) != 0) {
+      unlink(tmp.c_str());
+    }
+  }
+  return path;
+}
+
+// Returns the start of a command line that runs the given Xcode tool: its
+// resolved path if possible, else xcrun with the tool name.
+std::vector<std::string> XcrunToolCommand(const std::string &tool,
+                                          const std::string &developer_dir,
+                                          const std::string &sdk_root) {
+  std::string path = ResolveXcrunTool(tool, developer_dir, sdk_root);
+  if (path.empty()) {
+    return {XCRUN_PATH, tool};
+  }
+  return {path};
+}
+
+// The common prefix of the placeholders that Bazel puts in paths.
+const char kPlaceholderPrefix[] = "__BAZEL_XCODE_";
+
+// Passes the text in [begin, end) to write, in pieces, with the placeholders
+// replaced by developer_dir and sdk_root. The text is scanned once, for the
+// common prefix of the placeholders. Returns whether anything was replaced.
+template <typename Writer>
+bool ReplacePlaceholders(const char *begin, const char *end,
+                         const std::string &developer_dir,
+                         const std::string &sdk_root, Writer write) {
+  static const size_t kPrefixLength = sizeof(kPlaceholderPrefix) - 1;
+  static const char kDeveloperDir[] = "DEVELOPER_DIR__";
+  static const char kSdkRoot[] = "SDKROOT__";
+  bool replaced = false;
+  const char *p = begin;
+  for (;;) {
+    const char *match = static_cast<const char *>(
+        memmem(p, end - p, kPlaceholderPrefix, kPrefixLength));
+    if (match == nullptr) {
+      break;
+    }
+    const char *rest = match + kPrefixLength;
+    const std::string *value = nullptr;
+    size_t length = 0;
+    if (end - rest >= static_cast<ptrdiff_t>(sizeof(kDeveloperDir) - 1) &&
+        memcmp(rest, kDeveloperDir, sizeof(kDeveloperDir) - 1) == 0) {
+      value = &developer_dir;
+      length = sizeof(kDeveloperDir) - 1;
+    } else if (end - rest >= static_cast<ptrdiff_t>(sizeof(kSdkRoot) - 1) &&
+               memcmp(rest, kSdkRoot, sizeof(kSdkRoot) - 1) == 0) {
+      value = &sdk_root;
+      length = sizeof(kSdkRoot) - 1;
+    }
+    if (value == nullptr) {
+      write(p, rest - p);
+    } else {
+      write(p, match - p);
+      write(value->data(), value->size());
+      replaced = true;
+    }
+    p = rest + length;
+  }
+  write(p, end - p);
+  return replaced;
+}
+
+// Replaces the placeholders in arg in place.
+void ReplacePlaceholdersInArg(const std::string &developer_dir,
+                              const std::string &sdk_root, std::string *arg) {
+  if (arg->find(kPlaceholderPrefix) == std::string::npos) {
+    return;
+  }
+  std::string result;
+  result.reserve(arg->size() + developer_dir.size() + sdk_root.size());
+  ReplacePlaceholders(arg->data(), arg->data() + arg->size(), developer_dir,
+                      sdk_root, [&result](const char *data, size_t size) {
+                        result.append(data, size);
+                      });
+  arg->swap(result);
+}
+
+// If the params file at path contains placeholders, writes a copy of it with
+// the placeholders replaced to a new temporary file, stores that file's path
+// in rewritten_path and returns true. The params file is mapped and streamed
+// out in a single pass, so that the link of a large binary does not hold all
+// its arguments in memory. Returns false, leaving the params file to the tool,
+// if it has no placeholders or cannot be read.
+bool RewriteParamsFile(const std::string &path,
+                       const std::string &developer_dir,
+                       const std::string &sdk_root,
+                       std::string *rewritten_path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void *mapped = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  const char *begin = static_cast<const char *>(mapped);
+  const char *end = begin + st.st_size;
+  if (memmem(begin, st.st_size, kPlaceholderPrefix,
+             sizeof(kPlaceholderPrefix) - 1) == nullptr) {
+    munmap(mapped, st.st_size);
+    return false;
+  }
+
+  const char *tmpdir = getenv("TMPDIR");
+  std::string tmp_template =
+      std::string(tmpdir != nullptr && *tmpdir ? tmpdir : "/tmp") +
+      "/wrapped_clang_params.XXXXXX";
+  std::vector<char> tmp_path(tmp_template.begin(), tmp_template.end());
+  tmp_path.push_back('\0');
+  int out = mkstemp(tmp_path.data());
+  if (out < 0) {
+    std::cerr << "Error creating '" << tmp_template << "' to rewrite '" << path
+              << "'. " << strerror(errno) << "\n";
+    abort();
+  }
+  // Buffers the pieces into large writes.
+  std::string buffer;
+  auto flush = [&]() {
+    for (size_t written = 0; written < buffer.size();) {
+      ssize_t n = write(out, buffer.data() + written, buffer.size() - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        std::cerr << "Error writing '" << tmp_path.data() << "'. "
+                  << strerror(errno) << "\n";
+        unlink(tmp_path.data());
+        abort();
+      }
+      written += n;
+    }
+    buffer.clear();
+  };
+  ReplacePlaceholders(begin, end, developer_dir, sdk_root,
+                      [&](const char *data, size_t size) {
+                        buffer.append(data, size);
+                        if (buffer.size() >= 64 * 1024) {
+                          flush();
+                        }
+                      });
+  flush();
+  close(out);
+  munmap(mapped, st.st_size);
+  *rewritten_path = tmp_path.data();
+  return true;
 }
 
 // If arg is of the classic flag form "foo=bar", and flagname is 'foo', sets
@@ -172,9 +464,14 @@ int main(int argc, char *argv[]) {
   std::string developer_dir = GetMandatoryEnvVar("DEVELOPER_DIR");
   std::string sdk_root = GetMandatoryEnvVar("SDKROOT");
 
-  std::vector<std::string> processed_args = {"/usr/bin/xcrun", tool_name};
+  std::vector<std::string> processed_args =
+      XcrunToolCommand(tool_name, developer_dir, sdk_root);
+  processed_args.reserve(processed_args.size() + argc);
+  // Rewritten copies of params files, removed once the tool is done.
+  std::vector<std::string> temp_files;
 
   std::string linked_binary, dsym_path, dsym_bundle_zip, bitcode_symbol_map;
+  std::string dsym_num_threads;
   for (int i = 1; i < argc; i++) {
     std::string arg(argv[i]);
 
@@ -188,15 +485,24 @@ int main(int argc, char *argv[]) {
                             &dsym_bundle_zip)) {
       continue;
     }
+    if (SetArgIfFlagPresent(arg, "DSYM_HINT_NUM_THREADS", &dsym_num_threads)) {
+      continue;
+    }
     if (SetArgIfFlagPresent(arg, "BITCODE_TOUCH_SYMBOL_MAP",
                             &bitcode_symbol_map)) {
       // Touch bitcode_symbol_map.
       std::ofstream bitcode_symbol_map_file(bitcode_symbol_map);
       arg = bitcode_symbol_map;
     }
-    FindAndReplace("__BAZEL_XCODE_DEVELOPER_DIR__", developer_dir, &arg);
-    FindAndReplace("__BAZEL_XCODE_SDKROOT__", sdk_root, &arg);
-    processed_args.push_back(arg);
+    ReplacePlaceholdersInArg(developer_dir, sdk_root, &arg);
+    std::string rewritten_params;
+    if (arg.size() > 1 && arg[0] == '@' &&
+        RewriteParamsFile(arg.substr(1), developer_dir, sdk_root,
+                          &rewritten_params)) {
+      temp_files.push_back(rewritten_params);
+      arg = "@" + rewritten_params;
+    }
+    processed_args.push_back(std::move(arg));
   }
 
   // Check to see if we should postprocess with dsymutil.
@@ -222,16 +528,41 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (!postprocess) {
+  if (!postprocess && temp_files.empty()) {
     ExecProcess(processed_args);
     std::cerr << "ExecProcess should not return. Please fix!\n";
     abort();
   }
 
-  RunSubProcess(processed_args);
+  // The rewritten params files have to be removed after the tool, so it
+  // cannot replace this process.
+  int exit_code = RunSubProcessForExitCode(processed_args);
+  for (const std::string &temp_file : temp_files) {
+    unlink(temp_file.c_str());
+  }
+  if (!postprocess) {
+    return exit_code;
+  }
+  if (exit_code != 0) {
+    std::cerr << "Error in child process '" << processed_args[0] << "'. "
+              << exit_code << "\n";
+    abort();
+  }
 
-  std::vector<std::string> dsymutil_args = {"/usr/bin/xcrun", "dsymutil",
-                                            linked_binary, "-o", dsym_path};
+  std::vector<std::string> dsymutil_args =
+      XcrunToolCommand("dsymutil", developer_dir, sdk_root);
+  dsymutil_args.insert(dsymutil_args.end(), {linked_binary, "-o", dsym_path});
+  if (!dsym_num_threads.empty()) {
+    char *end;
+    long num_threads = strtol(dsym_num_threads.c_str(), &end, 10);
+    if (*end != '\0' || num_threads < 1) {
+      std::cerr << "Error in clang wrapper: DSYM_HINT_NUM_THREADS must be a "
+                   "positive number, got '"
+                << dsym_num_threads << "'\n";
+      abort();
+    }
+    dsymutil_args.push_back("--num-threads=" + dsym_num_threads);
+  }
 
   RunSubProcess(dsymutil_args);
 